@@ -0,0 +1,685 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+/*
+ * HTTP load generator
+ *
+ * Keeps a fixed number of keep-alive connections busy with GET requests
+ * and reports the throughput and the latency distribution.
+ *
+ * Without a rate every connection sends its next request as soon as the
+ * previous response arrived (closed loop). With a rate the requests are
+ * sent on a fixed schedule (open loop). The latency is then measured
+ * from the time a request should have been sent, so that a stalled
+ * server is not hidden by the requests the generator did not send in
+ * the meantime (coordinated omission).
+ *
+ * Usage: http_load [-t threads] [-c connections] [-d seconds] [-r rate] host port [path]
+ */
+
+#include <stdio.h> /* printf(), fprintf(), sprintf() */
+#include <stdlib.h> /* malloc(), calloc(), free(), strtod(), strtoul() */
+#include <string.h> /* strcmp(), strlen() */
+#include <vtm/core/buffer.h>
+#include <vtm/core/dataset.h>
+#include <vtm/core/error.h>
+#include <vtm/core/string.h>
+#include <vtm/net/socket.h>
+#include <vtm/net/socket_listener.h>
+#include <vtm/net/http/http.h>
+#include <vtm/net/http/http_parser.h>
+#include <vtm/util/thread.h>
+#include <vtm/util/time.h>
+
+#define BENCH_DEF_THREADS      2
+#define BENCH_DEF_CONNECTIONS  16
+#define BENCH_DEF_DURATION     10
+#define BENCH_EVENTS           64
+#define BENCH_READ_SIZE        16384
+#define BENCH_RECONNECT_DELAY  100000   /* microseconds */
+#define BENCH_MAX_WAIT         100      /* milliseconds */
+
+/*
+ * Latency histogram in microseconds with 64 linear sub-buckets per
+ * power of two, the relative error stays below 1.6 percent.
+ */
+#define BENCH_HIST_SUB_BITS    6
+#define BENCH_HIST_SUB         (1 << BENCH_HIST_SUB_BITS)
+#define BENCH_HIST_BUCKETS     (32 * BENCH_HIST_SUB)
+
+struct bench_cfg
+{
+	const char     *host;
+	unsigned int   port;
+	const char     *path;
+	unsigned int   threads;
+	unsigned int   connections;
+	unsigned int   duration;
+	double         rate;
+
+	char           *request;
+	size_t         request_len;
+};
+
+struct bench_worker;
+
+struct bench_con
+{
+	struct bench_worker     *w;
+	vtm_socket              *sock;
+	struct vtm_buf          recvbuf;
+	struct vtm_http_parser  parser;
+
+	bool                    connected;  /* at least one response received */
+	bool                    sending;
+	bool                    waiting;    /* request is not due yet */
+	size_t                  sent;
+
+	uint64_t                intended;   /* scheduled send time */
+	uint64_t                start;      /* actual send time */
+	uint64_t                retry;      /* earliest time for reconnecting */
+};
+
+struct bench_worker
+{
+	vtm_thread              *th;
+	vtm_socket_listener     *li;
+	struct bench_con        *cons;
+	unsigned int            con_count;
+	unsigned int            con_first;  /* global index of first connection */
+
+	uint64_t                interval;   /* per connection, zero in closed loop */
+	uint64_t                begin;
+	uint64_t                end;
+
+	uint64_t                requests;
+	uint64_t                bytes;
+	uint64_t                err_connect;
+	uint64_t                err_io;
+	uint64_t                err_status;
+	uint64_t                hist[BENCH_HIST_BUCKETS];
+};
+
+static struct bench_cfg cfg;
+
+static unsigned int bench_hist_index(uint64_t val)
+{
+	unsigned int shift;
+	unsigned int idx;
+
+	if (val < 2 * BENCH_HIST_SUB)
+		return (unsigned int) val;
+
+	shift = 0;
+	while ((val >> shift) >= 2 * BENCH_HIST_SUB)
+		shift++;
+
+	idx = (shift + 1) * BENCH_HIST_SUB + (unsigned int) (val >> shift) - BENCH_HIST_SUB;
+
+	return idx < BENCH_HIST_BUCKETS ? idx : BENCH_HIST_BUCKETS - 1;
+}
+
+static uint64_t bench_hist_value(unsigned int idx)
+{
+	unsigned int shift;
+
+	if (idx < 2 * BENCH_HIST_SUB)
+		return idx;
+
+	/* upper bound of the bucket */
+	shift = idx / BENCH_HIST_SUB - 1;
+	return (((uint64_t) (idx % BENCH_HIST_SUB + BENCH_HIST_SUB)) << shift) + ((1ULL << shift) - 1);
+}
+
+static uint64_t bench_hist_percentile(const uint64_t *hist, uint64_t count, double p)
+{
+	unsigned int i;
+	uint64_t target, sum;
+
+	target = (uint64_t) (count * p / 100.0);
+	if (target == 0)
+		target = 1;
+
+	sum = 0;
+	for (i=0; i < BENCH_HIST_BUCKETS; i++) {
+		sum += hist[i];
+		if (sum >= target)
+			return bench_hist_value(i);
+	}
+
+	return bench_hist_value(BENCH_HIST_BUCKETS - 1);
+}
+
+static int bench_con_watch(struct bench_con *con, unsigned int flag)
+{
+	vtm_socket_unset_state(con->sock, VTM_SOCK_STAT_NBL_READ | VTM_SOCK_STAT_NBL_WRITE);
+	vtm_socket_set_state(con->sock, flag);
+
+	return vtm_socket_listener_rearm(con->w->li, con->sock);
+}
+
+static void bench_con_close(struct bench_con *con)
+{
+	if (!con->sock)
+		return;
+
+	vtm_socket_listener_remove(con->w->li, con->sock);
+	vtm_socket_close(con->sock);
+	vtm_socket_free(con->sock);
+	con->sock = NULL;
+
+	if (con->parser.headers_free && con->parser.headers)
+		vtm_dataset_free(con->parser.headers);
+	vtm_http_parser_reset(&con->parser);
+	vtm_buf_clear(&con->recvbuf);
+}
+
+static int bench_con_open(struct bench_con *con)
+{
+	int rc;
+
+	con->sock = vtm_socket_new(VTM_SOCK_FAM_IN4, VTM_SOCK_TYPE_STREAM);
+	if (!con->sock)
+		return vtm_err_get_code();
+
+	vtm_socket_set_usr_data(con->sock, con);
+	con->connected = false;
+	con->sending = true;
+	con->sent = 0;
+
+	rc = vtm_socket_set_opt(con->sock, VTM_SOCK_OPT_NONBLOCKING, (bool[]) {true}, sizeof(bool));
+	if (rc != VTM_OK)
+		goto err;
+
+	vtm_socket_set_opt(con->sock, VTM_SOCK_OPT_TCP_NODELAY, (bool[]) {true}, sizeof(bool));
+
+	/* request is sent as soon as the connection is established */
+	rc = vtm_socket_connect(con->sock, cfg.host, cfg.port);
+	if (rc != VTM_OK && rc != VTM_E_IO_AGAIN)
+		goto err;
+
+	vtm_socket_set_state(con->sock, VTM_SOCK_STAT_NBL_WRITE);
+	rc = vtm_socket_listener_add(con->w->li, con->sock);
+	if (rc != VTM_OK)
+		goto err;
+
+	return VTM_OK;
+
+err:
+	vtm_socket_close(con->sock);
+	vtm_socket_free(con->sock);
+	con->sock = NULL;
+	return rc;
+}
+
+static void bench_con_fail(struct bench_con *con)
+{
+	struct bench_worker *w;
+
+	w = con->w;
+
+	/* pending request is sent again, its schedule is kept */
+	if (con->connected) {
+		w->err_io++;
+		bench_con_close(con);
+		if (bench_con_open(con) == VTM_OK)
+			return;
+	}
+	else {
+		bench_con_close(con);
+	}
+
+	w->err_connect++;
+	con->waiting = true;
+	con->retry = vtm_time_current_micros() + BENCH_RECONNECT_DELAY;
+}
+
+static void bench_con_send(struct bench_con *con)
+{
+	int rc;
+	size_t written;
+
+	while (con->sent < cfg.request_len) {
+		rc = vtm_socket_write(con->sock, cfg.request + con->sent, cfg.request_len - con->sent, &written);
+		con->sent += written;
+
+		if (rc == VTM_E_IO_AGAIN) {
+			if (bench_con_watch(con, VTM_SOCK_STAT_NBL_WRITE) != VTM_OK)
+				bench_con_fail(con);
+			return;
+		}
+
+		if (rc != VTM_OK) {
+			bench_con_fail(con);
+			return;
+		}
+	}
+
+	con->sending = false;
+	if (bench_con_watch(con, VTM_SOCK_STAT_NBL_READ) != VTM_OK)
+		bench_con_fail(con);
+}
+
+static void bench_con_start(struct bench_con *con, uint64_t now)
+{
+	con->waiting = false;
+	con->start = now;
+	con->sending = true;
+	con->sent = 0;
+
+	if (!con->sock) {
+		if (bench_con_open(con) != VTM_OK)
+			bench_con_fail(con);
+		return;
+	}
+
+	bench_con_send(con);
+}
+
+static void bench_con_complete(struct bench_con *con)
+{
+	uint64_t now, latency;
+	bool keep;
+	const char *val;
+	struct bench_worker *w;
+
+	w = con->w;
+	now = vtm_time_current_micros();
+
+	/* responses after the end are not counted */
+	if (now < w->end) {
+		latency = now - (w->interval > 0 ? con->intended : con->start);
+		w->hist[bench_hist_index(latency)]++;
+		w->requests++;
+		w->bytes += con->recvbuf.used;
+		if (con->parser.res_status_code < 200 || con->parser.res_status_code > 399)
+			w->err_status++;
+	}
+
+	keep = VTM_BUF_GET_AVAIL_TOTAL(&con->recvbuf) == 0;
+	if (con->parser.headers) {
+		val = vtm_dataset_get_string(con->parser.headers, VTM_HTTP_HEADER_CONNECTION);
+		if (val && vtm_str_casecmp(val, VTM_HTTP_VALUE_CLOSE) == 0)
+			keep = false;
+		if (con->parser.headers_free)
+			vtm_dataset_free(con->parser.headers);
+	}
+
+	con->connected = true;
+	vtm_http_parser_reset(&con->parser);
+	vtm_buf_clear(&con->recvbuf);
+
+	if (!keep)
+		bench_con_close(con);
+
+	if (now >= w->end)
+		return;
+
+	/* next request */
+	if (w->interval == 0) {
+		con->intended = now;
+		bench_con_start(con, now);
+		return;
+	}
+
+	con->intended += w->interval;
+	if (con->intended <= now)
+		bench_con_start(con, now);
+	else
+		con->waiting = true;
+}
+
+static void bench_con_recv(struct bench_con *con)
+{
+	int rc;
+	size_t read;
+	enum vtm_net_recv_stat stat;
+
+	while (true) {
+		rc = vtm_buf_ensure(&con->recvbuf, BENCH_READ_SIZE);
+		if (rc != VTM_OK) {
+			bench_con_fail(con);
+			return;
+		}
+
+		rc = vtm_socket_read(con->sock, VTM_BUF_PUT_PTR(&con->recvbuf),
+			VTM_BUF_PUT_AVAIL_TOTAL(&con->recvbuf), &read);
+		VTM_BUF_PUT_INC(&con->recvbuf, read);
+
+		if (rc == VTM_E_IO_AGAIN) {
+			if (bench_con_watch(con, VTM_SOCK_STAT_NBL_READ) != VTM_OK)
+				bench_con_fail(con);
+			return;
+		}
+
+		if (rc != VTM_OK) {
+			bench_con_fail(con);
+			return;
+		}
+
+		stat = vtm_http_parser_run(&con->parser, &con->recvbuf);
+		switch (stat) {
+			case VTM_NET_RECV_STAT_AGAIN:
+				continue;
+
+			case VTM_NET_RECV_STAT_COMPLETE:
+				bench_con_complete(con);
+				return;
+
+			default:
+				bench_con_fail(con);
+				return;
+		}
+	}
+}
+
+static unsigned long bench_worker_due(struct bench_worker *w, uint64_t now)
+{
+	unsigned int i;
+	uint64_t next, due;
+	struct bench_con *con;
+
+	next = w->end;
+	for (i=0; i < w->con_count; i++) {
+		con = &w->cons[i];
+		if (!con->waiting)
+			continue;
+
+		due = con->intended > con->retry ? con->intended : con->retry;
+		if (due <= now)
+			bench_con_start(con, now);
+		else if (due < next)
+			next = due;
+	}
+
+	if (next <= now)
+		return 0;
+
+	next = (next - now) / 1000;
+	return next < BENCH_MAX_WAIT ? (unsigned long) next : BENCH_MAX_WAIT;
+}
+
+static int bench_worker_run(void *arg)
+{
+	int rc;
+	unsigned int i;
+	size_t num_events;
+	uint64_t now;
+	unsigned long timeout;
+	struct vtm_socket_event *events;
+	struct bench_worker *w;
+	struct bench_con *con;
+
+	w = arg;
+
+	/* spread the schedule evenly over all connections */
+	for (i=0; i < w->con_count; i++) {
+		con = &w->cons[i];
+		con->waiting = true;
+		con->intended = w->begin;
+		if (w->interval > 0)
+			con->intended += (uint64_t) ((w->con_first + i) * 1000000.0 / cfg.rate);
+	}
+
+	rc = VTM_OK;
+	now = vtm_time_current_micros();
+
+	while (now < w->end) {
+		timeout = bench_worker_due(w, now);
+
+		rc = vtm_socket_listener_run_timeout(w->li, &events, &num_events, timeout);
+		if (rc != VTM_OK)
+			break;
+
+		for (i=0; i < num_events; i++) {
+			con = vtm_socket_get_usr_data(events[i].sock);
+			if (con->sending)
+				bench_con_send(con);
+			else
+				bench_con_recv(con);
+		}
+
+		now = vtm_time_current_micros();
+	}
+
+	for (i=0; i < w->con_count; i++)
+		bench_con_close(&w->cons[i]);
+
+	return rc;
+}
+
+static int bench_build_request(void)
+{
+	size_t len;
+
+	len = strlen(cfg.path) + strlen(cfg.host) + 64;
+	cfg.request = malloc(len);
+	if (!cfg.request) {
+		vtm_err_oom();
+		return vtm_err_get_code();
+	}
+
+	cfg.request_len = (size_t) sprintf(cfg.request,
+		"GET %s HTTP/1.1\r\nHost: %s:%u\r\n\r\n", cfg.path, cfg.host, cfg.port);
+
+	return VTM_OK;
+}
+
+static void bench_report(struct bench_worker *workers)
+{
+	unsigned int i, k;
+	uint64_t requests, bytes, err_connect, err_io, err_status, sum;
+	double secs, mean;
+	uint64_t *hist;
+
+	hist = workers[0].hist;
+	requests = bytes = err_connect = err_io = err_status = 0;
+	for (i=0; i < cfg.threads; i++) {
+		requests += workers[i].requests;
+		bytes += workers[i].bytes;
+		err_connect += workers[i].err_connect;
+		err_io += workers[i].err_io;
+		err_status += workers[i].err_status;
+		if (i > 0) {
+			for (k=0; k < BENCH_HIST_BUCKETS; k++)
+				hist[k] += workers[i].hist[k];
+		}
+	}
+
+	secs = cfg.duration;
+	printf("  Requests:    %llu in %us\n", (unsigned long long) requests, cfg.duration);
+	printf("  Throughput:  %.2f req/s, %.2f MB/s\n", requests / secs, bytes / secs / (1024 * 1024));
+	printf("  Errors:      connect %llu, io %llu, status %llu\n",
+		(unsigned long long) err_connect, (unsigned long long) err_io, (unsigned long long) err_status);
+
+	if (requests == 0)
+		return;
+
+	sum = 0;
+	for (k=0; k < BENCH_HIST_BUCKETS; k++)
+		sum += hist[k] * bench_hist_value(k);
+	mean = (double) sum / requests;
+
+	printf("  Latency%s:\n", cfg.rate > 0 ? " (corrected for coordinated omission)" : "");
+	printf("    mean     %10.3f ms\n", mean / 1000);
+	printf("    p50      %10.3f ms\n", bench_hist_percentile(hist, requests, 50) / 1000.0);
+	printf("    p90      %10.3f ms\n", bench_hist_percentile(hist, requests, 90) / 1000.0);
+	printf("    p99      %10.3f ms\n", bench_hist_percentile(hist, requests, 99) / 1000.0);
+	printf("    p99.9    %10.3f ms\n", bench_hist_percentile(hist, requests, 99.9) / 1000.0);
+	printf("    max      %10.3f ms\n", bench_hist_percentile(hist, requests, 100) / 1000.0);
+}
+
+static void bench_usage(void)
+{
+	fprintf(stderr, "Usage: http_load [-t threads] [-c connections] [-d seconds] [-r rate] host port [path]\n");
+	fprintf(stderr, "  -t  worker threads, default %u\n", BENCH_DEF_THREADS);
+	fprintf(stderr, "  -c  open connections, default %u\n", BENCH_DEF_CONNECTIONS);
+	fprintf(stderr, "  -d  duration in seconds, default %u\n", BENCH_DEF_DURATION);
+	fprintf(stderr, "  -r  requests per second of all connections, closed loop if omitted\n");
+}
+
+static bool bench_parse_args(int argc, char **argv)
+{
+	int i;
+	unsigned int pos;
+
+	cfg.threads = BENCH_DEF_THREADS;
+	cfg.connections = BENCH_DEF_CONNECTIONS;
+	cfg.duration = BENCH_DEF_DURATION;
+	cfg.rate = 0;
+	cfg.path = "/";
+
+	pos = 0;
+	for (i=1; i < argc; i++) {
+		if (argv[i][0] == '-') {
+			if (i + 1 >= argc)
+				return false;
+
+			if (strcmp(argv[i], "-t") == 0)
+				cfg.threads = (unsigned int) strtoul(argv[++i], NULL, 10);
+			else if (strcmp(argv[i], "-c") == 0)
+				cfg.connections = (unsigned int) strtoul(argv[++i], NULL, 10);
+			else if (strcmp(argv[i], "-d") == 0)
+				cfg.duration = (unsigned int) strtoul(argv[++i], NULL, 10);
+			else if (strcmp(argv[i], "-r") == 0)
+				cfg.rate = strtod(argv[++i], NULL);
+			else
+				return false;
+			continue;
+		}
+
+		switch (pos++) {
+			case 0:
+				cfg.host = argv[i];
+				break;
+
+			case 1:
+				cfg.port = (unsigned int) strtoul(argv[i], NULL, 10);
+				break;
+
+			case 2:
+				cfg.path = argv[i];
+				break;
+
+			default:
+				return false;
+		}
+	}
+
+	if (pos < 2 || cfg.threads == 0 || cfg.duration == 0 || cfg.rate < 0)
+		return false;
+
+	if (cfg.connections < cfg.threads)
+		cfg.connections = cfg.threads;
+
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	int rc;
+	unsigned int i, k, first;
+	uint64_t begin;
+	struct bench_worker *workers;
+	struct bench_con *cons;
+
+	if (!bench_parse_args(argc, argv)) {
+		bench_usage();
+		return EXIT_FAILURE;
+	}
+
+	rc = vtm_module_network_init();
+	if (rc != VTM_OK) {
+		vtm_err_print();
+		return EXIT_FAILURE;
+	}
+
+	rc = EXIT_FAILURE;
+
+	if (bench_build_request() != VTM_OK) {
+		vtm_err_print();
+		goto end;
+	}
+
+	workers = calloc(cfg.threads, sizeof(struct bench_worker));
+	cons = calloc(cfg.connections, sizeof(struct bench_con));
+	if (!workers || !cons) {
+		fprintf(stderr, "Out of memory\n");
+		goto free_mem;
+	}
+
+	if (cfg.rate > 0)
+		printf("Running %us test @ http://%s:%u%s\n  %u threads and %u connections, %.0f req/s\n",
+			cfg.duration, cfg.host, cfg.port, cfg.path, cfg.threads, cfg.connections, cfg.rate);
+	else
+		printf("Running %us test @ http://%s:%u%s\n  %u threads and %u connections, closed loop\n",
+			cfg.duration, cfg.host, cfg.port, cfg.path, cfg.threads, cfg.connections);
+	fflush(stdout);
+
+	/* distribute connections */
+	begin = vtm_time_current_micros();
+	first = 0;
+	for (i=0; i < cfg.threads; i++) {
+		workers[i].cons = cons + first;
+		workers[i].con_count = cfg.connections / cfg.threads + (i < cfg.connections % cfg.threads ? 1 : 0);
+		workers[i].con_first = first;
+		workers[i].interval = cfg.rate > 0 ? (uint64_t) (cfg.connections * 1000000.0 / cfg.rate) : 0;
+		workers[i].begin = begin;
+		workers[i].end = begin + cfg.duration * 1000000ULL;
+		first += workers[i].con_count;
+
+		for (k=0; k < workers[i].con_count; k++) {
+			workers[i].cons[k].w = &workers[i];
+			vtm_buf_init(&workers[i].cons[k].recvbuf, VTM_BYTEORDER_LE);
+			vtm_http_parser_init(&workers[i].cons[k].parser, VTM_HTTP_PM_RESPONSE);
+		}
+
+		workers[i].li = vtm_socket_listener_new(BENCH_EVENTS);
+		if (!workers[i].li) {
+			vtm_err_print();
+			goto free_workers;
+		}
+	}
+
+	for (i=0; i < cfg.threads; i++) {
+		workers[i].th = vtm_thread_new(bench_worker_run, &workers[i]);
+		if (!workers[i].th) {
+			vtm_err_print();
+			break;
+		}
+	}
+
+	rc = EXIT_SUCCESS;
+	for (i=0; i < cfg.threads; i++) {
+		if (!workers[i].th) {
+			rc = EXIT_FAILURE;
+			continue;
+		}
+		vtm_thread_join(workers[i].th);
+		if (vtm_thread_get_result(workers[i].th) != VTM_OK)
+			rc = EXIT_FAILURE;
+		vtm_thread_free(workers[i].th);
+	}
+
+	if (rc == EXIT_SUCCESS)
+		bench_report(workers);
+
+free_workers:
+	for (i=0; i < cfg.threads; i++) {
+		if (workers[i].li)
+			vtm_socket_listener_free(workers[i].li);
+		for (k=0; k < workers[i].con_count; k++)
+			vtm_buf_release(&workers[i].cons[k].recvbuf);
+	}
+
+free_mem:
+	free(cons);
+	free(workers);
+	free(cfg.request);
+
+end:
+	vtm_module_network_end();
+
+	return rc;
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+/*
+ * UTF-8 validation throughput
+ *
+ * Validates ASCII, Latin, CJK and emoji text of typical message sizes
+ * and compares the throughput of the library with a plain byte by byte
+ * decoder. The text is built from repeated words, so that every size
+ * contains the same mix of sequence lengths.
+ *
+ * Usage: utf8 [-m megabytes]
+ */
+
+#include <stdio.h> /* printf(), fprintf() */
+#include <stdlib.h> /* malloc(), free(), strtoul() */
+#include <string.h> /* strcmp(), strlen(), memcpy() */
+#include <vtm/core/utf8.h>
+#include <vtm/util/time.h>
+
+#define BENCH_DEF_MEGABYTES  1024
+#define BENCH_MAX_SIZE       1048576
+
+struct bench_text
+{
+	const char  *name;
+	const char  *word;
+};
+
+static const struct bench_text bench_texts[] = {
+	{"ascii",  "{\"symbol\":\"VTM\",\"bid\":10.25} "},
+	{"latin",  "Gr\xc3\xbc\xc3\x9f" "e aus K\xc3\xb6ln, \xc3\xa7" "a va tr\xc3\xa8s bien. "},
+	{"cjk",    "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae\xe3\x83\x86\xe3\x82\xad\xe3\x82\xb9\xe3\x83\x88 "},
+	{"emoji",  "ok \xf0\x9f\x98\x80\xf0\x9f\x9a\x80\xf0\x9f\x8e\x89 "}
+};
+
+static const size_t bench_sizes[] = {64, 1024, 65536, BENCH_MAX_SIZE};
+
+static bool bench_valid_bytewise(const void *src, size_t len)
+{
+	size_t i, k, n;
+	const unsigned char *p;
+	unsigned char lo, hi;
+
+	p = src;
+	for (i=0; i < len; i += n) {
+		lo = 0x80;
+		hi = 0xbf;
+
+		if (p[i] < 0x80) {
+			n = 1;
+			continue;
+		}
+		else if (p[i] >= 0xc2 && p[i] < 0xe0) {
+			n = 2;
+		}
+		else if (p[i] >= 0xe0 && p[i] < 0xf0) {
+			n = 3;
+			if (p[i] == 0xe0)
+				lo = 0xa0;
+			else if (p[i] == 0xed)
+				hi = 0x9f;
+		}
+		else if (p[i] >= 0xf0 && p[i] < 0xf5) {
+			n = 4;
+			if (p[i] == 0xf0)
+				lo = 0x90;
+			else if (p[i] == 0xf4)
+				hi = 0x8f;
+		}
+		else {
+			return false;
+		}
+
+		if (len - i < n)
+			return false;
+
+		for (k=1; k < n; k++) {
+			if (p[i+k] < lo || p[i+k] > hi)
+				return false;
+			lo = 0x80;
+			hi = 0xbf;
+		}
+	}
+
+	return true;
+}
+
+/* whole words only, so that the text stays valid */
+static size_t bench_fill(unsigned char *buf, size_t size, const char *word)
+{
+	size_t len, wlen;
+
+	len = 0;
+	wlen = strlen(word);
+	while (len + wlen <= size) {
+		memcpy(buf + len, word, wlen);
+		len += wlen;
+	}
+	while (len < size)
+		buf[len++] = ' ';
+
+	return len;
+}
+
+static double bench_run(bool (*fn)(const void*, size_t), const unsigned char *buf, size_t len,
+	uint64_t total, bool *valid)
+{
+	uint64_t i, rounds, begin, elapsed;
+
+	rounds = total / len;
+	if (rounds == 0)
+		rounds = 1;
+
+	*valid = true;
+	begin = vtm_time_current_micros();
+	for (i=0; i < rounds; i++)
+		*valid &= fn(buf, len);
+	elapsed = vtm_time_current_micros() - begin;
+
+	if (elapsed == 0)
+		elapsed = 1;
+
+	return (double) (rounds * len) / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+	size_t i, k, len;
+	unsigned long megabytes;
+	unsigned char *buf;
+	double ref, lib;
+	bool ref_valid, lib_valid;
+
+	megabytes = BENCH_DEF_MEGABYTES;
+	if (argc == 3 && strcmp(argv[1], "-m") == 0)
+		megabytes = strtoul(argv[2], NULL, 10);
+	else if (argc != 1)
+		megabytes = 0;
+
+	if (megabytes == 0) {
+		fprintf(stderr, "Usage: utf8 [-m megabytes]\n");
+		fprintf(stderr, "  -m  data validated per text and size, default %u\n", BENCH_DEF_MEGABYTES);
+		return EXIT_FAILURE;
+	}
+
+	buf = malloc(BENCH_MAX_SIZE);
+	if (!buf) {
+		fprintf(stderr, "Out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("%-6s %8s %14s %14s %8s\n", "text", "bytes", "bytewise MB/s", "library MB/s", "speedup");
+
+	for (i=0; i < sizeof(bench_texts) / sizeof(bench_texts[0]); i++) {
+		for (k=0; k < sizeof(bench_sizes) / sizeof(bench_sizes[0]); k++) {
+			len = bench_fill(buf, bench_sizes[k], bench_texts[i].word);
+
+			ref = bench_run(bench_valid_bytewise, buf, len, (uint64_t) megabytes << 20, &ref_valid);
+			lib = bench_run(vtm_utf8_is_valid, buf, len, (uint64_t) megabytes << 20, &lib_valid);
+
+			if (!ref_valid || !lib_valid) {
+				fprintf(stderr, "Validation failed: %s\n", bench_texts[i].name);
+				free(buf);
+				return EXIT_FAILURE;
+			}
+
+			printf("%-6s %8lu %14.0f %14.0f %7.1fx\n", bench_texts[i].name,
+				(unsigned long) len, ref, lib, lib / ref);
+		}
+	}
+
+	free(buf);
+
+	return EXIT_SUCCESS;
+}
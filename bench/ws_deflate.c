@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+/*
+ * WebSocket permessage-deflate cost
+ *
+ * Compresses a stream of small JSON messages as a server connection
+ * would send them and decompresses them on the client side. Prints
+ * the bytes saved against the CPU time per message for context
+ * takeover, no context takeover and different levels and windows,
+ * together with the memory held per connection.
+ *
+ * Usage: ws_deflate [-n messages]
+ */
+
+#include <stdio.h> /* printf(), fprintf(), snprintf() */
+#include <stdlib.h> /* malloc(), free(), strtoul() */
+#include <string.h> /* strcmp(), strlen(), memcmp() */
+#include <vtm/core/buffer.h>
+#include <vtm/core/error.h>
+#include <vtm/net/http/ws_deflate_intl.h>
+#include <vtm/util/time.h>
+
+#define BENCH_DEF_MESSAGES   100000
+#define BENCH_MSG_MAX        256
+#define BENCH_VARIANTS       1024
+
+struct bench_case
+{
+	const char    *name;
+	bool          no_context_takeover;
+	int           level;
+	unsigned int  bits;
+};
+
+static const struct bench_case bench_cases[] = {
+	{"context",      false, 1, 15},
+	{"context",      false, 6, 15},
+	{"context",      false, 9, 15},
+	{"context",      false, 6, 10},
+	{"no-context",   true,  1, 15},
+	{"no-context",   true,  6, 15},
+	{"no-context",   true,  6, 10}
+};
+
+static char *bench_msgs[BENCH_VARIANTS];
+static size_t bench_lens[BENCH_VARIANTS];
+
+static int bench_init_msgs(void)
+{
+	size_t i;
+	int len;
+
+	for (i=0; i < BENCH_VARIANTS; i++) {
+		bench_msgs[i] = malloc(BENCH_MSG_MAX);
+		if (!bench_msgs[i])
+			return VTM_E_MALLOC;
+
+		/* quote updates with changing numbers */
+		len = snprintf(bench_msgs[i], BENCH_MSG_MAX,
+			"{\"type\":\"quote\",\"seq\":%lu,\"symbol\":\"SYM%lu\",\"bid\":%lu.%02lu,"
+			"\"ask\":%lu.%02lu,\"volume\":%lu,\"exchange\":\"XNYS\",\"currency\":\"USD\"}",
+			(unsigned long) i, (unsigned long) (i % 50), (unsigned long) (100 + i % 7),
+			(unsigned long) (i * 13 % 100), (unsigned long) (100 + i % 7),
+			(unsigned long) (i * 17 % 100), (unsigned long) (i * 7919 % 100000));
+		bench_lens[i] = (size_t) len;
+	}
+
+	return VTM_OK;
+}
+
+static int bench_run(const struct bench_case *bc, unsigned long count)
+{
+	int rc;
+	unsigned long i;
+	size_t plain, comp_total, mem;
+	uint64_t begin, t_comp, t_decomp;
+	vtm_ws_deflate *srv, *cl;
+	struct vtm_ws_deflate_opts opts;
+	struct vtm_ws_deflate_params params;
+	struct vtm_buf comp, out;
+
+	memset(&opts, 0, sizeof(opts));
+	opts.enabled = true;
+	opts.level = bc->level;
+
+	params.server_no_context_takeover = bc->no_context_takeover;
+	params.client_no_context_takeover = bc->no_context_takeover;
+	params.server_max_window_bits = bc->bits;
+	params.client_max_window_bits = bc->bits;
+
+	srv = vtm_ws_deflate_new(VTM_WS_MODE_SERVER, &params, &opts);
+	cl = vtm_ws_deflate_new(VTM_WS_MODE_CLIENT, &params, &opts);
+	if (!srv || !cl) {
+		vtm_ws_deflate_free(srv);
+		vtm_ws_deflate_free(cl);
+		return VTM_ERROR;
+	}
+
+	vtm_buf_init(&comp, VTM_BYTEORDER_LE);
+	vtm_buf_init(&out, VTM_BYTEORDER_LE);
+
+	rc = VTM_OK;
+	plain = 0;
+	comp_total = 0;
+	t_comp = 0;
+	t_decomp = 0;
+	mem = 0;
+
+	for (i=0; i < count && rc == VTM_OK; i++) {
+		vtm_buf_clear(&comp);
+		vtm_buf_clear(&out);
+
+		begin = vtm_time_current_micros();
+		rc = vtm_ws_deflate_compress(srv, bench_msgs[i % BENCH_VARIANTS],
+			bench_lens[i % BENCH_VARIANTS], &comp);
+		t_comp += vtm_time_current_micros() - begin;
+		if (rc != VTM_OK)
+			break;
+
+		begin = vtm_time_current_micros();
+		rc = vtm_ws_deflate_decompress(cl, comp.data, comp.used, BENCH_MSG_MAX, &out);
+		t_decomp += vtm_time_current_micros() - begin;
+		if (rc != VTM_OK)
+			break;
+
+		if (out.used != bench_lens[i % BENCH_VARIANTS] ||
+			memcmp(out.data, bench_msgs[i % BENCH_VARIANTS], out.used) != 0) {
+			rc = VTM_ERROR;
+			break;
+		}
+
+		plain += bench_lens[i % BENCH_VARIANTS];
+		comp_total += comp.used;
+
+		if (i == 0)
+			mem = vtm_ws_deflate_get_mem_usage();
+	}
+
+	if (rc == VTM_OK) {
+		printf("%-11s %5d %4u %10.1f %9.1f%% %12.2f %12.2f %10lu\n",
+			bc->name, bc->level, bc->bits,
+			(double) plain / count, 100.0 - 100.0 * comp_total / plain,
+			(double) t_comp * 1000.0 / count, (double) t_decomp * 1000.0 / count,
+			(unsigned long) (mem / 1024));
+	}
+
+	vtm_buf_release(&comp);
+	vtm_buf_release(&out);
+	vtm_ws_deflate_free(srv);
+	vtm_ws_deflate_free(cl);
+
+	return rc;
+}
+
+int main(int argc, char **argv)
+{
+	size_t i;
+	unsigned long count;
+	int rc;
+
+	count = BENCH_DEF_MESSAGES;
+	if (argc == 3 && strcmp(argv[1], "-n") == 0)
+		count = strtoul(argv[2], NULL, 10);
+	else if (argc != 1)
+		count = 0;
+
+	if (count == 0) {
+		fprintf(stderr, "Usage: ws_deflate [-n messages]\n");
+		fprintf(stderr, "  -n  messages per configuration, default %u\n", BENCH_DEF_MESSAGES);
+		return EXIT_FAILURE;
+	}
+
+	rc = bench_init_msgs();
+	if (rc != VTM_OK) {
+		fprintf(stderr, "Out of memory\n");
+		goto end;
+	}
+
+	printf("%-11s %5s %4s %10s %10s %12s %12s %10s\n", "mode", "level", "bits",
+		"bytes/msg", "saved", "deflate ns", "inflate ns", "state KiB");
+
+	for (i=0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++) {
+		rc = bench_run(&bench_cases[i], count);
+		if (rc != VTM_OK) {
+			fprintf(stderr, "Benchmark failed: %s\n", vtm_err_get_msg());
+			break;
+		}
+	}
+
+end:
+	for (i=0; i < BENCH_VARIANTS; i++)
+		free(bench_msgs[i]);
+
+	return rc == VTM_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
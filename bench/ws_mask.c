@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+/*
+ * WebSocket masking throughput
+ *
+ * Unmasks payloads of typical frame sizes in place and compares the
+ * throughput of the library with a plain byte by byte loop. Buffers
+ * start one byte after an aligned address, so the unaligned head and
+ * tail handling is part of the measurement.
+ *
+ * Usage: ws_mask [-m megabytes]
+ */
+
+#include <stdio.h> /* printf(), fprintf() */
+#include <stdlib.h> /* malloc(), free(), strtoul() */
+#include <string.h> /* strcmp(), memset() */
+#include <vtm/net/http/ws_frame_intl.h>
+#include <vtm/util/time.h>
+
+#define BENCH_DEF_MEGABYTES  1024
+#define BENCH_MASK           0x37fa213dUL
+
+static const size_t bench_sizes[] = {16, 125, 1024, 16384, 1048576};
+
+static uint32_t bench_mask_bytewise(void *dst, size_t len, uint32_t mask)
+{
+	size_t i;
+	unsigned char *dst_uc;
+	unsigned char mask_uc[4];
+
+	dst_uc = dst;
+	for (i=0; i < 4; i++)
+		mask_uc[i] = (mask >> (24-8*i)) & 0xff;
+
+	for (i=0; i < len; i++)
+		dst_uc[i] = dst_uc[i] ^ mask_uc[i % 4];
+
+	return mask;
+}
+
+static double bench_run(uint32_t (*fn)(void*, size_t, uint32_t), unsigned char *buf, size_t len, uint64_t total)
+{
+	uint64_t i, rounds, begin, elapsed;
+
+	rounds = total / len;
+	if (rounds == 0)
+		rounds = 1;
+
+	begin = vtm_time_current_micros();
+	for (i=0; i < rounds; i++)
+		fn(buf, len, BENCH_MASK);
+	elapsed = vtm_time_current_micros() - begin;
+
+	if (elapsed == 0)
+		elapsed = 1;
+
+	return (double) (rounds * len) / elapsed;
+}
+
+int main(int argc, char **argv)
+{
+	size_t i, k;
+	unsigned long megabytes;
+	unsigned char *mem, *buf;
+	unsigned int sum;
+	double ref, lib;
+
+	megabytes = BENCH_DEF_MEGABYTES;
+	if (argc == 3 && strcmp(argv[1], "-m") == 0)
+		megabytes = strtoul(argv[2], NULL, 10);
+	else if (argc != 1)
+		megabytes = 0;
+
+	if (megabytes == 0) {
+		fprintf(stderr, "Usage: ws_mask [-m megabytes]\n");
+		fprintf(stderr, "  -m  data unmasked per frame size, default %u\n", BENCH_DEF_MEGABYTES);
+		return EXIT_FAILURE;
+	}
+
+	mem = malloc(bench_sizes[sizeof(bench_sizes) / sizeof(bench_sizes[0]) - 1] + 64);
+	if (!mem) {
+		fprintf(stderr, "Out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	buf = mem + 1;
+	memset(mem, 0x5a, bench_sizes[sizeof(bench_sizes) / sizeof(bench_sizes[0]) - 1] + 64);
+
+	printf("%10s %14s %14s %8s\n", "frame", "bytewise MB/s", "library MB/s", "speedup");
+	for (i=0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); i++) {
+		ref = bench_run(bench_mask_bytewise, buf, bench_sizes[i], megabytes * 1048576ULL);
+		lib = bench_run(vtm_ws_frame_mask_payload, buf, bench_sizes[i], megabytes * 1048576ULL);
+		printf("%10lu %14.0f %14.0f %7.1fx\n", (unsigned long) bench_sizes[i], ref, lib, lib / ref);
+	}
+
+	/* keeps the compiler from dropping the work */
+	sum = 0;
+	for (k=0; k < bench_sizes[0]; k++)
+		sum += buf[k];
+	printf("checksum %u\n", sum);
+
+	free(mem);
+
+	return EXIT_SUCCESS;
+}
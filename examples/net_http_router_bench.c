@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <vtm/core/error.h>
+#include <vtm/net/http/http_router.h>
+#include <vtm/util/time.h>
+
+#define LOOKUPS   1000000
+
+static int handle_rt(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
+{
+	return VTM_OK;
+}
+
+static int add_routes(vtm_http_router *rtr, unsigned int count)
+{
+	int rc;
+	unsigned int i;
+	char path[128];
+
+	for (i=0; i < count; i++) {
+		/* mix of static, parameter and wildcard routes */
+		switch (i % 4) {
+			case 0:
+				sprintf(path, "/api/v1/resource%u", i);
+				break;
+			case 1:
+				sprintf(path, "/api/v1/resource%u/:id", i);
+				break;
+			case 2:
+				sprintf(path, "/api/v1/resource%u/:id/items/:item", i);
+				break;
+			default:
+				sprintf(path, "/static/dir%u/*file", i);
+				break;
+		}
+
+		rc = vtm_http_router_static_rt(rtr, path, handle_rt);
+		if (rc != VTM_OK)
+			return rc;
+	}
+
+	return VTM_OK;
+}
+
+static void bench(unsigned int count)
+{
+	int rc;
+	vtm_http_router *rtr;
+	struct vtm_http_req req;
+	uint64_t begin, end;
+	unsigned int i;
+	char paths[4][128];
+
+	rtr = vtm_http_router_new();
+	if (!rtr) {
+		vtm_err_print();
+		return;
+	}
+
+	rc = add_routes(rtr, count);
+	if (rc != VTM_OK) {
+		vtm_err_print();
+		goto end;
+	}
+
+	/* lookup routes at the end of the table */
+	sprintf(paths[0], "/api/v1/resource%u", count - 4);
+	sprintf(paths[1], "/api/v1/resource%u/12345", count - 3);
+	sprintf(paths[2], "/api/v1/resource%u/12345/items/abc", count - 2);
+	sprintf(paths[3], "/static/dir%u/css/main.css", count - 1);
+
+	memset(&req, 0, sizeof(req));
+	req.method = VTM_HTTP_METHOD_GET;
+
+	begin = vtm_time_current_micros();
+	for (i=0; i < LOOKUPS; i++) {
+		req.path = paths[i % 4];
+		rc = vtm_http_router_handle(rtr, NULL, &req, NULL);
+		if (rc != VTM_OK) {
+			printf("Lookup failed: %s\n", req.path);
+			goto end;
+		}
+	}
+	end = vtm_time_current_micros();
+
+	printf("routes: %7u  lookups: %u  time: %8.3f ms  per lookup: %6.1f ns\n",
+		count, LOOKUPS, (end - begin) / 1000.0,
+		(end - begin) * 1000.0 / LOOKUPS);
+
+end:
+	vtm_http_router_free(rtr);
+}
+
+int main(void)
+{
+	bench(16);
+	bench(256);
+	bench(4096);
+	bench(65536);
+
+	return 0;
+}
@@ -0,0 +1,482 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include "utf8.h"
+
+#include <string.h> /* memcpy(), memset() */
+#include <vtm/core/lang.h>
+
+/* vector width is chosen at compile time, e.g. -mssse3 or -mavx2 */
+#if defined(__AVX2__)
+	#define VTM_UTF8_AVX2
+#endif
+
+#if defined(__SSSE3__) || defined(__AVX__)
+	#define VTM_UTF8_SSSE3
+	#include <immintrin.h>
+#elif defined(__aarch64__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+	#define VTM_UTF8_NEON
+	#include <arm_neon.h>
+#endif
+
+#if defined(VTM_UTF8_SSSE3) || defined(VTM_UTF8_NEON)
+	#define VTM_UTF8_VECTOR
+#endif
+
+/* shorter input does not pay for the setup */
+#define VTM_UTF8_MIN_VEC   16
+
+#define VTM_UTF8_ASCII_MASK   0x8080808080808080ULL
+
+/*
+ * Vector validation after Keiser and Lemire, "Validating UTF-8 in less
+ * than one instruction per byte". The high and low nibble of each byte
+ * and the high nibble of its successor select error classes from three
+ * 16 byte tables, a pair of bytes is invalid if a class is set in all
+ * three. Missing and unexpected third and fourth bytes are found by
+ * comparing the bytes two and three positions before with the leads.
+ */
+#define VTM_UTF8_TOO_SHORT    (1 << 0)   /* lead or ASCII after a lead */
+#define VTM_UTF8_TOO_LONG     (1 << 1)   /* continuation after ASCII */
+#define VTM_UTF8_OVERLONG_3   (1 << 2)
+#define VTM_UTF8_TOO_LARGE    (1 << 3)
+#define VTM_UTF8_SURROGATE    (1 << 4)
+#define VTM_UTF8_OVERLONG_2   (1 << 5)
+#define VTM_UTF8_TOO_LARGE_2  (1 << 6)   /* F4 90 and above */
+#define VTM_UTF8_OVERLONG_4   (1 << 6)
+#define VTM_UTF8_TWO_CONTS    (1 << 7)   /* only valid as third or fourth byte */
+#define VTM_UTF8_CARRY        (VTM_UTF8_TOO_SHORT | VTM_UTF8_TOO_LONG | VTM_UTF8_TWO_CONTS)
+
+#ifdef VTM_UTF8_VECTOR
+static const unsigned char vtm_utf8_byte1_high[16] = {
+	/* 0_______ ASCII */
+	VTM_UTF8_TOO_LONG, VTM_UTF8_TOO_LONG, VTM_UTF8_TOO_LONG, VTM_UTF8_TOO_LONG,
+	VTM_UTF8_TOO_LONG, VTM_UTF8_TOO_LONG, VTM_UTF8_TOO_LONG, VTM_UTF8_TOO_LONG,
+	/* 10______ continuation */
+	VTM_UTF8_TWO_CONTS, VTM_UTF8_TWO_CONTS, VTM_UTF8_TWO_CONTS, VTM_UTF8_TWO_CONTS,
+	/* 1100____ two byte lead */
+	VTM_UTF8_TOO_SHORT | VTM_UTF8_OVERLONG_2,
+	/* 1101____ two byte lead */
+	VTM_UTF8_TOO_SHORT,
+	/* 1110____ three byte lead */
+	VTM_UTF8_TOO_SHORT | VTM_UTF8_OVERLONG_3 | VTM_UTF8_SURROGATE,
+	/* 1111____ four byte lead */
+	VTM_UTF8_TOO_SHORT | VTM_UTF8_TOO_LARGE | VTM_UTF8_TOO_LARGE_2 | VTM_UTF8_OVERLONG_4
+};
+
+static const unsigned char vtm_utf8_byte1_low[16] = {
+	/* ____0000 */
+	VTM_UTF8_CARRY | VTM_UTF8_OVERLONG_3 | VTM_UTF8_OVERLONG_2 | VTM_UTF8_OVERLONG_4,
+	/* ____0001 */
+	VTM_UTF8_CARRY | VTM_UTF8_OVERLONG_2,
+	/* ____001_ */
+	VTM_UTF8_CARRY,
+	VTM_UTF8_CARRY,
+	/* ____0100 */
+	VTM_UTF8_CARRY | VTM_UTF8_TOO_LARGE,
+	/* ____0101 and above */
+	VTM_UTF8_CARRY | VTM_UTF8_TOO_LARGE | VTM_UTF8_TOO_LARGE_2,
+	VTM_UTF8_CARRY | VTM_UTF8_TOO_LARGE | VTM_UTF8_TOO_LARGE_2,
+	VTM_UTF8_CARRY | VTM_UTF8_TOO_LARGE | VTM_UTF8_TOO_LARGE_2,
+	VTM_UTF8_CARRY | VTM_UTF8_TOO_LARGE | VTM_UTF8_TOO_LARGE_2,
+	VTM_UTF8_CARRY | VTM_UTF8_TOO_LARGE | VTM_UTF8_TOO_LARGE_2,
+	VTM_UTF8_CARRY | VTM_UTF8_TOO_LARGE | VTM_UTF8_TOO_LARGE_2,
+	VTM_UTF8_CARRY | VTM_UTF8_TOO_LARGE | VTM_UTF8_TOO_LARGE_2,
+	VTM_UTF8_CARRY | VTM_UTF8_TOO_LARGE | VTM_UTF8_TOO_LARGE_2,
+	/* ____1101 */
+	VTM_UTF8_CARRY | VTM_UTF8_TOO_LARGE | VTM_UTF8_TOO_LARGE_2 | VTM_UTF8_SURROGATE,
+	VTM_UTF8_CARRY | VTM_UTF8_TOO_LARGE | VTM_UTF8_TOO_LARGE_2,
+	VTM_UTF8_CARRY | VTM_UTF8_TOO_LARGE | VTM_UTF8_TOO_LARGE_2
+};
+
+static const unsigned char vtm_utf8_byte2_high[16] = {
+	/* 0_______ ASCII */
+	VTM_UTF8_TOO_SHORT, VTM_UTF8_TOO_SHORT, VTM_UTF8_TOO_SHORT, VTM_UTF8_TOO_SHORT,
+	VTM_UTF8_TOO_SHORT, VTM_UTF8_TOO_SHORT, VTM_UTF8_TOO_SHORT, VTM_UTF8_TOO_SHORT,
+	/* 1000____ */
+	VTM_UTF8_TOO_LONG | VTM_UTF8_OVERLONG_2 | VTM_UTF8_TWO_CONTS |
+		VTM_UTF8_OVERLONG_3 | VTM_UTF8_TOO_LARGE_2 | VTM_UTF8_OVERLONG_4,
+	/* 1001____ */
+	VTM_UTF8_TOO_LONG | VTM_UTF8_OVERLONG_2 | VTM_UTF8_TWO_CONTS |
+		VTM_UTF8_OVERLONG_3 | VTM_UTF8_TOO_LARGE,
+	/* 101_____ */
+	VTM_UTF8_TOO_LONG | VTM_UTF8_OVERLONG_2 | VTM_UTF8_TWO_CONTS |
+		VTM_UTF8_SURROGATE | VTM_UTF8_TOO_LARGE,
+	VTM_UTF8_TOO_LONG | VTM_UTF8_OVERLONG_2 | VTM_UTF8_TWO_CONTS |
+		VTM_UTF8_SURROGATE | VTM_UTF8_TOO_LARGE,
+	/* 11______ lead */
+	VTM_UTF8_TOO_SHORT, VTM_UTF8_TOO_SHORT, VTM_UTF8_TOO_SHORT, VTM_UTF8_TOO_SHORT
+};
+
+/* a lead in the last three bytes of a block needs the next block */
+static const unsigned char vtm_utf8_incomplete_max[32] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xf0 - 1, 0xe0 - 1, 0xc0 - 1
+};
+#endif
+
+/* forward declaration */
+static bool vtm_utf8_check(const unsigned char *p, size_t len);
+static bool vtm_utf8_check_scalar(const unsigned char *p, const unsigned char *end);
+static int vtm_utf8_seq(const unsigned char *p, size_t avail);
+static size_t vtm_utf8_incomplete_tail(const unsigned char *p, size_t len);
+
+bool vtm_utf8_is_valid(const void *src, size_t len)
+{
+	return vtm_utf8_check(src, len);
+}
+
+void vtm_utf8_init(struct vtm_utf8_state *st)
+{
+	st->pending_len = 0;
+}
+
+bool vtm_utf8_validate(struct vtm_utf8_state *st, const void *src, size_t len, bool last)
+{
+	int n;
+	size_t tail;
+	const unsigned char *p, *end;
+
+	p = src;
+	end = p + len;
+
+	/* complete the sequence split by the previous part */
+	while (st->pending_len > 0 && p < end) {
+		st->pending[st->pending_len++] = *p++;
+		n = vtm_utf8_seq(st->pending, st->pending_len);
+		if (n == 0)
+			return false;
+		if (n > 0)
+			st->pending_len = 0;
+	}
+
+	if (st->pending_len > 0)
+		return !last;
+
+	/* a sequence at the end may continue in the next part */
+	tail = last ? 0 : vtm_utf8_incomplete_tail(p, end - p);
+	if (!vtm_utf8_check(p, (end - p) - tail))
+		return false;
+
+	memcpy(st->pending, end - tail, tail);
+	st->pending_len = (unsigned int) tail;
+
+	return true;
+}
+
+#if defined(VTM_UTF8_AVX2)
+
+#define VTM_UTF8_PREV256(IN, PREV, N) \
+	_mm256_alignr_epi8(IN, _mm256_permute2x128_si256(PREV, IN, 0x21), 16 - (N))
+
+static VTM_INLINE __m256i vtm_utf8_block(__m256i input, __m256i prev, __m256i t1, __m256i t2, __m256i t3)
+{
+	__m256i prev1, nibbles, sc, must23;
+
+	nibbles = _mm256_set1_epi8(0x0f);
+	prev1 = VTM_UTF8_PREV256(input, prev, 1);
+
+	sc = _mm256_shuffle_epi8(t1, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibbles));
+	sc = _mm256_and_si256(sc, _mm256_shuffle_epi8(t2, _mm256_and_si256(prev1, nibbles)));
+	sc = _mm256_and_si256(sc, _mm256_shuffle_epi8(t3, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibbles)));
+
+	/* third and fourth bytes must be continuations, they carry no class */
+	must23 = _mm256_or_si256(
+		_mm256_subs_epu8(VTM_UTF8_PREV256(input, prev, 2), _mm256_set1_epi8((char) (0xe0 - 0x80))),
+		_mm256_subs_epu8(VTM_UTF8_PREV256(input, prev, 3), _mm256_set1_epi8((char) (0xf0 - 0x80))));
+	must23 = _mm256_and_si256(must23, _mm256_set1_epi8((char) 0x80));
+
+	return _mm256_xor_si256(must23, sc);
+}
+
+static bool vtm_utf8_check(const unsigned char *p, size_t len)
+{
+	const unsigned char *end;
+	unsigned char pad[32];
+	__m256i t1, t2, t3, max, input, prev, incomplete, error;
+
+	if (len < VTM_UTF8_MIN_VEC)
+		return vtm_utf8_check_scalar(p, p + len);
+
+	end = p + len;
+	t1 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) vtm_utf8_byte1_high));
+	t2 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) vtm_utf8_byte1_low));
+	t3 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) vtm_utf8_byte2_high));
+	max = _mm256_loadu_si256((const __m256i*) vtm_utf8_incomplete_max);
+
+	prev = _mm256_setzero_si256();
+	incomplete = _mm256_setzero_si256();
+	error = _mm256_setzero_si256();
+
+	while (p < end) {
+		if (end - p >= 32) {
+			input = _mm256_loadu_si256((const __m256i*) p);
+		}
+		else {
+			/* zero padding ends a sequence like ASCII would */
+			memset(pad, 0, sizeof(pad));
+			memcpy(pad, p, end - p);
+			input = _mm256_loadu_si256((const __m256i*) pad);
+		}
+		p += 32;
+
+		if (_mm256_movemask_epi8(input) == 0) {
+			error = _mm256_or_si256(error, incomplete);
+			incomplete = _mm256_setzero_si256();
+		}
+		else {
+			error = _mm256_or_si256(error, vtm_utf8_block(input, prev, t1, t2, t3));
+			incomplete = _mm256_subs_epu8(input, max);
+		}
+		prev = input;
+	}
+
+	error = _mm256_or_si256(error, incomplete);
+
+	return _mm256_testz_si256(error, error) != 0;
+}
+
+#elif defined(VTM_UTF8_SSSE3)
+
+static VTM_INLINE __m128i vtm_utf8_block(__m128i input, __m128i prev, __m128i t1, __m128i t2, __m128i t3)
+{
+	__m128i prev1, nibbles, sc, must23;
+
+	nibbles = _mm_set1_epi8(0x0f);
+	prev1 = _mm_alignr_epi8(input, prev, 15);
+
+	sc = _mm_shuffle_epi8(t1, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibbles));
+	sc = _mm_and_si128(sc, _mm_shuffle_epi8(t2, _mm_and_si128(prev1, nibbles)));
+	sc = _mm_and_si128(sc, _mm_shuffle_epi8(t3, _mm_and_si128(_mm_srli_epi16(input, 4), nibbles)));
+
+	/* third and fourth bytes must be continuations, they carry no class */
+	must23 = _mm_or_si128(
+		_mm_subs_epu8(_mm_alignr_epi8(input, prev, 14), _mm_set1_epi8((char) (0xe0 - 0x80))),
+		_mm_subs_epu8(_mm_alignr_epi8(input, prev, 13), _mm_set1_epi8((char) (0xf0 - 0x80))));
+	must23 = _mm_and_si128(must23, _mm_set1_epi8((char) 0x80));
+
+	return _mm_xor_si128(must23, sc);
+}
+
+static bool vtm_utf8_check(const unsigned char *p, size_t len)
+{
+	const unsigned char *end;
+	unsigned char pad[16];
+	__m128i t1, t2, t3, max, input, prev, incomplete, error;
+
+	if (len < VTM_UTF8_MIN_VEC)
+		return vtm_utf8_check_scalar(p, p + len);
+
+	end = p + len;
+	t1 = _mm_loadu_si128((const __m128i*) vtm_utf8_byte1_high);
+	t2 = _mm_loadu_si128((const __m128i*) vtm_utf8_byte1_low);
+	t3 = _mm_loadu_si128((const __m128i*) vtm_utf8_byte2_high);
+	max = _mm_loadu_si128((const __m128i*) (vtm_utf8_incomplete_max + 16));
+
+	prev = _mm_setzero_si128();
+	incomplete = _mm_setzero_si128();
+	error = _mm_setzero_si128();
+
+	while (p < end) {
+		if (end - p >= 16) {
+			input = _mm_loadu_si128((const __m128i*) p);
+		}
+		else {
+			/* zero padding ends a sequence like ASCII would */
+			memset(pad, 0, sizeof(pad));
+			memcpy(pad, p, end - p);
+			input = _mm_loadu_si128((const __m128i*) pad);
+		}
+		p += 16;
+
+		if (_mm_movemask_epi8(input) == 0) {
+			error = _mm_or_si128(error, incomplete);
+			incomplete = _mm_setzero_si128();
+		}
+		else {
+			error = _mm_or_si128(error, vtm_utf8_block(input, prev, t1, t2, t3));
+			incomplete = _mm_subs_epu8(input, max);
+		}
+		prev = input;
+	}
+
+	error = _mm_or_si128(error, incomplete);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xffff;
+}
+
+#elif defined(VTM_UTF8_NEON)
+
+static VTM_INLINE uint8x16_t vtm_utf8_block(uint8x16_t input, uint8x16_t prev, uint8x16_t t1, uint8x16_t t2, uint8x16_t t3)
+{
+	uint8x16_t prev1, sc, must23;
+
+	prev1 = vextq_u8(prev, input, 15);
+
+	sc = vqtbl1q_u8(t1, vshrq_n_u8(prev1, 4));
+	sc = vandq_u8(sc, vqtbl1q_u8(t2, vandq_u8(prev1, vdupq_n_u8(0x0f))));
+	sc = vandq_u8(sc, vqtbl1q_u8(t3, vshrq_n_u8(input, 4)));
+
+	/* third and fourth bytes must be continuations, they carry no class */
+	must23 = vorrq_u8(
+		vqsubq_u8(vextq_u8(prev, input, 14), vdupq_n_u8(0xe0 - 0x80)),
+		vqsubq_u8(vextq_u8(prev, input, 13), vdupq_n_u8(0xf0 - 0x80)));
+	must23 = vandq_u8(must23, vdupq_n_u8(0x80));
+
+	return veorq_u8(must23, sc);
+}
+
+static bool vtm_utf8_check(const unsigned char *p, size_t len)
+{
+	const unsigned char *end;
+	unsigned char pad[16];
+	uint8x16_t t1, t2, t3, max, input, prev, incomplete, error;
+
+	if (len < VTM_UTF8_MIN_VEC)
+		return vtm_utf8_check_scalar(p, p + len);
+
+	end = p + len;
+	t1 = vld1q_u8(vtm_utf8_byte1_high);
+	t2 = vld1q_u8(vtm_utf8_byte1_low);
+	t3 = vld1q_u8(vtm_utf8_byte2_high);
+	max = vld1q_u8(vtm_utf8_incomplete_max + 16);
+
+	prev = vdupq_n_u8(0);
+	incomplete = vdupq_n_u8(0);
+	error = vdupq_n_u8(0);
+
+	while (p < end) {
+		if (end - p >= 16) {
+			input = vld1q_u8(p);
+		}
+		else {
+			/* zero padding ends a sequence like ASCII would */
+			memset(pad, 0, sizeof(pad));
+			memcpy(pad, p, end - p);
+			input = vld1q_u8(pad);
+		}
+		p += 16;
+
+		if (vmaxvq_u8(input) < 0x80) {
+			error = vorrq_u8(error, incomplete);
+			incomplete = vdupq_n_u8(0);
+		}
+		else {
+			error = vorrq_u8(error, vtm_utf8_block(input, prev, t1, t2, t3));
+			incomplete = vqsubq_u8(input, max);
+		}
+		prev = input;
+	}
+
+	error = vorrq_u8(error, incomplete);
+
+	return vmaxvq_u8(error) == 0;
+}
+
+#else
+
+static bool vtm_utf8_check(const unsigned char *p, size_t len)
+{
+	return vtm_utf8_check_scalar(p, p + len);
+}
+
+#endif
+
+static bool vtm_utf8_check_scalar(const unsigned char *p, const unsigned char *end)
+{
+	int n;
+	uint64_t word;
+
+	while (p < end) {
+		if (*p < 0x80) {
+			/* ASCII runs word by word, memcpy compiles to a plain load */
+			while (end - p >= 8) {
+				memcpy(&word, p, sizeof(word));
+				if (word & VTM_UTF8_ASCII_MASK)
+					break;
+				p += 8;
+			}
+			while (p < end && *p < 0x80)
+				p++;
+			continue;
+		}
+
+		n = vtm_utf8_seq(p, end - p);
+		if (n <= 0)
+			return false;
+		p += n;
+	}
+
+	return true;
+}
+
+/*
+ * Gets the length of the sequence beginning at p as in Table 3-7 of
+ * the Unicode standard. Returns 0 if it is invalid and -1 if the
+ * available bytes are a valid but incomplete beginning.
+ */
+static int vtm_utf8_seq(const unsigned char *p, size_t avail)
+{
+	int i, n;
+	unsigned char c, lo, hi;
+
+	c = p[0];
+	if (c < 0x80)
+		return 1;
+
+	lo = 0x80;
+	hi = 0xbf;
+
+	if (c < 0xc2) {
+		return 0;
+	}
+	else if (c < 0xe0) {
+		n = 2;
+	}
+	else if (c < 0xf0) {
+		n = 3;
+		if (c == 0xe0)
+			lo = 0xa0;
+		else if (c == 0xed)
+			hi = 0x9f;
+	}
+	else if (c < 0xf5) {
+		n = 4;
+		if (c == 0xf0)
+			lo = 0x90;
+		else if (c == 0xf4)
+			hi = 0x8f;
+	}
+	else {
+		return 0;
+	}
+
+	for (i=1; i < n; i++) {
+		if ((size_t) i >= avail)
+			return -1;
+		if (p[i] < lo || p[i] > hi)
+			return 0;
+		lo = 0x80;
+		hi = 0xbf;
+	}
+
+	return n;
+}
+
+/* number of trailing bytes that begin a valid but incomplete sequence */
+static size_t vtm_utf8_incomplete_tail(const unsigned char *p, size_t len)
+{
+	size_t k;
+
+	for (k=1; k <= 3 && k <= len; k++) {
+		if (p[len-k] < 0x80)
+			return 0;
+		if (p[len-k] >= 0xc0)
+			return vtm_utf8_seq(p + len - k, k) < 0 ? k : 0;
+	}
+
+	return 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+/**
+ * @file utf8.h
+ *
+ * @brief UTF-8 validation
+ *
+ * Checks that data is well-formed UTF-8 as defined by Unicode, which
+ * excludes overlong encodings, surrogates and code points beyond
+ * U+10FFFF. Text received from the network like WebSocket text
+ * messages, JSON documents or HTTP bodies can be checked before it is
+ * processed further.
+ *
+ * With SSSE3, AVX2 or NEON on AArch64 enabled at compile time the
+ * input is validated with vector table lookups, otherwise ASCII is
+ * skipped word by word.
+ */
+
+#ifndef VTM_CORE_UTF8_H_
+#define VTM_CORE_UTF8_H_
+
+#include <vtm/core/api.h>
+#include <vtm/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** State of an incremental validation, e.g. across message fragments */
+struct vtm_utf8_state
+{
+	unsigned char  pending[4];    /**< begin of a sequence split by the input */
+	unsigned int   pending_len;
+};
+
+/**
+ * Checks whether the input is complete and well-formed UTF-8.
+ *
+ * @param src the input data
+ * @param len the length of the input in bytes
+ * @return true if the input is valid UTF-8
+ */
+VTM_API bool vtm_utf8_is_valid(const void *src, size_t len);
+
+/**
+ * Initializes the state for an incremental validation.
+ *
+ * @param st the state
+ */
+VTM_API void vtm_utf8_init(struct vtm_utf8_state *st);
+
+/**
+ * Validates the next part of the input.
+ *
+ * A multibyte sequence may be split between two parts, its beginning
+ * is kept in the state. Validation stops at the first invalid part,
+ * the state must be initialized again before it can be reused.
+ *
+ * @param st the state
+ * @param src the next part of the input
+ * @param len the length of the part in bytes
+ * @param last true if this part ends the input
+ * @return true if the input is valid UTF-8 so far, with last set
+ *         if the whole input is valid
+ */
+VTM_API bool vtm_utf8_validate(struct vtm_utf8_state *st, const void *src, size_t len, bool last);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_CORE_UTF8_H_ */
@@ -22,6 +22,14 @@ extern "C" {
 #define VTM_FILE_ATTR_REG       1  /**< regular file */
 #define VTM_FILE_ATTR_DIR       2  /**< directory */
 
+/** File information */
+struct vtm_file_info
+{
+	int       attr;   /**< attributes, see VTM_FILE_ATTR_ macros */
+	uint64_t  size;   /**< size in bytes */
+	uint64_t  mtime;  /**< last modification, seconds since 1970-01-01 UTC */
+};
+
 /**
  * Determines the file size.
  *
@@ -29,6 +37,16 @@ extern "C" {
  */
 VTM_API uint64_t vtm_file_get_fsize(FILE *fp);
 
+/**
+ * Sets the file position indicator to the given absolute offset.
+ *
+ * @param fp the file stream
+ * @param offset the offset in bytes from the beginning of the file
+ * @return VTM_OK if the position was set successfully
+ * @return VTM_E_IO_UNKNOWN if an error occured
+ */
+VTM_API int vtm_file_seek(FILE *fp, uint64_t offset);
+
 /**
  * Reads one line delimited by \\n from file.
  *
@@ -62,6 +80,27 @@ VTM_API const char* vtm_file_get_ext(const char *filename);
  */
 VTM_API int vtm_file_get_fattr(FILE *fp, int *attr);
 
+/**
+ * Reads the attributes, size and modification time of given file.
+ *
+ * @param fp the file where to read from
+ * @param[out] info the information is stored here
+ * @return VTM_OK if the information was read successfully
+ * @return VTM_E_IO_UNKNOWN if an error occured
+ */
+VTM_API int vtm_file_get_finfo(FILE *fp, struct vtm_file_info *info);
+
+/**
+ * Reads the attributes, size and modification time of the file
+ * with given path.
+ *
+ * @param path the path of the file
+ * @param[out] info the information is stored here
+ * @return VTM_OK if the information was read successfully
+ * @return VTM_E_IO_UNKNOWN if an error occured
+ */
+VTM_API int vtm_file_get_finfo_path(const char *path, struct vtm_file_info *info);
+
 #ifdef __cplusplus
 }
 #endif
@@ -14,6 +14,7 @@
 const char* VTM_HTTP_VERSIONS[] = {
 	"HTTP/1.0",
 	"HTTP/1.1",
+	"HTTP/2",
 	NULL
 };
 
@@ -27,6 +28,9 @@ const char* vtm_http_get_version_string(enum vtm_http_version ver)
 		case VTM_HTTP_VER_1_1:
 			return VTM_HTTP_VERSIONS[1];
 
+		case VTM_HTTP_VER_2:
+			return VTM_HTTP_VERSIONS[2];
+
 		default:
 			break;
 	}
@@ -60,8 +64,8 @@ const char* VTM_HTTP_METHODS[] = {
 	"HEAD",
 	"PUT",
 	"PATCH",
-	"DELETE"
-	"TRACE"
+	"DELETE",
+	"TRACE",
 	"OPTIONS",
 	"CONNECT",
 	NULL
@@ -96,6 +100,7 @@ static const char* const VTM_HTTP_PHRASE_102 = "Processing";
 
 /* 2xx success */
 static const char* const VTM_HTTP_PHRASE_200 = "OK";
+static const char* const VTM_HTTP_PHRASE_206 = "Partial content";
 
 /* 3xx redirect */
 static const char* const VTM_HTTP_PHRASE_300 = "Multiple Choices";
@@ -115,6 +120,8 @@ static const char* const VTM_HTTP_PHRASE_402 = "Reserved";
 static const char* const VTM_HTTP_PHRASE_403 = "Forbidden";
 static const char* const VTM_HTTP_PHRASE_404 = "Not found";
 static const char* const VTM_HTTP_PHRASE_405 = "Method not allowed";
+static const char* const VTM_HTTP_PHRASE_416 = "Range not satisfiable";
+static const char* const VTM_HTTP_PHRASE_429 = "Too many requests";
 
 /* 5xx server error */
 static const char* const VTM_HTTP_PHRASE_500 = "Internal server error";
@@ -132,6 +139,7 @@ const char* vtm_http_get_status_phrase(int code)
 		case VTM_HTTP_102_PROCESSING:               return VTM_HTTP_PHRASE_102;
 
 		case VTM_HTTP_200_OK:                       return VTM_HTTP_PHRASE_200;
+		case VTM_HTTP_206_PARTIAL_CONTENT:          return VTM_HTTP_PHRASE_206;
 
 		case VTM_HTTP_300_MULTIPLE_CHOICES:         return VTM_HTTP_PHRASE_300;
 		case VTM_HTTP_301_MOVED_PERMANENTLY:        return VTM_HTTP_PHRASE_301;
@@ -149,6 +157,8 @@ const char* vtm_http_get_status_phrase(int code)
 		case VTM_HTTP_403_FORBIDDEN:                return VTM_HTTP_PHRASE_403;
 		case VTM_HTTP_404_NOT_FOUND:                return VTM_HTTP_PHRASE_404;
 		case VTM_HTTP_405_METHOD_NOT_ALLOWED:       return VTM_HTTP_PHRASE_405;
+		case VTM_HTTP_416_RANGE_NOT_SATISFIABLE:    return VTM_HTTP_PHRASE_416;
+		case VTM_HTTP_429_TOO_MANY_REQUESTS:        return VTM_HTTP_PHRASE_429;
 
 		case VTM_HTTP_500_INTERNAL_SERVER_ERROR:    return VTM_HTTP_PHRASE_500;
 		case VTM_HTTP_501_NOT_IMPLEMENTED:          return VTM_HTTP_PHRASE_501;
@@ -163,28 +173,52 @@ const char* vtm_http_get_status_phrase(int code)
 
 /* ########## HEADER FIELDS ########## */
 
+const char* const VTM_HTTP_HEADER_ACCEPT_ENCODING = "Accept-Encoding";
+const char* const VTM_HTTP_HEADER_ACCEPT_RANGES = "Accept-Ranges";
+const char* const VTM_HTTP_HEADER_AGE = "Age";
 const char* const VTM_HTTP_HEADER_AUTHORIZATION = "Authorization";
+const char* const VTM_HTTP_HEADER_CACHE_CONTROL = "Cache-Control";
 const char* const VTM_HTTP_HEADER_CONNECTION = "Connection";
+const char* const VTM_HTTP_HEADER_CONTENT_ENCODING = "Content-Encoding";
 const char* const VTM_HTTP_HEADER_CONTENT_LENGTH = "Content-Length";
+const char* const VTM_HTTP_HEADER_CONTENT_RANGE = "Content-Range";
 const char* const VTM_HTTP_HEADER_CONTENT_TYPE = "Content-Type";
 const char* const VTM_HTTP_HEADER_DATE = "Date";
+const char* const VTM_HTTP_HEADER_ETAG = "ETag";
+const char* const VTM_HTTP_HEADER_EXPECT = "Expect";
 const char* const VTM_HTTP_HEADER_EXPIRES = "Expires";
 const char* const VTM_HTTP_HEADER_HOST = "Host";
+const char* const VTM_HTTP_HEADER_HTTP2_SETTINGS = "HTTP2-Settings";
+const char* const VTM_HTTP_HEADER_IF_MODIFIED_SINCE = "If-Modified-Since";
+const char* const VTM_HTTP_HEADER_IF_NONE_MATCH = "If-None-Match";
+const char* const VTM_HTTP_HEADER_IF_RANGE = "If-Range";
+const char* const VTM_HTTP_HEADER_LAST_MODIFIED = "Last-Modified";
+const char* const VTM_HTTP_HEADER_RANGE = "Range";
+const char* const VTM_HTTP_HEADER_RETRY_AFTER = "Retry-After";
 const char* const VTM_HTTP_HEADER_SERVER = "Server";
+const char* const VTM_HTTP_HEADER_SET_COOKIE = "Set-Cookie";
 const char* const VTM_HTTP_HEADER_TRANSFER_ENCODING = "Transfer-Encoding";
 const char* const VTM_HTTP_HEADER_UPGRADE = "Upgrade";
 const char* const VTM_HTTP_HEADER_USER_AGENT = "User-Agent";
+const char* const VTM_HTTP_HEADER_VARY = "Vary";
 const char* const VTM_HTTP_HEADER_WWW_AUTHENTICATE = "WWW-Authenticate";
 
 const char* const VTM_HTTP_HEADER_SEC_WEBSOCKET_ACCEPT = "Sec-WebSocket-Accept";
+const char* const VTM_HTTP_HEADER_SEC_WEBSOCKET_EXTENSIONS = "Sec-WebSocket-Extensions";
 const char* const VTM_HTTP_HEADER_SEC_WEBSOCKET_KEY = "Sec-WebSocket-Key";
 const char* const VTM_HTTP_HEADER_SEC_WEBSOCKET_PROTOCOL = "Sec-WebSocket-Protocol";
 const char* const VTM_HTTP_HEADER_SEC_WEBSOCKET_VERSION = "Sec-WebSocket-Version";
 
 /* ########## HEADER VALUES ########## */
 
+const char* const VTM_HTTP_VALUE_100_CONTINUE = "100-continue";
+const char* const VTM_HTTP_VALUE_BR = "br";
+const char* const VTM_HTTP_VALUE_BYTES = "bytes";
 const char* const VTM_HTTP_VALUE_CHUNKED = "chunked";
 const char* const VTM_HTTP_VALUE_CLOSE = "close";
+const char* const VTM_HTTP_VALUE_DEFLATE = "deflate";
+const char* const VTM_HTTP_VALUE_GZIP = "gzip";
+const char* const VTM_HTTP_VALUE_H2C = "h2c";
 const char* const VTM_HTTP_VALUE_IDENTITY = "identity";
 const char* const VTM_HTTP_VALUE_KEEP_ALIVE = "keep-alive";
 const char* const VTM_HTTP_VALUE_UPGRADE = "Upgrade";
@@ -17,7 +17,8 @@ extern "C" {
 enum vtm_http_version
 {
 	VTM_HTTP_VER_1_0,
-	VTM_HTTP_VER_1_1
+	VTM_HTTP_VER_1_1,
+	VTM_HTTP_VER_2
 };
 
 VTM_API extern const char* VTM_HTTP_VERSIONS[];
@@ -56,6 +57,7 @@ VTM_API int vtm_http_get_method(const char *str, enum vtm_http_method *method);
 
 /* 2xx success */
 #define VTM_HTTP_200_OK                         200
+#define VTM_HTTP_206_PARTIAL_CONTENT            206
 
 /* 3xx redirect */
 #define VTM_HTTP_300_MULTIPLE_CHOICES           300
@@ -75,6 +77,8 @@ VTM_API int vtm_http_get_method(const char *str, enum vtm_http_method *method);
 #define VTM_HTTP_403_FORBIDDEN                  403
 #define VTM_HTTP_404_NOT_FOUND                  404
 #define VTM_HTTP_405_METHOD_NOT_ALLOWED         405
+#define VTM_HTTP_416_RANGE_NOT_SATISFIABLE      416
+#define VTM_HTTP_429_TOO_MANY_REQUESTS          429
 
 /* 5xx server error */
 #define VTM_HTTP_500_INTERNAL_SERVER_ERROR      500
@@ -88,28 +92,52 @@ VTM_API const char* vtm_http_get_status_phrase(int code);
 
 /* ########## HEADER FIELDS ########## */
 
+VTM_API extern const char* const VTM_HTTP_HEADER_ACCEPT_ENCODING;
+VTM_API extern const char* const VTM_HTTP_HEADER_ACCEPT_RANGES;
+VTM_API extern const char* const VTM_HTTP_HEADER_AGE;
 VTM_API extern const char* const VTM_HTTP_HEADER_AUTHORIZATION;
+VTM_API extern const char* const VTM_HTTP_HEADER_CACHE_CONTROL;
 VTM_API extern const char* const VTM_HTTP_HEADER_CONNECTION;
+VTM_API extern const char* const VTM_HTTP_HEADER_CONTENT_ENCODING;
 VTM_API extern const char* const VTM_HTTP_HEADER_CONTENT_LENGTH;
+VTM_API extern const char* const VTM_HTTP_HEADER_CONTENT_RANGE;
 VTM_API extern const char* const VTM_HTTP_HEADER_CONTENT_TYPE;
 VTM_API extern const char* const VTM_HTTP_HEADER_DATE;
+VTM_API extern const char* const VTM_HTTP_HEADER_ETAG;
+VTM_API extern const char* const VTM_HTTP_HEADER_EXPECT;
 VTM_API extern const char* const VTM_HTTP_HEADER_EXPIRES;
 VTM_API extern const char* const VTM_HTTP_HEADER_HOST;
+VTM_API extern const char* const VTM_HTTP_HEADER_HTTP2_SETTINGS;
+VTM_API extern const char* const VTM_HTTP_HEADER_IF_MODIFIED_SINCE;
+VTM_API extern const char* const VTM_HTTP_HEADER_IF_NONE_MATCH;
+VTM_API extern const char* const VTM_HTTP_HEADER_IF_RANGE;
+VTM_API extern const char* const VTM_HTTP_HEADER_LAST_MODIFIED;
+VTM_API extern const char* const VTM_HTTP_HEADER_RANGE;
+VTM_API extern const char* const VTM_HTTP_HEADER_RETRY_AFTER;
 VTM_API extern const char* const VTM_HTTP_HEADER_SERVER;
+VTM_API extern const char* const VTM_HTTP_HEADER_SET_COOKIE;
 VTM_API extern const char* const VTM_HTTP_HEADER_TRANSFER_ENCODING;
 VTM_API extern const char* const VTM_HTTP_HEADER_UPGRADE;
 VTM_API extern const char* const VTM_HTTP_HEADER_USER_AGENT;
+VTM_API extern const char* const VTM_HTTP_HEADER_VARY;
 VTM_API extern const char* const VTM_HTTP_HEADER_WWW_AUTHENTICATE;
 
 VTM_API extern const char* const VTM_HTTP_HEADER_SEC_WEBSOCKET_ACCEPT;
+VTM_API extern const char* const VTM_HTTP_HEADER_SEC_WEBSOCKET_EXTENSIONS;
 VTM_API extern const char* const VTM_HTTP_HEADER_SEC_WEBSOCKET_KEY;
 VTM_API extern const char* const VTM_HTTP_HEADER_SEC_WEBSOCKET_PROTOCOL;
 VTM_API extern const char* const VTM_HTTP_HEADER_SEC_WEBSOCKET_VERSION;
 
 /* ########## HEADER VALUES ########## */
 
+VTM_API extern const char* const VTM_HTTP_VALUE_100_CONTINUE;
+VTM_API extern const char* const VTM_HTTP_VALUE_BR;
+VTM_API extern const char* const VTM_HTTP_VALUE_BYTES;
 VTM_API extern const char* const VTM_HTTP_VALUE_CHUNKED;
 VTM_API extern const char* const VTM_HTTP_VALUE_CLOSE;
+VTM_API extern const char* const VTM_HTTP_VALUE_DEFLATE;
+VTM_API extern const char* const VTM_HTTP_VALUE_GZIP;
+VTM_API extern const char* const VTM_HTTP_VALUE_H2C;
 VTM_API extern const char* const VTM_HTTP_VALUE_IDENTITY;
 VTM_API extern const char* const VTM_HTTP_VALUE_KEEP_ALIVE;
 VTM_API extern const char* const VTM_HTTP_VALUE_UPGRADE;
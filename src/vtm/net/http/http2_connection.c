@@ -0,0 +1,1664 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include "http2_connection_intl.h"
+
+#include <stdlib.h> /* malloc(), free() */
+#include <string.h> /* memcmp(), memcpy(), memchr(), strchr(), strcmp(), strlen() */
+#include <vtm/core/buffer.h>
+#include <vtm/core/error.h>
+#include <vtm/core/math.h>
+#include <vtm/core/string.h>
+#include <vtm/net/http/http_connection_base_intl.h>
+#include <vtm/net/http/http_parser.h>
+#include <vtm/net/http/http2_hpack_intl.h>
+#include <vtm/util/base64.h>
+
+#define VTM_HTTP2_FRAME_HEADER_LEN     9
+#define VTM_HTTP2_DEFAULT_FRAME_SIZE   16384
+#define VTM_HTTP2_MAX_FRAME_SIZE       16777215
+#define VTM_HTTP2_DEFAULT_WINDOW       65535
+#define VTM_HTTP2_MAX_WINDOW           0x7fffffff
+
+/** receive window of each stream */
+#define VTM_HTTP2_WINDOW_SIZE          (1024*1024)
+
+/**
+ * receive window of the connection, it is only reopened for request
+ * bodies the application has consumed, so it also limits the body
+ * bytes that are buffered per connection
+ */
+#define VTM_HTTP2_CON_WINDOW_SIZE      (16*1024*1024)
+
+/** concurrently active streams that are accepted */
+#define VTM_HTTP2_MAX_STREAMS          100
+
+/** maximum decoded size of a header list */
+#define VTM_HTTP2_MAX_HEADER_LIST      (64*1024)
+
+/** DATA frames are only produced while less bytes are pending */
+#define VTM_HTTP2_SEND_WATERMARK       (64*1024)
+
+enum vtm_http2_frame_type
+{
+	VTM_HTTP2_FRAME_DATA           = 0x0,
+	VTM_HTTP2_FRAME_HEADERS        = 0x1,
+	VTM_HTTP2_FRAME_PRIORITY       = 0x2,
+	VTM_HTTP2_FRAME_RST_STREAM     = 0x3,
+	VTM_HTTP2_FRAME_SETTINGS       = 0x4,
+	VTM_HTTP2_FRAME_PUSH_PROMISE   = 0x5,
+	VTM_HTTP2_FRAME_PING           = 0x6,
+	VTM_HTTP2_FRAME_GOAWAY         = 0x7,
+	VTM_HTTP2_FRAME_WINDOW_UPDATE  = 0x8,
+	VTM_HTTP2_FRAME_CONTINUATION   = 0x9
+};
+
+#define VTM_HTTP2_FLAG_ACK             0x01
+#define VTM_HTTP2_FLAG_END_STREAM      0x01
+#define VTM_HTTP2_FLAG_END_HEADERS     0x04
+#define VTM_HTTP2_FLAG_PADDED          0x08
+#define VTM_HTTP2_FLAG_PRIORITY        0x20
+
+enum vtm_http2_error
+{
+	VTM_HTTP2_NO_ERROR             = 0x0,
+	VTM_HTTP2_PROTOCOL_ERROR       = 0x1,
+	VTM_HTTP2_INTERNAL_ERROR       = 0x2,
+	VTM_HTTP2_FLOW_CONTROL_ERROR   = 0x3,
+	VTM_HTTP2_STREAM_CLOSED        = 0x5,
+	VTM_HTTP2_FRAME_SIZE_ERROR     = 0x6,
+	VTM_HTTP2_REFUSED_STREAM       = 0x7,
+	VTM_HTTP2_CANCEL               = 0x8,
+	VTM_HTTP2_COMPRESSION_ERROR    = 0x9,
+	VTM_HTTP2_ENHANCE_YOUR_CALM    = 0xb
+};
+
+enum vtm_http2_setting
+{
+	VTM_HTTP2_SETTINGS_HEADER_TABLE_SIZE       = 0x1,
+	VTM_HTTP2_SETTINGS_ENABLE_PUSH             = 0x2,
+	VTM_HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS  = 0x3,
+	VTM_HTTP2_SETTINGS_INITIAL_WINDOW_SIZE     = 0x4,
+	VTM_HTTP2_SETTINGS_MAX_FRAME_SIZE          = 0x5,
+	VTM_HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE    = 0x6
+};
+
+enum vtm_http2_stream_state
+{
+	VTM_HTTP2_STREAM_OPEN,      /* request is received */
+	VTM_HTTP2_STREAM_REQUEST,   /* request is complete, waiting for response */
+	VTM_HTTP2_STREAM_RESPONSE   /* response body is sent */
+};
+
+struct vtm_http2_frame
+{
+	uint8_t              type;
+	uint8_t              flags;
+	uint32_t             stream_id;
+	const unsigned char  *payload;
+	size_t               len;
+};
+
+struct vtm_http2_stream
+{
+	uint32_t                     id;
+	enum vtm_http2_stream_state  state;
+	bool                         headers_done;
+	int64_t                      send_window;
+	int64_t                      recv_window;
+
+	/* request */
+	enum vtm_http_method         method;
+	bool                         method_set;
+	bool                         scheme_set;
+	bool                         regular;
+	bool                         malformed;
+	char                         *path;
+	char                         *authority;
+	vtm_dataset                  *headers;
+	vtm_dataset                  *params;
+	struct vtm_buf               *body;
+
+	/* response */
+	const unsigned char          *out_data;
+	size_t                       out_len;
+	struct vtm_buf               *out_buf;
+	void                         (*out_fr)(void *arg);
+	void                         *out_arg;
+	struct vtm_socket_emitter    *out_se;
+	uint64_t                     out_se_left;
+
+	struct vtm_http2_stream      *next;
+};
+
+struct vtm_http2_con
+{
+	struct vtm_http_con_base     base;
+	struct vtm_buf               recvbuf;
+	struct vtm_buf               sendbuf;
+	struct vtm_socket_emitter    *head;
+	bool                         preface;
+	bool                         settings;
+	bool                         failed;
+
+	/* peer settings */
+	uint32_t                     peer_window;
+	uint32_t                     peer_frame_size;
+
+	/* connection flow control */
+	int64_t                      send_window;
+	int64_t                      recv_window;
+	int64_t                      recv_consumed;
+
+	/* streams */
+	struct vtm_http2_stream      *streams;
+	size_t                       stream_count;
+	uint32_t                     last_stream_id;
+
+	/* header block that spans multiple frames */
+	uint32_t                     cont_stream;
+	bool                         cont_end_stream;
+	uint32_t                     cont_error;
+	struct vtm_buf               hblock;
+
+	/* header compression */
+	struct vtm_http2_hpack       dec;
+	struct vtm_http2_hpack       enc;
+	struct vtm_buf               scratch;
+};
+
+/* forward declaration */
+static enum vtm_net_recv_stat vtm_http2_con_read(struct vtm_http_con_base *base_con);
+static int vtm_http2_con_write(struct vtm_http_con_base *base_con);
+static int vtm_http2_con_next_frame(vtm_http2_con *con, struct vtm_http2_frame *frame);
+static uint32_t vtm_http2_con_process_frame(vtm_http2_con *con, struct vtm_http2_frame *frame, struct vtm_http2_stream **ready);
+static uint32_t vtm_http2_con_on_data(vtm_http2_con *con, struct vtm_http2_frame *frame, struct vtm_http2_stream **ready);
+static uint32_t vtm_http2_con_on_headers(vtm_http2_con *con, struct vtm_http2_frame *frame, struct vtm_http2_stream **ready);
+static uint32_t vtm_http2_con_on_continuation(vtm_http2_con *con, struct vtm_http2_frame *frame, struct vtm_http2_stream **ready);
+static uint32_t vtm_http2_con_end_headers(vtm_http2_con *con, struct vtm_http2_stream **ready);
+static uint32_t vtm_http2_con_on_settings(vtm_http2_con *con, struct vtm_http2_frame *frame);
+static uint32_t vtm_http2_con_apply_settings(vtm_http2_con *con, const unsigned char *data, size_t len);
+static uint32_t vtm_http2_con_on_window_update(vtm_http2_con *con, struct vtm_http2_frame *frame);
+static int vtm_http2_con_on_field(void *arg, const char *name, size_t name_len, const char *value, size_t value_len);
+static bool vtm_http2_con_check_request(struct vtm_http2_stream *stream);
+static int vtm_http2_con_set_params(struct vtm_http2_stream *stream, char *query);
+static void vtm_http2_con_fill_request(vtm_http2_con *con, struct vtm_http2_stream *stream, struct vtm_http_req *req);
+static int vtm_http2_con_strip_padding(struct vtm_http2_frame *frame);
+static void vtm_http2_con_consume(vtm_http2_con *con, size_t len);
+static void vtm_http2_con_consume_stream(vtm_http2_con *con, struct vtm_http2_stream *stream, size_t len);
+static int vtm_http2_con_encode_headers(vtm_http2_con *con, int status, const char *headers, size_t headers_len);
+static void vtm_http2_con_put_header_block(vtm_http2_con *con, uint32_t stream_id, bool end_stream);
+static void vtm_http2_con_frame_data(vtm_http2_con *con);
+static bool vtm_http2_con_frame_stream(vtm_http2_con *con, struct vtm_http2_stream *stream);
+static bool vtm_http2_con_frame_emitter(vtm_http2_con *con, struct vtm_http2_stream *stream, size_t max);
+static void vtm_http2_con_retain_output(struct vtm_http2_stream *stream);
+static void vtm_http2_con_put_frame_header(struct vtm_buf *buf, size_t len, uint8_t type, uint8_t flags, uint32_t stream_id);
+static void vtm_http2_con_put_u32(struct vtm_buf *buf, uint32_t val);
+static void vtm_http2_con_put_settings(vtm_http2_con *con);
+static void vtm_http2_con_put_window_update(vtm_http2_con *con, uint32_t stream_id, uint32_t inc);
+static void vtm_http2_con_reset_stream(vtm_http2_con *con, struct vtm_http2_stream *stream, uint32_t stream_id, uint32_t code);
+static void vtm_http2_con_goaway(vtm_http2_con *con, uint32_t code);
+static struct vtm_http2_stream* vtm_http2_con_stream_new(vtm_http2_con *con, uint32_t id);
+static struct vtm_http2_stream* vtm_http2_con_stream_find(vtm_http2_con *con, uint32_t id);
+static void vtm_http2_con_stream_remove(vtm_http2_con *con, struct vtm_http2_stream *stream);
+static void vtm_http2_con_stream_release_request(vtm_http2_con *con, struct vtm_http2_stream *stream);
+static void vtm_http2_con_stream_release_response(struct vtm_http2_stream *stream);
+static bool vtm_http2_con_name_eq(const char *name, size_t len, const char *str);
+static uint32_t vtm_http2_get_u32(const unsigned char *src);
+
+vtm_http2_con* vtm_http2_con_new(vtm_socket *sock)
+{
+	vtm_http2_con *con;
+
+	con = malloc(sizeof(vtm_http2_con));
+	if (!con) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	con->base.sock = sock;
+	con->base.type = VTM_HTTP_CON_TYPE_H2;
+
+	con->base.con_can_read = vtm_http2_con_read;
+	con->base.con_can_write = vtm_http2_con_write;
+	con->base.con_handle_req = NULL;
+
+	con->head = NULL;
+	con->preface = false;
+	con->settings = false;
+	con->failed = false;
+
+	con->peer_window = VTM_HTTP2_DEFAULT_WINDOW;
+	con->peer_frame_size = VTM_HTTP2_DEFAULT_FRAME_SIZE;
+
+	con->send_window = VTM_HTTP2_DEFAULT_WINDOW;
+	con->recv_window = VTM_HTTP2_CON_WINDOW_SIZE;
+	con->recv_consumed = 0;
+
+	con->streams = NULL;
+	con->stream_count = 0;
+	con->last_stream_id = 0;
+
+	con->cont_stream = 0;
+	con->cont_end_stream = false;
+	con->cont_error = VTM_HTTP2_NO_ERROR;
+
+	vtm_buf_init(&con->recvbuf, VTM_BYTEORDER_BE);
+	vtm_buf_init(&con->sendbuf, VTM_BYTEORDER_BE);
+	vtm_buf_init(&con->hblock, VTM_BYTEORDER_BE);
+	vtm_buf_init(&con->scratch, VTM_BYTEORDER_BE);
+
+	vtm_http2_hpack_init(&con->dec, VTM_HTTP2_HPACK_TABLE_SIZE);
+	vtm_http2_hpack_init(&con->enc, VTM_HTTP2_HPACK_TABLE_SIZE);
+
+	/* server connection preface */
+	vtm_http2_con_put_settings(con);
+	vtm_http2_con_put_window_update(con, 0, VTM_HTTP2_CON_WINDOW_SIZE - VTM_HTTP2_DEFAULT_WINDOW);
+
+	if (con->sendbuf.err != VTM_OK) {
+		vtm_http2_con_free(con);
+		vtm_err_oom();
+		return NULL;
+	}
+
+	return con;
+}
+
+void vtm_http2_con_free(vtm_http2_con *con)
+{
+	struct vtm_http2_stream *stream;
+
+	while (con->streams) {
+		stream = con->streams;
+		vtm_http2_con_stream_remove(con, stream);
+	}
+
+	if (con->head)
+		vtm_socket_emitter_free_chain(con->head);
+
+	vtm_http2_hpack_release(&con->dec);
+	vtm_http2_hpack_release(&con->enc);
+
+	vtm_buf_release(&con->recvbuf);
+	vtm_buf_release(&con->sendbuf);
+	vtm_buf_release(&con->hblock);
+	vtm_buf_release(&con->scratch);
+
+	free(con);
+}
+
+vtm_socket* vtm_http2_con_get_socket(vtm_http2_con *con)
+{
+	return con->base.sock;
+}
+
+void vtm_http2_con_set_head(vtm_http2_con *con, struct vtm_socket_emitter *se)
+{
+	con->head = se;
+}
+
+int vtm_http2_con_feed(vtm_http2_con *con, const void *data, size_t len)
+{
+	return vtm_buf_putm(&con->recvbuf, data, len);
+}
+
+int vtm_http2_con_upgrade(vtm_http2_con *con, const char *settings, struct vtm_http_req *req, uint32_t *stream_id)
+{
+	int rc;
+	char *b64;
+	unsigned char *payload;
+	size_t i, len, b64_len, payload_len;
+	struct vtm_http2_stream *stream;
+
+	/* HTTP2-Settings is base64url encoded without padding */
+	len = strlen(settings);
+	b64_len = (len + 3) / 4 * 4;
+	b64 = malloc(b64_len + 1);
+	payload = malloc(VTM_BASE64_DEC_BUF_LEN(b64_len) + 1);
+	if (!b64 || !payload) {
+		free(b64);
+		free(payload);
+		vtm_err_oom();
+		return vtm_err_get_code();
+	}
+
+	for (i=0; i < len; i++) {
+		switch (settings[i]) {
+			case '-':  b64[i] = '+';          break;
+			case '_':  b64[i] = '/';          break;
+			default:   b64[i] = settings[i];  break;
+		}
+	}
+	for (; i < b64_len; i++)
+		b64[i] = '=';
+	b64[b64_len] = '\0';
+
+	payload_len = VTM_BASE64_DEC_BUF_LEN(b64_len) + 1;
+	rc = vtm_base64_decode(b64, b64_len, payload, &payload_len);
+	if (rc == VTM_OK && vtm_http2_con_apply_settings(con, payload, payload_len) != VTM_HTTP2_NO_ERROR)
+		rc = VTM_E_IO_PROTOCOL;
+
+	free(b64);
+	free(payload);
+
+	if (rc != VTM_OK)
+		return rc;
+
+	/* request was received completely by HTTP/1.1 */
+	stream = vtm_http2_con_stream_new(con, 1);
+	if (!stream)
+		return vtm_err_get_code();
+
+	stream->state = VTM_HTTP2_STREAM_REQUEST;
+	stream->headers_done = true;
+	stream->method = req->method;
+
+	con->last_stream_id = 1;
+	*stream_id = 1;
+
+	return VTM_OK;
+}
+
+int vtm_http2_con_get_request(vtm_http2_con *con, struct vtm_http_req *req, uint32_t *stream_id)
+{
+	int rc;
+	uint32_t err;
+	struct vtm_http2_frame frame;
+	struct vtm_http2_stream *ready;
+
+	if (con->failed)
+		return VTM_E_IO_PROTOCOL;
+
+	while (true) {
+		if (!con->preface) {
+			if (VTM_BUF_GET_AVAIL_TOTAL(&con->recvbuf) < VTM_HTTP2_PREFACE_LEN)
+				return VTM_E_IO_AGAIN;
+
+			if (memcmp(con->recvbuf.data + con->recvbuf.read, VTM_HTTP2_PREFACE, VTM_HTTP2_PREFACE_LEN) != 0) {
+				vtm_http2_con_goaway(con, VTM_HTTP2_PROTOCOL_ERROR);
+				return VTM_E_IO_PROTOCOL;
+			}
+
+			vtm_buf_mark_processed(&con->recvbuf, VTM_HTTP2_PREFACE_LEN);
+			con->preface = true;
+		}
+
+		rc = vtm_http2_con_next_frame(con, &frame);
+		if (rc == VTM_E_IO_AGAIN)
+			return rc;
+
+		if (rc != VTM_OK) {
+			vtm_http2_con_goaway(con, VTM_HTTP2_FRAME_SIZE_ERROR);
+			return rc;
+		}
+
+		vtm_buf_mark_processed(&con->recvbuf, VTM_HTTP2_FRAME_HEADER_LEN + frame.len);
+
+		ready = NULL;
+		err = vtm_http2_con_process_frame(con, &frame, &ready);
+		if (err != VTM_HTTP2_NO_ERROR) {
+			vtm_http2_con_goaway(con, err);
+			return VTM_E_IO_PROTOCOL;
+		}
+
+		if (con->sendbuf.err != VTM_OK) {
+			vtm_http2_con_goaway(con, VTM_HTTP2_INTERNAL_ERROR);
+			return VTM_E_MALLOC;
+		}
+
+		if (ready) {
+			vtm_http2_con_fill_request(con, ready, req);
+			*stream_id = ready->id;
+			return VTM_OK;
+		}
+	}
+
+	VTM_ABORT_NOT_REACHABLE;
+	return VTM_ERROR;
+}
+
+void vtm_http2_con_end_request(vtm_http2_con *con, uint32_t stream_id)
+{
+	struct vtm_http2_stream *stream;
+
+	stream = vtm_http2_con_stream_find(con, stream_id);
+	if (!stream)
+		return;
+
+	/* handler did not respond */
+	if (stream->state == VTM_HTTP2_STREAM_REQUEST) {
+		vtm_http2_con_reset_stream(con, stream, stream_id, VTM_HTTP2_INTERNAL_ERROR);
+		return;
+	}
+
+	vtm_http2_con_stream_release_request(con, stream);
+}
+
+int vtm_http2_con_respond(vtm_http2_con *con, uint32_t stream_id, int status, const char *headers, size_t headers_len, struct vtm_http2_body *body)
+{
+	int rc;
+	bool has_body;
+	struct vtm_http2_stream *stream;
+
+	stream = vtm_http2_con_stream_find(con, stream_id);
+	if (!stream || stream->state != VTM_HTTP2_STREAM_REQUEST) {
+		rc = VTM_E_INVALID_STATE;
+		goto release;
+	}
+
+	has_body = (stream->method != VTM_HTTP_METHOD_HEAD &&
+		status >= 200 && status != 204 && status != VTM_HTTP_304_NOT_MODIFIED &&
+		(body->len > 0 || body->se));
+
+	rc = vtm_http2_con_encode_headers(con, status, headers, headers_len);
+	if (rc != VTM_OK)
+		goto release;
+
+	vtm_http2_con_put_header_block(con, stream_id, !has_body);
+	if (con->sendbuf.err != VTM_OK) {
+		rc = con->sendbuf.err;
+		goto release;
+	}
+
+	if (!has_body) {
+		vtm_http2_con_stream_remove(con, stream);
+		rc = VTM_OK;
+		goto release;
+	}
+
+	stream->state = VTM_HTTP2_STREAM_RESPONSE;
+	stream->out_data = body->data;
+	stream->out_len = body->len;
+	stream->out_fr = body->fr;
+	stream->out_arg = body->fr_arg;
+	stream->out_se = body->se;
+	stream->out_se_left = body->se ? body->se->length : 0;
+
+	/* send as much as possible directly from memory of the caller */
+	vtm_http2_con_frame_data(con);
+	if (con->sendbuf.err != VTM_OK)
+		return con->sendbuf.err;
+
+	stream = vtm_http2_con_stream_find(con, stream_id);
+	if (stream && body->copy)
+		vtm_http2_con_retain_output(stream);
+
+	if (stream && stream->out_buf && stream->out_buf->err != VTM_OK) {
+		vtm_http2_con_reset_stream(con, stream, stream_id, VTM_HTTP2_INTERNAL_ERROR);
+		return VTM_E_MALLOC;
+	}
+
+	return VTM_OK;
+
+release:
+	if (body->fr)
+		body->fr(body->fr_arg);
+	if (body->se)
+		vtm_socket_emitter_free_chain(body->se);
+
+	return rc;
+}
+
+int vtm_http2_con_flush(vtm_http2_con *con)
+{
+	int rc;
+	size_t written;
+
+	/* output of the previous protocol goes first */
+	if (con->head) {
+		rc = vtm_socket_emitter_try_write(&con->head);
+		if (rc != VTM_OK)
+			return rc;
+	}
+
+	while (true) {
+		if (!con->failed)
+			vtm_http2_con_frame_data(con);
+
+		if (con->sendbuf.err != VTM_OK)
+			return con->sendbuf.err;
+
+		if (VTM_BUF_GET_AVAIL_TOTAL(&con->sendbuf) == 0) {
+			vtm_buf_clear(&con->sendbuf);
+			return VTM_OK;
+		}
+
+		rc = vtm_socket_write(con->base.sock, con->sendbuf.data + con->sendbuf.read,
+			VTM_BUF_GET_AVAIL_TOTAL(&con->sendbuf), &written);
+
+		vtm_buf_mark_processed(&con->sendbuf, written);
+		vtm_buf_discard_processed(&con->sendbuf);
+
+		if (rc != VTM_OK)
+			return rc;
+	}
+
+	VTM_ABORT_NOT_REACHABLE;
+	return VTM_ERROR;
+}
+
+static enum vtm_net_recv_stat vtm_http2_con_read(struct vtm_http_con_base *base_con)
+{
+	int rc;
+	size_t read;
+	vtm_http2_con *con;
+	struct vtm_http2_frame frame;
+
+	con = (vtm_http2_con*) base_con;
+
+	if (con->failed)
+		return VTM_NET_RECV_STAT_ERROR;
+
+	/* process buffered frames first */
+	if (con->preface) {
+		if (vtm_http2_con_next_frame(con, &frame) != VTM_E_IO_AGAIN)
+			return VTM_NET_RECV_STAT_COMPLETE;
+	}
+	else if (VTM_BUF_GET_AVAIL_TOTAL(&con->recvbuf) >= VTM_HTTP2_PREFACE_LEN) {
+		return VTM_NET_RECV_STAT_COMPLETE;
+	}
+
+	vtm_buf_discard_processed(&con->recvbuf);
+
+	rc = vtm_buf_ensure(&con->recvbuf, VTM_HTTP2_DEFAULT_FRAME_SIZE);
+	if (rc != VTM_OK)
+		return VTM_NET_RECV_STAT_ERROR;
+
+	rc = vtm_socket_read(con->base.sock, VTM_BUF_PUT_PTR(&con->recvbuf),
+		VTM_BUF_PUT_AVAIL_TOTAL(&con->recvbuf), &read);
+
+	VTM_BUF_PUT_INC(&con->recvbuf, read);
+	if (rc != VTM_OK && rc != VTM_E_IO_AGAIN)
+		return VTM_NET_RECV_STAT_ERROR;
+
+	if (!con->preface)
+		return VTM_BUF_GET_AVAIL_TOTAL(&con->recvbuf) >= VTM_HTTP2_PREFACE_LEN ?
+			VTM_NET_RECV_STAT_COMPLETE : VTM_NET_RECV_STAT_AGAIN;
+
+	return vtm_http2_con_next_frame(con, &frame) != VTM_E_IO_AGAIN ?
+		VTM_NET_RECV_STAT_COMPLETE : VTM_NET_RECV_STAT_AGAIN;
+}
+
+static int vtm_http2_con_write(struct vtm_http_con_base *base_con)
+{
+	return vtm_http2_con_flush((vtm_http2_con*) base_con);
+}
+
+static int vtm_http2_con_next_frame(vtm_http2_con *con, struct vtm_http2_frame *frame)
+{
+	size_t len;
+	const unsigned char *src;
+
+	if (VTM_BUF_GET_AVAIL_TOTAL(&con->recvbuf) < VTM_HTTP2_FRAME_HEADER_LEN)
+		return VTM_E_IO_AGAIN;
+
+	src = con->recvbuf.data + con->recvbuf.read;
+	len = ((size_t) src[0] << 16) | ((size_t) src[1] << 8) | src[2];
+
+	/* larger frames than announced by SETTINGS_MAX_FRAME_SIZE */
+	if (len > VTM_HTTP2_DEFAULT_FRAME_SIZE)
+		return VTM_E_IO_PROTOCOL;
+
+	if (VTM_BUF_GET_AVAIL_TOTAL(&con->recvbuf) < VTM_HTTP2_FRAME_HEADER_LEN + len)
+		return VTM_E_IO_AGAIN;
+
+	frame->type = src[3];
+	frame->flags = src[4];
+	frame->stream_id = vtm_http2_get_u32(src + 5) & 0x7fffffff;
+	frame->payload = src + VTM_HTTP2_FRAME_HEADER_LEN;
+	frame->len = len;
+
+	return VTM_OK;
+}
+
+static uint32_t vtm_http2_con_process_frame(vtm_http2_con *con, struct vtm_http2_frame *frame, struct vtm_http2_stream **ready)
+{
+	struct vtm_http2_stream *stream;
+
+	/* header block must not be interrupted by other frames */
+	if (con->cont_stream != 0 &&
+		(frame->type != VTM_HTTP2_FRAME_CONTINUATION || frame->stream_id != con->cont_stream))
+		return VTM_HTTP2_PROTOCOL_ERROR;
+
+	/* first frame of client must be SETTINGS */
+	if (!con->settings && frame->type != VTM_HTTP2_FRAME_SETTINGS)
+		return VTM_HTTP2_PROTOCOL_ERROR;
+
+	switch (frame->type) {
+		case VTM_HTTP2_FRAME_DATA:
+			return vtm_http2_con_on_data(con, frame, ready);
+
+		case VTM_HTTP2_FRAME_HEADERS:
+			return vtm_http2_con_on_headers(con, frame, ready);
+
+		case VTM_HTTP2_FRAME_PRIORITY:
+			if (frame->stream_id == 0)
+				return VTM_HTTP2_PROTOCOL_ERROR;
+			if (frame->len != 5)
+				vtm_http2_con_reset_stream(con, vtm_http2_con_stream_find(con, frame->stream_id),
+					frame->stream_id, VTM_HTTP2_FRAME_SIZE_ERROR);
+			return VTM_HTTP2_NO_ERROR;
+
+		case VTM_HTTP2_FRAME_RST_STREAM:
+			if (frame->stream_id == 0 || frame->stream_id > con->last_stream_id)
+				return VTM_HTTP2_PROTOCOL_ERROR;
+			if (frame->len != 4)
+				return VTM_HTTP2_FRAME_SIZE_ERROR;
+			stream = vtm_http2_con_stream_find(con, frame->stream_id);
+			if (stream)
+				vtm_http2_con_stream_remove(con, stream);
+			return VTM_HTTP2_NO_ERROR;
+
+		case VTM_HTTP2_FRAME_SETTINGS:
+			return vtm_http2_con_on_settings(con, frame);
+
+		case VTM_HTTP2_FRAME_PUSH_PROMISE:
+			return VTM_HTTP2_PROTOCOL_ERROR;
+
+		case VTM_HTTP2_FRAME_PING:
+			if (frame->stream_id != 0)
+				return VTM_HTTP2_PROTOCOL_ERROR;
+			if (frame->len != 8)
+				return VTM_HTTP2_FRAME_SIZE_ERROR;
+			if (!(frame->flags & VTM_HTTP2_FLAG_ACK)) {
+				vtm_http2_con_put_frame_header(&con->sendbuf, 8, VTM_HTTP2_FRAME_PING, VTM_HTTP2_FLAG_ACK, 0);
+				vtm_buf_putm(&con->sendbuf, frame->payload, 8);
+			}
+			return VTM_HTTP2_NO_ERROR;
+
+		case VTM_HTTP2_FRAME_GOAWAY:
+			if (frame->stream_id != 0)
+				return VTM_HTTP2_PROTOCOL_ERROR;
+			if (frame->len < 8)
+				return VTM_HTTP2_FRAME_SIZE_ERROR;
+			/* client closes the connection when its streams are done */
+			return VTM_HTTP2_NO_ERROR;
+
+		case VTM_HTTP2_FRAME_WINDOW_UPDATE:
+			return vtm_http2_con_on_window_update(con, frame);
+
+		case VTM_HTTP2_FRAME_CONTINUATION:
+			if (con->cont_stream == 0)
+				return VTM_HTTP2_PROTOCOL_ERROR;
+			return vtm_http2_con_on_continuation(con, frame, ready);
+
+		default:
+			/* unknown frame types are ignored */
+			break;
+	}
+
+	return VTM_HTTP2_NO_ERROR;
+}
+
+static uint32_t vtm_http2_con_on_data(vtm_http2_con *con, struct vtm_http2_frame *frame, struct vtm_http2_stream **ready)
+{
+	size_t len;
+	struct vtm_http2_stream *stream;
+
+	if (frame->stream_id == 0)
+		return VTM_HTTP2_PROTOCOL_ERROR;
+
+	/* padding counts for flow control */
+	len = frame->len;
+	if ((int64_t) len > con->recv_window)
+		return VTM_HTTP2_FLOW_CONTROL_ERROR;
+
+	con->recv_window -= len;
+
+	if (vtm_http2_con_strip_padding(frame) != VTM_OK)
+		return VTM_HTTP2_PROTOCOL_ERROR;
+
+	stream = vtm_http2_con_stream_find(con, frame->stream_id);
+	if (!stream) {
+		if (frame->stream_id > con->last_stream_id)
+			return VTM_HTTP2_PROTOCOL_ERROR;
+		vtm_http2_con_consume(con, len);
+		vtm_http2_con_reset_stream(con, NULL, frame->stream_id, VTM_HTTP2_STREAM_CLOSED);
+		return VTM_HTTP2_NO_ERROR;
+	}
+
+	if (stream->state != VTM_HTTP2_STREAM_OPEN) {
+		vtm_http2_con_consume(con, len);
+		vtm_http2_con_reset_stream(con, stream, frame->stream_id, VTM_HTTP2_STREAM_CLOSED);
+		return VTM_HTTP2_NO_ERROR;
+	}
+
+	if ((int64_t) len > stream->recv_window) {
+		vtm_http2_con_consume(con, len);
+		vtm_http2_con_reset_stream(con, stream, frame->stream_id, VTM_HTTP2_FLOW_CONTROL_ERROR);
+		return VTM_HTTP2_NO_ERROR;
+	}
+
+	if (frame->len > 0) {
+		if (!stream->body) {
+			stream->body = vtm_buf_new(VTM_BYTEORDER_BE);
+			if (!stream->body)
+				return VTM_HTTP2_INTERNAL_ERROR;
+		}
+
+		if (stream->body->used + frame->len > VTM_HTTP_DEF_MAX_BODY_SIZE) {
+			vtm_http2_con_consume(con, len);
+			vtm_http2_con_reset_stream(con, stream, frame->stream_id, VTM_HTTP2_CANCEL);
+			return VTM_HTTP2_NO_ERROR;
+		}
+
+		if (vtm_buf_putm(stream->body, frame->payload, frame->len) != VTM_OK)
+			return VTM_HTTP2_INTERNAL_ERROR;
+	}
+
+	/* payload is consumed when the request was handled */
+	vtm_http2_con_consume(con, len - frame->len);
+
+	if (frame->flags & VTM_HTTP2_FLAG_END_STREAM) {
+		stream->state = VTM_HTTP2_STREAM_REQUEST;
+		*ready = stream;
+		return VTM_HTTP2_NO_ERROR;
+	}
+
+	/* incomplete bodies used up the window, none of them can finish */
+	if (con->recv_window < VTM_HTTP2_DEFAULT_FRAME_SIZE) {
+		vtm_http2_con_reset_stream(con, stream, frame->stream_id, VTM_HTTP2_REFUSED_STREAM);
+		return VTM_HTTP2_NO_ERROR;
+	}
+
+	vtm_http2_con_consume_stream(con, stream, len);
+
+	return VTM_HTTP2_NO_ERROR;
+}
+
+static uint32_t vtm_http2_con_on_headers(vtm_http2_con *con, struct vtm_http2_frame *frame, struct vtm_http2_stream **ready)
+{
+	uint32_t id;
+	struct vtm_http2_stream *stream;
+
+	id = frame->stream_id;
+	if (id == 0)
+		return VTM_HTTP2_PROTOCOL_ERROR;
+
+	if (vtm_http2_con_strip_padding(frame) != VTM_OK)
+		return VTM_HTTP2_PROTOCOL_ERROR;
+
+	con->cont_error = VTM_HTTP2_NO_ERROR;
+
+	if (frame->flags & VTM_HTTP2_FLAG_PRIORITY) {
+		if (frame->len < 5)
+			return VTM_HTTP2_FRAME_SIZE_ERROR;
+		if ((vtm_http2_get_u32(frame->payload) & 0x7fffffff) == id)
+			con->cont_error = VTM_HTTP2_PROTOCOL_ERROR;
+		frame->payload += 5;
+		frame->len -= 5;
+	}
+
+	stream = vtm_http2_con_stream_find(con, id);
+	if (!stream) {
+		/* client streams are odd and increasing */
+		if ((id & 1) == 0 || id <= con->last_stream_id)
+			return VTM_HTTP2_PROTOCOL_ERROR;
+
+		con->last_stream_id = id;
+
+		if (con->stream_count >= VTM_HTTP2_MAX_STREAMS) {
+			con->cont_error = VTM_HTTP2_REFUSED_STREAM;
+		}
+		else {
+			stream = vtm_http2_con_stream_new(con, id);
+			if (!stream)
+				return VTM_HTTP2_INTERNAL_ERROR;
+		}
+	}
+	else if (stream->state != VTM_HTTP2_STREAM_OPEN) {
+		con->cont_error = VTM_HTTP2_STREAM_CLOSED;
+	}
+	else if (!(frame->flags & VTM_HTTP2_FLAG_END_STREAM)) {
+		/* trailers must end the stream */
+		con->cont_error = VTM_HTTP2_PROTOCOL_ERROR;
+	}
+
+	con->cont_stream = id;
+	con->cont_end_stream = (frame->flags & VTM_HTTP2_FLAG_END_STREAM) != 0;
+
+	vtm_buf_clear(&con->hblock);
+	if (vtm_buf_putm(&con->hblock, frame->payload, frame->len) != VTM_OK)
+		return VTM_HTTP2_INTERNAL_ERROR;
+
+	if (frame->flags & VTM_HTTP2_FLAG_END_HEADERS)
+		return vtm_http2_con_end_headers(con, ready);
+
+	return VTM_HTTP2_NO_ERROR;
+}
+
+static uint32_t vtm_http2_con_on_continuation(vtm_http2_con *con, struct vtm_http2_frame *frame, struct vtm_http2_stream **ready)
+{
+	if (con->hblock.used + frame->len > VTM_HTTP2_MAX_HEADER_LIST)
+		return VTM_HTTP2_ENHANCE_YOUR_CALM;
+
+	if (vtm_buf_putm(&con->hblock, frame->payload, frame->len) != VTM_OK)
+		return VTM_HTTP2_INTERNAL_ERROR;
+
+	if (frame->flags & VTM_HTTP2_FLAG_END_HEADERS)
+		return vtm_http2_con_end_headers(con, ready);
+
+	return VTM_HTTP2_NO_ERROR;
+}
+
+static uint32_t vtm_http2_con_end_headers(vtm_http2_con *con, struct vtm_http2_stream **ready)
+{
+	int rc;
+	uint32_t id;
+	struct vtm_http2_stream *stream;
+
+	id = con->cont_stream;
+	con->cont_stream = 0;
+
+	stream = NULL;
+	if (con->cont_error == VTM_HTTP2_NO_ERROR)
+		stream = vtm_http2_con_stream_find(con, id);
+
+	/* block is always decoded to keep the dynamic table in sync */
+	rc = vtm_http2_hpack_decode(&con->dec, con->hblock.data, con->hblock.used,
+		VTM_HTTP2_MAX_HEADER_LIST, &con->scratch, vtm_http2_con_on_field, stream);
+
+	vtm_buf_clear(&con->hblock);
+
+	switch (rc) {
+		case VTM_OK:
+			break;
+
+		case VTM_E_MAX_REACHED:
+			if (con->cont_error == VTM_HTTP2_NO_ERROR)
+				con->cont_error = VTM_HTTP2_ENHANCE_YOUR_CALM;
+			break;
+
+		case VTM_E_MALLOC:
+			return VTM_HTTP2_INTERNAL_ERROR;
+
+		default:
+			return VTM_HTTP2_COMPRESSION_ERROR;
+	}
+
+	if (con->cont_error != VTM_HTTP2_NO_ERROR) {
+		vtm_http2_con_reset_stream(con, vtm_http2_con_stream_find(con, id), id, con->cont_error);
+		return VTM_HTTP2_NO_ERROR;
+	}
+
+	if (stream->malformed || (!stream->headers_done && !vtm_http2_con_check_request(stream))) {
+		vtm_http2_con_reset_stream(con, stream, id, VTM_HTTP2_PROTOCOL_ERROR);
+		return VTM_HTTP2_NO_ERROR;
+	}
+
+	stream->headers_done = true;
+
+	if (con->cont_end_stream) {
+		stream->state = VTM_HTTP2_STREAM_REQUEST;
+		*ready = stream;
+	}
+
+	return VTM_HTTP2_NO_ERROR;
+}
+
+static uint32_t vtm_http2_con_on_settings(vtm_http2_con *con, struct vtm_http2_frame *frame)
+{
+	uint32_t err;
+
+	if (frame->stream_id != 0)
+		return VTM_HTTP2_PROTOCOL_ERROR;
+
+	if (frame->flags & VTM_HTTP2_FLAG_ACK) {
+		if (frame->len != 0)
+			return VTM_HTTP2_FRAME_SIZE_ERROR;
+		return VTM_HTTP2_NO_ERROR;
+	}
+
+	err = vtm_http2_con_apply_settings(con, frame->payload, frame->len);
+	if (err != VTM_HTTP2_NO_ERROR)
+		return err;
+
+	con->settings = true;
+	vtm_http2_con_put_frame_header(&con->sendbuf, 0, VTM_HTTP2_FRAME_SETTINGS, VTM_HTTP2_FLAG_ACK, 0);
+
+	return VTM_HTTP2_NO_ERROR;
+}
+
+static uint32_t vtm_http2_con_apply_settings(vtm_http2_con *con, const unsigned char *data, size_t len)
+{
+	size_t i;
+	uint16_t id;
+	uint32_t val;
+	int64_t delta;
+	struct vtm_http2_stream *stream;
+
+	if (len % 6 != 0)
+		return VTM_HTTP2_FRAME_SIZE_ERROR;
+
+	for (i=0; i < len; i += 6) {
+		id = (uint16_t) ((data[i] << 8) | data[i+1]);
+		val = vtm_http2_get_u32(data + i + 2);
+
+		switch (id) {
+			case VTM_HTTP2_SETTINGS_HEADER_TABLE_SIZE:
+				vtm_http2_hpack_set_limit(&con->enc, val);
+				break;
+
+			case VTM_HTTP2_SETTINGS_ENABLE_PUSH:
+				if (val > 1)
+					return VTM_HTTP2_PROTOCOL_ERROR;
+				break;
+
+			case VTM_HTTP2_SETTINGS_INITIAL_WINDOW_SIZE:
+				if (val > VTM_HTTP2_MAX_WINDOW)
+					return VTM_HTTP2_FLOW_CONTROL_ERROR;
+
+				/* applies to all open streams */
+				delta = (int64_t) val - con->peer_window;
+				for (stream = con->streams; stream; stream = stream->next) {
+					stream->send_window += delta;
+					if (stream->send_window > VTM_HTTP2_MAX_WINDOW)
+						return VTM_HTTP2_FLOW_CONTROL_ERROR;
+				}
+				con->peer_window = val;
+				break;
+
+			case VTM_HTTP2_SETTINGS_MAX_FRAME_SIZE:
+				if (val < VTM_HTTP2_DEFAULT_FRAME_SIZE || val > VTM_HTTP2_MAX_FRAME_SIZE)
+					return VTM_HTTP2_PROTOCOL_ERROR;
+				con->peer_frame_size = val;
+				break;
+
+			default:
+				/* server never opens streams, unknown settings are ignored */
+				break;
+		}
+	}
+
+	return VTM_HTTP2_NO_ERROR;
+}
+
+static uint32_t vtm_http2_con_on_window_update(vtm_http2_con *con, struct vtm_http2_frame *frame)
+{
+	uint32_t inc;
+	struct vtm_http2_stream *stream;
+
+	if (frame->len != 4)
+		return VTM_HTTP2_FRAME_SIZE_ERROR;
+
+	inc = vtm_http2_get_u32(frame->payload) & 0x7fffffff;
+
+	if (frame->stream_id == 0) {
+		if (inc == 0)
+			return VTM_HTTP2_PROTOCOL_ERROR;
+
+		con->send_window += inc;
+		if (con->send_window > VTM_HTTP2_MAX_WINDOW)
+			return VTM_HTTP2_FLOW_CONTROL_ERROR;
+
+		return VTM_HTTP2_NO_ERROR;
+	}
+
+	stream = vtm_http2_con_stream_find(con, frame->stream_id);
+	if (!stream) {
+		if (frame->stream_id > con->last_stream_id)
+			return VTM_HTTP2_PROTOCOL_ERROR;
+		return VTM_HTTP2_NO_ERROR;
+	}
+
+	if (inc == 0) {
+		vtm_http2_con_reset_stream(con, stream, frame->stream_id, VTM_HTTP2_PROTOCOL_ERROR);
+		return VTM_HTTP2_NO_ERROR;
+	}
+
+	stream->send_window += inc;
+	if (stream->send_window > VTM_HTTP2_MAX_WINDOW)
+		vtm_http2_con_reset_stream(con, stream, frame->stream_id, VTM_HTTP2_FLOW_CONTROL_ERROR);
+
+	return VTM_HTTP2_NO_ERROR;
+}
+
+static int vtm_http2_con_on_field(void *arg, const char *name, size_t name_len, const char *value, size_t value_len)
+{
+	size_t i, prev_len;
+	const char *prev, *sep;
+	char *merged;
+	struct vtm_http2_stream *stream;
+
+	stream = arg;
+	if (!stream || stream->malformed)
+		return VTM_OK;
+
+	if (name_len == 0) {
+		stream->malformed = true;
+		return VTM_OK;
+	}
+
+	/* pseudo header fields */
+	if (name[0] == ':') {
+		if (stream->regular || stream->headers_done) {
+			stream->malformed = true;
+			return VTM_OK;
+		}
+
+		if (strcmp(name, ":method") == 0) {
+			if (stream->method_set || vtm_http_get_method(value, &stream->method) != VTM_OK)
+				stream->malformed = true;
+			stream->method_set = true;
+		}
+		else if (strcmp(name, ":path") == 0) {
+			if (stream->path || value_len == 0) {
+				stream->malformed = true;
+				return VTM_OK;
+			}
+			stream->path = vtm_str_copy(value);
+			if (!stream->path)
+				return vtm_err_get_code();
+		}
+		else if (strcmp(name, ":scheme") == 0) {
+			if (stream->scheme_set)
+				stream->malformed = true;
+			stream->scheme_set = true;
+		}
+		else if (strcmp(name, ":authority") == 0) {
+			if (stream->authority) {
+				stream->malformed = true;
+				return VTM_OK;
+			}
+			stream->authority = vtm_str_copy(value);
+			if (!stream->authority)
+				return vtm_err_get_code();
+		}
+		else {
+			stream->malformed = true;
+		}
+
+		return VTM_OK;
+	}
+
+	stream->regular = true;
+
+	for (i=0; i < name_len; i++) {
+		if (name[i] >= 'A' && name[i] <= 'Z') {
+			stream->malformed = true;
+			return VTM_OK;
+		}
+	}
+
+	/* trailers are not passed to the handler */
+	if (stream->headers_done)
+		return VTM_OK;
+
+	/* connection specific fields are not allowed */
+	if (strcmp(name, "connection") == 0 ||
+		strcmp(name, "keep-alive") == 0 ||
+		strcmp(name, "proxy-connection") == 0 ||
+		strcmp(name, "transfer-encoding") == 0 ||
+		strcmp(name, "upgrade") == 0 ||
+		(strcmp(name, "te") == 0 && strcmp(value, "trailers") != 0)) {
+		stream->malformed = true;
+		return VTM_OK;
+	}
+
+	if (!stream->headers) {
+		stream->headers = vtm_dataset_newh(VTM_DS_HINT_IGNORE_CASE);
+		if (!stream->headers)
+			return vtm_err_get_code();
+	}
+
+	prev = vtm_dataset_get_string(stream->headers, name);
+	if (!prev) {
+		vtm_dataset_set_string(stream->headers, name, value);
+		return VTM_OK;
+	}
+
+	/* cookies may be split into multiple fields */
+	sep = strcmp(name, "cookie") == 0 ? "; " : ", ";
+	prev_len = strlen(prev);
+
+	merged = malloc(prev_len + value_len + 3);
+	if (!merged) {
+		vtm_err_oom();
+		return vtm_err_get_code();
+	}
+
+	memcpy(merged, prev, prev_len);
+	memcpy(merged + prev_len, sep, 2);
+	memcpy(merged + prev_len + 2, value, value_len + 1);
+
+	vtm_dataset_set_string(stream->headers, name, merged);
+	free(merged);
+
+	return VTM_OK;
+}
+
+static bool vtm_http2_con_check_request(struct vtm_http2_stream *stream)
+{
+	if (!stream->method_set)
+		return false;
+
+	if (stream->method != VTM_HTTP_METHOD_CONNECT && (!stream->path || !stream->scheme_set))
+		return false;
+
+	/* authority replaces the host header */
+	if (stream->authority) {
+		if (!stream->headers) {
+			stream->headers = vtm_dataset_newh(VTM_DS_HINT_IGNORE_CASE);
+			if (!stream->headers)
+				return false;
+		}
+		if (!vtm_dataset_contains(stream->headers, VTM_HTTP_HEADER_HOST))
+			vtm_dataset_set_string(stream->headers, VTM_HTTP_HEADER_HOST, stream->authority);
+	}
+
+	return true;
+}
+
+static int vtm_http2_con_set_params(struct vtm_http2_stream *stream, char *query)
+{
+	char *name, *value, *next;
+
+	/* same rules as the HTTP/1.1 parser, values are not decoded */
+	for (name = query; name; name = next) {
+		next = strchr(name, '&');
+		if (next)
+			*next++ = '\0';
+
+		value = strchr(name, '=');
+		if (!value || value == name)
+			continue;
+		*value++ = '\0';
+
+		if (!stream->params) {
+			stream->params = vtm_dataset_new();
+			if (!stream->params)
+				return vtm_err_get_code();
+		}
+		vtm_dataset_set_string(stream->params, name, value);
+	}
+
+	return VTM_OK;
+}
+
+static void vtm_http2_con_fill_request(vtm_http2_con *con, struct vtm_http2_stream *stream, struct vtm_http_req *req)
+{
+	char *query;
+
+	query = stream->path ? strchr(stream->path, '?') : NULL;
+	if (query) {
+		*query++ = '\0';
+		vtm_http2_con_set_params(stream, query);
+	}
+
+	req->method = stream->method;
+	req->version = VTM_HTTP_VER_2;
+	req->path = stream->path ? stream->path : "";
+	req->headers = stream->headers;
+	req->params = stream->params;
+	req->body = stream->body ? stream->body->data : NULL;
+	req->body_len = stream->body ? stream->body->used : 0;
+	req->streamed = false;
+	req->usr_data = NULL;
+	req->con = con;
+	req->path_param_count = 0;
+
+	/* request owns headers and params now */
+	stream->headers = NULL;
+	stream->params = NULL;
+}
+
+static int vtm_http2_con_strip_padding(struct vtm_http2_frame *frame)
+{
+	size_t pad;
+
+	if (!(frame->flags & VTM_HTTP2_FLAG_PADDED))
+		return VTM_OK;
+
+	if (frame->len < 1)
+		return VTM_E_IO_PROTOCOL;
+
+	pad = frame->payload[0];
+	if (pad >= frame->len)
+		return VTM_E_IO_PROTOCOL;
+
+	frame->payload++;
+	frame->len -= pad + 1;
+
+	return VTM_OK;
+}
+
+static void vtm_http2_con_consume(vtm_http2_con *con, size_t len)
+{
+	/* consumed bytes are returned once less than half of
+	   the window is left */
+	con->recv_consumed += len;
+	if (con->recv_consumed == 0 || con->recv_window >= VTM_HTTP2_CON_WINDOW_SIZE / 2)
+		return;
+
+	vtm_http2_con_put_window_update(con, 0, (uint32_t) con->recv_consumed);
+	con->recv_window += con->recv_consumed;
+	con->recv_consumed = 0;
+}
+
+static void vtm_http2_con_consume_stream(vtm_http2_con *con, struct vtm_http2_stream *stream, size_t len)
+{
+	int64_t inc;
+
+	/* body of a single stream is limited by the maximum body size,
+	   the connection window limits all streams together */
+	stream->recv_window -= len;
+	inc = VTM_HTTP2_WINDOW_SIZE - stream->recv_window;
+	if (inc >= VTM_HTTP2_WINDOW_SIZE / 2) {
+		vtm_http2_con_put_window_update(con, stream->id, (uint32_t) inc);
+		stream->recv_window = VTM_HTTP2_WINDOW_SIZE;
+	}
+}
+
+static int vtm_http2_con_encode_headers(vtm_http2_con *con, int status, const char *headers, size_t headers_len)
+{
+	int rc;
+	char status_str[4];
+	const char *line, *end, *colon, *value, *value_end;
+	char *name;
+	size_t i, name_len;
+	enum vtm_http2_hpack_index idx;
+	struct vtm_buf *out;
+
+	out = &con->hblock;
+	vtm_buf_clear(out);
+
+	rc = vtm_http2_hpack_encode_begin(&con->enc, out);
+	if (rc != VTM_OK)
+		return rc;
+
+	status_str[0] = (char) ('0' + (status / 100) % 10);
+	status_str[1] = (char) ('0' + (status / 10) % 10);
+	status_str[2] = (char) ('0' + status % 10);
+	status_str[3] = '\0';
+
+	rc = vtm_http2_hpack_encode(&con->enc, out, ":status", 7, status_str, 3, VTM_HTTP2_HPACK_INDEX);
+	if (rc != VTM_OK)
+		return rc;
+
+	/* header lines of the response, "Name: value\r\n" */
+	end = headers + headers_len;
+	for (line = headers; line < end; line = value_end + 2) {
+		value_end = memchr(line, '\r', (size_t) (end - line));
+		if (!value_end || value_end + 1 >= end)
+			break;
+
+		colon = memchr(line, ':', (size_t) (value_end - line));
+		if (!colon)
+			continue;
+
+		value = colon + 1;
+		while (value < value_end && *value == ' ')
+			value++;
+
+		/* names must be lower case */
+		name_len = (size_t) (colon - line);
+		vtm_buf_clear(&con->scratch);
+		rc = vtm_buf_putm(&con->scratch, line, name_len);
+		if (rc != VTM_OK)
+			return rc;
+
+		name = (char*) con->scratch.data;
+		for (i=0; i < name_len; i++) {
+			if (name[i] >= 'A' && name[i] <= 'Z')
+				name[i] = (char) (name[i] - 'A' + 'a');
+		}
+
+		if (vtm_http2_con_name_eq(name, name_len, "connection") ||
+			vtm_http2_con_name_eq(name, name_len, "keep-alive") ||
+			vtm_http2_con_name_eq(name, name_len, "proxy-connection") ||
+			vtm_http2_con_name_eq(name, name_len, "transfer-encoding") ||
+			vtm_http2_con_name_eq(name, name_len, "upgrade"))
+			continue;
+
+		if (vtm_http2_con_name_eq(name, name_len, "set-cookie"))
+			idx = VTM_HTTP2_HPACK_NEVER_INDEX;
+		else if (name_len + (size_t) (value_end - value) + 32 > VTM_HTTP2_HPACK_TABLE_SIZE / 4)
+			idx = VTM_HTTP2_HPACK_NO_INDEX;
+		else
+			idx = VTM_HTTP2_HPACK_INDEX;
+
+		rc = vtm_http2_hpack_encode(&con->enc, out, name, name_len,
+			value, (size_t) (value_end - value), idx);
+		if (rc != VTM_OK)
+			return rc;
+	}
+
+	return VTM_OK;
+}
+
+static void vtm_http2_con_put_header_block(vtm_http2_con *con, uint32_t stream_id, bool end_stream)
+{
+	size_t pos, len;
+	uint8_t type, flags;
+
+	pos = 0;
+	type = VTM_HTTP2_FRAME_HEADERS;
+	flags = end_stream ? VTM_HTTP2_FLAG_END_STREAM : 0;
+
+	do {
+		len = VTM_MIN(con->hblock.used - pos, con->peer_frame_size);
+		if (pos + len == con->hblock.used)
+			flags |= VTM_HTTP2_FLAG_END_HEADERS;
+
+		vtm_http2_con_put_frame_header(&con->sendbuf, len, type, flags, stream_id);
+		vtm_buf_putm(&con->sendbuf, con->hblock.data + pos, len);
+
+		pos += len;
+		type = VTM_HTTP2_FRAME_CONTINUATION;
+		flags = 0;
+	} while (pos < con->hblock.used);
+
+	vtm_buf_clear(&con->hblock);
+}
+
+static void vtm_http2_con_frame_data(vtm_http2_con *con)
+{
+	bool progress;
+	struct vtm_http2_stream *stream, *next;
+
+	/*
+	 * after h2c upgrade the response to stream 1 is ready before the
+	 * client sent its SETTINGS, some clients cannot buffer a whole
+	 * window of DATA behind the 101 response
+	 */
+	if (!con->settings)
+		return;
+
+	/* round robin over streams, one frame each */
+	do {
+		progress = false;
+
+		for (stream = con->streams; stream; stream = next) {
+			next = stream->next;
+
+			if (VTM_BUF_GET_AVAIL_TOTAL(&con->sendbuf) >= VTM_HTTP2_SEND_WATERMARK ||
+				con->sendbuf.err != VTM_OK)
+				return;
+
+			if (stream->state != VTM_HTTP2_STREAM_RESPONSE)
+				continue;
+
+			if (vtm_http2_con_frame_stream(con, stream))
+				progress = true;
+		}
+	} while (progress);
+}
+
+static bool vtm_http2_con_frame_stream(vtm_http2_con *con, struct vtm_http2_stream *stream)
+{
+	size_t max, len;
+	uint8_t flags;
+
+	max = (size_t) VTM_MIN(con->send_window, stream->send_window);
+	max = VTM_MIN(max, con->peer_frame_size);
+
+	if (stream->out_len > 0) {
+		if (max == 0)
+			return false;
+
+		len = VTM_MIN(max, stream->out_len);
+		flags = (len == stream->out_len && !stream->out_se) ? VTM_HTTP2_FLAG_END_STREAM : 0;
+
+		vtm_http2_con_put_frame_header(&con->sendbuf, len, VTM_HTTP2_FRAME_DATA, flags, stream->id);
+		vtm_buf_putm(&con->sendbuf, stream->out_data, len);
+
+		stream->out_data += len;
+		stream->out_len -= len;
+		con->send_window -= len;
+		stream->send_window -= len;
+
+		if (flags & VTM_HTTP2_FLAG_END_STREAM)
+			vtm_http2_con_stream_remove(con, stream);
+
+		return true;
+	}
+
+	if (stream->out_se)
+		return vtm_http2_con_frame_emitter(con, stream, max);
+
+	/* only happens if an emitter ended early */
+	vtm_http2_con_put_frame_header(&con->sendbuf, 0, VTM_HTTP2_FRAME_DATA, VTM_HTTP2_FLAG_END_STREAM, stream->id);
+	vtm_http2_con_stream_remove(con, stream);
+
+	return true;
+}
+
+static bool vtm_http2_con_frame_emitter(vtm_http2_con *con, struct vtm_http2_stream *stream, size_t max)
+{
+	int rc;
+	size_t len, read;
+	uint8_t flags;
+	unsigned char *dst;
+	struct vtm_socket_emitter *se;
+
+	/* skip empty emitters */
+	while (stream->out_se && stream->out_se_left == 0) {
+		se = stream->out_se;
+		stream->out_se = se->next;
+		vtm_socket_emitter_free_single(se);
+		stream->out_se_left = stream->out_se ? stream->out_se->length : 0;
+	}
+
+	if (!stream->out_se) {
+		vtm_http2_con_put_frame_header(&con->sendbuf, 0, VTM_HTTP2_FRAME_DATA, VTM_HTTP2_FLAG_END_STREAM, stream->id);
+		vtm_http2_con_stream_remove(con, stream);
+		return true;
+	}
+
+	if (max == 0)
+		return false;
+
+	len = (size_t) VTM_MIN(max, stream->out_se_left);
+	if (vtm_buf_ensure(&con->sendbuf, VTM_HTTP2_FRAME_HEADER_LEN + len) != VTM_OK)
+		return false;
+
+	/* data is read directly behind the frame header */
+	dst = VTM_BUF_PUT_PTR(&con->sendbuf) + VTM_HTTP2_FRAME_HEADER_LEN;
+	rc = vtm_socket_emitter_read(stream->out_se, dst, len, &read);
+	if (rc != VTM_OK || read == 0) {
+		vtm_http2_con_reset_stream(con, stream, stream->id, VTM_HTTP2_INTERNAL_ERROR);
+		return true;
+	}
+
+	stream->out_se_left -= read;
+	if (stream->out_se_left == 0) {
+		se = stream->out_se;
+		stream->out_se = se->next;
+		vtm_socket_emitter_free_single(se);
+		stream->out_se_left = stream->out_se ? stream->out_se->length : 0;
+	}
+
+	flags = stream->out_se ? 0 : VTM_HTTP2_FLAG_END_STREAM;
+
+	/* space is reserved, so the header is written in front of the data */
+	vtm_http2_con_put_frame_header(&con->sendbuf, read, VTM_HTTP2_FRAME_DATA, flags, stream->id);
+	VTM_BUF_PUT_INC(&con->sendbuf, read);
+
+	con->send_window -= read;
+	stream->send_window -= read;
+
+	if (flags & VTM_HTTP2_FLAG_END_STREAM)
+		vtm_http2_con_stream_remove(con, stream);
+
+	return true;
+}
+
+static void vtm_http2_con_retain_output(struct vtm_http2_stream *stream)
+{
+	if (stream->out_len == 0)
+		return;
+
+	/* remaining data is copied because the memory is reused */
+	stream->out_buf = vtm_buf_new(VTM_BYTEORDER_BE);
+	if (!stream->out_buf)
+		return;
+
+	vtm_buf_putm(stream->out_buf, stream->out_data, stream->out_len);
+	stream->out_data = stream->out_buf->data;
+}
+
+static void vtm_http2_con_put_frame_header(struct vtm_buf *buf, size_t len, uint8_t type, uint8_t flags, uint32_t stream_id)
+{
+	unsigned char hdr[VTM_HTTP2_FRAME_HEADER_LEN];
+
+	hdr[0] = (unsigned char) ((len >> 16) & 0xff);
+	hdr[1] = (unsigned char) ((len >> 8) & 0xff);
+	hdr[2] = (unsigned char) (len & 0xff);
+	hdr[3] = type;
+	hdr[4] = flags;
+	hdr[5] = (unsigned char) ((stream_id >> 24) & 0x7f);
+	hdr[6] = (unsigned char) ((stream_id >> 16) & 0xff);
+	hdr[7] = (unsigned char) ((stream_id >> 8) & 0xff);
+	hdr[8] = (unsigned char) (stream_id & 0xff);
+
+	vtm_buf_putm(buf, hdr, VTM_HTTP2_FRAME_HEADER_LEN);
+}
+
+static void vtm_http2_con_put_u32(struct vtm_buf *buf, uint32_t val)
+{
+	vtm_buf_putc(buf, (unsigned char) ((val >> 24) & 0xff));
+	vtm_buf_putc(buf, (unsigned char) ((val >> 16) & 0xff));
+	vtm_buf_putc(buf, (unsigned char) ((val >> 8) & 0xff));
+	vtm_buf_putc(buf, (unsigned char) (val & 0xff));
+}
+
+static void vtm_http2_con_put_settings(vtm_http2_con *con)
+{
+	static const unsigned char settings[] = {
+		0x00, VTM_HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS,
+		0x00, 0x00, 0x00, VTM_HTTP2_MAX_STREAMS,
+		0x00, VTM_HTTP2_SETTINGS_INITIAL_WINDOW_SIZE,
+		(VTM_HTTP2_WINDOW_SIZE >> 24) & 0xff, (VTM_HTTP2_WINDOW_SIZE >> 16) & 0xff,
+		(VTM_HTTP2_WINDOW_SIZE >> 8) & 0xff, VTM_HTTP2_WINDOW_SIZE & 0xff,
+		0x00, VTM_HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE,
+		(VTM_HTTP2_MAX_HEADER_LIST >> 24) & 0xff, (VTM_HTTP2_MAX_HEADER_LIST >> 16) & 0xff,
+		(VTM_HTTP2_MAX_HEADER_LIST >> 8) & 0xff, VTM_HTTP2_MAX_HEADER_LIST & 0xff
+	};
+
+	vtm_http2_con_put_frame_header(&con->sendbuf, sizeof(settings), VTM_HTTP2_FRAME_SETTINGS, 0, 0);
+	vtm_buf_putm(&con->sendbuf, settings, sizeof(settings));
+}
+
+static void vtm_http2_con_put_window_update(vtm_http2_con *con, uint32_t stream_id, uint32_t inc)
+{
+	vtm_http2_con_put_frame_header(&con->sendbuf, 4, VTM_HTTP2_FRAME_WINDOW_UPDATE, 0, stream_id);
+	vtm_http2_con_put_u32(&con->sendbuf, inc);
+}
+
+static void vtm_http2_con_reset_stream(vtm_http2_con *con, struct vtm_http2_stream *stream, uint32_t stream_id, uint32_t code)
+{
+	vtm_http2_con_put_frame_header(&con->sendbuf, 4, VTM_HTTP2_FRAME_RST_STREAM, 0, stream_id);
+	vtm_http2_con_put_u32(&con->sendbuf, code);
+
+	if (stream)
+		vtm_http2_con_stream_remove(con, stream);
+}
+
+static void vtm_http2_con_goaway(vtm_http2_con *con, uint32_t code)
+{
+	/* no more DATA is produced, pending frames are flushed */
+	con->failed = true;
+
+	vtm_http2_con_put_frame_header(&con->sendbuf, 8, VTM_HTTP2_FRAME_GOAWAY, 0, 0);
+	vtm_http2_con_put_u32(&con->sendbuf, con->last_stream_id);
+	vtm_http2_con_put_u32(&con->sendbuf, code);
+}
+
+static struct vtm_http2_stream* vtm_http2_con_stream_new(vtm_http2_con *con, uint32_t id)
+{
+	struct vtm_http2_stream *stream;
+
+	stream = calloc(1, sizeof(*stream));
+	if (!stream) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	stream->id = id;
+	stream->state = VTM_HTTP2_STREAM_OPEN;
+	stream->send_window = con->peer_window;
+	stream->recv_window = VTM_HTTP2_WINDOW_SIZE;
+
+	stream->next = con->streams;
+	con->streams = stream;
+	con->stream_count++;
+
+	return stream;
+}
+
+static struct vtm_http2_stream* vtm_http2_con_stream_find(vtm_http2_con *con, uint32_t id)
+{
+	struct vtm_http2_stream *stream;
+
+	for (stream = con->streams; stream; stream = stream->next) {
+		if (stream->id == id)
+			return stream;
+	}
+
+	return NULL;
+}
+
+static void vtm_http2_con_stream_remove(vtm_http2_con *con, struct vtm_http2_stream *stream)
+{
+	struct vtm_http2_stream **link;
+
+	for (link = &con->streams; *link; link = &(*link)->next) {
+		if (*link == stream) {
+			*link = stream->next;
+			con->stream_count--;
+			break;
+		}
+	}
+
+	vtm_http2_con_stream_release_request(con, stream);
+	vtm_http2_con_stream_release_response(stream);
+	free(stream);
+}
+
+static void vtm_http2_con_stream_release_request(vtm_http2_con *con, struct vtm_http2_stream *stream)
+{
+	free(stream->path);
+	free(stream->authority);
+	vtm_dataset_free(stream->headers);
+	vtm_dataset_free(stream->params);
+	if (stream->body) {
+		/* buffered bytes are consumed now */
+		vtm_http2_con_consume(con, stream->body->used);
+		vtm_buf_free(stream->body);
+	}
+
+	stream->path = NULL;
+	stream->authority = NULL;
+	stream->headers = NULL;
+	stream->params = NULL;
+	stream->body = NULL;
+}
+
+static void vtm_http2_con_stream_release_response(struct vtm_http2_stream *stream)
+{
+	if (stream->out_fr)
+		stream->out_fr(stream->out_arg);
+
+	if (stream->out_se)
+		vtm_socket_emitter_free_chain(stream->out_se);
+
+	if (stream->out_buf)
+		vtm_buf_free(stream->out_buf);
+
+	stream->out_fr = NULL;
+	stream->out_se = NULL;
+	stream->out_buf = NULL;
+	stream->out_len = 0;
+}
+
+static uint32_t vtm_http2_get_u32(const unsigned char *src)
+{
+	return ((uint32_t) src[0] << 24) | ((uint32_t) src[1] << 16) |
+		((uint32_t) src[2] << 8) | (uint32_t) src[3];
+}
+
+static bool vtm_http2_con_name_eq(const char *name, size_t len, const char *str)
+{
+	return strlen(str) == len && memcmp(name, str, len) == 0;
+}
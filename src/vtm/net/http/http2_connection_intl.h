@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#ifndef VTM_NET_HTTP_HTTP2_CONNECTION_INTL_H_
+#define VTM_NET_HTTP_HTTP2_CONNECTION_INTL_H_
+
+#include <vtm/core/types.h>
+#include <vtm/net/common.h>
+#include <vtm/net/socket.h>
+#include <vtm/net/socket_emitter.h>
+#include <vtm/net/http/http.h>
+#include <vtm/net/http/http_request.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** client connection preface */
+#define VTM_HTTP2_PREFACE        "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define VTM_HTTP2_PREFACE_LEN    24
+
+/** protocols offered by ALPN when HTTP/2 is enabled */
+#define VTM_HTTP2_ALPN           "h2,http/1.1"
+#define VTM_HTTP2_ALPN_ID        "h2"
+
+typedef struct vtm_http2_con vtm_http2_con;
+
+/** response body that is handed over to a stream */
+struct vtm_http2_body
+{
+	const void                 *data;
+	size_t                     len;
+	bool                       copy;     /**< data is only valid during the call */
+	void                       (*fr)(void *arg);
+	void                       *fr_arg;
+	struct vtm_socket_emitter  *se;      /**< sent after data */
+};
+
+vtm_http2_con* vtm_http2_con_new(vtm_socket *sock);
+void vtm_http2_con_free(vtm_http2_con *con);
+
+vtm_socket* vtm_http2_con_get_socket(vtm_http2_con *con);
+
+/* data that was already received by the HTTP/1.1 connection */
+int vtm_http2_con_feed(vtm_http2_con *con, const void *data, size_t len);
+
+/* pending output that is written before any frame */
+void vtm_http2_con_set_head(vtm_http2_con *con, struct vtm_socket_emitter *se);
+
+/* h2c upgrade, the request becomes stream 1 */
+int vtm_http2_con_upgrade(vtm_http2_con *con, const char *settings, struct vtm_http_req *req, uint32_t *stream_id);
+
+/* requests */
+int vtm_http2_con_get_request(vtm_http2_con *con, struct vtm_http_req *req, uint32_t *stream_id);
+void vtm_http2_con_end_request(vtm_http2_con *con, uint32_t stream_id);
+
+/* responses */
+int vtm_http2_con_respond(vtm_http2_con *con, uint32_t stream_id, int status, const char *headers, size_t headers_len, struct vtm_http2_body *body);
+int vtm_http2_con_flush(vtm_http2_con *con);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_NET_HTTP_HTTP2_CONNECTION_INTL_H_ */
@@ -0,0 +1,727 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include "http2_hpack_intl.h"
+
+#include <stdlib.h> /* malloc(), realloc(), free() */
+#include <string.h> /* memcpy(), memcmp(), memmove(), strlen(), strncmp() */
+#include <vtm/core/error.h>
+
+#define VTM_HTTP2_HPACK_ENTRY_OVERHEAD   32
+#define VTM_HTTP2_HPACK_STATIC_COUNT     61
+
+struct vtm_http2_hpack_static
+{
+	const char *name;
+	const char *value;
+};
+
+struct vtm_http2_huff_code
+{
+	uint32_t code;
+	uint8_t len;
+};
+
+/* RFC 7541 Appendix A */
+static const struct vtm_http2_hpack_static vtm_http2_hpack_static_table[VTM_HTTP2_HPACK_STATIC_COUNT] = {
+	{":authority", ""},
+	{":method", "GET"},
+	{":method", "POST"},
+	{":path", "/"},
+	{":path", "/index.html"},
+	{":scheme", "http"},
+	{":scheme", "https"},
+	{":status", "200"},
+	{":status", "204"},
+	{":status", "206"},
+	{":status", "304"},
+	{":status", "400"},
+	{":status", "404"},
+	{":status", "500"},
+	{"accept-charset", ""},
+	{"accept-encoding", "gzip, deflate"},
+	{"accept-language", ""},
+	{"accept-ranges", ""},
+	{"accept", ""},
+	{"access-control-allow-origin", ""},
+	{"age", ""},
+	{"allow", ""},
+	{"authorization", ""},
+	{"cache-control", ""},
+	{"content-disposition", ""},
+	{"content-encoding", ""},
+	{"content-language", ""},
+	{"content-length", ""},
+	{"content-location", ""},
+	{"content-range", ""},
+	{"content-type", ""},
+	{"cookie", ""},
+	{"date", ""},
+	{"etag", ""},
+	{"expect", ""},
+	{"expires", ""},
+	{"from", ""},
+	{"host", ""},
+	{"if-match", ""},
+	{"if-modified-since", ""},
+	{"if-none-match", ""},
+	{"if-range", ""},
+	{"if-unmodified-since", ""},
+	{"last-modified", ""},
+	{"link", ""},
+	{"location", ""},
+	{"max-forwards", ""},
+	{"proxy-authenticate", ""},
+	{"proxy-authorization", ""},
+	{"range", ""},
+	{"referer", ""},
+	{"refresh", ""},
+	{"retry-after", ""},
+	{"server", ""},
+	{"set-cookie", ""},
+	{"strict-transport-security", ""},
+	{"transfer-encoding", ""},
+	{"user-agent", ""},
+	{"vary", ""},
+	{"via", ""},
+	{"www-authenticate", ""},
+};
+
+/* RFC 7541 Appendix B, last entry is EOS */
+static const struct vtm_http2_huff_code vtm_http2_huff_codes[257] = {
+	{0x00001ff8, 13}, {0x007fffd8, 23}, {0x0fffffe2, 28}, {0x0fffffe3, 28},
+	{0x0fffffe4, 28}, {0x0fffffe5, 28}, {0x0fffffe6, 28}, {0x0fffffe7, 28},
+	{0x0fffffe8, 28}, {0x00ffffea, 24}, {0x3ffffffc, 30}, {0x0fffffe9, 28},
+	{0x0fffffea, 28}, {0x3ffffffd, 30}, {0x0fffffeb, 28}, {0x0fffffec, 28},
+	{0x0fffffed, 28}, {0x0fffffee, 28}, {0x0fffffef, 28}, {0x0ffffff0, 28},
+	{0x0ffffff1, 28}, {0x0ffffff2, 28}, {0x3ffffffe, 30}, {0x0ffffff3, 28},
+	{0x0ffffff4, 28}, {0x0ffffff5, 28}, {0x0ffffff6, 28}, {0x0ffffff7, 28},
+	{0x0ffffff8, 28}, {0x0ffffff9, 28}, {0x0ffffffa, 28}, {0x0ffffffb, 28},
+	{0x00000014,  6}, {0x000003f8, 10}, {0x000003f9, 10}, {0x00000ffa, 12},
+	{0x00001ff9, 13}, {0x00000015,  6}, {0x000000f8,  8}, {0x000007fa, 11},
+	{0x000003fa, 10}, {0x000003fb, 10}, {0x000000f9,  8}, {0x000007fb, 11},
+	{0x000000fa,  8}, {0x00000016,  6}, {0x00000017,  6}, {0x00000018,  6},
+	{0x00000000,  5}, {0x00000001,  5}, {0x00000002,  5}, {0x00000019,  6},
+	{0x0000001a,  6}, {0x0000001b,  6}, {0x0000001c,  6}, {0x0000001d,  6},
+	{0x0000001e,  6}, {0x0000001f,  6}, {0x0000005c,  7}, {0x000000fb,  8},
+	{0x00007ffc, 15}, {0x00000020,  6}, {0x00000ffb, 12}, {0x000003fc, 10},
+	{0x00001ffa, 13}, {0x00000021,  6}, {0x0000005d,  7}, {0x0000005e,  7},
+	{0x0000005f,  7}, {0x00000060,  7}, {0x00000061,  7}, {0x00000062,  7},
+	{0x00000063,  7}, {0x00000064,  7}, {0x00000065,  7}, {0x00000066,  7},
+	{0x00000067,  7}, {0x00000068,  7}, {0x00000069,  7}, {0x0000006a,  7},
+	{0x0000006b,  7}, {0x0000006c,  7}, {0x0000006d,  7}, {0x0000006e,  7},
+	{0x0000006f,  7}, {0x00000070,  7}, {0x00000071,  7}, {0x00000072,  7},
+	{0x000000fc,  8}, {0x00000073,  7}, {0x000000fd,  8}, {0x00001ffb, 13},
+	{0x0007fff0, 19}, {0x00001ffc, 13}, {0x00003ffc, 14}, {0x00000022,  6},
+	{0x00007ffd, 15}, {0x00000003,  5}, {0x00000023,  6}, {0x00000004,  5},
+	{0x00000024,  6}, {0x00000005,  5}, {0x00000025,  6}, {0x00000026,  6},
+	{0x00000027,  6}, {0x00000006,  5}, {0x00000074,  7}, {0x00000075,  7},
+	{0x00000028,  6}, {0x00000029,  6}, {0x0000002a,  6}, {0x00000007,  5},
+	{0x0000002b,  6}, {0x00000076,  7}, {0x0000002c,  6}, {0x00000008,  5},
+	{0x00000009,  5}, {0x0000002d,  6}, {0x00000077,  7}, {0x00000078,  7},
+	{0x00000079,  7}, {0x0000007a,  7}, {0x0000007b,  7}, {0x00007ffe, 15},
+	{0x000007fc, 11}, {0x00003ffd, 14}, {0x00001ffd, 13}, {0x0ffffffc, 28},
+	{0x000fffe6, 20}, {0x003fffd2, 22}, {0x000fffe7, 20}, {0x000fffe8, 20},
+	{0x003fffd3, 22}, {0x003fffd4, 22}, {0x003fffd5, 22}, {0x007fffd9, 23},
+	{0x003fffd6, 22}, {0x007fffda, 23}, {0x007fffdb, 23}, {0x007fffdc, 23},
+	{0x007fffdd, 23}, {0x007fffde, 23}, {0x00ffffeb, 24}, {0x007fffdf, 23},
+	{0x00ffffec, 24}, {0x00ffffed, 24}, {0x003fffd7, 22}, {0x007fffe0, 23},
+	{0x00ffffee, 24}, {0x007fffe1, 23}, {0x007fffe2, 23}, {0x007fffe3, 23},
+	{0x007fffe4, 23}, {0x001fffdc, 21}, {0x003fffd8, 22}, {0x007fffe5, 23},
+	{0x003fffd9, 22}, {0x007fffe6, 23}, {0x007fffe7, 23}, {0x00ffffef, 24},
+	{0x003fffda, 22}, {0x001fffdd, 21}, {0x000fffe9, 20}, {0x003fffdb, 22},
+	{0x003fffdc, 22}, {0x007fffe8, 23}, {0x007fffe9, 23}, {0x001fffde, 21},
+	{0x007fffea, 23}, {0x003fffdd, 22}, {0x003fffde, 22}, {0x00fffff0, 24},
+	{0x001fffdf, 21}, {0x003fffdf, 22}, {0x007fffeb, 23}, {0x007fffec, 23},
+	{0x001fffe0, 21}, {0x001fffe1, 21}, {0x003fffe0, 22}, {0x001fffe2, 21},
+	{0x007fffed, 23}, {0x003fffe1, 22}, {0x007fffee, 23}, {0x007fffef, 23},
+	{0x000fffea, 20}, {0x003fffe2, 22}, {0x003fffe3, 22}, {0x003fffe4, 22},
+	{0x007ffff0, 23}, {0x003fffe5, 22}, {0x003fffe6, 22}, {0x007ffff1, 23},
+	{0x03ffffe0, 26}, {0x03ffffe1, 26}, {0x000fffeb, 20}, {0x0007fff1, 19},
+	{0x003fffe7, 22}, {0x007ffff2, 23}, {0x003fffe8, 22}, {0x01ffffec, 25},
+	{0x03ffffe2, 26}, {0x03ffffe3, 26}, {0x03ffffe4, 26}, {0x07ffffde, 27},
+	{0x07ffffdf, 27}, {0x03ffffe5, 26}, {0x00fffff1, 24}, {0x01ffffed, 25},
+	{0x0007fff2, 19}, {0x001fffe3, 21}, {0x03ffffe6, 26}, {0x07ffffe0, 27},
+	{0x07ffffe1, 27}, {0x03ffffe7, 26}, {0x07ffffe2, 27}, {0x00fffff2, 24},
+	{0x001fffe4, 21}, {0x001fffe5, 21}, {0x03ffffe8, 26}, {0x03ffffe9, 26},
+	{0x0ffffffd, 28}, {0x07ffffe3, 27}, {0x07ffffe4, 27}, {0x07ffffe5, 27},
+	{0x000fffec, 20}, {0x00fffff3, 24}, {0x000fffed, 20}, {0x001fffe6, 21},
+	{0x003fffe9, 22}, {0x001fffe7, 21}, {0x001fffe8, 21}, {0x007ffff3, 23},
+	{0x003fffea, 22}, {0x003fffeb, 22}, {0x01ffffee, 25}, {0x01ffffef, 25},
+	{0x00fffff4, 24}, {0x00fffff5, 24}, {0x03ffffea, 26}, {0x007ffff4, 23},
+	{0x03ffffeb, 26}, {0x07ffffe6, 27}, {0x03ffffec, 26}, {0x03ffffed, 26},
+	{0x07ffffe7, 27}, {0x07ffffe8, 27}, {0x07ffffe9, 27}, {0x07ffffea, 27},
+	{0x07ffffeb, 27}, {0x0ffffffe, 28}, {0x07ffffec, 27}, {0x07ffffed, 27},
+	{0x07ffffee, 27}, {0x07ffffef, 27}, {0x07fffff0, 27}, {0x03ffffee, 26},
+	{0x3fffffff, 30},
+};
+
+/* canonical decoding tables indexed by code length */
+static const uint32_t vtm_http2_huff_first[31] = {
+	0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000014, 0x0000005c,
+	0x000000f8, 0x00000000, 0x000003f8, 0x000007fa, 0x00000ffa, 0x00001ff8, 0x00003ffc, 0x00007ffc,
+	0x00000000, 0x00000000, 0x00000000, 0x0007fff0, 0x000fffe6, 0x001fffdc, 0x003fffd2, 0x007fffd8,
+	0x00ffffea, 0x01ffffec, 0x03ffffe0, 0x07ffffde, 0x0fffffe2, 0x00000000, 0x3ffffffc
+};
+
+static const uint32_t vtm_http2_huff_count[31] = {
+	  0,   0,   0,   0,   0,  10,  26,  32,
+	  6,   0,   5,   3,   2,   6,   2,   3,
+	  0,   0,   0,   3,   8,  13,  26,  29,
+	 12,   4,  15,  19,  29,   0,   4
+};
+
+static const uint32_t vtm_http2_huff_offset[31] = {
+	  0,   0,   0,   0,   0,   0,  10,  36,
+	 68,   0,  74,  79,  82,  84,  90,  92,
+	  0,   0,   0,  95,  98, 106, 119, 145,
+	174, 186, 190, 205, 224,   0, 253
+};
+
+static const uint16_t vtm_http2_huff_symbols[257] = {
+	 48,  49,  50,  97,  99, 101, 105, 111, 115, 116,  32,  37,  45,  46,  47,  51,
+	 52,  53,  54,  55,  56,  57,  61,  65,  95,  98, 100, 102, 103, 104, 108, 109,
+	110, 112, 114, 117,  58,  66,  67,  68,  69,  70,  71,  72,  73,  74,  75,  76,
+	 77,  78,  79,  80,  81,  82,  83,  84,  85,  86,  87,  89, 106, 107, 113, 118,
+	119, 120, 121, 122,  38,  42,  44,  59,  88,  90,  33,  34,  40,  41,  63,  39,
+	 43, 124,  35,  62,   0,  36,  64,  91,  93, 126,  94, 125,  60,  96, 123,  92,
+	195, 208, 128, 130, 131, 162, 184, 194, 224, 226, 153, 161, 167, 172, 176, 177,
+	179, 209, 216, 217, 227, 229, 230, 129, 132, 133, 134, 136, 146, 154, 156, 160,
+	163, 164, 169, 170, 173, 178, 181, 185, 186, 187, 189, 190, 196, 198, 228, 232,
+	233,   1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150, 151, 152, 155, 157,
+	158, 165, 166, 168, 174, 175, 180, 182, 183, 188, 191, 197, 231, 239,   9, 142,
+	144, 145, 148, 159, 171, 206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193,
+	200, 201, 202, 205, 210, 213, 218, 219, 238, 240, 242, 243, 255, 203, 204, 211,
+	212, 214, 221, 222, 223, 241, 244, 245, 246, 247, 248, 250, 251, 252, 253, 254,
+	  2,   3,   4,   5,   6,   7,   8,  11,  12,  14,  15,  16,  17,  18,  19,  20,
+	 21,  23,  24,  25,  26,  27,  28,  29,  30,  31, 127, 220, 249,  10,  13,  22,
+	256
+};
+
+/* forward declaration */
+static int vtm_http2_hpack_get_int(const unsigned char **p, const unsigned char *end, unsigned int prefix, size_t *out);
+static int vtm_http2_hpack_get_str(const unsigned char **p, const unsigned char *end, struct vtm_buf *scratch, size_t *off, size_t *len);
+static int vtm_http2_hpack_lookup(struct vtm_http2_hpack *hp, size_t idx, const char **name, size_t *name_len, const char **value, size_t *value_len);
+static int vtm_http2_hpack_insert(struct vtm_http2_hpack *hp, const char *name, size_t name_len, const char *value, size_t value_len);
+static void vtm_http2_hpack_evict(struct vtm_http2_hpack *hp, size_t max_size);
+static int vtm_http2_hpack_put_int(struct vtm_buf *out, unsigned char first, unsigned int prefix, size_t val);
+static int vtm_http2_hpack_put_str(struct vtm_buf *out, const char *src, size_t len);
+
+void vtm_http2_hpack_init(struct vtm_http2_hpack *hp, size_t max_size)
+{
+	hp->entries = NULL;
+	hp->count = 0;
+	hp->cap = 0;
+	hp->size = 0;
+	hp->max_size = max_size;
+	hp->limit = max_size;
+	hp->update_min = max_size;
+	hp->update_pending = false;
+}
+
+void vtm_http2_hpack_release(struct vtm_http2_hpack *hp)
+{
+	vtm_http2_hpack_evict(hp, 0);
+	free(hp->entries);
+	hp->entries = NULL;
+	hp->cap = 0;
+}
+
+void vtm_http2_hpack_set_limit(struct vtm_http2_hpack *hp, size_t limit)
+{
+	size_t max_size;
+
+	hp->limit = limit;
+
+	/* encoder never uses more than the default */
+	max_size = limit < VTM_HTTP2_HPACK_TABLE_SIZE ? limit : VTM_HTTP2_HPACK_TABLE_SIZE;
+	if (max_size == hp->max_size)
+		return;
+
+	vtm_http2_hpack_evict(hp, max_size);
+	hp->max_size = max_size;
+
+	if (!hp->update_pending || max_size < hp->update_min)
+		hp->update_min = max_size;
+	hp->update_pending = true;
+}
+
+int vtm_http2_hpack_decode(struct vtm_http2_hpack *hp, const void *src, size_t len, size_t limit, struct vtm_buf *scratch, vtm_http2_hpack_field_cb cb, void *arg)
+{
+	int rc;
+	const unsigned char *p, *end;
+	unsigned char c;
+	size_t idx, total;
+	size_t name_off, value_off;
+	const char *name, *value;
+	size_t name_len, value_len;
+	bool fields, indexing;
+
+	p = src;
+	end = p + len;
+	total = 0;
+	fields = false;
+
+	while (p < end) {
+		c = *p;
+		vtm_buf_clear(scratch);
+
+		/* dynamic table size update, only allowed at block start */
+		if ((c & 0xe0) == 0x20) {
+			if (fields)
+				return VTM_E_IO_PROTOCOL;
+			rc = vtm_http2_hpack_get_int(&p, end, 5, &idx);
+			if (rc != VTM_OK || idx > hp->limit)
+				return VTM_E_IO_PROTOCOL;
+			vtm_http2_hpack_evict(hp, idx);
+			hp->max_size = idx;
+			continue;
+		}
+
+		fields = true;
+
+		/* indexed header field */
+		if (c & 0x80) {
+			rc = vtm_http2_hpack_get_int(&p, end, 7, &idx);
+			if (rc != VTM_OK)
+				return rc;
+			rc = vtm_http2_hpack_lookup(hp, idx, &name, &name_len, &value, &value_len);
+			if (rc != VTM_OK)
+				return rc;
+			indexing = false;
+			goto emit;
+		}
+
+		/* literal with incremental indexing, without or never indexed */
+		indexing = (c & 0x40) != 0;
+		rc = vtm_http2_hpack_get_int(&p, end, indexing ? 6 : 4, &idx);
+		if (rc != VTM_OK)
+			return rc;
+
+		if (idx > 0) {
+			rc = vtm_http2_hpack_lookup(hp, idx, &name, &name_len, &value, &value_len);
+			if (rc != VTM_OK)
+				return rc;
+			name_off = 0;
+		}
+		else {
+			rc = vtm_http2_hpack_get_str(&p, end, scratch, &name_off, &name_len);
+			if (rc != VTM_OK)
+				return rc;
+		}
+
+		rc = vtm_http2_hpack_get_str(&p, end, scratch, &value_off, &value_len);
+		if (rc != VTM_OK)
+			return rc;
+
+		/* scratch buffer may have moved */
+		if (idx == 0)
+			name = (const char*) scratch->data + name_off;
+		value = (const char*) scratch->data + value_off;
+
+emit:
+		total += name_len + value_len + VTM_HTTP2_HPACK_ENTRY_OVERHEAD;
+		if (total > limit)
+			return VTM_E_MAX_REACHED;
+
+		rc = cb(arg, name, name_len, value, value_len);
+		if (rc != VTM_OK)
+			return rc;
+
+		/* insertion may evict the entry the name was taken from */
+		if (indexing) {
+			rc = vtm_http2_hpack_insert(hp, name, name_len, value, value_len);
+			if (rc != VTM_OK)
+				return rc;
+		}
+	}
+
+	return VTM_OK;
+}
+
+int vtm_http2_hpack_encode_begin(struct vtm_http2_hpack *hp, struct vtm_buf *out)
+{
+	int rc;
+
+	if (!hp->update_pending)
+		return VTM_OK;
+
+	/* smallest size first, so that the decoder evicts the same entries */
+	if (hp->update_min < hp->max_size) {
+		rc = vtm_http2_hpack_put_int(out, 0x20, 5, hp->update_min);
+		if (rc != VTM_OK)
+			return rc;
+	}
+
+	rc = vtm_http2_hpack_put_int(out, 0x20, 5, hp->max_size);
+	if (rc != VTM_OK)
+		return rc;
+
+	hp->update_pending = false;
+
+	return VTM_OK;
+}
+
+int vtm_http2_hpack_encode(struct vtm_http2_hpack *hp, struct vtm_buf *out, const char *name, size_t name_len, const char *value, size_t value_len, enum vtm_http2_hpack_index idx)
+{
+	int rc;
+	size_t i, name_idx;
+	const struct vtm_http2_hpack_static *st;
+	struct vtm_http2_hpack_entry *entry;
+
+	name_idx = 0;
+
+	for (i=0; i < VTM_HTTP2_HPACK_STATIC_COUNT; i++) {
+		st = &vtm_http2_hpack_static_table[i];
+		if (strncmp(st->name, name, name_len) != 0 || st->name[name_len] != '\0')
+			continue;
+		if (strncmp(st->value, value, value_len) == 0 && st->value[value_len] == '\0')
+			return vtm_http2_hpack_put_int(out, 0x80, 7, i + 1);
+		if (name_idx == 0)
+			name_idx = i + 1;
+	}
+
+	/* newest entries have the lowest index */
+	for (i=0; i < hp->count; i++) {
+		entry = &hp->entries[hp->count - 1 - i];
+		if (entry->name_len != name_len || memcmp(entry->name, name, name_len) != 0)
+			continue;
+		if (entry->value_len == value_len && memcmp(entry->value, value, value_len) == 0)
+			return vtm_http2_hpack_put_int(out, 0x80, 7, VTM_HTTP2_HPACK_STATIC_COUNT + 1 + i);
+		if (name_idx == 0)
+			name_idx = VTM_HTTP2_HPACK_STATIC_COUNT + 1 + i;
+	}
+
+	switch (idx) {
+		case VTM_HTTP2_HPACK_INDEX:
+			rc = vtm_http2_hpack_put_int(out, 0x40, 6, name_idx);
+			break;
+
+		case VTM_HTTP2_HPACK_NO_INDEX:
+			rc = vtm_http2_hpack_put_int(out, 0x00, 4, name_idx);
+			break;
+
+		case VTM_HTTP2_HPACK_NEVER_INDEX:
+			rc = vtm_http2_hpack_put_int(out, 0x10, 4, name_idx);
+			break;
+
+		default:
+			VTM_ABORT_NOT_REACHABLE;
+			return VTM_ERROR;
+	}
+
+	if (rc != VTM_OK)
+		return rc;
+
+	if (name_idx == 0) {
+		rc = vtm_http2_hpack_put_str(out, name, name_len);
+		if (rc != VTM_OK)
+			return rc;
+	}
+
+	rc = vtm_http2_hpack_put_str(out, value, value_len);
+	if (rc != VTM_OK)
+		return rc;
+
+	if (idx == VTM_HTTP2_HPACK_INDEX)
+		return vtm_http2_hpack_insert(hp, name, name_len, value, value_len);
+
+	return VTM_OK;
+}
+
+static int vtm_http2_hpack_get_int(const unsigned char **p, const unsigned char *end, unsigned int prefix, size_t *out)
+{
+	size_t val, max;
+	unsigned int shift;
+	unsigned char b;
+
+	if (*p >= end)
+		return VTM_E_IO_PROTOCOL;
+
+	max = (1u << prefix) - 1;
+	val = *(*p)++ & max;
+	if (val < max) {
+		*out = val;
+		return VTM_OK;
+	}
+
+	/* continuation bytes, values above 2^28 are never valid here */
+	shift = 0;
+	do {
+		if (*p >= end || shift > 21)
+			return VTM_E_IO_PROTOCOL;
+		b = *(*p)++;
+		val += (size_t) (b & 0x7f) << shift;
+		shift += 7;
+	} while (b & 0x80);
+
+	*out = val;
+
+	return VTM_OK;
+}
+
+static int vtm_http2_hpack_get_str(const unsigned char **p, const unsigned char *end, struct vtm_buf *scratch, size_t *off, size_t *len)
+{
+	int rc;
+	bool huff;
+	size_t slen;
+
+	if (*p >= end)
+		return VTM_E_IO_PROTOCOL;
+
+	huff = (**p & 0x80) != 0;
+	rc = vtm_http2_hpack_get_int(p, end, 7, &slen);
+	if (rc != VTM_OK)
+		return rc;
+
+	if (slen > (size_t) (end - *p))
+		return VTM_E_IO_PROTOCOL;
+
+	*off = scratch->used;
+
+	if (huff)
+		rc = vtm_http2_huff_decode(*p, slen, scratch);
+	else
+		rc = vtm_buf_putm(scratch, *p, slen);
+	if (rc != VTM_OK)
+		return rc;
+
+	*len = scratch->used - *off;
+	*p += slen;
+
+	return vtm_buf_putc(scratch, '\0');
+}
+
+static int vtm_http2_hpack_lookup(struct vtm_http2_hpack *hp, size_t idx, const char **name, size_t *name_len, const char **value, size_t *value_len)
+{
+	const struct vtm_http2_hpack_static *st;
+	struct vtm_http2_hpack_entry *entry;
+
+	if (idx == 0)
+		return VTM_E_IO_PROTOCOL;
+
+	if (idx <= VTM_HTTP2_HPACK_STATIC_COUNT) {
+		st = &vtm_http2_hpack_static_table[idx - 1];
+		*name = st->name;
+		*name_len = strlen(st->name);
+		*value = st->value;
+		*value_len = strlen(st->value);
+		return VTM_OK;
+	}
+
+	idx -= VTM_HTTP2_HPACK_STATIC_COUNT + 1;
+	if (idx >= hp->count)
+		return VTM_E_IO_PROTOCOL;
+
+	entry = &hp->entries[hp->count - 1 - idx];
+	*name = entry->name;
+	*name_len = entry->name_len;
+	*value = entry->value;
+	*value_len = entry->value_len;
+
+	return VTM_OK;
+}
+
+static int vtm_http2_hpack_insert(struct vtm_http2_hpack *hp, const char *name, size_t name_len, const char *value, size_t value_len)
+{
+	size_t size, cap;
+	char *mem;
+	struct vtm_http2_hpack_entry *entries, *entry;
+
+	/* entries larger than the table only clear it */
+	size = name_len + value_len + VTM_HTTP2_HPACK_ENTRY_OVERHEAD;
+	if (size > hp->max_size) {
+		vtm_http2_hpack_evict(hp, 0);
+		return VTM_OK;
+	}
+
+	vtm_http2_hpack_evict(hp, hp->max_size - size);
+
+	if (hp->count == hp->cap) {
+		cap = hp->cap > 0 ? hp->cap * 2 : 16;
+		entries = realloc(hp->entries, cap * sizeof(*entries));
+		if (!entries) {
+			vtm_err_oom();
+			return vtm_err_get_code();
+		}
+		hp->entries = entries;
+		hp->cap = cap;
+	}
+
+	mem = malloc(name_len + value_len + 2);
+	if (!mem) {
+		vtm_err_oom();
+		return vtm_err_get_code();
+	}
+
+	memcpy(mem, name, name_len);
+	mem[name_len] = '\0';
+	memcpy(mem + name_len + 1, value, value_len);
+	mem[name_len + value_len + 1] = '\0';
+
+	entry = &hp->entries[hp->count++];
+	entry->name = mem;
+	entry->name_len = name_len;
+	entry->value = mem + name_len + 1;
+	entry->value_len = value_len;
+
+	hp->size += size;
+
+	return VTM_OK;
+}
+
+static void vtm_http2_hpack_evict(struct vtm_http2_hpack *hp, size_t max_size)
+{
+	size_t n;
+	struct vtm_http2_hpack_entry *entry;
+
+	n = 0;
+	while (hp->size > max_size && n < hp->count) {
+		entry = &hp->entries[n++];
+		hp->size -= entry->name_len + entry->value_len + VTM_HTTP2_HPACK_ENTRY_OVERHEAD;
+		free(entry->name);
+	}
+
+	if (n == 0)
+		return;
+
+	hp->count -= n;
+	memmove(hp->entries, hp->entries + n, hp->count * sizeof(*hp->entries));
+}
+
+static int vtm_http2_hpack_put_int(struct vtm_buf *out, unsigned char first, unsigned int prefix, size_t val)
+{
+	size_t max;
+
+	max = (1u << prefix) - 1;
+	if (val < max)
+		return vtm_buf_putc(out, first | (unsigned char) val);
+
+	vtm_buf_putc(out, first | (unsigned char) max);
+	val -= max;
+	while (val >= 0x80) {
+		vtm_buf_putc(out, (unsigned char) ((val & 0x7f) | 0x80));
+		val >>= 7;
+	}
+
+	return vtm_buf_putc(out, (unsigned char) val);
+}
+
+static int vtm_http2_hpack_put_str(struct vtm_buf *out, const char *src, size_t len)
+{
+	int rc;
+	size_t huff_len;
+
+	/* huffman coding only if it saves space */
+	huff_len = vtm_http2_huff_encoded_len((const unsigned char*) src, len);
+	if (huff_len < len) {
+		rc = vtm_http2_hpack_put_int(out, 0x80, 7, huff_len);
+		if (rc != VTM_OK)
+			return rc;
+		return vtm_http2_huff_encode((const unsigned char*) src, len, out);
+	}
+
+	rc = vtm_http2_hpack_put_int(out, 0x00, 7, len);
+	if (rc != VTM_OK)
+		return rc;
+
+	return vtm_buf_putm(out, src, len);
+}
+
+int vtm_http2_huff_decode(const unsigned char *src, size_t len, struct vtm_buf *out)
+{
+	int rc;
+	size_t i;
+	int bit;
+	uint32_t code, idx;
+	unsigned int bits;
+	unsigned char *dst;
+	uint16_t sym;
+
+	/* shortest code has 5 bits */
+	rc = vtm_buf_ensure(out, len * 8 / 5 + 1);
+	if (rc != VTM_OK)
+		return rc;
+
+	dst = VTM_BUF_PUT_PTR(out);
+	code = 0;
+	bits = 0;
+
+	for (i=0; i < len; i++) {
+		for (bit=7; bit >= 0; bit--) {
+			code = (code << 1) | ((src[i] >> bit) & 1);
+			bits++;
+
+			/* codes of one length are consecutive numbers */
+			idx = code - vtm_http2_huff_first[bits];
+			if (code >= vtm_http2_huff_first[bits] && idx < vtm_http2_huff_count[bits]) {
+				sym = vtm_http2_huff_symbols[vtm_http2_huff_offset[bits] + idx];
+				if (sym > 255)
+					return VTM_E_IO_PROTOCOL;
+				*dst++ = (unsigned char) sym;
+				code = 0;
+				bits = 0;
+			}
+			else if (bits == 30) {
+				return VTM_E_IO_PROTOCOL;
+			}
+		}
+	}
+
+	/* padding is a prefix of EOS, so at most 7 bits set to one */
+	if (bits > 7 || code != (1u << bits) - 1)
+		return VTM_E_IO_PROTOCOL;
+
+	VTM_BUF_PUT_INC(out, dst - (unsigned char*) VTM_BUF_PUT_PTR(out));
+
+	return VTM_OK;
+}
+
+size_t vtm_http2_huff_encoded_len(const unsigned char *src, size_t len)
+{
+	size_t i, bits;
+
+	bits = 0;
+	for (i=0; i < len; i++)
+		bits += vtm_http2_huff_codes[src[i]].len;
+
+	return (bits + 7) / 8;
+}
+
+int vtm_http2_huff_encode(const unsigned char *src, size_t len, struct vtm_buf *out)
+{
+	int rc;
+	size_t i;
+	uint64_t acc;
+	unsigned int bits;
+	unsigned char *dst;
+	const struct vtm_http2_huff_code *hc;
+
+	rc = vtm_buf_ensure(out, vtm_http2_huff_encoded_len(src, len));
+	if (rc != VTM_OK)
+		return rc;
+
+	dst = VTM_BUF_PUT_PTR(out);
+	acc = 0;
+	bits = 0;
+
+	for (i=0; i < len; i++) {
+		hc = &vtm_http2_huff_codes[src[i]];
+		acc = (acc << hc->len) | hc->code;
+		bits += hc->len;
+		while (bits >= 8) {
+			bits -= 8;
+			*dst++ = (unsigned char) (acc >> bits);
+		}
+		acc &= ((uint64_t) 1 << bits) - 1;
+	}
+
+	/* pad with the most significant bits of EOS */
+	if (bits > 0)
+		*dst++ = (unsigned char) ((acc << (8 - bits)) | (0xff >> bits));
+
+	VTM_BUF_PUT_INC(out, dst - (unsigned char*) VTM_BUF_PUT_PTR(out));
+
+	return VTM_OK;
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#ifndef VTM_NET_HTTP_HTTP2_HPACK_INTL_H_
+#define VTM_NET_HTTP_HTTP2_HPACK_INTL_H_
+
+#include <vtm/core/buffer.h>
+#include <vtm/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** default size of the dynamic table in bytes */
+#define VTM_HTTP2_HPACK_TABLE_SIZE   4096
+
+/** how a field is represented by the encoder */
+enum vtm_http2_hpack_index
+{
+	VTM_HTTP2_HPACK_INDEX,       /**< field is added to the dynamic table */
+	VTM_HTTP2_HPACK_NO_INDEX,    /**< field is sent literally */
+	VTM_HTTP2_HPACK_NEVER_INDEX  /**< field must not be indexed by intermediaries */
+};
+
+struct vtm_http2_hpack_entry
+{
+	char    *name;  /**< name and value share one allocation */
+	size_t  name_len;
+	char    *value;
+	size_t  value_len;
+};
+
+/**
+ * Dynamic table of either a decoder or an encoder.
+ * Entries are stored from oldest to newest.
+ */
+struct vtm_http2_hpack
+{
+	struct vtm_http2_hpack_entry  *entries;
+	size_t                        count;
+	size_t                        cap;
+	size_t                        size;
+
+	/* current size and upper bound from SETTINGS_HEADER_TABLE_SIZE */
+	size_t                        max_size;
+	size_t                        limit;
+
+	/* encoder: table size update must be signaled in next block */
+	size_t                        update_min;
+	bool                          update_pending;
+};
+
+/**
+ * Receives decoded header fields. Name and value are NUL-terminated
+ * and only valid during the call.
+ */
+typedef int (*vtm_http2_hpack_field_cb)(void *arg, const char *name, size_t name_len, const char *value, size_t value_len);
+
+void vtm_http2_hpack_init(struct vtm_http2_hpack *hp, size_t max_size);
+void vtm_http2_hpack_release(struct vtm_http2_hpack *hp);
+
+/* changes the table size limit, the encoder announces it in the next block */
+void vtm_http2_hpack_set_limit(struct vtm_http2_hpack *hp, size_t limit);
+
+/* decodes a complete header block */
+int vtm_http2_hpack_decode(struct vtm_http2_hpack *hp, const void *src, size_t len, size_t limit, struct vtm_buf *scratch, vtm_http2_hpack_field_cb cb, void *arg);
+
+/* encodes a single header field, names must be lower case */
+int vtm_http2_hpack_encode_begin(struct vtm_http2_hpack *hp, struct vtm_buf *out);
+int vtm_http2_hpack_encode(struct vtm_http2_hpack *hp, struct vtm_buf *out, const char *name, size_t name_len, const char *value, size_t value_len, enum vtm_http2_hpack_index idx);
+
+/* huffman coding of string literals */
+int vtm_http2_huff_decode(const unsigned char *src, size_t len, struct vtm_buf *out);
+size_t vtm_http2_huff_encoded_len(const unsigned char *src, size_t len);
+int vtm_http2_huff_encode(const unsigned char *src, size_t len, struct vtm_buf *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_NET_HTTP_HTTP2_HPACK_INTL_H_ */
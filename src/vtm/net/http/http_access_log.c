@@ -0,0 +1,391 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include "http_access_log.h"
+
+#include <stdio.h> /* FILE, fopen(), fwrite(), fflush(), fclose(), snprintf() */
+#include <stdlib.h> /* malloc(), free() */
+#include <string.h> /* memset() */
+#include <vtm/core/buffer.h>
+#include <vtm/core/error.h>
+#include <vtm/core/format.h>
+#include <vtm/net/http/http_access_log_intl.h>
+#include <vtm/util/atomic.h>
+#include <vtm/util/mutex.h>
+#include <vtm/util/thread.h>
+#include <vtm/util/time.h>
+
+#define VTM_HTTP_ACCESS_LOG_DEFAULT_RING       2048
+#define VTM_HTTP_ACCESS_LOG_DEFAULT_INTERVAL   100
+#define VTM_HTTP_ACCESS_LOG_POLL_INTERVAL      10
+#define VTM_HTTP_ACCESS_LOG_BATCH_SIZE         65536
+#define VTM_HTTP_ACCESS_LOG_CACHE_LINE         64
+
+struct vtm_http_access_ring
+{
+	struct vtm_http_access_rec   *recs;
+	uint32_t                     mask;
+
+	/* producer side, written by the worker only */
+	VTM_ATOMIC_INT32_TYPE        head;
+	VTM_ATOMIC_INT32_TYPE        dropped;
+	uint32_t                     tail_cache;
+	char                         pad[VTM_HTTP_ACCESS_LOG_CACHE_LINE];
+
+	/* consumer side, written by the drain thread only */
+	VTM_ATOMIC_INT32_TYPE        tail;
+
+	struct vtm_http_access_ring  *next;
+};
+
+struct vtm_http_access_log
+{
+	FILE                         *fp;
+	uint32_t                     ring_size;
+	unsigned int                 interval;
+
+	vtm_mutex                    *mtx;
+	struct vtm_http_access_ring  *rings;
+	uint64_t                     dropped;
+
+	vtm_thread                   *th;
+	vtm_atomic_flag              running;
+
+	/* only used by the drain thread */
+	struct vtm_buf               buf;
+	uint64_t                     date_ts;
+	char                         date[32];
+};
+
+static const char *vtm_http_access_log_months[] = {
+	"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+	"Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+/* forward declaration */
+static int vtm_http_access_log_run(void *arg);
+static bool vtm_http_access_log_pending(vtm_http_access_log *log);
+static void vtm_http_access_log_drain(vtm_http_access_log *log);
+static void vtm_http_access_log_format(vtm_http_access_log *log, struct vtm_http_access_rec *rec);
+static void vtm_http_access_log_put_path(struct vtm_buf *buf, const char *path);
+static void vtm_http_access_log_write(vtm_http_access_log *log);
+static void vtm_http_access_ring_free(struct vtm_http_access_ring *ring);
+
+vtm_http_access_log* vtm_http_access_log_new(const struct vtm_http_access_log_opts *opts)
+{
+	vtm_http_access_log *log;
+	size_t size;
+
+	if (!opts->path) {
+		vtm_err_set(VTM_E_INVALID_ARG);
+		return NULL;
+	}
+
+	log = malloc(sizeof(*log));
+	if (!log) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	memset(log, 0, sizeof(*log));
+
+	size = opts->ring_size > 0 ? opts->ring_size : VTM_HTTP_ACCESS_LOG_DEFAULT_RING;
+	if (size > 0x40000000)
+		size = 0x40000000;
+	log->ring_size = 1;
+	while (log->ring_size < size)
+		log->ring_size <<= 1;
+
+	log->interval = opts->flush_interval > 0 ? opts->flush_interval : VTM_HTTP_ACCESS_LOG_DEFAULT_INTERVAL;
+	vtm_buf_init(&log->buf, VTM_BYTEORDER_LE);
+
+	log->mtx = vtm_mutex_new();
+	if (!log->mtx)
+		goto err_mtx;
+
+	log->fp = fopen(opts->path, "a");
+	if (!log->fp) {
+		vtm_err_setf(VTM_E_IO_UNKNOWN, "could not open access log: %s", opts->path);
+		goto err_fp;
+	}
+
+	vtm_atomic_flag_init(log->running, true);
+	log->th = vtm_thread_new(vtm_http_access_log_run, log);
+	if (!log->th)
+		goto err_th;
+
+	return log;
+
+err_th:
+	fclose(log->fp);
+
+err_fp:
+	vtm_mutex_free(log->mtx);
+
+err_mtx:
+	vtm_buf_release(&log->buf);
+	free(log);
+
+	return NULL;
+}
+
+void vtm_http_access_log_free(vtm_http_access_log *log)
+{
+	struct vtm_http_access_ring *ring, *next;
+
+	if (!log)
+		return;
+
+	/* thread drains the remaining records before it exits */
+	vtm_atomic_flag_unset(log->running);
+	vtm_thread_join(log->th);
+	vtm_thread_free(log->th);
+
+	for (ring = log->rings; ring; ring = next) {
+		next = ring->next;
+		vtm_http_access_ring_free(ring);
+	}
+
+	fclose(log->fp);
+	vtm_mutex_free(log->mtx);
+	vtm_buf_release(&log->buf);
+	free(log);
+}
+
+uint64_t vtm_http_access_log_get_dropped(vtm_http_access_log *log)
+{
+	uint64_t result;
+	struct vtm_http_access_ring *ring;
+
+	vtm_mutex_lock(log->mtx);
+
+	result = log->dropped;
+	for (ring = log->rings; ring; ring = ring->next)
+		result += (uint32_t) VTM_ATOMIC_LOAD_INT32(&ring->dropped);
+
+	vtm_mutex_unlock(log->mtx);
+
+	return result;
+}
+
+vtm_http_access_ring* vtm_http_access_log_add_ring(vtm_http_access_log *log)
+{
+	struct vtm_http_access_ring *ring;
+
+	ring = malloc(sizeof(*ring));
+	if (!ring) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	memset(ring, 0, sizeof(*ring));
+
+	ring->recs = malloc(log->ring_size * sizeof(struct vtm_http_access_rec));
+	if (!ring->recs) {
+		vtm_err_oom();
+		free(ring);
+		return NULL;
+	}
+
+	ring->mask = log->ring_size - 1;
+
+	vtm_mutex_lock(log->mtx);
+	ring->next = log->rings;
+	log->rings = ring;
+	vtm_mutex_unlock(log->mtx);
+
+	return ring;
+}
+
+static void vtm_http_access_ring_free(struct vtm_http_access_ring *ring)
+{
+	free(ring->recs);
+	free(ring);
+}
+
+struct vtm_http_access_rec* vtm_http_access_ring_acquire(vtm_http_access_ring *ring)
+{
+	uint32_t head;
+
+	head = (uint32_t) ring->head;
+
+	/* the drain thread is only asked when the ring looks full */
+	if (head - ring->tail_cache > ring->mask) {
+		ring->tail_cache = (uint32_t) VTM_ATOMIC_LOAD_INT32(&ring->tail);
+		if (head - ring->tail_cache > ring->mask) {
+			VTM_ATOMIC_ADD_INT32(&ring->dropped, 1);
+			return NULL;
+		}
+	}
+
+	return &ring->recs[head & ring->mask];
+}
+
+void vtm_http_access_ring_commit(vtm_http_access_ring *ring)
+{
+	/* full barrier, the record is visible before the new head */
+	VTM_ATOMIC_ADD_INT32(&ring->head, 1);
+}
+
+static int vtm_http_access_log_run(void *arg)
+{
+	vtm_http_access_log *log;
+	unsigned int waited;
+
+	log = arg;
+	waited = 0;
+
+	while (vtm_atomic_flag_isset(log->running)) {
+		vtm_thread_sleep(VTM_HTTP_ACCESS_LOG_POLL_INTERVAL);
+		waited += VTM_HTTP_ACCESS_LOG_POLL_INTERVAL;
+
+		if (waited < log->interval && !vtm_http_access_log_pending(log))
+			continue;
+
+		vtm_http_access_log_drain(log);
+		waited = 0;
+	}
+
+	vtm_http_access_log_drain(log);
+
+	return VTM_OK;
+}
+
+static bool vtm_http_access_log_pending(vtm_http_access_log *log)
+{
+	bool result;
+	uint32_t head;
+	struct vtm_http_access_ring *ring;
+
+	result = false;
+
+	vtm_mutex_lock(log->mtx);
+	for (ring = log->rings; ring; ring = ring->next) {
+		head = (uint32_t) VTM_ATOMIC_LOAD_INT32(&ring->head);
+		if (head - (uint32_t) ring->tail > (log->ring_size >> 1)) {
+			result = true;
+			break;
+		}
+	}
+	vtm_mutex_unlock(log->mtx);
+
+	return result;
+}
+
+static void vtm_http_access_log_drain(vtm_http_access_log *log)
+{
+	int32_t dropped;
+	uint32_t head, tail, count;
+	struct vtm_http_access_ring *ring;
+
+	vtm_mutex_lock(log->mtx);
+
+	for (ring = log->rings; ring; ring = ring->next) {
+		head = (uint32_t) VTM_ATOMIC_LOAD_INT32(&ring->head);
+		tail = (uint32_t) ring->tail;
+
+		/* slots are released in batches, so the worker sees free space early */
+		count = 0;
+		while (tail != head) {
+			vtm_http_access_log_format(log, &ring->recs[tail & ring->mask]);
+			tail++;
+			count++;
+
+			if (log->buf.used >= VTM_HTTP_ACCESS_LOG_BATCH_SIZE) {
+				VTM_ATOMIC_ADD_INT32(&ring->tail, (int32_t) count);
+				count = 0;
+				vtm_http_access_log_write(log);
+			}
+		}
+		if (count > 0)
+			VTM_ATOMIC_ADD_INT32(&ring->tail, (int32_t) count);
+
+		dropped = VTM_ATOMIC_LOAD_INT32(&ring->dropped);
+		if (dropped != 0) {
+			VTM_ATOMIC_ADD_INT32(&ring->dropped, -dropped);
+			log->dropped += (uint32_t) dropped;
+		}
+	}
+
+	vtm_mutex_unlock(log->mtx);
+
+	vtm_http_access_log_write(log);
+}
+
+static void vtm_http_access_log_format(vtm_http_access_log *log, struct vtm_http_access_rec *rec)
+{
+	int rc;
+	uint64_t ts;
+	struct vtm_date date;
+	char host[VTM_SOCK_ADDR_BUF_LEN];
+	char num[VTM_FMT_CHARS_INT64 + 1];
+
+	/* date changes at most once per second */
+	ts = rec->time / 1000000;
+	if (ts != log->date_ts || log->date[0] == '\0') {
+		if (vtm_date_from_ts(ts, &date) == VTM_OK) {
+			snprintf(log->date, sizeof(log->date), "[%02u/%s/%d:%02u:%02u:%02u +0000]",
+				date.day_of_month, vtm_http_access_log_months[date.month], date.year,
+				date.hour, date.minute, date.second);
+		}
+		else {
+			snprintf(log->date, sizeof(log->date), "[-]");
+		}
+		log->date_ts = ts;
+	}
+
+	rc = vtm_socket_os_addr_convert(&rec->peer, NULL, host, sizeof(host), NULL);
+	vtm_buf_puts(&log->buf, rc == VTM_OK ? host : "-");
+	vtm_buf_puts(&log->buf, " - - ");
+	vtm_buf_puts(&log->buf, log->date);
+	vtm_buf_puts(&log->buf, " \"");
+	vtm_buf_puts(&log->buf, VTM_HTTP_METHODS[rec->method]);
+	vtm_buf_putc(&log->buf, ' ');
+	vtm_http_access_log_put_path(&log->buf, rec->path);
+	vtm_buf_putc(&log->buf, ' ');
+	vtm_buf_puts(&log->buf, vtm_http_get_version_string(rec->version));
+	vtm_buf_puts(&log->buf, "\" ");
+
+	vtm_buf_putm(&log->buf, num, vtm_fmt_int(num, rec->status));
+	vtm_buf_putc(&log->buf, ' ');
+	vtm_buf_putm(&log->buf, num, vtm_fmt_uint64(num, rec->bytes));
+	vtm_buf_putc(&log->buf, ' ');
+	vtm_buf_putm(&log->buf, num, vtm_fmt_uint64(num, rec->duration));
+	vtm_buf_putc(&log->buf, '\n');
+}
+
+static void vtm_http_access_log_put_path(struct vtm_buf *buf, const char *path)
+{
+	const unsigned char *p;
+	char esc[4];
+	static const char hex[] = "0123456789abcdef";
+
+	esc[0] = '\\';
+	esc[1] = 'x';
+
+	/* quotes and control characters must not break the line format */
+	for (p = (const unsigned char*) path; *p != '\0'; p++) {
+		if (*p < 0x20 || *p >= 0x7f || *p == '"' || *p == '\\') {
+			esc[2] = hex[*p >> 4];
+			esc[3] = hex[*p & 0x0f];
+			vtm_buf_putm(buf, esc, sizeof(esc));
+		}
+		else {
+			vtm_buf_putc(buf, (char) *p);
+		}
+	}
+}
+
+static void vtm_http_access_log_write(vtm_http_access_log *log)
+{
+	if (log->buf.used == 0)
+		return;
+
+	if (log->buf.err == VTM_OK) {
+		fwrite(log->buf.data, 1, log->buf.used, log->fp);
+		fflush(log->fp);
+	}
+
+	vtm_buf_clear(&log->buf);
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+/**
+ * @file http_access_log.h
+ *
+ * @brief Asynchronous access log of the HTTP server
+ *
+ * Every worker writes fixed-size records into its own ring buffer
+ * without locking. A background thread drains the rings and appends
+ * the formatted lines to the log file in large batches. When the ring
+ * of a worker is full, the record is dropped and counted instead of
+ * blocking the worker.
+ *
+ * Each line uses the Common Log Format followed by the duration of the
+ * request in microseconds, the time is always given in UTC:
+ *
+ *     127.0.0.1 - - [18/Oct/2019:13:55:36 +0000] "GET /index.html HTTP/1.1" 200 2326 157
+ */
+
+#ifndef VTM_NET_HTTP_HTTP_ACCESS_LOG_H_
+#define VTM_NET_HTTP_HTTP_ACCESS_LOG_H_
+
+#include <vtm/core/api.h>
+#include <vtm/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** access log options, zero-initialized values select the defaults */
+struct vtm_http_access_log_opts
+{
+	/** file where the lines are appended, the log is disabled when NULL */
+	const char    *path;
+
+	/** records per worker ring, rounded up to a power of two, default is 2048 */
+	size_t        ring_size;
+
+	/**
+	 * Maximum time in milliseconds until records are written,
+	 * default is 100. Rings that are half full are drained earlier.
+	 */
+	unsigned int  flush_interval;
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_NET_HTTP_HTTP_ACCESS_LOG_H_ */
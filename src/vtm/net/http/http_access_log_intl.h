@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#ifndef VTM_NET_HTTP_HTTP_ACCESS_LOG_INTL_H_
+#define VTM_NET_HTTP_HTTP_ACCESS_LOG_INTL_H_
+
+#include <vtm/core/types.h>
+#include <vtm/net/socket_addr.h>
+#include <vtm/net/http/http.h>
+#include <vtm/net/http/http_access_log.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** longer paths are truncated */
+#define VTM_HTTP_ACCESS_LOG_PATH_LEN   256
+
+typedef struct vtm_http_access_log vtm_http_access_log;
+typedef struct vtm_http_access_ring vtm_http_access_ring;
+
+struct vtm_http_access_rec
+{
+	uint64_t                 time;      /* begin in microseconds since epoch */
+	uint64_t                 duration;  /* microseconds */
+	uint64_t                 bytes;     /* body bytes of the response */
+	struct vtm_socket_saddr  peer;      /* zeroed if unknown */
+	int                      status;
+	enum vtm_http_method     method;
+	enum vtm_http_version    version;
+	char                     path[VTM_HTTP_ACCESS_LOG_PATH_LEN];
+};
+
+vtm_http_access_log* vtm_http_access_log_new(const struct vtm_http_access_log_opts *opts);
+void vtm_http_access_log_free(vtm_http_access_log *log);
+uint64_t vtm_http_access_log_get_dropped(vtm_http_access_log *log);
+
+/* creates the ring of a worker, it is released with the log */
+vtm_http_access_ring* vtm_http_access_log_add_ring(vtm_http_access_log *log);
+
+/* returns the next free record or NULL if the ring is full */
+struct vtm_http_access_rec* vtm_http_access_ring_acquire(vtm_http_access_ring *ring);
+void vtm_http_access_ring_commit(vtm_http_access_ring *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_NET_HTTP_HTTP_ACCESS_LOG_INTL_H_ */
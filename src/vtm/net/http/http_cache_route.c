@@ -0,0 +1,574 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include "http_cache_route.h"
+
+#include <stdlib.h> /* malloc(), calloc(), free(), qsort() */
+#include <string.h> /* memcpy(), strcmp(), strlen() */
+#include <vtm/core/buffer.h>
+#include <vtm/core/dataset.h>
+#include <vtm/core/error.h>
+#include <vtm/core/format.h>
+#include <vtm/core/list.h>
+#include <vtm/core/map.h>
+#include <vtm/core/string.h>
+#include <vtm/core/variant.h>
+#include <vtm/net/http/http.h>
+#include <vtm/net/http/http_response_intl.h>
+#include <vtm/util/atomic.h>
+#include <vtm/util/mutex.h>
+#include <vtm/util/time.h>
+
+#define VTM_HTTP_CACHE_RT_DEF_MAX_SIZE  (16 * 1024 * 1024)
+
+struct vtm_http_cache_rt_entry
+{
+	VTM_ATOMIC_INT32_TYPE  refs;
+	char                   *key;
+
+	/* placeholder while the first response is computed */
+	bool                   loading;
+	bool                   failed;
+
+	/* expired entry that is recomputed by one request */
+	bool                   refreshing;
+
+	uint64_t               created;
+	uint64_t               expires;
+
+	int                    status;
+	char                   *headers;
+	size_t                 headers_len;
+	unsigned char          *body;
+	size_t                 body_len;
+
+	/* map and lru list membership */
+	bool                   stored;
+	bool                   linked;
+	struct vtm_http_cache_rt_entry *prev;
+	struct vtm_http_cache_rt_entry *next;
+};
+
+struct vtm_http_cache_rt
+{
+	struct vtm_http_route  base;
+	struct vtm_http_route  *rt;
+
+	vtm_mutex              *mtx;
+	vtm_cond               *cond;
+	vtm_map                *entries;
+
+	/* most recently used first */
+	struct vtm_http_cache_rt_entry *head;
+	struct vtm_http_cache_rt_entry *tail;
+
+	size_t                 used;
+	size_t                 max_size;
+	unsigned long          ttl;
+};
+
+/* forward declaration */
+static int vtm_http_cache_rt_handle(struct vtm_http_route *rt, struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res);
+static void vtm_http_cache_rt_free(struct vtm_http_route *rt);
+static int vtm_http_cache_rt_load(struct vtm_http_cache_rt *crt, struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res, const char *key, struct vtm_http_cache_rt_entry *pending);
+static int vtm_http_cache_rt_serve(vtm_http_res *res, struct vtm_http_cache_rt_entry *entry);
+static void vtm_http_cache_rt_store(struct vtm_http_cache_rt *crt, struct vtm_http_cache_rt_entry *entry);
+static bool vtm_http_cache_rt_status_cacheable(int status);
+static int vtm_http_cache_rt_key(struct vtm_http_req *req, struct vtm_buf *buf);
+static int vtm_http_cache_rt_param_cmp(const void *p1, const void *p2);
+static struct vtm_http_cache_rt_entry* vtm_http_cache_rt_entry_new(const char *key, struct vtm_http_res_capture *cap);
+static void vtm_http_cache_rt_entry_release(void *entry);
+static size_t vtm_http_cache_rt_entry_size(struct vtm_http_cache_rt_entry *entry);
+static void vtm_http_cache_rt_link(struct vtm_http_cache_rt *crt, struct vtm_http_cache_rt_entry *entry);
+static void vtm_http_cache_rt_unlink(struct vtm_http_cache_rt *crt, struct vtm_http_cache_rt_entry *entry);
+static void vtm_http_cache_rt_remove(struct vtm_http_cache_rt *crt, struct vtm_http_cache_rt_entry *entry);
+
+struct vtm_http_route* vtm_http_cache_rt_new(struct vtm_http_route *rt, unsigned long ttl)
+{
+	struct vtm_http_cache_rt *crt;
+
+	crt = malloc(sizeof(*crt));
+	if (!crt) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	crt->mtx = vtm_mutex_new();
+	if (!crt->mtx)
+		goto err_mtx;
+
+	crt->cond = vtm_cond_new();
+	if (!crt->cond)
+		goto err_cond;
+
+	crt->entries = vtm_map_new(VTM_ELEM_STRING, VTM_ELEM_POINTER, 64);
+	if (!crt->entries)
+		goto err_map;
+
+	crt->base.url_path = NULL;
+	crt->base.fn_rt_handle = vtm_http_cache_rt_handle;
+	crt->base.fn_rt_free = vtm_http_cache_rt_free;
+
+	crt->rt = rt;
+	crt->head = NULL;
+	crt->tail = NULL;
+	crt->used = 0;
+	crt->max_size = VTM_HTTP_CACHE_RT_DEF_MAX_SIZE;
+	crt->ttl = ttl;
+
+	return &crt->base;
+
+err_map:
+	vtm_cond_free(crt->cond);
+
+err_cond:
+	vtm_mutex_free(crt->mtx);
+
+err_mtx:
+	free(crt);
+	return NULL;
+}
+
+int vtm_http_cache_rt_set_opt(struct vtm_http_route *rt, int opt, const void *val, size_t len)
+{
+	struct vtm_http_cache_rt *crt;
+
+	crt = (struct vtm_http_cache_rt*) rt;
+
+	switch (opt) {
+		case VTM_HTTP_CACHE_RT_OPT_TTL:
+			if (len != sizeof(unsigned long))
+				return VTM_E_INVALID_ARG;
+			crt->ttl = *((unsigned long*) val);
+			break;
+
+		case VTM_HTTP_CACHE_RT_OPT_MAX_SIZE:
+			if (len != sizeof(size_t))
+				return VTM_E_INVALID_ARG;
+			crt->max_size = *((size_t*) val);
+			break;
+
+		default:
+			return VTM_E_NOT_SUPPORTED;
+	}
+
+	return VTM_OK;
+}
+
+static void vtm_http_cache_rt_free(struct vtm_http_route *rt)
+{
+	struct vtm_http_cache_rt *crt;
+	struct vtm_http_cache_rt_entry *entry, *next;
+
+	crt = (struct vtm_http_cache_rt*) rt;
+
+	for (entry = crt->head; entry; entry = next) {
+		next = entry->next;
+		vtm_http_cache_rt_entry_release(entry);
+	}
+
+	vtm_map_free(crt->entries);
+	vtm_cond_free(crt->cond);
+	vtm_mutex_free(crt->mtx);
+
+	crt->rt->fn_rt_free(crt->rt);
+	free(crt);
+}
+
+static int vtm_http_cache_rt_handle(struct vtm_http_route *rt, struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
+{
+	int rc;
+	struct vtm_http_cache_rt *crt;
+	struct vtm_http_cache_rt_entry *entry;
+	struct vtm_buf buf;
+	const char *key;
+	bool failed;
+
+	crt = (struct vtm_http_cache_rt*) rt;
+
+	/* wrapped route sees the path it is bound to */
+	crt->rt->url_path = crt->base.url_path;
+
+	if (req->method != VTM_HTTP_METHOD_GET)
+		return crt->rt->fn_rt_handle(crt->rt, ctx, req, res);
+
+	vtm_buf_init(&buf, VTM_BYTEORDER_LE);
+	rc = vtm_http_cache_rt_key(req, &buf);
+	if (rc != VTM_OK) {
+		vtm_buf_release(&buf);
+		return rc;
+	}
+	key = (const char*) buf.data;
+
+	vtm_mutex_lock(crt->mtx);
+
+	for (;;) {
+		entry = vtm_map_get_pointer_va(crt->entries, key);
+
+		/* miss, compute response while others wait */
+		if (!entry) {
+			entry = vtm_http_cache_rt_entry_new(key, NULL);
+			if (!entry || vtm_map_put_va(crt->entries, entry->key, entry) != VTM_OK) {
+				vtm_mutex_unlock(crt->mtx);
+				if (entry)
+					vtm_http_cache_rt_entry_release(entry);
+				goto bypass;
+			}
+
+			/* one reference for the map and one for the loader */
+			entry->loading = true;
+			entry->stored = true;
+			entry->refs = 2;
+			vtm_mutex_unlock(crt->mtx);
+
+			rc = vtm_http_cache_rt_load(crt, ctx, req, res, key, entry);
+			goto end;
+		}
+
+		/* wait for concurrent load of the same key */
+		if (entry->loading) {
+			VTM_ATOMIC_ADD_INT32(&entry->refs, 1);
+			while (entry->loading)
+				vtm_cond_wait(crt->cond, crt->mtx);
+			failed = entry->failed;
+			vtm_http_cache_rt_entry_release(entry);
+
+			/* response is not cacheable, do not serialize requests */
+			if (failed) {
+				vtm_mutex_unlock(crt->mtx);
+				goto bypass;
+			}
+			continue;
+		}
+
+		VTM_ATOMIC_ADD_INT32(&entry->refs, 1);
+
+		/* fresh or already being refreshed, stale copy is served */
+		if (entry->refreshing || vtm_time_current_millis() < entry->expires) {
+			vtm_http_cache_rt_unlink(crt, entry);
+			vtm_http_cache_rt_link(crt, entry);
+			vtm_mutex_unlock(crt->mtx);
+
+			rc = vtm_http_cache_rt_serve(res, entry);
+			vtm_http_cache_rt_entry_release(entry);
+			goto end;
+		}
+
+		/* expired, this request refreshes the entry */
+		entry->refreshing = true;
+		vtm_mutex_unlock(crt->mtx);
+
+		rc = vtm_http_cache_rt_load(crt, ctx, req, res, key, NULL);
+
+		vtm_mutex_lock(crt->mtx);
+		entry->refreshing = false;
+		vtm_mutex_unlock(crt->mtx);
+
+		vtm_http_cache_rt_entry_release(entry);
+		goto end;
+	}
+
+bypass:
+	rc = crt->rt->fn_rt_handle(crt->rt, ctx, req, res);
+
+end:
+	vtm_buf_release(&buf);
+	return rc;
+}
+
+static int vtm_http_cache_rt_load(struct vtm_http_cache_rt *crt, struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res, const char *key, struct vtm_http_cache_rt_entry *pending)
+{
+	int rc;
+	struct vtm_http_cache_rt_entry *entry;
+	struct vtm_http_res_capture cap;
+
+	cap.done = false;
+	cap.status = 0;
+	vtm_buf_init(&cap.headers, VTM_BYTEORDER_LE);
+	vtm_buf_init(&cap.body, VTM_BYTEORDER_LE);
+
+	vtm_http_res_set_capture(res, &cap);
+	rc = crt->rt->fn_rt_handle(crt->rt, ctx, req, res);
+	vtm_http_res_set_capture(res, NULL);
+
+	entry = NULL;
+	if (rc == VTM_OK && cap.done && vtm_http_cache_rt_status_cacheable(cap.status)) {
+		entry = vtm_http_cache_rt_entry_new(key, &cap);
+		if (entry)
+			entry->expires = entry->created + crt->ttl;
+	}
+
+	vtm_buf_release(&cap.headers);
+	vtm_buf_release(&cap.body);
+
+	vtm_mutex_lock(crt->mtx);
+
+	if (entry)
+		vtm_http_cache_rt_store(crt, entry);
+
+	/* wake up requests waiting for the placeholder */
+	if (pending) {
+		vtm_http_cache_rt_remove(crt, pending);
+		pending->failed = !entry || !entry->stored;
+		pending->loading = false;
+		vtm_cond_signal_all(crt->cond);
+	}
+
+	vtm_mutex_unlock(crt->mtx);
+
+	if (pending)
+		vtm_http_cache_rt_entry_release(pending);
+	if (entry)
+		vtm_http_cache_rt_entry_release(entry);
+
+	return rc;
+}
+
+static int vtm_http_cache_rt_serve(vtm_http_res *res, struct vtm_http_cache_rt_entry *entry)
+{
+	int rc;
+	uint64_t age;
+	char age_str[VTM_FMT_CHARS_INT64 + 1];
+
+	rc = vtm_http_res_begin(res, VTM_HTTP_RES_MODE_FIXED, entry->status);
+	if (rc != VTM_OK)
+		return rc;
+
+	if (entry->headers_len > 0) {
+		rc = vtm_http_res_header_block(res, entry->headers, entry->headers_len);
+		if (rc != VTM_OK)
+			return rc;
+	}
+
+	age = (vtm_time_current_millis() - entry->created) / 1000;
+	age_str[vtm_fmt_uint64(age_str, age)] = '\0';
+	rc = vtm_http_res_header(res, VTM_HTTP_HEADER_AGE, age_str);
+	if (rc != VTM_OK)
+		return rc;
+
+	/* entry stays referenced until the body was sent */
+	if (entry->body_len > 0) {
+		VTM_ATOMIC_ADD_INT32(&entry->refs, 1);
+		rc = vtm_http_res_body_own(res, entry->body, entry->body_len,
+			vtm_http_cache_rt_entry_release, entry);
+		if (rc != VTM_OK)
+			return rc;
+	}
+
+	return vtm_http_res_end(res);
+}
+
+static void vtm_http_cache_rt_store(struct vtm_http_cache_rt *crt, struct vtm_http_cache_rt_entry *entry)
+{
+	size_t size;
+	struct vtm_http_cache_rt_entry *existing;
+
+	/* caller must hold the lock */
+	size = vtm_http_cache_rt_entry_size(entry);
+	if (size > crt->max_size)
+		return;
+
+	/* replace previous or concurrently stored response */
+	existing = vtm_map_get_pointer_va(crt->entries, entry->key);
+	if (existing)
+		vtm_http_cache_rt_remove(crt, existing);
+
+	/* evict least recently used entries */
+	while (crt->tail && crt->used + size > crt->max_size)
+		vtm_http_cache_rt_remove(crt, crt->tail);
+
+	if (vtm_map_put_va(crt->entries, entry->key, entry) != VTM_OK)
+		return;
+
+	VTM_ATOMIC_ADD_INT32(&entry->refs, 1);
+	entry->stored = true;
+	vtm_http_cache_rt_link(crt, entry);
+	crt->used += size;
+}
+
+static bool vtm_http_cache_rt_status_cacheable(int status)
+{
+	/* cacheable by default according to RFC 7231 and RFC 7538 */
+	switch (status) {
+		case VTM_HTTP_200_OK:
+		case 203:
+		case 204:
+		case VTM_HTTP_300_MULTIPLE_CHOICES:
+		case VTM_HTTP_301_MOVED_PERMANENTLY:
+		case VTM_HTTP_308_PERMANENT_REDIRECT:
+		case VTM_HTTP_404_NOT_FOUND:
+		case 410:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+static int vtm_http_cache_rt_key(struct vtm_http_req *req, struct vtm_buf *buf)
+{
+	vtm_list *params;
+	struct vtm_dataset_entry **sorted;
+	size_t i, count;
+
+	vtm_buf_puts(buf, req->path);
+
+	params = req->params ? vtm_dataset_entryset(req->params) : NULL;
+	count = params ? vtm_list_size(params) : 0;
+
+	if (count > 0) {
+		sorted = malloc(sizeof(*sorted) * count);
+		if (!sorted) {
+			vtm_err_oom();
+			vtm_list_free(params);
+			return vtm_err_get_code();
+		}
+
+		for (i=0; i < count; i++)
+			sorted[i] = vtm_list_get_pointer(params, i);
+
+		/* parameter order does not change the response */
+		qsort(sorted, count, sizeof(*sorted), vtm_http_cache_rt_param_cmp);
+
+		for (i=0; i < count; i++) {
+			vtm_buf_putc(buf, i == 0 ? '?' : '&');
+			vtm_buf_puts(buf, sorted[i]->name);
+			vtm_buf_putc(buf, '=');
+			vtm_buf_puts(buf, vtm_variant_as_str(sorted[i]->var));
+		}
+
+		free(sorted);
+	}
+
+	if (params)
+		vtm_list_free(params);
+
+	vtm_buf_putc(buf, '\0');
+
+	return buf->err;
+}
+
+static int vtm_http_cache_rt_param_cmp(const void *p1, const void *p2)
+{
+	const struct vtm_dataset_entry *e1, *e2;
+
+	e1 = *((const struct vtm_dataset_entry* const*) p1);
+	e2 = *((const struct vtm_dataset_entry* const*) p2);
+
+	return strcmp(e1->name, e2->name);
+}
+
+static struct vtm_http_cache_rt_entry* vtm_http_cache_rt_entry_new(const char *key, struct vtm_http_res_capture *cap)
+{
+	struct vtm_http_cache_rt_entry *entry;
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	entry->refs = 1;
+	entry->key = vtm_str_copy(key);
+	if (!entry->key)
+		goto err;
+
+	/* placeholder without response */
+	if (!cap)
+		return entry;
+
+	entry->status = cap->status;
+	entry->created = vtm_time_current_millis();
+	entry->headers_len = cap->headers.used;
+	entry->body_len = cap->body.used;
+
+	entry->headers = malloc(entry->headers_len > 0 ? entry->headers_len : 1);
+	entry->body = malloc(entry->body_len > 0 ? entry->body_len : 1);
+	if (!entry->headers || !entry->body) {
+		vtm_err_oom();
+		goto err;
+	}
+
+	if (entry->headers_len > 0)
+		memcpy(entry->headers, cap->headers.data, entry->headers_len);
+	if (entry->body_len > 0)
+		memcpy(entry->body, cap->body.data, entry->body_len);
+
+	return entry;
+
+err:
+	vtm_http_cache_rt_entry_release(entry);
+	return NULL;
+}
+
+static void vtm_http_cache_rt_entry_release(void *arg)
+{
+	struct vtm_http_cache_rt_entry *entry;
+
+	entry = arg;
+	if (VTM_ATOMIC_ADD_INT32(&entry->refs, -1) != 0)
+		return;
+
+	free(entry->key);
+	free(entry->headers);
+	free(entry->body);
+	free(entry);
+}
+
+static size_t vtm_http_cache_rt_entry_size(struct vtm_http_cache_rt_entry *entry)
+{
+	return sizeof(*entry) + strlen(entry->key) + entry->headers_len + entry->body_len;
+}
+
+static void vtm_http_cache_rt_link(struct vtm_http_cache_rt *crt, struct vtm_http_cache_rt_entry *entry)
+{
+	entry->prev = NULL;
+	entry->next = crt->head;
+
+	if (crt->head)
+		crt->head->prev = entry;
+	else
+		crt->tail = entry;
+
+	crt->head = entry;
+	entry->linked = true;
+}
+
+static void vtm_http_cache_rt_unlink(struct vtm_http_cache_rt *crt, struct vtm_http_cache_rt_entry *entry)
+{
+	if (!entry->linked)
+		return;
+
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		crt->head = entry->next;
+
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		crt->tail = entry->prev;
+
+	entry->prev = NULL;
+	entry->next = NULL;
+	entry->linked = false;
+}
+
+static void vtm_http_cache_rt_remove(struct vtm_http_cache_rt *crt, struct vtm_http_cache_rt_entry *entry)
+{
+	/* caller must hold the lock */
+	if (!entry->stored)
+		return;
+
+	vtm_map_remove_va(crt->entries, entry->key);
+	entry->stored = false;
+
+	/* placeholders are not part of the lru list */
+	if (entry->linked) {
+		vtm_http_cache_rt_unlink(crt, entry);
+		crt->used -= vtm_http_cache_rt_entry_size(entry);
+	}
+
+	vtm_http_cache_rt_entry_release(entry);
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+/**
+ * @file http_cache_route.h
+ *
+ * @brief Route wrapper caching complete responses
+ */
+
+#ifndef VTM_NET_HTTP_HTTP_CACHE_ROUTE_H_
+#define VTM_NET_HTTP_HTTP_CACHE_ROUTE_H_
+
+#include <vtm/core/api.h>
+#include <vtm/core/types.h>
+#include <vtm/net/http/http_route.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VTM_HTTP_CACHE_RT_OPT_TTL       1  /**< expects unsigned long, value is milliseconds */
+#define VTM_HTTP_CACHE_RT_OPT_MAX_SIZE  2  /**< expects size_t, total cache size in bytes */
+
+/**
+ * Creates a route that caches the responses of another route.
+ *
+ * GET requests are answered from a shared in-memory cache keyed by the
+ * request path and the query parameters sorted by name, so the wrapped
+ * handler only runs once per key and time to live. All other methods are
+ * passed through unchanged.
+ *
+ * Only FIXED mode responses with status 200, 203, 204, 300, 301, 308,
+ * 404 or 410 are stored, together with all headers set by the handler.
+ * Responses that set a cookie or carry "Cache-Control: no-store" or
+ * "private" are never stored. The cached response must therefore only
+ * depend on the path and the query, not on other request headers.
+ * Compression is applied for every client individually when the cached
+ * response is sent and an Age header is added.
+ *
+ * Concurrent requests are coalesced: while a missing entry is computed,
+ * further requests for the same key wait for the result. When an entry
+ * expired, a single request recomputes it and concurrent requests are
+ * answered with the stale copy in the meantime.
+ *
+ * The wrapped route is released together with this route.
+ *
+ * @param rt the route whose responses should be cached
+ * @param ttl time to live of cached responses in milliseconds
+ * @return http route if call succeeded
+ * @return NULL if an error occured
+ */
+VTM_API struct vtm_http_route* vtm_http_cache_rt_new(struct vtm_http_route *rt, unsigned long ttl);
+
+/**
+ * Sets one of the possible options.
+ *
+ * The possible options are macros starting with VTM_HTTP_CACHE_RT_OPT_.
+ * Options must be set before the route is used for handling requests.
+ *
+ * @param rt the cache route where the option should be set
+ * @param opt the option that should be set
+ * @param val pointer to new value of the option
+ * @param len size of the value
+ * @return VTM_OK if the option was successfully set
+ * @return VTM_E_INVALID_ARG if the value size does not match
+ * @return VTM_E_NOT_SUPPORTED if the given option is not supported
+ */
+VTM_API int vtm_http_cache_rt_set_opt(struct vtm_http_route *rt, int opt, const void *val, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_NET_HTTP_HTTP_CACHE_ROUTE_H_ */
@@ -13,6 +13,7 @@
 #include <vtm/net/socket.h>
 #include <vtm/net/socket_writer.h>
 #include <vtm/net/url.h>
+#include <vtm/net/http/http_client_pool_intl.h>
 #include <vtm/net/http/http_parser.h>
 
 #define VTM_HTTP_CL_HINT_NO_CERT_CHECK      1
@@ -27,12 +28,19 @@ struct vtm_http_client
 	unsigned int               con_port;
 	unsigned int               hints;
 	unsigned long              opt_timeout;
+
+	/* shared connections, socket is only held during a request */
+	vtm_http_client_pool       *pool;
+	char                       *pool_key;
 };
 
 /* forward declaration */
 static int  vtm_http_client_con_open(vtm_http_client *cl, struct vtm_http_client_req *req, struct vtm_url *url);
 static bool vtm_http_client_con_must_close(vtm_http_client *cl, struct vtm_http_client_req *req, struct vtm_http_client_res *res);
 static void vtm_http_client_con_close(vtm_http_client *cl);
+static int  vtm_http_client_con_create(vtm_http_client *cl, struct vtm_http_client_req *req, struct vtm_url *url);
+static int  vtm_http_client_pool_open(vtm_http_client *cl, struct vtm_http_client_req *req, struct vtm_url *url);
+static void vtm_http_client_pool_done(vtm_http_client *cl, bool close_con);
 static int  vtm_http_client_send(vtm_http_client *cl, struct vtm_http_client_req *req, struct vtm_url *url);
 static int  vtm_http_client_recv(vtm_http_client *cl, struct vtm_http_client_res *res);
 
@@ -54,6 +62,8 @@ vtm_http_client* vtm_http_client_new(void)
 	cl->con_port = 0;
 	cl->hints = 0;
 	cl->opt_timeout = 0;
+	cl->pool = NULL;
+	cl->pool_key = NULL;
 
 	return cl;
 }
@@ -77,6 +87,13 @@ int vtm_http_client_take_socket(vtm_http_client *cl, vtm_socket **sock)
 
 	*sock = cl->sock;
 
+	/* socket leaves the pool */
+	if (cl->pool_key) {
+		vtm_http_client_pool_discard(cl->pool, cl->pool_key);
+		free(cl->pool_key);
+		cl->pool_key = NULL;
+	}
+
 	free(cl->con_host);
 
 	cl->sock = NULL;
@@ -104,6 +121,13 @@ int vtm_http_client_set_opt(vtm_http_client *cl, int opt, const void *val, size_
 			cl->opt_timeout = *((unsigned long*) val);
 			return VTM_OK;
 
+		case VTM_HTTP_CL_OPT_POOL:
+			if (len != sizeof(vtm_http_client_pool*))
+				return VTM_E_INVALID_ARG;
+			vtm_http_client_con_close(cl);
+			cl->pool = *((vtm_http_client_pool**) val);
+			return VTM_OK;
+
 		default:
 			break;
 	}
@@ -119,7 +143,8 @@ int vtm_http_client_request(vtm_http_client *cl, struct vtm_http_client_req *req
 
 	/* open or reuse connection */
 	close_con = true;
-	rc = vtm_http_client_con_open(cl, req, &url);
+	rc = cl->pool ? vtm_http_client_pool_open(cl, req, &url)
+	              : vtm_http_client_con_open(cl, req, &url);
 	if (rc != VTM_OK)
 		goto end;
 
@@ -138,7 +163,10 @@ int vtm_http_client_request(vtm_http_client *cl, struct vtm_http_client_req *req
 	                           : true;
 
 end:
-	if (close_con) {
+	if (cl->pool) {
+		vtm_http_client_pool_done(cl, close_con);
+	}
+	else if (close_con) {
 		vtm_http_client_con_close(cl);
 	}
 	else if (!cl->con_host) {
@@ -157,7 +185,6 @@ end:
 static int vtm_http_client_con_open(vtm_http_client *cl, struct vtm_http_client_req *req, struct vtm_url *url)
 {
 	int rc;
-	struct vtm_socket_tls_opts tls_opts;
 
 	/* parse destination addr */
 	rc = vtm_url_parse(req->url, url);
@@ -171,6 +198,17 @@ static int vtm_http_client_con_open(vtm_http_client *cl, struct vtm_http_client_
 		vtm_http_client_con_close(cl);
 	}
 
+	return vtm_http_client_con_create(cl, req, url);
+}
+
+static int vtm_http_client_con_create(vtm_http_client *cl, struct vtm_http_client_req *req, struct vtm_url *url)
+{
+	int rc;
+	struct vtm_socket_tls_opts tls_opts;
+
+	/* data of previous connection */
+	vtm_buf_clear(&cl->recvbuf);
+
 	/* open new connection */
 	switch (url->scheme) {
 		case VTM_URL_SCHEME_HTTP:
@@ -198,6 +236,52 @@ static int vtm_http_client_con_open(vtm_http_client *cl, struct vtm_http_client_
 	return vtm_socket_connect(cl->sock, url->host, url->port);
 }
 
+static int vtm_http_client_pool_open(vtm_http_client *cl, struct vtm_http_client_req *req, struct vtm_url *url)
+{
+	int rc;
+	vtm_socket *sock;
+
+	rc = vtm_url_parse(req->url, url);
+	if (rc != VTM_OK)
+		return rc;
+
+	/* connections are shared between clients with the same cert check */
+	cl->pool_key = vtm_str_printf("%d|%d|%d|%s|%u", (int) url->scheme, (int) req->fam,
+		(cl->hints & VTM_HTTP_CL_HINT_NO_CERT_CHECK) ? 1 : 0, url->host, url->port);
+	if (!cl->pool_key)
+		return vtm_err_get_code();
+
+	rc = vtm_http_client_pool_acquire(cl->pool, cl->pool_key, &sock);
+	if (rc != VTM_OK) {
+		free(cl->pool_key);
+		cl->pool_key = NULL;
+		return rc;
+	}
+
+	if (!sock)
+		return vtm_http_client_con_create(cl, req, url);
+
+	cl->sock = sock;
+	vtm_buf_clear(&cl->recvbuf);
+
+	/* timeout may differ between clients */
+	return vtm_socket_set_opt(cl->sock, VTM_SOCK_OPT_RECV_TIMEOUT,
+		(unsigned long[]) {cl->opt_timeout}, sizeof(unsigned long));
+}
+
+static void vtm_http_client_pool_done(vtm_http_client *cl, bool close_con)
+{
+	if (close_con || !cl->sock) {
+		vtm_http_client_con_close(cl);
+		return;
+	}
+
+	vtm_http_client_pool_release(cl->pool, cl->pool_key, cl->sock);
+	cl->sock = NULL;
+	free(cl->pool_key);
+	cl->pool_key = NULL;
+}
+
 static bool vtm_http_client_con_must_close(vtm_http_client *cl, struct vtm_http_client_req *req, struct vtm_http_client_res *res)
 {
 	const char *val;
@@ -228,6 +312,13 @@ static void vtm_http_client_con_close(vtm_http_client *cl)
 		cl->sock = NULL;
 	}
 
+	/* reserved slot is free again */
+	if (cl->pool_key) {
+		vtm_http_client_pool_discard(cl->pool, cl->pool_key);
+		free(cl->pool_key);
+		cl->pool_key = NULL;
+	}
+
 	free(cl->con_host);
 	cl->con_host = NULL;
 	cl->con_port = 0;
@@ -17,6 +17,7 @@
 #include <vtm/net/network.h>
 #include <vtm/net/socket_addr.h>
 #include <vtm/net/http/http.h>
+#include <vtm/net/http/http_client_pool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -24,6 +25,7 @@ extern "C" {
 
 #define VTM_HTTP_CL_OPT_NO_CERT_CHECK    1  /**< expects bool */
 #define VTM_HTTP_CL_OPT_TIMEOUT          2  /**< expects unsigned long, value is millisceonds */
+#define VTM_HTTP_CL_OPT_POOL             3  /**< expects vtm_http_client_pool*, NULL disables pooling */
 
 /** HTTP client request */
 struct vtm_http_client_req
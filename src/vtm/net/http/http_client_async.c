@@ -0,0 +1,853 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include "http_client_async.h"
+
+#include <stdlib.h> /* malloc(), free() */
+#include <string.h> /* memset() */
+#include <vtm/core/buffer.h>
+#include <vtm/core/error.h>
+#include <vtm/core/format.h>
+#include <vtm/core/list.h>
+#include <vtm/core/map.h>
+#include <vtm/core/string.h>
+#include <vtm/net/socket.h>
+#include <vtm/net/socket_listener.h>
+#include <vtm/net/url.h>
+#include <vtm/net/http/http_parser.h>
+#include <vtm/util/mutex.h>
+#include <vtm/util/time.h>
+
+#define VTM_HTTP_CL_ASYNC_EVENTS           64
+#define VTM_HTTP_CL_ASYNC_DEF_MAX_IDLE      8
+#define VTM_HTTP_CL_ASYNC_READ_SIZE      4096
+
+struct vtm_http_client_async_con;
+
+struct vtm_http_client_async_req
+{
+	char                              *key;
+	enum vtm_url_scheme               scheme;
+	enum vtm_socket_family            fam;
+	enum vtm_http_version             version;
+	char                              *host;
+	unsigned int                      port;
+	struct vtm_buf                    sendbuf;
+
+	uint64_t                          deadline;  /**< zero means none */
+	bool                              retried;
+	vtm_http_client_async_cb          cb;
+	void                              *arg;
+
+	struct vtm_http_client_async_con  *con;
+
+	/* queued or active requests */
+	struct vtm_http_client_async_req  *prev;
+	struct vtm_http_client_async_req  *next;
+};
+
+struct vtm_http_client_async_con
+{
+	vtm_socket                        *sock;
+	char                              *key;
+	struct vtm_buf                    recvbuf;
+	struct vtm_http_parser            parser;
+	bool                              reused;
+	bool                              sending;
+
+	/* current request, NULL when idle */
+	struct vtm_http_client_async_req  *req;
+
+	/* idle connections of the same destination */
+	struct vtm_http_client_async_con  *next;
+};
+
+struct vtm_http_client_async
+{
+	vtm_socket_listener               *li;
+
+	/* requests passed from other threads */
+	vtm_mutex                         *mtx;
+	struct vtm_http_client_async_req  *queue;
+	bool                              running;
+	bool                              stop;
+
+	/* owned by the event loop */
+	struct vtm_http_client_async_req  *active;
+	vtm_map                           *idle;
+
+	/* options */
+	unsigned int                      hints;
+	unsigned long                     opt_timeout;
+	unsigned int                      opt_max_idle;
+};
+
+#define VTM_HTTP_CL_ASYNC_HINT_NO_CERT_CHECK  1
+
+/* forward declaration */
+static int  vtm_http_client_async_build(struct vtm_http_client_async_req *areq, struct vtm_http_client_req *req, struct vtm_url *url);
+static void vtm_http_client_async_req_free(struct vtm_http_client_async_req *areq);
+static void vtm_http_client_async_start(vtm_http_client_async *cl, struct vtm_http_client_async_req *areq);
+static void vtm_http_client_async_finish(vtm_http_client_async *cl, struct vtm_http_client_async_req *areq, int rc, struct vtm_http_client_res *res);
+static void vtm_http_client_async_cancel(vtm_http_client_async *cl, struct vtm_http_client_async_req *list);
+static unsigned long vtm_http_client_async_expire(vtm_http_client_async *cl);
+static void vtm_http_client_async_handle(vtm_http_client_async *cl, struct vtm_http_client_async_con *con);
+static struct vtm_http_client_async_con* vtm_http_client_async_con_take(vtm_http_client_async *cl, const char *key);
+static struct vtm_http_client_async_con* vtm_http_client_async_con_new(vtm_http_client_async *cl, struct vtm_http_client_async_req *areq);
+static void vtm_http_client_async_con_idle(vtm_http_client_async *cl, struct vtm_http_client_async_con *con);
+static void vtm_http_client_async_con_unidle(vtm_http_client_async *cl, struct vtm_http_client_async_con *con);
+static void vtm_http_client_async_con_free(vtm_http_client_async *cl, struct vtm_http_client_async_con *con);
+static int  vtm_http_client_async_con_watch(vtm_http_client_async *cl, struct vtm_http_client_async_con *con, unsigned int flag);
+static void vtm_http_client_async_con_fail(vtm_http_client_async *cl, struct vtm_http_client_async_con *con, int rc);
+static void vtm_http_client_async_con_send(vtm_http_client_async *cl, struct vtm_http_client_async_con *con);
+static void vtm_http_client_async_con_recv(vtm_http_client_async *cl, struct vtm_http_client_async_con *con);
+static void vtm_http_client_async_con_complete(vtm_http_client_async *cl, struct vtm_http_client_async_con *con, bool eof);
+
+vtm_http_client_async* vtm_http_client_async_new(void)
+{
+	vtm_http_client_async *cl;
+
+	cl = malloc(sizeof(*cl));
+	if (!cl) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	cl->li = vtm_socket_listener_new(VTM_HTTP_CL_ASYNC_EVENTS);
+	if (!cl->li)
+		goto err_li;
+
+	cl->mtx = vtm_mutex_new();
+	if (!cl->mtx)
+		goto err_mtx;
+
+	cl->idle = vtm_map_new(VTM_ELEM_STRING, VTM_ELEM_POINTER, 16);
+	if (!cl->idle)
+		goto err_map;
+
+	cl->queue = NULL;
+	cl->running = false;
+	cl->stop = false;
+	cl->active = NULL;
+	cl->hints = 0;
+	cl->opt_timeout = 0;
+	cl->opt_max_idle = VTM_HTTP_CL_ASYNC_DEF_MAX_IDLE;
+
+	return cl;
+
+err_map:
+	vtm_mutex_free(cl->mtx);
+
+err_mtx:
+	vtm_socket_listener_free(cl->li);
+
+err_li:
+	free(cl);
+	return NULL;
+}
+
+void vtm_http_client_async_free(vtm_http_client_async *cl)
+{
+	vtm_list *entries;
+	struct vtm_map_entry *entry;
+	struct vtm_http_client_async_con *con, *next;
+	size_t i, count;
+
+	if (!cl)
+		return;
+
+	vtm_http_client_async_cancel(cl, cl->queue);
+
+	entries = vtm_map_entryset(cl->idle);
+	if (entries) {
+		count = vtm_list_size(entries);
+		for (i=0; i < count; i++) {
+			entry = vtm_list_get_pointer(entries, i);
+			for (con = entry->value.elem_pointer; con; con = next) {
+				next = con->next;
+				vtm_http_client_async_con_free(cl, con);
+			}
+		}
+		vtm_list_free(entries);
+	}
+
+	vtm_map_free(cl->idle);
+	vtm_mutex_free(cl->mtx);
+	vtm_socket_listener_free(cl->li);
+	free(cl);
+}
+
+int vtm_http_client_async_set_opt(vtm_http_client_async *cl, int opt, const void *val, size_t len)
+{
+	switch (opt) {
+		case VTM_HTTP_CL_ASYNC_OPT_NO_CERT_CHECK:
+			if (len != sizeof(bool))
+				return VTM_E_INVALID_ARG;
+			if (*((bool*) val))
+				cl->hints |= VTM_HTTP_CL_ASYNC_HINT_NO_CERT_CHECK;
+			else
+				cl->hints &= ~VTM_HTTP_CL_ASYNC_HINT_NO_CERT_CHECK;
+			return VTM_OK;
+
+		case VTM_HTTP_CL_ASYNC_OPT_TIMEOUT:
+			if (len != sizeof(unsigned long))
+				return VTM_E_INVALID_ARG;
+			cl->opt_timeout = *((unsigned long*) val);
+			return VTM_OK;
+
+		case VTM_HTTP_CL_ASYNC_OPT_MAX_IDLE:
+			if (len != sizeof(unsigned int))
+				return VTM_E_INVALID_ARG;
+			cl->opt_max_idle = *((unsigned int*) val);
+			return VTM_OK;
+
+		default:
+			break;
+	}
+
+	return VTM_E_NOT_SUPPORTED;
+}
+
+int vtm_http_client_async_request(vtm_http_client_async *cl, struct vtm_http_client_req *req, unsigned long timeout, vtm_http_client_async_cb cb, void *arg)
+{
+	int rc;
+	struct vtm_url url;
+	struct vtm_http_client_async_req *areq;
+
+	rc = vtm_url_parse(req->url, &url);
+	if (rc != VTM_OK)
+		return rc;
+
+	areq = malloc(sizeof(*areq));
+	if (!areq) {
+		vtm_err_oom();
+		rc = vtm_err_get_code();
+		goto end;
+	}
+
+	vtm_buf_init(&areq->sendbuf, VTM_BYTEORDER_LE);
+	areq->key = vtm_str_printf("%d|%d|%s|%u", (int) url.scheme, (int) req->fam, url.host, url.port);
+	areq->scheme = url.scheme;
+	areq->fam = req->fam;
+	areq->version = req->version;
+	areq->host = url.host;
+	areq->port = url.port;
+	areq->retried = false;
+	areq->cb = cb;
+	areq->arg = arg;
+	areq->con = NULL;
+	areq->prev = NULL;
+
+	/* host is kept for connecting */
+	url.host = NULL;
+
+	if (timeout == 0)
+		timeout = cl->opt_timeout;
+	areq->deadline = timeout > 0 ? vtm_time_current_millis() + timeout : 0;
+
+	if (!areq->key) {
+		rc = vtm_err_get_code();
+		vtm_http_client_async_req_free(areq);
+		goto end;
+	}
+
+	rc = vtm_http_client_async_build(areq, req, &url);
+	if (rc != VTM_OK) {
+		vtm_http_client_async_req_free(areq);
+		goto end;
+	}
+
+	/* loop picks up queued requests after interruption */
+	vtm_mutex_lock(cl->mtx);
+	areq->next = cl->queue;
+	cl->queue = areq;
+	vtm_mutex_unlock(cl->mtx);
+
+	vtm_socket_listener_interrupt(cl->li);
+
+end:
+	vtm_url_release(&url);
+
+	return rc;
+}
+
+int vtm_http_client_async_run(vtm_http_client_async *cl)
+{
+	int rc;
+	size_t i, num_events;
+	unsigned long timeout;
+	struct vtm_socket_event *events;
+	struct vtm_http_client_async_req *queue, *next;
+
+	vtm_mutex_lock(cl->mtx);
+	if (cl->running) {
+		vtm_mutex_unlock(cl->mtx);
+		return VTM_E_INVALID_STATE;
+	}
+	cl->running = true;
+	vtm_mutex_unlock(cl->mtx);
+
+	rc = VTM_OK;
+
+	while (true) {
+		/* take requests of other threads */
+		vtm_mutex_lock(cl->mtx);
+		if (cl->stop) {
+			vtm_mutex_unlock(cl->mtx);
+			break;
+		}
+		queue = cl->queue;
+		cl->queue = NULL;
+		vtm_mutex_unlock(cl->mtx);
+
+		for (; queue; queue = next) {
+			next = queue->next;
+			vtm_http_client_async_start(cl, queue);
+		}
+
+		/* wait until next deadline */
+		timeout = vtm_http_client_async_expire(cl);
+		if (timeout > 0)
+			rc = vtm_socket_listener_run_timeout(cl->li, &events, &num_events, timeout);
+		else
+			rc = vtm_socket_listener_run(cl->li, &events, &num_events);
+		if (rc != VTM_OK)
+			break;
+
+		for (i=0; i < num_events; i++)
+			vtm_http_client_async_handle(cl, vtm_socket_get_usr_data(events[i].sock));
+
+		vtm_http_client_async_expire(cl);
+	}
+
+	/* pending requests are not processed anymore */
+	vtm_mutex_lock(cl->mtx);
+	queue = cl->queue;
+	cl->queue = NULL;
+	cl->running = false;
+	cl->stop = false;
+	vtm_mutex_unlock(cl->mtx);
+
+	while (cl->active) {
+		if (cl->active->con)
+			vtm_http_client_async_con_free(cl, cl->active->con);
+		vtm_http_client_async_finish(cl, cl->active, VTM_E_IO_CANCELED, NULL);
+	}
+	vtm_http_client_async_cancel(cl, queue);
+
+	return rc;
+}
+
+void vtm_http_client_async_stop(vtm_http_client_async *cl)
+{
+	vtm_mutex_lock(cl->mtx);
+	cl->stop = true;
+	vtm_mutex_unlock(cl->mtx);
+
+	vtm_socket_listener_interrupt(cl->li);
+}
+
+static int vtm_http_client_async_build(struct vtm_http_client_async_req *areq, struct vtm_http_client_req *req, struct vtm_url *url)
+{
+	struct vtm_buf *buf;
+	char num[VTM_FMT_CHARS_INT64+1];
+
+	if (req->body && req->body_len > UINT64_MAX)
+		return vtm_err_set(VTM_E_INVALID_ARG);
+
+	buf = &areq->sendbuf;
+
+	vtm_buf_puts(buf, VTM_HTTP_METHODS[req->method]);
+	vtm_buf_putc(buf, ' ');
+	vtm_buf_puts(buf, url->path);
+	vtm_buf_putc(buf, ' ');
+	vtm_buf_puts(buf, VTM_HTTP_VERSIONS[req->version]);
+	vtm_buf_puts(buf, "\r\nHost: ");
+	vtm_buf_puts(buf, areq->host);
+	vtm_buf_puts(buf, "\r\n");
+
+	if (req->headers) {
+		vtm_list *entries;
+		struct vtm_dataset_entry *entry;
+		size_t i, count;
+
+		entries = vtm_dataset_entryset(req->headers);
+		if (!entries)
+			return vtm_err_get_code();
+
+		count = vtm_list_size(entries);
+		for (i=0; i < count; i++) {
+			entry = vtm_list_get_pointer(entries, i);
+
+			vtm_buf_puts(buf, entry->name);
+			vtm_buf_puts(buf, ": ");
+			vtm_buf_puts(buf, vtm_variant_as_str(entry->var));
+			vtm_buf_puts(buf, "\r\n");
+		}
+
+		vtm_list_free(entries);
+	}
+
+	/* content length header required? */
+	if (req->body && req->body_len > 0 && (!req->headers ||
+		(!vtm_dataset_contains(req->headers, VTM_HTTP_HEADER_CONTENT_LENGTH) &&
+		 !vtm_dataset_contains(req->headers, VTM_HTTP_HEADER_TRANSFER_ENCODING)))) {
+		num[vtm_fmt_uint64(num, (uint64_t) req->body_len)] = '\0';
+		vtm_buf_puts(buf, VTM_HTTP_HEADER_CONTENT_LENGTH);
+		vtm_buf_puts(buf, ": ");
+		vtm_buf_puts(buf, num);
+		vtm_buf_puts(buf, "\r\n");
+	}
+
+	vtm_buf_puts(buf, "\r\n");
+
+	if (req->body && req->body_len > 0)
+		vtm_buf_putm(buf, req->body, req->body_len);
+
+	return buf->err;
+}
+
+static void vtm_http_client_async_req_free(struct vtm_http_client_async_req *areq)
+{
+	vtm_buf_release(&areq->sendbuf);
+	free(areq->host);
+	free(areq->key);
+	free(areq);
+}
+
+static void vtm_http_client_async_start(vtm_http_client_async *cl, struct vtm_http_client_async_req *areq)
+{
+	struct vtm_http_client_async_con *con;
+
+	/* track for deadline and cancellation */
+	areq->prev = NULL;
+	areq->next = cl->active;
+	if (cl->active)
+		cl->active->prev = areq;
+	cl->active = areq;
+
+	/* a retry never uses another idle connection */
+	con = areq->retried ? NULL : vtm_http_client_async_con_take(cl, areq->key);
+	if (con) {
+		con->req = areq;
+		areq->con = con;
+		vtm_http_client_async_con_send(cl, con);
+		return;
+	}
+
+	con = vtm_http_client_async_con_new(cl, areq);
+	if (!con) {
+		vtm_http_client_async_finish(cl, areq, vtm_err_get_code(), NULL);
+		return;
+	}
+
+	areq->con = con;
+}
+
+static void vtm_http_client_async_finish(vtm_http_client_async *cl, struct vtm_http_client_async_req *areq, int rc, struct vtm_http_client_res *res)
+{
+	if (areq->prev)
+		areq->prev->next = areq->next;
+	else
+		cl->active = areq->next;
+
+	if (areq->next)
+		areq->next->prev = areq->prev;
+
+	areq->cb(areq->arg, rc, res);
+	vtm_http_client_async_req_free(areq);
+}
+
+static void vtm_http_client_async_cancel(vtm_http_client_async *cl, struct vtm_http_client_async_req *list)
+{
+	struct vtm_http_client_async_req *next;
+
+	for (; list; list = next) {
+		next = list->next;
+		list->cb(list->arg, VTM_E_IO_CANCELED, NULL);
+		vtm_http_client_async_req_free(list);
+	}
+}
+
+static unsigned long vtm_http_client_async_expire(vtm_http_client_async *cl)
+{
+	uint64_t now, next;
+	struct vtm_http_client_async_req *areq, *areq_next;
+
+	now = vtm_time_current_millis();
+	next = 0;
+
+	for (areq = cl->active; areq; areq = areq_next) {
+		areq_next = areq->next;
+		if (areq->deadline == 0)
+			continue;
+
+		if (areq->deadline <= now) {
+			if (areq->con)
+				vtm_http_client_async_con_free(cl, areq->con);
+			vtm_http_client_async_finish(cl, areq, VTM_E_IO_TIMEOUT, NULL);
+			continue;
+		}
+
+		if (next == 0 || areq->deadline < next)
+			next = areq->deadline;
+	}
+
+	return next > 0 ? (unsigned long) (next - now) : 0;
+}
+
+static void vtm_http_client_async_handle(vtm_http_client_async *cl, struct vtm_http_client_async_con *con)
+{
+	/* idle connection was closed by the peer or sent unexpected data */
+	if (!con->req) {
+		vtm_http_client_async_con_unidle(cl, con);
+		vtm_http_client_async_con_free(cl, con);
+		return;
+	}
+
+	/* errors are reported by the next socket operation */
+	if (con->sending)
+		vtm_http_client_async_con_send(cl, con);
+	else
+		vtm_http_client_async_con_recv(cl, con);
+}
+
+static struct vtm_http_client_async_con* vtm_http_client_async_con_take(vtm_http_client_async *cl, const char *key)
+{
+	struct vtm_http_client_async_con *con;
+
+	con = vtm_map_get_pointer_va(cl->idle, key);
+	if (!con)
+		return NULL;
+
+	vtm_http_client_async_con_unidle(cl, con);
+	con->reused = true;
+
+	return con;
+}
+
+static struct vtm_http_client_async_con* vtm_http_client_async_con_new(vtm_http_client_async *cl, struct vtm_http_client_async_req *areq)
+{
+	int rc;
+	struct vtm_http_client_async_con *con;
+	struct vtm_socket_tls_opts tls_opts;
+
+	con = malloc(sizeof(*con));
+	if (!con) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	con->key = vtm_str_copy(areq->key);
+	if (!con->key)
+		goto err_key;
+
+	switch (areq->scheme) {
+		case VTM_URL_SCHEME_HTTP:
+			con->sock = vtm_socket_new(areq->fam, VTM_SOCK_TYPE_STREAM);
+			break;
+
+		case VTM_URL_SCHEME_HTTPS:
+			memset(&tls_opts, 0, sizeof(tls_opts));
+			if (cl->hints & VTM_HTTP_CL_ASYNC_HINT_NO_CERT_CHECK)
+				tls_opts.no_cert_check = true;
+			con->sock = vtm_socket_tls_new(areq->fam, &tls_opts);
+			break;
+
+		default:
+			vtm_err_set(VTM_E_NOT_SUPPORTED);
+			con->sock = NULL;
+			break;
+	}
+
+	if (!con->sock)
+		goto err_sock;
+
+	vtm_buf_init(&con->recvbuf, VTM_BYTEORDER_LE);
+	vtm_http_parser_init(&con->parser, VTM_HTTP_PM_RESPONSE);
+	vtm_socket_set_usr_data(con->sock, con);
+	con->reused = false;
+	con->sending = true;
+	con->req = areq;
+	con->next = NULL;
+
+	rc = vtm_socket_set_opt(con->sock, VTM_SOCK_OPT_NONBLOCKING, (bool[]) {true}, sizeof(bool));
+	if (rc != VTM_OK)
+		goto err_con;
+
+	/* request is sent as soon as connection is established */
+	rc = vtm_socket_connect(con->sock, areq->host, areq->port);
+	if (rc != VTM_OK && rc != VTM_E_IO_AGAIN)
+		goto err_con;
+
+	vtm_socket_set_state(con->sock, VTM_SOCK_STAT_NBL_WRITE);
+	rc = vtm_socket_listener_add(cl->li, con->sock);
+	if (rc != VTM_OK)
+		goto err_con;
+
+	return con;
+
+err_con:
+	vtm_http_parser_release(&con->parser);
+	vtm_buf_release(&con->recvbuf);
+	vtm_socket_close(con->sock);
+	vtm_socket_free(con->sock);
+
+err_sock:
+	free(con->key);
+
+err_key:
+	free(con);
+	return NULL;
+}
+
+static void vtm_http_client_async_con_idle(vtm_http_client_async *cl, struct vtm_http_client_async_con *con)
+{
+	unsigned int count;
+	struct vtm_http_client_async_con *first, *it;
+
+	first = vtm_map_get_pointer_va(cl->idle, con->key);
+
+	count = 0;
+	for (it = first; it; it = it->next)
+		count++;
+
+	if (count >= cl->opt_max_idle)
+		goto close;
+
+	con->req = NULL;
+	con->next = first;
+	if (vtm_map_put_va(cl->idle, con->key, con) != VTM_OK) {
+		con->next = NULL;
+		goto close;
+	}
+
+	/* watch for close by the peer */
+	if (vtm_http_client_async_con_watch(cl, con, VTM_SOCK_STAT_NBL_READ) != VTM_OK) {
+		vtm_http_client_async_con_unidle(cl, con);
+		goto close;
+	}
+
+	return;
+
+close:
+	vtm_http_client_async_con_free(cl, con);
+}
+
+static void vtm_http_client_async_con_unidle(vtm_http_client_async *cl, struct vtm_http_client_async_con *con)
+{
+	struct vtm_http_client_async_con *first, *it;
+
+	first = vtm_map_get_pointer_va(cl->idle, con->key);
+	if (first == con) {
+		if (con->next)
+			vtm_map_put_va(cl->idle, con->key, con->next);
+		else
+			vtm_map_remove_va(cl->idle, con->key);
+	}
+	else {
+		for (it = first; it; it = it->next) {
+			if (it->next == con) {
+				it->next = con->next;
+				break;
+			}
+		}
+	}
+
+	con->next = NULL;
+}
+
+static void vtm_http_client_async_con_free(vtm_http_client_async *cl, struct vtm_http_client_async_con *con)
+{
+	if (con->req)
+		con->req->con = NULL;
+
+	vtm_socket_listener_remove(cl->li, con->sock);
+	vtm_socket_close(con->sock);
+	vtm_socket_free(con->sock);
+
+	vtm_http_parser_release(&con->parser);
+	vtm_buf_release(&con->recvbuf);
+	free(con->key);
+	free(con);
+}
+
+static int vtm_http_client_async_con_watch(vtm_http_client_async *cl, struct vtm_http_client_async_con *con, unsigned int flag)
+{
+	vtm_socket_unset_state(con->sock, VTM_SOCK_STAT_NBL_READ | VTM_SOCK_STAT_NBL_WRITE);
+	vtm_socket_set_state(con->sock, flag);
+
+	return vtm_socket_listener_rearm(cl->li, con->sock);
+}
+
+static void vtm_http_client_async_con_fail(vtm_http_client_async *cl, struct vtm_http_client_async_con *con, int rc)
+{
+	bool retry;
+	struct vtm_http_client_async_req *areq;
+
+	areq = con->req;
+
+	/* reused connection may have been closed by the server meanwhile */
+	retry = con->reused && !areq->retried && con->recvbuf.used == 0;
+
+	vtm_http_client_async_con_free(cl, con);
+
+	if (!retry) {
+		vtm_http_client_async_finish(cl, areq, rc, NULL);
+		return;
+	}
+
+	/* restart request on a new connection */
+	if (areq->prev)
+		areq->prev->next = areq->next;
+	else
+		cl->active = areq->next;
+	if (areq->next)
+		areq->next->prev = areq->prev;
+
+	areq->retried = true;
+	areq->sendbuf.read = 0;
+	vtm_http_client_async_start(cl, areq);
+}
+
+static void vtm_http_client_async_con_send(vtm_http_client_async *cl, struct vtm_http_client_async_con *con)
+{
+	int rc;
+	size_t written;
+	struct vtm_buf *buf;
+
+	buf = &con->req->sendbuf;
+
+	while (buf->read < buf->used) {
+		rc = vtm_socket_write(con->sock, buf->data + buf->read, buf->used - buf->read, &written);
+		buf->read += written;
+
+		if (rc == VTM_E_IO_AGAIN) {
+			/* TLS may need to read before it can write */
+			rc = vtm_http_client_async_con_watch(cl, con,
+				(vtm_socket_get_state(con->sock) & VTM_SOCK_STAT_WRITE_AGAIN_WHEN_READABLE)
+					? VTM_SOCK_STAT_NBL_READ
+					: VTM_SOCK_STAT_NBL_WRITE);
+			if (rc != VTM_OK)
+				vtm_http_client_async_con_fail(cl, con, rc);
+			return;
+		}
+
+		if (rc != VTM_OK) {
+			vtm_http_client_async_con_fail(cl, con, rc);
+			return;
+		}
+	}
+
+	con->sending = false;
+	vtm_buf_clear(&con->recvbuf);
+	vtm_http_parser_reset(&con->parser);
+
+	vtm_http_client_async_con_recv(cl, con);
+}
+
+static void vtm_http_client_async_con_recv(vtm_http_client_async *cl, struct vtm_http_client_async_con *con)
+{
+	int rc;
+	size_t read;
+	enum vtm_net_recv_stat stat;
+
+	while (true) {
+		rc = vtm_buf_ensure(&con->recvbuf, VTM_HTTP_CL_ASYNC_READ_SIZE);
+		if (rc != VTM_OK) {
+			vtm_http_client_async_con_fail(cl, con, rc);
+			return;
+		}
+
+		rc = vtm_socket_read(con->sock, VTM_BUF_PUT_PTR(&con->recvbuf),
+			VTM_BUF_PUT_AVAIL_TOTAL(&con->recvbuf), &read);
+		VTM_BUF_PUT_INC(&con->recvbuf, read);
+
+		if (rc == VTM_E_IO_AGAIN) {
+			/* TLS may need to write before it can read */
+			rc = vtm_http_client_async_con_watch(cl, con,
+				(vtm_socket_get_state(con->sock) & VTM_SOCK_STAT_READ_AGAIN_WHEN_WRITEABLE)
+					? VTM_SOCK_STAT_NBL_WRITE
+					: VTM_SOCK_STAT_NBL_READ);
+			if (rc != VTM_OK)
+				vtm_http_client_async_con_fail(cl, con, rc);
+			return;
+		}
+
+		/* body without length ends with the connection */
+		if (rc == VTM_E_IO_EOF && con->parser.state == VTM_HTTP_PARSE_BODY_READALL) {
+			vtm_http_client_async_con_complete(cl, con, true);
+			return;
+		}
+
+		if (rc != VTM_OK) {
+			vtm_http_client_async_con_fail(cl, con, rc);
+			return;
+		}
+
+		stat = vtm_http_parser_run(&con->parser, &con->recvbuf);
+		switch (stat) {
+			case VTM_NET_RECV_STAT_AGAIN:
+				continue;
+
+			case VTM_NET_RECV_STAT_COMPLETE:
+				vtm_http_client_async_con_complete(cl, con, false);
+				return;
+
+			default:
+				vtm_http_client_async_con_fail(cl, con, VTM_E_IO_PROTOCOL);
+				return;
+		}
+	}
+}
+
+static void vtm_http_client_async_con_complete(vtm_http_client_async *cl, struct vtm_http_client_async_con *con, bool eof)
+{
+	bool keep;
+	const char *val;
+	struct vtm_http_client_async_req *areq;
+	struct vtm_http_client_res res;
+
+	/* finish body that was terminated by connection close */
+	if (eof && vtm_http_parser_run(&con->parser, &con->recvbuf) != VTM_NET_RECV_STAT_COMPLETE) {
+		vtm_http_client_async_con_fail(cl, con, VTM_E_IO_PROTOCOL);
+		return;
+	}
+
+	areq = con->req;
+
+	res.version = con->parser.version;
+	res.status_code = con->parser.res_status_code;
+	res.status_msg = con->parser.res_status_msg;
+	res.headers = con->parser.headers;
+	res.body = con->parser.body;
+	res.body_len = con->parser.body_len;
+
+	vtm_http_parser_reset(&con->parser);
+
+	/* decide whether the connection can be reused */
+	keep = !eof && VTM_BUF_GET_AVAIL_TOTAL(&con->recvbuf) == 0 &&
+		!(vtm_socket_get_state(con->sock) & VTM_SOCK_STAT_CLOSED);
+
+	val = res.headers ? vtm_dataset_get_string(res.headers, VTM_HTTP_HEADER_CONNECTION) : NULL;
+	if (val && vtm_str_casecmp(val, VTM_HTTP_VALUE_CLOSE) == 0)
+		keep = false;
+	if (areq->version < VTM_HTTP_VER_1_1 &&
+		(!val || vtm_str_casecmp(val, VTM_HTTP_VALUE_KEEP_ALIVE) != 0))
+		keep = false;
+
+	/* response is only valid during the callback */
+	con->req = NULL;
+	areq->con = NULL;
+	vtm_http_client_async_finish(cl, areq, VTM_OK, &res);
+	vtm_http_client_res_release(&res);
+
+	vtm_buf_clear(&con->recvbuf);
+	con->sending = true;
+
+	if (keep)
+		vtm_http_client_async_con_idle(cl, con);
+	else
+		vtm_http_client_async_con_free(cl, con);
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+/**
+ * @file http_client_async.h
+ *
+ * @brief Event based HTTP client for many concurrent requests
+ */
+
+#ifndef VTM_NET_HTTP_HTTP_CLIENT_ASYNC_H_
+#define VTM_NET_HTTP_HTTP_CLIENT_ASYNC_H_
+
+#include <vtm/core/api.h>
+#include <vtm/core/types.h>
+#include <vtm/net/http/http_client.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VTM_HTTP_CL_ASYNC_OPT_NO_CERT_CHECK  1  /**< expects bool */
+#define VTM_HTTP_CL_ASYNC_OPT_TIMEOUT        2  /**< expects unsigned long, default deadline in milliseconds */
+#define VTM_HTTP_CL_ASYNC_OPT_MAX_IDLE       3  /**< expects unsigned int, idle connections kept per destination */
+
+typedef struct vtm_http_client_async vtm_http_client_async;
+
+/**
+ * Called when a request finished.
+ *
+ * The callback runs in the thread that executes vtm_http_client_async_run().
+ * The response and all its fields are only valid until the callback
+ * returns. New requests may be started from within the callback.
+ *
+ * @param arg the user argument of the request
+ * @param rc VTM_OK if a response was received, otherwise the error code,
+ *        VTM_E_IO_TIMEOUT if the deadline elapsed and VTM_E_IO_CANCELED
+ *        if the client was stopped before
+ * @param res the response, NULL if an error occured
+ */
+typedef void (*vtm_http_client_async_cb)(void *arg, int rc, struct vtm_http_client_res *res);
+
+/**
+ * Creates a new client.
+ *
+ * @return the created client which can be used in the other functions
+ * @return NULL if an error occured
+ */
+VTM_API vtm_http_client_async* vtm_http_client_async_new(void);
+
+/**
+ * Releases the client and all allocated resources.
+ *
+ * The client must not be running anymore. Requests that were not started
+ * yet are finished with VTM_E_IO_CANCELED.
+ *
+ * @param cl the client that should be released
+ */
+VTM_API void vtm_http_client_async_free(vtm_http_client_async *cl);
+
+/**
+ * Sets one of the possible options.
+ *
+ * The possible options are macros starting with VTM_HTTP_CL_ASYNC_OPT_.
+ * Options should be set before the client runs.
+ *
+ * @param cl the client where the option should be set
+ * @param opt the option that should be set
+ * @param val pointer to new value of the option
+ * @param len size of the value
+ * @return VTM_OK if the option was successfully set
+ * @return VTM_E_NOT_SUPPORTED if the given option or the value format is
+ *         not supported
+ */
+VTM_API int vtm_http_client_async_set_opt(vtm_http_client_async *cl, int opt, const void *val, size_t len);
+
+/**
+ * Starts a request.
+ *
+ * The call does not block, the request is serialized immediately so that
+ * the passed structure and body can be released afterwards. It can be
+ * called from any thread. Idle connections to the same destination are
+ * reused, otherwise a new connection is opened.
+ *
+ * @param cl the client
+ * @param req the request parameters
+ * @param timeout deadline of the whole request in milliseconds, zero means
+ *        the VTM_HTTP_CL_ASYNC_OPT_TIMEOUT option is used
+ * @param cb the callback that is invoked when the request finished
+ * @param arg user argument that is passed to the callback
+ * @return VTM_OK if the request was queued, then the callback is
+ *         invoked exactly once
+ * @return VTM_E_INVALID_ARG if the url could not be parsed
+ * @return VTM_E_MALLOC if the request could not be allocated
+ */
+VTM_API int vtm_http_client_async_request(vtm_http_client_async *cl, struct vtm_http_client_req *req, unsigned long timeout, vtm_http_client_async_cb cb, void *arg);
+
+/**
+ * Runs the event loop of the client.
+ *
+ * The call blocks until vtm_http_client_async_stop() is called. All
+ * pending requests are finished with VTM_E_IO_CANCELED then.
+ *
+ * @param cl the client
+ * @return VTM_OK if the client was stopped
+ * @return VTM_E_INVALID_STATE if the client is already running
+ * @return VTM_ERROR if an error occured
+ */
+VTM_API int vtm_http_client_async_run(vtm_http_client_async *cl);
+
+/**
+ * Stops the event loop of the client.
+ *
+ * The call does not wait for the event loop to finish. It can be
+ * called from any thread, including request callbacks.
+ *
+ * @param cl the client
+ */
+VTM_API void vtm_http_client_async_stop(vtm_http_client_async *cl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_NET_HTTP_HTTP_CLIENT_ASYNC_H_ */
@@ -0,0 +1,390 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include "http_client_pool_intl.h"
+
+#include <stdlib.h> /* malloc(), free() */
+#include <vtm/core/error.h>
+#include <vtm/core/map.h>
+#include <vtm/util/mutex.h>
+#include <vtm/util/time.h>
+
+struct vtm_http_client_pool_host;
+
+struct vtm_http_client_pool_con
+{
+	vtm_socket                        *sock;
+	struct vtm_http_client_pool_host  *host;
+	uint64_t                          idle_since;
+
+	/* all idle connections, most recently used first */
+	struct vtm_http_client_pool_con   *prev;
+	struct vtm_http_client_pool_con   *next;
+
+	/* idle connections of the same destination */
+	struct vtm_http_client_pool_con   *host_prev;
+	struct vtm_http_client_pool_con   *host_next;
+};
+
+struct vtm_http_client_pool_host
+{
+	unsigned int                     open;  /**< idle and in use */
+	struct vtm_http_client_pool_con  *idle;
+};
+
+struct vtm_http_client_pool
+{
+	vtm_mutex                        *mtx;
+	vtm_cond                         *cond;
+	vtm_map                          *hosts;
+
+	struct vtm_http_client_pool_con  *head;
+	struct vtm_http_client_pool_con  *tail;
+
+	struct vtm_http_client_pool_opts opts;
+	struct vtm_http_client_pool_stats stats;
+};
+
+/* forward declaration */
+static struct vtm_http_client_pool_host* vtm_http_client_pool_get_host(vtm_http_client_pool *pool, const char *key);
+static void vtm_http_client_pool_link(vtm_http_client_pool *pool, struct vtm_http_client_pool_con *con);
+static void vtm_http_client_pool_unlink(vtm_http_client_pool *pool, struct vtm_http_client_pool_con *con);
+static void vtm_http_client_pool_drop(vtm_http_client_pool *pool, struct vtm_http_client_pool_con *con, struct vtm_http_client_pool_con **closed);
+static bool vtm_http_client_pool_expire(vtm_http_client_pool *pool, struct vtm_http_client_pool_con **closed);
+static bool vtm_http_client_pool_check(vtm_socket *sock);
+static void vtm_http_client_pool_close(struct vtm_http_client_pool_con *chain);
+
+vtm_http_client_pool* vtm_http_client_pool_new(const struct vtm_http_client_pool_opts *opts)
+{
+	vtm_http_client_pool *pool;
+
+	pool = malloc(sizeof(*pool));
+	if (!pool) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	pool->mtx = vtm_mutex_new();
+	if (!pool->mtx)
+		goto err_mtx;
+
+	pool->cond = vtm_cond_new();
+	if (!pool->cond)
+		goto err_cond;
+
+	pool->hosts = vtm_map_new(VTM_ELEM_STRING, VTM_ELEM_POINTER, 16);
+	if (!pool->hosts)
+		goto err_map;
+
+	vtm_map_set_free_func(pool->hosts, free);
+
+	pool->head = NULL;
+	pool->tail = NULL;
+	pool->opts = *opts;
+	pool->stats.hits = 0;
+	pool->stats.misses = 0;
+	pool->stats.stale = 0;
+	pool->stats.evicted = 0;
+	pool->stats.idle = 0;
+
+	return pool;
+
+err_map:
+	vtm_cond_free(pool->cond);
+
+err_cond:
+	vtm_mutex_free(pool->mtx);
+
+err_mtx:
+	free(pool);
+	return NULL;
+}
+
+void vtm_http_client_pool_free(vtm_http_client_pool *pool)
+{
+	struct vtm_http_client_pool_con *con, *next;
+
+	if (!pool)
+		return;
+
+	for (con = pool->head; con; con = next) {
+		next = con->next;
+		vtm_socket_close(con->sock);
+		vtm_socket_free(con->sock);
+		free(con);
+	}
+
+	vtm_map_free(pool->hosts);
+	vtm_cond_free(pool->cond);
+	vtm_mutex_free(pool->mtx);
+	free(pool);
+}
+
+void vtm_http_client_pool_evict(vtm_http_client_pool *pool)
+{
+	struct vtm_http_client_pool_con *closed;
+
+	closed = NULL;
+
+	vtm_mutex_lock(pool->mtx);
+	if (vtm_http_client_pool_expire(pool, &closed))
+		vtm_cond_signal_all(pool->cond);
+	vtm_mutex_unlock(pool->mtx);
+
+	vtm_http_client_pool_close(closed);
+}
+
+void vtm_http_client_pool_get_stats(vtm_http_client_pool *pool, struct vtm_http_client_pool_stats *stats)
+{
+	vtm_mutex_lock(pool->mtx);
+	*stats = pool->stats;
+	vtm_mutex_unlock(pool->mtx);
+}
+
+int vtm_http_client_pool_acquire(vtm_http_client_pool *pool, const char *key, vtm_socket **sock)
+{
+	bool healthy;
+	struct vtm_http_client_pool_host *host;
+	struct vtm_http_client_pool_con *con, *closed;
+
+	*sock = NULL;
+	closed = NULL;
+
+	vtm_mutex_lock(pool->mtx);
+
+	host = vtm_http_client_pool_get_host(pool, key);
+	if (!host) {
+		vtm_mutex_unlock(pool->mtx);
+		return vtm_err_get_code();
+	}
+
+	vtm_http_client_pool_expire(pool, &closed);
+
+	while (true) {
+		/* reuse idle connection, it keeps its slot */
+		con = host->idle;
+		if (con) {
+			vtm_http_client_pool_unlink(pool, con);
+
+			vtm_mutex_unlock(pool->mtx);
+			healthy = vtm_http_client_pool_check(con->sock);
+			vtm_mutex_lock(pool->mtx);
+
+			if (healthy) {
+				pool->stats.hits++;
+				*sock = con->sock;
+				free(con);
+				break;
+			}
+
+			pool->stats.stale++;
+			host->open--;
+			con->next = closed;
+			closed = con;
+			continue;
+		}
+
+		/* reserve slot for a new connection */
+		if (pool->opts.max_per_host == 0 || host->open < pool->opts.max_per_host) {
+			pool->stats.misses++;
+			host->open++;
+			break;
+		}
+
+		vtm_cond_wait(pool->cond, pool->mtx);
+	}
+
+	/* freed slots may be used by other destinations */
+	if (closed)
+		vtm_cond_signal_all(pool->cond);
+
+	vtm_mutex_unlock(pool->mtx);
+
+	vtm_http_client_pool_close(closed);
+
+	return VTM_OK;
+}
+
+void vtm_http_client_pool_release(vtm_http_client_pool *pool, const char *key, vtm_socket *sock)
+{
+	struct vtm_http_client_pool_host *host;
+	struct vtm_http_client_pool_con *con, *closed;
+
+	closed = NULL;
+
+	con = malloc(sizeof(*con));
+	if (!con) {
+		vtm_socket_close(sock);
+		vtm_socket_free(sock);
+		vtm_http_client_pool_discard(pool, key);
+		return;
+	}
+
+	con->sock = sock;
+	con->idle_since = vtm_time_current_millis();
+
+	vtm_mutex_lock(pool->mtx);
+
+	host = vtm_map_get_pointer_va(pool->hosts, key);
+	VTM_ASSERT(host);
+	con->host = host;
+
+	/* oldest idle connection makes room */
+	if (pool->opts.max_idle > 0 && pool->stats.idle >= pool->opts.max_idle && pool->tail) {
+		pool->stats.evicted++;
+		vtm_http_client_pool_drop(pool, pool->tail, &closed);
+	}
+
+	vtm_http_client_pool_link(pool, con);
+	vtm_http_client_pool_expire(pool, &closed);
+
+	vtm_cond_signal_all(pool->cond);
+	vtm_mutex_unlock(pool->mtx);
+
+	vtm_http_client_pool_close(closed);
+}
+
+void vtm_http_client_pool_discard(vtm_http_client_pool *pool, const char *key)
+{
+	struct vtm_http_client_pool_host *host;
+
+	vtm_mutex_lock(pool->mtx);
+
+	host = vtm_map_get_pointer_va(pool->hosts, key);
+	VTM_ASSERT(host && host->open > 0);
+	host->open--;
+
+	vtm_cond_signal_all(pool->cond);
+	vtm_mutex_unlock(pool->mtx);
+}
+
+static struct vtm_http_client_pool_host* vtm_http_client_pool_get_host(vtm_http_client_pool *pool, const char *key)
+{
+	struct vtm_http_client_pool_host *host;
+
+	host = vtm_map_get_pointer_va(pool->hosts, key);
+	if (host)
+		return host;
+
+	host = malloc(sizeof(*host));
+	if (!host) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	host->open = 0;
+	host->idle = NULL;
+
+	if (vtm_map_put_va(pool->hosts, key, host) != VTM_OK) {
+		free(host);
+		return NULL;
+	}
+
+	return host;
+}
+
+static void vtm_http_client_pool_link(vtm_http_client_pool *pool, struct vtm_http_client_pool_con *con)
+{
+	con->prev = NULL;
+	con->next = pool->head;
+	if (pool->head)
+		pool->head->prev = con;
+	else
+		pool->tail = con;
+	pool->head = con;
+
+	con->host_prev = NULL;
+	con->host_next = con->host->idle;
+	if (con->host->idle)
+		con->host->idle->host_prev = con;
+	con->host->idle = con;
+
+	pool->stats.idle++;
+}
+
+static void vtm_http_client_pool_unlink(vtm_http_client_pool *pool, struct vtm_http_client_pool_con *con)
+{
+	if (con->prev)
+		con->prev->next = con->next;
+	else
+		pool->head = con->next;
+
+	if (con->next)
+		con->next->prev = con->prev;
+	else
+		pool->tail = con->prev;
+
+	if (con->host_prev)
+		con->host_prev->host_next = con->host_next;
+	else
+		con->host->idle = con->host_next;
+
+	if (con->host_next)
+		con->host_next->host_prev = con->host_prev;
+
+	pool->stats.idle--;
+}
+
+static void vtm_http_client_pool_drop(vtm_http_client_pool *pool, struct vtm_http_client_pool_con *con, struct vtm_http_client_pool_con **closed)
+{
+	vtm_http_client_pool_unlink(pool, con);
+	con->host->open--;
+
+	con->next = *closed;
+	*closed = con;
+}
+
+static bool vtm_http_client_pool_expire(vtm_http_client_pool *pool, struct vtm_http_client_pool_con **closed)
+{
+	uint64_t now;
+	bool expired;
+
+	if (pool->opts.idle_timeout == 0)
+		return false;
+
+	now = vtm_time_current_millis();
+	expired = false;
+
+	while (pool->tail && now - pool->tail->idle_since >= pool->opts.idle_timeout) {
+		pool->stats.evicted++;
+		vtm_http_client_pool_drop(pool, pool->tail, closed);
+		expired = true;
+	}
+
+	return expired;
+}
+
+static bool vtm_http_client_pool_check(vtm_socket *sock)
+{
+	int rc;
+	char c;
+	size_t read;
+
+	if (vtm_socket_get_state(sock) & VTM_SOCK_STAT_CLOSED)
+		return false;
+
+	/* idle connection must neither be closed nor have pending data */
+	rc = vtm_socket_set_opt(sock, VTM_SOCK_OPT_NONBLOCKING, (bool[]) {true}, sizeof(bool));
+	if (rc != VTM_OK)
+		return false;
+
+	rc = vtm_socket_read(sock, &c, 1, &read);
+
+	if (vtm_socket_set_opt(sock, VTM_SOCK_OPT_NONBLOCKING, (bool[]) {false}, sizeof(bool)) != VTM_OK)
+		return false;
+
+	return rc == VTM_E_IO_AGAIN;
+}
+
+static void vtm_http_client_pool_close(struct vtm_http_client_pool_con *chain)
+{
+	struct vtm_http_client_pool_con *next;
+
+	for (; chain; chain = next) {
+		next = chain->next;
+		vtm_socket_close(chain->sock);
+		vtm_socket_free(chain->sock);
+		free(chain);
+	}
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+/**
+ * @file http_client_pool.h
+ *
+ * @brief Keep-alive connection pool for HTTP clients
+ */
+
+#ifndef VTM_NET_HTTP_HTTP_CLIENT_POOL_H_
+#define VTM_NET_HTTP_HTTP_CLIENT_POOL_H_
+
+#include <vtm/core/api.h>
+#include <vtm/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct vtm_http_client_pool vtm_http_client_pool;
+
+/** pool limits, zero means unlimited */
+struct vtm_http_client_pool_opts
+{
+	/** maximum number of idle connections over all destinations */
+	unsigned int   max_idle;
+
+	/**
+	 * Maximum number of open connections to one destination, including
+	 * the ones in use. When the limit is reached, a request waits until
+	 * another client returns or closes a connection.
+	 */
+	unsigned int   max_per_host;
+
+	/** milliseconds after which an idle connection is closed */
+	unsigned long  idle_timeout;
+};
+
+/** pool counters */
+struct vtm_http_client_pool_stats
+{
+	uint64_t      hits;     /**< requests that reused an idle connection */
+	uint64_t      misses;   /**< requests that opened a new connection */
+	uint64_t      stale;    /**< idle connections closed by the peer */
+	uint64_t      evicted;  /**< idle connections closed by the limits */
+	unsigned int  idle;     /**< current number of idle connections */
+};
+
+/**
+ * Creates a new pool.
+ *
+ * The pool can be shared between clients of different threads, it is
+ * assigned to a client with the VTM_HTTP_CL_OPT_POOL option. Connections
+ * are only reused for the same scheme, host, port and socket family.
+ *
+ * @param opts the limits of the pool
+ * @return the created pool
+ * @return NULL if an error occured
+ */
+VTM_API vtm_http_client_pool* vtm_http_client_pool_new(const struct vtm_http_client_pool_opts *opts);
+
+/**
+ * Closes all idle connections and releases the pool.
+ *
+ * All clients using the pool must be released before.
+ *
+ * @param pool the pool that should be released
+ */
+VTM_API void vtm_http_client_pool_free(vtm_http_client_pool *pool);
+
+/**
+ * Closes all connections that exceeded the idle timeout.
+ *
+ * This happens automatically whenever a connection is taken from or
+ * returned to the pool, calling it periodically also cleans up pools
+ * that are not in use.
+ *
+ * @param pool the pool
+ */
+VTM_API void vtm_http_client_pool_evict(vtm_http_client_pool *pool);
+
+/**
+ * Retrieves the current counters.
+ *
+ * @param pool the pool
+ * @param[out] stats the counters are stored here
+ */
+VTM_API void vtm_http_client_pool_get_stats(vtm_http_client_pool *pool, struct vtm_http_client_pool_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_NET_HTTP_HTTP_CLIENT_POOL_H_ */
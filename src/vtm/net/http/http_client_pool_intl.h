@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#ifndef VTM_NET_HTTP_HTTP_CLIENT_POOL_INTL_H_
+#define VTM_NET_HTTP_HTTP_CLIENT_POOL_INTL_H_
+
+#include <vtm/net/socket.h>
+#include <vtm/net/http/http_client_pool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Reserves a connection slot for the destination. The socket is NULL
+ * when no idle connection was available, then the caller connects and
+ * either releases or discards the slot afterwards.
+ */
+int vtm_http_client_pool_acquire(vtm_http_client_pool *pool, const char *key, vtm_socket **sock);
+
+/* connection can be reused */
+void vtm_http_client_pool_release(vtm_http_client_pool *pool, const char *key, vtm_socket *sock);
+
+/* connection was closed by the caller */
+void vtm_http_client_pool_discard(vtm_http_client_pool *pool, const char *key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_NET_HTTP_HTTP_CLIENT_POOL_INTL_H_ */
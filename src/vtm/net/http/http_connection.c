@@ -4,10 +4,20 @@
 
 #include "http_connection_intl.h"
 
+#include <string.h> /* memcmp() */
+
 #include <vtm/core/buffer.h>
 #include <vtm/core/error.h>
+#include <vtm/core/math.h>
+#include <vtm/core/string.h>
 #include <vtm/net/http/http_connection_base_intl.h>
+#include <vtm/net/http/http2_connection_intl.h>
 #include <vtm/net/http/http_parser.h>
+#include <vtm/net/http/http_request_intl.h>
+#include <vtm/net/http/http_response_intl.h>
+
+/** maximum bytes read from socket at once while streaming a body */
+#define VTM_HTTP_CON_STREAM_WINDOW   (16*1024)
 
 struct vtm_http_con
 {
@@ -16,10 +26,22 @@ struct vtm_http_con
 	struct vtm_http_parser       parser;
 	struct vtm_socket_emitter    *emitter;
 	bool                         clear;
+
+	/* HTTP/2 with prior knowledge */
+	bool                         h2_detect;
+	bool                         h2_preface;
+
+	/* streamed request body */
+	bool                         stream;
+	struct vtm_http_req          stream_req;
+	char                         *stream_path;
+	vtm_http_res                 *stream_res;
+	uint64_t                     stream_begin;
 };
 
 /* forward declaration */
 static enum vtm_net_recv_stat vtm_http_con_read(struct vtm_http_con_base *base_con);
+static enum vtm_net_recv_stat vtm_http_con_read_stream(vtm_http_con *con);
 static int vtm_http_con_write(struct vtm_http_con_base *base_con);
 
 vtm_http_con* vtm_http_con_new(vtm_socket *sock)
@@ -42,6 +64,14 @@ vtm_http_con* vtm_http_con_new(vtm_socket *sock)
 	con->emitter = NULL;
 	con->clear = false;
 
+	con->h2_detect = false;
+	con->h2_preface = false;
+
+	con->stream = false;
+	con->stream_path = NULL;
+	con->stream_res = NULL;
+	con->stream_begin = 0;
+
 	vtm_buf_init(&con->recvbuf, VTM_BYTEORDER_LE);
 	vtm_http_parser_init(&con->parser, VTM_HTTP_PM_REQUEST);
 
@@ -50,6 +80,13 @@ vtm_http_con* vtm_http_con_new(vtm_socket *sock)
 
 void vtm_http_con_free(vtm_http_con *con)
 {
+	vtm_http_con_end_stream(con);
+	if (con->stream_res)
+		vtm_http_res_free(con->stream_res);
+
+	if (con->emitter)
+		vtm_socket_emitter_free_chain(con->emitter);
+
 	vtm_buf_release(&con->recvbuf);
 	vtm_http_parser_release(&con->parser);
 	free(con);
@@ -70,17 +107,169 @@ int vtm_http_con_get_request(vtm_http_con *con, struct vtm_http_req *req)
 	req->path = con->parser.req_path;
 	req->headers = con->parser.headers;
 	req->params = con->parser.req_params;
+	req->body = con->parser.body;
+	req->body_len = (size_t) con->parser.body_len;
+	req->streamed = false;
+	req->usr_data = NULL;
 	req->con = con;
+	req->path_param_count = 0;
 
 	con->clear = true;
+	con->h2_detect = false;
 	vtm_http_parser_reset(&con->parser);
 
 	return VTM_OK;
 }
 
-void vtm_http_con_set_emitter(vtm_http_con *con, struct vtm_socket_emitter *se)
+void vtm_http_con_set_h2_detect(vtm_http_con *con, bool enabled)
 {
-	con->emitter = se;
+	con->h2_detect = enabled;
+}
+
+bool vtm_http_con_has_h2_preface(vtm_http_con *con)
+{
+	return con->h2_preface;
+}
+
+void vtm_http_con_get_pending(vtm_http_con *con, const void **data, size_t *len)
+{
+	*data = con->recvbuf.data + con->recvbuf.read;
+	*len = VTM_BUF_GET_AVAIL_TOTAL(&con->recvbuf);
+}
+
+int vtm_http_con_send(vtm_http_con *con, struct vtm_socket_emitter *se)
+{
+	int rc;
+	struct vtm_socket_emitter *last;
+
+	/* previous output is still pending, keep the order */
+	if (con->emitter) {
+		for (last = con->emitter; last->next; last = last->next);
+		last->next = se;
+		return VTM_OK;
+	}
+
+	rc = vtm_socket_emitter_try_write(&se);
+	switch (rc) {
+		case VTM_OK:
+			return VTM_OK;
+
+		case VTM_E_IO_AGAIN:
+			/* remaining data is written when socket is writeable */
+			con->emitter = se;
+			return VTM_OK;
+
+		default:
+			vtm_socket_emitter_free_chain(se);
+			break;
+	}
+
+	return rc;
+}
+
+struct vtm_socket_emitter* vtm_http_con_take_emitter(vtm_http_con *con)
+{
+	struct vtm_socket_emitter *se;
+
+	se = con->emitter;
+	con->emitter = NULL;
+
+	return se;
+}
+
+void vtm_http_con_set_stream_body(vtm_http_con *con, bool enabled)
+{
+	con->parser.stream_body = enabled;
+}
+
+bool vtm_http_con_in_stream(vtm_http_con *con)
+{
+	return con->stream || VTM_HTTP_PARSER_IN_STREAM(&con->parser);
+}
+
+int vtm_http_con_begin_stream(vtm_http_con *con, struct vtm_http_req **req, vtm_http_res **res)
+{
+	struct vtm_http_req *sreq;
+
+	if (con->stream || !VTM_HTTP_PARSER_IN_STREAM(&con->parser))
+		return VTM_E_INVALID_STATE;
+
+	if (!con->stream_res) {
+		con->stream_res = vtm_http_res_new();
+		if (!con->stream_res)
+			return vtm_err_get_code();
+	}
+
+	/* path points into the receive buffer which is reused for the body */
+	con->stream_path = vtm_str_copy(con->parser.req_path);
+	if (!con->stream_path)
+		return vtm_err_get_code();
+
+	sreq = &con->stream_req;
+	sreq->method = con->parser.req_method;
+	sreq->version = con->parser.version;
+	sreq->path = con->stream_path;
+	sreq->headers = con->parser.headers;
+	sreq->params = con->parser.req_params;
+	sreq->body = NULL;
+	sreq->body_len = 0;
+	sreq->streamed = true;
+	sreq->usr_data = NULL;
+	sreq->con = con;
+	sreq->path_param_count = 0;
+
+	/* request owns headers and params now */
+	con->parser.headers = NULL;
+	con->parser.headers_free = false;
+	con->parser.req_params = NULL;
+	con->parser.req_params_free = false;
+
+	con->stream = true;
+
+	*req = sreq;
+	*res = con->stream_res;
+
+	return VTM_OK;
+}
+
+enum vtm_net_recv_stat vtm_http_con_get_body(vtm_http_con *con, const void **data, size_t *len)
+{
+	return vtm_http_parser_run_body(&con->parser, &con->recvbuf, data, len);
+}
+
+struct vtm_http_req* vtm_http_con_get_stream_request(vtm_http_con *con)
+{
+	return con->stream ? &con->stream_req : NULL;
+}
+
+vtm_http_res* vtm_http_con_get_stream_response(vtm_http_con *con)
+{
+	return con->stream ? con->stream_res : NULL;
+}
+
+void vtm_http_con_set_stream_begin(vtm_http_con *con, uint64_t begin)
+{
+	con->stream_begin = begin;
+}
+
+uint64_t vtm_http_con_get_stream_begin(vtm_http_con *con)
+{
+	return con->stream_begin;
+}
+
+void vtm_http_con_end_stream(vtm_http_con *con)
+{
+	if (!con->stream)
+		return;
+
+	vtm_http_req_release(&con->stream_req);
+	free(con->stream_path);
+	con->stream_path = NULL;
+	con->stream = false;
+
+	/* trailing data belongs to the next request */
+	con->clear = true;
+	vtm_http_parser_reset(&con->parser);
 }
 
 static enum vtm_net_recv_stat vtm_http_con_read(struct vtm_http_con_base *base_con)
@@ -88,9 +277,13 @@ static enum vtm_net_recv_stat vtm_http_con_read(struct vtm_http_con_base *base_c
 	int rc;
 	vtm_http_con *con;
 	size_t read;
+	size_t avail;
 
 	con = (vtm_http_con*) base_con;
 
+	if (vtm_http_con_in_stream(con))
+		return vtm_http_con_read_stream(con);
+
 	/* discard buffer contents from previous request */
 	if (con->clear) {
 		con->clear = false;
@@ -110,10 +303,55 @@ static enum vtm_net_recv_stat vtm_http_con_read(struct vtm_http_con_base *base_c
 	if (rc != VTM_OK && rc != VTM_E_IO_AGAIN)
 		return VTM_NET_RECV_STAT_ERROR;
 
+	/* first bytes may be the HTTP/2 connection preface */
+	if (con->h2_detect) {
+		avail = VTM_MIN(VTM_BUF_GET_AVAIL_TOTAL(&con->recvbuf), VTM_HTTP2_PREFACE_LEN);
+		if (memcmp(con->recvbuf.data + con->recvbuf.read, VTM_HTTP2_PREFACE, avail) != 0)
+			con->h2_detect = false;
+		else if (avail < VTM_HTTP2_PREFACE_LEN)
+			return VTM_NET_RECV_STAT_AGAIN;
+		else {
+			con->h2_preface = true;
+			return VTM_NET_RECV_STAT_COMPLETE;
+		}
+	}
+
 	/* run parser */
 	return vtm_http_parser_run(&con->parser, &con->recvbuf);
 }
 
+static enum vtm_net_recv_stat vtm_http_con_read_stream(vtm_http_con *con)
+{
+	int rc;
+	size_t read;
+
+	/* handler is busy, leave data in socket */
+	if (vtm_socket_get_state(con->base.sock) & VTM_SOCK_STAT_READ_PAUSED)
+		return VTM_NET_RECV_STAT_AGAIN;
+
+	/* deliver buffered data first */
+	if (VTM_BUF_GET_AVAIL_TOTAL(&con->recvbuf) > 0 ||
+		con->parser.state == VTM_HTTP_PARSE_COMPLETE)
+		return VTM_NET_RECV_STAT_COMPLETE;
+
+	/* everything was consumed, buffer starts over */
+	vtm_buf_discard_processed(&con->recvbuf);
+
+	rc = vtm_buf_ensure(&con->recvbuf, VTM_HTTP_CON_STREAM_WINDOW);
+	if (rc != VTM_OK)
+		return VTM_NET_RECV_STAT_ERROR;
+
+	rc = vtm_socket_read(con->base.sock, VTM_BUF_PUT_PTR(&con->recvbuf),
+		VTM_MIN(VTM_HTTP_CON_STREAM_WINDOW, VTM_BUF_PUT_AVAIL_TOTAL(&con->recvbuf)),
+		&read);
+
+	VTM_BUF_PUT_INC(&con->recvbuf, read);
+	if (rc != VTM_OK && rc != VTM_E_IO_AGAIN)
+		return VTM_NET_RECV_STAT_ERROR;
+
+	return read > 0 ? VTM_NET_RECV_STAT_COMPLETE : VTM_NET_RECV_STAT_AGAIN;
+}
+
 static int vtm_http_con_write(struct vtm_http_con_base *base_con)
 {
 	int rc;
@@ -16,7 +16,9 @@ extern "C" {
 enum vtm_http_con_type
 {
 	VTM_HTTP_CON_TYPE_H1,
-	VTM_HTTP_CON_TYPE_WS
+	VTM_HTTP_CON_TYPE_WS,
+	VTM_HTTP_CON_TYPE_H2,
+	VTM_HTTP_CON_TYPE_SSE
 };
 
 struct vtm_http_con_base
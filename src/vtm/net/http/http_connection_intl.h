@@ -23,7 +23,25 @@ void vtm_http_con_free(vtm_http_con *con);
 vtm_socket* vtm_http_con_get_socket(vtm_http_con *con);
 int vtm_http_con_get_request(vtm_http_con *con, struct vtm_http_req *req);
 
-void vtm_http_con_set_emitter(vtm_http_con *con, struct vtm_socket_emitter *se);
+/* output is queued behind pending data and resumed when writeable */
+int vtm_http_con_send(vtm_http_con *con, struct vtm_socket_emitter *se);
+struct vtm_socket_emitter* vtm_http_con_take_emitter(vtm_http_con *con);
+
+/* HTTP/2 with prior knowledge */
+void vtm_http_con_set_h2_detect(vtm_http_con *con, bool enabled);
+bool vtm_http_con_has_h2_preface(vtm_http_con *con);
+void vtm_http_con_get_pending(vtm_http_con *con, const void **data, size_t *len);
+
+/* streamed request body */
+void vtm_http_con_set_stream_body(vtm_http_con *con, bool enabled);
+bool vtm_http_con_in_stream(vtm_http_con *con);
+int vtm_http_con_begin_stream(vtm_http_con *con, struct vtm_http_req **req, vtm_http_res **res);
+enum vtm_net_recv_stat vtm_http_con_get_body(vtm_http_con *con, const void **data, size_t *len);
+struct vtm_http_req* vtm_http_con_get_stream_request(vtm_http_con *con);
+vtm_http_res* vtm_http_con_get_stream_response(vtm_http_con *con);
+void vtm_http_con_set_stream_begin(vtm_http_con *con, uint64_t begin);
+uint64_t vtm_http_con_get_stream_begin(vtm_http_con *con);
+void vtm_http_con_end_stream(vtm_http_con *con);
 
 #ifdef __cplusplus
 }
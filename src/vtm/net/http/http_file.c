@@ -4,11 +4,29 @@
 
 #include "http_file.h"
 
+#include <ctype.h> /* tolower() */
+#include <stdio.h> /* snprintf() */
+#include <vtm/core/buffer.h>
 #include <vtm/core/error.h>
+#include <vtm/core/hash.h>
+#include <vtm/core/system.h>
 #include <vtm/fs/mime.h>
 #include <vtm/net/socket_emitter.h>
 #include <vtm/net/http/http.h>
 #include <vtm/net/http/http_response.h>
+#include <vtm/util/time.h>
+
+#define VTM_HTTP_FILE_RANGE_LEN      80
+#define VTM_HTTP_FILE_BOUNDARY_LEN   32
+
+/* forward declaration */
+static bool vtm_http_file_parse_num(const char **src, uint64_t *val, bool *overflow);
+static int vtm_http_file_range_headers(vtm_http_res *res, const char *mime, const char *boundary, uint64_t size, const struct vtm_http_range *ranges, size_t count);
+static int vtm_http_file_fmt_range(char *buf, size_t len, const struct vtm_http_range *range, uint64_t size);
+static void vtm_http_file_make_boundary(vtm_http_res *res, char *buf, size_t len);
+static int vtm_http_file_put_part_header(struct vtm_buf *buf, const char *boundary, const char *mime, const struct vtm_http_range *range, uint64_t size);
+static int vtm_http_file_put_part_end(struct vtm_buf *buf, const char *boundary);
+static int vtm_http_file_chain_buffer(struct vtm_socket_emitter ***tail, struct vtm_buf *buf);
 
 int vtm_http_file_serve(vtm_http_res *res, const char *name, FILE *fp)
 {
@@ -31,3 +49,369 @@ int vtm_http_file_serve(vtm_http_res *res, const char *name, FILE *fp)
 
 	return vtm_http_res_body_emt(res, se);
 }
+
+int vtm_http_file_parse_range(const char *src, uint64_t size, struct vtm_http_range *ranges, size_t *count)
+{
+	const char *unit;
+	uint64_t first, last;
+	bool has_first, has_last, overflow;
+	size_t max, specs, n;
+
+	/* unit is case-insensitive */
+	for (unit = VTM_HTTP_VALUE_BYTES; *unit != '\0'; unit++, src++) {
+		if (tolower((unsigned char) *src) != *unit)
+			return VTM_E_INVALID_ARG;
+	}
+
+	if (*src++ != '=')
+		return VTM_E_INVALID_ARG;
+
+	max = *count;
+	specs = 0;
+	n = 0;
+
+	while (true) {
+		/* skip whitespace and empty list elements */
+		while (*src == ' ' || *src == '\t' || *src == ',')
+			src++;
+
+		if (*src == '\0')
+			break;
+
+		overflow = false;
+		has_first = vtm_http_file_parse_num(&src, &first, &overflow);
+
+		if (*src++ != '-')
+			return VTM_E_INVALID_ARG;
+
+		has_last = vtm_http_file_parse_num(&src, &last, &overflow);
+
+		if (overflow || (!has_first && !has_last))
+			return VTM_E_INVALID_ARG;
+
+		if (has_first && has_last && last < first)
+			return VTM_E_INVALID_ARG;
+
+		while (*src == ' ' || *src == '\t')
+			src++;
+
+		if (*src != ',' && *src != '\0')
+			return VTM_E_INVALID_ARG;
+
+		specs++;
+
+		if (has_first) {
+			/* first-last or first- */
+			if (first >= size)
+				continue;
+
+			if (!has_last || last >= size)
+				last = size - 1;
+
+			if (n == max)
+				return VTM_E_INVALID_ARG;
+
+			ranges[n].offset = first;
+			ranges[n].len = last - first + 1;
+			n++;
+		}
+		else {
+			/* suffix range -len */
+			if (last == 0 || size == 0)
+				continue;
+
+			if (last > size)
+				last = size;
+
+			if (n == max)
+				return VTM_E_INVALID_ARG;
+
+			ranges[n].offset = size - last;
+			ranges[n].len = last;
+			n++;
+		}
+	}
+
+	if (specs == 0)
+		return VTM_E_INVALID_ARG;
+
+	*count = n;
+
+	return (n > 0) ? VTM_OK : VTM_E_OUT_OF_RANGE;
+}
+
+int vtm_http_file_serve_ranges(vtm_http_res *res, const char *name, FILE *fp, uint64_t size, const struct vtm_http_range *ranges, size_t count)
+{
+	int rc;
+	size_t i;
+	const char *mime;
+	char boundary[VTM_HTTP_FILE_BOUNDARY_LEN];
+	struct vtm_socket_emitter *head, **tail, *trailer, *se;
+	struct vtm_buf *buf;
+
+	if (count == 0)
+		return vtm_err_set(VTM_E_INVALID_ARG);
+
+	mime = vtm_mime_type_for_name(name);
+	vtm_http_file_make_boundary(res, boundary, sizeof(boundary));
+
+	rc = vtm_http_file_range_headers(res, mime, boundary, size, ranges, count);
+	if (rc != VTM_OK)
+		return rc;
+
+	if (count == 1) {
+		se = vtm_socket_emitter_for_file_range(NULL, fp, ranges[0].offset, ranges[0].len, true);
+		if (!se)
+			return vtm_err_get_code();
+
+		rc = vtm_http_res_body_emt(res, se);
+		if (rc != VTM_OK) {
+			se->vtm_sock_emt_clean = NULL;
+			vtm_socket_emitter_free_single(se);
+		}
+		return rc;
+	}
+
+	head = NULL;
+	tail = &head;
+	trailer = NULL;
+
+	/* closing delimiter, created first so that nothing can fail
+	   after the emitter owning the file stream was created */
+	buf = vtm_buf_new(vtm_sys_get_byteorder());
+	if (!buf)
+		return vtm_err_get_code();
+
+	rc = vtm_http_file_put_part_end(buf, boundary);
+	if (rc != VTM_OK) {
+		vtm_buf_free(buf);
+		return rc;
+	}
+
+	trailer = vtm_socket_emitter_for_buffer(NULL, buf, true);
+	if (!trailer) {
+		vtm_buf_free(buf);
+		return vtm_err_get_code();
+	}
+
+	/* part header followed by range of file */
+	for (i=0; i < count; i++) {
+		buf = vtm_buf_new(vtm_sys_get_byteorder());
+		if (!buf) {
+			rc = vtm_err_get_code();
+			goto err;
+		}
+
+		rc = vtm_http_file_put_part_header(buf, boundary, mime, &ranges[i], size);
+		if (rc != VTM_OK) {
+			vtm_buf_free(buf);
+			goto err;
+		}
+
+		rc = vtm_http_file_chain_buffer(&tail, buf);
+		if (rc != VTM_OK)
+			goto err;
+
+		/* last range emitter closes the shared file stream */
+		se = vtm_socket_emitter_for_file_range(NULL, fp, ranges[i].offset,
+			ranges[i].len, i == count - 1);
+		if (!se) {
+			rc = vtm_err_get_code();
+			goto err;
+		}
+
+		*tail = se;
+		tail = &se->next;
+	}
+
+	*tail = trailer;
+
+	rc = vtm_http_res_body_emt(res, head);
+	if (rc != VTM_OK) {
+		se->vtm_sock_emt_clean = NULL;
+		vtm_socket_emitter_free_chain(head);
+	}
+
+	return rc;
+
+err:
+	vtm_socket_emitter_free_chain(head);
+	vtm_socket_emitter_free_single(trailer);
+	return rc;
+}
+
+int vtm_http_file_serve_raw_ranges(vtm_http_res *res, const char *mime, const void *src, uint64_t size, const struct vtm_http_range *ranges, size_t count)
+{
+	int rc;
+	size_t i;
+	char boundary[VTM_HTTP_FILE_BOUNDARY_LEN];
+	struct vtm_buf buf;
+
+	if (count == 0)
+		return vtm_err_set(VTM_E_INVALID_ARG);
+
+	vtm_http_file_make_boundary(res, boundary, sizeof(boundary));
+
+	rc = vtm_http_file_range_headers(res, mime, boundary, size, ranges, count);
+	if (rc != VTM_OK)
+		return rc;
+
+	if (count == 1)
+		return vtm_http_res_body_raw(res, (const char*) src + ranges[0].offset,
+			(size_t) ranges[0].len);
+
+	vtm_buf_init(&buf, vtm_sys_get_byteorder());
+
+	for (i=0; i < count; i++) {
+		vtm_buf_clear(&buf);
+		rc = vtm_http_file_put_part_header(&buf, boundary, mime, &ranges[i], size);
+		if (rc != VTM_OK)
+			goto end;
+
+		rc = vtm_buf_putm(&buf, (const char*) src + ranges[i].offset, (size_t) ranges[i].len);
+		if (rc != VTM_OK)
+			goto end;
+
+		rc = vtm_http_res_body_raw(res, (const char*) buf.data, buf.used);
+		if (rc != VTM_OK)
+			goto end;
+	}
+
+	vtm_buf_clear(&buf);
+	rc = vtm_http_file_put_part_end(&buf, boundary);
+	if (rc != VTM_OK)
+		goto end;
+
+	rc = vtm_http_res_body_raw(res, (const char*) buf.data, buf.used);
+
+end:
+	vtm_buf_release(&buf);
+
+	return rc;
+}
+
+static bool vtm_http_file_parse_num(const char **src, uint64_t *val, bool *overflow)
+{
+	const char *s;
+	uint64_t num;
+
+	s = *src;
+	num = 0;
+
+	while (*s >= '0' && *s <= '9') {
+		if (num > (UINT64_MAX - (uint64_t) (*s - '0')) / 10)
+			*overflow = true;
+		num = num * 10 + (uint64_t) (*s - '0');
+		s++;
+	}
+
+	if (s == *src)
+		return false;
+
+	*src = s;
+	*val = num;
+
+	return true;
+}
+
+static int vtm_http_file_range_headers(vtm_http_res *res, const char *mime, const char *boundary, uint64_t size, const struct vtm_http_range *ranges, size_t count)
+{
+	int rc;
+	char buf[VTM_HTTP_FILE_RANGE_LEN];
+
+	if (count > 1) {
+		rc = snprintf(buf, sizeof(buf), "multipart/byteranges; boundary=%s", boundary);
+		if (rc <= 0 || (size_t) rc >= sizeof(buf))
+			return VTM_ERROR;
+
+		return vtm_http_res_header(res, VTM_HTTP_HEADER_CONTENT_TYPE, buf);
+	}
+
+	if (mime) {
+		rc = vtm_http_res_header(res, VTM_HTTP_HEADER_CONTENT_TYPE, mime);
+		if (rc != VTM_OK)
+			return rc;
+	}
+
+	rc = vtm_http_file_fmt_range(buf, sizeof(buf), &ranges[0], size);
+	if (rc != VTM_OK)
+		return rc;
+
+	return vtm_http_res_header(res, VTM_HTTP_HEADER_CONTENT_RANGE, buf);
+}
+
+static int vtm_http_file_fmt_range(char *buf, size_t len, const struct vtm_http_range *range, uint64_t size)
+{
+	int rc;
+
+	rc = snprintf(buf, len, "%s %llu-%llu/%llu", VTM_HTTP_VALUE_BYTES,
+		(unsigned long long) range->offset,
+		(unsigned long long) (range->offset + range->len - 1),
+		(unsigned long long) size);
+
+	if (rc <= 0 || (size_t) rc >= len)
+		return VTM_ERROR;
+
+	return VTM_OK;
+}
+
+static void vtm_http_file_make_boundary(vtm_http_res *res, char *buf, size_t len)
+{
+	/* unique enough to not collide with file contents by chance */
+	snprintf(buf, len, "%08lx%016llx",
+		(unsigned long) vtm_hash_ptr(res),
+		(unsigned long long) vtm_time_current_micros());
+}
+
+static int vtm_http_file_put_part_header(struct vtm_buf *buf, const char *boundary, const char *mime, const struct vtm_http_range *range, uint64_t size)
+{
+	int rc;
+	char val[VTM_HTTP_FILE_RANGE_LEN];
+
+	rc = vtm_http_file_fmt_range(val, sizeof(val), range, size);
+	if (rc != VTM_OK)
+		return rc;
+
+	vtm_buf_puts(buf, "\r\n--");
+	vtm_buf_puts(buf, boundary);
+	vtm_buf_puts(buf, "\r\n");
+
+	if (mime) {
+		vtm_buf_puts(buf, VTM_HTTP_HEADER_CONTENT_TYPE);
+		vtm_buf_puts(buf, ": ");
+		vtm_buf_puts(buf, mime);
+		vtm_buf_puts(buf, "\r\n");
+	}
+
+	vtm_buf_puts(buf, VTM_HTTP_HEADER_CONTENT_RANGE);
+	vtm_buf_puts(buf, ": ");
+	vtm_buf_puts(buf, val);
+	vtm_buf_puts(buf, "\r\n\r\n");
+
+	return buf->err;
+}
+
+static int vtm_http_file_put_part_end(struct vtm_buf *buf, const char *boundary)
+{
+	vtm_buf_puts(buf, "\r\n--");
+	vtm_buf_puts(buf, boundary);
+	vtm_buf_puts(buf, "--\r\n");
+
+	return buf->err;
+}
+
+static int vtm_http_file_chain_buffer(struct vtm_socket_emitter ***tail, struct vtm_buf *buf)
+{
+	struct vtm_socket_emitter *se;
+
+	se = vtm_socket_emitter_for_buffer(NULL, buf, true);
+	if (!se) {
+		vtm_buf_free(buf);
+		return vtm_err_get_code();
+	}
+
+	**tail = se;
+	*tail = &se->next;
+
+	return VTM_OK;
+}
@@ -13,6 +13,7 @@
 
 #include <stdio.h> /* FILE */
 #include <vtm/core/api.h>
+#include <vtm/core/types.h>
 #include <vtm/net/http/http_response.h>
 
 #ifdef __cplusplus
@@ -33,6 +34,72 @@ extern "C" {
  */
 VTM_API int vtm_http_file_serve(vtm_http_res *res, const char *name, FILE *fp);
 
+/** Maximum number of ranges that are accepted in one Range header */
+#define VTM_HTTP_FILE_MAX_RANGES    16
+
+/** Satisfiable byte range of a file */
+struct vtm_http_range
+{
+	uint64_t offset;  /**< offset of first byte */
+	uint64_t len;     /**< number of bytes, always greater than zero */
+};
+
+/**
+ * Parses the value of a Range header.
+ *
+ * Ranges that lie completely outside of the file are skipped, all other
+ * ranges are clipped to the file size.
+ *
+ * @param src the header value, for example "bytes=0-499,-500"
+ * @param size the size of the file in bytes
+ * @param[out] ranges the satisfiable ranges are stored here
+ * @param[in,out] count in: the capacity of ranges array,
+ *                      out: the number of satisfiable ranges
+ * @return VTM_OK if at least one satisfiable range was found
+ * @return VTM_E_OUT_OF_RANGE if no range is satisfiable
+ * @return VTM_E_INVALID_ARG if the value is malformed, the unit is not
+ *         bytes or there are more ranges than the capacity. In this case
+ *         the header should be ignored.
+ */
+VTM_API int vtm_http_file_parse_range(const char *src, uint64_t size, struct vtm_http_range *ranges, size_t *count);
+
+/**
+ * Serves the given ranges of a file as response body.
+ *
+ * The response must have been started in fixed mode with status
+ * 206 Partial Content. A single range is sent with a Content-Range header,
+ * multiple ranges are sent as multipart/byteranges. Every range is read
+ * directly from its offset when the response is sent.
+ *
+ * @param res the response where the ranges should be served
+ * @param name the name of the file
+ * @param fp the already opened file stream, closed after the response
+ *        was sent. If an error occurs the stream is not closed.
+ * @param size the size of the file in bytes
+ * @param ranges the ranges that should be served
+ * @param count the number of ranges
+ * @return VTM_OK if the ranges were embedded into the response
+ * @return VTM_ERROR or VTM_E_MALLOC if an error occured
+ */
+VTM_API int vtm_http_file_serve_ranges(vtm_http_res *res, const char *name, FILE *fp, uint64_t size, const struct vtm_http_range *ranges, size_t count);
+
+/**
+ * Serves the given ranges of a memory block as response body.
+ *
+ * Behaves like vtm_http_file_serve_ranges() but the data is copied
+ * from memory.
+ *
+ * @param res the response where the ranges should be served
+ * @param mime the mime type of the data or NULL if unknown
+ * @param src the complete data
+ * @param size the size of the data in bytes
+ * @param ranges the ranges that should be served
+ * @param count the number of ranges
+ * @return VTM_OK if the ranges were embedded into the response
+ * @return VTM_ERROR or VTM_E_MALLOC if an error occured
+ */
+VTM_API int vtm_http_file_serve_raw_ranges(vtm_http_res *res, const char *mime, const void *src, uint64_t size, const struct vtm_http_range *ranges, size_t count);
+
 #ifdef __cplusplus
 }
 #endif
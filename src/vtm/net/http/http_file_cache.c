@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include "http_file_cache_intl.h"
+
+#include <stdio.h> /* snprintf(), fread() */
+#include <stdlib.h> /* malloc(), free() */
+#include <string.h> /* strlen() */
+#include <vtm/core/error.h>
+#include <vtm/core/hash.h>
+#include <vtm/core/map.h>
+#include <vtm/core/string.h>
+#include <vtm/net/http/http.h>
+#include <vtm/util/mutex.h>
+#include <vtm/util/time.h>
+
+struct vtm_http_file_cache
+{
+	vtm_mutex                         *mtx;
+	vtm_map                           *entries;
+
+	/* most recently used first */
+	struct vtm_http_file_cache_entry  *head;
+	struct vtm_http_file_cache_entry  *tail;
+
+	size_t                            used;
+	size_t                            max_size;
+	size_t                            max_file_size;
+	unsigned long                     check_interval;
+};
+
+/* forward declaration */
+static struct vtm_http_file_cache_entry* vtm_http_file_cache_entry_new(const char *key, const char *fs_path, FILE *fp, struct vtm_file_info *info, const char *mime);
+static void vtm_http_file_cache_entry_free(struct vtm_http_file_cache_entry *entry);
+static size_t vtm_http_file_cache_entry_size(struct vtm_http_file_cache_entry *entry);
+static void vtm_http_file_cache_link(vtm_http_file_cache *fc, struct vtm_http_file_cache_entry *entry);
+static void vtm_http_file_cache_unlink(vtm_http_file_cache *fc, struct vtm_http_file_cache_entry *entry);
+static void vtm_http_file_cache_remove(vtm_http_file_cache *fc, struct vtm_http_file_cache_entry *entry);
+
+vtm_http_file_cache* vtm_http_file_cache_new(size_t max_size, size_t max_file_size, unsigned long check_interval)
+{
+	vtm_http_file_cache *fc;
+
+	fc = malloc(sizeof(*fc));
+	if (!fc) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	fc->mtx = vtm_mutex_new();
+	if (!fc->mtx)
+		goto err_mtx;
+
+	fc->entries = vtm_map_new(VTM_ELEM_STRING, VTM_ELEM_POINTER, 64);
+	if (!fc->entries)
+		goto err_map;
+
+	fc->head = NULL;
+	fc->tail = NULL;
+	fc->used = 0;
+	fc->max_size = max_size;
+	fc->max_file_size = max_file_size;
+	fc->check_interval = check_interval;
+
+	return fc;
+
+err_map:
+	vtm_mutex_free(fc->mtx);
+
+err_mtx:
+	free(fc);
+	return NULL;
+}
+
+void vtm_http_file_cache_free(vtm_http_file_cache *fc)
+{
+	struct vtm_http_file_cache_entry *entry, *next;
+
+	if (!fc)
+		return;
+
+	for (entry = fc->head; entry; entry = next) {
+		next = entry->next;
+		vtm_http_file_cache_release(entry);
+	}
+
+	vtm_map_free(fc->entries);
+	vtm_mutex_free(fc->mtx);
+	free(fc);
+}
+
+bool vtm_http_file_cache_accepts(vtm_http_file_cache *fc, uint64_t size)
+{
+	return size <= fc->max_file_size && size <= fc->max_size;
+}
+
+struct vtm_http_file_cache_entry* vtm_http_file_cache_get(vtm_http_file_cache *fc, const char *key)
+{
+	struct vtm_http_file_cache_entry *entry;
+	struct vtm_file_info info;
+	uint64_t now;
+	bool check;
+
+	now = vtm_time_current_millis();
+
+	vtm_mutex_lock(fc->mtx);
+
+	entry = vtm_map_get_pointer_va(fc->entries, key);
+	if (!entry) {
+		vtm_mutex_unlock(fc->mtx);
+		return NULL;
+	}
+
+	VTM_ATOMIC_ADD_INT32(&entry->refs, 1);
+
+	/* move to front */
+	vtm_http_file_cache_unlink(fc, entry);
+	vtm_http_file_cache_link(fc, entry);
+
+	/* only one caller revalidates the entry per interval */
+	check = now - entry->checked >= fc->check_interval;
+	if (check)
+		entry->checked = now;
+
+	vtm_mutex_unlock(fc->mtx);
+
+	if (!check)
+		return entry;
+
+	/* revalidate against file system */
+	if (vtm_file_get_finfo_path(entry->fs_path, &info) != VTM_OK ||
+		(info.attr & VTM_FILE_ATTR_REG) == 0 ||
+		info.mtime != entry->mtime || info.size != entry->size) {
+		vtm_mutex_lock(fc->mtx);
+		vtm_http_file_cache_remove(fc, entry);
+		vtm_mutex_unlock(fc->mtx);
+		vtm_http_file_cache_release(entry);
+		return NULL;
+	}
+
+	return entry;
+}
+
+struct vtm_http_file_cache_entry* vtm_http_file_cache_put(vtm_http_file_cache *fc, const char *key, const char *fs_path, FILE *fp, struct vtm_file_info *info, const char *mime)
+{
+	int rc;
+	struct vtm_http_file_cache_entry *entry, *existing;
+	size_t size;
+
+	if (!vtm_http_file_cache_accepts(fc, info->size))
+		return NULL;
+
+	entry = vtm_http_file_cache_entry_new(key, fs_path, fp, info, mime);
+	if (!entry)
+		return NULL;
+
+	size = vtm_http_file_cache_entry_size(entry);
+
+	vtm_mutex_lock(fc->mtx);
+
+	/* concurrent put for same key, keep the existing entry */
+	existing = vtm_map_get_pointer_va(fc->entries, key);
+	if (existing) {
+		VTM_ATOMIC_ADD_INT32(&existing->refs, 1);
+		vtm_mutex_unlock(fc->mtx);
+		vtm_http_file_cache_entry_free(entry);
+		return existing;
+	}
+
+	/* evict least recently used entries */
+	while (fc->tail && fc->used + size > fc->max_size)
+		vtm_http_file_cache_remove(fc, fc->tail);
+
+	rc = vtm_map_put_va(fc->entries, entry->key, entry);
+	if (rc != VTM_OK) {
+		vtm_mutex_unlock(fc->mtx);
+		return entry;
+	}
+
+	/* one reference for the cache and one for the caller */
+	entry->refs = 2;
+	vtm_http_file_cache_link(fc, entry);
+	fc->used += size;
+
+	vtm_mutex_unlock(fc->mtx);
+
+	return entry;
+}
+
+void vtm_http_file_cache_retain(struct vtm_http_file_cache_entry *entry)
+{
+	VTM_ATOMIC_ADD_INT32(&entry->refs, 1);
+}
+
+void vtm_http_file_cache_release(struct vtm_http_file_cache_entry *entry)
+{
+	if (VTM_ATOMIC_ADD_INT32(&entry->refs, -1) == 0)
+		vtm_http_file_cache_entry_free(entry);
+}
+
+int vtm_http_file_cache_make_etag(char *buf, size_t len, uint64_t size, uint64_t mtime)
+{
+	int rc;
+
+	/* same size within the same second is possible, therefore weak */
+	rc = snprintf(buf, len, "W/\"%llx-%llx\"",
+		(unsigned long long) mtime, (unsigned long long) size);
+
+	if (rc <= 0 || (size_t) rc >= len)
+		return VTM_ERROR;
+
+	return VTM_OK;
+}
+
+static struct vtm_http_file_cache_entry* vtm_http_file_cache_entry_new(const char *key, const char *fs_path, FILE *fp, struct vtm_file_info *info, const char *mime)
+{
+	int rc;
+	struct vtm_http_file_cache_entry *entry;
+	struct vtm_date date;
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	entry->refs = 1;
+	entry->size = info->size;
+	entry->mtime = info->mtime;
+	entry->checked = vtm_time_current_millis();
+	entry->len = (size_t) info->size;
+
+	entry->key = vtm_str_copy(key);
+	entry->fs_path = vtm_str_copy(fs_path);
+	entry->data = malloc(entry->len > 0 ? entry->len : 1);
+	if (!entry->key || !entry->fs_path || !entry->data) {
+		vtm_err_oom();
+		goto err;
+	}
+
+	/* read whole file */
+	if (fread(entry->data, 1, entry->len, fp) != entry->len) {
+		vtm_err_set(VTM_E_IO_UNKNOWN);
+		goto err;
+	}
+
+	/* strong etag based on content */
+	rc = snprintf(entry->etag, sizeof(entry->etag), "\"%08lx-%llx-%llx\"",
+		(unsigned long) vtm_hash_mem(entry->data, entry->len),
+		(unsigned long long) entry->mtime,
+		(unsigned long long) entry->size);
+	if (rc <= 0 || (size_t) rc >= sizeof(entry->etag))
+		goto err;
+
+	rc = vtm_date_from_ts(entry->mtime, &date);
+	if (rc != VTM_OK)
+		goto err;
+
+	rc = vtm_http_fmt_date(entry->last_modified, sizeof(entry->last_modified), &date);
+	if (rc != VTM_OK)
+		goto err;
+
+	/* precomputed validator header block */
+	entry->mime = mime;
+	entry->headers = vtm_str_printf("%s: %s\r\n%s: %s\r\n",
+		VTM_HTTP_HEADER_ETAG, entry->etag,
+		VTM_HTTP_HEADER_LAST_MODIFIED, entry->last_modified);
+	if (!entry->headers)
+		goto err;
+
+	entry->headers_len = strlen(entry->headers);
+
+	return entry;
+
+err:
+	vtm_http_file_cache_entry_free(entry);
+	return NULL;
+}
+
+static void vtm_http_file_cache_entry_free(struct vtm_http_file_cache_entry *entry)
+{
+	free(entry->key);
+	free(entry->fs_path);
+	free(entry->data);
+	free(entry->headers);
+	free(entry);
+}
+
+static size_t vtm_http_file_cache_entry_size(struct vtm_http_file_cache_entry *entry)
+{
+	return sizeof(*entry) + entry->len + entry->headers_len +
+		strlen(entry->key) + strlen(entry->fs_path);
+}
+
+static void vtm_http_file_cache_link(vtm_http_file_cache *fc, struct vtm_http_file_cache_entry *entry)
+{
+	entry->prev = NULL;
+	entry->next = fc->head;
+
+	if (fc->head)
+		fc->head->prev = entry;
+	else
+		fc->tail = entry;
+
+	fc->head = entry;
+	entry->linked = true;
+}
+
+static void vtm_http_file_cache_unlink(vtm_http_file_cache *fc, struct vtm_http_file_cache_entry *entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		fc->head = entry->next;
+
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		fc->tail = entry->prev;
+
+	entry->prev = NULL;
+	entry->next = NULL;
+	entry->linked = false;
+}
+
+static void vtm_http_file_cache_remove(vtm_http_file_cache *fc, struct vtm_http_file_cache_entry *entry)
+{
+	/* caller must hold the lock */
+	if (!entry->linked)
+		return;
+
+	vtm_map_remove_va(fc->entries, entry->key);
+	vtm_http_file_cache_unlink(fc, entry);
+	fc->used -= vtm_http_file_cache_entry_size(entry);
+	vtm_http_file_cache_release(entry);
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#ifndef VTM_NET_HTTP_HTTP_FILE_CACHE_INTL_H_
+#define VTM_NET_HTTP_HTTP_FILE_CACHE_INTL_H_
+
+#include <stdio.h> /* FILE */
+#include <vtm/core/types.h>
+#include <vtm/fs/file.h>
+#include <vtm/net/http/http_format.h>
+#include <vtm/util/atomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VTM_HTTP_FILE_CACHE_ETAG_LEN    48
+
+typedef struct vtm_http_file_cache vtm_http_file_cache;
+
+struct vtm_http_file_cache_entry
+{
+	VTM_ATOMIC_INT32_TYPE  refs;
+
+	char                   *key;
+	char                   *fs_path;
+	uint64_t               size;
+	uint64_t               mtime;
+	uint64_t               checked;
+
+	/* file contents */
+	unsigned char          *data;
+	size_t                 len;
+
+	/* precomputed values and validator header block */
+	const char             *mime;
+	char                   etag[VTM_HTTP_FILE_CACHE_ETAG_LEN];
+	char                   last_modified[VTM_HTTP_DATE_LEN];
+	char                   *headers;
+	size_t                 headers_len;
+
+	/* lru list, only valid while linked */
+	bool                   linked;
+	struct vtm_http_file_cache_entry *prev;
+	struct vtm_http_file_cache_entry *next;
+};
+
+vtm_http_file_cache* vtm_http_file_cache_new(size_t max_size, size_t max_file_size, unsigned long check_interval);
+void vtm_http_file_cache_free(vtm_http_file_cache *fc);
+
+bool vtm_http_file_cache_accepts(vtm_http_file_cache *fc, uint64_t size);
+
+struct vtm_http_file_cache_entry* vtm_http_file_cache_get(vtm_http_file_cache *fc, const char *key);
+struct vtm_http_file_cache_entry* vtm_http_file_cache_put(vtm_http_file_cache *fc, const char *key, const char *fs_path, FILE *fp, struct vtm_file_info *info, const char *mime);
+void vtm_http_file_cache_retain(struct vtm_http_file_cache_entry *entry);
+void vtm_http_file_cache_release(struct vtm_http_file_cache_entry *entry);
+
+int vtm_http_file_cache_make_etag(char *buf, size_t len, uint64_t size, uint64_t mtime);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_NET_HTTP_HTTP_FILE_CACHE_INTL_H_ */
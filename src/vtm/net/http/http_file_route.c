@@ -4,27 +4,70 @@
 
 #include "http_file_route.h"
 
-#include <string.h> /* strlen() */
+#include <stdio.h> /* fopen(), snprintf() */
+#include <string.h> /* strlen(), strcmp(), strncmp(), strchr(), strcpy(), memcpy() */
 #include <vtm/core/error.h>
+#include <vtm/core/format.h>
+#include <vtm/core/macros.h>
+#include <vtm/core/map.h>
 #include <vtm/core/string.h>
 #include <vtm/fs/file.h>
+#include <vtm/fs/mime.h>
 #include <vtm/fs/path.h>
 #include <vtm/net/http/http.h>
 #include <vtm/net/http/http_error.h>
 #include <vtm/net/http/http_file.h>
+#include <vtm/net/http/http_file_cache_intl.h>
+#include <vtm/net/http/http_format.h>
 #include <vtm/net/http/http_request.h>
 #include <vtm/net/http/http_response.h>
+#include <vtm/net/http/http_response_intl.h>
+#include <vtm/util/mutex.h>
+#include <vtm/util/time.h>
+
+#define VTM_HTTP_FILE_RT_DEF_CACHE_SIZE            (16 * 1024 * 1024)
+#define VTM_HTTP_FILE_RT_DEF_CACHE_FILE_SIZE       (256 * 1024)
+#define VTM_HTTP_FILE_RT_DEF_CACHE_CHECK_INTERVAL  1000
+#define VTM_HTTP_FILE_RT_MAX_SIDECARS              4096
 
 struct vtm_http_file_rt
 {
 	struct vtm_http_route    base;
 	char                     *fs_real_root;
+
+	vtm_http_file_cache      *cache;
+	size_t                   cache_size;
+	size_t                   cache_file_size;
+	unsigned long            cache_check_interval;
+
+	/* precompressed sidecar files */
+	bool                     precompressed;
+	vtm_mutex                *sidecar_mtx;
+	vtm_map                  *sidecars;
+};
+
+struct vtm_http_file_rt_sidecar
+{
+	uint64_t                 checked;
+	unsigned int             codings;
 };
 
 /* forward declaration */
 static int vtm_http_file_rt_handle(struct vtm_http_route *rt, struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res);
 static void vtm_http_file_rt_free(struct vtm_http_route *rt);
+static int vtm_http_file_rt_init_cache(struct vtm_http_file_rt *rt);
 static char* vtm_http_file_rt_get_real_path(struct vtm_http_file_rt *rt, struct vtm_http_req *req);
+static unsigned int vtm_http_file_rt_find_sidecars(struct vtm_http_file_rt *rt, struct vtm_http_req *req, unsigned int accepted, char **fs_path);
+static unsigned int vtm_http_file_rt_stat_sidecars(const char *fs_path);
+static int vtm_http_file_rt_serve_sidecar(struct vtm_http_file_rt *rt, struct vtm_http_req *req, vtm_http_res *res, const char *fs_path, unsigned int coding);
+static int vtm_http_file_rt_serve_entry(struct vtm_http_req *req, vtm_http_res *res, struct vtm_http_file_cache_entry *entry, const char *encoding, bool vary);
+static int vtm_http_file_rt_serve_file(struct vtm_http_req *req, vtm_http_res *res, const char *filename, FILE *fp, struct vtm_file_info *info, const char *encoding, bool vary);
+static int vtm_http_file_rt_variant_headers(vtm_http_res *res, const char *encoding, bool vary);
+static void vtm_http_file_rt_entry_release(void *entry);
+static bool vtm_http_file_rt_not_modified(struct vtm_http_req *req, const char *etag, uint64_t mtime);
+static bool vtm_http_file_rt_etag_matches(const char *list, const char *etag);
+static int vtm_http_file_rt_eval_range(struct vtm_http_req *req, const char *etag, uint64_t mtime, uint64_t size, struct vtm_http_range *ranges, size_t *count);
+static int vtm_http_file_rt_not_satisfiable(vtm_http_res *res, uint64_t size);
 
 struct vtm_http_route* vtm_http_file_rt_new(const char *fs_root)
 {
@@ -40,48 +83,183 @@ struct vtm_http_route* vtm_http_file_rt_new(const char *fs_root)
 	rt->base.fn_rt_handle = vtm_http_file_rt_handle;
 	rt->base.fn_rt_free = vtm_http_file_rt_free;
 
+	rt->fs_real_root = NULL;
+	rt->cache = NULL;
+	rt->cache_size = VTM_HTTP_FILE_RT_DEF_CACHE_SIZE;
+	rt->cache_file_size = VTM_HTTP_FILE_RT_DEF_CACHE_FILE_SIZE;
+	rt->cache_check_interval = VTM_HTTP_FILE_RT_DEF_CACHE_CHECK_INTERVAL;
+
+	rt->precompressed = true;
+	rt->sidecar_mtx = NULL;
+	rt->sidecars = NULL;
+
+	rt->sidecar_mtx = vtm_mutex_new();
+	if (!rt->sidecar_mtx) {
+		vtm_http_file_rt_free(&rt->base);
+		return NULL;
+	}
+
+	rt->sidecars = vtm_map_new(VTM_ELEM_STRING, VTM_ELEM_POINTER, VTM_HTTP_FILE_RT_MAX_SIDECARS / 4);
+	if (!rt->sidecars) {
+		vtm_http_file_rt_free(&rt->base);
+		return NULL;
+	}
+	vtm_map_set_free_func(rt->sidecars, free);
+
 	rc = vtm_path_get_real(fs_root, &(rt->fs_real_root));
 	if (rc != VTM_OK) {
 		vtm_http_file_rt_free(&rt->base);
 		return NULL;
 	}
 
+	rc = vtm_http_file_rt_init_cache(rt);
+	if (rc != VTM_OK) {
+		vtm_http_file_rt_free(&rt->base);
+		return NULL;
+	}
+
 	return &rt->base;
 }
 
+int vtm_http_file_rt_set_opt(struct vtm_http_route *rt, int opt, const void *val, size_t len)
+{
+	struct vtm_http_file_rt *frt;
+
+	frt = (struct vtm_http_file_rt*) rt;
+
+	switch (opt) {
+		case VTM_HTTP_FILE_RT_OPT_CACHE_SIZE:
+			if (len != sizeof(size_t))
+				return VTM_E_INVALID_ARG;
+			frt->cache_size = *((size_t*) val);
+			break;
+
+		case VTM_HTTP_FILE_RT_OPT_CACHE_FILE_SIZE:
+			if (len != sizeof(size_t))
+				return VTM_E_INVALID_ARG;
+			frt->cache_file_size = *((size_t*) val);
+			break;
+
+		case VTM_HTTP_FILE_RT_OPT_CACHE_CHECK_INTERVAL:
+			if (len != sizeof(unsigned long))
+				return VTM_E_INVALID_ARG;
+			frt->cache_check_interval = *((unsigned long*) val);
+			break;
+
+		case VTM_HTTP_FILE_RT_OPT_PRECOMPRESSED:
+			if (len != sizeof(bool))
+				return VTM_E_INVALID_ARG;
+			frt->precompressed = *((bool*) val);
+			break;
+
+		default:
+			return VTM_E_NOT_SUPPORTED;
+	}
+
+	return vtm_http_file_rt_init_cache(frt);
+}
+
+static int vtm_http_file_rt_init_cache(struct vtm_http_file_rt *rt)
+{
+	vtm_mutex_lock(rt->sidecar_mtx);
+	vtm_map_clear(rt->sidecars);
+	vtm_mutex_unlock(rt->sidecar_mtx);
+
+	vtm_http_file_cache_free(rt->cache);
+	rt->cache = NULL;
+
+	if (rt->cache_size == 0 || rt->cache_file_size == 0)
+		return VTM_OK;
+
+	rt->cache = vtm_http_file_cache_new(rt->cache_size,
+		rt->cache_file_size, rt->cache_check_interval);
+
+	return rt->cache ? VTM_OK : vtm_err_get_code();
+}
+
 static int vtm_http_file_rt_handle(struct vtm_http_route *rt, struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
 {
-	int rc, attr;
+	int rc;
+	struct vtm_http_file_rt *frt;
+	struct vtm_http_file_cache_entry *entry;
+	struct vtm_file_info info;
 	FILE *fp;
 	char *filename;
+	const char *val;
+	unsigned int accepted, avail;
+	bool vary;
+
+	frt = (struct vtm_http_file_rt*) rt;
+
+	/* precompressed variant, ranges always refer to the identity */
+	vary = false;
+	if (frt->precompressed) {
+		accepted = 0;
+		if (!vtm_http_req_get_header_str(req, VTM_HTTP_HEADER_RANGE)) {
+			val = vtm_http_req_get_header_str(req, VTM_HTTP_HEADER_ACCEPT_ENCODING);
+			if (val)
+				accepted = vtm_http_parse_accept_encoding(val);
+		}
+
+		avail = vtm_http_file_rt_find_sidecars(frt, req, accepted, &filename);
+		if (avail & accepted) {
+			rc = vtm_http_file_rt_serve_sidecar(frt, req, res, filename,
+				(avail & accepted & VTM_HTTP_CODING_BR) ?
+				VTM_HTTP_CODING_BR : VTM_HTTP_CODING_GZIP);
+			free(filename);
+			if (rc != VTM_E_NOT_HANDLED)
+				return rc;
+		}
+		vary = (avail != 0);
+	}
+
+	/* cache hit does not touch the file system */
+	if (frt->cache) {
+		entry = vtm_http_file_cache_get(frt->cache, req->path);
+		if (entry) {
+			vtm_http_file_rt_serve_entry(req, res, entry, NULL, vary);
+			vtm_http_file_cache_release(entry);
+			return VTM_OK;
+		}
+	}
 
-	filename = vtm_http_file_rt_get_real_path((struct vtm_http_file_rt*) rt, req);
+	filename = vtm_http_file_rt_get_real_path(frt, req);
 	if (!filename)
 		return VTM_E_HTTP_NOT_FOUND;
 
-	fp = fopen(filename, "r");
+	fp = fopen(filename, "rb");
 	if (!fp) {
 		rc = VTM_E_HTTP_NOT_FOUND;
 		goto cleanup;
 	}
 
-	rc = vtm_file_get_fattr(fp, &attr);
+	rc = vtm_file_get_finfo(fp, &info);
 	if (rc != VTM_OK) {
 		fclose(fp);
 		goto cleanup;
 	}
 
-	if ((attr & VTM_FILE_ATTR_REG) == 0) {
+	if ((info.attr & VTM_FILE_ATTR_REG) == 0) {
 		fclose(fp);
 		rc = VTM_E_HTTP_NOT_FOUND;
 		goto cleanup;
 	}
 
-	vtm_http_res_begin(res, VTM_HTTP_RES_MODE_FIXED, VTM_HTTP_200_OK);
-	vtm_http_res_set_date(res);
-	vtm_http_file_serve(res, filename, fp);
-	vtm_http_res_end(res);
+	/* small files are loaded into cache */
+	if (frt->cache && vtm_http_file_cache_accepts(frt->cache, info.size)) {
+		entry = vtm_http_file_cache_put(frt->cache, req->path, filename,
+			fp, &info, vtm_mime_type_for_name(filename));
+		if (entry) {
+			fclose(fp);
+			vtm_http_file_rt_serve_entry(req, res, entry, NULL, vary);
+			vtm_http_file_cache_release(entry);
+			rc = VTM_OK;
+			goto cleanup;
+		}
+		rewind(fp);
+	}
 
+	vtm_http_file_rt_serve_file(req, res, filename, fp, &info, NULL, vary);
 	rc = VTM_OK;
 
 cleanup:
@@ -90,6 +268,414 @@ cleanup:
 	return rc;
 }
 
+static unsigned int vtm_http_file_rt_find_sidecars(struct vtm_http_file_rt *rt, struct vtm_http_req *req, unsigned int accepted, char **fs_path)
+{
+	struct vtm_http_file_rt_sidecar *sc;
+	unsigned int codings;
+	uint64_t now;
+	char *filename;
+
+	*fs_path = NULL;
+	now = vtm_time_current_millis();
+
+	/* aliases of a request path share the entry of the resolved file */
+	filename = vtm_http_file_rt_get_real_path(rt, req);
+	if (!filename)
+		return 0;
+
+	/* cached lookup result */
+	vtm_mutex_lock(rt->sidecar_mtx);
+	sc = vtm_map_get_pointer_va(rt->sidecars, filename);
+	if (sc && now - sc->checked < rt->cache_check_interval) {
+		codings = sc->codings;
+		vtm_mutex_unlock(rt->sidecar_mtx);
+		goto out;
+	}
+	vtm_mutex_unlock(rt->sidecar_mtx);
+
+	codings = vtm_http_file_rt_stat_sidecars(filename);
+
+	sc = malloc(sizeof(*sc));
+	if (sc) {
+		sc->checked = now;
+		sc->codings = codings;
+
+		vtm_mutex_lock(rt->sidecar_mtx);
+		/* bounded, entries are cheap to rebuild */
+		if (vtm_map_size(rt->sidecars) >= VTM_HTTP_FILE_RT_MAX_SIDECARS &&
+			!vtm_map_contains_key_va(rt->sidecars, filename))
+			vtm_map_clear(rt->sidecars);
+		if (vtm_map_put_va(rt->sidecars, filename, sc) != VTM_OK)
+			free(sc);
+		vtm_mutex_unlock(rt->sidecar_mtx);
+	}
+
+out:
+	if (codings & accepted)
+		*fs_path = filename;
+	else
+		free(filename);
+
+	return codings;
+}
+
+static unsigned int vtm_http_file_rt_stat_sidecars(const char *fs_path)
+{
+	unsigned int codings;
+	size_t len;
+	char *path;
+	struct vtm_file_info info, sc_info;
+
+	if (vtm_file_get_finfo_path(fs_path, &info) != VTM_OK ||
+		(info.attr & VTM_FILE_ATTR_REG) == 0)
+		return 0;
+
+	len = strlen(fs_path);
+	path = malloc(len + 4);
+	if (!path)
+		return 0;
+
+	memcpy(path, fs_path, len);
+	codings = 0;
+
+	/* sidecars older than the file are outdated */
+	strcpy(path + len, ".gz");
+	if (vtm_file_get_finfo_path(path, &sc_info) == VTM_OK &&
+		(sc_info.attr & VTM_FILE_ATTR_REG) && sc_info.mtime >= info.mtime)
+		codings |= VTM_HTTP_CODING_GZIP;
+
+	strcpy(path + len, ".br");
+	if (vtm_file_get_finfo_path(path, &sc_info) == VTM_OK &&
+		(sc_info.attr & VTM_FILE_ATTR_REG) && sc_info.mtime >= info.mtime)
+		codings |= VTM_HTTP_CODING_BR;
+
+	free(path);
+
+	return codings;
+}
+
+static int vtm_http_file_rt_serve_sidecar(struct vtm_http_file_rt *rt, struct vtm_http_req *req, vtm_http_res *res, const char *fs_path, unsigned int coding)
+{
+	int rc;
+	const char *suffix, *encoding;
+	char *sc_path, *key;
+	FILE *fp;
+	struct vtm_file_info info;
+	struct vtm_http_file_cache_entry *entry;
+
+	if (coding == VTM_HTTP_CODING_BR) {
+		suffix = ".br";
+		encoding = VTM_HTTP_VALUE_BR;
+	}
+	else {
+		suffix = ".gz";
+		encoding = VTM_HTTP_VALUE_GZIP;
+	}
+
+	/* cache key can not collide with request paths */
+	key = NULL;
+	if (rt->cache) {
+		key = vtm_str_printf("%s:%s", suffix + 1, req->path);
+		if (!key)
+			return vtm_err_get_code();
+
+		entry = vtm_http_file_cache_get(rt->cache, key);
+		if (entry) {
+			free(key);
+			vtm_http_file_rt_serve_entry(req, res, entry, encoding, true);
+			vtm_http_file_cache_release(entry);
+			return VTM_OK;
+		}
+	}
+
+	sc_path = vtm_str_printf("%s%s", fs_path, suffix);
+	if (!sc_path) {
+		rc = vtm_err_get_code();
+		goto cleanup;
+	}
+
+	/* sidecar vanished, fall back to identity */
+	fp = fopen(sc_path, "rb");
+	if (!fp) {
+		rc = VTM_E_NOT_HANDLED;
+		goto cleanup;
+	}
+
+	rc = vtm_file_get_finfo(fp, &info);
+	if (rc != VTM_OK || (info.attr & VTM_FILE_ATTR_REG) == 0) {
+		fclose(fp);
+		rc = VTM_E_NOT_HANDLED;
+		goto cleanup;
+	}
+
+	/* variant keeps the media type of the original file */
+	if (key && vtm_http_file_cache_accepts(rt->cache, info.size)) {
+		entry = vtm_http_file_cache_put(rt->cache, key, sc_path,
+			fp, &info, vtm_mime_type_for_name(fs_path));
+		if (entry) {
+			fclose(fp);
+			vtm_http_file_rt_serve_entry(req, res, entry, encoding, true);
+			vtm_http_file_cache_release(entry);
+			rc = VTM_OK;
+			goto cleanup;
+		}
+		rewind(fp);
+	}
+
+	vtm_http_file_rt_serve_file(req, res, fs_path, fp, &info, encoding, true);
+	rc = VTM_OK;
+
+cleanup:
+	free(sc_path);
+	free(key);
+
+	return rc;
+}
+
+static int vtm_http_file_rt_variant_headers(vtm_http_res *res, const char *encoding, bool vary)
+{
+	int rc;
+
+	/* marks the response as encoded, server compression leaves it alone */
+	if (encoding) {
+		rc = vtm_http_res_header(res, VTM_HTTP_HEADER_CONTENT_ENCODING, encoding);
+		if (rc != VTM_OK)
+			return rc;
+	}
+
+	if (vary)
+		return vtm_http_res_header(res, VTM_HTTP_HEADER_VARY, VTM_HTTP_HEADER_ACCEPT_ENCODING);
+
+	return VTM_OK;
+}
+
+static int vtm_http_file_rt_serve_entry(struct vtm_http_req *req, vtm_http_res *res, struct vtm_http_file_cache_entry *entry, const char *encoding, bool vary)
+{
+	int rc;
+	struct vtm_http_range ranges[VTM_HTTP_FILE_MAX_RANGES];
+	size_t count;
+
+	if (vtm_http_file_rt_not_modified(req, entry->etag, entry->mtime)) {
+		vtm_http_res_begin(res, VTM_HTTP_RES_MODE_FIXED, VTM_HTTP_304_NOT_MODIFIED);
+		vtm_http_file_rt_variant_headers(res, NULL, vary);
+		vtm_http_res_header_block(res, entry->headers, entry->headers_len);
+		return vtm_http_res_end(res);
+	}
+
+	count = VTM_ARRAY_LEN(ranges);
+	rc = vtm_http_file_rt_eval_range(req, entry->etag, entry->mtime, entry->size, ranges, &count);
+	switch (rc) {
+		case VTM_OK:
+			vtm_http_res_begin(res, VTM_HTTP_RES_MODE_FIXED, VTM_HTTP_206_PARTIAL_CONTENT);
+			vtm_http_file_rt_variant_headers(res, encoding, vary);
+			vtm_http_res_header_block(res, entry->headers, entry->headers_len);
+			vtm_http_file_serve_raw_ranges(res, entry->mime, entry->data, entry->size, ranges, count);
+			return vtm_http_res_end(res);
+
+		case VTM_E_OUT_OF_RANGE:
+			return vtm_http_file_rt_not_satisfiable(res, entry->size);
+
+		default:
+			break;
+	}
+
+	vtm_http_res_begin(res, VTM_HTTP_RES_MODE_FIXED, VTM_HTTP_200_OK);
+	vtm_http_res_header(res, VTM_HTTP_HEADER_ACCEPT_RANGES, VTM_HTTP_VALUE_BYTES);
+	if (entry->mime)
+		vtm_http_res_header(res, VTM_HTTP_HEADER_CONTENT_TYPE, entry->mime);
+	vtm_http_file_rt_variant_headers(res, encoding, vary);
+	vtm_http_res_header_block(res, entry->headers, entry->headers_len);
+
+	/* entry stays referenced until the body was sent */
+	vtm_http_file_cache_retain(entry);
+	vtm_http_res_body_own(res, entry->data, entry->len, vtm_http_file_rt_entry_release, entry);
+
+	return vtm_http_res_end(res);
+}
+
+static void vtm_http_file_rt_entry_release(void *entry)
+{
+	vtm_http_file_cache_release(entry);
+}
+
+static int vtm_http_file_rt_serve_file(struct vtm_http_req *req, vtm_http_res *res, const char *filename, FILE *fp, struct vtm_file_info *info, const char *encoding, bool vary)
+{
+	int rc;
+	struct vtm_date date;
+	struct vtm_http_range ranges[VTM_HTTP_FILE_MAX_RANGES];
+	size_t count;
+	size_t len;
+	char etag[VTM_HTTP_FILE_CACHE_ETAG_LEN];
+	char last_modified[VTM_HTTP_DATE_LEN];
+
+	rc = vtm_http_file_cache_make_etag(etag, sizeof(etag), info->size, info->mtime);
+	if (rc != VTM_OK)
+		goto err;
+
+	/* distinct validator for each content coding */
+	if (encoding) {
+		len = strlen(etag);
+		rc = snprintf(etag + len - 1, sizeof(etag) - len + 1, "-%s\"", encoding);
+		if (rc <= 0 || (size_t) rc >= sizeof(etag) - len + 1) {
+			rc = VTM_ERROR;
+			goto err;
+		}
+	}
+
+	rc = vtm_date_from_ts(info->mtime, &date);
+	if (rc != VTM_OK)
+		goto err;
+
+	rc = vtm_http_fmt_date(last_modified, sizeof(last_modified), &date);
+	if (rc != VTM_OK)
+		goto err;
+
+	if (vtm_http_file_rt_not_modified(req, etag, info->mtime)) {
+		fclose(fp);
+		vtm_http_res_begin(res, VTM_HTTP_RES_MODE_FIXED, VTM_HTTP_304_NOT_MODIFIED);
+		vtm_http_file_rt_variant_headers(res, NULL, vary);
+		vtm_http_res_header(res, VTM_HTTP_HEADER_ETAG, etag);
+		vtm_http_res_header(res, VTM_HTTP_HEADER_LAST_MODIFIED, last_modified);
+		return vtm_http_res_end(res);
+	}
+
+	count = VTM_ARRAY_LEN(ranges);
+	rc = vtm_http_file_rt_eval_range(req, etag, info->mtime, info->size, ranges, &count);
+	switch (rc) {
+		case VTM_OK:
+			vtm_http_res_begin(res, VTM_HTTP_RES_MODE_FIXED, VTM_HTTP_206_PARTIAL_CONTENT);
+			vtm_http_file_rt_variant_headers(res, encoding, vary);
+			vtm_http_res_header(res, VTM_HTTP_HEADER_ETAG, etag);
+			vtm_http_res_header(res, VTM_HTTP_HEADER_LAST_MODIFIED, last_modified);
+			rc = vtm_http_file_serve_ranges(res, filename, fp, info->size, ranges, count);
+			if (rc != VTM_OK)
+				goto err;
+			return vtm_http_res_end(res);
+
+		case VTM_E_OUT_OF_RANGE:
+			fclose(fp);
+			return vtm_http_file_rt_not_satisfiable(res, info->size);
+
+		default:
+			break;
+	}
+
+	vtm_http_res_begin(res, VTM_HTTP_RES_MODE_FIXED, VTM_HTTP_200_OK);
+	vtm_http_res_header(res, VTM_HTTP_HEADER_ACCEPT_RANGES, VTM_HTTP_VALUE_BYTES);
+	vtm_http_file_rt_variant_headers(res, encoding, vary);
+	vtm_http_res_header(res, VTM_HTTP_HEADER_ETAG, etag);
+	vtm_http_res_header(res, VTM_HTTP_HEADER_LAST_MODIFIED, last_modified);
+	rc = vtm_http_file_serve(res, filename, fp);
+	if (rc != VTM_OK)
+		goto err;
+
+	return vtm_http_res_end(res);
+
+err:
+	fclose(fp);
+	return rc;
+}
+
+static int vtm_http_file_rt_eval_range(struct vtm_http_req *req, const char *etag, uint64_t mtime, uint64_t size, struct vtm_http_range *ranges, size_t *count)
+{
+	const char *val;
+	uint64_t date;
+
+	if (req->method != VTM_HTTP_METHOD_GET)
+		return VTM_E_NOT_HANDLED;
+
+	val = vtm_http_req_get_header_str(req, VTM_HTTP_HEADER_RANGE);
+	if (!val)
+		return VTM_E_NOT_HANDLED;
+
+	/* If-Range requires a strong match, weak validators send the full file */
+	val = vtm_http_req_get_header_str(req, VTM_HTTP_HEADER_IF_RANGE);
+	if (val) {
+		if (*val == '"' || strncmp(val, "W/", 2) == 0) {
+			if (*val != '"' || *etag != '"' || strcmp(val, etag) != 0)
+				return VTM_E_NOT_HANDLED;
+		}
+		else if (vtm_http_parse_date(val, &date) != VTM_OK || date != mtime) {
+			return VTM_E_NOT_HANDLED;
+		}
+	}
+
+	val = vtm_http_req_get_header_str(req, VTM_HTTP_HEADER_RANGE);
+
+	return vtm_http_file_parse_range(val, size, ranges, count);
+}
+
+static int vtm_http_file_rt_not_satisfiable(vtm_http_res *res, uint64_t size)
+{
+	char buf[VTM_FMT_CHARS_INT64 + 8];
+
+	strcpy(buf, "bytes */");
+	buf[8 + vtm_fmt_uint64(buf + 8, size)] = '\0';
+
+	vtm_http_res_begin(res, VTM_HTTP_RES_MODE_FIXED, VTM_HTTP_416_RANGE_NOT_SATISFIABLE);
+	vtm_http_res_header(res, VTM_HTTP_HEADER_CONTENT_RANGE, buf);
+
+	return vtm_http_res_end(res);
+}
+
+static bool vtm_http_file_rt_not_modified(struct vtm_http_req *req, const char *etag, uint64_t mtime)
+{
+	const char *val;
+	uint64_t since;
+
+	/* If-None-Match takes precedence over If-Modified-Since */
+	val = vtm_http_req_get_header_str(req, VTM_HTTP_HEADER_IF_NONE_MATCH);
+	if (val)
+		return vtm_http_file_rt_etag_matches(val, etag);
+
+	val = vtm_http_req_get_header_str(req, VTM_HTTP_HEADER_IF_MODIFIED_SINCE);
+	if (val && vtm_http_parse_date(val, &since) == VTM_OK)
+		return mtime <= since;
+
+	return false;
+}
+
+static bool vtm_http_file_rt_etag_matches(const char *list, const char *etag)
+{
+	const char *end;
+	size_t etag_len;
+
+	/* weak comparison */
+	if (strncmp(etag, "W/", 2) == 0)
+		etag += 2;
+
+	etag_len = strlen(etag);
+
+	while (*list != '\0') {
+		/* skip separators */
+		if (*list == ' ' || *list == '\t' || *list == ',') {
+			list++;
+			continue;
+		}
+
+		if (*list == '*')
+			return true;
+
+		if (strncmp(list, "W/", 2) == 0)
+			list += 2;
+
+		if (*list != '"')
+			return false;
+
+		end = strchr(list + 1, '"');
+		if (!end)
+			return false;
+
+		if ((size_t) (end - list + 1) == etag_len &&
+			strncmp(list, etag, etag_len) == 0)
+			return true;
+
+		list = end + 1;
+	}
+
+	return false;
+}
+
 static char* vtm_http_file_rt_get_real_path(struct vtm_http_file_rt *rt, struct vtm_http_req *req)
 {
 	int rc;
@@ -129,6 +715,9 @@ static void vtm_http_file_rt_free(struct vtm_http_route *rt)
 
 	frt = (struct vtm_http_file_rt*) rt;
 
+	vtm_http_file_cache_free(frt->cache);
+	vtm_map_free(frt->sidecars);
+	vtm_mutex_free(frt->sidecar_mtx);
 	free(frt->fs_real_root);
 	free(rt);
 }
@@ -12,12 +12,18 @@
 #define VTM_NET_HTTP_HTTP_FILE_ROUTE_H_
 
 #include <vtm/core/api.h>
+#include <vtm/core/types.h>
 #include <vtm/net/http/http_route.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define VTM_HTTP_FILE_RT_OPT_CACHE_SIZE            1  /**< expects size_t, total cache size in bytes, 0 disables cache */
+#define VTM_HTTP_FILE_RT_OPT_CACHE_FILE_SIZE       2  /**< expects size_t, maximum size of a cached file in bytes */
+#define VTM_HTTP_FILE_RT_OPT_CACHE_CHECK_INTERVAL  3  /**< expects unsigned long, value is milliseconds */
+#define VTM_HTTP_FILE_RT_OPT_PRECOMPRESSED         4  /**< expects bool, serve .br and .gz sidecar files, enabled by default */
+
 /**
  * Creates a route for serving static files from given root directory.
  *
@@ -25,12 +31,50 @@ extern "C" {
  * is bound at "/files/", a HTTP request to path "/files/subdir/a.txt" will
  * serve "/srv/static/subdir/a.txt".
  *
+ * Small files are kept in a memory cache together with their validators.
+ * Cached files get a strong ETag based on their content, other files a
+ * weak one based on modification time and size.
+ * Responses carry ETag and Last-Modified headers and conditional requests
+ * with If-None-Match or If-Modified-Since are answered with 304 Not Modified.
+ * Cached entries are revalidated against the modification time and size of
+ * the file at most once per check interval.
+ *
+ * GET requests with a Range header (optionally guarded by If-Range) are
+ * answered with 206 Partial Content, multiple ranges are sent as
+ * multipart/byteranges. If-Range with a weak ETag always gets the full
+ * file.
+ *
+ * When the client accepts br or gzip content coding, a precompressed
+ * sidecar file "name.br" or "name.gz" next to the requested file is sent
+ * instead, with the media type of the original file. Sidecars that are
+ * older than the file are ignored. The sidecar lookup is cached per
+ * resolved file for a bounded number of files and revalidated with the
+ * cache check interval.
+ *
  * @param fs_root the root directory
  * @return http route if call succeeded
  * @return NULL if an error occured
  */
 VTM_API struct vtm_http_route* vtm_http_file_rt_new(const char *fs_root);
 
+/**
+ * Sets one of the possible options.
+ *
+ * The possible options are macros starting with VTM_HTTP_FILE_RT_OPT_.
+ * Options must be set before the route is used for handling requests,
+ * changing an option clears the cache.
+ *
+ * @param rt the file route where the option should be set
+ * @param opt the option that should be set
+ * @param val pointer to new value of the option
+ * @param len size of the value
+ * @return VTM_OK if the option was successfully set
+ * @return VTM_E_NOT_SUPPORTED if the given option or the value format is
+ *         not supported
+ * @return VTM_ERROR if an error occured
+ */
+VTM_API int vtm_http_file_rt_set_opt(struct vtm_http_route *rt, int opt, const void *val, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,517 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include "http_form.h"
+
+#include <ctype.h> /* tolower() */
+#include <string.h> /* memchr(), memcmp(), memcpy(), strlen() */
+#include <vtm/core/error.h>
+#include <vtm/core/lang.h>
+
+#define VTM_HTTP_FORM_IS_WS(C)   ((C) == ' ' || (C) == '\t')
+
+enum vtm_http_form_mp_state
+{
+	VTM_HTTP_FORM_MP_PREAMBLE,
+	VTM_HTTP_FORM_MP_DELIM_TAIL,
+	VTM_HTTP_FORM_MP_DELIM_DASH,
+	VTM_HTTP_FORM_MP_DELIM_LF,
+	VTM_HTTP_FORM_MP_HEADERS,
+	VTM_HTTP_FORM_MP_DATA,
+	VTM_HTTP_FORM_MP_EPILOGUE,
+	VTM_HTTP_FORM_MP_ERROR
+};
+
+struct vtm_http_form_param
+{
+	const char  *key;
+	size_t      key_len;
+	const char  *val;
+	size_t      val_len;
+};
+
+/* forward declaration */
+static int vtm_http_form_decode(char *s, size_t len, size_t *out_len);
+static VTM_INLINE int vtm_http_form_hex(char c);
+static bool vtm_http_form_next_param(const char **pos, const char *end, struct vtm_http_form_param *param);
+static bool vtm_http_form_token_eq(const char *s, size_t len, const char *lit);
+static const char* vtm_http_form_mp_scan(struct vtm_http_form_multipart *mp, const char *p, const char *end, int *rc);
+static const char* vtm_http_form_mp_headers(struct vtm_http_form_multipart *mp, const char *p, const char *end, int *rc);
+static int vtm_http_form_mp_header(struct vtm_http_form_multipart *mp, const char *line, size_t len);
+static int vtm_http_form_mp_emit(struct vtm_http_form_multipart *mp, const char *data, size_t len);
+static int vtm_http_form_mp_fail(struct vtm_http_form_multipart *mp, int rc);
+
+void vtm_http_form_urlenc_init(struct vtm_http_form_urlenc *it, void *body, size_t len)
+{
+	it->pos = body;
+	it->end = it->pos + len;
+}
+
+int vtm_http_form_urlenc_next(struct vtm_http_form_urlenc *it, struct vtm_http_form_field *field)
+{
+	int rc;
+	char *begin, *sep, *eq;
+
+	while (it->pos < it->end) {
+		begin = it->pos;
+
+		sep = memchr(begin, '&', (size_t) (it->end - begin));
+		if (!sep)
+			sep = it->end;
+
+		it->pos = sep < it->end ? sep + 1 : it->end;
+
+		/* empty field */
+		if (sep == begin)
+			continue;
+
+		eq = memchr(begin, '=', (size_t) (sep - begin));
+		if (!eq)
+			eq = sep;
+
+		rc = vtm_http_form_decode(begin, (size_t) (eq - begin), &field->name_len);
+		if (rc != VTM_OK)
+			return rc;
+		field->name = begin;
+
+		if (eq == sep) {
+			field->value = sep;
+			field->value_len = 0;
+			return VTM_OK;
+		}
+
+		rc = vtm_http_form_decode(eq + 1, (size_t) (sep - eq - 1), &field->value_len);
+		if (rc != VTM_OK)
+			return rc;
+		field->value = eq + 1;
+
+		return VTM_OK;
+	}
+
+	return VTM_E_NOT_FOUND;
+}
+
+int vtm_http_form_multipart_init(struct vtm_http_form_multipart *mp, const char *content_type,
+	const struct vtm_http_form_multipart_cbs *cbs, void *usr_data)
+{
+	const char *pos, *end;
+	struct vtm_http_form_param param;
+
+	end = content_type + strlen(content_type);
+	if (!vtm_http_form_token_eq(content_type, 10, "multipart/"))
+		return VTM_E_INVALID_ARG;
+
+	mp->delim_len = 0;
+	pos = content_type;
+	while (vtm_http_form_next_param(&pos, end, &param)) {
+		if (!vtm_http_form_token_eq(param.key, param.key_len, "boundary"))
+			continue;
+
+		if (param.val_len == 0 || param.val_len > VTM_HTTP_FORM_MAX_BOUNDARY)
+			return VTM_E_INVALID_ARG;
+
+		memcpy(mp->delim, "\r\n--", 4);
+		memcpy(mp->delim + 4, param.val, param.val_len);
+		mp->delim_len = param.val_len + 4;
+		break;
+	}
+
+	if (mp->delim_len == 0)
+		return VTM_E_INVALID_ARG;
+
+	mp->cbs = *cbs;
+	mp->usr_data = usr_data;
+	mp->state = VTM_HTTP_FORM_MP_PREAMBLE;
+	mp->err = VTM_OK;
+	mp->in_part = false;
+	mp->line_len = 0;
+
+	/* the first delimiter may directly start the body without CRLF */
+	mp->match = 2;
+
+	return VTM_OK;
+}
+
+int vtm_http_form_multipart_run(struct vtm_http_form_multipart *mp, const void *data, size_t len)
+{
+	int rc;
+	const char *p, *end;
+
+	p = data;
+	end = p + len;
+	rc = VTM_OK;
+
+	while (p < end) {
+		switch (mp->state) {
+			case VTM_HTTP_FORM_MP_PREAMBLE:
+			case VTM_HTTP_FORM_MP_DATA:
+				p = vtm_http_form_mp_scan(mp, p, end, &rc);
+				break;
+
+			case VTM_HTTP_FORM_MP_DELIM_TAIL:
+				/* transport padding may follow the boundary */
+				if (*p == '-')
+					mp->state = VTM_HTTP_FORM_MP_DELIM_DASH;
+				else if (*p == '\r')
+					mp->state = VTM_HTTP_FORM_MP_DELIM_LF;
+				else if (!VTM_HTTP_FORM_IS_WS(*p))
+					rc = VTM_E_IO_PROTOCOL;
+				p++;
+				break;
+
+			case VTM_HTTP_FORM_MP_DELIM_DASH:
+				if (*p++ != '-') {
+					rc = VTM_E_IO_PROTOCOL;
+					break;
+				}
+				mp->state = VTM_HTTP_FORM_MP_EPILOGUE;
+				break;
+
+			case VTM_HTTP_FORM_MP_DELIM_LF:
+				if (*p++ != '\n') {
+					rc = VTM_E_IO_PROTOCOL;
+					break;
+				}
+				mp->state = VTM_HTTP_FORM_MP_HEADERS;
+				mp->line_len = 0;
+				mp->in_part = true;
+				if (mp->cbs.part_begin)
+					rc = mp->cbs.part_begin(mp->usr_data);
+				break;
+
+			case VTM_HTTP_FORM_MP_HEADERS:
+				p = vtm_http_form_mp_headers(mp, p, end, &rc);
+				break;
+
+			case VTM_HTTP_FORM_MP_EPILOGUE:
+				return VTM_OK;
+
+			default:
+				return mp->err;
+		}
+
+		if (rc != VTM_OK)
+			return vtm_http_form_mp_fail(mp, rc);
+	}
+
+	return VTM_OK;
+}
+
+bool vtm_http_form_multipart_is_complete(struct vtm_http_form_multipart *mp)
+{
+	return mp->state == VTM_HTTP_FORM_MP_EPILOGUE;
+}
+
+int vtm_http_form_disposition_parse(const char *value, size_t len, struct vtm_http_form_disposition *disp)
+{
+	size_t type_len;
+	const char *pos, *end;
+	struct vtm_http_form_param param;
+
+	end = value + len;
+	while (value < end && VTM_HTTP_FORM_IS_WS(*value))
+		value++;
+
+	for (type_len=0; value + type_len < end; type_len++) {
+		if (value[type_len] == ';' || VTM_HTTP_FORM_IS_WS(value[type_len]))
+			break;
+	}
+
+	if (!vtm_http_form_token_eq(value, type_len, "form-data"))
+		return VTM_E_INVALID_ARG;
+
+	disp->name = NULL;
+	disp->name_len = 0;
+	disp->filename = NULL;
+	disp->filename_len = 0;
+
+	pos = value;
+	while (vtm_http_form_next_param(&pos, end, &param)) {
+		if (!param.val)
+			continue;
+
+		if (vtm_http_form_token_eq(param.key, param.key_len, "name")) {
+			disp->name = param.val;
+			disp->name_len = param.val_len;
+		}
+		else if (vtm_http_form_token_eq(param.key, param.key_len, "filename")) {
+			disp->filename = param.val;
+			disp->filename_len = param.val_len;
+		}
+	}
+
+	return VTM_OK;
+}
+
+static int vtm_http_form_decode(char *s, size_t len, size_t *out_len)
+{
+	int hi, lo;
+	char *in, *out, *end;
+
+	in = s;
+	end = s + len;
+
+	/* nothing is moved before the first encoded character */
+	while (in < end && *in != '%' && *in != '+')
+		in++;
+
+	out = in;
+	while (in < end) {
+		switch (*in) {
+			case '+':
+				*out++ = ' ';
+				in++;
+				break;
+
+			case '%':
+				if (end - in < 3)
+					return VTM_E_INVALID_ARG;
+
+				hi = vtm_http_form_hex(in[1]);
+				lo = vtm_http_form_hex(in[2]);
+				if (hi < 0 || lo < 0)
+					return VTM_E_INVALID_ARG;
+
+				*out++ = (char) ((hi << 4) | lo);
+				in += 3;
+				break;
+
+			default:
+				*out++ = *in++;
+				break;
+		}
+	}
+
+	*out_len = (size_t) (out - s);
+
+	return VTM_OK;
+}
+
+static VTM_INLINE int vtm_http_form_hex(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+static bool vtm_http_form_next_param(const char **pos, const char *end, struct vtm_http_form_param *param)
+{
+	const char *p, *q;
+
+	p = memchr(*pos, ';', (size_t) (end - *pos));
+	if (!p)
+		return false;
+	p++;
+
+	while (p < end && VTM_HTTP_FORM_IS_WS(*p))
+		p++;
+
+	param->key = p;
+	while (p < end && *p != '=' && *p != ';' && !VTM_HTTP_FORM_IS_WS(*p))
+		p++;
+	param->key_len = (size_t) (p - param->key);
+
+	while (p < end && VTM_HTTP_FORM_IS_WS(*p))
+		p++;
+
+	param->val = NULL;
+	param->val_len = 0;
+
+	if (p < end && *p == '=') {
+		p++;
+		while (p < end && VTM_HTTP_FORM_IS_WS(*p))
+			p++;
+
+		if (p < end && *p == '"') {
+			p++;
+			q = memchr(p, '"', (size_t) (end - p));
+			if (!q)
+				q = end;
+			param->val = p;
+			param->val_len = (size_t) (q - p);
+			p = q < end ? q + 1 : end;
+		}
+		else {
+			param->val = p;
+			while (p < end && *p != ';' && !VTM_HTTP_FORM_IS_WS(*p))
+				p++;
+			param->val_len = (size_t) (p - param->val);
+		}
+	}
+
+	*pos = p;
+
+	return true;
+}
+
+static bool vtm_http_form_token_eq(const char *s, size_t len, const char *lit)
+{
+	size_t i;
+
+	for (i=0; i < len; i++) {
+		if (lit[i] == '\0' || tolower((unsigned char) s[i]) != lit[i])
+			return false;
+	}
+
+	return lit[len] == '\0';
+}
+
+static const char* vtm_http_form_mp_scan(struct vtm_http_form_multipart *mp, const char *p, const char *end, int *rc)
+{
+	size_t n;
+	const char *begin, *cr;
+
+	/* delimiter that was split across inputs */
+	if (mp->match > 0) {
+		while (mp->match < mp->delim_len && p < end && *p == mp->delim[mp->match]) {
+			mp->match++;
+			p++;
+		}
+
+		if (mp->match < mp->delim_len) {
+			if (p == end)
+				return p;
+
+			/*
+			 * The boundary cannot contain CR, so the held back bytes
+			 * never contain the start of another delimiter.
+			 */
+			*rc = vtm_http_form_mp_emit(mp, mp->delim, mp->match);
+			mp->match = 0;
+			return p;
+		}
+
+		mp->match = 0;
+		goto found;
+	}
+
+	/* candidates are located with memchr(), which is vectorized by the C library */
+	begin = p;
+	while (p < end) {
+		cr = memchr(p, '\r', (size_t) (end - p));
+		if (!cr)
+			break;
+
+		n = (size_t) (end - cr);
+		if (n > mp->delim_len)
+			n = mp->delim_len;
+
+		if (memcmp(cr, mp->delim, n) != 0) {
+			p = cr + 1;
+			continue;
+		}
+
+		*rc = vtm_http_form_mp_emit(mp, begin, (size_t) (cr - begin));
+		if (*rc != VTM_OK)
+			return end;
+
+		/* partial delimiter at the end of the input */
+		if (n < mp->delim_len) {
+			mp->match = n;
+			return end;
+		}
+
+		p = cr + n;
+		goto found;
+	}
+
+	*rc = vtm_http_form_mp_emit(mp, begin, (size_t) (end - begin));
+	return end;
+
+found:
+	if (mp->state == VTM_HTTP_FORM_MP_DATA) {
+		mp->in_part = false;
+		if (mp->cbs.part_end)
+			*rc = mp->cbs.part_end(mp->usr_data);
+	}
+	mp->state = VTM_HTTP_FORM_MP_DELIM_TAIL;
+
+	return p;
+}
+
+static const char* vtm_http_form_mp_headers(struct vtm_http_form_multipart *mp, const char *p, const char *end, int *rc)
+{
+	size_t n;
+	const char *nl, *line;
+
+	nl = memchr(p, '\n', (size_t) (end - p));
+	n = (size_t) ((nl ? nl : end) - p);
+
+	if (mp->line_len + n > sizeof(mp->line)) {
+		*rc = VTM_E_MAX_REACHED;
+		return end;
+	}
+
+	/* complete lines are parsed directly from the input */
+	if (nl && mp->line_len == 0) {
+		line = p;
+	}
+	else {
+		memcpy(mp->line + mp->line_len, p, n);
+		mp->line_len += n;
+		if (!nl)
+			return end;
+		line = mp->line;
+		n = mp->line_len;
+	}
+
+	mp->line_len = 0;
+
+	if (n == 0 || line[n-1] != '\r') {
+		*rc = VTM_E_IO_PROTOCOL;
+		return end;
+	}
+	n--;
+
+	/* empty line ends the headers */
+	if (n == 0)
+		mp->state = VTM_HTTP_FORM_MP_DATA;
+	else
+		*rc = vtm_http_form_mp_header(mp, line, n);
+
+	return nl + 1;
+}
+
+static int vtm_http_form_mp_header(struct vtm_http_form_multipart *mp, const char *line, size_t len)
+{
+	const char *colon, *val, *end;
+
+	colon = memchr(line, ':', len);
+	if (!colon || colon == line)
+		return VTM_E_IO_PROTOCOL;
+
+	end = line + len;
+	val = colon + 1;
+	while (val < end && VTM_HTTP_FORM_IS_WS(*val))
+		val++;
+	while (end > val && VTM_HTTP_FORM_IS_WS(end[-1]))
+		end--;
+
+	if (!mp->cbs.part_header)
+		return VTM_OK;
+
+	return mp->cbs.part_header(mp->usr_data, line, (size_t) (colon - line), val, (size_t) (end - val));
+}
+
+static int vtm_http_form_mp_emit(struct vtm_http_form_multipart *mp, const char *data, size_t len)
+{
+	/* preamble is ignored */
+	if (len == 0 || mp->state != VTM_HTTP_FORM_MP_DATA || !mp->cbs.part_data)
+		return VTM_OK;
+
+	return mp->cbs.part_data(mp->usr_data, data, len);
+}
+
+static int vtm_http_form_mp_fail(struct vtm_http_form_multipart *mp, int rc)
+{
+	mp->state = VTM_HTTP_FORM_MP_ERROR;
+	mp->err = rc;
+
+	return rc;
+}
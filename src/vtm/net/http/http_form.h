@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+/**
+ * @file http_form.h
+ *
+ * @brief Form body parsing
+ *
+ * Decoding of application/x-www-form-urlencoded bodies and an
+ * incremental parser for multipart/form-data bodies.
+ *
+ * Neither parser allocates memory. Urlencoded fields are decoded in
+ * place and returned as views into the body. The multipart parser
+ * passes the part data to the callbacks directly from the input
+ * fragments, so it can be fed from the http_body callback of a
+ * streamed request without buffering the whole body.
+ */
+
+#ifndef VTM_NET_HTTP_HTTP_FORM_H_
+#define VTM_NET_HTTP_HTTP_FORM_H_
+
+#include <vtm/core/api.h>
+#include <vtm/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Maximum boundary length according to RFC 2046 */
+#define VTM_HTTP_FORM_MAX_BOUNDARY       70
+
+/** Maximum length of a single part header line */
+#define VTM_HTTP_FORM_MAX_HEADER_LINE    1024
+
+/** Content type of urlencoded forms */
+#define VTM_HTTP_FORM_TYPE_URLENCODED    "application/x-www-form-urlencoded"
+
+/** Content type of multipart forms */
+#define VTM_HTTP_FORM_TYPE_MULTIPART     "multipart/form-data"
+
+/** Decoded name and value of a form field, not NUL-terminated */
+struct vtm_http_form_field
+{
+	const char  *name;
+	size_t      name_len;
+	const char  *value;
+	size_t      value_len;
+};
+
+/** Iterator over the fields of an urlencoded body */
+struct vtm_http_form_urlenc
+{
+	char        *pos;
+	char        *end;
+};
+
+/** Parameters of a Content-Disposition part header, not NUL-terminated */
+struct vtm_http_form_disposition
+{
+	const char  *name;          /**< field name, NULL if missing */
+	size_t      name_len;
+	const char  *filename;      /**< file name, NULL if missing */
+	size_t      filename_len;
+};
+
+/**
+ * Callbacks of the multipart parser.
+ *
+ * Every callback can stop the parser by returning an error code, which
+ * is then returned by vtm_http_form_multipart_run(). Unused callbacks
+ * MUST be set to NULL.
+ */
+struct vtm_http_form_multipart_cbs
+{
+	/**
+	 * Called when a new part begins.
+	 *
+	 * @param usr_data the user data of the parser
+	 * @return VTM_OK to continue
+	 */
+	int (*part_begin)(void *usr_data);
+
+	/**
+	 * Called for each header of the current part.
+	 *
+	 * Name and value are only valid during the call.
+	 *
+	 * @param usr_data the user data of the parser
+	 * @param name the header name
+	 * @param name_len length of the name
+	 * @param value the header value without surrounding whitespace
+	 * @param value_len length of the value
+	 * @return VTM_OK to continue
+	 */
+	int (*part_header)(void *usr_data, const char *name, size_t name_len, const char *value, size_t value_len);
+
+	/**
+	 * Called for each fragment of the part content.
+	 *
+	 * The data points into the input or into the parser and is only
+	 * valid during the call.
+	 *
+	 * @param usr_data the user data of the parser
+	 * @param data begin of the fragment
+	 * @param len length of the fragment, never zero
+	 * @return VTM_OK to continue
+	 */
+	int (*part_data)(void *usr_data, const void *data, size_t len);
+
+	/**
+	 * Called when the content of the current part is complete.
+	 *
+	 * @param usr_data the user data of the parser
+	 * @return VTM_OK to continue
+	 */
+	int (*part_end)(void *usr_data);
+};
+
+/** Incremental multipart parser, all fields are internal */
+struct vtm_http_form_multipart
+{
+	struct vtm_http_form_multipart_cbs  cbs;
+	void                                *usr_data;
+
+	int                                 state;
+	int                                 err;
+	bool                                in_part;
+
+	/* CRLF, two dashes and the boundary */
+	char                                delim[VTM_HTTP_FORM_MAX_BOUNDARY + 4];
+	size_t                              delim_len;
+
+	/* delimiter bytes matched at the end of the last input */
+	size_t                              match;
+
+	char                                line[VTM_HTTP_FORM_MAX_HEADER_LINE];
+	size_t                              line_len;
+};
+
+/**
+ * Prepares the decoding of an urlencoded body.
+ *
+ * The body is modified while the fields are decoded.
+ *
+ * @param it the iterator that should be initialized
+ * @param body begin of the body
+ * @param len length of the body
+ */
+VTM_API void vtm_http_form_urlenc_init(struct vtm_http_form_urlenc *it, void *body, size_t len);
+
+/**
+ * Decodes the next field in place.
+ *
+ * Plus signs are replaced with spaces and percent-encoded characters
+ * are decoded. Empty fields are skipped, a field without equal sign
+ * has an empty value.
+ *
+ * @param it the iterator
+ * @param[out] field the decoded field, pointing into the body
+ * @return VTM_OK if a field was decoded
+ * @return VTM_E_NOT_FOUND if no more fields are available
+ * @return VTM_E_INVALID_ARG if the field is not properly encoded
+ */
+VTM_API int vtm_http_form_urlenc_next(struct vtm_http_form_urlenc *it, struct vtm_http_form_field *field);
+
+/**
+ * Initializes the multipart parser.
+ *
+ * @param mp the parser that should be initialized
+ * @param content_type the Content-Type header of the request, which
+ *        contains the boundary parameter
+ * @param cbs the callbacks, they are copied
+ * @param usr_data passed to each callback
+ * @return VTM_OK if the parser was initialized
+ * @return VTM_E_INVALID_ARG if the content type is not multipart or
+ *         the boundary is missing or invalid
+ */
+VTM_API int vtm_http_form_multipart_init(struct vtm_http_form_multipart *mp, const char *content_type,
+	const struct vtm_http_form_multipart_cbs *cbs, void *usr_data);
+
+/**
+ * Parses the next fragment of the body.
+ *
+ * The fragments can have any size. Once the closing delimiter was
+ * parsed, the remaining input is ignored.
+ *
+ * @param mp the parser
+ * @param data begin of the fragment
+ * @param len length of the fragment
+ * @return VTM_OK if the fragment was parsed
+ * @return VTM_E_IO_PROTOCOL if the body is malformed
+ * @return VTM_E_MAX_REACHED if a header line is too long
+ * @return the error code of a callback that stopped the parser
+ */
+VTM_API int vtm_http_form_multipart_run(struct vtm_http_form_multipart *mp, const void *data, size_t len);
+
+/**
+ * Checks if the closing delimiter was parsed.
+ *
+ * @param mp the parser
+ * @return true if the body is complete
+ */
+VTM_API bool vtm_http_form_multipart_is_complete(struct vtm_http_form_multipart *mp);
+
+/**
+ * Extracts the name and filename parameters of a Content-Disposition
+ * header value.
+ *
+ * @param value the header value
+ * @param len length of the value
+ * @param[out] disp the parameters, pointing into value
+ * @return VTM_OK if the value is a form-data disposition
+ * @return VTM_E_INVALID_ARG otherwise
+ */
+VTM_API int vtm_http_form_disposition_parse(const char *value, size_t len, struct vtm_http_form_disposition *disp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_NET_HTTP_HTTP_FORM_H_ */
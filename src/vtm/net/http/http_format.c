@@ -4,8 +4,12 @@
 
 #include "http_format.h"
 
-#include <string.h> /* sprintf() */
+#include <ctype.h> /* tolower() */
+#include <stdio.h> /* snprintf() */
+#include <stdlib.h> /* strtod() */
+#include <string.h> /* strlen(), strcmp(), strncmp() */
 #include <vtm/core/error.h>
+#include <vtm/core/macros.h>
 
 static const char* VTM_HTTP_MONTH[] = {
 	"Jan", "Feb", "Mar", "Apr", "May", "Jun",
@@ -16,6 +20,19 @@ static const char* VTM_HTTP_DAY[] = {
 	"Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"
 };
 
+static const struct {
+	const char    *name;
+	unsigned int  flag;
+} VTM_HTTP_CODINGS[] = {
+	{"gzip",     VTM_HTTP_CODING_GZIP},
+	{"deflate",  VTM_HTTP_CODING_DEFLATE},
+	{"br",       VTM_HTTP_CODING_BR}
+};
+
+/* forward declaration */
+static bool vtm_http_parse_num(const char **src, unsigned int digits, unsigned int *out);
+static bool vtm_http_token_equals(const char *token, size_t len, const char *name);
+
 int vtm_http_fmt_date(char *dst, size_t max_len, struct vtm_date *date)
 {
 	int rc;
@@ -35,3 +52,142 @@ int vtm_http_fmt_date(char *dst, size_t max_len, struct vtm_date *date)
 	
 	return VTM_OK;
 }
+
+int vtm_http_parse_date(const char *src, uint64_t *ts)
+{
+	unsigned int i, day, month, year, hour, minute, second;
+	int64_t y, era, yoe, doy, doe, days;
+
+	/* day name is ignored */
+	if (strlen(src) != 29 || src[3] != ',' || src[4] != ' ')
+		return VTM_E_INVALID_ARG;
+
+	src += 5;
+	if (!vtm_http_parse_num(&src, 2, &day) || *src++ != ' ')
+		return VTM_E_INVALID_ARG;
+
+	for (i=0; i < 12; i++) {
+		if (strncmp(src, VTM_HTTP_MONTH[i], 3) == 0)
+			break;
+	}
+	if (i == 12)
+		return VTM_E_INVALID_ARG;
+	month = i + 1;
+	src += 3;
+
+	if (*src++ != ' ' ||
+		!vtm_http_parse_num(&src, 4, &year) || *src++ != ' ' ||
+		!vtm_http_parse_num(&src, 2, &hour) || *src++ != ':' ||
+		!vtm_http_parse_num(&src, 2, &minute) || *src++ != ':' ||
+		!vtm_http_parse_num(&src, 2, &second) ||
+		strcmp(src, " GMT") != 0)
+		return VTM_E_INVALID_ARG;
+
+	if (day < 1 || day > 31 || year < 1970 || hour > 23 || minute > 59 || second > 60)
+		return VTM_E_INVALID_ARG;
+
+	/* days since epoch from civil date */
+	y = (int64_t) year - (month <= 2);
+	era = y / 400;
+	yoe = y - era * 400;
+	doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	days = era * 146097 + doe - 719468;
+
+	*ts = (uint64_t) days * 86400 + hour * 3600 + minute * 60 + second;
+
+	return VTM_OK;
+}
+
+static bool vtm_http_parse_num(const char **src, unsigned int digits, unsigned int *out)
+{
+	unsigned int i;
+	const char *s;
+
+	s = *src;
+	*out = 0;
+
+	for (i=0; i < digits; i++) {
+		if (s[i] < '0' || s[i] > '9')
+			return false;
+		*out = *out * 10 + (s[i] - '0');
+	}
+
+	*src += digits;
+
+	return true;
+}
+
+unsigned int vtm_http_parse_accept_encoding(const char *src)
+{
+	size_t i, len;
+	const char *name;
+	double q;
+	unsigned int accepted, listed;
+	bool any;
+
+	accepted = 0;
+	listed = 0;
+	any = false;
+
+	while (*src) {
+		/* coding name */
+		while (*src == ' ' || *src == '\t' || *src == ',')
+			src++;
+		name = src;
+		while (*src && *src != ',' && *src != ';' && *src != ' ' && *src != '\t')
+			src++;
+		len = src - name;
+
+		/* parameters, only q is evaluated */
+		q = 1;
+		while (*src && *src != ',') {
+			if (*src == ';') {
+				src++;
+				while (*src == ' ' || *src == '\t')
+					src++;
+				if ((*src == 'q' || *src == 'Q') && *(src+1) == '=') {
+					q = strtod(src+2, (char**) &src);
+					continue;
+				}
+			}
+			src++;
+		}
+
+		if (len == 1 && *name == '*') {
+			any = q > 0;
+			continue;
+		}
+
+		for (i=0; i < VTM_ARRAY_LEN(VTM_HTTP_CODINGS); i++) {
+			if (!vtm_http_token_equals(name, len, VTM_HTTP_CODINGS[i].name))
+				continue;
+			listed |= VTM_HTTP_CODINGS[i].flag;
+			if (q > 0)
+				accepted |= VTM_HTTP_CODINGS[i].flag;
+			break;
+		}
+	}
+
+	/* wildcard applies only to codings that are not listed */
+	if (any) {
+		for (i=0; i < VTM_ARRAY_LEN(VTM_HTTP_CODINGS); i++) {
+			if ((listed & VTM_HTTP_CODINGS[i].flag) == 0)
+				accepted |= VTM_HTTP_CODINGS[i].flag;
+		}
+	}
+
+	return accepted;
+}
+
+static bool vtm_http_token_equals(const char *token, size_t len, const char *name)
+{
+	size_t i;
+
+	for (i=0; i < len; i++) {
+		if (name[i] == '\0' || tolower((unsigned char) token[i]) != name[i])
+			return false;
+	}
+
+	return name[len] == '\0';
+}
@@ -22,6 +22,11 @@ extern "C" {
 /** Minimum buffer length in bytes for holding a formatted HTTP date */
 #define VTM_HTTP_DATE_LEN       30
 
+/* content codings */
+#define VTM_HTTP_CODING_GZIP       0x01  /**< gzip */
+#define VTM_HTTP_CODING_DEFLATE    0x02  /**< deflate (zlib format) */
+#define VTM_HTTP_CODING_BR         0x04  /**< brotli */
+
 /**
  * Converts given date to HTTP date format.
  *
@@ -33,6 +38,31 @@ extern "C" {
  */
 VTM_API int vtm_http_fmt_date(char *dst, size_t max_len, struct vtm_date *date);
 
+/**
+ * Parses a HTTP date in IMF-fixdate format.
+ *
+ * Example: Sun, 06 Nov 1994 08:49:37 GMT
+ *
+ * @param src the date string
+ * @param[out] ts the seconds since 1970-01-01 UTC are stored here
+ * @return VTM_OK if the date was successfully parsed
+ * @return VTM_E_INVALID_ARG if the date string has an invalid format
+ */
+VTM_API int vtm_http_parse_date(const char *src, uint64_t *ts);
+
+/**
+ * Evaluates the value of an Accept-Encoding header.
+ *
+ * Codings with a quality value of zero are not accepted, a wildcard
+ * applies to all codings that are not listed explicitly.
+ *
+ * Example: gzip;q=1.0, br, *;q=0
+ *
+ * @param src the header value
+ * @return bitmask of the accepted VTM_HTTP_CODING_ values
+ */
+VTM_API unsigned int vtm_http_parse_accept_encoding(const char *src);
+
 #ifdef __cplusplus
 }
 #endif
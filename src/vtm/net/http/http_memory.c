@@ -4,117 +4,538 @@
 
 #include "http_memory.h"
 
-#include <string.h> /* memset() */
+#include <stdlib.h> /* malloc(), calloc(), free() */
+#include <string.h> /* memcpy(), strcmp(), strlen() */
 #include <vtm/core/error.h> /* result codes */
+#include <vtm/core/hash.h>
+#include <vtm/core/list.h>
 #include <vtm/core/map.h>
+#include <vtm/core/string.h>
 #include <vtm/util/mutex.h>
+#include <vtm/util/time.h>
 #include <vtm/net/http/http_memory_intl.h>
 
+#define VTM_HTTP_MEM_DEF_SHARDS     16
+#define VTM_HTTP_MEM_INIT_BUCKETS   16
+
+struct vtm_http_mem_entry
+{
+	uint32_t                   hash;
+	char                       *key;
+	void                       *val;
+	size_t                     len;      /**< length of copied data */
+	bool                       copied;   /**< stored with vtm_http_mem_set() */
+	uint64_t                   expires;  /**< zero means never */
+
+	struct vtm_http_mem_entry  *bucket_next;
+
+	/* copied values, most recently used first */
+	struct vtm_http_mem_entry  *prev;
+	struct vtm_http_mem_entry  *next;
+};
+
+struct vtm_http_mem_shard
+{
+	vtm_mutex                  *mtx;
+	vtm_map                    *mutexes;
+
+	/* grows when it holds more entries than buckets */
+	struct vtm_http_mem_entry  **buckets;
+	size_t                     bucket_count;
+	size_t                     count;
+
+	struct vtm_http_mem_entry  *head;
+	struct vtm_http_mem_entry  *tail;
+	size_t                     used;
+};
+
 struct vtm_http_mem
 {
-	vtm_mutex *mtx;
-	vtm_map *values;
-	vtm_map *mutexes;
+	struct vtm_http_mem_shard  *shards;
+	unsigned int               shard_count;
+	size_t                     shard_max_size;
+	unsigned long              ttl;
 };
 
-vtm_http_mem* vtm_http_mem_new(void)
+/* forward declaration */
+static int  vtm_http_mem_shard_init(struct vtm_http_mem_shard *shard);
+static void vtm_http_mem_shard_release(struct vtm_http_mem_shard *shard);
+static struct vtm_http_mem_shard* vtm_http_mem_shard_get(vtm_http_mem *mem, const char *key, uint32_t *hash);
+static struct vtm_http_mem_entry** vtm_http_mem_find(vtm_http_mem *mem, struct vtm_http_mem_shard *shard, const char *key, uint32_t hash);
+static struct vtm_http_mem_entry* vtm_http_mem_lookup(vtm_http_mem *mem, struct vtm_http_mem_shard *shard, const char *key, uint32_t hash);
+static int  vtm_http_mem_insert(vtm_http_mem *mem, struct vtm_http_mem_shard *shard, struct vtm_http_mem_entry *entry);
+static void vtm_http_mem_grow(vtm_http_mem *mem, struct vtm_http_mem_shard *shard);
+static void vtm_http_mem_unlink(struct vtm_http_mem_shard *shard, struct vtm_http_mem_entry *entry);
+static void vtm_http_mem_remove_entry(vtm_http_mem *mem, struct vtm_http_mem_shard *shard, struct vtm_http_mem_entry *entry);
+static size_t vtm_http_mem_entry_size(struct vtm_http_mem_entry *entry);
+static void vtm_http_mem_entry_free(struct vtm_http_mem_entry *entry);
+
+vtm_http_mem* vtm_http_mem_new(const struct vtm_http_mem_opts *opts)
 {
+	unsigned int i;
 	vtm_http_mem *mem;
-	
+
 	mem = malloc(sizeof(vtm_http_mem));
-	if (!mem)
+	if (!mem) {
+		vtm_err_oom();
 		return NULL;
+	}
+
+	mem->shard_count = opts->shards > 0 ? opts->shards : VTM_HTTP_MEM_DEF_SHARDS;
+	mem->shard_max_size = opts->max_size > 0 ? opts->max_size / mem->shard_count : 0;
+	mem->ttl = opts->ttl;
+
+	/* limit is enforced per shard */
+	if (opts->max_size > 0 && mem->shard_max_size == 0)
+		mem->shard_max_size = 1;
+
+	mem->shards = calloc(mem->shard_count, sizeof(struct vtm_http_mem_shard));
+	if (!mem->shards) {
+		vtm_err_oom();
+		goto err_shards;
+	}
+
+	for (i=0; i < mem->shard_count; i++) {
+		if (vtm_http_mem_shard_init(&mem->shards[i]) != VTM_OK)
+			goto err_init;
+	}
 
-	memset(mem, 0, sizeof(vtm_http_mem));
-	mem->mtx = vtm_mutex_new();
-	if (!mem->mtx)
-		goto err;
-
-	mem->values = vtm_map_new(VTM_ELEM_STRING, VTM_ELEM_POINTER, 16);
-	if (!mem->values)
-		goto err;
-	
-	mem->mutexes = vtm_map_new(VTM_ELEM_STRING, VTM_ELEM_POINTER, 16);
-	if (!mem->mutexes) 
-		goto err;
-	
 	return mem;
 
-err:
-	vtm_mutex_free(mem->mtx);
-	vtm_map_free(mem->values);
-	vtm_map_free(mem->mutexes);
+err_init:
+	while (i-- > 0)
+		vtm_http_mem_shard_release(&mem->shards[i]);
+	free(mem->shards);
+
+err_shards:
 	free(mem);
 	return NULL;
 }
 
 void vtm_http_mem_free(vtm_http_mem *mem)
 {
-	vtm_list *entries;
-	struct vtm_map_entry *entry;
-	
+	unsigned int i;
+
 	if (mem == NULL)
 		return;
-	
-	/* values should have been freed external */	
-	vtm_map_free(mem->values);
-	
-	/* free auto created mutexes */
-	entries = vtm_map_entryset(mem->mutexes);
-	if (entries) {
-		size_t len;
-		size_t i;
-		
-		len = vtm_list_size(entries);
-		for (i=0; i < len; i++) {
-			entry = vtm_list_get_pointer(entries, i);
-			vtm_mutex_free(entry->value.elem_pointer);
-		}
-	}
 
-	vtm_map_free(mem->mutexes);
+	for (i=0; i < mem->shard_count; i++)
+		vtm_http_mem_shard_release(&mem->shards[i]);
+
+	free(mem->shards);
 	free(mem);
 }
 
 void vtm_http_mem_put(vtm_http_mem *mem, const char *key, void *val)
 {
-	vtm_mutex_lock(mem->mtx);
-	vtm_map_put_va(mem->values, key, val);
-	vtm_mutex_unlock(mem->mtx);
+	uint32_t hash;
+	struct vtm_http_mem_shard *shard;
+	struct vtm_http_mem_entry *entry;
+
+	shard = vtm_http_mem_shard_get(mem, key, &hash);
+
+	entry = malloc(sizeof(*entry));
+	if (!entry) {
+		vtm_err_oom();
+		return;
+	}
+
+	entry->hash = hash;
+	entry->key = vtm_str_copy(key);
+	entry->val = val;
+	entry->len = 0;
+	entry->copied = false;
+	entry->expires = 0;
+
+	if (!entry->key) {
+		free(entry);
+		return;
+	}
+
+	vtm_mutex_lock(shard->mtx);
+	vtm_http_mem_insert(mem, shard, entry);
+	vtm_mutex_unlock(shard->mtx);
 }
 
 void* vtm_http_mem_get(vtm_http_mem *mem, const char *key)
 {
+	uint32_t hash;
 	void *result;
-	
-	vtm_mutex_lock(mem->mtx);
-	result = vtm_map_get_pointer_va(mem->values, key);
-	vtm_mutex_unlock(mem->mtx);
-	
+	struct vtm_http_mem_shard *shard;
+	struct vtm_http_mem_entry *entry;
+
+	shard = vtm_http_mem_shard_get(mem, key, &hash);
+
+	vtm_mutex_lock(shard->mtx);
+	entry = vtm_http_mem_lookup(mem, shard, key, hash);
+	result = (entry && !entry->copied) ? entry->val : NULL;
+	vtm_mutex_unlock(shard->mtx);
+
 	return result;
 }
 
+int vtm_http_mem_set(vtm_http_mem *mem, const char *key, const void *data, size_t len, unsigned long ttl)
+{
+	int rc;
+	uint32_t hash;
+	struct vtm_http_mem_shard *shard;
+	struct vtm_http_mem_entry *entry;
+
+	shard = vtm_http_mem_shard_get(mem, key, &hash);
+
+	/* copy outside of the lock */
+	entry = malloc(sizeof(*entry));
+	if (!entry) {
+		vtm_err_oom();
+		return vtm_err_get_code();
+	}
+
+	entry->hash = hash;
+	entry->key = vtm_str_copy(key);
+	entry->val = malloc(len > 0 ? len : 1);
+	entry->len = len;
+	entry->copied = true;
+
+	if (!entry->key || !entry->val) {
+		vtm_http_mem_entry_free(entry);
+		vtm_err_oom();
+		return vtm_err_get_code();
+	}
+
+	if (len > 0)
+		memcpy(entry->val, data, len);
+
+	if (ttl == 0)
+		ttl = mem->ttl;
+	entry->expires = ttl > 0 ? vtm_time_current_millis() + ttl : 0;
+
+	if (mem->shard_max_size > 0 && vtm_http_mem_entry_size(entry) > mem->shard_max_size) {
+		vtm_http_mem_entry_free(entry);
+		return vtm_err_set(VTM_E_MAX_REACHED);
+	}
+
+	vtm_mutex_lock(shard->mtx);
+	rc = vtm_http_mem_insert(mem, shard, entry);
+	vtm_mutex_unlock(shard->mtx);
+
+	return rc;
+}
+
+int vtm_http_mem_get_data(vtm_http_mem *mem, const char *key, struct vtm_buf *buf)
+{
+	int rc;
+	uint32_t hash;
+	struct vtm_http_mem_shard *shard;
+	struct vtm_http_mem_entry *entry;
+
+	shard = vtm_http_mem_shard_get(mem, key, &hash);
+
+	vtm_mutex_lock(shard->mtx);
+
+	entry = vtm_http_mem_lookup(mem, shard, key, hash);
+	if (!entry || !entry->copied) {
+		rc = VTM_E_NOT_FOUND;
+		goto unlock;
+	}
+
+	/* mark as most recently used */
+	if (shard->head != entry) {
+		vtm_http_mem_unlink(shard, entry);
+		entry->prev = NULL;
+		entry->next = shard->head;
+		shard->head->prev = entry;
+		shard->head = entry;
+	}
+
+	rc = vtm_buf_putm(buf, entry->val, entry->len);
+
+unlock:
+	vtm_mutex_unlock(shard->mtx);
+
+	return rc;
+}
+
+bool vtm_http_mem_remove(vtm_http_mem *mem, const char *key)
+{
+	uint32_t hash;
+	struct vtm_http_mem_shard *shard;
+	struct vtm_http_mem_entry *entry;
+
+	shard = vtm_http_mem_shard_get(mem, key, &hash);
+
+	vtm_mutex_lock(shard->mtx);
+	entry = vtm_http_mem_lookup(mem, shard, key, hash);
+	if (entry)
+		vtm_http_mem_remove_entry(mem, shard, entry);
+	vtm_mutex_unlock(shard->mtx);
+
+	return entry != NULL;
+}
+
+size_t vtm_http_mem_size(vtm_http_mem *mem)
+{
+	unsigned int i;
+	size_t size;
+
+	size = 0;
+	for (i=0; i < mem->shard_count; i++) {
+		vtm_mutex_lock(mem->shards[i].mtx);
+		size += mem->shards[i].used;
+		vtm_mutex_unlock(mem->shards[i].mtx);
+	}
+
+	return size;
+}
+
 void vtm_http_mem_lock(vtm_http_mem *mem, const char *key)
 {
 	vtm_mutex *mtx;
-	
-	vtm_mutex_lock(mem->mtx);
-	mtx = vtm_map_get_pointer_va(mem->mutexes, key);
+	struct vtm_http_mem_shard *shard;
+
+	shard = vtm_http_mem_shard_get(mem, key, NULL);
+
+	vtm_mutex_lock(shard->mtx);
+	mtx = vtm_map_get_pointer_va(shard->mutexes, key);
 	if (!mtx) {
 		mtx = vtm_mutex_new();
-		vtm_map_put_va(mem->mutexes, key);
+		if (mtx && vtm_map_put_va(shard->mutexes, key, mtx) != VTM_OK) {
+			vtm_mutex_free(mtx);
+			mtx = NULL;
+		}
 	}
+	vtm_mutex_unlock(shard->mtx);
+
+	VTM_ASSERT(mtx);
+
+	/* key mutexes live as long as the memory, wait without shard lock */
 	vtm_mutex_lock(mtx);
-	vtm_mutex_unlock(mem->mtx);
 }
 
 void vtm_http_mem_unlock(vtm_http_mem *mem, const char *key)
 {
 	vtm_mutex *mtx;
-	
-	vtm_mutex_lock(mem->mtx);
-	mtx = vtm_map_get_pointer_va(mem->mutexes, key);
+	struct vtm_http_mem_shard *shard;
+
+	shard = vtm_http_mem_shard_get(mem, key, NULL);
+
+	vtm_mutex_lock(shard->mtx);
+	mtx = vtm_map_get_pointer_va(shard->mutexes, key);
+	vtm_mutex_unlock(shard->mtx);
+
 	VTM_ASSERT(mtx);
 	vtm_mutex_unlock(mtx);
-	vtm_mutex_unlock(mem->mtx);
+}
+
+static int vtm_http_mem_shard_init(struct vtm_http_mem_shard *shard)
+{
+	shard->mtx = vtm_mutex_new();
+	if (!shard->mtx)
+		goto err_mtx;
+
+	shard->mutexes = vtm_map_new(VTM_ELEM_STRING, VTM_ELEM_POINTER, 16);
+	if (!shard->mutexes)
+		goto err_map;
+
+	shard->buckets = calloc(VTM_HTTP_MEM_INIT_BUCKETS, sizeof(struct vtm_http_mem_entry*));
+	if (!shard->buckets) {
+		vtm_err_oom();
+		goto err_buckets;
+	}
+
+	shard->bucket_count = VTM_HTTP_MEM_INIT_BUCKETS;
+	shard->count = 0;
+	shard->head = NULL;
+	shard->tail = NULL;
+	shard->used = 0;
+
+	return VTM_OK;
+
+err_buckets:
+	vtm_map_free(shard->mutexes);
+
+err_map:
+	vtm_mutex_free(shard->mtx);
+
+err_mtx:
+	return vtm_err_get_code();
+}
+
+static void vtm_http_mem_shard_release(struct vtm_http_mem_shard *shard)
+{
+	size_t i, count;
+	vtm_list *entries;
+	struct vtm_map_entry *mentry;
+	struct vtm_http_mem_entry *entry, *next;
+
+	/* pointer values should have been freed external */
+	for (i=0; i < shard->bucket_count; i++) {
+		for (entry = shard->buckets[i]; entry; entry = next) {
+			next = entry->bucket_next;
+			vtm_http_mem_entry_free(entry);
+		}
+	}
+	free(shard->buckets);
+
+	/* free auto created mutexes */
+	entries = vtm_map_entryset(shard->mutexes);
+	if (entries) {
+		count = vtm_list_size(entries);
+		for (i=0; i < count; i++) {
+			mentry = vtm_list_get_pointer(entries, i);
+			vtm_mutex_free(mentry->value.elem_pointer);
+		}
+		vtm_list_free(entries);
+	}
+
+	vtm_map_free(shard->mutexes);
+	vtm_mutex_free(shard->mtx);
+}
+
+static struct vtm_http_mem_shard* vtm_http_mem_shard_get(vtm_http_mem *mem, const char *key, uint32_t *hash)
+{
+	uint32_t h;
+
+	h = vtm_hash_str(key);
+	if (hash)
+		*hash = h;
+
+	return &mem->shards[h % mem->shard_count];
+}
+
+static struct vtm_http_mem_entry** vtm_http_mem_find(vtm_http_mem *mem, struct vtm_http_mem_shard *shard, const char *key, uint32_t hash)
+{
+	struct vtm_http_mem_entry **pos;
+
+	/* low bits select the shard */
+	pos = &shard->buckets[(hash / mem->shard_count) & (shard->bucket_count - 1)];
+	for (; *pos; pos = &(*pos)->bucket_next) {
+		if ((*pos)->hash == hash && strcmp((*pos)->key, key) == 0)
+			return pos;
+	}
+
+	return pos;
+}
+
+static struct vtm_http_mem_entry* vtm_http_mem_lookup(vtm_http_mem *mem, struct vtm_http_mem_shard *shard, const char *key, uint32_t hash)
+{
+	struct vtm_http_mem_entry *entry;
+
+	entry = *vtm_http_mem_find(mem, shard, key, hash);
+	if (!entry)
+		return NULL;
+
+	/* expired entries are removed lazily */
+	if (entry->expires > 0 && entry->expires <= vtm_time_current_millis()) {
+		vtm_http_mem_remove_entry(mem, shard, entry);
+		return NULL;
+	}
+
+	return entry;
+}
+
+static int vtm_http_mem_insert(vtm_http_mem *mem, struct vtm_http_mem_shard *shard, struct vtm_http_mem_entry *entry)
+{
+	size_t size;
+	struct vtm_http_mem_entry **pos;
+
+	/* replace existing value */
+	pos = vtm_http_mem_find(mem, shard, entry->key, entry->hash);
+	if (*pos)
+		vtm_http_mem_remove_entry(mem, shard, *pos);
+
+	if (entry->copied) {
+		/* least recently used values make room */
+		size = vtm_http_mem_entry_size(entry);
+		while (mem->shard_max_size > 0 && shard->tail &&
+			shard->used + size > mem->shard_max_size) {
+			vtm_http_mem_remove_entry(mem, shard, shard->tail);
+		}
+
+		entry->prev = NULL;
+		entry->next = shard->head;
+		if (shard->head)
+			shard->head->prev = entry;
+		else
+			shard->tail = entry;
+		shard->head = entry;
+		shard->used += size;
+	}
+
+	if (shard->count >= shard->bucket_count)
+		vtm_http_mem_grow(mem, shard);
+
+	pos = vtm_http_mem_find(mem, shard, entry->key, entry->hash);
+	entry->bucket_next = NULL;
+	*pos = entry;
+	shard->count++;
+
+	return VTM_OK;
+}
+
+static void vtm_http_mem_grow(vtm_http_mem *mem, struct vtm_http_mem_shard *shard)
+{
+	size_t i, count, index;
+	struct vtm_http_mem_entry **buckets;
+	struct vtm_http_mem_entry *entry, *next;
+
+	count = shard->bucket_count << 1;
+	buckets = calloc(count, sizeof(struct vtm_http_mem_entry*));
+	if (!buckets)
+		return;
+
+	for (i=0; i < shard->bucket_count; i++) {
+		for (entry = shard->buckets[i]; entry; entry = next) {
+			next = entry->bucket_next;
+			index = (entry->hash / mem->shard_count) & (count - 1);
+			entry->bucket_next = buckets[index];
+			buckets[index] = entry;
+		}
+	}
+
+	free(shard->buckets);
+	shard->buckets = buckets;
+	shard->bucket_count = count;
+}
+
+static void vtm_http_mem_unlink(struct vtm_http_mem_shard *shard, struct vtm_http_mem_entry *entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		shard->head = entry->next;
+
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		shard->tail = entry->prev;
+}
+
+static void vtm_http_mem_remove_entry(vtm_http_mem *mem, struct vtm_http_mem_shard *shard, struct vtm_http_mem_entry *entry)
+{
+	struct vtm_http_mem_entry **pos;
+
+	pos = vtm_http_mem_find(mem, shard, entry->key, entry->hash);
+	VTM_ASSERT(*pos == entry);
+	*pos = entry->bucket_next;
+	shard->count--;
+
+	if (entry->copied) {
+		vtm_http_mem_unlink(shard, entry);
+		shard->used -= vtm_http_mem_entry_size(entry);
+	}
+
+	vtm_http_mem_entry_free(entry);
+}
+
+static size_t vtm_http_mem_entry_size(struct vtm_http_mem_entry *entry)
+{
+	return sizeof(*entry) + strlen(entry->key) + entry->len;
+}
+
+static void vtm_http_mem_entry_free(struct vtm_http_mem_entry *entry)
+{
+	if (entry->copied)
+		free(entry->val);
+	free(entry->key);
+	free(entry);
 }
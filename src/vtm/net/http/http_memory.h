@@ -6,12 +6,18 @@
  * @file http_memory.h
  *
  * @brief Global server memory
+ *
+ * The memory is shared by all workers of a server. Keys are distributed
+ * over independently locked shards, so that operations on unrelated keys
+ * do not block each other.
  */
 
 #ifndef VTM_NET_HTTP_HTTP_MEMORY_H_
 #define VTM_NET_HTTP_HTTP_MEMORY_H_
 
 #include <vtm/core/api.h>
+#include <vtm/core/buffer.h>
+#include <vtm/core/types.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -19,9 +25,30 @@ extern "C" {
 
 typedef struct vtm_http_mem vtm_http_mem;
 
+/** memory options, zero-initialized values select the defaults */
+struct vtm_http_mem_opts
+{
+	/** number of shards, default is 16 */
+	unsigned int   shards;
+
+	/**
+	 * Maximum number of bytes used by values stored with
+	 * vtm_http_mem_set() including their keys. When the limit is
+	 * reached, the least recently used values are evicted. Zero means
+	 * unlimited.
+	 */
+	size_t         max_size;
+
+	/** default time to live in milliseconds, zero means unlimited */
+	unsigned long  ttl;
+};
+
 /**
  * Stores a single value in the memory.
  *
+ * The pointer is stored as it is, it never expires and is not evicted.
+ * The caller remains responsible for releasing it.
+ *
  * @param mem the global memory
  * @param key the key under which the value is stored
  * @param val the value that is stored
@@ -33,9 +60,55 @@ VTM_API void vtm_http_mem_put(vtm_http_mem *mem, const char *key, void *val);
  *
  * @param mem the global memory
  * @param key the key for the value that should be retrieved
+ * @return the pointer stored with vtm_http_mem_put()
+ * @return NULL if no pointer is stored under the key
  */
 VTM_API void* vtm_http_mem_get(vtm_http_mem *mem, const char *key);
 
+/**
+ * Stores a copy of the given data.
+ *
+ * @param mem the global memory
+ * @param key the key under which the data is stored
+ * @param data the data that is copied
+ * @param len length of the data
+ * @param ttl time to live in milliseconds, zero selects the default
+ * @return VTM_OK if the data was stored
+ * @return VTM_E_MAX_REACHED if the data exceeds the size limit of a shard
+ * @return VTM_E_MALLOC if the memory could not be allocated
+ */
+VTM_API int vtm_http_mem_set(vtm_http_mem *mem, const char *key, const void *data, size_t len, unsigned long ttl);
+
+/**
+ * Appends a copy of stored data to the given buffer.
+ *
+ * @param mem the global memory
+ * @param key the key of the data
+ * @param buf the buffer where the data is appended
+ * @return VTM_OK if the data was copied
+ * @return VTM_E_NOT_FOUND if no data is stored under the key or it expired
+ * @return VTM_E_MALLOC if the buffer could not be enlarged
+ */
+VTM_API int vtm_http_mem_get_data(vtm_http_mem *mem, const char *key, struct vtm_buf *buf);
+
+/**
+ * Removes the value stored under the key.
+ *
+ * @param mem the global memory
+ * @param key the key that should be removed
+ * @return true if a value was removed
+ */
+VTM_API bool vtm_http_mem_remove(vtm_http_mem *mem, const char *key);
+
+/**
+ * Retrieves the number of bytes used by values stored with
+ * vtm_http_mem_set().
+ *
+ * @param mem the global memory
+ * @return the used bytes over all shards
+ */
+VTM_API size_t vtm_http_mem_size(vtm_http_mem *mem);
+
 /**
  * Acquire global lock for given key.
  *
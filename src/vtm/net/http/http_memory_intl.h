@@ -11,7 +11,7 @@
 extern "C" {
 #endif
 
-vtm_http_mem* vtm_http_mem_new(void);
+vtm_http_mem* vtm_http_mem_new(const struct vtm_http_mem_opts *opts);
 void vtm_http_mem_free(vtm_http_mem *mem);
 
 #ifdef __cplusplus
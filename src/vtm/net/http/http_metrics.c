@@ -0,0 +1,489 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include "http_metrics.h"
+
+#include <stdio.h> /* snprintf() */
+#include <stdlib.h> /* malloc(), calloc(), realloc(), free() */
+#include <string.h> /* memcpy(), memset() */
+#include <vtm/core/error.h>
+#include <vtm/core/lang.h>
+#include <vtm/core/macros.h>
+#include <vtm/core/string.h>
+#include <vtm/core/types.h>
+#include <vtm/net/http/http.h>
+#include <vtm/net/http/http_metrics_intl.h>
+#include <vtm/util/atomic.h>
+#include <vtm/util/mutex.h>
+#include <vtm/util/thread.h>
+#include <vtm/util/time.h>
+
+#define VTM_HTTP_METRICS_CLASSES   5
+#define VTM_HTTP_METRICS_CONTENT_TYPE  "text/plain; version=0.0.4; charset=utf-8"
+
+/* upper bounds of the latency buckets in microseconds */
+static const uint64_t vtm_http_metrics_bounds[] = {
+	100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000
+};
+
+#define VTM_HTTP_METRICS_BUCKETS   (VTM_ARRAY_LEN(vtm_http_metrics_bounds) + 1)
+
+struct vtm_http_metrics_slot
+{
+	uint64_t  requests;
+	uint64_t  classes[VTM_HTTP_METRICS_CLASSES];
+	uint64_t  buckets[VTM_HTTP_METRICS_BUCKETS];
+	uint64_t  latency_sum;
+	int64_t   in_flight;
+};
+
+struct vtm_http_metrics_shard
+{
+	unsigned long                  thread_id;
+	struct vtm_http_metrics_slot   *slots;
+	unsigned int                   slot_count;
+	struct vtm_http_metrics_shard  *next;
+};
+
+struct vtm_http_metrics_route
+{
+	char  *name;
+	int   method;
+};
+
+struct vtm_http_metrics
+{
+	int32_t                        serial;
+	vtm_mutex                      *mtx;
+
+	struct vtm_http_metrics_route  *routes;
+	unsigned int                   route_count;
+
+	struct vtm_http_metrics_shard  *shards;
+};
+
+struct vtm_http_metrics_rt
+{
+	struct vtm_http_route  base;
+	vtm_http_metrics       *metrics;
+};
+
+/* identifies metrics instances, so that a cached shard is never used after free */
+static VTM_ATOMIC_INT32_TYPE vtm_http_metrics_serial_next;
+
+/* shard of the current thread for the last used metrics */
+static VTM_THREAD_LOCAL int32_t vtm_http_metrics_tls_serial;
+static VTM_THREAD_LOCAL struct vtm_http_metrics_shard *vtm_http_metrics_tls_shard;
+
+/* forward declaration */
+static struct vtm_http_metrics_slot* vtm_http_metrics_get_slot(vtm_http_metrics *m, unsigned int id);
+static struct vtm_http_metrics_shard* vtm_http_metrics_get_shard(vtm_http_metrics *m);
+static int vtm_http_metrics_shard_grow(vtm_http_metrics *m, struct vtm_http_metrics_shard *shard);
+static void vtm_http_metrics_sum(vtm_http_metrics *m, unsigned int id, struct vtm_http_metrics_slot *sum);
+static void vtm_http_metrics_put_labels(struct vtm_buf *buf, struct vtm_http_metrics_route *rt);
+static int vtm_http_metrics_rt_handle(struct vtm_http_route *rt, struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res);
+static void vtm_http_metrics_rt_free(struct vtm_http_route *rt);
+
+vtm_http_metrics* vtm_http_metrics_new(void)
+{
+	vtm_http_metrics *m;
+
+	m = malloc(sizeof(*m));
+	if (!m) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	m->mtx = vtm_mutex_new();
+	if (!m->mtx) {
+		free(m);
+		return NULL;
+	}
+
+	m->serial = VTM_ATOMIC_ADD_INT32(&vtm_http_metrics_serial_next, 1);
+	m->routes = NULL;
+	m->route_count = 0;
+	m->shards = NULL;
+
+	return m;
+}
+
+void vtm_http_metrics_free(vtm_http_metrics *m)
+{
+	unsigned int i;
+	struct vtm_http_metrics_shard *shard, *next;
+
+	if (!m)
+		return;
+
+	for (shard = m->shards; shard; shard = next) {
+		next = shard->next;
+		free(shard->slots);
+		free(shard);
+	}
+
+	for (i=0; i < m->route_count; i++)
+		free(m->routes[i].name);
+
+	free(m->routes);
+	vtm_mutex_free(m->mtx);
+	free(m);
+}
+
+int vtm_http_metrics_register(vtm_http_metrics *m, int method, const char *route, unsigned int *id)
+{
+	int rc;
+	char *name;
+	struct vtm_http_metrics_route *routes;
+
+	name = vtm_str_copy(route);
+	if (!name)
+		return vtm_err_get_code();
+
+	vtm_mutex_lock(m->mtx);
+
+	routes = realloc(m->routes, sizeof(*routes) * (m->route_count + 1));
+	if (!routes) {
+		vtm_err_oom();
+		rc = vtm_err_get_code();
+		free(name);
+		goto unlock;
+	}
+
+	m->routes = routes;
+	m->routes[m->route_count].name = name;
+	m->routes[m->route_count].method = method;
+	*id = m->route_count++;
+	rc = VTM_OK;
+
+unlock:
+	vtm_mutex_unlock(m->mtx);
+
+	return rc;
+}
+
+uint64_t vtm_http_metrics_begin(vtm_http_metrics *m, unsigned int id)
+{
+	struct vtm_http_metrics_slot *slot;
+
+	slot = vtm_http_metrics_get_slot(m, id);
+	if (slot)
+		slot->in_flight++;
+
+	return vtm_time_current_micros();
+}
+
+void vtm_http_metrics_end(vtm_http_metrics *m, unsigned int id, uint64_t start, int status)
+{
+	size_t i;
+	uint64_t now, latency;
+	struct vtm_http_metrics_slot *slot;
+
+	now = vtm_time_current_micros();
+
+	slot = vtm_http_metrics_get_slot(m, id);
+	if (!slot)
+		return;
+
+	slot->in_flight--;
+
+	/* route did not handle the request */
+	if (status < 0)
+		return;
+
+	/* clock may have been adjusted */
+	latency = now > start ? now - start : 0;
+
+	for (i=0; i < VTM_ARRAY_LEN(vtm_http_metrics_bounds); i++) {
+		if (latency <= vtm_http_metrics_bounds[i])
+			break;
+	}
+
+	slot->requests++;
+	slot->buckets[i]++;
+	slot->latency_sum += latency;
+
+	if (status >= 100 && status < 600)
+		slot->classes[status / 100 - 1]++;
+}
+
+int vtm_http_metrics_render(vtm_http_metrics *m, struct vtm_buf *buf)
+{
+	size_t i;
+	unsigned int id;
+	uint64_t cumulative;
+	struct vtm_http_metrics_slot *sums;
+	struct vtm_http_metrics_route *rt;
+	char num[64];
+
+	vtm_mutex_lock(m->mtx);
+
+	/* one snapshot, so that all families agree */
+	sums = malloc(sizeof(*sums) * (m->route_count > 0 ? m->route_count : 1));
+	if (!sums) {
+		vtm_mutex_unlock(m->mtx);
+		vtm_err_oom();
+		return vtm_err_get_code();
+	}
+
+	for (id=0; id < m->route_count; id++)
+		vtm_http_metrics_sum(m, id, &sums[id]);
+
+	/* samples of a family must follow its HELP and TYPE lines */
+	vtm_buf_puts(buf, "# HELP vtm_http_requests_total Requests handled per route.\n");
+	vtm_buf_puts(buf, "# TYPE vtm_http_requests_total counter\n");
+
+	for (id=0; id < m->route_count; id++) {
+		vtm_buf_puts(buf, "vtm_http_requests_total");
+		vtm_http_metrics_put_labels(buf, &m->routes[id]);
+		vtm_buf_puts(buf, "} ");
+		snprintf(num, sizeof(num), "%llu\n", (unsigned long long) sums[id].requests);
+		vtm_buf_puts(buf, num);
+	}
+
+	vtm_buf_puts(buf, "# HELP vtm_http_responses_total Responses per route and status class.\n");
+	vtm_buf_puts(buf, "# TYPE vtm_http_responses_total counter\n");
+
+	for (id=0; id < m->route_count; id++) {
+		for (i=0; i < VTM_HTTP_METRICS_CLASSES; i++) {
+			vtm_buf_puts(buf, "vtm_http_responses_total");
+			vtm_http_metrics_put_labels(buf, &m->routes[id]);
+			snprintf(num, sizeof(num), ",code=\"%uxx\"} %llu\n",
+				(unsigned int) i + 1, (unsigned long long) sums[id].classes[i]);
+			vtm_buf_puts(buf, num);
+		}
+	}
+
+	vtm_buf_puts(buf, "# HELP vtm_http_requests_in_flight Requests currently handled per route.\n");
+	vtm_buf_puts(buf, "# TYPE vtm_http_requests_in_flight gauge\n");
+
+	for (id=0; id < m->route_count; id++) {
+		vtm_buf_puts(buf, "vtm_http_requests_in_flight");
+		vtm_http_metrics_put_labels(buf, &m->routes[id]);
+		snprintf(num, sizeof(num), "} %lld\n", (long long) sums[id].in_flight);
+		vtm_buf_puts(buf, num);
+	}
+
+	vtm_buf_puts(buf, "# HELP vtm_http_request_duration_seconds Request latency per route.\n");
+	vtm_buf_puts(buf, "# TYPE vtm_http_request_duration_seconds histogram\n");
+
+	for (id=0; id < m->route_count; id++) {
+		rt = &m->routes[id];
+
+		cumulative = 0;
+		for (i=0; i < VTM_HTTP_METRICS_BUCKETS; i++) {
+			cumulative += sums[id].buckets[i];
+			vtm_buf_puts(buf, "vtm_http_request_duration_seconds_bucket");
+			vtm_http_metrics_put_labels(buf, rt);
+			if (i < VTM_ARRAY_LEN(vtm_http_metrics_bounds))
+				snprintf(num, sizeof(num), ",le=\"%g\"} %llu\n",
+					vtm_http_metrics_bounds[i] / 1000000.0, (unsigned long long) cumulative);
+			else
+				snprintf(num, sizeof(num), ",le=\"+Inf\"} %llu\n", (unsigned long long) cumulative);
+			vtm_buf_puts(buf, num);
+		}
+
+		vtm_buf_puts(buf, "vtm_http_request_duration_seconds_sum");
+		vtm_http_metrics_put_labels(buf, rt);
+		snprintf(num, sizeof(num), "} %.6f\n", sums[id].latency_sum / 1000000.0);
+		vtm_buf_puts(buf, num);
+
+		vtm_buf_puts(buf, "vtm_http_request_duration_seconds_count");
+		vtm_http_metrics_put_labels(buf, rt);
+		snprintf(num, sizeof(num), "} %llu\n", (unsigned long long) cumulative);
+		vtm_buf_puts(buf, num);
+	}
+
+	vtm_mutex_unlock(m->mtx);
+
+	free(sums);
+
+	return buf->err;
+}
+
+struct vtm_http_route* vtm_http_metrics_rt_new(vtm_http_metrics *m)
+{
+	struct vtm_http_metrics_rt *rt;
+
+	rt = malloc(sizeof(*rt));
+	if (!rt) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	rt->base.url_path = NULL;
+	rt->base.fn_rt_handle = vtm_http_metrics_rt_handle;
+	rt->base.fn_rt_free = vtm_http_metrics_rt_free;
+	rt->metrics = m;
+
+	return &rt->base;
+}
+
+static struct vtm_http_metrics_slot* vtm_http_metrics_get_slot(vtm_http_metrics *m, unsigned int id)
+{
+	struct vtm_http_metrics_shard *shard;
+
+	/* fast path, shard of this thread was used before */
+	if (vtm_http_metrics_tls_serial == m->serial) {
+		shard = vtm_http_metrics_tls_shard;
+	}
+	else {
+		shard = vtm_http_metrics_get_shard(m);
+		if (!shard)
+			return NULL;
+	}
+
+	/* route was registered after the shard was created */
+	if (id >= shard->slot_count && vtm_http_metrics_shard_grow(m, shard) != VTM_OK)
+		return NULL;
+
+	return &shard->slots[id];
+}
+
+static struct vtm_http_metrics_shard* vtm_http_metrics_get_shard(vtm_http_metrics *m)
+{
+	unsigned long thread_id;
+	struct vtm_http_metrics_shard *shard;
+
+	thread_id = vtm_thread_get_current_id();
+
+	vtm_mutex_lock(m->mtx);
+
+	for (shard = m->shards; shard; shard = shard->next) {
+		if (shard->thread_id == thread_id)
+			goto found;
+	}
+
+	shard = calloc(1, sizeof(*shard));
+	if (!shard) {
+		vtm_err_oom();
+		goto unlock;
+	}
+
+	shard->thread_id = thread_id;
+	shard->next = m->shards;
+	m->shards = shard;
+
+found:
+	vtm_http_metrics_tls_serial = m->serial;
+	vtm_http_metrics_tls_shard = shard;
+
+unlock:
+	vtm_mutex_unlock(m->mtx);
+
+	return shard;
+}
+
+static int vtm_http_metrics_shard_grow(vtm_http_metrics *m, struct vtm_http_metrics_shard *shard)
+{
+	int rc;
+	struct vtm_http_metrics_slot *slots;
+
+	/* only the owning thread grows its shard, readers hold the lock */
+	vtm_mutex_lock(m->mtx);
+
+	slots = calloc(m->route_count, sizeof(*slots));
+	if (!slots) {
+		vtm_err_oom();
+		rc = vtm_err_get_code();
+		goto unlock;
+	}
+
+	if (shard->slot_count > 0)
+		memcpy(slots, shard->slots, sizeof(*slots) * shard->slot_count);
+
+	free(shard->slots);
+	shard->slots = slots;
+	shard->slot_count = m->route_count;
+	rc = VTM_OK;
+
+unlock:
+	vtm_mutex_unlock(m->mtx);
+
+	return rc;
+}
+
+static void vtm_http_metrics_sum(vtm_http_metrics *m, unsigned int id, struct vtm_http_metrics_slot *sum)
+{
+	size_t i;
+	struct vtm_http_metrics_shard *shard;
+	struct vtm_http_metrics_slot *slot;
+
+	/* caller must hold the lock */
+	memset(sum, 0, sizeof(*sum));
+
+	for (shard = m->shards; shard; shard = shard->next) {
+		if (id >= shard->slot_count)
+			continue;
+
+		slot = &shard->slots[id];
+		sum->requests += slot->requests;
+		sum->latency_sum += slot->latency_sum;
+		sum->in_flight += slot->in_flight;
+
+		for (i=0; i < VTM_HTTP_METRICS_CLASSES; i++)
+			sum->classes[i] += slot->classes[i];
+
+		for (i=0; i < VTM_HTTP_METRICS_BUCKETS; i++)
+			sum->buckets[i] += slot->buckets[i];
+	}
+}
+
+static void vtm_http_metrics_put_labels(struct vtm_buf *buf, struct vtm_http_metrics_route *rt)
+{
+	const char *c;
+
+	vtm_buf_puts(buf, "{method=\"");
+	vtm_buf_puts(buf, rt->method < 0 ? "any" : VTM_HTTP_METHODS[rt->method]);
+	vtm_buf_puts(buf, "\",route=\"");
+
+	for (c = rt->name; *c; c++) {
+		switch (*c) {
+			case '\\':
+			case '"':
+				vtm_buf_putc(buf, '\\');
+				vtm_buf_putc(buf, *c);
+				break;
+
+			case '\n':
+				vtm_buf_puts(buf, "\\n");
+				break;
+
+			default:
+				vtm_buf_putc(buf, *c);
+				break;
+		}
+	}
+
+	vtm_buf_putc(buf, '"');
+}
+
+static int vtm_http_metrics_rt_handle(struct vtm_http_route *rt, struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
+{
+	int rc;
+	struct vtm_buf buf;
+
+	vtm_buf_init(&buf, VTM_BYTEORDER_LE);
+
+	rc = vtm_http_metrics_render(((struct vtm_http_metrics_rt*) rt)->metrics, &buf);
+	if (rc != VTM_OK)
+		goto end;
+
+	rc = vtm_http_res_begin(res, VTM_HTTP_RES_MODE_FIXED, VTM_HTTP_200_OK);
+	if (rc != VTM_OK)
+		goto end;
+
+	vtm_http_res_header(res, VTM_HTTP_HEADER_CONTENT_TYPE, VTM_HTTP_METRICS_CONTENT_TYPE);
+	vtm_http_res_body_raw(res, (const char*) buf.data, buf.used);
+	rc = vtm_http_res_end(res);
+
+end:
+	vtm_buf_release(&buf);
+	return rc;
+}
+
+static void vtm_http_metrics_rt_free(struct vtm_http_route *rt)
+{
+	free(rt);
+}
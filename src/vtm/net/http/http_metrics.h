@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+/**
+ * @file http_metrics.h
+ *
+ * @brief Per-route request metrics
+ *
+ * Metrics are collected by a router after vtm_http_router_set_metrics()
+ * was called. For every route the number of handled requests, the
+ * responses per status class, the requests currently in flight and a
+ * latency histogram are recorded. The latency is measured from the
+ * dispatch of the parsed request until the handler returned, which
+ * includes writing the response to the socket unless the socket would
+ * block.
+ *
+ * Every worker thread records into its own shard without locking, the
+ * shards are only summed up when the metrics are rendered.
+ */
+
+#ifndef VTM_NET_HTTP_HTTP_METRICS_H_
+#define VTM_NET_HTTP_HTTP_METRICS_H_
+
+#include <vtm/core/api.h>
+#include <vtm/core/buffer.h>
+#include <vtm/net/http/http_route.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct vtm_http_metrics vtm_http_metrics;
+
+/**
+ * Creates a new metrics collection.
+ *
+ * @return the created metrics
+ * @return NULL if an error occured
+ */
+VTM_API vtm_http_metrics* vtm_http_metrics_new(void);
+
+/**
+ * Releases the metrics and all allocated resources.
+ *
+ * The metrics must not be used by any router or route anymore.
+ *
+ * @param m the metrics that should be released
+ */
+VTM_API void vtm_http_metrics_free(vtm_http_metrics *m);
+
+/**
+ * Renders the metrics in the Prometheus text exposition format.
+ *
+ * The values are read while the workers keep recording, so a rendered
+ * snapshot may miss requests that are just being recorded.
+ *
+ * @param m the metrics
+ * @param buf the buffer where the text is appended
+ * @return VTM_OK if the metrics were rendered
+ * @return VTM_E_MALLOC if the buffer could not be enlarged
+ */
+VTM_API int vtm_http_metrics_render(vtm_http_metrics *m, struct vtm_buf *buf);
+
+/**
+ * Creates a route that serves the rendered metrics.
+ *
+ * The route does not take over the metrics, they must be released
+ * after the router.
+ *
+ * @param m the metrics that should be served
+ * @return http route if call succeeded
+ * @return NULL if an error occured
+ */
+VTM_API struct vtm_http_route* vtm_http_metrics_rt_new(vtm_http_metrics *m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_NET_HTTP_HTTP_METRICS_H_ */
@@ -0,0 +1,24 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#ifndef VTM_NET_HTTP_HTTP_METRICS_INTL_H_
+#define VTM_NET_HTTP_HTTP_METRICS_INTL_H_
+
+#include <vtm/core/types.h>
+#include <vtm/net/http/http_metrics.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int vtm_http_metrics_register(vtm_http_metrics *m, int method, const char *route, unsigned int *id);
+
+uint64_t vtm_http_metrics_begin(vtm_http_metrics *m, unsigned int id);
+void vtm_http_metrics_end(vtm_http_metrics *m, unsigned int id, uint64_t start, int status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_NET_HTTP_HTTP_METRICS_INTL_H_ */
@@ -27,6 +27,7 @@ void vtm_http_parser_init(struct vtm_http_parser *par, enum vtm_http_parser_mode
 
 	par->max_header_size = VTM_HTTP_DEF_MAX_HEADER_SIZE;
 	par->max_body_size = VTM_HTTP_DEF_MAX_BODY_SIZE;
+	par->stream_body = false;
 
 	vtm_http_parser_reset(par);
 }
@@ -74,6 +75,7 @@ void vtm_http_parser_reset(struct vtm_http_parser *par)
 	par->chunk_dst = 0;
 	par->chunk_begin = 0;
 	par->chunk_size = 0;
+	par->body_left = 0;
 }
 
 enum vtm_net_recv_stat vtm_http_parser_run(struct vtm_http_parser *par, struct vtm_buf *buf)
@@ -85,6 +87,10 @@ enum vtm_net_recv_stat vtm_http_parser_run(struct vtm_http_parser *par, struct v
 	const char *val;
 	bool found;
 
+	/* body is consumed with vtm_http_parser_run_body() */
+	if (VTM_HTTP_PARSER_IN_STREAM(par))
+		return VTM_NET_RECV_STAT_COMPLETE;
+
 	oldstate = par->state;
 	n = VTM_BUF_GET_AVAIL_TOTAL(buf);
 
@@ -406,6 +412,15 @@ eval:
 			case VTM_HTTP_PARSE_BODY:
 				par->body_begin = buf->read;
 
+				/* 1xx, 204 and 304 responses have no body */
+				if (par->mode == VTM_HTTP_PM_RESPONSE &&
+					(par->res_status_code < 200 ||
+					 par->res_status_code == 204 ||
+					 par->res_status_code == VTM_HTTP_304_NOT_MODIFIED)) {
+					par->state = VTM_HTTP_PARSE_COMPLETE;
+					goto eval;
+				}
+
 				if (par->headers) {
 					/* Transfer-Encoding given? */
 					val = vtm_dataset_get_string(par->headers,
@@ -413,6 +428,11 @@ eval:
 
 					if (val && vtm_str_list_contains(val, ",",
 							VTM_HTTP_VALUE_CHUNKED, true)) {
+						if (par->stream_body) {
+							par->state_chars = 0;
+							par->state = VTM_HTTP_PARSE_STREAM_CHUNK_SIZE;
+							return VTM_NET_RECV_STAT_COMPLETE;
+						}
 						par->state = VTM_HTTP_PARSE_BODY_CHUNKED;
 						continue;
 					}
@@ -422,6 +442,11 @@ eval:
 						 VTM_HTTP_HEADER_CONTENT_LENGTH)) {
 						par->body_len = vtm_dataset_get_uint64(par->headers,
 							VTM_HTTP_HEADER_CONTENT_LENGTH);
+						if (par->stream_body && par->body_len > 0) {
+							par->body_left = par->body_len;
+							par->state = VTM_HTTP_PARSE_STREAM_FIXEDLENGTH;
+							return VTM_NET_RECV_STAT_COMPLETE;
+						}
 						par->state = VTM_HTTP_PARSE_BODY_FIXEDLENGTH;
 						goto eval;
 					}
@@ -446,7 +471,7 @@ eval:
 				return VTM_NET_RECV_STAT_AGAIN;
 
 			case VTM_HTTP_PARSE_BODY_FIXEDLENGTH:
-				if (par->state_chars < par->body_len)
+				if (buf->read - par->body_begin < par->body_len)
 					continue;
 				par->state = VTM_HTTP_PARSE_COMPLETE;
 				goto eval;
@@ -519,6 +544,17 @@ eval:
 				par->state = VTM_HTTP_PARSE_BODY_CHUNKED;
 				break;
 
+			case VTM_HTTP_PARSE_STREAM_FIXEDLENGTH:
+			case VTM_HTTP_PARSE_STREAM_CHUNK_SIZE:
+			case VTM_HTTP_PARSE_STREAM_CHUNK_EXT:
+			case VTM_HTTP_PARSE_STREAM_CHUNK_SIZE_LF:
+			case VTM_HTTP_PARSE_STREAM_CHUNK_CONTENT:
+			case VTM_HTTP_PARSE_STREAM_CHUNK_END_CR:
+			case VTM_HTTP_PARSE_STREAM_CHUNK_END_LF:
+			case VTM_HTTP_PARSE_STREAM_TRAILER:
+				/* checked before loop */
+				return VTM_NET_RECV_STAT_COMPLETE;
+
 			case VTM_HTTP_PARSE_COMPLETE:
 				VTM_HTTP_PARSER_MARK_BODY(par, buf);
 				return VTM_NET_RECV_STAT_COMPLETE;
@@ -527,6 +563,142 @@ eval:
 	return VTM_NET_RECV_STAT_AGAIN;
 }
 
+enum vtm_net_recv_stat vtm_http_parser_run_body(struct vtm_http_parser *par, struct vtm_buf *buf, const void **data, size_t *len)
+{
+	char c;
+	int digit;
+	size_t n;
+
+	*data = NULL;
+	*len = 0;
+
+	while (true) {
+		switch (par->state) {
+			case VTM_HTTP_PARSE_STREAM_FIXEDLENGTH:
+			case VTM_HTTP_PARSE_STREAM_CHUNK_CONTENT:
+				/* hand out as much content as available */
+				n = VTM_BUF_GET_AVAIL_TOTAL(buf);
+				if (n > par->body_left)
+					n = (size_t) par->body_left;
+
+				*data = buf->data + buf->read;
+				*len = n;
+				buf->read += n;
+				par->body_left -= n;
+
+				if (par->body_left > 0)
+					return VTM_NET_RECV_STAT_AGAIN;
+
+				if (par->state == VTM_HTTP_PARSE_STREAM_FIXEDLENGTH) {
+					par->state = VTM_HTTP_PARSE_COMPLETE;
+					return VTM_NET_RECV_STAT_COMPLETE;
+				}
+
+				par->state = VTM_HTTP_PARSE_STREAM_CHUNK_END_CR;
+				if (n > 0)
+					return VTM_NET_RECV_STAT_AGAIN;
+				continue;
+
+			case VTM_HTTP_PARSE_COMPLETE:
+				return VTM_NET_RECV_STAT_COMPLETE;
+
+			default:
+				break;
+		}
+
+		/* chunk framing, processed per character */
+		if (VTM_BUF_GET_AVAIL_TOTAL(buf) == 0)
+			return VTM_NET_RECV_STAT_AGAIN;
+
+		c = VTM_BUF_GETC(buf);
+		par->state_chars++;
+
+		switch (par->state) {
+			case VTM_HTTP_PARSE_STREAM_CHUNK_SIZE:
+				if (c >= '0' && c <= '9') {
+					digit = c - '0';
+				}
+				else if (c >= 'A' && c <= 'F') {
+					digit = c - 'A' + 10;
+				}
+				else if (c >= 'a' && c <= 'f') {
+					digit = c - 'a' + 10;
+				}
+				else if (par->state_chars > 1 && (c == ';' || c == '\r')) {
+					par->state = (c == ';')
+						? VTM_HTTP_PARSE_STREAM_CHUNK_EXT
+						: VTM_HTTP_PARSE_STREAM_CHUNK_SIZE_LF;
+					break;
+				}
+				else {
+					return VTM_NET_RECV_STAT_INVALID;
+				}
+
+				if (par->chunk_size > (SIZE_MAX >> 4))
+					return VTM_NET_RECV_STAT_INVALID;
+				par->chunk_size = (par->chunk_size << 4) + digit;
+				break;
+
+			case VTM_HTTP_PARSE_STREAM_CHUNK_EXT:
+				/* extensions are ignored */
+				if (c == '\r')
+					par->state = VTM_HTTP_PARSE_STREAM_CHUNK_SIZE_LF;
+				else if (par->state_chars > par->max_header_size)
+					return VTM_NET_RECV_STAT_INVALID;
+				break;
+
+			case VTM_HTTP_PARSE_STREAM_CHUNK_SIZE_LF:
+				if (VTM_UNLIKELY(c != '\n'))
+					return VTM_NET_RECV_STAT_INVALID;
+
+				par->state_chars = 0;
+				if (par->chunk_size == 0) {
+					par->state = VTM_HTTP_PARSE_STREAM_TRAILER;
+					break;
+				}
+
+				par->body_len += par->chunk_size;
+				par->body_left = par->chunk_size;
+				par->state = VTM_HTTP_PARSE_STREAM_CHUNK_CONTENT;
+				break;
+
+			case VTM_HTTP_PARSE_STREAM_CHUNK_END_CR:
+				if (VTM_UNLIKELY(c != '\r'))
+					return VTM_NET_RECV_STAT_INVALID;
+				par->state = VTM_HTTP_PARSE_STREAM_CHUNK_END_LF;
+				break;
+
+			case VTM_HTTP_PARSE_STREAM_CHUNK_END_LF:
+				if (VTM_UNLIKELY(c != '\n'))
+					return VTM_NET_RECV_STAT_INVALID;
+				par->chunk_size = 0;
+				par->state_chars = 0;
+				par->state = VTM_HTTP_PARSE_STREAM_CHUNK_SIZE;
+				break;
+
+			case VTM_HTTP_PARSE_STREAM_TRAILER:
+				/* trailer fields are skipped until the empty line */
+				if (c == '\n') {
+					if (par->chunk_size == 0) {
+						par->state = VTM_HTTP_PARSE_COMPLETE;
+						return VTM_NET_RECV_STAT_COMPLETE;
+					}
+					par->chunk_size = 0;
+				}
+				else if (c != '\r') {
+					par->chunk_size++;
+				}
+
+				if (par->state_chars > par->max_header_size)
+					return VTM_NET_RECV_STAT_INVALID;
+				break;
+
+			default:
+				return VTM_NET_RECV_STAT_INVALID;
+		}
+	}
+}
+
 static VTM_INLINE bool vtm_http_parser_isspace(char c)
 {
 	switch (c) {
@@ -66,9 +66,22 @@ enum vtm_http_parser_state
 	VTM_HTTP_PARSE_BODY_CHUNK_SIZE_LF,
 	VTM_HTTP_PARSE_BODY_CHUNK_CONTENT,
 	VTM_HTTP_PARSE_BODY_CHUNK_END_LF,
+	VTM_HTTP_PARSE_STREAM_FIXEDLENGTH,
+	VTM_HTTP_PARSE_STREAM_CHUNK_SIZE,
+	VTM_HTTP_PARSE_STREAM_CHUNK_EXT,
+	VTM_HTTP_PARSE_STREAM_CHUNK_SIZE_LF,
+	VTM_HTTP_PARSE_STREAM_CHUNK_CONTENT,
+	VTM_HTTP_PARSE_STREAM_CHUNK_END_CR,
+	VTM_HTTP_PARSE_STREAM_CHUNK_END_LF,
+	VTM_HTTP_PARSE_STREAM_TRAILER,
 	VTM_HTTP_PARSE_COMPLETE
 };
 
+/** Checks if the parser is positioned inside a streamed body */
+#define VTM_HTTP_PARSER_IN_STREAM(PAR)                   \
+	((PAR)->state >= VTM_HTTP_PARSE_STREAM_FIXEDLENGTH && \
+	 (PAR)->state < VTM_HTTP_PARSE_COMPLETE)
+
 struct vtm_http_parser
 {
 	enum vtm_http_parser_mode    mode;
@@ -78,6 +91,9 @@ struct vtm_http_parser
 	size_t                       max_header_size;
 	size_t                       max_body_size;
 
+	/* deliver body in fragments, see vtm_http_parser_run_body() */
+	bool                         stream_body;
+
 	/* request fields */
 	enum vtm_http_method         req_method;
 	const char                  *req_path;
@@ -111,6 +127,7 @@ struct vtm_http_parser
 	size_t                       chunk_dst;
 	size_t                       chunk_begin;
 	size_t                       chunk_size;
+	uint64_t                     body_left;
 };
 
 /**
@@ -153,6 +170,32 @@ VTM_API void vtm_http_parser_reset(struct vtm_http_parser *par);
  */
 VTM_API enum vtm_net_recv_stat vtm_http_parser_run(struct vtm_http_parser *par, struct vtm_buf *buf);
 
+/**
+ * Decodes the next fragment of a streamed body.
+ *
+ * If stream_body is set, vtm_http_parser_run() returns
+ * VTM_NET_RECV_STAT_COMPLETE as soon as the headers of a message with
+ * a fixed length or chunked body are parsed and VTM_HTTP_PARSER_IN_STREAM()
+ * becomes true. The body must then be consumed with this function.
+ *
+ * The returned fragment points directly into the input buffer and is
+ * only valid until the buffer is modified. All input that was consumed,
+ * including the chunk framing, is marked as processed, so that the caller
+ * can discard it and keep the buffer small. The max_body_size limit
+ * does not apply to streamed bodies.
+ *
+ * @param par the parser
+ * @param buf the input buffer
+ * @param[out] data begin of decoded body data
+ * @param[out] len length of decoded body data, may be zero
+ * @return VTM_NET_RECV_STAT_COMPLETE if the body is complete, the final
+ *         fragment is returned with it
+ * @return VTM_NET_RECV_STAT_AGAIN if the body continues, when len is zero
+ *         more input data is needed
+ * @return VTM_NET_RECV_STAT_INVALID if the chunk framing is invalid
+ */
+VTM_API enum vtm_net_recv_stat vtm_http_parser_run_body(struct vtm_http_parser *par, struct vtm_buf *buf, const void **data, size_t *len);
+
 #ifdef __cplusplus
 }
 #endif
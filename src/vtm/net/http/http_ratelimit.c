@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include "http_ratelimit.h"
+
+#include <stdlib.h> /* malloc(), calloc(), free() */
+#include <string.h> /* memcmp(), memcpy() */
+#include <vtm/core/error.h>
+#include <vtm/core/format.h>
+#include <vtm/core/hash.h>
+#include <vtm/net/socket.h>
+#include <vtm/net/socket_addr.h>
+#include <vtm/net/http/http.h>
+#include <vtm/net/http/http_connection_base_intl.h>
+#include <vtm/util/spinlock.h>
+#include <vtm/util/time.h>
+
+#define VTM_HTTP_RATELIMIT_DEF_CLIENTS   16384
+#define VTM_HTTP_RATELIMIT_DEF_SHARDS    16
+#define VTM_HTTP_RATELIMIT_WAYS          8
+#define VTM_HTTP_RATELIMIT_CACHE_LINE    64
+
+struct vtm_http_ratelimit_entry
+{
+	unsigned char  ip[VTM_SOCK_ADDR_IP_LEN];
+	uint64_t       last;    /* microseconds, zero if the slot is free */
+	double         tokens;
+};
+
+struct vtm_http_ratelimit_shard
+{
+	struct vtm_spinlock              lock;
+	struct vtm_http_ratelimit_entry  *entries;
+	char                             pad[VTM_HTTP_RATELIMIT_CACHE_LINE];
+};
+
+struct vtm_http_ratelimit
+{
+	double                           rate;
+	double                           burst;
+	unsigned int                     shard_count;
+	size_t                           set_count;
+	struct vtm_http_ratelimit_shard  *shards;
+};
+
+struct vtm_http_ratelimit_rt
+{
+	struct vtm_http_route  base;
+	struct vtm_http_route  *rt;
+	vtm_http_ratelimit     *rl;
+};
+
+/* forward declaration */
+static struct vtm_http_ratelimit_entry* vtm_http_ratelimit_lookup(vtm_http_ratelimit *rl, struct vtm_http_ratelimit_entry *set, const unsigned char *ip, uint64_t now);
+static int vtm_http_ratelimit_reject(struct vtm_http_req *req, vtm_http_res *res, unsigned long retry_after);
+static int vtm_http_ratelimit_rt_handle(struct vtm_http_route *rt, struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res);
+static void vtm_http_ratelimit_rt_free(struct vtm_http_route *rt);
+
+vtm_http_ratelimit* vtm_http_ratelimit_new(const struct vtm_http_ratelimit_opts *opts)
+{
+	vtm_http_ratelimit *rl;
+	size_t clients;
+	unsigned int i;
+
+	if (!(opts->rate > 0)) {
+		vtm_err_set(VTM_E_INVALID_ARG);
+		return NULL;
+	}
+
+	rl = malloc(sizeof(*rl));
+	if (!rl) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	rl->rate = opts->rate;
+	rl->burst = opts->burst > 0 ? opts->burst : opts->rate;
+	if (rl->burst < 1)
+		rl->burst = 1;
+
+	rl->shard_count = opts->shards > 0 ? opts->shards : VTM_HTTP_RATELIMIT_DEF_SHARDS;
+	clients = opts->clients > 0 ? opts->clients : VTM_HTTP_RATELIMIT_DEF_CLIENTS;
+
+	rl->set_count = clients / rl->shard_count / VTM_HTTP_RATELIMIT_WAYS;
+	if (rl->set_count == 0)
+		rl->set_count = 1;
+
+	rl->shards = calloc(rl->shard_count, sizeof(struct vtm_http_ratelimit_shard));
+	if (!rl->shards) {
+		vtm_err_oom();
+		goto err_shards;
+	}
+
+	for (i=0; i < rl->shard_count; i++) {
+		vtm_spinlock_init(&rl->shards[i].lock);
+		rl->shards[i].entries = calloc(rl->set_count * VTM_HTTP_RATELIMIT_WAYS,
+			sizeof(struct vtm_http_ratelimit_entry));
+		if (!rl->shards[i].entries) {
+			vtm_err_oom();
+			goto err_entries;
+		}
+	}
+
+	return rl;
+
+err_entries:
+	while (i-- > 0)
+		free(rl->shards[i].entries);
+	free(rl->shards);
+
+err_shards:
+	free(rl);
+	return NULL;
+}
+
+void vtm_http_ratelimit_free(vtm_http_ratelimit *rl)
+{
+	unsigned int i;
+
+	if (!rl)
+		return;
+
+	for (i=0; i < rl->shard_count; i++)
+		free(rl->shards[i].entries);
+
+	free(rl->shards);
+	free(rl);
+}
+
+bool vtm_http_ratelimit_take(vtm_http_ratelimit *rl, const unsigned char *ip, unsigned long *retry_after)
+{
+	uint32_t hash;
+	uint64_t now;
+	double wait;
+	bool result;
+	struct vtm_http_ratelimit_shard *shard;
+	struct vtm_http_ratelimit_entry *entry;
+
+	hash = vtm_hash_mem(ip, VTM_SOCK_ADDR_IP_LEN);
+	shard = &rl->shards[hash % rl->shard_count];
+	now = vtm_time_current_micros();
+
+	vtm_spinlock_lock(&shard->lock);
+
+	entry = vtm_http_ratelimit_lookup(rl,
+		shard->entries + ((hash / rl->shard_count) % rl->set_count) * VTM_HTTP_RATELIMIT_WAYS,
+		ip, now);
+
+	/* refill, clock may go backwards */
+	if (now > entry->last) {
+		entry->tokens += (now - entry->last) * rl->rate / 1000000.0;
+		if (entry->tokens > rl->burst)
+			entry->tokens = rl->burst;
+		entry->last = now;
+	}
+
+	result = entry->tokens >= 1;
+	if (result) {
+		entry->tokens -= 1;
+	}
+	else if (retry_after) {
+		wait = (1 - entry->tokens) / rl->rate;
+		*retry_after = (unsigned long) wait;
+		if (*retry_after < wait || *retry_after == 0)
+			(*retry_after)++;
+	}
+
+	vtm_spinlock_unlock(&shard->lock);
+
+	return result;
+}
+
+bool vtm_http_ratelimit_allow(vtm_http_ratelimit *rl, struct vtm_http_req *req, vtm_http_res *res)
+{
+	struct vtm_socket_saddr saddr;
+	unsigned char ip[VTM_SOCK_ADDR_IP_LEN];
+	unsigned long retry_after;
+
+	/* requests with unknown origin are not limited */
+	if (vtm_socket_get_remote_addr(((struct vtm_http_con_base*) req->con)->sock, &saddr) != VTM_OK)
+		return true;
+
+	if (vtm_socket_os_addr_get_ip(&saddr, ip) != VTM_OK)
+		return true;
+
+	if (vtm_http_ratelimit_take(rl, ip, &retry_after))
+		return true;
+
+	vtm_http_ratelimit_reject(req, res, retry_after);
+
+	return false;
+}
+
+struct vtm_http_route* vtm_http_ratelimit_rt_new(vtm_http_ratelimit *rl, struct vtm_http_route *rt)
+{
+	struct vtm_http_ratelimit_rt *lrt;
+
+	lrt = malloc(sizeof(*lrt));
+	if (!lrt) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	lrt->base.url_path = NULL;
+	lrt->base.fn_rt_handle = vtm_http_ratelimit_rt_handle;
+	lrt->base.fn_rt_free = vtm_http_ratelimit_rt_free;
+
+	lrt->rt = rt;
+	lrt->rl = rl;
+
+	return &lrt->base;
+}
+
+static struct vtm_http_ratelimit_entry* vtm_http_ratelimit_lookup(vtm_http_ratelimit *rl, struct vtm_http_ratelimit_entry *set, const unsigned char *ip, uint64_t now)
+{
+	unsigned int i;
+	struct vtm_http_ratelimit_entry *victim;
+
+	victim = set;
+	for (i=0; i < VTM_HTTP_RATELIMIT_WAYS; i++) {
+		if (set[i].last != 0 && memcmp(set[i].ip, ip, VTM_SOCK_ADDR_IP_LEN) == 0)
+			return &set[i];
+
+		/* free slots have the lowest timestamp */
+		if (set[i].last < victim->last)
+			victim = &set[i];
+	}
+
+	/* new client replaces the least recently seen one */
+	memcpy(victim->ip, ip, VTM_SOCK_ADDR_IP_LEN);
+	victim->last = now;
+	victim->tokens = rl->burst;
+
+	return victim;
+}
+
+static int vtm_http_ratelimit_reject(struct vtm_http_req *req, vtm_http_res *res, unsigned long retry_after)
+{
+	int rc;
+	unsigned int len;
+	char buf[VTM_FMT_CHARS_INT64 + 1];
+
+	rc = vtm_http_res_begin(res, VTM_HTTP_RES_MODE_FIXED, VTM_HTTP_429_TOO_MANY_REQUESTS);
+	if (rc != VTM_OK)
+		return rc;
+
+	len = vtm_fmt_uint64(buf, retry_after);
+	buf[len] = '\0';
+	vtm_http_res_header(res, VTM_HTTP_HEADER_RETRY_AFTER, buf);
+
+	/* the body of a streamed request is not read */
+	if (req->streamed)
+		vtm_http_res_set_action(res, VTM_HTTP_RES_ACT_CLOSE_CON, NULL);
+
+	return vtm_http_res_end(res);
+}
+
+static int vtm_http_ratelimit_rt_handle(struct vtm_http_route *rt, struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
+{
+	struct vtm_http_ratelimit_rt *lrt;
+
+	lrt = (struct vtm_http_ratelimit_rt*) rt;
+
+	/* wrapped route sees the path it is bound to */
+	lrt->rt->url_path = lrt->base.url_path;
+
+	if (!vtm_http_ratelimit_allow(lrt->rl, req, res))
+		return VTM_OK;
+
+	return lrt->rt->fn_rt_handle(lrt->rt, ctx, req, res);
+}
+
+static void vtm_http_ratelimit_rt_free(struct vtm_http_route *rt)
+{
+	struct vtm_http_ratelimit_rt *lrt;
+
+	lrt = (struct vtm_http_ratelimit_rt*) rt;
+
+	lrt->rt->fn_rt_free(lrt->rt);
+	free(lrt);
+}
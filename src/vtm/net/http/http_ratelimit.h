@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+/**
+ * @file http_ratelimit.h
+ *
+ * @brief Per-client request rate limiting
+ *
+ * Every remote IP address gets a token bucket that is refilled with a
+ * constant rate up to its burst size, each request takes one token.
+ *
+ * The buckets are kept in a hash table of fixed size that is split into
+ * independently locked shards. Each address maps to a small set of slots,
+ * when all of them are used the least recently seen client of the set is
+ * replaced. A client that was replaced starts again with a full bucket,
+ * so the table should be large enough for the expected number of
+ * concurrently active clients.
+ *
+ * A rate limiter can be set for the whole server with the ratelimit
+ * option or wrapped around single routes.
+ */
+
+#ifndef VTM_NET_HTTP_HTTP_RATELIMIT_H_
+#define VTM_NET_HTTP_HTTP_RATELIMIT_H_
+
+#include <vtm/core/api.h>
+#include <vtm/core/types.h>
+#include <vtm/net/http/http_request.h>
+#include <vtm/net/http/http_response.h>
+#include <vtm/net/http/http_route.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct vtm_http_ratelimit vtm_http_ratelimit;
+
+/** rate limit options, zero-initialized values select the defaults */
+struct vtm_http_ratelimit_opts
+{
+	/** tokens per second that are added to each bucket, must be set */
+	double         rate;
+
+	/** maximum tokens of a bucket, default is the rate but at least one */
+	unsigned int   burst;
+
+	/** number of clients that can be tracked, default is 16384 */
+	size_t         clients;
+
+	/** number of shards, default is 16 */
+	unsigned int   shards;
+};
+
+/**
+ * Creates a new rate limiter.
+ *
+ * All memory for the buckets is allocated here.
+ *
+ * @param opts the options
+ * @return the created rate limiter
+ * @return NULL if an error occured
+ */
+VTM_API vtm_http_ratelimit* vtm_http_ratelimit_new(const struct vtm_http_ratelimit_opts *opts);
+
+/**
+ * Releases the rate limiter and all allocated resources.
+ *
+ * @param rl the rate limiter that should be released
+ */
+VTM_API void vtm_http_ratelimit_free(vtm_http_ratelimit *rl);
+
+/**
+ * Takes a token from the bucket of the given address.
+ *
+ * @param rl the rate limiter
+ * @param ip binary IP address with VTM_SOCK_ADDR_IP_LEN bytes, see
+ *        vtm_socket_os_addr_get_ip()
+ * @param[out] retry_after seconds until the next token is available,
+ *        only set when no token was left. Can be NULL.
+ * @return true if a token was taken
+ * @return false if the bucket was empty
+ */
+VTM_API bool vtm_http_ratelimit_take(vtm_http_ratelimit *rl, const unsigned char *ip, unsigned long *retry_after);
+
+/**
+ * Checks if a request of the client is allowed.
+ *
+ * If the bucket of the remote address is empty, the request is answered
+ * with 429 Too Many Requests and a Retry-After header. The connection
+ * of a request with a streamed body is closed in that case, because its
+ * body is not read.
+ *
+ * @param rl the rate limiter
+ * @param req the request
+ * @param res the response that is used for rejecting the request
+ * @return true if the request should be handled
+ * @return false if the request was rejected
+ */
+VTM_API bool vtm_http_ratelimit_allow(vtm_http_ratelimit *rl, struct vtm_http_req *req, vtm_http_res *res);
+
+/**
+ * Creates a route that limits the request rate of another route.
+ *
+ * The rate limiter is not taken over and must be released after the
+ * router, so it can be shared by several routes. The wrapped route is
+ * released together with this route.
+ *
+ * @param rl the rate limiter
+ * @param rt the route that should be limited
+ * @return http route if call succeeded
+ * @return NULL if an error occured
+ */
+VTM_API struct vtm_http_route* vtm_http_ratelimit_rt_new(vtm_http_ratelimit *rl, struct vtm_http_route *rt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_NET_HTTP_HTTP_RATELIMIT_H_ */
@@ -4,6 +4,7 @@
 
 #include "http_request.h"
 
+#include <string.h> /* strcmp(), memcpy() */
 #include <vtm/core/error.h>
 #include <vtm/net/http/http_connection_base_intl.h>
 #include <vtm/net/http/http_request_intl.h>
@@ -35,6 +36,49 @@ const char* vtm_http_req_get_query_str(struct vtm_http_req *req, const char *nam
 	return NULL;
 }
 
+const char* vtm_http_req_get_path_param(struct vtm_http_req *req, const char *name, size_t *len)
+{
+	unsigned int i;
+
+	for (i=0; i < req->path_param_count; i++) {
+		if (strcmp(req->path_params[i].name, name) == 0) {
+			*len = req->path_params[i].len;
+			return req->path_params[i].val;
+		}
+	}
+
+	return NULL;
+}
+
+int vtm_http_req_copy_path_param(struct vtm_http_req *req, const char *name, char *buf, size_t len)
+{
+	const char *val;
+	size_t val_len;
+
+	val = vtm_http_req_get_path_param(req, name, &val_len);
+	if (!val)
+		return VTM_E_NOT_FOUND;
+
+	if (val_len >= len)
+		return VTM_E_OVERFLOW;
+
+	memcpy(buf, val, val_len);
+	buf[val_len] = '\0';
+
+	return VTM_OK;
+}
+
+int vtm_http_req_resume(struct vtm_http_req *req)
+{
+	struct vtm_http_con_base *con;
+
+	con = req->con;
+	if (!con)
+		return VTM_E_INVALID_STATE;
+
+	return vtm_socket_resume_read(con->sock);
+}
+
 int vtm_http_req_get_remote_info(struct vtm_http_req *req, char *buf, size_t len, unsigned int *port)
 {
 	int rc;
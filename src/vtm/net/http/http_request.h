@@ -20,6 +20,25 @@
 extern "C" {
 #endif
 
+/** Maximum number of path parameters captured by the router */
+#define VTM_HTTP_REQ_MAX_PATH_PARAMS     8
+
+/** Path parameter captured by the router, points into the request path */
+struct vtm_http_path_param
+{
+	const char  *name;  /**< name of the parameter, NUL-terminated */
+	const char  *val;   /**< begin of value, NOT NUL-terminated */
+	size_t       len;   /**< length of value in bytes */
+};
+
+/** State of a streamed request body passed to the body callback */
+enum vtm_http_req_body_stat
+{
+	VTM_HTTP_REQ_BODY_MORE,     /**< fragment received, more will follow */
+	VTM_HTTP_REQ_BODY_LAST,     /**< body complete, fragment may be empty */
+	VTM_HTTP_REQ_BODY_ABORTED   /**< connection closed before body was complete */
+};
+
 struct vtm_http_req
 {
 	enum vtm_http_method    method;   /**< method of the request */
@@ -27,7 +46,14 @@ struct vtm_http_req
 	const char             *path;     /**< request path without parameters */
 	vtm_dataset            *headers;  /**< headers, keys are case insensitive */
 	vtm_dataset            *params;   /**< parameters that were encoded in url */
+	const void             *body;     /**< body, NULL if empty or streamed */
+	size_t                  body_len; /**< length of body in bytes */
+	bool                    streamed; /**< body is passed to the http_body callback */
+	void                   *usr_data; /**< free for use by the request handler */
 	void                   *con;      /**< internal */
+
+	struct vtm_http_path_param path_params[VTM_HTTP_REQ_MAX_PATH_PARAMS]; /**< path parameters set by router */
+	unsigned int               path_param_count;  /**< number of path parameters */
 };
 
 /**
@@ -59,6 +85,47 @@ VTM_API const char* vtm_http_req_get_header_str(struct vtm_http_req *req, const
  */
 VTM_API const char* vtm_http_req_get_query_str(struct vtm_http_req *req, const char *name);
 
+/**
+ * Retrieves a path parameter that was captured by the router.
+ *
+ * The returned value points directly into the request path and is
+ * NOT NUL-terminated, use the length for accessing it.
+ *
+ * @param req the request
+ * @param name the name of the parameter as used in the route path
+ * @param[out] len the length of the value is stored here
+ * @return the begin of the parameter value
+ * @return NULL if the parameter was not captured
+ */
+VTM_API const char* vtm_http_req_get_path_param(struct vtm_http_req *req, const char *name, size_t *len);
+
+/**
+ * Copies a path parameter to the given buffer as NUL-terminated string.
+ *
+ * @param req the request
+ * @param name the name of the parameter as used in the route path
+ * @param buf the buffer where the value should be stored
+ * @param len the length of the buffer in bytes
+ * @return VTM_OK if the value was successfully copied
+ * @return VTM_E_NOT_FOUND if the parameter was not captured
+ * @return VTM_E_OVERFLOW if the buffer is too small
+ */
+VTM_API int vtm_http_req_copy_path_param(struct vtm_http_req *req, const char *name, char *buf, size_t len);
+
+/**
+ * Resumes delivery of a streamed request body.
+ *
+ * Must be called once for each time the body callback returned
+ * VTM_E_IO_AGAIN. The call may happen from any thread, even before
+ * the callback has returned. It must not be called after the callback
+ * was invoked with VTM_HTTP_REQ_BODY_ABORTED.
+ *
+ * @param req the streamed request
+ * @return VTM_OK if the delivery was resumed
+ * @return VTM_E_IO_CLOSED if the connection was already closed
+ */
+VTM_API int vtm_http_req_resume(struct vtm_http_req *req);
+
 /**
  * Retrieves the source ip address and used port of a request.
  *
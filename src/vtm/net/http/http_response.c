@@ -4,15 +4,32 @@
 
 #include "http_response.h"
 
-#include <string.h> /* strlen() */
+#include <ctype.h> /* tolower() */
+#include <string.h> /* strlen(), strcmp(), strchr(), memchr(), memcpy(), memset() */
 #include <vtm/core/buffer.h>
 #include <vtm/core/error.h>
 #include <vtm/core/format.h>
+#include <vtm/core/macros.h>
 #include <vtm/core/string.h>
 #include <vtm/core/version.h>
 #include <vtm/net/socket_emitter.h>
+#include <vtm/net/http/http_connection_base_intl.h>
 #include <vtm/net/http/http_format.h>
 #include <vtm/net/http/http_response_intl.h>
+#include <vtm/net/http/http_sse_intl.h>
+#include <vtm/net/http/http2_connection_intl.h>
+#include <vtm/net/http/ws_deflate_intl.h>
+#include <vtm/util/deflate.h>
+
+#define VTM_HTTP_RES_MIME_MAX_LEN   64
+#define VTM_HTTP_RES_LINE_BUF_LEN   256
+
+enum vtm_http_res_enc
+{
+	VTM_HTTP_RES_ENC_NONE,
+	VTM_HTTP_RES_ENC_GZIP,
+	VTM_HTTP_RES_ENC_DEFLATE
+};
 
 enum vtm_http_res_stage
 {
@@ -25,9 +42,11 @@ enum vtm_http_res_stage
 
 struct vtm_http_res
 {
-	vtm_http_con *con;
+	struct vtm_http_con_base *con;
+	uint32_t stream;
 
 	enum vtm_http_version version;
+	int status;
 	enum vtm_http_res_mode mode;
 	enum vtm_http_res_stage stage;
 	enum vtm_http_res_act act;
@@ -36,12 +55,53 @@ struct vtm_http_res
 	struct vtm_buf buf;
 	struct vtm_buf body_buf;
 	struct vtm_socket_emitter *body_se;
+	uint64_t body_bytes;
+
+	/* referenced body, not copied */
+	const void *body_ext;
+	size_t body_ext_len;
+	bool body_ext_set;
+	void (*body_ext_fr)(void *arg);
+	void *body_ext_arg;
+
+	/* compression */
+	struct vtm_http_res_compress_opts comp_opts;
+	vtm_deflate *comp;
+	struct vtm_buf comp_buf;
+	enum vtm_http_res_enc comp_enc;
+	bool comp_enabled;
+	bool comp_skip;
+	bool comp_encoded;
+	bool comp_active;
+
+	/* capture for shared caches */
+	struct vtm_http_res_capture *cap;
+	size_t cap_headers;
+	bool cap_denied;
+
+	/* WebSocket permessage-deflate */
+	const struct vtm_ws_deflate_opts *ws_deflate_opts;
+	struct vtm_ws_deflate_params ws_deflate;
 };
 
 /* forward declaration */
 static int vtm_http_res_write_chunked(vtm_http_res *res, const void *src, size_t len);
 static int vtm_http_res_close_headers(vtm_http_res *res);
-static int vtm_http_res_send(vtm_http_res *res);
+static int vtm_http_res_send(vtm_http_res *res, const void *body, size_t len);
+static int vtm_http_res_send_h2(vtm_http_res *res, const void *body, size_t len);
+static int vtm_http_res_body_set_ext(vtm_http_res *res, const void *src, size_t len, void (*fr)(void *arg), void *arg);
+static void vtm_http_res_body_release_ext(vtm_http_res *res);
+static void vtm_http_res_track_header(vtm_http_res *res, const char *name, const char *value);
+static int vtm_http_res_track_line(vtm_http_res *res, const char *line, size_t len);
+static bool vtm_http_res_vary_other(const char *value);
+static void vtm_http_res_capture(vtm_http_res *res);
+
+/* compression */
+static bool vtm_http_res_comp_mime_allowed(const char *mime);
+static bool vtm_http_res_comp_eligible(vtm_http_res *res);
+static int vtm_http_res_comp_start(vtm_http_res *res);
+static int vtm_http_res_comp_fixed(vtm_http_res *res, const void **body, size_t *len);
+static int vtm_http_res_comp_chunk(vtm_http_res *res, const void *src, size_t len, enum vtm_deflate_flush flush);
 
 vtm_http_res* vtm_http_res_new(void)
 {
@@ -55,6 +115,7 @@ vtm_http_res* vtm_http_res_new(void)
 
 	res->con = NULL;
 	res->version = 0;
+	res->status = 0;
 
 	res->mode = VTM_HTTP_RES_MODE_FIXED;
 	res->stage = VTM_HTTP_RES_STAGE_UNINITIALZED;
@@ -65,21 +126,67 @@ vtm_http_res* vtm_http_res_new(void)
 
 	res->body_se = NULL;
 
+	res->body_ext = NULL;
+	res->body_ext_len = 0;
+	res->body_ext_set = false;
+	res->body_ext_fr = NULL;
+	res->body_ext_arg = NULL;
+
+	memset(&res->comp_opts, 0, sizeof(res->comp_opts));
+	res->comp = NULL;
+	vtm_buf_init(&res->comp_buf, vtm_sys_get_byteorder());
+	res->comp_enc = VTM_HTTP_RES_ENC_NONE;
+	res->comp_enabled = false;
+	res->comp_skip = false;
+	res->comp_encoded = false;
+	res->comp_active = false;
+
+	res->cap = NULL;
+	res->cap_headers = 0;
+	res->cap_denied = false;
+
+	res->ws_deflate_opts = NULL;
+
 	return res;
 }
 
 void vtm_http_res_free(vtm_http_res *res)
 {
+	vtm_http_res_body_release_ext(res);
 	vtm_buf_release(&res->buf);
 	vtm_buf_release(&res->body_buf);
+	vtm_buf_release(&res->comp_buf);
+	vtm_deflate_free(res->comp);
 	free(res);
 }
 
+void vtm_http_res_set_compress_opts(vtm_http_res *res, const struct vtm_http_res_compress_opts *opts)
+{
+	res->comp_opts = *opts;
+}
+
+void vtm_http_res_set_ws_deflate_opts(vtm_http_res *res, const struct vtm_ws_deflate_opts *opts)
+{
+	res->ws_deflate_opts = opts;
+}
+
+const struct vtm_ws_deflate_opts* vtm_http_res_get_ws_deflate_opts(vtm_http_res *res)
+{
+	return res->ws_deflate_opts;
+}
+
+struct vtm_ws_deflate_params* vtm_http_res_get_ws_deflate_params(vtm_http_res *res)
+{
+	return &res->ws_deflate;
+}
+
 void vtm_http_res_prepare(vtm_http_res *res, struct vtm_http_req *req)
 {
 	const char *val;
+	unsigned int codings;
 
 	res->con = req->con;
+	res->stream = 0;
 	res->version = req->version;
 
 	res->mode = VTM_HTTP_RES_MODE_FIXED;
@@ -88,6 +195,26 @@ void vtm_http_res_prepare(vtm_http_res *res, struct vtm_http_req *req)
 	vtm_buf_clear(&res->buf);
 	vtm_buf_clear(&res->body_buf);
 	res->body_se = NULL;
+	res->body_bytes = 0;
+	vtm_http_res_body_release_ext(res);
+
+	/* eval supported content codings */
+	res->comp_enabled = res->comp_opts.enabled;
+	res->comp_skip = false;
+	res->comp_encoded = false;
+	res->comp_active = false;
+	res->comp_enc = VTM_HTTP_RES_ENC_NONE;
+	res->cap = NULL;
+	if (res->comp_enabled) {
+		val = vtm_http_req_get_header_str(req, VTM_HTTP_HEADER_ACCEPT_ENCODING);
+		if (val) {
+			codings = vtm_http_parse_accept_encoding(val);
+			if (codings & VTM_HTTP_CODING_GZIP)
+				res->comp_enc = VTM_HTTP_RES_ENC_GZIP;
+			else if (codings & VTM_HTTP_CODING_DEFLATE)
+				res->comp_enc = VTM_HTTP_RES_ENC_DEFLATE;
+		}
+	}
 
 	/* eval default action */
 	res->act_data = NULL;
@@ -103,9 +230,24 @@ void vtm_http_res_prepare(vtm_http_res *res, struct vtm_http_req *req)
 			else
 				res->act = VTM_HTTP_RES_ACT_KEEP_CON;
 			break;
+
+		case VTM_HTTP_VER_2:
+			/* connection is managed by HTTP/2 itself */
+			res->act = VTM_HTTP_RES_ACT_KEEP_CON;
+			break;
 	}
 }
 
+void vtm_http_res_set_stream(vtm_http_res *res, uint32_t stream)
+{
+	res->stream = stream;
+}
+
+void vtm_http_res_set_capture(vtm_http_res *res, struct vtm_http_res_capture *cap)
+{
+	res->cap = cap;
+}
+
 int vtm_http_res_begin(vtm_http_res *res, enum vtm_http_res_mode mode, int status)
 {
 	int rc;
@@ -118,22 +260,26 @@ int vtm_http_res_begin(vtm_http_res *res, enum vtm_http_res_mode mode, int statu
 
 	res->stage = VTM_HTTP_RES_STAGE_HEADER_OR_BODY;
 	res->mode = mode;
+	res->status = status;
 
 	version = vtm_http_get_version_string(res->version);
 	reason = vtm_http_get_status_phrase(status);
 
-	rc = vtm_fmt_int(status_str, status);
-	status_str[rc] = '\0';
+	/* HTTP/2 transmits the status as pseudo header */
+	if (res->version != VTM_HTTP_VER_2) {
+		rc = vtm_fmt_int(status_str, status);
+		status_str[rc] = '\0';
 
-	vtm_buf_puts(&res->buf, version);
-	vtm_buf_putc(&res->buf, ' ');
-	vtm_buf_puts(&res->buf, status_str);
-	vtm_buf_putc(&res->buf, ' ');
-	vtm_buf_puts(&res->buf, reason);
-	vtm_buf_puts(&res->buf, "\r\n");
+		vtm_buf_puts(&res->buf, version);
+		vtm_buf_putc(&res->buf, ' ');
+		vtm_buf_puts(&res->buf, status_str);
+		vtm_buf_putc(&res->buf, ' ');
+		vtm_buf_puts(&res->buf, reason);
+		vtm_buf_puts(&res->buf, "\r\n");
 
-	if (res->buf.err != VTM_OK)
-		return VTM_ERROR;
+		if (res->buf.err != VTM_OK)
+			return VTM_ERROR;
+	}
 
 	rc = vtm_http_res_header(res, VTM_HTTP_HEADER_SERVER, VTM_BUILD_VERSION);
 	if (rc != VTM_OK)
@@ -143,6 +289,14 @@ int vtm_http_res_begin(vtm_http_res *res, enum vtm_http_res_mode mode, int statu
 	if (rc != VTM_OK)
 		return rc;
 
+	/* captured header block starts after the generated headers */
+	res->cap_headers = res->buf.used;
+	res->cap_denied = false;
+
+	/* HTTP/2 frames the body itself */
+	if (res->version == VTM_HTTP_VER_2)
+		return VTM_OK;
+
 	switch (res->mode) {
 		case VTM_HTTP_RES_MODE_CHUNKED:
 			rc = vtm_http_res_header(res, VTM_HTTP_HEADER_TRANSFER_ENCODING, VTM_HTTP_VALUE_CHUNKED);
@@ -168,11 +322,145 @@ int vtm_http_res_header(vtm_http_res *res, const char *name, const char *value)
 	vtm_buf_puts(&res->buf, value);
 	vtm_buf_puts(&res->buf, "\r\n");
 
+	vtm_http_res_track_header(res, name, value);
+
 	return (res->buf.err);
 }
 
+static void vtm_http_res_track_header(vtm_http_res *res, const char *name, const char *value)
+{
+	if (res->cap) {
+		if (vtm_str_casecmp(name, VTM_HTTP_HEADER_SET_COOKIE) == 0)
+			res->cap_denied = true;
+		else if (vtm_str_casecmp(name, VTM_HTTP_HEADER_CACHE_CONTROL) == 0 &&
+			(vtm_str_list_contains(value, ",", "no-store", true) ||
+			 vtm_str_list_contains(value, ",", "private", true)))
+			res->cap_denied = true;
+		else if (vtm_str_casecmp(name, VTM_HTTP_HEADER_VARY) == 0 &&
+			vtm_http_res_vary_other(value))
+			res->cap_denied = true;
+	}
+
+	if (!res->comp_enabled)
+		return;
+
+	/* both only turn compression off, regardless of their order */
+	if (vtm_str_casecmp(name, VTM_HTTP_HEADER_CONTENT_ENCODING) == 0)
+		res->comp_encoded = true;
+	else if (vtm_str_casecmp(name, VTM_HTTP_HEADER_CONTENT_TYPE) == 0 &&
+		!vtm_http_res_comp_mime_allowed(value))
+		res->comp_skip = true;
+}
+
+static bool vtm_http_res_vary_other(const char *value)
+{
+	size_t i, len, name_len;
+	const char *end;
+
+	/* captured variants are only separated by their encoding */
+	name_len = strlen(VTM_HTTP_HEADER_ACCEPT_ENCODING);
+	while (*value != '\0') {
+		while (*value == ',' || *value == ' ' || *value == '\t')
+			value++;
+		if (*value == '\0')
+			break;
+
+		end = value;
+		while (*end != '\0' && *end != ',')
+			end++;
+
+		len = end - value;
+		while (len > 0 && (value[len-1] == ' ' || value[len-1] == '\t'))
+			len--;
+
+		if (len != name_len)
+			return true;
+
+		for (i=0; i < len; i++) {
+			if (tolower((unsigned char) value[i]) !=
+				tolower((unsigned char) VTM_HTTP_HEADER_ACCEPT_ENCODING[i]))
+				return true;
+		}
+
+		value = end;
+	}
+
+	return false;
+}
+
+int vtm_http_res_header_block(vtm_http_res *res, const char *block, size_t len)
+{
+	int rc;
+	const char *end, *eol, *next;
+
+	if (res->stage != VTM_HTTP_RES_STAGE_HEADER_OR_BODY &&
+		res->stage != VTM_HTTP_RES_STAGE_HEADER)
+		return VTM_ERROR;
+
+	res->stage = VTM_HTTP_RES_STAGE_HEADER;
+
+	rc = vtm_buf_putm(&res->buf, block, len);
+	if (rc != VTM_OK)
+		return rc;
+
+	/* replayed headers affect compression like single ones */
+	end = block + len;
+	while (block < end) {
+		eol = memchr(block, '\n', end - block);
+		next = eol ? eol + 1 : end;
+
+		rc = vtm_http_res_track_line(res, block, next - block);
+		if (rc != VTM_OK)
+			return rc;
+
+		block = next;
+	}
+
+	return VTM_OK;
+}
+
+static int vtm_http_res_track_line(vtm_http_res *res, const char *line, size_t len)
+{
+	char buf[VTM_HTTP_RES_LINE_BUF_LEN];
+	char *name, *value, *sep;
+
+	/* strip line ending */
+	while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r'))
+		len--;
+
+	if (len < sizeof(buf)) {
+		name = buf;
+	}
+	else {
+		name = malloc(len + 1);
+		if (!name) {
+			vtm_err_oom();
+			return vtm_err_get_code();
+		}
+	}
+
+	memcpy(name, line, len);
+	name[len] = '\0';
+
+	sep = strchr(name, ':');
+	if (sep) {
+		*sep = '\0';
+		for (value = sep + 1; *value == ' ' || *value == '\t'; value++)
+			;
+		vtm_http_res_track_header(res, name, value);
+	}
+
+	if (name != buf)
+		free(name);
+
+	return VTM_OK;
+}
+
 static int vtm_http_res_close_headers(vtm_http_res *res)
 {
+	if (res->version == VTM_HTTP_VER_2)
+		return res->buf.err;
+
 	switch (res->act) {
 		case VTM_HTTP_RES_ACT_CLOSE_CON:
 			vtm_http_res_header(res, VTM_HTTP_HEADER_CONNECTION, VTM_HTTP_VALUE_CLOSE);
@@ -204,15 +492,21 @@ int vtm_http_res_body_raw(vtm_http_res *res, const char *src, size_t len)
 
 	switch (res->mode) {
 		case VTM_HTTP_RES_MODE_FIXED:
+			if (res->body_ext_set)
+				return VTM_E_INVALID_STATE;
 			return vtm_buf_putm(&res->body_buf, src, len);
 
 		case VTM_HTTP_RES_MODE_CHUNKED:
 			if (res->stage != VTM_HTTP_RES_STAGE_BODY) {
-				rc = vtm_http_res_close_headers(res);
+				rc = vtm_http_res_comp_start(res);
+				if (rc == VTM_OK)
+					rc = vtm_http_res_close_headers(res);
 				res->stage = VTM_HTTP_RES_STAGE_BODY;
 				if (rc != VTM_OK)
 					return rc;
 			}
+			if (res->comp_active)
+				return vtm_http_res_comp_chunk(res, src, len, VTM_DEFLATE_FLUSH_NONE);
 			return vtm_http_res_write_chunked(res, src, len);
 	}
 
@@ -220,6 +514,51 @@ int vtm_http_res_body_raw(vtm_http_res *res, const char *src, size_t len)
 	return VTM_ERROR;
 }
 
+int vtm_http_res_body_ref(vtm_http_res *res, const void *src, size_t len)
+{
+	return vtm_http_res_body_set_ext(res, src, len, NULL, NULL);
+}
+
+int vtm_http_res_body_own(vtm_http_res *res, const void *src, size_t len, void (*fr)(void *arg), void *arg)
+{
+	int rc;
+
+	rc = vtm_http_res_body_set_ext(res, src, len, fr, arg);
+	if (rc != VTM_OK)
+		fr(arg);
+
+	return rc;
+}
+
+static int vtm_http_res_body_set_ext(vtm_http_res *res, const void *src, size_t len, void (*fr)(void *arg), void *arg)
+{
+	if (res->stage == VTM_HTTP_RES_STAGE_UNINITIALZED ||
+		res->stage == VTM_HTTP_RES_STAGE_COMPLETED ||
+		res->mode != VTM_HTTP_RES_MODE_FIXED ||
+		res->body_ext_set || res->body_buf.used > 0)
+		return VTM_E_INVALID_STATE;
+
+	res->body_ext = src;
+	res->body_ext_len = len;
+	res->body_ext_set = true;
+	res->body_ext_fr = fr;
+	res->body_ext_arg = arg;
+
+	return VTM_OK;
+}
+
+static void vtm_http_res_body_release_ext(vtm_http_res *res)
+{
+	if (res->body_ext_fr)
+		res->body_ext_fr(res->body_ext_arg);
+
+	res->body_ext = NULL;
+	res->body_ext_len = 0;
+	res->body_ext_set = false;
+	res->body_ext_fr = NULL;
+	res->body_ext_arg = NULL;
+}
+
 int vtm_http_res_body_emt(vtm_http_res *res, struct vtm_socket_emitter *se)
 {
 	if (res->body_se)
@@ -235,6 +574,12 @@ static int vtm_http_res_write_chunked(vtm_http_res *res, const void *src, size_t
 	int rc;
 	int hex_len;
 
+	res->body_bytes += len;
+
+	/* HTTP/2 body is collected and framed by the connection */
+	if (res->version == VTM_HTTP_VER_2)
+		return vtm_buf_putm(&res->body_buf, src, len);
+
 	hex_len = vtm_fmt_hex_size(NULL, len);
 	rc = vtm_buf_ensure(&res->buf, hex_len);
 	if (rc != VTM_OK)
@@ -250,17 +595,41 @@ static int vtm_http_res_write_chunked(vtm_http_res *res, const void *src, size_t
 	return res->buf.err;
 }
 
+int vtm_http_res_set_compression(vtm_http_res *res, bool enabled)
+{
+	if (res->stage >= VTM_HTTP_RES_STAGE_BODY)
+		return VTM_E_INVALID_STATE;
+
+	res->comp_enabled = enabled;
+
+	return VTM_OK;
+}
+
 int vtm_http_res_set_action(vtm_http_res *res, enum vtm_http_res_act act, void *data)
 {
 	if (res->stage >= VTM_HTTP_RES_STAGE_BODY)
 		return VTM_E_INVALID_STATE;
 
+	/* event stream continues the chunked body of the response */
+	if (act == VTM_HTTP_RES_ACT_SSE && res->mode != VTM_HTTP_RES_MODE_CHUNKED)
+		return VTM_E_INVALID_STATE;
+
 	res->act = act;
 	res->act_data = data;
 
 	return VTM_OK;
 }
 
+int vtm_http_res_get_status(vtm_http_res *res)
+{
+	return res->stage != VTM_HTTP_RES_STAGE_UNINITIALZED ? res->status : 0;
+}
+
+uint64_t vtm_http_res_get_body_len(vtm_http_res *res)
+{
+	return res->body_bytes;
+}
+
 enum vtm_http_res_act vtm_http_res_get_action(vtm_http_res *res)
 {
 	return res->act;
@@ -274,9 +643,11 @@ void* vtm_http_res_get_action_data(vtm_http_res *res)
 int vtm_http_res_end(vtm_http_res *res)
 {
 	int rc;
-	char *val;
 	uint64_t len;
 	uint64_t chain_len;
+	const void *body;
+	size_t body_len;
+	char len_str[VTM_FMT_CHARS_INT64 + 1];
 
 	if (res->stage == VTM_HTTP_RES_STAGE_UNINITIALZED ||
 		res->stage == VTM_HTTP_RES_STAGE_COMPLETED)
@@ -286,9 +657,14 @@ int vtm_http_res_end(vtm_http_res *res)
 
 	switch (res->mode) {
 		case VTM_HTTP_RES_MODE_FIXED:
-			len = 0;
-			if (res->body_buf.used > 0)
-				len += res->body_buf.used;
+			if (res->cap)
+				vtm_http_res_capture(res);
+
+			rc = vtm_http_res_comp_fixed(res, &body, &body_len);
+			if (rc != VTM_OK)
+				return rc;
+
+			len = body_len;
 
 			if (res->body_se) {
 				rc = vtm_socket_emitter_get_chain_lensum(res->body_se, &chain_len);
@@ -297,19 +673,23 @@ int vtm_http_res_end(vtm_http_res *res)
 				len += chain_len;
 			}
 
-			val = vtm_str_printf("%llu", len);
-			rc = vtm_http_res_header(res, VTM_HTTP_HEADER_CONTENT_LENGTH, val);
-			free(val);
-			if (rc != VTM_OK)
-				return rc;
+			res->body_bytes = len;
+
+			/* 1xx, 204 and 304 responses have no body */
+			if (res->status >= 200 && res->status != 204 &&
+				res->status != VTM_HTTP_304_NOT_MODIFIED) {
+				len_str[vtm_fmt_uint64(len_str, len)] = '\0';
+				rc = vtm_http_res_header(res, VTM_HTTP_HEADER_CONTENT_LENGTH, len_str);
+				if (rc != VTM_OK)
+					return rc;
+			}
 
 			rc = vtm_http_res_close_headers(res);
 			if (rc != VTM_OK)
 				return rc;
 
-			if (res->body_buf.used > 0)
-				vtm_buf_putm(&res->buf, res->body_buf.data, res->body_buf.used);
-			break;
+			/* body is sent from its own memory after the headers */
+			return vtm_http_res_send(res, body, body_len);
 
 		case VTM_HTTP_RES_MODE_CHUNKED:
 			if (res->stage == VTM_HTTP_RES_STAGE_HEADER_OR_BODY ||
@@ -318,6 +698,18 @@ int vtm_http_res_end(vtm_http_res *res)
 				if (rc != VTM_OK)
 					return rc;
 			}
+			if (res->act == VTM_HTTP_RES_ACT_SSE) {
+				/* body is not terminated, events follow as chunks */
+				rc = vtm_http_sse_start(res->act_data, res->con->sock, res->buf.data, res->buf.used);
+				if (rc == VTM_OK)
+					res->stage = VTM_HTTP_RES_STAGE_COMPLETED;
+				return rc;
+			}
+			if (res->comp_active) {
+				rc = vtm_http_res_comp_chunk(res, NULL, 0, VTM_DEFLATE_FLUSH_FINISH);
+				if (rc != VTM_OK)
+					return rc;
+			}
 			rc = vtm_http_res_write_chunked(res, NULL, 0);
 			break;
 	}
@@ -325,44 +717,117 @@ int vtm_http_res_end(vtm_http_res *res)
 	if (rc != VTM_OK)
 		return rc;
 
-	return vtm_http_res_send(res);
+	return vtm_http_res_send(res, NULL, 0);
 }
 
-static int vtm_http_res_send(vtm_http_res *res)
+static int vtm_http_res_send(vtm_http_res *res, const void *body, size_t len)
 {
 	int rc;
 	vtm_socket *sock;
-	struct vtm_socket_emitter *se;
+	struct vtm_socket_emitter *se, *cur;
+	struct vtm_socket_iovec vec[2];
+	size_t count;
+	void (*fr)(void *arg);
+
+	if (res->version == VTM_HTTP_VER_2)
+		return vtm_http_res_send_h2(res, body, len);
+
+	sock = res->con->sock;
 
-	sock = vtm_http_con_get_socket(res->con);
+	vec[0].data = res->buf.data;
+	vec[0].len = res->buf.used;
+	count = 1;
 
-	se = vtm_socket_emitter_for_buffer(sock, &res->buf, false);
+	if (len > 0) {
+		vec[1].data = body;
+		vec[1].len = len;
+		count++;
+	}
+
+	/* emitter takes over ownership of a referenced body */
+	fr = (body == res->body_ext) ? res->body_ext_fr : NULL;
+	se = vtm_socket_emitter_for_iovec(sock, vec, count, fr, res->body_ext_arg);
 	if (!se)
 		return vtm_err_get_code();
 
+	if (fr) {
+		res->body_ext_fr = NULL;
+		res->body_ext_arg = NULL;
+	}
+
 	if (res->body_se) {
-		res->body_se->sock = sock;
 		se->next = res->body_se;
+		for (cur = res->body_se; cur; cur = cur->next)
+			cur->sock = sock;
 	}
 
-	rc = vtm_socket_emitter_try_write(&se);
-	switch (rc) {
-		case VTM_OK:
-			res->stage = VTM_HTTP_RES_STAGE_COMPLETED;
-			return VTM_OK;
+	rc = vtm_http_con_send((vtm_http_con*) res->con, se);
+	if (rc != VTM_OK)
+		return rc;
 
-		case VTM_E_IO_AGAIN:
-			res->stage = VTM_HTTP_RES_STAGE_COMPLETED;
-			vtm_http_con_set_emitter(res->con, se);
-			return VTM_OK;
+	res->stage = VTM_HTTP_RES_STAGE_COMPLETED;
+	return VTM_OK;
+}
 
-		default:
-			vtm_socket_emitter_free_chain(se);
-			break;
+static int vtm_http_res_send_h2(vtm_http_res *res, const void *body, size_t len)
+{
+	int rc;
+	struct vtm_http2_body h2body;
+
+	if (res->mode == VTM_HTTP_RES_MODE_CHUNKED) {
+		body = res->body_buf.data;
+		len = res->body_buf.used;
 	}
+
+	/* worker buffers are reused, only referenced bodies stay valid */
+	h2body.data = body;
+	h2body.len = len;
+	h2body.copy = (body != res->body_ext);
+	h2body.fr = NULL;
+	h2body.fr_arg = NULL;
+	h2body.se = res->body_se;
+
+	/* stream takes over ownership of a referenced body */
+	if (body == res->body_ext && res->body_ext_fr) {
+		h2body.fr = res->body_ext_fr;
+		h2body.fr_arg = res->body_ext_arg;
+		res->body_ext_fr = NULL;
+		res->body_ext_arg = NULL;
+	}
+
+	rc = vtm_http2_con_respond((vtm_http2_con*) res->con, res->stream, res->status,
+		(const char*) res->buf.data, res->buf.used, &h2body);
+
+	if (rc == VTM_OK)
+		res->stage = VTM_HTTP_RES_STAGE_COMPLETED;
+
 	return rc;
 }
 
+static void vtm_http_res_capture(vtm_http_res *res)
+{
+	struct vtm_http_res_capture *cap;
+
+	cap = res->cap;
+	if (res->cap_denied || res->body_se || res->act == VTM_HTTP_RES_ACT_UPGRADE_WS)
+		return;
+
+	vtm_buf_clear(&cap->headers);
+	vtm_buf_clear(&cap->body);
+
+	vtm_buf_putm(&cap->headers, res->buf.data + res->cap_headers, res->buf.used - res->cap_headers);
+	if (res->body_ext_set)
+		vtm_buf_putm(&cap->body, res->body_ext, res->body_ext_len);
+	else
+		vtm_buf_putm(&cap->body, res->body_buf.data, res->body_buf.used);
+
+	if (cap->headers.err != VTM_OK || cap->body.err != VTM_OK)
+		return;
+
+	cap->status = res->status;
+	cap->done = true;
+}
+
 int vtm_http_res_set_date(vtm_http_res *res)
 {
 	int rc;
@@ -394,3 +859,153 @@ enum vtm_http_version vtm_http_res_get_version(vtm_http_res *res)
 {
 	return res->version;
 }
+
+static bool vtm_http_res_comp_mime_allowed(const char *mime)
+{
+	size_t i;
+	char type[VTM_HTTP_RES_MIME_MAX_LEN];
+
+	static const char* const denied_prefix[] = {
+		"image/",
+		"audio/",
+		"video/",
+		"font/"
+	};
+
+	static const char* const denied[] = {
+		"application/gzip",
+		"application/octet-stream",
+		"application/pdf",
+		"application/vnd.rar",
+		"application/x-7z-compressed",
+		"application/x-bzip2",
+		"application/x-rar-compressed",
+		"application/zip",
+		"application/font-woff"
+	};
+
+	/* lower case media type without parameters */
+	for (i=0; i < sizeof(type)-1 && mime[i] && mime[i] != ';' && mime[i] != ' '; i++)
+		type[i] = tolower((unsigned char) mime[i]);
+	type[i] = '\0';
+
+	if (strcmp(type, "image/svg+xml") == 0)
+		return true;
+
+	for (i=0; i < VTM_ARRAY_LEN(denied_prefix); i++) {
+		if (vtm_str_starts_with(type, denied_prefix[i]))
+			return false;
+	}
+
+	for (i=0; i < VTM_ARRAY_LEN(denied); i++) {
+		if (strcmp(type, denied[i]) == 0)
+			return false;
+	}
+
+	return true;
+}
+
+static bool vtm_http_res_comp_eligible(vtm_http_res *res)
+{
+	if (!res->comp_enabled || res->comp_skip || res->comp_encoded)
+		return false;
+
+	/* 1xx, 204 and 304 have no body, 206 ranges refer to the identity */
+	if (res->status < 200 || res->status == 204 ||
+		res->status == VTM_HTTP_206_PARTIAL_CONTENT ||
+		res->status == VTM_HTTP_304_NOT_MODIFIED)
+		return false;
+
+	return true;
+}
+
+static int vtm_http_res_comp_start(vtm_http_res *res)
+{
+	int rc;
+	int level;
+
+	if (!vtm_http_res_comp_eligible(res))
+		return VTM_OK;
+
+	/* representation depends on the request header */
+	rc = vtm_http_res_header(res, VTM_HTTP_HEADER_VARY, VTM_HTTP_HEADER_ACCEPT_ENCODING);
+	if (rc != VTM_OK || res->comp_enc == VTM_HTTP_RES_ENC_NONE)
+		return rc;
+
+	/* compressor is created once per worker and reused afterwards */
+	if (!res->comp) {
+		level = res->comp_opts.level > 0 ? res->comp_opts.level : VTM_DEFLATE_LEVEL_DEFAULT;
+		res->comp = vtm_deflate_new(level, VTM_DEFLATE_WINDOW_DEFAULT);
+		if (!res->comp) {
+			/* send uncompressed from now on */
+			res->comp_opts.enabled = false;
+			return VTM_OK;
+		}
+	}
+
+	rc = vtm_deflate_begin(res->comp, res->comp_enc == VTM_HTTP_RES_ENC_GZIP ?
+		VTM_DEFLATE_FMT_GZIP : VTM_DEFLATE_FMT_ZLIB);
+	if (rc != VTM_OK)
+		return rc;
+
+	rc = vtm_http_res_header(res, VTM_HTTP_HEADER_CONTENT_ENCODING,
+		res->comp_enc == VTM_HTTP_RES_ENC_GZIP ? VTM_HTTP_VALUE_GZIP : VTM_HTTP_VALUE_DEFLATE);
+	if (rc != VTM_OK)
+		return rc;
+
+	vtm_buf_clear(&res->comp_buf);
+	res->comp_active = true;
+
+	return VTM_OK;
+}
+
+static int vtm_http_res_comp_fixed(vtm_http_res *res, const void **body, size_t *len)
+{
+	int rc;
+
+	if (res->body_ext_set) {
+		*body = res->body_ext;
+		*len = res->body_ext_len;
+	}
+	else {
+		*body = res->body_buf.data;
+		*len = res->body_buf.used;
+	}
+
+	if (res->body_se || *len < res->comp_opts.min_size || *len == 0)
+		return VTM_OK;
+
+	rc = vtm_http_res_comp_start(res);
+	if (rc != VTM_OK || !res->comp_active)
+		return rc;
+
+	rc = vtm_deflate_update(res->comp, *body, *len,
+		VTM_DEFLATE_FLUSH_FINISH, &res->comp_buf);
+	if (rc != VTM_OK)
+		return rc;
+
+	/* compressed copy replaces a referenced body */
+	vtm_http_res_body_release_ext(res);
+
+	*body = res->comp_buf.data;
+	*len = res->comp_buf.used;
+
+	return VTM_OK;
+}
+
+static int vtm_http_res_comp_chunk(vtm_http_res *res, const void *src, size_t len, enum vtm_deflate_flush flush)
+{
+	int rc;
+
+	vtm_buf_clear(&res->comp_buf);
+
+	rc = vtm_deflate_update(res->comp, src, len, flush, &res->comp_buf);
+	if (rc != VTM_OK)
+		return rc;
+
+	/* compressor may buffer input, empty chunk would end the body */
+	if (res->comp_buf.used == 0)
+		return VTM_OK;
+
+	return vtm_http_res_write_chunked(res, res->comp_buf.data, res->comp_buf.used);
+}
@@ -30,11 +30,33 @@ enum vtm_http_res_act
 {
 	VTM_HTTP_RES_ACT_CLOSE_CON,  /**< close connection after response has been sent */
 	VTM_HTTP_RES_ACT_KEEP_CON,   /**< keep connection alive */
-	VTM_HTTP_RES_ACT_UPGRADE_WS  /**< Upgrade connection to a WebSocket connection */
+	VTM_HTTP_RES_ACT_UPGRADE_WS, /**< Upgrade connection to a WebSocket connection */
+	VTM_HTTP_RES_ACT_SSE         /**< Keep connection as Server-Sent Events stream, CHUNKED only */
 };
 
 typedef struct vtm_http_res vtm_http_res;
 
+/**
+ * Options for compressing response bodies.
+ *
+ * Bodies are only compressed when the client announced support for
+ * gzip or deflate in its Accept-Encoding header. Bodies with a
+ * Content-Type that is already compressed (images, audio, video,
+ * archives, fonts) or with a user supplied Content-Encoding are sent
+ * unchanged.
+ */
+struct vtm_http_res_compress_opts
+{
+	/** enables compression for all responses */
+	bool enabled;
+
+	/** compression level from 1 to 9, zero selects the default level */
+	int level;
+
+	/** minimum size of FIXED bodies, smaller bodies are sent uncompressed */
+	size_t min_size;
+};
+
 /**
  * Initializes and starts the response with mode and status code.
  *
@@ -80,6 +102,38 @@ VTM_API int vtm_http_res_body_str(vtm_http_res *res, const char *data);
  */
 VTM_API int vtm_http_res_body_raw(vtm_http_res *res, const char *src, size_t len);
 
+/**
+ * References a memory region as response body without copying it.
+ *
+ * Only possible in FIXED mode when no other body data was added. The
+ * memory must stay valid until the response was sent completely, so
+ * this is intended for static or otherwise long-lived data.
+ *
+ * @param res the response
+ * @param src pointer to the memory region
+ * @param len length of memory region in bytes
+ * @return VTM_OK if the call succeeded
+ * @return VTM_E_INVALID_STATE if the mode is not FIXED or body data was already added
+ */
+VTM_API int vtm_http_res_body_ref(vtm_http_res *res, const void *src, size_t len);
+
+/**
+ * Hands over ownership of a memory region that is used as response body.
+ *
+ * Like vtm_http_res_body_ref(), but the release function is called
+ * with arg once the body was sent or the response is discarded.
+ * The release function is also called when the call fails.
+ *
+ * @param res the response
+ * @param src pointer to the memory region
+ * @param len length of memory region in bytes
+ * @param fr the release function
+ * @param arg the argument for the release function, typically src
+ * @return VTM_OK if the call succeeded
+ * @return VTM_E_INVALID_STATE if the mode is not FIXED or body data was already added
+ */
+VTM_API int vtm_http_res_body_own(vtm_http_res *res, const void *src, size_t len, void (*fr)(void *arg), void *arg);
+
 /**
  * Lets the response body be defined by a socket emitter.
  *
@@ -92,6 +146,19 @@ VTM_API int vtm_http_res_body_raw(vtm_http_res *res, const char *src, size_t len
  */
 VTM_API int vtm_http_res_body_emt(vtm_http_res *res, struct vtm_socket_emitter *se);
 
+/**
+ * Enables or disables compression for this response.
+ *
+ * Overrides the server wide setting. The call must happen before
+ * the first body data of a CHUNKED response is written.
+ *
+ * @param res the response
+ * @param enabled true if the body may be compressed
+ * @return VTM_OK if the call succeeded
+ * @return VTM_E_INVALID_STATE if the body was already started
+ */
+VTM_API int vtm_http_res_set_compression(vtm_http_res *res, bool enabled);
+
 /**
  * Sets the action that is performed after the response has been sent.
  *
@@ -5,23 +5,55 @@
 #ifndef VTM_NET_HTTP_HTTP_RESPONSE_INTL_H_
 #define VTM_NET_HTTP_HTTP_RESPONSE_INTL_H_
 
+#include <vtm/core/buffer.h>
+#include <vtm/core/types.h>
 #include <vtm/net/socket.h>
 #include <vtm/net/http/http.h>
 #include <vtm/net/http/http_connection_intl.h>
 #include <vtm/net/http/http_request.h>
 #include <vtm/net/http/http_response.h>
+#include <vtm/net/http/ws_deflate_intl.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/** Copy of a response taken by vtm_http_res_end() */
+struct vtm_http_res_capture
+{
+	bool            done;     /**< response was captured */
+	int             status;
+	struct vtm_buf  headers;  /**< header block set by the handler */
+	struct vtm_buf  body;     /**< uncompressed body */
+};
+
 vtm_http_res* vtm_http_res_new(void);
 void vtm_http_res_free(vtm_http_res *res);
+void vtm_http_res_set_compress_opts(vtm_http_res *res, const struct vtm_http_res_compress_opts *opts);
+
+/* Options for WebSocket upgrades, the options must outlive the response */
+void vtm_http_res_set_ws_deflate_opts(vtm_http_res *res, const struct vtm_ws_deflate_opts *opts);
+const struct vtm_ws_deflate_opts* vtm_http_res_get_ws_deflate_opts(vtm_http_res *res);
+
+/* Storage for the negotiated parameters, passed as action data of the upgrade */
+struct vtm_ws_deflate_params* vtm_http_res_get_ws_deflate_params(vtm_http_res *res);
 
 void vtm_http_res_prepare(vtm_http_res *res, struct vtm_http_req *req);
+void vtm_http_res_set_stream(vtm_http_res *res, uint32_t stream);
+int vtm_http_res_get_status(vtm_http_res *res);
+uint64_t vtm_http_res_get_body_len(vtm_http_res *res);
 enum vtm_http_res_act vtm_http_res_get_action(vtm_http_res *res);
 void* vtm_http_res_get_action_data(vtm_http_res *res);
 
+int vtm_http_res_header_block(vtm_http_res *res, const char *block, size_t len);
+
+/*
+ * Captures FIXED responses without emitter body that may be shared with
+ * other clients. Responses setting cookies or forbidding storage with
+ * Cache-Control are skipped. Pass NULL to stop capturing.
+ */
+void vtm_http_res_set_capture(vtm_http_res *res, struct vtm_http_res_capture *cap);
+
 #ifdef __cplusplus
 }
 #endif
@@ -4,20 +4,74 @@
 
 #include "http_router.h"
 
-#include <string.h> /* strcmp() */
+#include <string.h> /* strlen(), strcmp(), strncmp(), strchr(), memchr() */
 #include <vtm/core/error.h>
 #include <vtm/core/list.h>
 #include <vtm/core/string.h>
+#include <vtm/net/http/http_metrics_intl.h>
 #include <vtm/net/http/http_request.h>
+#include <vtm/net/http/http_response_intl.h>
 #include <vtm/net/http/http_static_route.h>
 
+#define VTM_HTTP_ROUTER_METHODS    (VTM_HTTP_METHOD_CONNECT + 1)
+
+enum vtm_http_router_node_type
+{
+	VTM_HTTP_ROUTER_NODE_STATIC,
+	VTM_HTTP_ROUTER_NODE_PARAM,
+	VTM_HTTP_ROUTER_NODE_WILDCARD
+};
+
+struct vtm_http_router_entry
+{
+	struct vtm_http_route         *rt;
+	struct vtm_http_router_entry  *next;
+
+	/* metrics of the route, NULL if not measured */
+	vtm_http_metrics              *metrics;
+	unsigned int                  metrics_id;
+};
+
+struct vtm_http_router_node
+{
+	enum vtm_http_router_node_type  type;
+
+	/* static: compressed path segment, param/wildcard: parameter name */
+	char                            *label;
+	size_t                          label_len;
+
+	/* static children, indices holds first char of each child label */
+	struct vtm_http_router_node     **children;
+	char                            *indices;
+	size_t                          child_count;
+
+	struct vtm_http_router_node     *param_child;
+	struct vtm_http_router_node     *wildcard_child;
+
+	/* handlers for any method and per method */
+	struct vtm_http_router_entry    *any;
+	struct vtm_http_router_entry    *methods[VTM_HTTP_ROUTER_METHODS];
+};
+
 struct vtm_http_router
 {
-	vtm_list *routes;
+	vtm_list                     *routes;
+	struct vtm_http_router_node  *root;
+	vtm_http_metrics             *metrics;
 };
 
 /* forward declaration */
-static bool vtm_http_router_matches(const char *path, const char *rt_path);
+static int vtm_http_router_add(vtm_http_router *rtr, int method, const char *path, struct vtm_http_route *rt);
+static int vtm_http_router_check_path(const char *path);
+static struct vtm_http_router_node* vtm_http_router_node_new(enum vtm_http_router_node_type type, const char *label, size_t label_len);
+static void vtm_http_router_node_free(struct vtm_http_router_node *node);
+static int vtm_http_router_node_add_child(struct vtm_http_router_node *node, struct vtm_http_router_node *child);
+static struct vtm_http_router_node* vtm_http_router_node_get_child(struct vtm_http_router_node *node, char c, size_t *index);
+static int vtm_http_router_node_split(struct vtm_http_router_node *node, size_t index, size_t len);
+static struct vtm_http_router_node* vtm_http_router_node_insert(struct vtm_http_router_node *node, const char *path);
+static int vtm_http_router_node_match(struct vtm_http_router_node *node, const char *path, struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res);
+static int vtm_http_router_node_call(struct vtm_http_router_node *node, struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res);
+static int vtm_http_router_entry_call(struct vtm_http_router_entry *entry, struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res);
 static void vtm_http_router_http_free_rt(void *val);
 
 vtm_http_router* vtm_http_router_new(void)
@@ -38,6 +92,15 @@ vtm_http_router* vtm_http_router_new(void)
 
 	vtm_list_set_free_func(rtr->routes, vtm_http_router_http_free_rt);
 
+	rtr->root = vtm_http_router_node_new(VTM_HTTP_ROUTER_NODE_STATIC, "", 0);
+	if (!rtr->root) {
+		vtm_list_free(rtr->routes);
+		free(rtr);
+		return NULL;
+	}
+
+	rtr->metrics = NULL;
+
 	return rtr;
 }
 
@@ -46,79 +109,510 @@ void vtm_http_router_free(vtm_http_router *rtr)
 	if (!rtr)
 		return;
 
+	vtm_http_router_node_free(rtr->root);
 	vtm_list_free(rtr->routes);
 	free(rtr);
 }
 
+void vtm_http_router_set_metrics(vtm_http_router *rtr, vtm_http_metrics *metrics)
+{
+	rtr->metrics = metrics;
+}
+
 int vtm_http_router_add_rt(vtm_http_router *rtr, const char *path, struct vtm_http_route *rt)
 {
-	rt->url_path = vtm_str_copy(path);
-	return vtm_list_add_va(rtr->routes, rt);
+	return vtm_http_router_add(rtr, -1, path, rt);
+}
+
+int vtm_http_router_add_rt_method(vtm_http_router *rtr, enum vtm_http_method method, const char *path, struct vtm_http_route *rt)
+{
+	if ((int) method < 0 || method >= VTM_HTTP_ROUTER_METHODS)
+		return vtm_err_set(VTM_E_INVALID_ARG);
+
+	return vtm_http_router_add(rtr, method, path, rt);
 }
 
 int vtm_http_router_static_rt(vtm_http_router *rtr, const char *path, vtm_http_static_rt_handle_fn fn)
 {
+	int rc;
 	struct vtm_http_route *rt;
 
 	rt = vtm_http_static_rt_new(path, fn);
 	if (!rt)
 		return vtm_err_get_code();
 
-	return vtm_http_router_add_rt(rtr, path, rt);
+	rc = vtm_http_router_add_rt(rtr, path, rt);
+	if (rc != VTM_OK)
+		rt->fn_rt_free(rt);
+
+	return rc;
 }
 
-int vtm_http_router_handle(vtm_http_router *rtr, struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
+int vtm_http_router_static_rt_method(vtm_http_router *rtr, enum vtm_http_method method, const char *path, vtm_http_static_rt_handle_fn fn)
 {
 	int rc;
 	struct vtm_http_route *rt;
-	size_t i, rts_count;
 
-	rts_count = vtm_list_size(rtr->routes);
+	rt = vtm_http_static_rt_new(path, fn);
+	if (!rt)
+		return vtm_err_get_code();
+
+	rc = vtm_http_router_add_rt_method(rtr, method, path, rt);
+	if (rc != VTM_OK)
+		rt->fn_rt_free(rt);
+
+	return rc;
+}
+
+int vtm_http_router_handle(vtm_http_router *rtr, struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
+{
+	req->path_param_count = 0;
+
+	if (!req->path)
+		return VTM_E_NOT_HANDLED;
+
+	return vtm_http_router_node_match(rtr->root, req->path, ctx, req, res);
+}
+
+static int vtm_http_router_add(vtm_http_router *rtr, int method, const char *path, struct vtm_http_route *rt)
+{
+	int rc;
+	struct vtm_http_router_node *node;
+	struct vtm_http_router_entry *entry, **slot;
+	char *ipath;
+	size_t len;
+
+	rc = vtm_http_router_check_path(path);
+	if (rc != VTM_OK)
+		return rc;
+
+	/* paths ending with slash also match all subpaths */
+	len = strlen(path);
+	if (path[len-1] == '/') {
+		ipath = malloc(len + 2);
+		if (!ipath) {
+			vtm_err_oom();
+			return vtm_err_get_code();
+		}
+		memcpy(ipath, path, len);
+		ipath[len] = '*';
+		ipath[len+1] = '\0';
+	}
+	else {
+		ipath = (char*) path;
+	}
+
+	node = vtm_http_router_node_insert(rtr->root, ipath);
+	if (ipath != path)
+		free(ipath);
+
+	if (!node)
+		return vtm_err_get_code();
+
+	entry = malloc(sizeof(*entry));
+	if (!entry) {
+		vtm_err_oom();
+		return vtm_err_get_code();
+	}
+
+	entry->metrics = rtr->metrics;
+	entry->metrics_id = 0;
+	if (entry->metrics) {
+		rc = vtm_http_metrics_register(entry->metrics, method, path, &entry->metrics_id);
+		if (rc != VTM_OK) {
+			free(entry);
+			return rc;
+		}
+	}
+
+	rt->url_path = vtm_str_copy(path);
+	if (!rt->url_path) {
+		free(entry);
+		return vtm_err_get_code();
+	}
+
+	rc = vtm_list_add_va(rtr->routes, rt);
+	if (rc != VTM_OK) {
+		free(rt->url_path);
+		free(entry);
+		return rc;
+	}
+
+	/* append to slot, earlier added routes are tried first */
+	slot = (method < 0) ? &node->any : &node->methods[method];
+	while (*slot)
+		slot = &(*slot)->next;
+
+	entry->rt = rt;
+	entry->next = NULL;
+	*slot = entry;
+
+	return VTM_OK;
+}
+
+static int vtm_http_router_check_path(const char *path)
+{
+	const char *p;
+	unsigned int params;
+
+	if (!path || *path != '/')
+		return vtm_err_set(VTM_E_INVALID_ARG);
+
+	params = 0;
+	for (p=path; *p != '\0'; p++) {
+		switch (*p) {
+			case ':':
+				/* parameter must span a whole segment and have a name */
+				if (*(p-1) != '/' || *(p+1) == '/' || *(p+1) == '\0')
+					return vtm_err_set(VTM_E_INVALID_ARG);
+				while (*(p+1) != '/' && *(p+1) != '\0') {
+					p++;
+					if (*p == ':' || *p == '*')
+						return vtm_err_set(VTM_E_INVALID_ARG);
+				}
+				params++;
+				break;
+
+			case '*':
+				/* wildcard must begin a segment and be the last element */
+				if (*(p-1) != '/' || strchr(p, '/') != NULL)
+					return vtm_err_set(VTM_E_INVALID_ARG);
+				params++;
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	/* slash suffix is converted to a wildcard */
+	if (*(p-1) == '/')
+		params++;
+
+	if (params > VTM_HTTP_REQ_MAX_PATH_PARAMS)
+		return vtm_err_set(VTM_E_INVALID_ARG);
+
+	return VTM_OK;
+}
+
+static struct vtm_http_router_node* vtm_http_router_node_new(enum vtm_http_router_node_type type, const char *label, size_t label_len)
+{
+	struct vtm_http_router_node *node;
+
+	node = calloc(1, sizeof(*node));
+	if (!node) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	node->label = vtm_str_ncopy(label, label_len);
+	if (!node->label) {
+		free(node);
+		return NULL;
+	}
+
+	node->type = type;
+	node->label_len = label_len;
+
+	return node;
+}
+
+static void vtm_http_router_node_free(struct vtm_http_router_node *node)
+{
+	size_t i;
+	struct vtm_http_router_entry *entry, *next;
+
+	if (!node)
+		return;
 
-	for (i=0; i < rts_count; i++) {
-		rt = vtm_list_get_pointer(rtr->routes, i);
+	for (i=0; i < node->child_count; i++)
+		vtm_http_router_node_free(node->children[i]);
 
-		if (!vtm_http_router_matches(req->path, rt->url_path))
+	vtm_http_router_node_free(node->param_child);
+	vtm_http_router_node_free(node->wildcard_child);
+
+	for (i=0; i <= VTM_HTTP_ROUTER_METHODS; i++) {
+		entry = (i == VTM_HTTP_ROUTER_METHODS) ? node->any : node->methods[i];
+		while (entry) {
+			next = entry->next;
+			free(entry);
+			entry = next;
+		}
+	}
+
+	free(node->children);
+	free(node->indices);
+	free(node->label);
+	free(node);
+}
+
+static int vtm_http_router_node_add_child(struct vtm_http_router_node *node, struct vtm_http_router_node *child)
+{
+	struct vtm_http_router_node **children;
+	char *indices;
+
+	children = realloc(node->children, sizeof(*children) * (node->child_count + 1));
+	if (!children) {
+		vtm_err_oom();
+		return vtm_err_get_code();
+	}
+	node->children = children;
+
+	indices = realloc(node->indices, node->child_count + 1);
+	if (!indices) {
+		vtm_err_oom();
+		return vtm_err_get_code();
+	}
+	node->indices = indices;
+
+	node->children[node->child_count] = child;
+	node->indices[node->child_count] = child->label[0];
+	node->child_count++;
+
+	return VTM_OK;
+}
+
+static struct vtm_http_router_node* vtm_http_router_node_get_child(struct vtm_http_router_node *node, char c, size_t *index)
+{
+	const char *found;
+
+	if (node->child_count == 0)
+		return NULL;
+
+	found = memchr(node->indices, c, node->child_count);
+	if (!found)
+		return NULL;
+
+	*index = found - node->indices;
+
+	return node->children[*index];
+}
+
+static int vtm_http_router_node_split(struct vtm_http_router_node *node, size_t index, size_t len)
+{
+	struct vtm_http_router_node *child, *split;
+	char *label;
+
+	child = node->children[index];
+
+	split = vtm_http_router_node_new(VTM_HTTP_ROUTER_NODE_STATIC, child->label, len);
+	if (!split)
+		return vtm_err_get_code();
+
+	label = vtm_str_copy(child->label + len);
+	if (!label) {
+		vtm_http_router_node_free(split);
+		return vtm_err_get_code();
+	}
+
+	split->children = malloc(sizeof(*split->children));
+	split->indices = malloc(1);
+	if (!split->children || !split->indices) {
+		vtm_err_oom();
+		free(label);
+		vtm_http_router_node_free(split);
+		return vtm_err_get_code();
+	}
+
+	/* child keeps the remaining suffix */
+	free(child->label);
+	child->label = label;
+	child->label_len -= len;
+
+	split->children[0] = child;
+	split->indices[0] = label[0];
+	split->child_count = 1;
+
+	node->children[index] = split;
+
+	return VTM_OK;
+}
+
+static struct vtm_http_router_node* vtm_http_router_node_insert(struct vtm_http_router_node *node, const char *path)
+{
+	struct vtm_http_router_node *child;
+	const char *end;
+	size_t len, common, index;
+
+	while (*path != '\0') {
+		/* parameter */
+		if (*path == ':') {
+			path++;
+			end = strchr(path, '/');
+			len = end ? (size_t) (end - path) : strlen(path);
+
+			if (!node->param_child) {
+				node->param_child = vtm_http_router_node_new(VTM_HTTP_ROUTER_NODE_PARAM, path, len);
+				if (!node->param_child)
+					return NULL;
+			}
+			else if (node->param_child->label_len != len ||
+				strncmp(node->param_child->label, path, len) != 0) {
+				/* conflicting parameter names at same position */
+				vtm_err_set(VTM_E_INVALID_ARG);
+				return NULL;
+			}
+
+			node = node->param_child;
+			path += len;
 			continue;
+		}
 
-		rc = rt->fn_rt_handle(rt, ctx, req, res);
+		/* wildcard */
+		if (*path == '*') {
+			path++;
+			len = strlen(path);
+
+			if (!node->wildcard_child) {
+				node->wildcard_child = vtm_http_router_node_new(VTM_HTTP_ROUTER_NODE_WILDCARD, path, len);
+				if (!node->wildcard_child)
+					return NULL;
+			}
+			else if (strcmp(node->wildcard_child->label, path) != 0) {
+				/* conflicting wildcard names at same position */
+				vtm_err_set(VTM_E_INVALID_ARG);
+				return NULL;
+			}
+
+			return node->wildcard_child;
+		}
+
+		/* static segment up to next parameter or wildcard */
+		len = strcspn(path, ":*");
+
+		child = vtm_http_router_node_get_child(node, *path, &index);
+		if (!child) {
+			child = vtm_http_router_node_new(VTM_HTTP_ROUTER_NODE_STATIC, path, len);
+			if (!child)
+				return NULL;
+
+			if (vtm_http_router_node_add_child(node, child) != VTM_OK) {
+				vtm_http_router_node_free(child);
+				return NULL;
+			}
+
+			node = child;
+			path += len;
+			continue;
+		}
+
+		/* longest common prefix */
+		common = 0;
+		while (common < len && common < child->label_len &&
+			path[common] == child->label[common])
+			common++;
+
+		if (common < child->label_len) {
+			if (vtm_http_router_node_split(node, index, common) != VTM_OK)
+				return NULL;
+			child = node->children[index];
+		}
+
+		node = child;
+		path += common;
+	}
+
+	return node;
+}
+
+static int vtm_http_router_node_match(struct vtm_http_router_node *node, const char *path, struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
+{
+	int rc;
+	struct vtm_http_router_node *child;
+	struct vtm_http_path_param *param;
+	const char *end;
+	size_t index, len;
+
+	if (*path == '\0') {
+		rc = vtm_http_router_node_call(node, ctx, req, res);
+		if (rc != VTM_E_NOT_HANDLED)
+			return rc;
+	}
+	else {
+		/* static children first */
+		child = vtm_http_router_node_get_child(node, *path, &index);
+		if (child && strncmp(child->label, path, child->label_len) == 0) {
+			rc = vtm_http_router_node_match(child, path + child->label_len, ctx, req, res);
+			if (rc != VTM_E_NOT_HANDLED)
+				return rc;
+		}
+
+		/* then parameter, which must not be empty */
+		if (node->param_child && *path != '/') {
+			end = strchr(path, '/');
+			len = end ? (size_t) (end - path) : strlen(path);
+
+			param = &req->path_params[req->path_param_count++];
+			param->name = node->param_child->label;
+			param->val = path;
+			param->len = len;
+
+			rc = vtm_http_router_node_match(node->param_child, path + len, ctx, req, res);
+			if (rc != VTM_E_NOT_HANDLED)
+				return rc;
+			req->path_param_count--;
+		}
+	}
+
+	/* wildcard as last resort, may be empty */
+	if (node->wildcard_child) {
+		param = &req->path_params[req->path_param_count++];
+		param->name = node->wildcard_child->label;
+		param->val = path;
+		param->len = strlen(path);
+
+		rc = vtm_http_router_node_call(node->wildcard_child, ctx, req, res);
 		if (rc != VTM_E_NOT_HANDLED)
 			return rc;
+		req->path_param_count--;
 	}
 
 	return VTM_E_NOT_HANDLED;
 }
 
-static void vtm_http_router_http_free_rt(void *val)
+static int vtm_http_router_node_call(struct vtm_http_router_node *node, struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
 {
-	struct vtm_http_route *rt;
+	int rc;
+	struct vtm_http_router_entry *entry;
 
-	rt = val;
-	free(rt->url_path);
-	rt->fn_rt_free(rt);
+	if ((int) req->method >= 0 && req->method < VTM_HTTP_ROUTER_METHODS) {
+		for (entry = node->methods[req->method]; entry; entry = entry->next) {
+			rc = vtm_http_router_entry_call(entry, ctx, req, res);
+			if (rc != VTM_E_NOT_HANDLED)
+				return rc;
+		}
+	}
+
+	for (entry = node->any; entry; entry = entry->next) {
+		rc = vtm_http_router_entry_call(entry, ctx, req, res);
+		if (rc != VTM_E_NOT_HANDLED)
+			return rc;
+	}
+
+	return VTM_E_NOT_HANDLED;
 }
 
-static bool vtm_http_router_matches(const char *path, const char *rt_path)
+static int vtm_http_router_entry_call(struct vtm_http_router_entry *entry, struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
 {
-	int num;
+	int rc;
+	uint64_t start;
 
-	num = 0;
-	while (*path == *rt_path) {
-		if (*path == '\0' || *rt_path == '\0')
-			break;
+	if (!entry->metrics)
+		return entry->rt->fn_rt_handle(entry->rt, ctx, req, res);
 
-		path++;
-		rt_path++;
-		num++;
-	}
+	start = vtm_http_metrics_begin(entry->metrics, entry->metrics_id);
+	rc = entry->rt->fn_rt_handle(entry->rt, ctx, req, res);
+	vtm_http_metrics_end(entry->metrics, entry->metrics_id, start,
+		rc == VTM_E_NOT_HANDLED ? -1 : vtm_http_res_get_status(res));
 
-	/* exact match */
-	if (*path == *rt_path)
-		return true;
+	return rc;
+}
 
-	/* route path ends with / and matches path so far */
-	if (num > 0 && *rt_path == '\0'	&& *(rt_path-1) == '/' && *(path-1) == '/')
-		return true;
+static void vtm_http_router_http_free_rt(void *val)
+{
+	struct vtm_http_route *rt;
 
-	return false;
+	rt = val;
+	free(rt->url_path);
+	rt->fn_rt_free(rt);
 }
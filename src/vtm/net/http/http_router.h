@@ -6,13 +6,33 @@
  * @file http_router.h
  *
  * @brief HTTP router
+ *
+ * Routes are stored in a compressed radix tree, so the lookup cost only
+ * depends on the length of the request path and not on the number of
+ * routes.
+ *
+ * Route paths may contain following elements:
+ * - static text, for example /users/list
+ * - named parameters spanning a whole segment, for example /users/:id
+ * - a trailing wildcard that matches the rest of the path, for example
+ *   /static/ *name (without the space)
+ *
+ * A path ending with a slash additionally matches all of its subpaths.
+ * When multiple routes match a request, static segments are preferred
+ * over parameters and parameters over wildcards. If a route returns
+ * VTM_E_NOT_HANDLED the next matching route is tried.
+ *
+ * Captured parameters are available in the handler via
+ * vtm_http_req_get_path_param().
  */
 
 #ifndef VTM_NET_HTTP_HTTP_ROUTER_H_
 #define VTM_NET_HTTP_HTTP_ROUTER_H_
 
 #include <vtm/core/api.h>
+#include <vtm/net/http/http.h>
 #include <vtm/net/http/http_context.h>
+#include <vtm/net/http/http_metrics.h>
 #include <vtm/net/http/http_route.h>
 #include <vtm/net/http/http_static_route.h>
 
@@ -40,17 +60,48 @@ VTM_API vtm_http_router* vtm_http_router_new(void);
  */
 VTM_API void vtm_http_router_free(vtm_http_router *rtr);
 
+/**
+ * Enables per-route metrics.
+ *
+ * Only routes that are added after this call are measured, so it
+ * should be called right after creating the router. The router does
+ * not take over the metrics, they must be released after the router.
+ *
+ * @param rtr the router
+ * @param metrics the metrics where the requests are recorded
+ */
+VTM_API void vtm_http_router_set_metrics(vtm_http_router *rtr, vtm_http_metrics *metrics);
+
 /**
  * Binds the route to the given URL path.
  *
+ * The route handles requests with any method.
+ *
  * @param rtr the router where the route should be added
  * @param path the URL path where the route should be bound to
  * @param rt the route that should be added
  * @return VTM_OK if the route was added successfully
+ * @return VTM_E_INVALID_ARG if the path is malformed or conflicts with
+ *         the parameter names of a previously added route
  * @return VTM_ERROR if an error occured
  */
 VTM_API int vtm_http_router_add_rt(vtm_http_router *rtr, const char *path, struct vtm_http_route *rt);
 
+/**
+ * Binds the route to the given URL path for a single method.
+ *
+ * Method specific routes are tried before routes that handle any method.
+ *
+ * @param rtr the router where the route should be added
+ * @param method the HTTP method the route should handle
+ * @param path the URL path where the route should be bound to
+ * @param rt the route that should be added
+ * @return VTM_OK if the route was added successfully
+ * @return VTM_E_INVALID_ARG if the method or path is invalid
+ * @return VTM_ERROR if an error occured
+ */
+VTM_API int vtm_http_router_add_rt_method(vtm_http_router *rtr, enum vtm_http_method method, const char *path, struct vtm_http_route *rt);
+
 /**
  * Adds a static route for the given path.
  *
@@ -62,6 +113,19 @@ VTM_API int vtm_http_router_add_rt(vtm_http_router *rtr, const char *path, struc
  */
 VTM_API int vtm_http_router_static_rt(vtm_http_router *rtr, const char *path, vtm_http_static_rt_handle_fn fn);
 
+/**
+ * Adds a static route for the given path and a single method.
+ *
+ * @param rtr the router where the route should be added
+ * @param method the HTTP method the route should handle
+ * @param path the URL path where the route should be bound to
+ * @param fn the callback function that should handle the route
+ * @return VTM_OK if the route was added successfully
+ * @return VTM_E_INVALID_ARG if the method or path is invalid
+ * @return VTM_ERROR if an error occured
+ */
+VTM_API int vtm_http_router_static_rt_method(vtm_http_router *rtr, enum vtm_http_method method, const char *path, vtm_http_static_rt_handle_fn fn);
+
 /**
  * Lets the router handle a given request.
  *
@@ -4,20 +4,28 @@
 
 #include "http_server.h"
 
-#include <string.h> /* memset() */
+#include <string.h> /* memset(), memcpy(), strcmp(), strlen() */
 #include <vtm/core/error.h>
 #include <vtm/core/lang.h>
+#include <vtm/core/string.h>
 #include <vtm/net/socket_stream_server.h>
+#include <vtm/net/http/http_access_log_intl.h>
 #include <vtm/net/http/http_connection_intl.h>
 #include <vtm/net/http/http_connection_base_intl.h>
+#include <vtm/net/http/http_memory_intl.h>
+#include <vtm/net/http/http2_connection_intl.h>
 #include <vtm/net/http/http_request.h>
 #include <vtm/net/http/http_request_intl.h>
 #include <vtm/net/http/http_response_intl.h>
+#include <vtm/net/http/http_sse_intl.h>
 #include <vtm/net/http/ws_connection_intl.h>
+#include <vtm/net/http/ws_keepalive_intl.h>
 #include <vtm/net/http/ws_message_intl.h>
 #include <vtm/util/spinlock.h>
+#include <vtm/util/time.h>
 
 #define VTM_HTTP_WD_RESPONSE          "_RESPONSE"
+#define VTM_HTTP_WD_ACCESS_LOG        "_ACCESS_LOG"
 
 struct vtm_http_srv
 {
@@ -25,6 +33,9 @@ struct vtm_http_srv
 	struct vtm_http_srv_opts  *opts;
 	struct vtm_http_srv_cbs   cbs;
 	vtm_http_mem              *mem;
+	vtm_http_access_log       *access_log;
+	uint64_t                  access_log_dropped;
+	vtm_ws_keepalive          *ws_keepalive;
 	struct vtm_spinlock       stop_lock;
 };
 
@@ -32,13 +43,25 @@ struct vtm_http_srv
 static void vtm_http_srv_init_callbacks(struct vtm_socket_stream_srv_cbs *cbs);
 static enum vtm_socket_family vtm_http_srv_determine_sock_family(const char *addr);
 static VTM_INLINE void vtm_http_srv_fill_ctx(vtm_http_srv *srv, struct vtm_http_ctx *ctx, vtm_dataset *wd);
+static void vtm_http_srv_log_access(vtm_dataset *wd, vtm_socket *sock, struct vtm_http_req *req, vtm_http_res *res, uint64_t begin);
 
 /* http connection */
 static bool vtm_http_srv_http_handle_request(vtm_http_srv *srv, vtm_dataset *wd, struct vtm_http_con_base *bcon);
+static bool vtm_http_srv_http_dispatch(vtm_http_srv *srv, vtm_dataset *wd, vtm_http_con *con, struct vtm_http_req *req);
+static bool vtm_http_srv_http_handle_body(vtm_http_srv *srv, vtm_dataset *wd, vtm_http_con *con);
+static bool vtm_http_srv_http_finish(vtm_http_srv *srv, vtm_dataset *wd, vtm_http_con *con, vtm_http_res *res);
+static int vtm_http_srv_http_continue(vtm_http_con *con, struct vtm_http_req *req);
 static void vtm_http_srv_http_con_upgrade_ws(vtm_http_srv *srv, vtm_dataset *wd, vtm_http_con *con, vtm_http_res *res);
 
+/* http2 connection */
+static bool vtm_http_srv_http_is_h2c(struct vtm_http_req *req);
+static bool vtm_http_srv_http_upgrade_h2(vtm_http_srv *srv, vtm_dataset *wd, vtm_http_con *con, struct vtm_http_req *req);
+static bool vtm_http_srv_h2_handle_request(vtm_http_srv *srv, vtm_dataset *wd, struct vtm_http_con_base *bcon);
+static void vtm_http_srv_h2_dispatch(vtm_http_srv *srv, vtm_dataset *wd, vtm_http2_con *con, struct vtm_http_req *req, uint32_t stream_id);
+
 /* ws connection */
 static bool vtm_http_srv_ws_handle_request(vtm_http_srv *srv, vtm_dataset *wd, struct vtm_http_con_base *bcon);
+static void vtm_http_srv_ws_congestion(void *arg, vtm_ws_con *con, bool congested);
 
 /* forward declaration callbacks */
 static void vtm_http_srv_server_ready(vtm_socket_stream_srv *sock_srv, struct vtm_socket_stream_srv_opts *opts);
@@ -83,10 +106,33 @@ int vtm_http_srv_run(vtm_http_srv *srv, struct vtm_http_srv_opts *opts)
 
 	/* create stream server */
 	vtm_spinlock_lock(&srv->stop_lock);
+	srv->mem = vtm_http_mem_new(&opts->mem);
+	if (!srv->mem) {
+		rc = vtm_err_get_code();
+		goto unlock;
+	}
+
+	srv->access_log_dropped = 0;
+	if (opts->access_log.path) {
+		srv->access_log = vtm_http_access_log_new(&opts->access_log);
+		if (!srv->access_log) {
+			rc = vtm_err_get_code();
+			goto free_mem;
+		}
+	}
+
+	if (opts->ws_con.ping_interval > 0) {
+		srv->ws_keepalive = vtm_ws_keepalive_new(&opts->ws_con);
+		if (!srv->ws_keepalive) {
+			rc = vtm_err_get_code();
+			goto free_log;
+		}
+	}
+
 	srv->sock_srv = vtm_socket_stream_srv_new();
 	if (!srv->sock_srv) {
 		rc = vtm_err_get_code();
-		goto unlock;
+		goto free_keepalive;
 	}
 
 	/* set callbacks */
@@ -101,9 +147,13 @@ int vtm_http_srv_run(vtm_http_srv *srv, struct vtm_http_srv_opts *opts)
 	stream_opts.addr.host = opts->host;
 	stream_opts.addr.port = opts->port;
 	stream_opts.tls = opts->tls;
+	if (opts->http2 && opts->tls.enabled && !stream_opts.tls.alpn)
+		stream_opts.tls.alpn = VTM_HTTP2_ALPN;
 	stream_opts.backlog = opts->backlog;
 	stream_opts.events = opts->events;
 	stream_opts.threads = opts->threads;
+	stream_opts.max_cons = opts->max_cons;
+	stream_opts.max_cons_per_ip = opts->max_cons_per_ip;
 
 	/* run stream server */
 	vtm_socket_stream_srv_set_usr_data(srv->sock_srv, srv);
@@ -117,6 +167,21 @@ int vtm_http_srv_run(vtm_http_srv *srv, struct vtm_http_srv_opts *opts)
 	vtm_socket_stream_srv_free(srv->sock_srv);
 	srv->sock_srv = NULL;
 
+free_keepalive:
+	vtm_ws_keepalive_free(srv->ws_keepalive);
+	srv->ws_keepalive = NULL;
+
+free_log:
+	if (srv->access_log) {
+		srv->access_log_dropped = vtm_http_access_log_get_dropped(srv->access_log);
+		vtm_http_access_log_free(srv->access_log);
+		srv->access_log = NULL;
+	}
+
+free_mem:
+	vtm_http_mem_free(srv->mem);
+	srv->mem = NULL;
+
 unlock:
 	vtm_spinlock_unlock(&srv->stop_lock);
 
@@ -139,6 +204,22 @@ int vtm_http_srv_stop(vtm_http_srv *srv)
 	return rc;
 }
 
+uint64_t vtm_http_srv_get_access_log_dropped(vtm_http_srv *srv)
+{
+	uint64_t result;
+
+	vtm_spinlock_lock(&srv->stop_lock);
+
+	if (srv->access_log)
+		result = vtm_http_access_log_get_dropped(srv->access_log);
+	else
+		result = srv->access_log_dropped;
+
+	vtm_spinlock_unlock(&srv->stop_lock);
+
+	return result;
+}
+
 static enum vtm_socket_family vtm_http_srv_determine_sock_family(const char *addr)
 {
 	const char *p;
@@ -175,6 +256,22 @@ static int vtm_http_srv_con_create(vtm_http_srv *srv, vtm_socket *sock)
 		return VTM_ERROR;
 
 	((struct vtm_http_con_base*) con)->con_handle_req = vtm_http_srv_http_handle_request;
+	vtm_http_con_set_stream_body(con, srv->cbs.http_body != NULL);
+	vtm_http_con_set_h2_detect(con, srv->opts->http2);
+	vtm_socket_set_usr_data(sock, con);
+
+	return VTM_OK;
+}
+
+static int vtm_http_srv_h2_con_create(vtm_http_srv *srv, vtm_socket *sock)
+{
+	vtm_http2_con *con;
+
+	con = vtm_http2_con_new(sock);
+	if (!con)
+		return vtm_err_get_code();
+
+	((struct vtm_http_con_base*) con)->con_handle_req = vtm_http_srv_h2_handle_request;
 	vtm_socket_set_usr_data(sock, con);
 
 	return VTM_OK;
@@ -182,10 +279,24 @@ static int vtm_http_srv_con_create(vtm_http_srv *srv, vtm_socket *sock)
 
 static int vtm_http_srv_ws_con_create(vtm_http_srv *srv, vtm_socket *sock, vtm_ws_con **con)
 {
+	int rc;
+
 	*con = vtm_ws_con_new(VTM_WS_MODE_SERVER, sock);
 	if (!*con)
 		return vtm_err_get_code();
 
+	vtm_ws_con_set_opts(*con, &srv->opts->ws_con);
+	if (srv->cbs.ws_congestion)
+		vtm_ws_con_set_congestion_cb(*con, vtm_http_srv_ws_congestion, srv);
+
+	if (srv->ws_keepalive) {
+		rc = vtm_ws_keepalive_add(srv->ws_keepalive, *con);
+		if (rc != VTM_OK) {
+			vtm_ws_con_free(*con);
+			return rc;
+		}
+	}
+
 	((struct vtm_http_con_base*) *con)->con_handle_req = vtm_http_srv_ws_handle_request;
 	vtm_socket_set_usr_data(sock, *con);
 
@@ -225,11 +336,20 @@ static void vtm_http_srv_worker_init(vtm_socket_stream_srv *sock_srv, vtm_datase
 	vtm_http_res *res;
 	struct vtm_http_ctx ctx;
 
+	srv = vtm_socket_stream_srv_get_usr_data(sock_srv);
+	VTM_ASSERT(srv);
+
 	res = vtm_http_res_new();
+	if (res) {
+		vtm_http_res_set_compress_opts(res, &srv->opts->compress);
+		vtm_http_res_set_ws_deflate_opts(res, &srv->opts->ws_deflate);
+	}
 	vtm_dataset_set_pointer(wd, VTM_HTTP_WD_RESPONSE, res);
 
-	srv = vtm_socket_stream_srv_get_usr_data(sock_srv);
-	VTM_ASSERT(srv);
+	/* without a ring the requests of this worker are not logged */
+	if (srv->access_log)
+		vtm_dataset_set_pointer(wd, VTM_HTTP_WD_ACCESS_LOG,
+			vtm_http_access_log_add_ring(srv->access_log));
 
 	if (srv->cbs.worker_init) {
 		vtm_http_srv_fill_ctx(srv, &ctx, wd);
@@ -246,6 +366,9 @@ static void vtm_http_srv_worker_end(vtm_socket_stream_srv *sock_srv, vtm_dataset
 	res = vtm_dataset_get_pointer(wd, VTM_HTTP_WD_RESPONSE);
 	vtm_http_res_free(res);
 
+	/* cached websocket message buffers of this worker */
+	vtm_ws_msg_pool_clear();
+
 	srv = vtm_socket_stream_srv_get_usr_data(sock_srv);
 	VTM_ASSERT(srv);
 
@@ -258,11 +381,21 @@ static void vtm_http_srv_worker_end(vtm_socket_stream_srv *sock_srv, vtm_dataset
 static void vtm_http_srv_sock_connected(vtm_socket_stream_srv *sock_srv, vtm_dataset *wd, vtm_socket *sock)
 {
 	vtm_http_srv *srv;
+	char proto[16];
 
 	vtm_socket_set_opt(sock, VTM_SOCK_OPT_TCP_NODELAY, (bool[]) {true}, sizeof(bool));
 	vtm_socket_set_state(sock, VTM_SOCK_STAT_NBL_AUTO | VTM_SOCK_STAT_NBL_READ);
 
 	srv = vtm_socket_stream_srv_get_usr_data(sock_srv);
+
+	/* protocol was negotiated during TLS handshake */
+	if (srv->opts->http2 && srv->opts->tls.enabled &&
+		vtm_socket_get_opt(sock, VTM_SOCK_OPT_TLS_ALPN, proto, sizeof(proto)) == VTM_OK &&
+		strcmp(proto, VTM_HTTP2_ALPN_ID) == 0) {
+		vtm_http_srv_h2_con_create(srv, sock);
+		return;
+	}
+
 	vtm_http_srv_con_create(srv, sock);
 }
 
@@ -276,11 +409,12 @@ static void vtm_http_srv_sock_can_read(vtm_socket_stream_srv *sock_srv, vtm_data
 	srv = vtm_socket_stream_srv_get_usr_data(sock_srv);
 	VTM_ASSERT(srv);
 
-	con = vtm_socket_get_usr_data(sock);
-	VTM_ASSERT(con);
-
 	loop = true;
 	while (loop) {
+		/* connection may have been replaced by an upgrade */
+		con = vtm_socket_get_usr_data(sock);
+		VTM_ASSERT(con);
+
 		stat =  con->con_can_read(con);
 		switch (stat) {
 			case VTM_NET_RECV_STAT_ERROR:
@@ -326,6 +460,7 @@ static void vtm_http_srv_sock_unregister(vtm_socket_stream_srv *sock_srv, vtm_da
 	vtm_http_srv *srv;
 	struct vtm_http_con_base *con;
 	struct vtm_http_ctx ctx;
+	struct vtm_http_req *req;
 
 	srv = vtm_socket_stream_srv_get_usr_data(sock_srv);
 	VTM_ASSERT(srv);
@@ -336,6 +471,13 @@ static void vtm_http_srv_sock_unregister(vtm_socket_stream_srv *sock_srv, vtm_da
 
 	switch (con->type) {
 		case VTM_HTTP_CON_TYPE_H1:
+			req = vtm_http_con_get_stream_request((vtm_http_con*) con);
+			if (req) {
+				vtm_http_srv_fill_ctx(srv, &ctx, wd);
+				srv->cbs.http_body(&ctx, req,
+					vtm_http_con_get_stream_response((vtm_http_con*) con),
+					NULL, 0, VTM_HTTP_REQ_BODY_ABORTED);
+			}
 			vtm_http_con_free((vtm_http_con*) con);
 			break;
 
@@ -344,8 +486,18 @@ static void vtm_http_srv_sock_unregister(vtm_socket_stream_srv *sock_srv, vtm_da
 				vtm_http_srv_fill_ctx(srv, &ctx, wd);
 				srv->cbs.ws_close(&ctx, (vtm_ws_con*) con);
 			}
+			if (srv->ws_keepalive)
+				vtm_ws_keepalive_remove(srv->ws_keepalive, (vtm_ws_con*) con);
 			vtm_ws_con_free((vtm_ws_con*) con);
 			break;
+
+		case VTM_HTTP_CON_TYPE_H2:
+			vtm_http2_con_free((vtm_http2_con*) con);
+			break;
+
+		case VTM_HTTP_CON_TYPE_SSE:
+			vtm_http_sse_detach((vtm_http_sse*) con);
+			break;
 	}
 }
 
@@ -353,22 +505,180 @@ static bool vtm_http_srv_http_handle_request(vtm_http_srv *srv, vtm_dataset *wd,
 {
 	int rc;
 	vtm_http_con *con;
-	struct vtm_http_ctx ctx;
 	struct vtm_http_req req;
-	vtm_http_res *res;
-	enum vtm_http_res_act act;
 
 	con = (vtm_http_con*) bcon;
+
+	/* HTTP/2 with prior knowledge */
+	if (vtm_http_con_has_h2_preface(con))
+		return vtm_http_srv_http_upgrade_h2(srv, wd, con, NULL);
+
+	/* request with streamed body */
+	if (vtm_http_con_in_stream(con))
+		return vtm_http_srv_http_handle_body(srv, wd, con);
+
 	rc = vtm_http_con_get_request(con, &req);
 	if (rc != VTM_OK)
 		return false;
 
+	/* h2c upgrade, the request is answered on stream 1 */
+	if (srv->opts->http2 && vtm_http_srv_http_is_h2c(&req))
+		return vtm_http_srv_http_upgrade_h2(srv, wd, con, &req);
+
+	return vtm_http_srv_http_dispatch(srv, wd, con, &req);
+}
+
+static bool vtm_http_srv_http_dispatch(vtm_http_srv *srv, vtm_dataset *wd, vtm_http_con *con, struct vtm_http_req *req)
+{
+	struct vtm_http_ctx ctx;
+	vtm_http_res *res;
+	uint64_t begin;
+
 	res = vtm_dataset_get_pointer(wd, VTM_HTTP_WD_RESPONSE);
-	vtm_http_res_prepare(res, &req);
+	vtm_http_res_prepare(res, req);
+
+	begin = srv->access_log ? vtm_time_current_micros() : 0;
+
+	vtm_http_srv_fill_ctx(srv, &ctx, wd);
+	if (!srv->opts->ratelimit || vtm_http_ratelimit_allow(srv->opts->ratelimit, req, res))
+		srv->cbs.http_request(&ctx, req, res);
+
+	if (srv->access_log)
+		vtm_http_srv_log_access(wd, vtm_http_con_get_socket(con), req, res, begin);
+
+	vtm_http_req_release(req);
+
+	return vtm_http_srv_http_finish(srv, wd, con, res);
+}
+
+static bool vtm_http_srv_http_handle_body(vtm_http_srv *srv, vtm_dataset *wd, vtm_http_con *con)
+{
+	int rc;
+	struct vtm_http_ctx ctx;
+	struct vtm_http_req *req;
+	vtm_http_res *res;
+	enum vtm_net_recv_stat stat;
+	const void *data;
+	size_t len;
 
 	vtm_http_srv_fill_ctx(srv, &ctx, wd);
-	srv->cbs.http_request(&ctx, &req, res);
-	vtm_http_req_release(&req);
+
+	req = vtm_http_con_get_stream_request(con);
+	res = vtm_http_con_get_stream_response(con);
+
+	/* headers complete, body follows */
+	if (!req) {
+		rc = vtm_http_con_begin_stream(con, &req, &res);
+		if (rc != VTM_OK) {
+			vtm_socket_close(vtm_http_con_get_socket(con));
+			return false;
+		}
+
+		vtm_http_res_set_compress_opts(res, &srv->opts->compress);
+		vtm_http_res_set_ws_deflate_opts(res, &srv->opts->ws_deflate);
+		vtm_http_res_prepare(res, req);
+
+		if (srv->access_log)
+			vtm_http_con_set_stream_begin(con, vtm_time_current_micros());
+
+		if (!srv->opts->ratelimit || vtm_http_ratelimit_allow(srv->opts->ratelimit, req, res))
+			srv->cbs.http_request(&ctx, req, res);
+
+		/* early response like 413 or 429 without reading the body */
+		if (vtm_http_res_was_sent(res) &&
+			vtm_http_res_get_action(res) == VTM_HTTP_RES_ACT_CLOSE_CON) {
+			if (srv->access_log)
+				vtm_http_srv_log_access(wd, vtm_http_con_get_socket(con), req, res,
+					vtm_http_con_get_stream_begin(con));
+			vtm_socket_close(vtm_http_con_get_socket(con));
+			return false;
+		}
+
+		/* handler accepted the body */
+		if (!vtm_http_res_was_started(res)) {
+			rc = vtm_http_srv_http_continue(con, req);
+			if (rc != VTM_OK) {
+				vtm_socket_close(vtm_http_con_get_socket(con));
+				return false;
+			}
+		}
+	}
+
+	while (true) {
+		stat = vtm_http_con_get_body(con, &data, &len);
+		switch (stat) {
+			case VTM_NET_RECV_STAT_AGAIN:
+				if (len == 0)
+					return true;
+				break;
+
+			case VTM_NET_RECV_STAT_COMPLETE:
+				rc = srv->cbs.http_body(&ctx, req, res, data, len, VTM_HTTP_REQ_BODY_LAST);
+				switch (rc) {
+					case VTM_OK:
+						break;
+
+					case VTM_E_IO_AGAIN:
+						/* nothing left to pause, unsent response closes below */
+						break;
+
+					default:
+						vtm_socket_close(vtm_http_con_get_socket(con));
+						return false;
+				}
+				if (srv->access_log)
+					vtm_http_srv_log_access(wd, vtm_http_con_get_socket(con), req, res,
+						vtm_http_con_get_stream_begin(con));
+				vtm_http_con_end_stream(con);
+				return vtm_http_srv_http_finish(srv, wd, con, res);
+
+			default:
+				vtm_socket_close(vtm_http_con_get_socket(con));
+				return false;
+		}
+
+		rc = srv->cbs.http_body(&ctx, req, res, data, len, VTM_HTTP_REQ_BODY_MORE);
+		switch (rc) {
+			case VTM_OK:
+				break;
+
+			case VTM_E_IO_AGAIN:
+				/* next read of connection sees the pause */
+				if (vtm_socket_pause_read(vtm_http_con_get_socket(con)))
+					return true;
+				break;
+
+			default:
+				vtm_socket_close(vtm_http_con_get_socket(con));
+				return false;
+		}
+	}
+}
+
+static int vtm_http_srv_http_continue(vtm_http_con *con, struct vtm_http_req *req)
+{
+	const char *val;
+	struct vtm_socket_emitter *se;
+	static const char interim[] = "HTTP/1.1 100 Continue\r\n\r\n";
+
+	if (req->version != VTM_HTTP_VER_1_1)
+		return VTM_OK;
+
+	val = vtm_http_req_get_header_str(req, VTM_HTTP_HEADER_EXPECT);
+	if (!val || vtm_str_casecmp(val, VTM_HTTP_VALUE_100_CONTINUE) != 0)
+		return VTM_OK;
+
+	/* previous responses may still be pending */
+	se = vtm_socket_emitter_for_raw(vtm_http_con_get_socket(con), interim, sizeof(interim) - 1);
+	if (!se)
+		return vtm_err_get_code();
+
+	return vtm_http_con_send(con, se);
+}
+
+static bool vtm_http_srv_http_finish(vtm_http_srv *srv, vtm_dataset *wd, vtm_http_con *con, vtm_http_res *res)
+{
+	enum vtm_http_res_act act;
 
 	act = vtm_http_res_get_action(res);
 	if (!vtm_http_res_was_sent(res))
@@ -385,6 +695,12 @@ static bool vtm_http_srv_http_handle_request(vtm_http_srv *srv, vtm_dataset *wd,
 		case VTM_HTTP_RES_ACT_UPGRADE_WS:
 			vtm_http_srv_http_con_upgrade_ws(srv, wd, con, res);
 			return false;
+
+		case VTM_HTTP_RES_ACT_SSE:
+			/* event stream takes over the socket */
+			vtm_socket_set_usr_data(vtm_http_con_get_socket(con), vtm_http_res_get_action_data(res));
+			vtm_http_con_free(con);
+			return false;
 	}
 
 	return false;
@@ -395,6 +711,7 @@ static void vtm_http_srv_http_con_upgrade_ws(vtm_http_srv *srv, vtm_dataset *wd,
 	int rc;
 	vtm_socket *sock;
 	vtm_ws_con *ws_con;
+	struct vtm_ws_deflate_params *params;
 	struct vtm_http_ctx ctx;
 
 	sock = vtm_http_con_get_socket(con);
@@ -408,12 +725,155 @@ static void vtm_http_srv_http_con_upgrade_ws(vtm_http_srv *srv, vtm_dataset *wd,
 		return;
 	}
 
+	/* extension accepted in handshake */
+	params = vtm_http_res_get_action_data(res);
+	if (params) {
+		rc = vtm_ws_con_enable_deflate(ws_con, params, &srv->opts->ws_deflate);
+		if (rc != VTM_OK) {
+			vtm_socket_close(sock);
+			return;
+		}
+	}
+
 	if (srv->cbs.ws_connect) {
 		vtm_http_srv_fill_ctx(srv, &ctx, wd);
 		srv->cbs.ws_connect(&ctx, ws_con);
 	}
 }
 
+static bool vtm_http_srv_http_is_h2c(struct vtm_http_req *req)
+{
+	const char *field;
+
+	if (req->version != VTM_HTTP_VER_1_1)
+		return false;
+
+	field = vtm_http_req_get_header_str(req, VTM_HTTP_HEADER_UPGRADE);
+	if (!field || !vtm_str_list_contains(field, ",", VTM_HTTP_VALUE_H2C, true))
+		return false;
+
+	return vtm_http_req_get_header_str(req, VTM_HTTP_HEADER_HTTP2_SETTINGS) != NULL;
+}
+
+static bool vtm_http_srv_http_upgrade_h2(vtm_http_srv *srv, vtm_dataset *wd, vtm_http_con *con, struct vtm_http_req *req)
+{
+	int rc;
+	vtm_socket *sock;
+	vtm_http2_con *h2_con;
+	uint32_t stream_id;
+	const void *pending;
+	size_t pending_len;
+	struct vtm_socket_emitter *se;
+	static const char switching[] = "HTTP/1.1 101 Switching Protocols\r\n"
+		"Connection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+
+	sock = vtm_http_con_get_socket(con);
+
+	h2_con = vtm_http2_con_new(sock);
+	if (!h2_con)
+		goto err;
+
+	if (req) {
+		/* invalid settings, answer with HTTP/1.1 instead */
+		rc = vtm_http2_con_upgrade(h2_con, vtm_http_req_get_header_str(req,
+			VTM_HTTP_HEADER_HTTP2_SETTINGS), req, &stream_id);
+		if (rc != VTM_OK) {
+			vtm_http2_con_free(h2_con);
+			return vtm_http_srv_http_dispatch(srv, wd, con, req);
+		}
+
+		/* queued behind pending responses, frames follow */
+		se = vtm_socket_emitter_for_raw(sock, switching, sizeof(switching) - 1);
+		if (!se || vtm_http_con_send(con, se) != VTM_OK)
+			goto err_h2;
+
+		req->version = VTM_HTTP_VER_2;
+		req->con = h2_con;
+		vtm_http_srv_h2_dispatch(srv, wd, h2_con, req, stream_id);
+		req = NULL;
+	}
+
+	/* bytes after the request belong to the new protocol */
+	vtm_http_con_get_pending(con, &pending, &pending_len);
+	if (vtm_http2_con_feed(h2_con, pending, pending_len) != VTM_OK)
+		goto err_h2;
+
+	/* unwritten output of HTTP/1.1 is sent before the first frame */
+	vtm_http2_con_set_head(h2_con, vtm_http_con_take_emitter(con));
+	vtm_http_con_free(con);
+	((struct vtm_http_con_base*) h2_con)->con_handle_req = vtm_http_srv_h2_handle_request;
+	vtm_socket_set_usr_data(sock, h2_con);
+
+	rc = vtm_http2_con_flush(h2_con);
+	if (rc != VTM_OK && rc != VTM_E_IO_AGAIN) {
+		vtm_socket_close(sock);
+		return false;
+	}
+
+	return true;
+
+err_h2:
+	vtm_http2_con_free(h2_con);
+
+err:
+	if (req)
+		vtm_http_req_release(req);
+	vtm_socket_close(sock);
+	return false;
+}
+
+static bool vtm_http_srv_h2_handle_request(vtm_http_srv *srv, vtm_dataset *wd, struct vtm_http_con_base *bcon)
+{
+	int rc;
+	vtm_http2_con *con;
+	struct vtm_http_req req;
+	uint32_t stream_id;
+
+	con = (vtm_http2_con*) bcon;
+
+	while ((rc = vtm_http2_con_get_request(con, &req, &stream_id)) == VTM_OK)
+		vtm_http_srv_h2_dispatch(srv, wd, con, &req, stream_id);
+
+	/* protocol error, try to deliver GOAWAY before closing */
+	if (rc != VTM_E_IO_AGAIN) {
+		vtm_http2_con_flush(con);
+		vtm_socket_close(vtm_http2_con_get_socket(con));
+		return false;
+	}
+
+	rc = vtm_http2_con_flush(con);
+	if (rc != VTM_OK && rc != VTM_E_IO_AGAIN) {
+		vtm_socket_close(vtm_http2_con_get_socket(con));
+		return false;
+	}
+
+	return true;
+}
+
+static void vtm_http_srv_h2_dispatch(vtm_http_srv *srv, vtm_dataset *wd, vtm_http2_con *con, struct vtm_http_req *req, uint32_t stream_id)
+{
+	vtm_http_res *res;
+	struct vtm_http_ctx ctx;
+	uint64_t begin;
+
+	res = vtm_dataset_get_pointer(wd, VTM_HTTP_WD_RESPONSE);
+	vtm_http_res_prepare(res, req);
+	vtm_http_res_set_stream(res, stream_id);
+
+	begin = srv->access_log ? vtm_time_current_micros() : 0;
+
+	vtm_http_srv_fill_ctx(srv, &ctx, wd);
+	if (!srv->opts->ratelimit || vtm_http_ratelimit_allow(srv->opts->ratelimit, req, res))
+		srv->cbs.http_request(&ctx, req, res);
+
+	if (srv->access_log)
+		vtm_http_srv_log_access(wd, vtm_http2_con_get_socket(con), req, res, begin);
+
+	vtm_http_req_release(req);
+
+	vtm_http2_con_end_request(con, stream_id);
+}
+
 static bool vtm_http_srv_ws_handle_request(vtm_http_srv *srv, vtm_dataset *wd, struct vtm_http_con_base *bcon)
 {
 	int rc;
@@ -434,6 +894,55 @@ static bool vtm_http_srv_ws_handle_request(vtm_http_srv *srv, vtm_dataset *wd, s
 	return true;
 }
 
+static void vtm_http_srv_ws_congestion(void *arg, vtm_ws_con *con, bool congested)
+{
+	vtm_http_srv *srv;
+	struct vtm_http_ctx ctx;
+
+	/* may run on any sending thread, there is no worker data */
+	srv = arg;
+	vtm_http_srv_fill_ctx(srv, &ctx, NULL);
+	srv->cbs.ws_congestion(&ctx, con, congested);
+}
+
+static void vtm_http_srv_log_access(vtm_dataset *wd, vtm_socket *sock, struct vtm_http_req *req, vtm_http_res *res, uint64_t begin)
+{
+	vtm_http_access_ring *ring;
+	struct vtm_http_access_rec *rec;
+	size_t len;
+
+	ring = vtm_dataset_get_pointer(wd, VTM_HTTP_WD_ACCESS_LOG);
+	if (!ring)
+		return;
+
+	/* full ring drops the record, the worker never waits */
+	rec = vtm_http_access_ring_acquire(ring);
+	if (!rec)
+		return;
+
+	rec->time = begin;
+	rec->duration = vtm_time_current_micros() - begin;
+	rec->bytes = vtm_http_res_get_body_len(res);
+	rec->status = vtm_http_res_get_status(res);
+	rec->method = req->method;
+	rec->version = req->version;
+
+	/* address is formatted by the log thread */
+	if (vtm_socket_get_remote_addr(sock, &rec->peer) != VTM_OK)
+		memset(&rec->peer, 0, sizeof(rec->peer));
+
+	len = 0;
+	if (req->path) {
+		len = strlen(req->path);
+		if (len >= sizeof(rec->path))
+			len = sizeof(rec->path) - 1;
+		memcpy(rec->path, req->path, len);
+	}
+	rec->path[len] = '\0';
+
+	vtm_http_access_ring_commit(ring);
+}
+
 static VTM_INLINE void vtm_http_srv_fill_ctx(vtm_http_srv *srv, struct vtm_http_ctx *ctx, vtm_dataset *wd)
 {
 	ctx->mem = srv->mem;
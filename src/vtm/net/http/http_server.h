@@ -17,12 +17,15 @@
 #include <vtm/net/socket_addr.h>
 #include <vtm/net/socket_shared.h>
 #include <vtm/net/http/http.h>
+#include <vtm/net/http/http_access_log.h>
 #include <vtm/net/http/http_context.h>
 #include <vtm/net/http/http_error.h>
 #include <vtm/net/http/http_memory.h>
+#include <vtm/net/http/http_ratelimit.h>
 #include <vtm/net/http/http_request.h>
 #include <vtm/net/http/http_response.h>
 #include <vtm/net/http/ws_connection.h>
+#include <vtm/net/http/ws_deflate.h>
 #include <vtm/net/http/ws_message.h>
 
 #ifdef __cplusplus
@@ -84,6 +87,44 @@ struct vtm_http_srv_cbs
 	 */
 	void (*http_request)(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res);
 
+	/**
+	 * Called for each fragment of a streamed request body.
+	 *
+	 * When this callback is set, requests with a body are not buffered.
+	 * Instead http_request is called with req->streamed set as soon as
+	 * the headers are received and the body is passed to this function
+	 * piece by piece, chunked
+	 * transfer encoding is already removed. The request and response
+	 * stay valid until the body is complete, the response can be sent
+	 * in http_request or in any body callback. Per-request state can be
+	 * stored in req->usr_data. HTTP/2 request bodies are still
+	 * buffered completely, flow control limits the amount of data
+	 * a client can send before its requests were handled.
+	 *
+	 * Returning VTM_E_IO_AGAIN pauses reading from the connection until
+	 * vtm_http_req_resume() is called, so a slow handler limits the
+	 * amount of buffered data instead of the client. On the last
+	 * fragment there is nothing left to pause, so VTM_E_IO_AGAIN is
+	 * treated like VTM_OK and a response that was not sent yet
+	 * closes the connection. Any other error code closes the
+	 * connection.
+	 *
+	 * The data is only valid during the call. If the connection is
+	 * closed before the body is complete, the function is called once
+	 * more with VTM_HTTP_REQ_BODY_ABORTED, so that resources held in
+	 * req->usr_data can be released.
+	 *
+	 * @param ctx the context
+	 * @param req the request details
+	 * @param res response handle for sending back the HTTP response
+	 * @param data begin of the body fragment
+	 * @param len length of the body fragment, may be zero
+	 * @param stat whether more fragments follow
+	 * @return VTM_OK to continue receiving
+	 * @return VTM_E_IO_AGAIN to pause receiving
+	 */
+	int (*http_body)(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res, const void *data, size_t len, enum vtm_http_req_body_stat stat);
+
 	/**
 	 * Called for each new WebSocket connection.
 	 *
@@ -107,6 +148,17 @@ struct vtm_http_srv_cbs
 	 * @param con the connection that was closed
 	 */
 	void (*ws_close)(struct vtm_http_ctx *ctx, vtm_ws_con *con);
+
+	/**
+	 * Called when the send queue of a WebSocket connection reaches
+	 * the high watermark and when it falls to the low watermark again.
+	 * It runs on the thread that sent or flushed, ctx->wd is NULL.
+	 *
+	 * @param ctx the context
+	 * @param con the connection
+	 * @param congested true if the high watermark was reached
+	 */
+	void (*ws_congestion)(struct vtm_http_ctx *ctx, vtm_ws_con *con, bool congested);
 };
 
 struct vtm_http_srv_opts
@@ -137,6 +189,49 @@ struct vtm_http_srv_opts
 	 * lets the server run in single threaded mode.
 	 */
 	unsigned int threads;
+
+	/** Maximum number of open connections, zero means unlimited */
+	unsigned int max_cons;
+
+	/** Maximum number of open connections per remote IP address, zero means unlimited */
+	unsigned int max_cons_per_ip;
+
+	/**
+	 * Limits the request rate of each client before http_request is
+	 * called, disabled when NULL. The rate limiter is not taken over
+	 * and must stay valid while the server runs.
+	 */
+	vtm_http_ratelimit *ratelimit;
+
+	/** response compression, disabled when zero-initialized */
+	struct vtm_http_res_compress_opts compress;
+
+	/** shared memory of all workers, available as ctx->mem */
+	struct vtm_http_mem_opts mem;
+
+	/** asynchronous access log, disabled when zero-initialized */
+	struct vtm_http_access_log_opts access_log;
+
+	/**
+	 * WebSocket permessage-deflate, disabled when zero-initialized.
+	 * The extension is accepted by vtm_http_upgrade_to_ws() if the
+	 * client offers it.
+	 */
+	struct vtm_ws_deflate_opts ws_deflate;
+
+	/**
+	 * WebSocket keepalive pings and send queue limits, disabled
+	 * when zero-initialized. Pings are sent by a separate thread.
+	 */
+	struct vtm_ws_con_opts ws_con;
+
+	/**
+	 * Enables HTTP/2. Clients can use it with prior knowledge or
+	 * the h2c upgrade, with TLS it is offered by ALPN unless
+	 * tls.alpn is set. Request bodies are always buffered on
+	 * HTTP/2 connections, http_body is not called for them.
+	 */
+	bool http2;
 };
 
 /**
@@ -181,6 +276,17 @@ VTM_API int vtm_http_srv_run(vtm_http_srv *srv, struct vtm_http_srv_opts *opts);
  */
 VTM_API int vtm_http_srv_stop(vtm_http_srv *srv);
 
+/**
+ * Gets the number of access log records that were dropped because
+ * the ring of a worker was full.
+ *
+ * After the server was stopped, the number of the last run is returned.
+ *
+ * @param srv the server
+ * @return the number of dropped records
+ */
+VTM_API uint64_t vtm_http_srv_get_access_log_dropped(vtm_http_srv *srv);
+
 #ifdef __cplusplus
 }
 #endif
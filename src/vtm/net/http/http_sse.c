@@ -0,0 +1,688 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include "http_sse.h"
+
+#include <string.h> /* memcpy(), memmove(), strlen(), strpbrk() */
+#include <vtm/core/buffer.h>
+#include <vtm/core/error.h>
+#include <vtm/core/format.h>
+#include <vtm/net/common.h>
+#include <vtm/net/socket_intl.h>
+#include <vtm/net/http/http.h>
+#include <vtm/net/http/http_connection_base_intl.h>
+#include <vtm/net/http/http_sse_intl.h>
+#include <vtm/util/atomic.h>
+#include <vtm/util/mutex.h>
+
+#define VTM_HTTP_SSE_CONTENT_TYPE   "text/event-stream"
+#define VTM_HTTP_SSE_NO_CACHE       "no-cache"
+#define VTM_HTTP_SSE_QUEUE_INIT     8
+#define VTM_HTTP_SSE_IOVEC_MAX      16
+#define VTM_HTTP_SSE_CHAN_INIT      64
+
+struct vtm_http_sse_msg
+{
+	VTM_ATOMIC_INT32_TYPE  refs;
+	size_t                 len;
+	char                   data[];  /* complete HTTP chunk */
+};
+
+struct vtm_http_sse
+{
+	struct vtm_http_con_base  base;
+	VTM_ATOMIC_INT32_TYPE     refs;
+	vtm_mutex                 *mtx;
+	bool                      closed;
+
+	/* ring of messages waiting to be sent */
+	vtm_http_sse_msg          **queue;
+	size_t                    queue_cap;
+	size_t                    queue_head;
+	size_t                    queue_len;
+
+	/* bytes of the first message that were already sent */
+	size_t                    offset;
+};
+
+struct vtm_http_sse_chan
+{
+	vtm_mutex     *mtx;
+	vtm_http_sse  **subs;
+	size_t        count;
+	size_t        cap;
+};
+
+/* forward declaration */
+static vtm_http_sse* vtm_http_sse_new(void);
+static void vtm_http_sse_free(vtm_http_sse *sse);
+static int vtm_http_sse_push(vtm_http_sse *sse, vtm_http_sse_msg *msg);
+static int vtm_http_sse_flush(vtm_http_sse *sse);
+static void vtm_http_sse_shutdown(vtm_http_sse *sse);
+static void vtm_http_sse_clear(vtm_http_sse *sse);
+static enum vtm_net_recv_stat vtm_http_sse_con_read(struct vtm_http_con_base *base_con);
+static int vtm_http_sse_con_write(struct vtm_http_con_base *base_con);
+static vtm_http_sse_msg* vtm_http_sse_msg_alloc(const void *payload, size_t len);
+static void vtm_http_sse_msg_field(struct vtm_buf *buf, const char *name, const char *value);
+static void vtm_http_sse_msg_data(struct vtm_buf *buf, const char *data, size_t len);
+
+int vtm_http_sse_begin(vtm_http_res *res, vtm_http_sse **sse)
+{
+	int rc;
+	vtm_http_sse *s;
+
+	/* HTTP/1.0 has no chunked encoding, HTTP/2 streams are not kept */
+	if (vtm_http_res_get_version(res) != VTM_HTTP_VER_1_1)
+		return VTM_E_NOT_SUPPORTED;
+
+	if (!vtm_http_res_was_started(res)) {
+		rc = vtm_http_res_begin(res, VTM_HTTP_RES_MODE_CHUNKED, VTM_HTTP_200_OK);
+		if (rc != VTM_OK)
+			return rc;
+	}
+
+	s = vtm_http_sse_new();
+	if (!s)
+		return vtm_err_get_code();
+
+	rc = vtm_http_res_set_action(res, VTM_HTTP_RES_ACT_SSE, s);
+	if (rc != VTM_OK)
+		goto err;
+
+	/* events are flushed individually and must not be buffered by a compressor */
+	vtm_http_res_set_compression(res, false);
+
+	rc = vtm_http_res_header(res, VTM_HTTP_HEADER_CONTENT_TYPE, VTM_HTTP_SSE_CONTENT_TYPE);
+	if (rc != VTM_OK)
+		goto err_act;
+
+	rc = vtm_http_res_header(res, VTM_HTTP_HEADER_CACHE_CONTROL, VTM_HTTP_SSE_NO_CACHE);
+	if (rc != VTM_OK)
+		goto err_act;
+
+	rc = vtm_http_res_end(res);
+	if (rc != VTM_OK)
+		goto err_act;
+
+	*sse = s;
+
+	return VTM_OK;
+
+err_act:
+	vtm_http_res_set_action(res, VTM_HTTP_RES_ACT_CLOSE_CON, NULL);
+
+err:
+	vtm_http_sse_free(s);
+	return rc;
+}
+
+static vtm_http_sse* vtm_http_sse_new(void)
+{
+	vtm_http_sse *sse;
+
+	sse = malloc(sizeof(*sse));
+	if (!sse) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	sse->mtx = vtm_mutex_new();
+	if (!sse->mtx) {
+		free(sse);
+		return NULL;
+	}
+
+	sse->base.sock = NULL;
+	sse->base.type = VTM_HTTP_CON_TYPE_SSE;
+	sse->base.con_can_read = vtm_http_sse_con_read;
+	sse->base.con_can_write = vtm_http_sse_con_write;
+	sse->base.con_handle_req = NULL;
+
+	/* one reference for the application and one for the connection */
+	sse->refs = 2;
+	sse->closed = false;
+
+	sse->queue = NULL;
+	sse->queue_cap = 0;
+	sse->queue_head = 0;
+	sse->queue_len = 0;
+	sse->offset = 0;
+
+	return sse;
+}
+
+static void vtm_http_sse_free(vtm_http_sse *sse)
+{
+	vtm_http_sse_clear(sse);
+	free(sse->queue);
+	vtm_mutex_free(sse->mtx);
+
+	if (sse->base.sock)
+		vtm_socket_unref(sse->base.sock);
+
+	free(sse);
+}
+
+int vtm_http_sse_start(vtm_http_sse *sse, vtm_socket *sock, const void *headers, size_t len)
+{
+	int rc;
+	vtm_http_sse_msg *msg;
+
+	msg = malloc(sizeof(*msg) + len);
+	if (!msg) {
+		vtm_err_oom();
+		return vtm_err_get_code();
+	}
+
+	msg->refs = 1;
+	msg->len = len;
+	memcpy(msg->data, headers, len);
+
+	vtm_mutex_lock(sse->mtx);
+
+	/* socket must outlive the stream, events may be sent after a close */
+	vtm_socket_ref(sock);
+	sse->base.sock = sock;
+
+	rc = vtm_http_sse_push(sse, msg);
+	vtm_http_sse_msg_release(msg);
+	if (rc != VTM_OK)
+		goto unlock;
+
+	/* write errors are noticed by the server */
+	vtm_http_sse_flush(sse);
+
+unlock:
+	vtm_mutex_unlock(sse->mtx);
+
+	if (rc != VTM_OK) {
+		vtm_socket_unref(sock);
+		sse->base.sock = NULL;
+	}
+
+	return rc;
+}
+
+void vtm_http_sse_detach(vtm_http_sse *sse)
+{
+	vtm_mutex_lock(sse->mtx);
+	sse->closed = true;
+	vtm_http_sse_clear(sse);
+	vtm_mutex_unlock(sse->mtx);
+
+	vtm_http_sse_release(sse);
+}
+
+int vtm_http_sse_send(vtm_http_sse *sse, const struct vtm_http_sse_event *ev)
+{
+	int rc;
+	vtm_http_sse_msg *msg;
+
+	msg = vtm_http_sse_msg_new(ev);
+	if (!msg)
+		return vtm_err_get_code();
+
+	rc = vtm_http_sse_send_msg(sse, msg);
+	vtm_http_sse_msg_release(msg);
+
+	return rc;
+}
+
+int vtm_http_sse_send_msg(vtm_http_sse *sse, vtm_http_sse_msg *msg)
+{
+	int rc;
+
+	vtm_mutex_lock(sse->mtx);
+
+	if (sse->closed) {
+		rc = VTM_E_IO_CLOSED;
+		goto unlock;
+	}
+
+	rc = vtm_http_sse_push(sse, msg);
+	if (rc != VTM_OK) {
+		vtm_http_sse_shutdown(sse);
+		goto unlock;
+	}
+
+	/* pending data is sent when the socket becomes writable again */
+	if (sse->queue_len > 1)
+		goto unlock;
+
+	rc = vtm_http_sse_flush(sse);
+	switch (rc) {
+		case VTM_OK:
+			break;
+
+		case VTM_E_IO_AGAIN:
+			rc = VTM_OK;
+			break;
+
+		default:
+			vtm_http_sse_shutdown(sse);
+			break;
+	}
+
+unlock:
+	vtm_mutex_unlock(sse->mtx);
+
+	return rc;
+}
+
+bool vtm_http_sse_is_open(vtm_http_sse *sse)
+{
+	bool open;
+
+	vtm_mutex_lock(sse->mtx);
+	open = !sse->closed;
+	vtm_mutex_unlock(sse->mtx);
+
+	return open;
+}
+
+void vtm_http_sse_close(vtm_http_sse *sse)
+{
+	vtm_mutex_lock(sse->mtx);
+	vtm_http_sse_shutdown(sse);
+	vtm_mutex_unlock(sse->mtx);
+}
+
+void vtm_http_sse_release(vtm_http_sse *sse)
+{
+	if (!sse)
+		return;
+
+	if (VTM_ATOMIC_ADD_INT32(&sse->refs, -1) == 0)
+		vtm_http_sse_free(sse);
+}
+
+static int vtm_http_sse_push(vtm_http_sse *sse, vtm_http_sse_msg *msg)
+{
+	size_t i, cap;
+	vtm_http_sse_msg **queue;
+
+	if (sse->queue_len == sse->queue_cap) {
+		if (sse->queue_cap >= VTM_HTTP_SSE_MAX_PENDING)
+			return VTM_E_MAX_REACHED;
+
+		cap = sse->queue_cap > 0 ? sse->queue_cap * 2 : VTM_HTTP_SSE_QUEUE_INIT;
+		queue = malloc(cap * sizeof(*queue));
+		if (!queue) {
+			vtm_err_oom();
+			return vtm_err_get_code();
+		}
+
+		/* oldest message moves to the front */
+		for (i=0; i < sse->queue_len; i++)
+			queue[i] = sse->queue[(sse->queue_head + i) % sse->queue_cap];
+
+		free(sse->queue);
+		sse->queue = queue;
+		sse->queue_cap = cap;
+		sse->queue_head = 0;
+	}
+
+	VTM_ATOMIC_ADD_INT32(&msg->refs, 1);
+	sse->queue[(sse->queue_head + sse->queue_len) % sse->queue_cap] = msg;
+	sse->queue_len++;
+
+	return VTM_OK;
+}
+
+static int vtm_http_sse_flush(vtm_http_sse *sse)
+{
+	int rc;
+	size_t i, count, written;
+	vtm_http_sse_msg *msg;
+	struct vtm_socket_iovec vec[VTM_HTTP_SSE_IOVEC_MAX];
+
+	while (sse->queue_len > 0) {
+		count = sse->queue_len < VTM_HTTP_SSE_IOVEC_MAX ? sse->queue_len : VTM_HTTP_SSE_IOVEC_MAX;
+		for (i=0; i < count; i++) {
+			msg = sse->queue[(sse->queue_head + i) % sse->queue_cap];
+			vec[i].data = msg->data;
+			vec[i].len = msg->len;
+		}
+		vec[0].data = (const char*) vec[0].data + sse->offset;
+		vec[0].len -= sse->offset;
+
+		rc = vtm_socket_writev(sse->base.sock, vec, count, &written);
+
+		/* release messages that were sent completely */
+		written += sse->offset;
+		while (sse->queue_len > 0) {
+			msg = sse->queue[sse->queue_head];
+			if (written < msg->len)
+				break;
+
+			written -= msg->len;
+			vtm_http_sse_msg_release(msg);
+			sse->queue_head = (sse->queue_head + 1) % sse->queue_cap;
+			sse->queue_len--;
+		}
+		sse->offset = written;
+
+		if (rc != VTM_OK) {
+			if (rc == VTM_E_IO_AGAIN)
+				vtm_socket_update_srv(sse->base.sock);
+			return rc;
+		}
+	}
+
+	return VTM_OK;
+}
+
+static void vtm_http_sse_shutdown(vtm_http_sse *sse)
+{
+	if (sse->closed)
+		return;
+
+	sse->closed = true;
+	vtm_http_sse_clear(sse);
+
+	/* server releases the connection */
+	vtm_socket_close(sse->base.sock);
+	vtm_socket_update_srv(sse->base.sock);
+}
+
+static void vtm_http_sse_clear(vtm_http_sse *sse)
+{
+	while (sse->queue_len > 0) {
+		vtm_http_sse_msg_release(sse->queue[sse->queue_head]);
+		sse->queue_head = (sse->queue_head + 1) % sse->queue_cap;
+		sse->queue_len--;
+	}
+	sse->offset = 0;
+}
+
+static enum vtm_net_recv_stat vtm_http_sse_con_read(struct vtm_http_con_base *base_con)
+{
+	int rc;
+	char buf[256];
+	size_t read;
+
+	/* client does not send anything after the request, only the close is of interest */
+	rc = vtm_socket_read(base_con->sock, buf, sizeof(buf), &read);
+	switch (rc) {
+		case VTM_OK:
+		case VTM_E_IO_AGAIN:
+			return VTM_NET_RECV_STAT_AGAIN;
+
+		default:
+			break;
+	}
+
+	return VTM_NET_RECV_STAT_CLOSED;
+}
+
+static int vtm_http_sse_con_write(struct vtm_http_con_base *base_con)
+{
+	int rc;
+	vtm_http_sse *sse;
+
+	sse = (vtm_http_sse*) base_con;
+
+	vtm_mutex_lock(sse->mtx);
+	rc = sse->closed ? VTM_E_IO_CLOSED : vtm_http_sse_flush(sse);
+	vtm_mutex_unlock(sse->mtx);
+
+	return rc;
+}
+
+vtm_http_sse_msg* vtm_http_sse_msg_new(const struct vtm_http_sse_event *ev)
+{
+	struct vtm_buf buf;
+	vtm_http_sse_msg *msg;
+	char retry[VTM_FMT_CHARS_INT64 + 1];
+
+	if ((ev->id && strpbrk(ev->id, "\r\n")) ||
+		(ev->event && strpbrk(ev->event, "\r\n")) ||
+		(ev->comment && strpbrk(ev->comment, "\r\n"))) {
+		vtm_err_set(VTM_E_INVALID_ARG);
+		return NULL;
+	}
+
+	vtm_buf_init(&buf, VTM_NET_BYTEORDER);
+
+	if (ev->comment)
+		vtm_http_sse_msg_field(&buf, "", ev->comment);
+
+	if (ev->id)
+		vtm_http_sse_msg_field(&buf, "id", ev->id);
+
+	if (ev->event)
+		vtm_http_sse_msg_field(&buf, "event", ev->event);
+
+	if (ev->retry > 0) {
+		retry[vtm_fmt_uint64(retry, ev->retry)] = '\0';
+		vtm_http_sse_msg_field(&buf, "retry", retry);
+	}
+
+	if (ev->data)
+		vtm_http_sse_msg_data(&buf, ev->data, ev->data_len);
+
+	/* empty line dispatches the event */
+	vtm_buf_putc(&buf, '\n');
+
+	if (buf.err != VTM_OK) {
+		vtm_buf_release(&buf);
+		vtm_err_oom();
+		return NULL;
+	}
+
+	msg = vtm_http_sse_msg_alloc(buf.data, buf.used);
+	vtm_buf_release(&buf);
+
+	return msg;
+}
+
+static vtm_http_sse_msg* vtm_http_sse_msg_alloc(const void *payload, size_t len)
+{
+	vtm_http_sse_msg *msg;
+	unsigned int hex_len;
+	char *p;
+
+	hex_len = vtm_fmt_hex_size(NULL, len);
+
+	msg = malloc(sizeof(*msg) + hex_len + len + 4);
+	if (!msg) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	msg->refs = 1;
+	msg->len = hex_len + len + 4;
+
+	/* event is framed as chunk once, so every stream can send it unchanged */
+	p = msg->data;
+	p += vtm_fmt_hex_size(p, len);
+	*p++ = '\r';
+	*p++ = '\n';
+	memcpy(p, payload, len);
+	p += len;
+	*p++ = '\r';
+	*p++ = '\n';
+
+	return msg;
+}
+
+static void vtm_http_sse_msg_field(struct vtm_buf *buf, const char *name, const char *value)
+{
+	vtm_buf_puts(buf, name);
+	vtm_buf_puts(buf, ": ");
+	vtm_buf_puts(buf, value);
+	vtm_buf_putc(buf, '\n');
+}
+
+static void vtm_http_sse_msg_data(struct vtm_buf *buf, const char *data, size_t len)
+{
+	size_t i, begin;
+
+	/* CR, LF and CRLF all end a line of the payload */
+	begin = 0;
+	for (i=0; i < len; i++) {
+		if (data[i] != '\r' && data[i] != '\n')
+			continue;
+
+		vtm_buf_puts(buf, "data: ");
+		vtm_buf_putm(buf, data + begin, i - begin);
+		vtm_buf_putc(buf, '\n');
+
+		if (data[i] == '\r' && i+1 < len && data[i+1] == '\n')
+			i++;
+		begin = i+1;
+	}
+
+	vtm_buf_puts(buf, "data: ");
+	vtm_buf_putm(buf, data + begin, len - begin);
+	vtm_buf_putc(buf, '\n');
+}
+
+void vtm_http_sse_msg_release(vtm_http_sse_msg *msg)
+{
+	if (!msg)
+		return;
+
+	if (VTM_ATOMIC_ADD_INT32(&msg->refs, -1) == 0)
+		free(msg);
+}
+
+vtm_http_sse_chan* vtm_http_sse_chan_new(void)
+{
+	vtm_http_sse_chan *chan;
+
+	chan = malloc(sizeof(*chan));
+	if (!chan) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	chan->mtx = vtm_mutex_new();
+	if (!chan->mtx) {
+		free(chan);
+		return NULL;
+	}
+
+	chan->subs = NULL;
+	chan->count = 0;
+	chan->cap = 0;
+
+	return chan;
+}
+
+void vtm_http_sse_chan_free(vtm_http_sse_chan *chan)
+{
+	size_t i;
+
+	if (!chan)
+		return;
+
+	for (i=0; i < chan->count; i++)
+		vtm_http_sse_release(chan->subs[i]);
+
+	free(chan->subs);
+	vtm_mutex_free(chan->mtx);
+	free(chan);
+}
+
+int vtm_http_sse_chan_subscribe(vtm_http_sse_chan *chan, vtm_http_sse *sse)
+{
+	int rc;
+	size_t cap;
+	vtm_http_sse **subs;
+
+	rc = VTM_OK;
+
+	vtm_mutex_lock(chan->mtx);
+
+	if (chan->count == chan->cap) {
+		cap = chan->cap > 0 ? chan->cap * 2 : VTM_HTTP_SSE_CHAN_INIT;
+		subs = realloc(chan->subs, cap * sizeof(*subs));
+		if (!subs) {
+			vtm_err_oom();
+			rc = vtm_err_get_code();
+			goto unlock;
+		}
+		chan->subs = subs;
+		chan->cap = cap;
+	}
+
+	VTM_ATOMIC_ADD_INT32(&sse->refs, 1);
+	chan->subs[chan->count++] = sse;
+
+unlock:
+	vtm_mutex_unlock(chan->mtx);
+
+	return rc;
+}
+
+void vtm_http_sse_chan_unsubscribe(vtm_http_sse_chan *chan, vtm_http_sse *sse)
+{
+	size_t i;
+	bool found;
+
+	found = false;
+
+	vtm_mutex_lock(chan->mtx);
+	for (i=0; i < chan->count; i++) {
+		if (chan->subs[i] != sse)
+			continue;
+
+		chan->subs[i] = chan->subs[--chan->count];
+		found = true;
+		break;
+	}
+	vtm_mutex_unlock(chan->mtx);
+
+	if (found)
+		vtm_http_sse_release(sse);
+}
+
+int vtm_http_sse_chan_publish(vtm_http_sse_chan *chan, const struct vtm_http_sse_event *ev)
+{
+	vtm_http_sse_msg *msg;
+
+	msg = vtm_http_sse_msg_new(ev);
+	if (!msg)
+		return vtm_err_get_code();
+
+	vtm_http_sse_chan_publish_msg(chan, msg);
+	vtm_http_sse_msg_release(msg);
+
+	return VTM_OK;
+}
+
+void vtm_http_sse_chan_publish_msg(vtm_http_sse_chan *chan, vtm_http_sse_msg *msg)
+{
+	size_t i;
+	vtm_http_sse *sse;
+
+	vtm_mutex_lock(chan->mtx);
+
+	i = 0;
+	while (i < chan->count) {
+		sse = chan->subs[i];
+		if (vtm_http_sse_send_msg(sse, msg) == VTM_OK) {
+			i++;
+			continue;
+		}
+
+		/* stream was closed, last subscriber takes its place */
+		chan->subs[i] = chan->subs[--chan->count];
+		vtm_http_sse_release(sse);
+	}
+
+	vtm_mutex_unlock(chan->mtx);
+}
+
+size_t vtm_http_sse_chan_count(vtm_http_sse_chan *chan)
+{
+	size_t count;
+
+	vtm_mutex_lock(chan->mtx);
+	count = chan->count;
+	vtm_mutex_unlock(chan->mtx);
+
+	return count;
+}
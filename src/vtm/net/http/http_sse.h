@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+/**
+ * @file http_sse.h
+ *
+ * @brief Server-Sent Events
+ *
+ * An event stream is a CHUNKED response that stays open after the
+ * request handler returned. Events can be pushed from any thread of
+ * the application as long as the server runs with worker threads.
+ *
+ * Each event is encoded only once into a complete HTTP chunk. The
+ * encoded message is reference counted and shared by all streams it
+ * is sent to, so a channel with many subscribers neither formats nor
+ * copies the event per subscriber.
+ */
+
+#ifndef VTM_NET_HTTP_HTTP_SSE_H_
+#define VTM_NET_HTTP_HTTP_SSE_H_
+
+#include <vtm/core/api.h>
+#include <vtm/core/types.h>
+#include <vtm/net/http/http_response.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Maximum number of messages queued for a slow stream before it is closed */
+#define VTM_HTTP_SSE_MAX_PENDING   1024
+
+typedef struct vtm_http_sse vtm_http_sse;
+typedef struct vtm_http_sse_msg vtm_http_sse_msg;
+typedef struct vtm_http_sse_chan vtm_http_sse_chan;
+
+/** Fields of an event, unused fields are NULL or zero */
+struct vtm_http_sse_event
+{
+	const char     *id;        /**< event id, must not contain line breaks */
+	const char     *event;     /**< event type, must not contain line breaks */
+	const char     *data;      /**< payload, sent as one data field per line */
+	size_t         data_len;   /**< length of the payload */
+	const char     *comment;   /**< comment, ignored by clients, e.g. for keep-alive */
+	unsigned long  retry;      /**< reconnection time in milliseconds */
+};
+
+/**
+ * Starts an event stream as answer to a request.
+ *
+ * The response is sent with status 200 and Content-Type
+ * text/event-stream. Additional headers can be set by starting the
+ * response with vtm_http_res_begin() in CHUNKED mode before.
+ * After this call the response must not be used anymore.
+ *
+ * The returned stream holds a reference that must be released with
+ * vtm_http_sse_release() when the stream is no longer needed.
+ *
+ * @param res the response of the request
+ * @param[out] sse the created stream
+ * @return VTM_OK if the stream was started
+ * @return VTM_E_NOT_SUPPORTED if the request is not HTTP/1.1
+ * @return VTM_E_INVALID_STATE if the response body was already started
+ * @return VTM_E_IO_UNKNOWN or VTM_ERROR if an error occured
+ */
+VTM_API int vtm_http_sse_begin(vtm_http_res *res, vtm_http_sse **sse);
+
+/**
+ * Sends an event to a single stream.
+ *
+ * @param sse the stream
+ * @param ev the event
+ * @return VTM_OK if the event was queued for sending
+ * @return VTM_E_INVALID_ARG if id or event contain line breaks
+ * @return VTM_E_IO_CLOSED if the stream was closed
+ * @return VTM_E_MAX_REACHED if the client is too slow, the stream is closed then
+ */
+VTM_API int vtm_http_sse_send(vtm_http_sse *sse, const struct vtm_http_sse_event *ev);
+
+/**
+ * Sends an encoded message to a single stream.
+ *
+ * The stream takes its own reference of the message.
+ *
+ * @param sse the stream
+ * @param msg the message
+ * @return VTM_OK if the message was queued for sending
+ * @return VTM_E_IO_CLOSED if the stream was closed
+ * @return VTM_E_MAX_REACHED if the client is too slow, the stream is closed then
+ */
+VTM_API int vtm_http_sse_send_msg(vtm_http_sse *sse, vtm_http_sse_msg *msg);
+
+/**
+ * Checks if events can still be sent over the stream.
+ *
+ * @param sse the stream
+ * @return true if the stream is open
+ */
+VTM_API bool vtm_http_sse_is_open(vtm_http_sse *sse);
+
+/**
+ * Closes the connection of the stream.
+ *
+ * @param sse the stream
+ */
+VTM_API void vtm_http_sse_close(vtm_http_sse *sse);
+
+/**
+ * Releases a reference of the stream.
+ *
+ * The connection is not closed by this call.
+ *
+ * @param sse the stream
+ */
+VTM_API void vtm_http_sse_release(vtm_http_sse *sse);
+
+/**
+ * Encodes an event into a message that can be sent to many streams.
+ *
+ * @param ev the event
+ * @return the message with one reference held by the caller
+ * @return NULL if an error occured
+ */
+VTM_API vtm_http_sse_msg* vtm_http_sse_msg_new(const struct vtm_http_sse_event *ev);
+
+/**
+ * Releases a reference of the message.
+ *
+ * @param msg the message
+ */
+VTM_API void vtm_http_sse_msg_release(vtm_http_sse_msg *msg);
+
+/**
+ * Creates a new channel.
+ *
+ * @return the created channel
+ * @return NULL if an error occured
+ */
+VTM_API vtm_http_sse_chan* vtm_http_sse_chan_new(void);
+
+/**
+ * Releases the channel and the references of all subscribers.
+ *
+ * @param chan the channel
+ */
+VTM_API void vtm_http_sse_chan_free(vtm_http_sse_chan *chan);
+
+/**
+ * Adds a stream to the channel.
+ *
+ * The channel takes its own reference of the stream, closed streams
+ * are removed automatically.
+ *
+ * @param chan the channel
+ * @param sse the stream
+ * @return VTM_OK if the stream was added
+ * @return VTM_ERROR if an error occured
+ */
+VTM_API int vtm_http_sse_chan_subscribe(vtm_http_sse_chan *chan, vtm_http_sse *sse);
+
+/**
+ * Removes a stream from the channel.
+ *
+ * @param chan the channel
+ * @param sse the stream
+ */
+VTM_API void vtm_http_sse_chan_unsubscribe(vtm_http_sse_chan *chan, vtm_http_sse *sse);
+
+/**
+ * Sends an event to all subscribers.
+ *
+ * The event is encoded once and shared by all subscribers.
+ *
+ * @param chan the channel
+ * @param ev the event
+ * @return VTM_OK if the event was passed to all subscribers
+ * @return VTM_E_INVALID_ARG if id or event contain line breaks
+ * @return VTM_ERROR if an error occured
+ */
+VTM_API int vtm_http_sse_chan_publish(vtm_http_sse_chan *chan, const struct vtm_http_sse_event *ev);
+
+/**
+ * Sends an encoded message to all subscribers.
+ *
+ * @param chan the channel
+ * @param msg the message
+ */
+VTM_API void vtm_http_sse_chan_publish_msg(vtm_http_sse_chan *chan, vtm_http_sse_msg *msg);
+
+/**
+ * Gets the number of subscribers.
+ *
+ * Closed streams are counted until the next publish.
+ *
+ * @param chan the channel
+ * @return the number of subscribers
+ */
+VTM_API size_t vtm_http_sse_chan_count(vtm_http_sse_chan *chan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_NET_HTTP_HTTP_SSE_H_ */
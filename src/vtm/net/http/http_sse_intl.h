@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#ifndef VTM_NET_HTTP_HTTP_SSE_INTL_H_
+#define VTM_NET_HTTP_HTTP_SSE_INTL_H_
+
+#include <vtm/core/types.h>
+#include <vtm/net/socket.h>
+#include <vtm/net/http/http_sse.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Sends the header block of the response as first data of the stream.
+ * The server registers the stream as connection of the socket once the
+ * request handler returned.
+ */
+int vtm_http_sse_start(vtm_http_sse *sse, vtm_socket *sock, const void *headers, size_t len);
+
+/* Called when the connection was closed, releases the reference of the connection */
+void vtm_http_sse_detach(vtm_http_sse *sse);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_NET_HTTP_HTTP_SSE_INTL_H_ */
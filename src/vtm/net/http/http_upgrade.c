@@ -5,15 +5,21 @@
 #include "http_upgrade.h"
 
 #include <string.h> /* strcmp() */
+#include <vtm/core/buffer.h>
 #include <vtm/core/error.h>
 #include <vtm/core/string.h>
 #include <vtm/crypto/hash.h>
+#include <vtm/net/http/http_response_intl.h>
+#include <vtm/net/http/ws_deflate_intl.h>
 #include <vtm/util/base64.h>
 
 #define VTM_HTTP_WS_VERSION         "13"
 #define VTM_HTTP_WS_GUID            "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
 #define VTM_HTTP_WS_MAX_KEY_LEN     128
 
+/* forward declaration */
+static struct vtm_ws_deflate_params* vtm_http_upgrade_ws_deflate(struct vtm_http_req *req, vtm_http_res *res);
+
 bool vtm_http_is_ws_request(struct vtm_http_req *req)
 {
 	const char *field;
@@ -59,15 +65,18 @@ int vtm_http_upgrade_to_ws(struct vtm_http_req *req, vtm_http_res *res, char *pr
 	int rc;
 	const char *req_key;
 	char *hash_input;
-	char *proto_copy;
+	struct vtm_ws_deflate_params *params;
 	unsigned char hash[VTM_CRYPTO_SHA1_LEN];
 	char base64[VTM_BASE64_ENC_BUF_LEN(VTM_CRYPTO_SHA1_LEN)];
 	size_t req_key_len;
 	size_t hash_input_len;
 
+	/* HTTP/2 has no connection upgrade */
+	if (req->version == VTM_HTTP_VER_2)
+		return VTM_E_NOT_SUPPORTED;
+
 	rc = VTM_OK;
 	hash_input = NULL;
-	proto_copy = NULL;
 
 	req_key = vtm_http_req_get_header_str(req, VTM_HTTP_HEADER_SEC_WEBSOCKET_KEY);
 	if (!req_key)
@@ -98,15 +107,44 @@ int vtm_http_upgrade_to_ws(struct vtm_http_req *req, vtm_http_res *res, char *pr
 	vtm_http_res_header(res, VTM_HTTP_HEADER_UPGRADE, VTM_HTTP_VALUE_WEBSOCKET);
 	vtm_http_res_header(res, VTM_HTTP_HEADER_SEC_WEBSOCKET_ACCEPT, base64);
 
-	if (proto) {
-		proto_copy = vtm_str_copy(proto);
+	if (proto)
 		vtm_http_res_header(res, VTM_HTTP_HEADER_SEC_WEBSOCKET_PROTOCOL, proto);
-	}
 
-	vtm_http_res_set_action(res, VTM_HTTP_RES_ACT_UPGRADE_WS, proto_copy);
+	/* negotiated parameters are picked up by the server */
+	params = vtm_http_upgrade_ws_deflate(req, res);
+
+	vtm_http_res_set_action(res, VTM_HTTP_RES_ACT_UPGRADE_WS, params);
 	vtm_http_res_end(res);
 
 cleanup:
 	free(hash_input);
 	return rc;
 }
+
+static struct vtm_ws_deflate_params* vtm_http_upgrade_ws_deflate(struct vtm_http_req *req, vtm_http_res *res)
+{
+	const char *offers;
+	const struct vtm_ws_deflate_opts *opts;
+	struct vtm_ws_deflate_params *params;
+	struct vtm_buf buf;
+
+	opts = vtm_http_res_get_ws_deflate_opts(res);
+	if (!opts || !opts->enabled)
+		return NULL;
+
+	offers = vtm_http_req_get_header_str(req, VTM_HTTP_HEADER_SEC_WEBSOCKET_EXTENSIONS);
+	if (!offers)
+		return NULL;
+
+	params = vtm_http_res_get_ws_deflate_params(res);
+
+	vtm_buf_init(&buf, VTM_BYTEORDER_LE);
+	if (vtm_ws_deflate_accept(opts, offers, params, &buf) == VTM_OK &&
+		vtm_buf_putc(&buf, '\0') == VTM_OK)
+		vtm_http_res_header(res, VTM_HTTP_HEADER_SEC_WEBSOCKET_EXTENSIONS, (const char*) buf.data);
+	else
+		params = NULL;
+	vtm_buf_release(&buf);
+
+	return params;
+}
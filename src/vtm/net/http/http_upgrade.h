@@ -42,6 +42,9 @@ VTM_API void vtm_http_get_ws_protocols(struct vtm_http_req *req, char ***protos,
  * Prepares the response so that the connection is upgraded
  * to WebSocket protocol afterwards.
  *
+ * If the server options enable permessage-deflate and the client
+ * offers it, the extension is accepted in the response.
+ *
  * @param req the WebSocket handshake request
  * @param res the response that should be filled
  * @param proto the chosen WebSocket protocol, can be NULL
@@ -14,6 +14,7 @@
 #include <vtm/net/http/http.h>
 #include <vtm/net/http/http_client.h>
 #include <vtm/net/http/http_client_intl.h>
+#include <vtm/net/http/ws_deflate_intl.h>
 #include <vtm/net/http/ws_frame_intl.h>
 #include <vtm/net/http/ws_parser.h>
 #include <vtm/util/base64.h>
@@ -28,8 +29,15 @@ struct vtm_ws_client
 	struct vtm_ws_parser  parser;
 	unsigned int          hints;
 	long                  opt_timeout;
+
+	/* permessage-deflate */
+	struct vtm_ws_deflate_opts  deflate_opts;
+	vtm_ws_deflate              *deflate;
 };
 
+/* forward declaration */
+static int vtm_ws_client_confirm_ext(vtm_ws_client *cl, struct vtm_http_client_res *res);
+
 vtm_ws_client* vtm_ws_client_new(void)
 {
 	vtm_ws_client *cl;
@@ -51,6 +59,9 @@ vtm_ws_client* vtm_ws_client_new(void)
 	cl->hints = 0;
 	cl->opt_timeout = 0;
 
+	memset(&cl->deflate_opts, 0, sizeof(cl->deflate_opts));
+	cl->deflate = NULL;
+
 	return cl;
 }
 
@@ -66,6 +77,7 @@ void vtm_ws_client_free(vtm_ws_client *cl)
 
 	vtm_ws_parser_release(&cl->parser);
 	vtm_buf_release(&cl->recvbuf);
+	vtm_ws_deflate_free(cl->deflate);
 
 	free(cl);
 }
@@ -88,6 +100,12 @@ int vtm_ws_client_set_opt(vtm_ws_client *cl, int opt, const void *val, size_t le
 			cl->opt_timeout = *((unsigned long*) val);
 			return VTM_OK;
 
+		case VTM_WS_CL_OPT_DEFLATE:
+			if (len != sizeof(struct vtm_ws_deflate_opts))
+				return VTM_E_INVALID_ARG;
+			cl->deflate_opts = *((const struct vtm_ws_deflate_opts*) val);
+			return VTM_OK;
+
 		default:
 			break;
 	}
@@ -102,6 +120,7 @@ int vtm_ws_client_connect(vtm_ws_client *cl, enum vtm_socket_family fam, const c
 	struct vtm_http_client_req req;
 	struct vtm_http_client_res res;
 	vtm_dataset *headers;
+	struct vtm_buf offer;
 	char ws_key[VTM_BASE64_ENC_BUF_LEN(sizeof(uint64_t))];
 	uint64_t time;
 
@@ -142,6 +161,15 @@ int vtm_ws_client_connect(vtm_ws_client *cl, enum vtm_socket_family fam, const c
 	vtm_dataset_set_string(headers, VTM_HTTP_HEADER_SEC_WEBSOCKET_KEY, ws_key);
 	vtm_dataset_set_string(headers, VTM_HTTP_HEADER_SEC_WEBSOCKET_VERSION, "13");
 
+	if (cl->deflate_opts.enabled) {
+		vtm_buf_init(&offer, VTM_BYTEORDER_LE);
+		vtm_ws_deflate_offer(&cl->deflate_opts, &offer);
+		vtm_buf_putc(&offer, '\0');
+		if (offer.err == VTM_OK)
+			vtm_dataset_set_string(headers, VTM_HTTP_HEADER_SEC_WEBSOCKET_EXTENSIONS, (const char*) offer.data);
+		vtm_buf_release(&offer);
+	}
+
 	/* prepare request */
 	memset(&req, 0, sizeof(req));
 	req.method = VTM_HTTP_METHOD_GET;
@@ -159,14 +187,15 @@ int vtm_ws_client_connect(vtm_ws_client *cl, enum vtm_socket_family fam, const c
 
 	/* check response */
 	status = res.status_code;
+	rc = (status == VTM_HTTP_101_SWITCHING_PROTOCOLS) ?
+		vtm_ws_client_confirm_ext(cl, &res) : VTM_E_IO_UNKNOWN;
 	vtm_http_client_res_release(&res);
-	if (status != VTM_HTTP_101_SWITCHING_PROTOCOLS) {
-		rc = VTM_E_IO_UNKNOWN;
+	if (rc != VTM_OK)
 		goto end;
-	}
 
 	vtm_buf_clear(&cl->recvbuf);
 	vtm_ws_parser_reset(&cl->parser);
+	vtm_ws_parser_set_deflate(&cl->parser, cl->deflate);
 
 	rc = vtm_http_client_take_socket(http_cl, &cl->sock);
 
@@ -176,6 +205,37 @@ end:
 	return rc;
 }
 
+static int vtm_ws_client_confirm_ext(vtm_ws_client *cl, struct vtm_http_client_res *res)
+{
+	int rc;
+	const char *val;
+	struct vtm_ws_deflate_params params;
+
+	/* state of a previous connection */
+	vtm_ws_deflate_free(cl->deflate);
+	cl->deflate = NULL;
+
+	val = res->headers ? vtm_dataset_get_string(res->headers, VTM_HTTP_HEADER_SEC_WEBSOCKET_EXTENSIONS) : NULL;
+	if (!val)
+		return VTM_OK;
+
+	/* server must not answer with extensions that were not offered */
+	if (!cl->deflate_opts.enabled)
+		return vtm_err_set(VTM_E_IO_PROTOCOL);
+
+	rc = vtm_ws_deflate_confirm(&cl->deflate_opts, val, &params);
+	if (rc == VTM_E_NOT_FOUND)
+		return VTM_OK;
+	else if (rc != VTM_OK)
+		return rc;
+
+	cl->deflate = vtm_ws_deflate_new(VTM_WS_MODE_CLIENT, &params, &cl->deflate_opts);
+	if (!cl->deflate)
+		return vtm_err_get_code();
+
+	return VTM_OK;
+}
+
 int vtm_ws_client_close(vtm_ws_client *cl)
 {
 	if (!cl->sock)
@@ -187,7 +247,7 @@ int vtm_ws_client_close(vtm_ws_client *cl)
 int vtm_ws_client_send(vtm_ws_client *cl, enum vtm_ws_msg_type type, const void *src, size_t len)
 {
 	int rc;
-	struct vtm_buf buf;
+	struct vtm_buf buf, comp;
 	struct vtm_ws_frame_desc desc;
 	size_t payload_begin, written;
 	if (!cl->sock)
@@ -201,6 +261,21 @@ int vtm_ws_client_send(vtm_ws_client *cl, enum vtm_ws_msg_type type, const void
 	desc.masked = 1;
 
 	vtm_buf_init(&buf, VTM_BYTEORDER_LE);
+	vtm_buf_init(&comp, VTM_BYTEORDER_LE);
+
+	/* compressed payload replaces the input */
+	if (cl->deflate && (type == VTM_WS_MSG_TEXT || type == VTM_WS_MSG_BINARY)) {
+		rc = vtm_ws_deflate_compress(cl->deflate, src, len, &comp);
+		if (rc == VTM_OK) {
+			desc.rsv1 = 1;
+			desc.len = len = comp.used;
+			src = comp.data;
+		}
+		else if (rc != VTM_E_NOT_HANDLED) {
+			goto end;
+		}
+	}
+
 	rc = vtm_ws_frame_write_header(&buf, &desc);
 	if (rc != VTM_OK)
 		goto end;
@@ -218,6 +293,7 @@ int vtm_ws_client_send(vtm_ws_client *cl, enum vtm_ws_msg_type type, const void
 
 end:
 	vtm_buf_release(&buf);
+	vtm_buf_release(&comp);
 
 	return rc;
 }
@@ -237,7 +313,7 @@ int vtm_ws_client_recv(vtm_ws_client *cl, struct vtm_ws_msg *msg)
 	while(true) {
 		rc = vtm_buf_ensure(&cl->recvbuf, 512);
 		if (rc != VTM_OK)
-			return VTM_NET_RECV_STAT_ERROR;
+			return rc;
 
 		/* read from socket to buffer */
 		rc = vtm_socket_read(cl->sock,
@@ -246,7 +322,7 @@ int vtm_ws_client_recv(vtm_ws_client *cl, struct vtm_ws_msg *msg)
 
 		VTM_BUF_PUT_INC(&cl->recvbuf, read);
 		if (rc != VTM_OK && rc != VTM_E_IO_AGAIN)
-			return VTM_NET_RECV_STAT_ERROR;
+			return rc;
 
 parse:
 		stat = vtm_ws_parser_run(&cl->parser, &cl->recvbuf);
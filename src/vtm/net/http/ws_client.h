@@ -15,6 +15,7 @@
 #include <vtm/core/types.h>
 #include <vtm/net/network.h>
 #include <vtm/net/http/ws.h>
+#include <vtm/net/http/ws_deflate.h>
 #include <vtm/net/http/ws_message.h>
 #include <vtm/net/socket_spec.h>
 
@@ -24,6 +25,7 @@ extern "C" {
 
 #define VTM_WS_CL_OPT_NO_CERT_CHECK       1  /**< expects bool */
 #define VTM_WS_CL_OPT_TIMEOUT             2  /**< expects unsigned long, value is millisceonds */
+#define VTM_WS_CL_OPT_DEFLATE             3  /**< expects struct vtm_ws_deflate_opts, offers permessage-deflate */
 
 typedef struct vtm_ws_client vtm_ws_client;
 
@@ -67,6 +69,8 @@ VTM_API int vtm_ws_client_set_opt(vtm_ws_client *cl, int opt, const void *val, s
  * @param fam the desired socket family (IPv4 or IPv6)
  * @param url the url where to connect to (must use http/https as scheme)
  * @return VTM_OK if the client connected to the server
+ * @return VTM_E_IO_PROTOCOL if the server answered the offered
+ *         extension with invalid parameters
  * @return VTM_E_IO_UNKNOWN or VTM_ERROR if an error occured
  */
 VTM_API int vtm_ws_client_connect(vtm_ws_client *cl, enum vtm_socket_family fam, const char *url);
@@ -96,6 +100,9 @@ VTM_API int vtm_ws_client_send(vtm_ws_client *cl, enum vtm_ws_msg_type type, con
 /**
  * Tries to receive a message.
  *
+ * The message stays valid until it is released with
+ * vtm_ws_msg_release(), further messages can be received before.
+ *
  * @param cl the client
  * @param[out] msg the structure where the received message is stored
  * @return VTM_OK if a message was successfully received
@@ -0,0 +1,1122 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include "ws_client_async.h"
+
+#include <stdlib.h> /* malloc(), free() */
+#include <string.h> /* memset() */
+#include <vtm/core/buffer.h>
+#include <vtm/core/error.h>
+#include <vtm/core/hash.h>
+#include <vtm/net/common.h>
+#include <vtm/net/socket.h>
+#include <vtm/net/socket_listener.h>
+#include <vtm/net/url.h>
+#include <vtm/net/http/http.h>
+#include <vtm/net/http/http_parser.h>
+#include <vtm/net/http/ws_deflate_intl.h>
+#include <vtm/net/http/ws_frame_intl.h>
+#include <vtm/net/http/ws_parser.h>
+#include <vtm/util/atomic.h>
+#include <vtm/util/base64.h>
+#include <vtm/util/mutex.h>
+#include <vtm/util/time.h>
+
+#define VTM_WS_CL_ASYNC_EVENTS                64
+#define VTM_WS_CL_ASYNC_READ_SIZE           4096
+#define VTM_WS_CL_ASYNC_READ_ROUNDS           16
+#define VTM_WS_CL_ASYNC_DEF_TIMEOUT        10000
+#define VTM_WS_CL_ASYNC_DEF_RECONNECT_MIN    250
+#define VTM_WS_CL_ASYNC_DEF_RECONNECT_MAX  30000
+#define VTM_WS_CL_ASYNC_MAX_ATTEMPTS          20
+
+#define VTM_WS_CL_ASYNC_HINT_NO_CERT_CHECK  1
+
+enum vtm_ws_client_async_stat
+{
+	VTM_WS_CL_ASYNC_STAT_WAIT,       /* no socket, reconnects at deadline */
+	VTM_WS_CL_ASYNC_STAT_CONNECT,    /* sends the upgrade request */
+	VTM_WS_CL_ASYNC_STAT_HANDSHAKE,  /* reads the upgrade response */
+	VTM_WS_CL_ASYNC_STAT_OPEN
+};
+
+struct vtm_ws_client_async_con
+{
+	vtm_ws_client_async             *cl;
+	void                            *arg;
+
+	/* destination */
+	enum vtm_url_scheme             scheme;
+	enum vtm_socket_family          fam;
+	char                            *host;
+	char                            *path;
+	unsigned int                    port;
+
+	/* owned by the event loop */
+	enum vtm_ws_client_async_stat   stat;
+	vtm_socket                      *sock;
+	struct vtm_buf                  recvbuf;
+	struct vtm_http_parser          http_parser;
+	struct vtm_ws_parser            parser;
+	uint64_t                        deadline;  /**< zero means none */
+	unsigned int                    attempts;
+
+	/* output, shared with sending threads */
+	vtm_mutex                       *mtx;
+	struct vtm_buf                  sendbuf;
+	struct vtm_buf                  compbuf;
+	vtm_ws_deflate                  *deflate;
+	uint64_t                        mask_seed;
+	bool                            open;
+	bool                            closing;
+	bool                            finished;
+
+	/* handle of the application and the event loop */
+	VTM_ATOMIC_INT32_TYPE           refs;
+
+	/* set while the connection waits for the event loop to flush it */
+	vtm_atomic_flag                 dirty;
+	struct vtm_ws_client_async_con  *dirty_next;
+
+	/* queued or started connections */
+	struct vtm_ws_client_async_con  *prev;
+	struct vtm_ws_client_async_con  *next;
+};
+
+struct vtm_ws_client_async
+{
+	vtm_socket_listener             *li;
+	struct vtm_ws_client_async_cbs  cbs;
+
+	/* connections passed from other threads */
+	vtm_mutex                       *mtx;
+	struct vtm_ws_client_async_con  *queue;
+	struct vtm_ws_client_async_con  *dirty;
+	bool                            running;
+	bool                            stop;
+
+	/* owned by the event loop */
+	struct vtm_ws_client_async_con  *cons;
+	size_t                          num_timed;
+
+	/* options */
+	unsigned int                    hints;
+	unsigned long                   opt_timeout;
+	unsigned long                   opt_reconnect_min;
+	unsigned long                   opt_reconnect_max;
+	struct vtm_ws_deflate_opts      deflate_opts;
+};
+
+/* forward declaration */
+static void vtm_ws_client_async_cancel(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *list);
+static void vtm_ws_client_async_mark_dirty(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con);
+static void vtm_ws_client_async_start(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con);
+static void vtm_ws_client_async_update(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con);
+static unsigned long vtm_ws_client_async_expire(vtm_ws_client_async *cl);
+static void vtm_ws_client_async_handle(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con);
+static void vtm_ws_client_async_con_detach(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con);
+static void vtm_ws_client_async_con_unref(struct vtm_ws_client_async_con *con);
+static void vtm_ws_client_async_con_set_deadline(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con, uint64_t deadline);
+static void vtm_ws_client_async_con_connect(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con);
+static int  vtm_ws_client_async_con_build(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con);
+static void vtm_ws_client_async_con_disconnect(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con);
+static void vtm_ws_client_async_con_fail(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con, int rc);
+static void vtm_ws_client_async_con_finish(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con, int rc);
+static int  vtm_ws_client_async_con_watch(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con, bool pending);
+static int  vtm_ws_client_async_con_flush(struct vtm_ws_client_async_con *con, bool *pending);
+static int  vtm_ws_client_async_con_queue(struct vtm_ws_client_async_con *con, enum vtm_ws_msg_type type, const void *src, size_t len);
+static void vtm_ws_client_async_con_send_request(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con);
+static void vtm_ws_client_async_con_handshake(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con);
+static int  vtm_ws_client_async_con_upgrade(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con);
+static void vtm_ws_client_async_con_serve(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con);
+static bool vtm_ws_client_async_con_deliver(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con);
+
+vtm_ws_client_async* vtm_ws_client_async_new(const struct vtm_ws_client_async_cbs *cbs)
+{
+	vtm_ws_client_async *cl;
+
+	cl = malloc(sizeof(*cl));
+	if (!cl) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	cl->li = vtm_socket_listener_new(VTM_WS_CL_ASYNC_EVENTS);
+	if (!cl->li)
+		goto err_li;
+
+	cl->mtx = vtm_mutex_new();
+	if (!cl->mtx)
+		goto err_mtx;
+
+	cl->cbs = *cbs;
+	cl->queue = NULL;
+	cl->dirty = NULL;
+	cl->running = false;
+	cl->stop = false;
+	cl->cons = NULL;
+	cl->num_timed = 0;
+	cl->hints = 0;
+	cl->opt_timeout = VTM_WS_CL_ASYNC_DEF_TIMEOUT;
+	cl->opt_reconnect_min = VTM_WS_CL_ASYNC_DEF_RECONNECT_MIN;
+	cl->opt_reconnect_max = VTM_WS_CL_ASYNC_DEF_RECONNECT_MAX;
+	memset(&cl->deflate_opts, 0, sizeof(cl->deflate_opts));
+
+	return cl;
+
+err_mtx:
+	vtm_socket_listener_free(cl->li);
+
+err_li:
+	free(cl);
+	return NULL;
+}
+
+void vtm_ws_client_async_free(vtm_ws_client_async *cl)
+{
+	if (!cl)
+		return;
+
+	vtm_ws_client_async_cancel(cl, cl->queue);
+
+	vtm_mutex_free(cl->mtx);
+	vtm_socket_listener_free(cl->li);
+	free(cl);
+}
+
+int vtm_ws_client_async_set_opt(vtm_ws_client_async *cl, int opt, const void *val, size_t len)
+{
+	switch (opt) {
+		case VTM_WS_CL_ASYNC_OPT_NO_CERT_CHECK:
+			if (len != sizeof(bool))
+				return VTM_E_INVALID_ARG;
+			if (*((bool*) val))
+				cl->hints |= VTM_WS_CL_ASYNC_HINT_NO_CERT_CHECK;
+			else
+				cl->hints &= ~VTM_WS_CL_ASYNC_HINT_NO_CERT_CHECK;
+			return VTM_OK;
+
+		case VTM_WS_CL_ASYNC_OPT_TIMEOUT:
+			if (len != sizeof(unsigned long))
+				return VTM_E_INVALID_ARG;
+			cl->opt_timeout = *((unsigned long*) val);
+			return VTM_OK;
+
+		case VTM_WS_CL_ASYNC_OPT_DEFLATE:
+			if (len != sizeof(struct vtm_ws_deflate_opts))
+				return VTM_E_INVALID_ARG;
+			cl->deflate_opts = *((const struct vtm_ws_deflate_opts*) val);
+			return VTM_OK;
+
+		case VTM_WS_CL_ASYNC_OPT_RECONNECT_MIN:
+			if (len != sizeof(unsigned long))
+				return VTM_E_INVALID_ARG;
+			cl->opt_reconnect_min = *((unsigned long*) val);
+			return VTM_OK;
+
+		case VTM_WS_CL_ASYNC_OPT_RECONNECT_MAX:
+			if (len != sizeof(unsigned long))
+				return VTM_E_INVALID_ARG;
+			cl->opt_reconnect_max = *((unsigned long*) val);
+			return VTM_OK;
+
+		default:
+			break;
+	}
+
+	return VTM_E_NOT_SUPPORTED;
+}
+
+int vtm_ws_client_async_connect(vtm_ws_client_async *cl, enum vtm_socket_family fam, const char *url, void *arg, vtm_ws_client_async_con **out)
+{
+	int rc;
+	struct vtm_url u;
+	struct vtm_ws_client_async_con *con;
+
+	rc = vtm_url_parse(url, &u);
+	if (rc != VTM_OK)
+		return rc;
+
+	con = malloc(sizeof(*con));
+	if (!con) {
+		vtm_err_oom();
+		rc = vtm_err_get_code();
+		goto end;
+	}
+
+	con->mtx = vtm_mutex_new();
+	if (!con->mtx) {
+		rc = vtm_err_get_code();
+		free(con);
+		goto end;
+	}
+
+	rc = vtm_ws_parser_init(&con->parser, VTM_WS_MODE_CLIENT);
+	if (rc != VTM_OK) {
+		vtm_mutex_free(con->mtx);
+		free(con);
+		goto end;
+	}
+
+	/* messages are only valid during the callback */
+	vtm_ws_parser_set_zero_copy(&con->parser, true);
+	vtm_http_parser_init(&con->http_parser, VTM_HTTP_PM_RESPONSE);
+	vtm_buf_init(&con->recvbuf, VTM_NET_BYTEORDER);
+	vtm_buf_init(&con->sendbuf, VTM_NET_BYTEORDER);
+	vtm_buf_init(&con->compbuf, VTM_NET_BYTEORDER);
+
+	con->cl = cl;
+	con->arg = arg;
+	con->scheme = u.scheme;
+	con->fam = fam;
+	con->host = u.host;
+	con->path = u.path;
+	con->port = u.port;
+	con->stat = VTM_WS_CL_ASYNC_STAT_WAIT;
+	con->sock = NULL;
+	con->deadline = 0;
+	con->attempts = 0;
+	con->deflate = NULL;
+	con->mask_seed = vtm_time_current_micros() ^ (uint64_t) (uintptr_t) con;
+	con->open = false;
+	con->closing = false;
+	con->finished = false;
+	con->refs = 2;
+	vtm_atomic_flag_init(con->dirty, false);
+	con->dirty_next = NULL;
+	con->prev = NULL;
+
+	/* host and path are kept for reconnecting */
+	u.host = NULL;
+	u.path = NULL;
+
+	/* loop picks up queued connections after interruption */
+	vtm_mutex_lock(cl->mtx);
+	con->next = cl->queue;
+	cl->queue = con;
+	vtm_mutex_unlock(cl->mtx);
+
+	vtm_socket_listener_interrupt(cl->li);
+
+	*out = con;
+
+end:
+	vtm_url_release(&u);
+
+	return rc;
+}
+
+void vtm_ws_client_async_close(vtm_ws_client_async_con *con)
+{
+	/* status code 1000, normal closure */
+	static const unsigned char payload[] = {0x03, 0xe8};
+
+	vtm_mutex_lock(con->mtx);
+	if (!con->finished) {
+		if (con->open) {
+			vtm_ws_client_async_con_queue(con, VTM_WS_MSG_CLOSE, payload, sizeof(payload));
+			con->open = false;
+		}
+		con->closing = true;
+		vtm_ws_client_async_mark_dirty(con->cl, con);
+	}
+	vtm_mutex_unlock(con->mtx);
+
+	/* loop keeps its own reference until the connection is finished */
+	vtm_ws_client_async_con_unref(con);
+}
+
+int vtm_ws_client_async_send(vtm_ws_client_async_con *con, enum vtm_ws_msg_type type, const void *src, size_t len)
+{
+	int rc;
+
+	vtm_mutex_lock(con->mtx);
+	if (con->open)
+		rc = vtm_ws_client_async_con_queue(con, type, src, len);
+	else
+		rc = VTM_E_INVALID_STATE;
+
+	/* finished connections are not open, so the loop still knows it */
+	if (rc == VTM_OK)
+		vtm_ws_client_async_mark_dirty(con->cl, con);
+	vtm_mutex_unlock(con->mtx);
+
+	return rc;
+}
+
+int vtm_ws_client_async_run(vtm_ws_client_async *cl)
+{
+	int rc;
+	size_t i, num_events;
+	unsigned long timeout;
+	struct vtm_socket_event *events;
+	struct vtm_ws_client_async_con *queue, *dirty, *next;
+
+	vtm_mutex_lock(cl->mtx);
+	if (cl->running) {
+		vtm_mutex_unlock(cl->mtx);
+		return VTM_E_INVALID_STATE;
+	}
+	cl->running = true;
+	vtm_mutex_unlock(cl->mtx);
+
+	rc = VTM_OK;
+
+	while (true) {
+		/* take connections and output of other threads */
+		vtm_mutex_lock(cl->mtx);
+		if (cl->stop) {
+			vtm_mutex_unlock(cl->mtx);
+			break;
+		}
+		queue = cl->queue;
+		cl->queue = NULL;
+		dirty = cl->dirty;
+		cl->dirty = NULL;
+		vtm_mutex_unlock(cl->mtx);
+
+		for (; queue; queue = next) {
+			next = queue->next;
+			vtm_ws_client_async_start(cl, queue);
+		}
+
+		/* all messages queued since the last round are written at once */
+		for (; dirty; dirty = next) {
+			next = dirty->dirty_next;
+			vtm_ws_client_async_update(cl, dirty);
+		}
+
+		/* wait until next deadline */
+		timeout = vtm_ws_client_async_expire(cl);
+		if (timeout > 0)
+			rc = vtm_socket_listener_run_timeout(cl->li, &events, &num_events, timeout);
+		else
+			rc = vtm_socket_listener_run(cl->li, &events, &num_events);
+		if (rc != VTM_OK)
+			break;
+
+		for (i=0; i < num_events; i++)
+			vtm_ws_client_async_handle(cl, vtm_socket_get_usr_data(events[i].sock));
+	}
+
+	/* connections are not processed anymore */
+	vtm_mutex_lock(cl->mtx);
+	queue = cl->queue;
+	cl->queue = NULL;
+	cl->dirty = NULL;
+	cl->running = false;
+	cl->stop = false;
+	vtm_mutex_unlock(cl->mtx);
+
+	while (cl->cons)
+		vtm_ws_client_async_con_finish(cl, cl->cons, VTM_E_IO_CANCELED);
+	vtm_ws_client_async_cancel(cl, queue);
+
+	/* message buffers were borrowed by this thread */
+	vtm_ws_msg_pool_clear();
+
+	return rc;
+}
+
+void vtm_ws_client_async_stop(vtm_ws_client_async *cl)
+{
+	vtm_mutex_lock(cl->mtx);
+	cl->stop = true;
+	vtm_mutex_unlock(cl->mtx);
+
+	vtm_socket_listener_interrupt(cl->li);
+}
+
+static void vtm_ws_client_async_cancel(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *list)
+{
+	struct vtm_ws_client_async_con *next;
+
+	for (; list; list = next) {
+		next = list->next;
+		vtm_ws_client_async_con_detach(cl, list);
+		if (cl->cbs.ws_close)
+			cl->cbs.ws_close(list->arg, list, VTM_E_IO_CANCELED, false);
+		vtm_ws_client_async_con_unref(list);
+	}
+}
+
+static void vtm_ws_client_async_mark_dirty(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con)
+{
+	bool wakeup;
+
+	/* already waiting, the output is taken along */
+	if (VTM_ATOMIC_CAS_INT32(&con->dirty, 0, 1) != 0)
+		return;
+
+	vtm_mutex_lock(cl->mtx);
+	con->dirty_next = cl->dirty;
+	wakeup = cl->dirty == NULL;
+	cl->dirty = con;
+	vtm_mutex_unlock(cl->mtx);
+
+	/* one interruption per round is enough */
+	if (wakeup)
+		vtm_socket_listener_interrupt(cl->li);
+}
+
+static void vtm_ws_client_async_start(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con)
+{
+	con->prev = NULL;
+	con->next = cl->cons;
+	if (cl->cons)
+		cl->cons->prev = con;
+	cl->cons = con;
+
+	/* connected by the expiry, a close may be pending in this round */
+	con->stat = VTM_WS_CL_ASYNC_STAT_WAIT;
+	vtm_ws_client_async_con_set_deadline(cl, con, vtm_time_current_millis());
+}
+
+static void vtm_ws_client_async_update(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con)
+{
+	int rc;
+	bool closing, pending;
+
+	/* later messages mark the connection again */
+	vtm_atomic_flag_unset(con->dirty);
+
+	vtm_mutex_lock(con->mtx);
+	closing = con->closing;
+	vtm_mutex_unlock(con->mtx);
+
+	if (con->stat != VTM_WS_CL_ASYNC_STAT_OPEN) {
+		if (closing)
+			vtm_ws_client_async_con_finish(cl, con, VTM_OK);
+		return;
+	}
+
+	rc = vtm_ws_client_async_con_flush(con, &pending);
+
+	/* close frame is sent on a best effort basis */
+	if (closing) {
+		vtm_ws_client_async_con_finish(cl, con, VTM_OK);
+		return;
+	}
+
+	if (rc == VTM_OK)
+		rc = vtm_ws_client_async_con_watch(cl, con, pending);
+	if (rc != VTM_OK)
+		vtm_ws_client_async_con_fail(cl, con, rc);
+}
+
+static unsigned long vtm_ws_client_async_expire(vtm_ws_client_async *cl)
+{
+	uint64_t now, next;
+	struct vtm_ws_client_async_con *con, *con_next;
+
+	/* open connections have no deadline */
+	if (cl->num_timed == 0)
+		return 0;
+
+	now = vtm_time_current_millis();
+	for (con = cl->cons; con; con = con_next) {
+		con_next = con->next;
+		if (con->deadline == 0 || con->deadline > now)
+			continue;
+
+		if (con->stat == VTM_WS_CL_ASYNC_STAT_WAIT)
+			vtm_ws_client_async_con_connect(cl, con);
+		else
+			vtm_ws_client_async_con_fail(cl, con, VTM_E_IO_TIMEOUT);
+	}
+
+	now = vtm_time_current_millis();
+	next = 0;
+	for (con = cl->cons; con; con = con->next) {
+		if (con->deadline > 0 && (next == 0 || con->deadline < next))
+			next = con->deadline;
+	}
+
+	if (next == 0)
+		return 0;
+
+	return next > now ? (unsigned long) (next - now) : 1;
+}
+
+static void vtm_ws_client_async_handle(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con)
+{
+	/* errors are reported by the next socket operation */
+	switch (con->stat) {
+		case VTM_WS_CL_ASYNC_STAT_CONNECT:
+			vtm_ws_client_async_con_send_request(cl, con);
+			break;
+
+		case VTM_WS_CL_ASYNC_STAT_HANDSHAKE:
+			vtm_ws_client_async_con_handshake(cl, con);
+			break;
+
+		case VTM_WS_CL_ASYNC_STAT_OPEN:
+			vtm_ws_client_async_con_serve(cl, con);
+			break;
+
+		default:
+			break;
+	}
+}
+
+static void vtm_ws_client_async_con_detach(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con)
+{
+	struct vtm_ws_client_async_con *it;
+
+	/* senders mark the connection under the lock, afterwards nobody does */
+	vtm_mutex_lock(con->mtx);
+	con->finished = true;
+	vtm_mutex_unlock(con->mtx);
+
+	/* may still wait for a flush */
+	vtm_mutex_lock(cl->mtx);
+	if (cl->dirty == con) {
+		cl->dirty = con->dirty_next;
+	}
+	else {
+		for (it = cl->dirty; it; it = it->dirty_next) {
+			if (it->dirty_next == con) {
+				it->dirty_next = con->dirty_next;
+				break;
+			}
+		}
+	}
+	vtm_mutex_unlock(cl->mtx);
+}
+
+static void vtm_ws_client_async_con_unref(struct vtm_ws_client_async_con *con)
+{
+	if (VTM_ATOMIC_ADD_INT32(&con->refs, -1) > 0)
+		return;
+
+	vtm_ws_parser_release(&con->parser);
+	vtm_http_parser_release(&con->http_parser);
+	vtm_buf_release(&con->recvbuf);
+	vtm_buf_release(&con->sendbuf);
+	vtm_buf_release(&con->compbuf);
+	vtm_ws_deflate_free(con->deflate);
+	vtm_mutex_free(con->mtx);
+	free(con->host);
+	free(con->path);
+	free(con);
+}
+
+static void vtm_ws_client_async_con_set_deadline(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con, uint64_t deadline)
+{
+	if (con->deadline == 0 && deadline > 0)
+		cl->num_timed++;
+	else if (con->deadline > 0 && deadline == 0)
+		cl->num_timed--;
+
+	con->deadline = deadline;
+}
+
+static void vtm_ws_client_async_con_connect(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con)
+{
+	int rc;
+	struct vtm_socket_tls_opts tls_opts;
+
+	switch (con->scheme) {
+		case VTM_URL_SCHEME_HTTP:
+			con->sock = vtm_socket_new(con->fam, VTM_SOCK_TYPE_STREAM);
+			break;
+
+		case VTM_URL_SCHEME_HTTPS:
+			memset(&tls_opts, 0, sizeof(tls_opts));
+			if (cl->hints & VTM_WS_CL_ASYNC_HINT_NO_CERT_CHECK)
+				tls_opts.no_cert_check = true;
+			con->sock = vtm_socket_tls_new(con->fam, &tls_opts);
+			break;
+
+		default:
+			vtm_err_set(VTM_E_NOT_SUPPORTED);
+			con->sock = NULL;
+			break;
+	}
+
+	if (!con->sock) {
+		rc = vtm_err_get_code();
+		goto err;
+	}
+
+	vtm_socket_set_usr_data(con->sock, con);
+	con->stat = VTM_WS_CL_ASYNC_STAT_CONNECT;
+	vtm_ws_client_async_con_set_deadline(cl, con, cl->opt_timeout > 0 ?
+		vtm_time_current_millis() + cl->opt_timeout : 0);
+
+	rc = vtm_socket_set_opt(con->sock, VTM_SOCK_OPT_NONBLOCKING, (bool[]) {true}, sizeof(bool));
+	if (rc != VTM_OK)
+		goto err;
+
+	/* upgrade request is sent as soon as connection is established */
+	rc = vtm_socket_connect(con->sock, con->host, con->port);
+	if (rc != VTM_OK && rc != VTM_E_IO_AGAIN)
+		goto err;
+
+	rc = vtm_ws_client_async_con_build(cl, con);
+	if (rc != VTM_OK)
+		goto err;
+
+	vtm_socket_set_state(con->sock, VTM_SOCK_STAT_NBL_WRITE);
+	rc = vtm_socket_listener_add(cl->li, con->sock);
+	if (rc != VTM_OK)
+		goto err;
+
+	return;
+
+err:
+	vtm_ws_client_async_con_fail(cl, con, rc);
+}
+
+static int vtm_ws_client_async_con_build(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con)
+{
+	int rc;
+	struct vtm_buf *buf;
+	char ws_key[VTM_BASE64_ENC_BUF_LEN(sizeof(uint64_t))];
+	uint64_t nonce;
+
+	/* generate websocket handshake key */
+	nonce = vtm_time_current_micros() ^ con->mask_seed;
+	rc = vtm_base64_encode(&nonce, sizeof(nonce), ws_key, sizeof(ws_key));
+	if (rc != VTM_OK)
+		return rc;
+
+	/* connection is not open, senders do not append */
+	buf = &con->sendbuf;
+
+	vtm_buf_puts(buf, "GET ");
+	vtm_buf_puts(buf, con->path ? con->path : "/");
+	vtm_buf_puts(buf, " HTTP/1.1\r\nHost: ");
+	vtm_buf_puts(buf, con->host);
+	vtm_buf_puts(buf, "\r\n");
+
+	vtm_buf_puts(buf, VTM_HTTP_HEADER_UPGRADE);
+	vtm_buf_puts(buf, ": ");
+	vtm_buf_puts(buf, VTM_HTTP_VALUE_WEBSOCKET);
+	vtm_buf_puts(buf, "\r\n");
+	vtm_buf_puts(buf, VTM_HTTP_HEADER_CONNECTION);
+	vtm_buf_puts(buf, ": ");
+	vtm_buf_puts(buf, VTM_HTTP_VALUE_UPGRADE);
+	vtm_buf_puts(buf, "\r\n");
+	vtm_buf_puts(buf, VTM_HTTP_HEADER_SEC_WEBSOCKET_KEY);
+	vtm_buf_puts(buf, ": ");
+	vtm_buf_puts(buf, ws_key);
+	vtm_buf_puts(buf, "\r\n");
+	vtm_buf_puts(buf, VTM_HTTP_HEADER_SEC_WEBSOCKET_VERSION);
+	vtm_buf_puts(buf, ": 13\r\n");
+
+	if (cl->deflate_opts.enabled) {
+		vtm_buf_puts(buf, VTM_HTTP_HEADER_SEC_WEBSOCKET_EXTENSIONS);
+		vtm_buf_puts(buf, ": ");
+		vtm_ws_deflate_offer(&cl->deflate_opts, buf);
+		vtm_buf_puts(buf, "\r\n");
+	}
+
+	vtm_buf_puts(buf, "\r\n");
+
+	return buf->err;
+}
+
+static void vtm_ws_client_async_con_disconnect(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con)
+{
+	if (con->sock) {
+		vtm_socket_listener_remove(cl->li, con->sock);
+		vtm_socket_close(con->sock);
+		vtm_socket_free(con->sock);
+		con->sock = NULL;
+	}
+
+	/* unsent output belongs to the lost connection */
+	vtm_mutex_lock(con->mtx);
+	con->open = false;
+	vtm_buf_release(&con->sendbuf);
+	vtm_buf_init(&con->sendbuf, VTM_NET_BYTEORDER);
+	vtm_buf_release(&con->compbuf);
+	vtm_buf_init(&con->compbuf, VTM_NET_BYTEORDER);
+	vtm_ws_deflate_free(con->deflate);
+	con->deflate = NULL;
+	vtm_mutex_unlock(con->mtx);
+
+	vtm_ws_parser_set_deflate(&con->parser, NULL);
+	vtm_ws_parser_reset(&con->parser);
+	vtm_http_parser_release(&con->http_parser);
+	vtm_http_parser_reset(&con->http_parser);
+	vtm_buf_release(&con->recvbuf);
+	vtm_buf_init(&con->recvbuf, VTM_NET_BYTEORDER);
+
+	con->stat = VTM_WS_CL_ASYNC_STAT_WAIT;
+	vtm_ws_client_async_con_set_deadline(cl, con, 0);
+}
+
+static void vtm_ws_client_async_con_fail(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con, int rc)
+{
+	unsigned long delay;
+	unsigned int i;
+	bool reconnect;
+
+	reconnect = cl->opt_reconnect_min > 0;
+	if (!reconnect) {
+		vtm_ws_client_async_con_finish(cl, con, rc);
+		return;
+	}
+
+	vtm_ws_client_async_con_disconnect(cl, con);
+	if (cl->cbs.ws_close)
+		cl->cbs.ws_close(con->arg, con, rc, true);
+
+	/* exponential backoff */
+	delay = cl->opt_reconnect_min;
+	for (i=0; i < con->attempts && delay < cl->opt_reconnect_max; i++)
+		delay *= 2;
+	if (delay > cl->opt_reconnect_max)
+		delay = cl->opt_reconnect_max;
+	if (con->attempts < VTM_WS_CL_ASYNC_MAX_ATTEMPTS)
+		con->attempts++;
+
+	/* random half of the delay, so that feeds of a restarted server spread */
+	delay = delay / 2 + vtm_hash_unum(con->mask_seed++) % (delay / 2 + 1);
+
+	vtm_ws_client_async_con_set_deadline(cl, con, vtm_time_current_millis() + delay);
+}
+
+static void vtm_ws_client_async_con_finish(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con, int rc)
+{
+	vtm_ws_client_async_con_disconnect(cl, con);
+
+	if (con->prev)
+		con->prev->next = con->next;
+	else
+		cl->cons = con->next;
+	if (con->next)
+		con->next->prev = con->prev;
+
+	vtm_ws_client_async_con_detach(cl, con);
+	if (cl->cbs.ws_close)
+		cl->cbs.ws_close(con->arg, con, rc, false);
+
+	vtm_ws_client_async_con_unref(con);
+}
+
+static int vtm_ws_client_async_con_watch(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con, bool pending)
+{
+	unsigned int state, flags;
+
+	state = vtm_socket_get_state(con->sock);
+
+	/* TLS may need to read before it can write and vice versa */
+	if (con->stat == VTM_WS_CL_ASYNC_STAT_CONNECT) {
+		flags = (state & VTM_SOCK_STAT_WRITE_AGAIN_WHEN_READABLE)
+			? VTM_SOCK_STAT_NBL_READ
+			: VTM_SOCK_STAT_NBL_WRITE;
+	}
+	else {
+		flags = VTM_SOCK_STAT_NBL_READ;
+		if (pending || (state & VTM_SOCK_STAT_READ_AGAIN_WHEN_WRITEABLE))
+			flags |= VTM_SOCK_STAT_NBL_WRITE;
+	}
+
+	vtm_socket_unset_state(con->sock, VTM_SOCK_STAT_NBL_READ | VTM_SOCK_STAT_NBL_WRITE);
+	vtm_socket_set_state(con->sock, flags);
+
+	return vtm_socket_listener_rearm(cl->li, con->sock);
+}
+
+static int vtm_ws_client_async_con_flush(struct vtm_ws_client_async_con *con, bool *pending)
+{
+	int rc;
+	size_t written;
+	struct vtm_buf *buf;
+
+	buf = &con->sendbuf;
+	rc = VTM_OK;
+
+	vtm_mutex_lock(con->mtx);
+
+	while (buf->read < buf->used) {
+		rc = vtm_socket_write(con->sock, buf->data + buf->read, buf->used - buf->read, &written);
+		buf->read += written;
+		if (rc != VTM_OK)
+			break;
+	}
+
+	if (buf->read == buf->used)
+		vtm_buf_clear(buf);
+	else
+		vtm_buf_discard_processed(buf);
+
+	*pending = buf->used > 0;
+
+	vtm_mutex_unlock(con->mtx);
+
+	return rc == VTM_E_IO_AGAIN ? VTM_OK : rc;
+}
+
+static int vtm_ws_client_async_con_queue(struct vtm_ws_client_async_con *con, enum vtm_ws_msg_type type, const void *src, size_t len)
+{
+	int rc;
+	size_t begin, payload_begin;
+	struct vtm_buf *buf;
+	struct vtm_ws_frame_desc desc;
+
+	buf = &con->sendbuf;
+	begin = buf->used;
+
+	memset(&desc, 0, sizeof(desc));
+	desc.fin = true;
+	desc.opcode = type;
+	desc.len = len;
+	desc.mask = vtm_hash_unum(con->mask_seed++);
+	desc.masked = 1;
+
+	/* compressed payload replaces the input */
+	if (con->deflate && (type == VTM_WS_MSG_TEXT || type == VTM_WS_MSG_BINARY)) {
+		vtm_buf_clear(&con->compbuf);
+		rc = vtm_ws_deflate_compress(con->deflate, src, len, &con->compbuf);
+		if (rc == VTM_OK) {
+			desc.rsv1 = 1;
+			desc.len = len = con->compbuf.used;
+			src = con->compbuf.data;
+		}
+		else if (rc != VTM_E_NOT_HANDLED) {
+			return rc;
+		}
+	}
+
+	/* header and payload are written to the output directly */
+	rc = vtm_ws_frame_write_header(buf, &desc);
+	payload_begin = buf->used;
+	if (rc == VTM_OK)
+		rc = vtm_buf_putm(buf, src, len);
+
+	if (rc != VTM_OK) {
+		/* partial frame would corrupt the stream */
+		buf->used = begin;
+		buf->err = VTM_OK;
+		return rc;
+	}
+
+	vtm_ws_frame_mask_payload(buf->data + payload_begin, len, desc.mask);
+
+	return VTM_OK;
+}
+
+static void vtm_ws_client_async_con_send_request(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con)
+{
+	int rc;
+	bool pending;
+
+	rc = vtm_ws_client_async_con_flush(con, &pending);
+	if (rc == VTM_OK && pending)
+		rc = vtm_ws_client_async_con_watch(cl, con, true);
+	if (rc != VTM_OK) {
+		vtm_ws_client_async_con_fail(cl, con, rc);
+		return;
+	}
+
+	if (pending)
+		return;
+
+	con->stat = VTM_WS_CL_ASYNC_STAT_HANDSHAKE;
+	vtm_ws_client_async_con_handshake(cl, con);
+}
+
+static void vtm_ws_client_async_con_handshake(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con)
+{
+	int rc;
+	size_t read;
+	enum vtm_net_recv_stat stat;
+
+	while (true) {
+		rc = vtm_buf_ensure(&con->recvbuf, VTM_WS_CL_ASYNC_READ_SIZE);
+		if (rc != VTM_OK) {
+			vtm_ws_client_async_con_fail(cl, con, rc);
+			return;
+		}
+
+		rc = vtm_socket_read(con->sock, VTM_BUF_PUT_PTR(&con->recvbuf),
+			VTM_BUF_PUT_AVAIL_TOTAL(&con->recvbuf), &read);
+		VTM_BUF_PUT_INC(&con->recvbuf, read);
+
+		if (rc == VTM_E_IO_AGAIN) {
+			rc = vtm_ws_client_async_con_watch(cl, con, false);
+			if (rc != VTM_OK)
+				vtm_ws_client_async_con_fail(cl, con, rc);
+			return;
+		}
+
+		if (rc != VTM_OK) {
+			vtm_ws_client_async_con_fail(cl, con, rc);
+			return;
+		}
+
+		stat = vtm_http_parser_run(&con->http_parser, &con->recvbuf);
+		if (stat == VTM_NET_RECV_STAT_COMPLETE)
+			break;
+		else if (stat != VTM_NET_RECV_STAT_AGAIN) {
+			vtm_ws_client_async_con_fail(cl, con, VTM_E_IO_PROTOCOL);
+			return;
+		}
+	}
+
+	rc = vtm_ws_client_async_con_upgrade(cl, con);
+	if (rc != VTM_OK) {
+		vtm_ws_client_async_con_fail(cl, con, rc);
+		return;
+	}
+
+	con->stat = VTM_WS_CL_ASYNC_STAT_OPEN;
+	con->attempts = 0;
+	vtm_ws_client_async_con_set_deadline(cl, con, 0);
+
+	if (cl->cbs.ws_open)
+		cl->cbs.ws_open(con->arg, con);
+
+	/* frames may have followed the response */
+	vtm_ws_client_async_con_serve(cl, con);
+}
+
+static int vtm_ws_client_async_con_upgrade(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con)
+{
+	int rc;
+	const char *val;
+	vtm_ws_deflate *wd;
+	struct vtm_ws_deflate_params params;
+
+	if (con->http_parser.res_status_code != VTM_HTTP_101_SWITCHING_PROTOCOLS)
+		return vtm_err_set(VTM_E_IO_PROTOCOL);
+
+	wd = NULL;
+	val = con->http_parser.headers ?
+		vtm_dataset_get_string(con->http_parser.headers, VTM_HTTP_HEADER_SEC_WEBSOCKET_EXTENSIONS) : NULL;
+
+	if (val) {
+		/* server must not answer with extensions that were not offered */
+		if (!cl->deflate_opts.enabled)
+			return vtm_err_set(VTM_E_IO_PROTOCOL);
+
+		rc = vtm_ws_deflate_confirm(&cl->deflate_opts, val, &params);
+		if (rc == VTM_OK) {
+			wd = vtm_ws_deflate_new(VTM_WS_MODE_CLIENT, &params, &cl->deflate_opts);
+			if (!wd)
+				return vtm_err_get_code();
+		}
+		else if (rc != VTM_E_NOT_FOUND) {
+			return rc;
+		}
+	}
+
+	/* remaining input is WebSocket data */
+	vtm_http_parser_release(&con->http_parser);
+	vtm_http_parser_reset(&con->http_parser);
+	vtm_ws_parser_set_deflate(&con->parser, wd);
+
+	vtm_mutex_lock(con->mtx);
+	con->deflate = wd;
+	con->open = true;
+	vtm_mutex_unlock(con->mtx);
+
+	return VTM_OK;
+}
+
+static void vtm_ws_client_async_con_serve(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con)
+{
+	int rc;
+	size_t read;
+	unsigned int rounds;
+	enum vtm_net_recv_stat stat;
+	bool pending;
+
+	rounds = 0;
+
+	while (true) {
+		stat = vtm_ws_parser_run(&con->parser, &con->recvbuf);
+		if (stat == VTM_NET_RECV_STAT_COMPLETE) {
+			if (!vtm_ws_client_async_con_deliver(cl, con))
+				return;
+			continue;
+		}
+		else if (stat != VTM_NET_RECV_STAT_AGAIN) {
+			vtm_ws_client_async_con_fail(cl, con, VTM_E_IO_PROTOCOL);
+			return;
+		}
+
+		/* busy connection lets the others take turns */
+		if (++rounds > VTM_WS_CL_ASYNC_READ_ROUNDS)
+			break;
+
+		rc = vtm_buf_ensure(&con->recvbuf, VTM_WS_CL_ASYNC_READ_SIZE);
+		if (rc != VTM_OK) {
+			vtm_ws_client_async_con_fail(cl, con, rc);
+			return;
+		}
+
+		rc = vtm_socket_read(con->sock, VTM_BUF_PUT_PTR(&con->recvbuf),
+			VTM_BUF_PUT_AVAIL_TOTAL(&con->recvbuf), &read);
+		VTM_BUF_PUT_INC(&con->recvbuf, read);
+
+		if (rc == VTM_E_IO_AGAIN && read == 0)
+			break;
+
+		if (rc != VTM_OK && rc != VTM_E_IO_AGAIN) {
+			vtm_ws_client_async_con_fail(cl, con, rc);
+			return;
+		}
+	}
+
+	/* pongs and messages sent by the callbacks */
+	rc = vtm_ws_client_async_con_flush(con, &pending);
+	if (rc == VTM_OK)
+		rc = vtm_ws_client_async_con_watch(cl, con, pending);
+	if (rc != VTM_OK)
+		vtm_ws_client_async_con_fail(cl, con, rc);
+}
+
+static bool vtm_ws_client_async_con_deliver(vtm_ws_client_async *cl, struct vtm_ws_client_async_con *con)
+{
+	int rc;
+	bool pending;
+	struct vtm_ws_msg msg;
+
+	rc = vtm_ws_parser_get_msg(&con->parser, &msg);
+	if (rc != VTM_OK) {
+		vtm_ws_client_async_con_fail(cl, con, rc);
+		return false;
+	}
+
+	switch (msg.type) {
+		case VTM_WS_MSG_PING:
+			vtm_mutex_lock(con->mtx);
+			if (con->open)
+				vtm_ws_client_async_con_queue(con, VTM_WS_MSG_PONG, msg.data, msg.len);
+			vtm_mutex_unlock(con->mtx);
+			break;
+
+		case VTM_WS_MSG_PONG:
+			break;
+
+		case VTM_WS_MSG_CLOSE:
+			/* echo the status code and give up the connection */
+			vtm_mutex_lock(con->mtx);
+			if (con->open) {
+				vtm_ws_client_async_con_queue(con, VTM_WS_MSG_CLOSE, msg.data, msg.len < 2 ? msg.len : 2);
+				con->open = false;
+			}
+			vtm_mutex_unlock(con->mtx);
+			vtm_ws_msg_release(&msg);
+
+			vtm_ws_client_async_con_flush(con, &pending);
+			vtm_ws_client_async_con_fail(cl, con, VTM_E_IO_CLOSED);
+			return false;
+
+		default:
+			msg.con = NULL;
+			if (cl->cbs.ws_message)
+				cl->cbs.ws_message(con->arg, con, &msg);
+			break;
+	}
+
+	vtm_ws_msg_release(&msg);
+
+	return true;
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+/**
+ * @file ws_client_async.h
+ *
+ * @brief Event based WebSocket client for many concurrent connections
+ *
+ * All connections of a client are served by one thread that runs
+ * vtm_ws_client_async_run(). A connection handle stays valid while the
+ * connection is reestablished, lost connections and failed attempts are
+ * retried with an exponential backoff. Pings of the server are answered
+ * automatically.
+ *
+ * Messages can be sent from any thread while the handle is valid. They
+ * are appended to the output of the connection and written by the event
+ * loop, so that messages sent in a row go out together with a single
+ * write.
+ *
+ * A handle stays valid until the application releases it with
+ * vtm_ws_client_async_close(), also after the connection was finished
+ * by the event loop. Every handle returned by vtm_ws_client_async_connect()
+ * must be closed exactly once.
+ */
+
+#ifndef VTM_NET_HTTP_WS_CLIENT_ASYNC_H_
+#define VTM_NET_HTTP_WS_CLIENT_ASYNC_H_
+
+#include <vtm/core/api.h>
+#include <vtm/core/types.h>
+#include <vtm/net/socket_spec.h>
+#include <vtm/net/http/ws.h>
+#include <vtm/net/http/ws_deflate.h>
+#include <vtm/net/http/ws_message.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VTM_WS_CL_ASYNC_OPT_NO_CERT_CHECK    1  /**< expects bool */
+#define VTM_WS_CL_ASYNC_OPT_TIMEOUT          2  /**< expects unsigned long, deadline of connect and handshake in milliseconds */
+#define VTM_WS_CL_ASYNC_OPT_DEFLATE          3  /**< expects struct vtm_ws_deflate_opts, offers permessage-deflate */
+#define VTM_WS_CL_ASYNC_OPT_RECONNECT_MIN    4  /**< expects unsigned long, first reconnect delay in milliseconds, zero disables reconnects */
+#define VTM_WS_CL_ASYNC_OPT_RECONNECT_MAX    5  /**< expects unsigned long, upper bound of the reconnect delay in milliseconds */
+
+typedef struct vtm_ws_client_async vtm_ws_client_async;
+typedef struct vtm_ws_client_async_con vtm_ws_client_async_con;
+
+/**
+ * Callbacks of the client.
+ *
+ * All callbacks run in the thread that executes vtm_ws_client_async_run().
+ * Messages may be sent and new connections may be started from within
+ * the callbacks.
+ */
+struct vtm_ws_client_async_cbs
+{
+	/**
+	 * Called when the handshake of a connection completed, again after
+	 * every reconnect. Subscriptions should be sent here.
+	 */
+	void (*ws_open)(void *arg, vtm_ws_client_async_con *con);
+
+	/**
+	 * Called for every received text or binary message. The message is
+	 * only valid until the callback returns.
+	 */
+	void (*ws_message)(void *arg, vtm_ws_client_async_con *con, struct vtm_ws_msg *msg);
+
+	/**
+	 * Called when a connection was lost or a connection attempt failed.
+	 *
+	 * The error code is VTM_E_IO_CLOSED if the server sent a close
+	 * frame, VTM_E_IO_EOF if the server dropped the connection,
+	 * VTM_E_IO_PROTOCOL if the upgrade was rejected or the server
+	 * violated the protocol, VTM_E_IO_TIMEOUT if the handshake did not complete in
+	 * time, VTM_OK if vtm_ws_client_async_close() was called and
+	 * VTM_E_IO_CANCELED if the client was stopped or released.
+	 *
+	 * If reconnect is false the connection is finished and messages
+	 * can not be sent anymore. The handle stays valid until
+	 * vtm_ws_client_async_close() was called for it.
+	 */
+	void (*ws_close)(void *arg, vtm_ws_client_async_con *con, int rc, bool reconnect);
+};
+
+/**
+ * Creates a new client.
+ *
+ * @param cbs the callbacks of the client, copied by this call
+ * @return the created client which can be used in the other functions
+ * @return NULL if an error occured
+ */
+VTM_API vtm_ws_client_async* vtm_ws_client_async_new(const struct vtm_ws_client_async_cbs *cbs);
+
+/**
+ * Releases the client and all allocated resources.
+ *
+ * The client must not be running anymore. Connections that were not
+ * started yet are finished with VTM_E_IO_CANCELED. Handles that were
+ * not closed yet stay valid until vtm_ws_client_async_close().
+ *
+ * @param cl the client that should be released
+ */
+VTM_API void vtm_ws_client_async_free(vtm_ws_client_async *cl);
+
+/**
+ * Sets one of the possible options.
+ *
+ * The possible options are macros starting with VTM_WS_CL_ASYNC_OPT_.
+ * Options should be set before the client runs.
+ *
+ * @param cl the client where the option should be set
+ * @param opt the option that should be set
+ * @param val pointer to new value of the option
+ * @param len size of the value
+ * @return VTM_OK if the option was successfully set
+ * @return VTM_E_NOT_SUPPORTED if the given option or the value format is
+ *         not supported
+ */
+VTM_API int vtm_ws_client_async_set_opt(vtm_ws_client_async *cl, int opt, const void *val, size_t len);
+
+/**
+ * Starts a new connection.
+ *
+ * The call does not block, the connection is established by the event
+ * loop. It can be called from any thread.
+ *
+ * @param cl the client
+ * @param fam the desired socket family (IPv4 or IPv6)
+ * @param url the url where to connect to (must use http/https as scheme)
+ * @param arg user argument that is passed to the callbacks
+ * @param[out] con the handle of the connection
+ * @return VTM_OK if the connection was queued, then the ws_close
+ *         callback is invoked with reconnect set to false exactly once
+ *         and the handle must be released with vtm_ws_client_async_close()
+ * @return VTM_E_INVALID_ARG if the url could not be parsed
+ * @return VTM_E_MALLOC if the connection could not be allocated
+ */
+VTM_API int vtm_ws_client_async_connect(vtm_ws_client_async *cl, enum vtm_socket_family fam, const char *url, void *arg, vtm_ws_client_async_con **con);
+
+/**
+ * Closes a connection for good and releases the handle.
+ *
+ * A close frame is sent if the connection is open. Afterwards the
+ * ws_close callback is invoked with VTM_OK. If the connection was
+ * already finished, only the handle is released. The call can be made
+ * from any thread, including the callbacks, and even after the client
+ * was released. The handle must not be used after the call.
+ *
+ * @param con the connection that should be closed
+ */
+VTM_API void vtm_ws_client_async_close(vtm_ws_client_async_con *con);
+
+/**
+ * Sends a message to the server.
+ *
+ * The message is copied to the output of the connection, the call does
+ * not block. It can be called from any thread while the handle is valid.
+ *
+ * @param con the connection
+ * @param type the type of the message
+ * @param src pointer to payload of message
+ * @param len length of payload
+ * @return VTM_OK if the message was queued
+ * @return VTM_E_INVALID_STATE if the connection is not open or finished
+ * @return VTM_ERROR if an error occured
+ */
+VTM_API int vtm_ws_client_async_send(vtm_ws_client_async_con *con, enum vtm_ws_msg_type type, const void *src, size_t len);
+
+/**
+ * Runs the event loop of the client.
+ *
+ * The call blocks until vtm_ws_client_async_stop() is called. All
+ * connections are closed and finished with VTM_E_IO_CANCELED then.
+ *
+ * @param cl the client
+ * @return VTM_OK if the client was stopped
+ * @return VTM_E_INVALID_STATE if the client is already running
+ * @return VTM_ERROR if an error occured
+ */
+VTM_API int vtm_ws_client_async_run(vtm_ws_client_async *cl);
+
+/**
+ * Stops the event loop of the client.
+ *
+ * The call does not wait for the event loop to finish. It can be
+ * called from any thread, including the callbacks.
+ *
+ * @param cl the client
+ */
+VTM_API void vtm_ws_client_async_stop(vtm_ws_client_async *cl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_NET_HTTP_WS_CLIENT_ASYNC_H_ */
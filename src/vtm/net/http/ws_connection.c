@@ -4,25 +4,62 @@
 
 #include "ws_connection.h"
 
-#include <string.h> /* memset() */
+#include <stdlib.h> /* malloc(), free() */
 #include <vtm/core/error.h>
 #include <vtm/net/socket_connection.h>
+#include <vtm/net/socket_intl.h>
 #include <vtm/net/http/http_connection_base_intl.h>
 #include <vtm/net/http/ws_parser.h>
 #include <vtm/net/http/ws_frame_intl.h>
 #include <vtm/net/http/ws_connection_intl.h>
+#include <vtm/net/http/ws_deflate_intl.h>
+#include <vtm/net/http/ws_error.h>
 #include <vtm/net/http/ws_message_intl.h>
+#include <vtm/util/atomic.h>
+#include <vtm/util/time.h>
+
+#define VTM_WS_CON_QUEUE_INIT   8
+#define VTM_WS_CON_IOVEC_MAX    16
 
 struct vtm_ws_con
 {
 	struct vtm_http_con_base   base;
 	struct vtm_socket_con      sock_con;
 	struct vtm_ws_parser       parser;
+	vtm_ws_deflate             *deflate;
+
+	/* frames waiting to be sent, guarded by the write lock */
+	struct vtm_ws_frame_buf    **queue;
+	size_t                     queue_cap;
+	size_t                     queue_head;
+	size_t                     queue_len;
+	size_t                     queue_bytes;
+	size_t                     offset;
+	bool                       congested;
+	bool                       closed;
+
+	const struct vtm_ws_con_opts  *opts;
+	vtm_ws_con_congestion_cb      congestion_cb;
+	void                          *congestion_arg;
+
+	/* keepalive, only the activity flag is set by the worker */
+	VTM_ATOMIC_INT32_TYPE      activity;
+	uint64_t                   idle_since;
+	uint64_t                   ping_sent;
+	size_t                     keepalive_slot;
 };
 
 /* forward declaration */
 static int vtm_ws_con_write(struct vtm_http_con_base *base_con);
 static enum vtm_net_recv_stat vtm_ws_con_read(struct vtm_http_con_base *base_con);
+static int vtm_ws_con_queue(vtm_ws_con *con, struct vtm_ws_frame_buf *fb);
+static int vtm_ws_con_push(vtm_ws_con *con, struct vtm_ws_frame_buf *fb);
+static int vtm_ws_con_flush(vtm_ws_con *con);
+static int vtm_ws_con_shed(vtm_ws_con *con, size_t len);
+static size_t vtm_ws_con_get_low_watermark(vtm_ws_con *con);
+static bool vtm_ws_con_is_data_frame(struct vtm_ws_frame_buf *fb);
+static void vtm_ws_con_close_locked(vtm_ws_con *con);
+static void vtm_ws_con_notify(vtm_ws_con *con, bool before, bool after);
 
 vtm_ws_con* vtm_ws_con_new(enum vtm_ws_mode mode, vtm_socket *sock)
 {
@@ -40,10 +77,33 @@ vtm_ws_con* vtm_ws_con_new(enum vtm_ws_mode mode, vtm_socket *sock)
 	}
 
 	if (vtm_ws_parser_init(&con->parser, mode) != VTM_OK) {
+		vtm_socket_con_release(&con->sock_con);
 		free(con);
 		return NULL;
 	}
 
+	/* messages are released before the connection reads again */
+	vtm_ws_parser_set_zero_copy(&con->parser, true);
+
+	con->deflate = NULL;
+	con->queue = NULL;
+	con->queue_cap = 0;
+	con->queue_head = 0;
+	con->queue_len = 0;
+	con->queue_bytes = 0;
+	con->offset = 0;
+	con->congested = false;
+	con->closed = false;
+
+	con->opts = NULL;
+	con->congestion_cb = NULL;
+	con->congestion_arg = NULL;
+
+	vtm_atomic_flag_init(con->activity, false);
+	con->idle_since = vtm_time_current_millis();
+	con->ping_sent = 0;
+	con->keepalive_slot = 0;
+
 	con->base.sock = sock;
 	con->base.type = VTM_HTTP_CON_TYPE_WS;
 	con->base.con_can_read = vtm_ws_con_read;
@@ -55,11 +115,120 @@ vtm_ws_con* vtm_ws_con_new(enum vtm_ws_mode mode, vtm_socket *sock)
 
 void vtm_ws_con_free(vtm_ws_con *con)
 {
+	while (con->queue_len > 0) {
+		vtm_ws_frame_buf_release(con->queue[con->queue_head]);
+		con->queue_head = (con->queue_head + 1) % con->queue_cap;
+		con->queue_len--;
+	}
+	free(con->queue);
+
 	vtm_socket_con_release(&con->sock_con);
 	vtm_ws_parser_release(&con->parser);
+	vtm_ws_deflate_free(con->deflate);
 	free(con);
 }
 
+int vtm_ws_con_enable_deflate(vtm_ws_con *con, const struct vtm_ws_deflate_params *params,
+	const struct vtm_ws_deflate_opts *opts)
+{
+	con->deflate = vtm_ws_deflate_new(VTM_WS_MODE_SERVER, params, opts);
+	if (!con->deflate)
+		return vtm_err_get_code();
+
+	vtm_ws_parser_set_deflate(&con->parser, con->deflate);
+
+	return VTM_OK;
+}
+
+vtm_ws_deflate* vtm_ws_con_get_deflate(vtm_ws_con *con)
+{
+	return con->deflate;
+}
+
+void vtm_ws_con_set_opts(vtm_ws_con *con, const struct vtm_ws_con_opts *opts)
+{
+	con->opts = opts;
+}
+
+void vtm_ws_con_set_congestion_cb(vtm_ws_con *con, vtm_ws_con_congestion_cb cb, void *arg)
+{
+	con->congestion_cb = cb;
+	con->congestion_arg = arg;
+}
+
+bool vtm_ws_con_is_congested(vtm_ws_con *con)
+{
+	bool result;
+
+	vtm_socket_con_write_lock(&con->sock_con);
+	result = con->congested;
+	vtm_socket_con_write_unlock(&con->sock_con);
+
+	return result;
+}
+
+size_t vtm_ws_con_get_queued(vtm_ws_con *con)
+{
+	size_t result;
+
+	vtm_socket_con_write_lock(&con->sock_con);
+	result = con->queue_bytes - con->offset;
+	vtm_socket_con_write_unlock(&con->sock_con);
+
+	return result;
+}
+
+void vtm_ws_con_close(vtm_ws_con *con)
+{
+	vtm_socket_con_write_lock(&con->sock_con);
+	vtm_ws_con_close_locked(con);
+	vtm_socket_con_write_unlock(&con->sock_con);
+}
+
+void vtm_ws_con_keepalive(vtm_ws_con *con, uint64_t now)
+{
+	unsigned long timeout;
+	struct vtm_ws_frame_buf *fb;
+
+	if (con->closed)
+		return;
+
+	/* any received data proves that the peer is alive */
+	if (VTM_ATOMIC_CAS_INT32(&con->activity, 1, 0) == 1) {
+		con->idle_since = now;
+		con->ping_sent = 0;
+		return;
+	}
+
+	if (con->ping_sent > 0) {
+		timeout = con->opts->pong_timeout > 0 ? con->opts->pong_timeout : con->opts->ping_interval;
+		if (now - con->ping_sent >= timeout)
+			vtm_ws_con_close(con);
+		return;
+	}
+
+	if (now - con->idle_since < con->opts->ping_interval)
+		return;
+
+	fb = vtm_ws_frame_buf_new(VTM_WS_MSG_PING, false, "", 0);
+	if (!fb)
+		return;
+
+	vtm_ws_con_send_frame(con, fb);
+	vtm_ws_frame_buf_release(fb);
+	con->ping_sent = now;
+}
+
+size_t vtm_ws_con_get_keepalive_slot(vtm_ws_con *con)
+{
+	return con->keepalive_slot;
+}
+
+void vtm_ws_con_set_keepalive_slot(vtm_ws_con *con, size_t slot)
+{
+	con->keepalive_slot = slot;
+}
+
 static enum vtm_net_recv_stat vtm_ws_con_read(struct vtm_http_con_base *base_con)
 {
 	int rc;
@@ -82,17 +251,30 @@ static enum vtm_net_recv_stat vtm_ws_con_read(struct vtm_http_con_base *base_con
 	if (rc != VTM_OK && rc != VTM_E_IO_AGAIN)
 		return VTM_NET_RECV_STAT_ERROR;
 
+	if (read > 0 && !vtm_atomic_flag_isset(con->activity))
+		vtm_atomic_flag_set(con->activity);
+
 	/* run parser */
 	return vtm_ws_parser_run(&con->parser, &con->sock_con.recvbuf);
 }
 
 static int vtm_ws_con_write(struct vtm_http_con_base *base_con)
 {
+	int rc;
 	vtm_ws_con *con;
+	bool before, after;
 
 	con = (vtm_ws_con*) base_con;
 
-	return vtm_socket_con_write(&con->sock_con);
+	vtm_socket_con_write_lock(&con->sock_con);
+	before = con->congested;
+	rc = vtm_ws_con_flush(con);
+	after = con->congested;
+	vtm_socket_con_write_unlock(&con->sock_con);
+
+	vtm_ws_con_notify(con, before, after);
+
+	return rc;
 }
 
 int vtm_ws_con_get_msg(vtm_ws_con *con, struct vtm_ws_msg *msg)
@@ -108,33 +290,261 @@ int vtm_ws_con_get_msg(vtm_ws_con *con, struct vtm_ws_msg *msg)
 int vtm_ws_con_send_msg(vtm_ws_con *con, enum vtm_ws_msg_type type, const void *data, size_t len)
 {
 	int rc;
-	struct vtm_ws_frame_desc desc;
+	struct vtm_ws_frame_buf *fb;
+	bool before, after;
+
+	if (!con->deflate || (type != VTM_WS_MSG_TEXT && type != VTM_WS_MSG_BINARY)) {
+		fb = vtm_ws_frame_buf_new(type, false, data, len);
+		if (!fb)
+			return vtm_err_get_code();
 
-	memset(&desc, 0, sizeof(desc));
-	desc.fin = true;
-	desc.opcode = type;
-	desc.len = len;
+		rc = vtm_ws_con_send_frame(con, fb);
+		vtm_ws_frame_buf_release(fb);
 
+		return rc;
+	}
+
+	/* compressor context must advance in sending order */
 	vtm_socket_con_write_lock(&con->sock_con);
+	before = con->congested;
 
-	rc = vtm_ws_frame_write_header(&con->sock_con.sendbuf, &desc);
-	if (rc != VTM_OK)
-		goto end;
+	if (con->closed) {
+		rc = vtm_err_set(VTM_E_IO_CLOSED);
+	}
+	else {
+		fb = vtm_ws_deflate_frame_new(con->deflate, type, data, len);
+		if (fb) {
+			rc = vtm_ws_con_queue(con, fb);
+			vtm_ws_frame_buf_release(fb);
+		}
+		else {
+			rc = vtm_err_get_code();
+		}
+	}
+
+	after = con->congested;
+	vtm_socket_con_write_unlock(&con->sock_con);
+
+	vtm_ws_con_notify(con, before, after);
+
+	return rc;
+}
+
+int vtm_ws_con_send_frame(vtm_ws_con *con, struct vtm_ws_frame_buf *fb)
+{
+	int rc;
+	bool before, after;
+
+	vtm_socket_con_write_lock(&con->sock_con);
+	before = con->congested;
+	rc = vtm_ws_con_queue(con, fb);
+	after = con->congested;
+	vtm_socket_con_write_unlock(&con->sock_con);
+
+	vtm_ws_con_notify(con, before, after);
 
-	rc = vtm_buf_putm(&con->sock_con.sendbuf, data, len);
+	return rc;
+}
+
+static int vtm_ws_con_queue(vtm_ws_con *con, struct vtm_ws_frame_buf *fb)
+{
+	int rc;
+	size_t high;
+
+	if (con->closed)
+		return vtm_err_set(VTM_E_IO_CLOSED);
+
+	/* control frames are small and always queued */
+	high = con->opts ? con->opts->high_watermark : 0;
+	if (high > 0 && con->queue_bytes + fb->len > high && vtm_ws_con_is_data_frame(fb)) {
+		con->congested = true;
+		rc = vtm_ws_con_shed(con, fb->len);
+		if (rc != VTM_OK)
+			return rc;
+	}
+
+	rc = vtm_ws_con_push(con, fb);
 	if (rc != VTM_OK)
-		goto end;
+		return rc;
 
-	rc = vtm_socket_con_write_start(&con->sock_con);
+	/* a pending write continues when the socket becomes writable */
+	if (con->sock_con.writing)
+		return VTM_OK;
+
+	con->sock_con.writing = true;
+	rc = vtm_ws_con_flush(con);
 	if (rc == VTM_E_IO_AGAIN)
 		rc = VTM_OK;
 
-end:
-	vtm_socket_con_write_unlock(&con->sock_con);
-
 	return rc;
 }
 
+static int vtm_ws_con_push(vtm_ws_con *con, struct vtm_ws_frame_buf *fb)
+{
+	size_t i, cap;
+	struct vtm_ws_frame_buf **queue;
+
+	if (con->queue_len == con->queue_cap) {
+		cap = con->queue_cap > 0 ? con->queue_cap * 2 : VTM_WS_CON_QUEUE_INIT;
+		queue = malloc(cap * sizeof(*queue));
+		if (!queue) {
+			vtm_err_oom();
+			return vtm_err_get_code();
+		}
+
+		/* oldest frame moves to the front */
+		for (i=0; i < con->queue_len; i++)
+			queue[i] = con->queue[(con->queue_head + i) % con->queue_cap];
+
+		free(con->queue);
+		con->queue = queue;
+		con->queue_cap = cap;
+		con->queue_head = 0;
+	}
+
+	vtm_ws_frame_buf_ref(fb);
+	con->queue[(con->queue_head + con->queue_len) % con->queue_cap] = fb;
+	con->queue_len++;
+	con->queue_bytes += fb->len;
+
+	return VTM_OK;
+}
+
+static int vtm_ws_con_flush(vtm_ws_con *con)
+{
+	int rc;
+	size_t i, count, written;
+	struct vtm_ws_frame_buf *fb;
+	struct vtm_socket_iovec vec[VTM_WS_CON_IOVEC_MAX];
+
+	while (con->queue_len > 0) {
+		count = con->queue_len < VTM_WS_CON_IOVEC_MAX ? con->queue_len : VTM_WS_CON_IOVEC_MAX;
+		for (i=0; i < count; i++) {
+			fb = con->queue[(con->queue_head + i) % con->queue_cap];
+			vec[i].data = fb->data;
+			vec[i].len = fb->len;
+		}
+		vec[0].data = (const unsigned char*) vec[0].data + con->offset;
+		vec[0].len -= con->offset;
+
+		rc = vtm_socket_writev(con->sock_con.sock, vec, count, &written);
+
+		/* release frames that were sent completely */
+		written += con->offset;
+		while (con->queue_len > 0) {
+			fb = con->queue[con->queue_head];
+			if (written < fb->len)
+				break;
+
+			written -= fb->len;
+			con->queue_bytes -= fb->len;
+			vtm_ws_frame_buf_release(fb);
+			con->queue_head = (con->queue_head + 1) % con->queue_cap;
+			con->queue_len--;
+		}
+		con->offset = written;
+
+		/* recovers at the low watermark */
+		if (con->congested && con->queue_bytes - con->offset <= vtm_ws_con_get_low_watermark(con))
+			con->congested = false;
+
+		if (rc != VTM_OK) {
+			vtm_socket_update_srv(con->sock_con.sock);
+			return rc;
+		}
+	}
+
+	con->sock_con.writing = false;
+
+	return VTM_OK;
+}
+
+static int vtm_ws_con_shed(vtm_ws_con *con, size_t len)
+{
+	size_t i, kept, low, target;
+	struct vtm_ws_frame_buf *fb;
+
+	/* a context takeover peer cannot decompress after a gap */
+	if (con->opts->slow_policy == VTM_WS_SLOW_DISCONNECT ||
+		(con->deflate && vtm_ws_deflate_get_shared_bits(con->deflate) == 0)) {
+		vtm_ws_con_close_locked(con);
+		return vtm_err_set(VTM_E_WS_CONGESTED);
+	}
+
+	if (con->opts->slow_policy == VTM_WS_SLOW_DROP_NEWEST)
+		return vtm_err_set(VTM_E_WS_CONGESTED);
+
+	/*
+	 * Drop the oldest messages to halfway between the watermarks, so
+	 * that the queue is not compacted again for each following message
+	 * and stays congested until the peer reads. A partially sent frame
+	 * must be completed.
+	 */
+	low = vtm_ws_con_get_low_watermark(con);
+	target = low + (con->opts->high_watermark - low) / 2;
+	kept = 0;
+	for (i=0; i < con->queue_len; i++) {
+		fb = con->queue[(con->queue_head + i) % con->queue_cap];
+		if (con->queue_bytes + len > target && !(i == 0 && con->offset > 0) &&
+			vtm_ws_con_is_data_frame(fb)) {
+			con->queue_bytes -= fb->len;
+			vtm_ws_frame_buf_release(fb);
+			continue;
+		}
+		con->queue[(con->queue_head + kept) % con->queue_cap] = fb;
+		kept++;
+	}
+	con->queue_len = kept;
+
+	return VTM_OK;
+}
+
+static size_t vtm_ws_con_get_low_watermark(vtm_ws_con *con)
+{
+	return con->opts->low_watermark > 0 ? con->opts->low_watermark : con->opts->high_watermark / 2;
+}
+
+static bool vtm_ws_con_is_data_frame(struct vtm_ws_frame_buf *fb)
+{
+	/* only complete messages, fragments cannot be dropped */
+	if (!(fb->data[0] & 0x80))
+		return false;
+
+	switch (fb->data[0] & 0x0f) {
+		case VTM_WS_OPCODE_TEXT:
+		case VTM_WS_OPCODE_BINARY:
+			return true;
+	}
+
+	return false;
+}
+
+static void vtm_ws_con_close_locked(vtm_ws_con *con)
+{
+	if (con->closed)
+		return;
+
+	con->closed = true;
+
+	/* nothing more is sent, the memory is released immediately */
+	while (con->queue_len > 0) {
+		vtm_ws_frame_buf_release(con->queue[con->queue_head]);
+		con->queue_head = (con->queue_head + 1) % con->queue_cap;
+		con->queue_len--;
+	}
+	con->queue_bytes = 0;
+	con->offset = 0;
+
+	vtm_socket_close(con->sock_con.sock);
+	vtm_socket_update_srv(con->sock_con.sock);
+}
+
+static void vtm_ws_con_notify(vtm_ws_con *con, bool before, bool after)
+{
+	if (before != after && con->congestion_cb)
+		con->congestion_cb(con->congestion_arg, con, after);
+}
+
 int vtm_ws_con_get_remote_info(vtm_ws_con *con, char *buf, size_t len, unsigned int *port)
 {
 	int rc;
@@ -21,6 +21,51 @@ extern "C" {
 
 typedef struct vtm_ws_con vtm_ws_con;
 
+/** What happens with messages to a connection above the high watermark */
+enum vtm_ws_slow_policy
+{
+	/** closes the connection */
+	VTM_WS_SLOW_DISCONNECT,
+
+	/** drops queued messages whose sending has not started yet */
+	VTM_WS_SLOW_DROP_OLDEST,
+
+	/** drops the message that should be sent */
+	VTM_WS_SLOW_DROP_NEWEST
+};
+
+/**
+ * Options of server-side connections, zero-initialized values disable
+ * the keepalive and the watermarks.
+ *
+ * Connections with permessage-deflate and context takeover are always
+ * disconnected when messages would be dropped, because the peer could
+ * not decompress the following messages.
+ */
+struct vtm_ws_con_opts
+{
+	/** milliseconds without received data until a ping is sent */
+	unsigned long ping_interval;
+
+	/**
+	 * Milliseconds the peer has to answer a ping with any data before
+	 * the connection is closed, zero selects the ping interval.
+	 */
+	unsigned long pong_timeout;
+
+	/** queued outbound bytes at which the connection is congested */
+	size_t high_watermark;
+
+	/**
+	 * Queued outbound bytes at which a congested connection recovers,
+	 * zero selects half of the high watermark.
+	 */
+	size_t low_watermark;
+
+	/** handling of messages while the high watermark is exceeded */
+	enum vtm_ws_slow_policy slow_policy;
+};
+
 /**
  * Sends a message to the peer.
  *
@@ -29,10 +74,33 @@ typedef struct vtm_ws_con vtm_ws_con;
  * @param data pointer to message payload
  * @param len length of payload in bytes
  * @return VTM_OK if the transmission was successfully started
+ * @return VTM_E_WS_CONGESTED if the message was dropped or the connection
+ *         was closed by the slow consumer policy
+ * @return VTM_E_IO_CLOSED if the connection was already closed
  * @return VTM_E_IO_UNKNOWN or VTM_ERROR if an error occcured
  */
 VTM_API int vtm_ws_con_send_msg(vtm_ws_con *con, enum vtm_ws_msg_type type, const void *data, size_t len);
 
+/**
+ * Checks whether the queued outbound data reached the high watermark
+ * and did not yet fall to the low watermark.
+ *
+ * A broadcaster can skip congested connections instead of building
+ * messages that would be dropped.
+ *
+ * @param con the connection
+ * @return true if the connection is congested
+ */
+VTM_API bool vtm_ws_con_is_congested(vtm_ws_con *con);
+
+/**
+ * Gets the number of queued outbound bytes.
+ *
+ * @param con the connection
+ * @return the bytes of the frames that are not yet completely sent
+ */
+VTM_API size_t vtm_ws_con_get_queued(vtm_ws_con *con);
+
 /**
  * Retrieves the source ip address and used port of a client connection.
  *
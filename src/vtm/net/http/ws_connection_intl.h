@@ -10,17 +10,50 @@
 #include <vtm/net/socket_emitter.h>
 #include <vtm/net/http/ws.h>
 #include <vtm/net/http/ws_connection.h>
+#include <vtm/net/http/ws_deflate_intl.h>
+#include <vtm/net/http/ws_frame_intl.h>
 #include <vtm/net/http/ws_message.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Notifies about reaching the high watermark and falling to the low one */
+typedef void (*vtm_ws_con_congestion_cb)(void *arg, vtm_ws_con *con, bool congested);
+
 vtm_ws_con* vtm_ws_con_new(enum vtm_ws_mode mode, vtm_socket *sock);
 void vtm_ws_con_free(vtm_ws_con *con);
 
+/* Sets keepalive and watermark options, they must outlive the connection */
+void vtm_ws_con_set_opts(vtm_ws_con *con, const struct vtm_ws_con_opts *opts);
+void vtm_ws_con_set_congestion_cb(vtm_ws_con *con, vtm_ws_con_congestion_cb cb, void *arg);
+
+/* Closes the socket from any thread, the server releases the connection */
+void vtm_ws_con_close(vtm_ws_con *con);
+
+/*
+ * Called periodically by the keepalive thread. Sends a ping after the
+ * ping interval without received data and closes the connection if
+ * the peer stays silent until the pong timeout.
+ */
+void vtm_ws_con_keepalive(vtm_ws_con *con, uint64_t now);
+
+/* Position in the keepalive registry */
+size_t vtm_ws_con_get_keepalive_slot(vtm_ws_con *con);
+void vtm_ws_con_set_keepalive_slot(vtm_ws_con *con, size_t slot);
+
 int vtm_ws_con_get_msg(vtm_ws_con *con, struct vtm_ws_msg *msg);
 
+/* Enables permessage-deflate with the parameters of the handshake */
+int vtm_ws_con_enable_deflate(vtm_ws_con *con, const struct vtm_ws_deflate_params *params,
+	const struct vtm_ws_deflate_opts *opts);
+
+/* Gets the permessage-deflate state, NULL if not negotiated */
+vtm_ws_deflate* vtm_ws_con_get_deflate(vtm_ws_con *con);
+
+/* Queues a frame for sending, the connection takes its own reference */
+int vtm_ws_con_send_frame(vtm_ws_con *con, struct vtm_ws_frame_buf *fb);
+
 #ifdef __cplusplus
 }
 #endif
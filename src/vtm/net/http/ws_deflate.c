@@ -0,0 +1,528 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include "ws_deflate_intl.h"
+
+#include <ctype.h> /* tolower() */
+#include <stdio.h> /* snprintf() */
+#include <stdlib.h> /* malloc(), free() */
+#include <string.h> /* memcmp() */
+#include <vtm/core/error.h>
+#include <vtm/util/atomic.h>
+#include <vtm/util/deflate.h>
+#include <vtm/util/inflate.h>
+
+#define VTM_WS_DEFLATE_BITS_MIN      9
+#define VTM_WS_DEFLATE_BITS_MAX     15
+
+#define VTM_WS_DEFLATE_IS_WS(c)      ((c) == ' ' || (c) == '\t')
+#define VTM_WS_DEFLATE_IS_SEP(c)     ((c) == '\0' || (c) == ',' || (c) == ';' || (c) == '=' || (c) == '"' || VTM_WS_DEFLATE_IS_WS(c))
+
+struct vtm_ws_deflate
+{
+	int            level;
+	size_t         min_size;
+
+	/* own compressor and decompressor for the peer */
+	unsigned int   out_bits;
+	unsigned int   in_bits;
+	bool           out_keep;
+	bool           in_keep;
+
+	/* only set with context takeover */
+	vtm_deflate    *df;
+	vtm_inflate    *inf;
+	int32_t        mem_kb;
+};
+
+/* one element of a Sec-WebSocket-Extensions header */
+struct vtm_ws_deflate_ext
+{
+	bool          empty;
+	bool          match;
+	bool          valid;
+	bool          server_no_context_takeover;
+	bool          client_no_context_takeover;
+	unsigned int  server_max_window_bits;  /* zero if absent */
+	unsigned int  client_max_window_bits;  /* zero if absent */
+	bool          client_max_window_bits_empty;
+};
+
+static const unsigned char vtm_ws_deflate_tail[] = {0x00, 0x00, 0xff, 0xff};
+
+/* state memory of all connections with context takeover */
+static VTM_ATOMIC_INT32_TYPE vtm_ws_deflate_mem_kb;
+
+/* forward declaration */
+static const char* vtm_ws_deflate_parse(const char *s, struct vtm_ws_deflate_ext *ext);
+static void vtm_ws_deflate_parse_param(struct vtm_ws_deflate_ext *ext, const char *name, size_t name_len, const char *val, size_t val_len);
+static unsigned int vtm_ws_deflate_parse_bits(const char *val, size_t len);
+static const char* vtm_ws_deflate_skip_ws(const char *s);
+static bool vtm_ws_deflate_token_eq(const char *s, size_t len, const char *lit);
+static void vtm_ws_deflate_put_bits(struct vtm_buf *buf, const char *name, unsigned int bits);
+static unsigned int vtm_ws_deflate_max_bits(const struct vtm_ws_deflate_opts *opts);
+static bool vtm_ws_deflate_over_budget(const struct vtm_ws_deflate_opts *opts);
+static int32_t vtm_ws_deflate_df_kb(unsigned int bits);
+static int32_t vtm_ws_deflate_inf_kb(unsigned int bits);
+static void vtm_ws_deflate_account(vtm_ws_deflate *wd, int32_t kb);
+
+int vtm_ws_deflate_accept(const struct vtm_ws_deflate_opts *opts, const char *offers,
+	struct vtm_ws_deflate_params *params, struct vtm_buf *response)
+{
+	const char *s;
+	unsigned int bits;
+	bool pressure;
+	struct vtm_ws_deflate_ext ext;
+
+	bits = vtm_ws_deflate_max_bits(opts);
+	pressure = vtm_ws_deflate_over_budget(opts);
+
+	s = offers;
+	while (*s != '\0') {
+		s = vtm_ws_deflate_parse(s, &ext);
+		if (!ext.match || !ext.valid)
+			continue;
+
+		/* zlib cannot compress with a 256 byte window */
+		if (ext.server_max_window_bits == 8)
+			continue;
+
+		params->server_no_context_takeover = ext.server_no_context_takeover ||
+			opts->no_context_takeover || pressure;
+		params->client_no_context_takeover = ext.client_no_context_takeover ||
+			opts->no_context_takeover || pressure;
+
+		params->server_max_window_bits = bits;
+		if (ext.server_max_window_bits > 0 && ext.server_max_window_bits < bits)
+			params->server_max_window_bits = ext.server_max_window_bits;
+
+		/* window of the client can only be limited when offered */
+		params->client_max_window_bits = VTM_WS_DEFLATE_BITS_MAX;
+		if (ext.client_max_window_bits > 0)
+			params->client_max_window_bits = ext.client_max_window_bits < bits ?
+				ext.client_max_window_bits : bits;
+
+		vtm_buf_puts(response, VTM_WS_DEFLATE_EXT);
+		if (params->server_no_context_takeover)
+			vtm_buf_puts(response, "; server_no_context_takeover");
+		if (params->client_no_context_takeover)
+			vtm_buf_puts(response, "; client_no_context_takeover");
+		if (ext.server_max_window_bits > 0 || params->server_max_window_bits < VTM_WS_DEFLATE_BITS_MAX)
+			vtm_ws_deflate_put_bits(response, "server_max_window_bits", params->server_max_window_bits);
+		if (ext.client_max_window_bits > 0)
+			vtm_ws_deflate_put_bits(response, "client_max_window_bits", params->client_max_window_bits);
+
+		return response->err;
+	}
+
+	return VTM_E_NOT_FOUND;
+}
+
+int vtm_ws_deflate_offer(const struct vtm_ws_deflate_opts *opts, struct vtm_buf *offer)
+{
+	unsigned int bits;
+
+	bits = vtm_ws_deflate_max_bits(opts);
+
+	vtm_buf_puts(offer, VTM_WS_DEFLATE_EXT);
+	if (opts->no_context_takeover || vtm_ws_deflate_over_budget(opts))
+		vtm_buf_puts(offer, "; server_no_context_takeover; client_no_context_takeover");
+
+	if (bits < VTM_WS_DEFLATE_BITS_MAX) {
+		vtm_ws_deflate_put_bits(offer, "server_max_window_bits", bits);
+		vtm_ws_deflate_put_bits(offer, "client_max_window_bits", bits);
+	}
+	else {
+		vtm_buf_puts(offer, "; client_max_window_bits");
+	}
+
+	return offer->err;
+}
+
+int vtm_ws_deflate_confirm(const struct vtm_ws_deflate_opts *opts, const char *response,
+	struct vtm_ws_deflate_params *params)
+{
+	const char *s;
+	unsigned int bits;
+	bool found;
+	struct vtm_ws_deflate_ext ext;
+
+	bits = vtm_ws_deflate_max_bits(opts);
+	found = false;
+
+	s = response;
+	while (*s != '\0') {
+		s = vtm_ws_deflate_parse(s, &ext);
+		if (ext.empty)
+			continue;
+
+		/* only one extension was offered */
+		if (!ext.match || !ext.valid || found || ext.client_max_window_bits_empty)
+			return vtm_err_set(VTM_E_IO_PROTOCOL);
+
+		/* windows must not be larger than offered */
+		if (ext.client_max_window_bits > bits ||
+			(bits < VTM_WS_DEFLATE_BITS_MAX && ext.server_max_window_bits > bits))
+			return vtm_err_set(VTM_E_IO_PROTOCOL);
+
+		if (ext.client_max_window_bits > 0 && ext.client_max_window_bits < VTM_WS_DEFLATE_BITS_MIN)
+			return vtm_err_set(VTM_E_NOT_SUPPORTED);
+
+		params->server_no_context_takeover = ext.server_no_context_takeover;
+		params->client_no_context_takeover = ext.client_no_context_takeover ||
+			opts->no_context_takeover || vtm_ws_deflate_over_budget(opts);
+		params->server_max_window_bits = ext.server_max_window_bits > 0 ?
+			ext.server_max_window_bits : VTM_WS_DEFLATE_BITS_MAX;
+		params->client_max_window_bits = ext.client_max_window_bits > 0 ?
+			ext.client_max_window_bits : bits;
+
+		found = true;
+	}
+
+	return found ? VTM_OK : VTM_E_NOT_FOUND;
+}
+
+vtm_ws_deflate* vtm_ws_deflate_new(enum vtm_ws_mode mode, const struct vtm_ws_deflate_params *params,
+	const struct vtm_ws_deflate_opts *opts)
+{
+	vtm_ws_deflate *wd;
+
+	wd = malloc(sizeof(*wd));
+	if (!wd) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	wd->level = opts->level > 0 ? opts->level : VTM_DEFLATE_LEVEL_DEFAULT;
+	wd->min_size = opts->min_size;
+
+	if (mode == VTM_WS_MODE_SERVER) {
+		wd->out_bits = params->server_max_window_bits;
+		wd->out_keep = !params->server_no_context_takeover;
+		wd->in_bits = params->client_max_window_bits;
+		wd->in_keep = !params->client_no_context_takeover;
+	}
+	else {
+		wd->out_bits = params->client_max_window_bits;
+		wd->out_keep = !params->client_no_context_takeover;
+		wd->in_bits = params->server_max_window_bits;
+		wd->in_keep = !params->server_no_context_takeover;
+	}
+
+	/* some compressors use 512 bytes when asked for 256 */
+	if (wd->in_bits < VTM_WS_DEFLATE_BITS_MIN)
+		wd->in_bits = VTM_WS_DEFLATE_BITS_MIN;
+
+	wd->df = NULL;
+	wd->inf = NULL;
+	wd->mem_kb = 0;
+
+	/* reserved up front, so that the budget sees idle connections */
+	if (wd->out_keep)
+		vtm_ws_deflate_account(wd, vtm_ws_deflate_df_kb(wd->out_bits));
+	if (wd->in_keep)
+		vtm_ws_deflate_account(wd, vtm_ws_deflate_inf_kb(wd->in_bits));
+
+	return wd;
+}
+
+void vtm_ws_deflate_free(vtm_ws_deflate *wd)
+{
+	if (!wd)
+		return;
+
+	vtm_deflate_free(wd->df);
+	vtm_inflate_free(wd->inf);
+	vtm_ws_deflate_account(wd, -wd->mem_kb);
+	free(wd);
+}
+
+int vtm_ws_deflate_compress(vtm_ws_deflate *wd, const void *src, size_t len, struct vtm_buf *out)
+{
+	int rc;
+	size_t begin;
+	vtm_deflate *df;
+
+	if (len < wd->min_size)
+		return VTM_E_NOT_HANDLED;
+
+	/* state without context takeover only lives during the message */
+	df = wd->df;
+	if (!df) {
+		df = vtm_deflate_new(wd->level, (int) wd->out_bits);
+		if (!df)
+			return vtm_err_get_code();
+
+		if (wd->out_keep)
+			wd->df = df;
+	}
+
+	begin = out->used;
+	rc = vtm_deflate_update(df, src, len, VTM_DEFLATE_FLUSH_SYNC, out);
+
+	/* empty stored block of the flush is implied by the receiver */
+	if (rc == VTM_OK && out->used - begin >= sizeof(vtm_ws_deflate_tail) &&
+		memcmp(out->data + out->used - sizeof(vtm_ws_deflate_tail),
+		vtm_ws_deflate_tail, sizeof(vtm_ws_deflate_tail)) == 0)
+		out->used -= sizeof(vtm_ws_deflate_tail);
+
+	/* a fresh compressor stays decodable after a failed message */
+	if (!wd->out_keep || rc != VTM_OK) {
+		wd->df = NULL;
+		vtm_deflate_free(df);
+	}
+
+	return rc;
+}
+
+struct vtm_ws_frame_buf* vtm_ws_deflate_frame_new(vtm_ws_deflate *wd, enum vtm_ws_msg_type type,
+	const void *data, size_t len)
+{
+	int rc;
+	struct vtm_buf buf;
+	struct vtm_ws_frame_buf *fb;
+
+	vtm_buf_init(&buf, VTM_BYTEORDER_LE);
+
+	rc = vtm_ws_deflate_compress(wd, data, len, &buf);
+	switch (rc) {
+		case VTM_OK:
+			fb = vtm_ws_frame_buf_new(type, true, buf.data, buf.used);
+			break;
+
+		case VTM_E_NOT_HANDLED:
+			fb = vtm_ws_frame_buf_new(type, false, data, len);
+			break;
+
+		default:
+			fb = NULL;
+			break;
+	}
+
+	vtm_buf_release(&buf);
+
+	return fb;
+}
+
+unsigned int vtm_ws_deflate_get_shared_bits(vtm_ws_deflate *wd)
+{
+	return wd->out_keep ? 0 : wd->out_bits;
+}
+
+int vtm_ws_deflate_decompress(vtm_ws_deflate *wd, const void *src, size_t len, size_t max, struct vtm_buf *out)
+{
+	int rc;
+	size_t begin;
+	vtm_inflate *inf;
+
+	inf = wd->inf;
+	if (!inf) {
+		inf = vtm_inflate_new((int) wd->in_bits);
+		if (!inf)
+			return vtm_err_get_code();
+
+		if (wd->in_keep)
+			wd->inf = inf;
+	}
+
+	begin = out->used;
+	rc = vtm_inflate_update(inf, src, len, max, out);
+	if (rc == VTM_OK)
+		rc = vtm_inflate_update(inf, vtm_ws_deflate_tail, sizeof(vtm_ws_deflate_tail),
+			max - (out->used - begin), out);
+
+	if (!wd->in_keep)
+		vtm_inflate_free(inf);
+
+	return rc;
+}
+
+size_t vtm_ws_deflate_get_mem_usage(void)
+{
+	return (size_t) VTM_ATOMIC_LOAD_INT32(&vtm_ws_deflate_mem_kb) * 1024;
+}
+
+static const char* vtm_ws_deflate_parse(const char *s, struct vtm_ws_deflate_ext *ext)
+{
+	const char *name, *val;
+	size_t name_len, val_len;
+
+	memset(ext, 0, sizeof(*ext));
+	ext->valid = true;
+
+	s = vtm_ws_deflate_skip_ws(s);
+	name = s;
+	while (!VTM_WS_DEFLATE_IS_SEP(*s))
+		s++;
+	name_len = (size_t) (s - name);
+
+	ext->empty = (name_len == 0);
+	ext->match = vtm_ws_deflate_token_eq(name, name_len, VTM_WS_DEFLATE_EXT);
+
+	s = vtm_ws_deflate_skip_ws(s);
+	while (*s == ';') {
+		s = vtm_ws_deflate_skip_ws(s + 1);
+		name = s;
+		while (!VTM_WS_DEFLATE_IS_SEP(*s))
+			s++;
+		name_len = (size_t) (s - name);
+
+		val = NULL;
+		val_len = 0;
+
+		s = vtm_ws_deflate_skip_ws(s);
+		if (*s == '=') {
+			s = vtm_ws_deflate_skip_ws(s + 1);
+			if (*s == '"') {
+				val = ++s;
+				while (*s != '\0' && *s != '"')
+					s++;
+				val_len = (size_t) (s - val);
+				if (*s == '"')
+					s++;
+				else
+					ext->valid = false;
+			}
+			else {
+				val = s;
+				while (!VTM_WS_DEFLATE_IS_SEP(*s))
+					s++;
+				val_len = (size_t) (s - val);
+			}
+			s = vtm_ws_deflate_skip_ws(s);
+		}
+
+		vtm_ws_deflate_parse_param(ext, name, name_len, val, val_len);
+	}
+
+	/* garbage up to the next element */
+	if (*s != '\0' && *s != ',') {
+		ext->empty = false;
+		ext->valid = false;
+		while (*s != '\0' && *s != ',')
+			s++;
+	}
+
+	if (*s == ',')
+		s++;
+
+	return s;
+}
+
+static void vtm_ws_deflate_parse_param(struct vtm_ws_deflate_ext *ext, const char *name, size_t name_len, const char *val, size_t val_len)
+{
+	unsigned int bits;
+
+	if (vtm_ws_deflate_token_eq(name, name_len, "server_no_context_takeover")) {
+		if (val || ext->server_no_context_takeover)
+			ext->valid = false;
+		ext->server_no_context_takeover = true;
+	}
+	else if (vtm_ws_deflate_token_eq(name, name_len, "client_no_context_takeover")) {
+		if (val || ext->client_no_context_takeover)
+			ext->valid = false;
+		ext->client_no_context_takeover = true;
+	}
+	else if (vtm_ws_deflate_token_eq(name, name_len, "server_max_window_bits")) {
+		bits = val ? vtm_ws_deflate_parse_bits(val, val_len) : 0;
+		if (bits == 0 || ext->server_max_window_bits > 0)
+			ext->valid = false;
+		ext->server_max_window_bits = bits;
+	}
+	else if (vtm_ws_deflate_token_eq(name, name_len, "client_max_window_bits")) {
+		bits = val ? vtm_ws_deflate_parse_bits(val, val_len) : VTM_WS_DEFLATE_BITS_MAX;
+		if (bits == 0 || ext->client_max_window_bits > 0)
+			ext->valid = false;
+		ext->client_max_window_bits = bits;
+		ext->client_max_window_bits_empty = !val;
+	}
+	else {
+		ext->valid = false;
+	}
+}
+
+static unsigned int vtm_ws_deflate_parse_bits(const char *val, size_t len)
+{
+	unsigned int bits;
+
+	/* decimal without leading zero */
+	if (len == 1 && val[0] >= '8' && val[0] <= '9')
+		bits = (unsigned int) (val[0] - '0');
+	else if (len == 2 && val[0] == '1' && val[1] >= '0' && val[1] <= '5')
+		bits = 10 + (unsigned int) (val[1] - '0');
+	else
+		bits = 0;
+
+	return bits;
+}
+
+static const char* vtm_ws_deflate_skip_ws(const char *s)
+{
+	while (VTM_WS_DEFLATE_IS_WS(*s))
+		s++;
+
+	return s;
+}
+
+static bool vtm_ws_deflate_token_eq(const char *s, size_t len, const char *lit)
+{
+	size_t i;
+
+	for (i=0; i < len; i++) {
+		if (lit[i] == '\0' || tolower((unsigned char) s[i]) != lit[i])
+			return false;
+	}
+
+	return lit[len] == '\0';
+}
+
+static void vtm_ws_deflate_put_bits(struct vtm_buf *buf, const char *name, unsigned int bits)
+{
+	char param[40];
+
+	snprintf(param, sizeof(param), "; %s=%u", name, bits);
+	vtm_buf_puts(buf, param);
+}
+
+static unsigned int vtm_ws_deflate_max_bits(const struct vtm_ws_deflate_opts *opts)
+{
+	if (opts->max_window_bits < VTM_WS_DEFLATE_BITS_MIN)
+		return opts->max_window_bits == 0 ? VTM_WS_DEFLATE_BITS_MAX : VTM_WS_DEFLATE_BITS_MIN;
+
+	if (opts->max_window_bits > VTM_WS_DEFLATE_BITS_MAX)
+		return VTM_WS_DEFLATE_BITS_MAX;
+
+	return opts->max_window_bits;
+}
+
+static bool vtm_ws_deflate_over_budget(const struct vtm_ws_deflate_opts *opts)
+{
+	size_t need;
+
+	if (opts->mem_budget == 0)
+		return false;
+
+	need = (size_t) (vtm_ws_deflate_df_kb(vtm_ws_deflate_max_bits(opts)) +
+		vtm_ws_deflate_inf_kb(VTM_WS_DEFLATE_BITS_MAX)) * 1024;
+
+	return vtm_ws_deflate_get_mem_usage() + need > opts->mem_budget;
+}
+
+static int32_t vtm_ws_deflate_df_kb(unsigned int bits)
+{
+	/* window, hash tables of the default memory level and state */
+	return (int32_t) ((1UL << (bits + 2)) / 1024) + 128 + 6;
+}
+
+static int32_t vtm_ws_deflate_inf_kb(unsigned int bits)
+{
+	/* window and state */
+	return (int32_t) ((1UL << bits) / 1024) + 7;
+}
+
+static void vtm_ws_deflate_account(vtm_ws_deflate *wd, int32_t kb)
+{
+	wd->mem_kb += kb;
+	VTM_ATOMIC_ADD_INT32(&vtm_ws_deflate_mem_kb, kb);
+}
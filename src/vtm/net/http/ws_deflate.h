@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+/**
+ * @file ws_deflate.h
+ *
+ * @brief WebSocket permessage-deflate extension (RFC 7692)
+ *
+ * With context takeover each side keeps its compressor and
+ * decompressor between messages, so repeated keys and values of
+ * similar messages are encoded as references into the previous ones.
+ * This gives the best ratio, but a compressor with a 32 KiB window
+ * holds about 260 KiB per connection. Without context takeover the
+ * state is only allocated while a message is processed, each message
+ * is compressed on its own.
+ */
+
+#ifndef VTM_NET_HTTP_WS_DEFLATE_H_
+#define VTM_NET_HTTP_WS_DEFLATE_H_
+
+#include <vtm/core/api.h>
+#include <vtm/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Options of the permessage-deflate extension, disabled when zero-initialized */
+struct vtm_ws_deflate_opts
+{
+	/** offers or accepts the extension */
+	bool enabled;
+
+	/** compression level from 1 to 9, zero selects the default level */
+	int level;
+
+	/**
+	 * Base two logarithm of the largest window from 9 to 15 used
+	 * for the compressor of this side. The window of the peer is
+	 * limited as well if it offers client_max_window_bits or
+	 * accepts server_max_window_bits. Zero selects 15.
+	 */
+	unsigned int max_window_bits;
+
+	/** negotiates no context takeover for both directions */
+	bool no_context_takeover;
+
+	/** smaller messages are sent uncompressed */
+	size_t min_size;
+
+	/**
+	 * Memory in bytes that compressors and decompressors with
+	 * context takeover of all connections of the process may hold,
+	 * zero means unlimited. Once the budget is used up, further
+	 * connections negotiate no context takeover.
+	 */
+	size_t mem_budget;
+};
+
+/**
+ * Gets the memory reserved for the compressors and decompressors of all
+ * connections with context takeover. The memory is reserved when the
+ * extension is set up, not when the first message is sent.
+ *
+ * @return the estimated memory usage in bytes
+ */
+VTM_API size_t vtm_ws_deflate_get_mem_usage(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_NET_HTTP_WS_DEFLATE_H_ */
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#ifndef VTM_NET_HTTP_WS_DEFLATE_INTL_H_
+#define VTM_NET_HTTP_WS_DEFLATE_INTL_H_
+
+#include <vtm/core/buffer.h>
+#include <vtm/core/types.h>
+#include <vtm/net/http/ws.h>
+#include <vtm/net/http/ws_deflate.h>
+#include <vtm/net/http/ws_frame_intl.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VTM_WS_DEFLATE_EXT   "permessage-deflate"
+
+/* Negotiated parameters, window bits are always set */
+struct vtm_ws_deflate_params
+{
+	bool          server_no_context_takeover;
+	bool          client_no_context_takeover;
+	unsigned int  server_max_window_bits;
+	unsigned int  client_max_window_bits;
+};
+
+typedef struct vtm_ws_deflate vtm_ws_deflate;
+
+/*
+ * Server side: selects the first acceptable offer of a
+ * Sec-WebSocket-Extensions request header and writes the response
+ * value. Returns VTM_E_NOT_FOUND if no offer is acceptable.
+ */
+int vtm_ws_deflate_accept(const struct vtm_ws_deflate_opts *opts, const char *offers,
+	struct vtm_ws_deflate_params *params, struct vtm_buf *response);
+
+/* Client side: writes the offer for the request header */
+int vtm_ws_deflate_offer(const struct vtm_ws_deflate_opts *opts, struct vtm_buf *offer);
+
+/*
+ * Client side: checks the response header value against the offer.
+ * Returns VTM_E_IO_PROTOCOL if the response is invalid and
+ * VTM_E_NOT_SUPPORTED if the requested client window is below 9 bits.
+ */
+int vtm_ws_deflate_confirm(const struct vtm_ws_deflate_opts *opts, const char *response,
+	struct vtm_ws_deflate_params *params);
+
+vtm_ws_deflate* vtm_ws_deflate_new(enum vtm_ws_mode mode, const struct vtm_ws_deflate_params *params,
+	const struct vtm_ws_deflate_opts *opts);
+void vtm_ws_deflate_free(vtm_ws_deflate *wd);
+
+/*
+ * Compresses a message payload without the trailing 00 00 ff ff.
+ * Returns VTM_E_NOT_HANDLED if the message should be sent uncompressed.
+ * With context takeover calls must be serialized in sending order.
+ */
+int vtm_ws_deflate_compress(vtm_ws_deflate *wd, const void *src, size_t len, struct vtm_buf *out);
+
+/* Creates an unmasked frame of a data message, compressed if eligible */
+struct vtm_ws_frame_buf* vtm_ws_deflate_frame_new(vtm_ws_deflate *wd, enum vtm_ws_msg_type type,
+	const void *data, size_t len);
+
+/*
+ * Gets the window bits of the own compressor if it keeps no context,
+ * so that a compressed frame can be shared with other connections of
+ * the same window size. Returns zero with context takeover.
+ */
+unsigned int vtm_ws_deflate_get_shared_bits(vtm_ws_deflate *wd);
+
+/*
+ * Decompresses a complete message payload and appends it to out.
+ * Returns VTM_E_MAX_REACHED if the message exceeds max bytes and
+ * VTM_E_IO_PROTOCOL if the payload is invalid.
+ */
+int vtm_ws_deflate_decompress(vtm_ws_deflate *wd, const void *src, size_t len, size_t max, struct vtm_buf *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_NET_HTTP_WS_DEFLATE_INTL_H_ */
@@ -13,5 +13,8 @@
 #define VTM_E_WS_INVALID_PAYLOAD_LEN    -2505
 #define VTM_E_WS_BAD_CONTINUE_FRAME     -2506
 #define VTM_E_WS_MSG_NOT_CONTINUED      -2507
+#define VTM_E_WS_INFLATE_FAILED         -2508
+#define VTM_E_WS_CONGESTED              -2509
+#define VTM_E_WS_INVALID_UTF8           -2510
 
 #endif /* VTM_NET_HTTP_WS_ERROR_H_ */
@@ -4,20 +4,45 @@
 
 #include "ws_frame_intl.h"
 
+#include <stdlib.h> /* malloc(), free() */
+#include <string.h> /* memcpy(), memset() */
 #include <vtm/core/error.h>
 #include <vtm/net/http/ws_error.h>
+#include <vtm/util/atomic.h>
+
+/* vector width is chosen at compile time, e.g. -mavx2 enables AVX2 */
+#if defined(__AVX2__)
+	#define VTM_WS_MASK_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define VTM_WS_MASK_SSE2
+	#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#define VTM_WS_MASK_NEON
+	#include <arm_neon.h>
+#endif
+
+#define VTM_WS_MASK_ALIGN    16
+#define VTM_WS_MASK_MIN_VEC  64
 
 int vtm_ws_frame_write_header(struct vtm_buf *buf, struct vtm_ws_frame_desc *desc)
 {
-	unsigned char header[14];
+	unsigned char header[VTM_WS_FRAME_HEADER_MAX];
+
+	if (desc->len > VTM_WS_LEN64_MAX)
+		return vtm_err_set(VTM_E_WS_INVALID_PAYLOAD_LEN);
+
+	return vtm_buf_putm(buf, header, vtm_ws_frame_encode_header(header, desc));
+}
+
+unsigned int vtm_ws_frame_encode_header(unsigned char *header, struct vtm_ws_frame_desc *desc)
+{
 	unsigned int header_len;
 	uint8_t len7;
 	uint16_t len16;
 	uint64_t len64;
 
-	if (desc->len > VTM_WS_LEN64_MAX)
-		return vtm_err_set(VTM_E_WS_INVALID_PAYLOAD_LEN);
-
 	header_len = 0;
 
 	/* fin and opcode */
@@ -70,20 +95,136 @@ int vtm_ws_frame_write_header(struct vtm_buf *buf, struct vtm_ws_frame_desc *des
 		header[header_len++] = desc->mask & 0xff;
 	}
 
-	return vtm_buf_putm(buf, header, header_len);
+	return header_len;
+}
+
+struct vtm_ws_frame_buf* vtm_ws_frame_buf_new(enum vtm_ws_msg_type type, bool compressed, const void *data, size_t len)
+{
+	struct vtm_ws_frame_buf *fb;
+	struct vtm_ws_frame_desc desc;
+	unsigned int header_len;
+
+	if (len > VTM_WS_LEN64_MAX) {
+		vtm_err_set(VTM_E_WS_INVALID_PAYLOAD_LEN);
+		return NULL;
+	}
+
+	fb = malloc(sizeof(*fb) + VTM_WS_FRAME_HEADER_MAX + len);
+	if (!fb) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	memset(&desc, 0, sizeof(desc));
+	desc.fin = true;
+	desc.rsv1 = compressed;
+	desc.opcode = type;
+	desc.len = len;
+
+	header_len = vtm_ws_frame_encode_header(fb->data, &desc);
+	memcpy(fb->data + header_len, data, len);
+
+	fb->refs = 1;
+	fb->len = header_len + len;
+
+	return fb;
+}
+
+void vtm_ws_frame_buf_ref(struct vtm_ws_frame_buf *fb)
+{
+	VTM_ATOMIC_ADD_INT32(&fb->refs, 1);
+}
+
+void vtm_ws_frame_buf_release(struct vtm_ws_frame_buf *fb)
+{
+	if (!fb)
+		return;
+
+	if (VTM_ATOMIC_ADD_INT32(&fb->refs, -1) == 0)
+		free(fb);
 }
 
-void vtm_ws_frame_mask_payload(void *dst, size_t len, uint32_t mask)
+uint32_t vtm_ws_frame_mask_payload(void *dst, size_t len, uint32_t mask)
 {
 	size_t i;
-	unsigned char *dst_uc;
-	unsigned char mask_uc[4];
+	unsigned char *p, *end;
+	unsigned char mask_uc[32];
+	unsigned char mask_rot[4];
+	unsigned int phase;
+	uint64_t mask64, word;
+#if defined(VTM_WS_MASK_AVX2)
+	__m256i mask256;
+#endif
+#if defined(VTM_WS_MASK_SSE2)
+	__m128i mask128;
+#elif defined(VTM_WS_MASK_NEON)
+	uint8x16_t mask128;
+#endif
+
+	p = dst;
+	end = p + len;
 
-	dst_uc = dst;
 	for (i=0; i < 4; i++)
 		mask_uc[i] = (mask >> (24-8*i)) & 0xff;
 
-	for (i=0; i < len; i++) {
-		dst_uc[i] = dst_uc[i] ^ mask_uc[i % 4];
+	/* short payloads like control frames do not pay for the setup */
+	if (len < VTM_WS_MASK_MIN_VEC) {
+		for (i=0; i < len; i++)
+			p[i] ^= mask_uc[i & 3];
+		goto finish;
+	}
+
+	/* unaligned head, byte by byte */
+	phase = 0;
+	while (((uintptr_t) p & (VTM_WS_MASK_ALIGN-1)) != 0) {
+		*p++ ^= mask_uc[phase];
+		phase = (phase + 1) & 3;
 	}
+
+	/* blocks are multiples of 4 bytes, so the phase stays the same */
+	for (i=0; i < 4; i++)
+		mask_rot[i] = mask_uc[(i + phase) & 3];
+	for (i=0; i < sizeof(mask_uc); i++)
+		mask_uc[i] = mask_rot[i & 3];
+
+#if defined(VTM_WS_MASK_AVX2)
+	mask256 = _mm256_loadu_si256((const __m256i*) mask_uc);
+	while (end - p >= 32) {
+		_mm256_storeu_si256((__m256i*) p,
+			_mm256_xor_si256(_mm256_loadu_si256((const __m256i*) p), mask256));
+		p += 32;
+	}
+#endif
+
+#if defined(VTM_WS_MASK_SSE2)
+	mask128 = _mm_loadu_si128((const __m128i*) mask_uc);
+	while (end - p >= 16) {
+		_mm_store_si128((__m128i*) p, _mm_xor_si128(_mm_load_si128((const __m128i*) p), mask128));
+		p += 16;
+	}
+#elif defined(VTM_WS_MASK_NEON)
+	mask128 = vld1q_u8(mask_uc);
+	while (end - p >= 16) {
+		vst1q_u8(p, veorq_u8(vld1q_u8(p), mask128));
+		p += 16;
+	}
+#endif
+
+	/* remaining words, memcpy avoids aliasing and compiles to plain moves */
+	memcpy(&mask64, mask_uc, sizeof(mask64));
+	while (end - p >= 8) {
+		memcpy(&word, p, sizeof(word));
+		word ^= mask64;
+		memcpy(p, &word, sizeof(word));
+		p += 8;
+	}
+
+	/* tail */
+	for (i=0; p < end; i++)
+		*p++ ^= mask_uc[i];
+
+finish:
+	/* mask for the bytes following this fragment */
+	phase = len & 3;
+	return phase == 0 ? mask : (mask << 8*phase) | (mask >> (32-8*phase));
 }
@@ -8,11 +8,14 @@
 #include <vtm/core/types.h> /* size_t */
 #include <vtm/core/buffer.h>
 #include <vtm/net/http/ws.h>
+#include <vtm/util/atomic.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define VTM_WS_FRAME_HEADER_MAX  14
+
 struct vtm_ws_frame_desc
 {
 	unsigned int fin    : 1;
@@ -26,8 +29,37 @@ struct vtm_ws_frame_desc
 	size_t len;
 };
 
+/* Complete immutable frame that can be queued on many connections */
+struct vtm_ws_frame_buf
+{
+	VTM_ATOMIC_INT32_TYPE  refs;
+	size_t                 len;
+	unsigned char          data[];
+};
+
 int vtm_ws_frame_write_header(struct vtm_buf *buf, struct vtm_ws_frame_desc *desc);
-void vtm_ws_frame_mask_payload(void *dst, size_t len, uint32_t mask);
+
+/*
+ * Writes the header to a buffer of VTM_WS_FRAME_HEADER_MAX bytes.
+ * The payload length must have been checked before.
+ */
+unsigned int vtm_ws_frame_encode_header(unsigned char *header, struct vtm_ws_frame_desc *desc);
+
+/*
+ * Masks or unmasks the payload in place.
+ *
+ * Returns the mask for the bytes that follow, so a payload can be
+ * processed in several fragments.
+ */
+uint32_t vtm_ws_frame_mask_payload(void *dst, size_t len, uint32_t mask);
+
+/*
+ * Creates an unmasked single frame message with one reference.
+ * Compressed messages have the rsv1 bit set.
+ */
+struct vtm_ws_frame_buf* vtm_ws_frame_buf_new(enum vtm_ws_msg_type type, bool compressed, const void *data, size_t len);
+void vtm_ws_frame_buf_ref(struct vtm_ws_frame_buf *fb);
+void vtm_ws_frame_buf_release(struct vtm_ws_frame_buf *fb);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include "ws_group.h"
+
+#include <stdlib.h> /* malloc(), realloc(), free() */
+#include <vtm/core/error.h>
+#include <vtm/net/http/ws_connection_intl.h>
+#include <vtm/net/http/ws_deflate_intl.h>
+#include <vtm/net/http/ws_frame_intl.h>
+#include <vtm/util/mutex.h>
+
+#define VTM_WS_GROUP_INIT    64
+#define VTM_WS_GROUP_FRAMES  16   /* plain frame and one per window bits */
+
+struct vtm_ws_group
+{
+	vtm_mutex   *mtx;
+	vtm_ws_con  **cons;
+	size_t      used;    /* slots including holes */
+	size_t      count;   /* members */
+	size_t      cap;
+	size_t      busy;    /* running broadcasts */
+};
+
+/* forward declaration */
+static void vtm_ws_group_compact(vtm_ws_group *grp);
+
+vtm_ws_group* vtm_ws_group_new(void)
+{
+	vtm_ws_group *grp;
+
+	grp = malloc(sizeof(*grp));
+	if (!grp) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	grp->mtx = vtm_mutex_new();
+	if (!grp->mtx) {
+		free(grp);
+		return NULL;
+	}
+
+	grp->cons = NULL;
+	grp->used = 0;
+	grp->count = 0;
+	grp->cap = 0;
+	grp->busy = 0;
+
+	return grp;
+}
+
+void vtm_ws_group_free(vtm_ws_group *grp)
+{
+	if (!grp)
+		return;
+
+	vtm_mutex_free(grp->mtx);
+	free(grp->cons);
+	free(grp);
+}
+
+int vtm_ws_group_join(vtm_ws_group *grp, vtm_ws_con *con)
+{
+	int rc;
+	size_t i, cap;
+	vtm_ws_con **cons;
+
+	rc = VTM_OK;
+
+	vtm_mutex_lock(grp->mtx);
+
+	for (i=0; i < grp->used; i++) {
+		if (grp->cons[i] == con) {
+			rc = VTM_E_INVALID_STATE;
+			goto unlock;
+		}
+	}
+
+	if (grp->used == grp->cap) {
+		cap = grp->cap > 0 ? grp->cap * 2 : VTM_WS_GROUP_INIT;
+		cons = realloc(grp->cons, cap * sizeof(*cons));
+		if (!cons) {
+			vtm_err_oom();
+			rc = vtm_err_get_code();
+			goto unlock;
+		}
+		grp->cons = cons;
+		grp->cap = cap;
+	}
+
+	grp->cons[grp->used++] = con;
+	grp->count++;
+
+unlock:
+	vtm_mutex_unlock(grp->mtx);
+
+	return rc;
+}
+
+void vtm_ws_group_leave(vtm_ws_group *grp, vtm_ws_con *con)
+{
+	size_t i;
+
+	vtm_mutex_lock(grp->mtx);
+	for (i=0; i < grp->used; i++) {
+		if (grp->cons[i] != con)
+			continue;
+
+		grp->count--;
+
+		/* running broadcast must not see members move */
+		if (grp->busy > 0) {
+			grp->cons[i] = NULL;
+			break;
+		}
+
+		/* order of members is not significant */
+		grp->cons[i] = grp->cons[--grp->used];
+		break;
+	}
+	vtm_mutex_unlock(grp->mtx);
+}
+
+size_t vtm_ws_group_count(vtm_ws_group *grp)
+{
+	size_t count;
+
+	vtm_mutex_lock(grp->mtx);
+	count = grp->count;
+	vtm_mutex_unlock(grp->mtx);
+
+	return count;
+}
+
+int vtm_ws_group_broadcast(vtm_ws_group *grp, enum vtm_ws_msg_type type, const void *data, size_t len)
+{
+	int rc;
+	size_t i, end;
+	unsigned int bits;
+	vtm_ws_con *con;
+	vtm_ws_deflate *wd;
+	struct vtm_ws_frame_buf *frames[VTM_WS_GROUP_FRAMES];
+
+	/* plain frame is always needed for members without extension */
+	frames[0] = vtm_ws_frame_buf_new(type, false, data, len);
+	if (!frames[0])
+		return vtm_err_get_code();
+
+	for (i=1; i < VTM_WS_GROUP_FRAMES; i++)
+		frames[i] = NULL;
+
+	rc = VTM_OK;
+
+	vtm_mutex_lock(grp->mtx);
+
+	/* callbacks of the members may leave or join the group meanwhile */
+	grp->busy++;
+	end = grp->used;
+
+	for (i=0; i < end; i++) {
+		con = grp->cons[i];
+		if (!con)
+			continue;
+
+		wd = vtm_ws_con_get_deflate(con);
+		bits = wd ? vtm_ws_deflate_get_shared_bits(wd) : 0;
+
+		if (wd && bits == 0) {
+			vtm_ws_con_send_msg(con, type, data, len);
+			continue;
+		}
+
+		/* compressed once per window size */
+		if (!frames[bits]) {
+			frames[bits] = vtm_ws_deflate_frame_new(wd, type, data, len);
+			if (!frames[bits]) {
+				rc = vtm_err_get_code();
+				break;
+			}
+		}
+
+		vtm_ws_con_send_frame(con, frames[bits]);
+	}
+
+	if (--grp->busy == 0 && grp->used > grp->count)
+		vtm_ws_group_compact(grp);
+
+	vtm_mutex_unlock(grp->mtx);
+
+	for (i=0; i < VTM_WS_GROUP_FRAMES; i++)
+		vtm_ws_frame_buf_release(frames[i]);
+
+	return rc;
+}
+
+static void vtm_ws_group_compact(vtm_ws_group *grp)
+{
+	size_t i, n;
+
+	for (i=0, n=0; i < grp->used; i++) {
+		if (grp->cons[i])
+			grp->cons[n++] = grp->cons[i];
+	}
+
+	grp->used = n;
+}
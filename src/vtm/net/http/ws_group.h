@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+/**
+ * @file ws_group.h
+ *
+ * @brief Broadcasting to WebSocket connections
+ *
+ * A broadcast builds the frame only once. Every member queues a
+ * reference of the same immutable frame and writes it with vectored
+ * I/O, the frame is freed when the last member has sent it.
+ *
+ * Members with permessage-deflate but without server context takeover
+ * share one compressed frame per window size. With context takeover
+ * the message is compressed for each member separately, because the
+ * frame depends on the previous messages of the connection.
+ *
+ * Connections must leave all their groups before they are released,
+ * the ws_close callback of the server is the place for it.
+ *
+ * Callbacks that run during a broadcast, like ws_congestion, may leave
+ * or join groups, including the broadcasting one. A connection that
+ * leaves gets no further part of the broadcast, the other members are
+ * not affected. A connection that joins gets the next broadcast.
+ */
+
+#ifndef VTM_NET_HTTP_WS_GROUP_H_
+#define VTM_NET_HTTP_WS_GROUP_H_
+
+#include <vtm/core/api.h>
+#include <vtm/core/types.h>
+#include <vtm/net/http/ws.h>
+#include <vtm/net/http/ws_connection.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct vtm_ws_group vtm_ws_group;
+
+/**
+ * Creates a new group.
+ *
+ * @return the created group
+ * @return NULL if an error occured
+ */
+VTM_API vtm_ws_group* vtm_ws_group_new(void);
+
+/**
+ * Releases the group.
+ *
+ * The member connections are not closed.
+ *
+ * @param grp the group
+ */
+VTM_API void vtm_ws_group_free(vtm_ws_group *grp);
+
+/**
+ * Adds a connection to the group.
+ *
+ * @param grp the group
+ * @param con the connection
+ * @return VTM_OK if the connection was added
+ * @return VTM_E_INVALID_STATE if the connection is already a member
+ * @return VTM_ERROR if an error occured
+ */
+VTM_API int vtm_ws_group_join(vtm_ws_group *grp, vtm_ws_con *con);
+
+/**
+ * Removes a connection from the group.
+ *
+ * Can be called from callbacks during a broadcast of the group.
+ *
+ * @param grp the group
+ * @param con the connection
+ */
+VTM_API void vtm_ws_group_leave(vtm_ws_group *grp, vtm_ws_con *con);
+
+/**
+ * Gets the number of members.
+ *
+ * @param grp the group
+ * @return the number of connections in the group
+ */
+VTM_API size_t vtm_ws_group_count(vtm_ws_group *grp);
+
+/**
+ * Sends a message to all members.
+ *
+ * Failed sends do not stop the broadcast, the affected connections are
+ * closed by the server.
+ *
+ * @param grp the group
+ * @param type the type of the WebSocket message
+ * @param data pointer to message payload
+ * @param len length of payload in bytes
+ * @return VTM_OK if the message was passed to all members
+ * @return VTM_ERROR if the frame could not be created
+ */
+VTM_API int vtm_ws_group_broadcast(vtm_ws_group *grp, enum vtm_ws_msg_type type, const void *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_NET_HTTP_WS_GROUP_H_ */
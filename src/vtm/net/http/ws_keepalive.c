@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include "ws_keepalive_intl.h"
+
+#include <stdlib.h> /* malloc(), realloc(), free() */
+#include <string.h> /* memset() */
+#include <vtm/core/error.h>
+#include <vtm/net/http/ws_connection_intl.h>
+#include <vtm/util/atomic.h>
+#include <vtm/util/mutex.h>
+#include <vtm/util/thread.h>
+#include <vtm/util/time.h>
+
+#define VTM_WS_KEEPALIVE_POLL_MAX      100
+#define VTM_WS_KEEPALIVE_POLL_MIN       10
+#define VTM_WS_KEEPALIVE_INITIAL_CAP    64
+
+struct vtm_ws_keepalive
+{
+	const struct vtm_ws_con_opts  *opts;
+	unsigned long                 poll;
+
+	vtm_mutex                     *mtx;
+	vtm_ws_con                    **cons;
+	size_t                        cons_len;
+	size_t                        cons_cap;
+
+	vtm_thread                    *th;
+	vtm_atomic_flag               running;
+};
+
+/* forward declaration */
+static int vtm_ws_keepalive_run(void *arg);
+
+vtm_ws_keepalive* vtm_ws_keepalive_new(const struct vtm_ws_con_opts *opts)
+{
+	vtm_ws_keepalive *ka;
+
+	if (opts->ping_interval == 0) {
+		vtm_err_set(VTM_E_INVALID_ARG);
+		return NULL;
+	}
+
+	ka = malloc(sizeof(*ka));
+	if (!ka) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	memset(ka, 0, sizeof(*ka));
+	ka->opts = opts;
+
+	/* a fraction of the interval keeps the pings punctual */
+	ka->poll = opts->ping_interval / 4;
+	if (ka->poll > VTM_WS_KEEPALIVE_POLL_MAX)
+		ka->poll = VTM_WS_KEEPALIVE_POLL_MAX;
+	else if (ka->poll < VTM_WS_KEEPALIVE_POLL_MIN)
+		ka->poll = VTM_WS_KEEPALIVE_POLL_MIN;
+
+	ka->mtx = vtm_mutex_new();
+	if (!ka->mtx)
+		goto err_mtx;
+
+	vtm_atomic_flag_init(ka->running, true);
+	ka->th = vtm_thread_new(vtm_ws_keepalive_run, ka);
+	if (!ka->th)
+		goto err_th;
+
+	return ka;
+
+err_th:
+	vtm_mutex_free(ka->mtx);
+
+err_mtx:
+	free(ka);
+
+	return NULL;
+}
+
+void vtm_ws_keepalive_free(vtm_ws_keepalive *ka)
+{
+	if (!ka)
+		return;
+
+	vtm_atomic_flag_unset(ka->running);
+	vtm_thread_join(ka->th);
+	vtm_thread_free(ka->th);
+
+	vtm_mutex_free(ka->mtx);
+	free(ka->cons);
+	free(ka);
+}
+
+int vtm_ws_keepalive_add(vtm_ws_keepalive *ka, vtm_ws_con *con)
+{
+	int rc;
+	size_t cap;
+	vtm_ws_con **cons;
+
+	rc = VTM_OK;
+	vtm_mutex_lock(ka->mtx);
+
+	if (ka->cons_len == ka->cons_cap) {
+		cap = ka->cons_cap > 0 ? ka->cons_cap * 2 : VTM_WS_KEEPALIVE_INITIAL_CAP;
+		cons = realloc(ka->cons, cap * sizeof(vtm_ws_con*));
+		if (!cons) {
+			vtm_err_oom();
+			rc = VTM_E_MALLOC;
+			goto end;
+		}
+		ka->cons = cons;
+		ka->cons_cap = cap;
+	}
+
+	vtm_ws_con_set_keepalive_slot(con, ka->cons_len);
+	ka->cons[ka->cons_len++] = con;
+
+end:
+	vtm_mutex_unlock(ka->mtx);
+
+	return rc;
+}
+
+void vtm_ws_keepalive_remove(vtm_ws_keepalive *ka, vtm_ws_con *con)
+{
+	size_t slot;
+
+	vtm_mutex_lock(ka->mtx);
+
+	slot = vtm_ws_con_get_keepalive_slot(con);
+	if (slot < ka->cons_len && ka->cons[slot] == con) {
+		ka->cons[slot] = ka->cons[--ka->cons_len];
+		vtm_ws_con_set_keepalive_slot(ka->cons[slot], slot);
+	}
+
+	vtm_mutex_unlock(ka->mtx);
+}
+
+static int vtm_ws_keepalive_run(void *arg)
+{
+	vtm_ws_keepalive *ka;
+	uint64_t now;
+	size_t i;
+
+	ka = arg;
+
+	while (vtm_atomic_flag_isset(ka->running)) {
+		vtm_thread_sleep(ka->poll);
+
+		now = vtm_time_current_millis();
+
+		/* workers only wait here when connections come and go */
+		vtm_mutex_lock(ka->mtx);
+		for (i=0; i < ka->cons_len; i++)
+			vtm_ws_con_keepalive(ka->cons[i], now);
+		vtm_mutex_unlock(ka->mtx);
+	}
+
+	return VTM_OK;
+}
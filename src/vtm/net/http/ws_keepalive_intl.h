@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#ifndef VTM_NET_HTTP_WS_KEEPALIVE_INTL_H_
+#define VTM_NET_HTTP_WS_KEEPALIVE_INTL_H_
+
+#include <vtm/core/types.h>
+#include <vtm/net/http/ws_connection.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct vtm_ws_keepalive vtm_ws_keepalive;
+
+/*
+ * Starts a thread that pings idle WebSocket connections and closes
+ * those that do not answer, the options must outlive the instance.
+ */
+vtm_ws_keepalive* vtm_ws_keepalive_new(const struct vtm_ws_con_opts *opts);
+void vtm_ws_keepalive_free(vtm_ws_keepalive *ka);
+
+int vtm_ws_keepalive_add(vtm_ws_keepalive *ka, vtm_ws_con *con);
+
+/* After return the connection is no longer used by the thread */
+void vtm_ws_keepalive_remove(vtm_ws_keepalive *ka, vtm_ws_con *con);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_NET_HTTP_WS_KEEPALIVE_INTL_H_ */
@@ -4,16 +4,197 @@
 
 #include "ws_message_intl.h"
 
-#include <stdlib.h> /* free() */
+#include <stdlib.h> /* malloc(), free() */
+#include <string.h> /* memset() */
+#include <vtm/core/error.h>
+#include <vtm/core/lang.h>
+#include <vtm/util/time.h>
 
-void vtm_ws_msg_init(struct vtm_ws_msg *msg, enum vtm_ws_msg_type type, void *data, size_t len)
+/* size classes from 1 KiB to 64 KiB, the largest message of the parser */
+#define VTM_WS_MSG_POOL_MIN_SHIFT       10
+#define VTM_WS_MSG_POOL_CLASSES          7
+
+/* bytes a size class may cache, at least one buffer */
+#define VTM_WS_MSG_POOL_CLASS_BYTES  65536U
+
+/* operations between checks of the clock */
+#define VTM_WS_MSG_POOL_TRIM_OPS        64
+#define VTM_WS_MSG_POOL_IDLE_MILLIS   1000
+
+struct vtm_ws_msg_pool_buf
+{
+	struct vtm_ws_msg_pool_buf  *next;
+	size_t                      size;
+};
+
+struct vtm_ws_msg_pool_class
+{
+	struct vtm_ws_msg_pool_buf  *free;
+	unsigned int                count;
+	unsigned int                idle;   /* fewest cached buffers since the last trim */
+};
+
+struct vtm_ws_msg_pool
+{
+	struct vtm_ws_msg_pool_class  classes[VTM_WS_MSG_POOL_CLASSES];
+	unsigned int                  ops;
+	uint64_t                      trimmed;
+};
+
+static VTM_THREAD_LOCAL struct vtm_ws_msg_pool vtm_ws_msg_tls_pool;
+
+/* forward declaration */
+static unsigned int vtm_ws_msg_pool_class_of(size_t size);
+static void vtm_ws_msg_pool_tick(struct vtm_ws_msg_pool *pool);
+
+void vtm_ws_msg_init(struct vtm_ws_msg *msg, enum vtm_ws_msg_type type, void *data, size_t len, bool pooled)
 {
 	msg->type = type;
 	msg->data = data;
 	msg->len = len;
+	msg->pooled = pooled;
 }
 
 void vtm_ws_msg_release(struct vtm_ws_msg *msg)
 {
-	free(msg->data);
+	if (msg->pooled)
+		vtm_ws_msg_buf_put(msg->data);
+}
+
+void* vtm_ws_msg_buf_get(size_t size, size_t *cap)
+{
+	unsigned int cls;
+	struct vtm_ws_msg_pool *pool;
+	struct vtm_ws_msg_pool_class *pc;
+	struct vtm_ws_msg_pool_buf *pb;
+
+	pool = &vtm_ws_msg_tls_pool;
+	cls = vtm_ws_msg_pool_class_of(size);
+	if (cls < VTM_WS_MSG_POOL_CLASSES) {
+		size = (size_t) 1 << (cls + VTM_WS_MSG_POOL_MIN_SHIFT);
+		pc = &pool->classes[cls];
+		if (pc->free) {
+			pb = pc->free;
+			pc->free = pb->next;
+			pc->count--;
+			if (pc->count < pc->idle)
+				pc->idle = pc->count;
+			goto finish;
+		}
+	}
+
+	pb = malloc(sizeof(*pb) + size);
+	if (!pb) {
+		vtm_err_oom();
+		return NULL;
+	}
+	pb->size = size;
+
+finish:
+	vtm_ws_msg_pool_tick(pool);
+	*cap = pb->size;
+
+	return pb + 1;
+}
+
+void vtm_ws_msg_buf_put(void *data)
+{
+	unsigned int cls;
+	struct vtm_ws_msg_pool *pool;
+	struct vtm_ws_msg_pool_class *pc;
+	struct vtm_ws_msg_pool_buf *pb;
+
+	if (!data)
+		return;
+
+	pool = &vtm_ws_msg_tls_pool;
+	pb = ((struct vtm_ws_msg_pool_buf*) data) - 1;
+	cls = vtm_ws_msg_pool_class_of(pb->size);
+
+	if (cls < VTM_WS_MSG_POOL_CLASSES &&
+		pool->classes[cls].count < VTM_WS_MSG_POOL_CLASS_BYTES >> (cls + VTM_WS_MSG_POOL_MIN_SHIFT)) {
+		pc = &pool->classes[cls];
+		pb->next = pc->free;
+		pc->free = pb;
+		pc->count++;
+	}
+	else {
+		free(pb);
+	}
+
+	vtm_ws_msg_pool_tick(pool);
+}
+
+void vtm_ws_msg_pool_trim(void)
+{
+	unsigned int i;
+	struct vtm_ws_msg_pool *pool;
+	struct vtm_ws_msg_pool_class *pc;
+	struct vtm_ws_msg_pool_buf *pb;
+
+	pool = &vtm_ws_msg_tls_pool;
+
+	/* buffers below the lowest count were not needed for a whole period */
+	for (i=0; i < VTM_WS_MSG_POOL_CLASSES; i++) {
+		pc = &pool->classes[i];
+		for (; pc->idle > 0; pc->idle--) {
+			pb = pc->free;
+			pc->free = pb->next;
+			pc->count--;
+			free(pb);
+		}
+		pc->idle = pc->count;
+	}
+
+	pool->trimmed = vtm_time_current_millis();
+}
+
+void vtm_ws_msg_pool_clear(void)
+{
+	unsigned int i;
+	struct vtm_ws_msg_pool *pool;
+	struct vtm_ws_msg_pool_buf *pb, *next;
+
+	pool = &vtm_ws_msg_tls_pool;
+	for (i=0; i < VTM_WS_MSG_POOL_CLASSES; i++) {
+		for (pb = pool->classes[i].free; pb; pb = next) {
+			next = pb->next;
+			free(pb);
+		}
+	}
+
+	memset(pool, 0, sizeof(*pool));
+}
+
+size_t vtm_ws_msg_pool_get_size(void)
+{
+	unsigned int i;
+	size_t size;
+
+	size = 0;
+	for (i=0; i < VTM_WS_MSG_POOL_CLASSES; i++)
+		size += vtm_ws_msg_tls_pool.classes[i].count * ((size_t) 1 << (i + VTM_WS_MSG_POOL_MIN_SHIFT));
+
+	return size;
+}
+
+static unsigned int vtm_ws_msg_pool_class_of(size_t size)
+{
+	unsigned int cls;
+
+	for (cls=0; cls < VTM_WS_MSG_POOL_CLASSES; cls++) {
+		if (size <= (size_t) 1 << (cls + VTM_WS_MSG_POOL_MIN_SHIFT))
+			break;
+	}
+
+	return cls;
+}
+
+static void vtm_ws_msg_pool_tick(struct vtm_ws_msg_pool *pool)
+{
+	if (++pool->ops % VTM_WS_MSG_POOL_TRIM_OPS != 0)
+		return;
+
+	if (vtm_time_current_millis() - pool->trimmed >= VTM_WS_MSG_POOL_IDLE_MILLIS)
+		vtm_ws_msg_pool_trim();
 }
@@ -6,6 +6,13 @@
  * @file ws_message.h
  *
  * @brief WebSocket message
+ *
+ * Message payloads are borrowed from a buffer pool of the receiving
+ * thread and returned with vtm_ws_msg_release(), so that repeated
+ * messages do not allocate. Buffers that stay unused for a while are
+ * freed again. Messages of a single frame that are received by the
+ * server are not copied, their payload points into the receive buffer
+ * of the connection and is only valid until the message is released.
  */
 
 #ifndef VTM_NET_HTTP_WS_MESSAGE_H_
@@ -26,6 +33,7 @@ struct vtm_ws_msg
 	enum vtm_ws_msg_type   type;  /**< type of the message */
 	void                  *data;  /**< pointer to payload of the message */
 	size_t                 len;   /**< payload length in bytes */
+	bool                   pooled; /**< internal, payload is a pooled buffer */
 };
 
 /**
@@ -35,6 +43,14 @@ struct vtm_ws_msg
  */
 VTM_API void vtm_ws_msg_release(struct vtm_ws_msg *msg);
 
+/**
+ * Frees the message buffers cached by the calling thread.
+ *
+ * The server does this when a worker ends. Other threads that receive
+ * messages with a WebSocket client should call it before they end.
+ */
+VTM_API void vtm_ws_msg_pool_clear(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -11,7 +11,21 @@
 extern "C" {
 #endif
 
-void vtm_ws_msg_init(struct vtm_ws_msg *msg, enum vtm_ws_msg_type type, void *data, size_t len);
+void vtm_ws_msg_init(struct vtm_ws_msg *msg, enum vtm_ws_msg_type type, void *data, size_t len, bool pooled);
+
+/*
+ * Borrows a buffer of at least size bytes from the pool of the calling
+ * thread, the usable size is stored in cap. Buffers are returned with
+ * vtm_ws_msg_buf_put(), possibly by another thread.
+ */
+void* vtm_ws_msg_buf_get(size_t size, size_t *cap);
+void vtm_ws_msg_buf_put(void *data);
+
+/* Frees the cached buffers that were not used since the last trim */
+void vtm_ws_msg_pool_trim(void);
+
+/* Gets the number of bytes cached by the pool of the calling thread */
+size_t vtm_ws_msg_pool_get_size(void);
 
 #ifdef __cplusplus
 }
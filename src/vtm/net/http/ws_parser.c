@@ -8,30 +8,31 @@
 #include <vtm/core/error.h>
 #include <vtm/core/types.h>
 #include <vtm/net/http/ws.h>
+#include <vtm/net/http/ws_deflate_intl.h>
 #include <vtm/net/http/ws_error.h>
 #include <vtm/net/http/ws_frame_intl.h>
 #include <vtm/net/http/ws_message_intl.h>
 
-#define VTM_WS_PARSER_MSG_BUF_INIT       1024
 #define VTM_WS_PARSER_MSG_BUF_MAX       65536
 
 /* forward declaration */
 static bool vtm_ws_parser_is_valid_opcode(unsigned int opcode);
 static bool vtm_ws_parser_is_control_opcode(unsigned int opcode);
 static enum vtm_ws_msg_type vtm_ws_parser_convert_opcode(unsigned int opcode);
+static int vtm_ws_parser_grow(struct vtm_ws_parser *par, size_t size);
+static int vtm_ws_parser_inflate(struct vtm_ws_parser *par);
 
 int vtm_ws_parser_init(struct vtm_ws_parser *par, enum vtm_ws_mode mode)
 {
-	par->msg_buf = malloc(VTM_WS_PARSER_MSG_BUF_INIT);
-	if (!par->msg_buf) {
-		vtm_err_oom();
-		return vtm_err_get_code();
-	}
-
 	par->mode = mode;
 	par->stage = VTM_WS_PARSE_MSG_BEGIN;
-	par->msg_buf_size = VTM_WS_PARSER_MSG_BUF_INIT;
+	par->msg_buf = NULL;
+	par->msg_buf_size = 0;
 	par->msg_buf_used = 0;
+	par->msg_compressed = false;
+	par->zero_copy = false;
+	par->msg_view = NULL;
+	par->deflate = NULL;
 	par->has_ctrl_msg = false;
 
 	return VTM_OK;
@@ -39,13 +40,27 @@ int vtm_ws_parser_init(struct vtm_ws_parser *par, enum vtm_ws_mode mode)
 
 void vtm_ws_parser_release(struct vtm_ws_parser *par)
 {
-	free(par->msg_buf);
+	vtm_ws_msg_buf_put(par->msg_buf);
+
+	if (par->has_ctrl_msg)
+		vtm_ws_msg_release(&par->ctrl_msg);
+}
+
+void vtm_ws_parser_set_deflate(struct vtm_ws_parser *par, struct vtm_ws_deflate *wd)
+{
+	par->deflate = wd;
+}
+
+void vtm_ws_parser_set_zero_copy(struct vtm_ws_parser *par, bool zero_copy)
+{
+	par->zero_copy = zero_copy;
 }
 
 void vtm_ws_parser_reset(struct vtm_ws_parser *par)
 {
 	par->stage = VTM_WS_PARSE_MSG_BEGIN;
 	par->msg_buf_used = 0;
+	par->msg_view = NULL;
 
 	if (par->has_ctrl_msg) {
 		par->has_ctrl_msg = false;
@@ -58,15 +73,20 @@ enum vtm_net_recv_stat vtm_ws_parser_run(struct vtm_ws_parser *par, struct vtm_b
 	int rc;
 	enum vtm_net_recv_stat stat;
 	unsigned char c, *payload;
-	size_t i;
+	size_t i, size;
 	uint64_t payload64;
 
 	while (true) {
 		switch (par->stage) {
 			case VTM_WS_PARSE_MSG_BEGIN:
+				/* previous msg may still reference the input */
+				vtm_buf_discard_processed(buf);
+				par->msg_view = NULL;
 				par->msg_buf_used = 0;
 				par->msg_frame_count = 0;
 				par->msg_type = VTM_WS_MSG_CLOSE;
+				par->msg_compressed = false;
+				vtm_utf8_init(&par->utf8);
 				par->stage = VTM_WS_PARSE_FRAME_BEGIN;
 				break;
 
@@ -78,7 +98,7 @@ enum vtm_net_recv_stat vtm_ws_parser_run(struct vtm_ws_parser *par, struct vtm_b
 
 			case VTM_WS_PARSE_FRAME_FIN_OPCODE:
 				if (!VTM_BUF_GET_AVAIL(buf,1)) {
-					stat = VTM_NET_RECV_STAT_INVALID;
+					stat = VTM_NET_RECV_STAT_AGAIN;
 					goto end;
 				}
 				c = VTM_BUF_GETC(buf);
@@ -88,8 +108,8 @@ enum vtm_net_recv_stat vtm_ws_parser_run(struct vtm_ws_parser *par, struct vtm_b
 				par->rsv3 = c >> 4 & 0x01;
 				par->opcode = c & 0x0f;
 
-				/* rsv1-3 must be zero */
-				if (par->rsv1 || par->rsv2 || par->rsv3) {
+				/* rsv1-3 must be zero, except rsv1 of compressed messages */
+				if (par->rsv2 || par->rsv3 || (par->rsv1 && !par->deflate)) {
 					vtm_err_set(VTM_E_WS_RSV_NONZERO);
 					goto invalid;
 				}
@@ -120,9 +140,17 @@ enum vtm_net_recv_stat vtm_ws_parser_run(struct vtm_ws_parser *par, struct vtm_b
 					goto invalid;
 				}
 
+				/* only the first frame of a data message marks compression */
+				if (par->rsv1 && (par->opcode == VTM_WS_OPCODE_CONTINUE || par->opcode >= VTM_WS_OPCODE_CLOSE)) {
+					vtm_err_set(VTM_E_WS_RSV_NONZERO);
+					goto invalid;
+				}
+
 				/* store msg type if beginning of non ctrl frame */
-				if (par->msg_frame_count == 0 && par->opcode < VTM_WS_OPCODE_CLOSE)
+				if (par->msg_frame_count == 0 && par->opcode < VTM_WS_OPCODE_CLOSE) {
 					par->msg_type = vtm_ws_parser_convert_opcode(par->opcode);
+					par->msg_compressed = par->rsv1;
+				}
 
 				par->stage = VTM_WS_PARSE_FRAME_MASK_LEN7;
 				break;
@@ -260,39 +288,58 @@ enum vtm_net_recv_stat vtm_ws_parser_run(struct vtm_ws_parser *par, struct vtm_b
 					goto invalid;
 				}
 
-				/* allocate buffer for ctrl payload */
-				payload = malloc(par->payload_len);
+				/* borrow buffer for ctrl payload */
+				payload = vtm_ws_msg_buf_get(par->payload_len, &size);
 				if (!payload) {
-					vtm_err_oom();
 					stat = VTM_NET_RECV_STAT_ERROR;
 					goto end;
 				}
 				memcpy(payload, buf->data + par->payload_begin, par->payload_len);
 
+				/* close reason follows the status code */
+				if (par->opcode == VTM_WS_OPCODE_CLOSE && par->payload_len > 2 &&
+					!vtm_utf8_is_valid(payload + 2, par->payload_len - 2)) {
+					vtm_ws_msg_buf_put(payload);
+					vtm_err_set(VTM_E_WS_INVALID_UTF8);
+					goto invalid;
+				}
+
 				/* create ctrl message */
 				vtm_ws_msg_init(&par->ctrl_msg,
 					vtm_ws_parser_convert_opcode(par->opcode),
-					payload, par->payload_len);
+					payload, par->payload_len, true);
 
 				par->has_ctrl_msg = true;
 				par->stage = VTM_WS_PARSE_FRAME_COMPLETE;
 				break;
 
 			case VTM_WS_PARSE_FRAME_FINISH_DATA:
-				if (par->msg_buf_size - par->msg_buf_used < par->payload_len) {
-					if (par->msg_buf_size < VTM_WS_PARSER_MSG_BUF_MAX) {
-						par->msg_buf_size *= 2;
-						par->msg_buf = realloc(par->msg_buf, par->msg_buf_size);
-						if (!par->msg_buf) {
-							vtm_err_oom();
-							stat = VTM_NET_RECV_STAT_ERROR;
-							goto end;
-						}
-					}
-					else {
-						stat = VTM_NET_RECV_STAT_ERROR;
-						goto end;
-					}
+				if (par->payload_len > VTM_WS_PARSER_MSG_BUF_MAX - par->msg_buf_used) {
+					stat = VTM_NET_RECV_STAT_ERROR;
+					goto end;
+				}
+
+				/* fails on the first fragment with invalid text */
+				if (par->msg_type == VTM_WS_MSG_TEXT && !par->msg_compressed &&
+					!vtm_utf8_validate(&par->utf8, buf->data + par->payload_begin,
+						par->payload_len, par->fin)) {
+					vtm_err_set(VTM_E_WS_INVALID_UTF8);
+					goto invalid;
+				}
+
+				/* single frame msg stays in the input until the next run */
+				if (par->zero_copy && par->fin && par->msg_frame_count == 0) {
+					par->msg_view = buf->data + par->payload_begin;
+					par->msg_buf_used = par->payload_len;
+					par->msg_frame_count++;
+					par->stage = VTM_WS_PARSE_MSG_COMPLETE;
+					break;
+				}
+
+				rc = vtm_ws_parser_grow(par, par->msg_buf_used + par->payload_len);
+				if (rc != VTM_OK) {
+					stat = VTM_NET_RECV_STAT_ERROR;
+					goto end;
 				}
 
 				memcpy(par->msg_buf + par->msg_buf_used,
@@ -317,6 +364,24 @@ enum vtm_net_recv_stat vtm_ws_parser_run(struct vtm_ws_parser *par, struct vtm_b
 				break;
 
 			case VTM_WS_PARSE_MSG_COMPLETE:
+				if (par->msg_compressed) {
+					rc = vtm_ws_parser_inflate(par);
+					if (rc == VTM_E_MAX_REACHED || rc == VTM_E_IO_PROTOCOL) {
+						vtm_err_set(VTM_E_WS_INFLATE_FAILED);
+						goto invalid;
+					}
+					else if (rc != VTM_OK) {
+						stat = VTM_NET_RECV_STAT_ERROR;
+						goto end;
+					}
+
+					if (par->msg_type == VTM_WS_MSG_TEXT &&
+						!vtm_utf8_is_valid(par->msg_buf, par->msg_buf_used)) {
+						vtm_err_set(VTM_E_WS_INVALID_UTF8);
+						goto invalid;
+					}
+				}
+
 				par->stage = VTM_WS_PARSE_MSG_BEGIN;
 				stat = VTM_NET_RECV_STAT_COMPLETE;
 				goto end;
@@ -385,6 +450,59 @@ static enum vtm_ws_msg_type vtm_ws_parser_convert_opcode(unsigned int opcode)
 	return VTM_WS_MSG_CLOSE;
 }
 
+static int vtm_ws_parser_grow(struct vtm_ws_parser *par, size_t size)
+{
+	unsigned char *msg_buf;
+	size_t cap;
+
+	if (par->msg_buf && par->msg_buf_size >= size)
+		return VTM_OK;
+
+	msg_buf = vtm_ws_msg_buf_get(size, &cap);
+	if (!msg_buf)
+		return vtm_err_get_code();
+
+	if (par->msg_buf) {
+		memcpy(msg_buf, par->msg_buf, par->msg_buf_used);
+		vtm_ws_msg_buf_put(par->msg_buf);
+	}
+
+	par->msg_buf = msg_buf;
+	par->msg_buf_size = cap;
+
+	return VTM_OK;
+}
+
+static int vtm_ws_parser_inflate(struct vtm_ws_parser *par)
+{
+	int rc;
+	struct vtm_buf out;
+
+	vtm_buf_init(&out, VTM_BYTEORDER_LE);
+
+	rc = vtm_ws_deflate_decompress(par->deflate,
+		par->msg_view ? par->msg_view : par->msg_buf, par->msg_buf_used,
+		VTM_WS_PARSER_MSG_BUF_MAX, &out);
+	if (rc != VTM_OK)
+		goto end;
+
+	/* decompressed msg is never a view */
+	par->msg_view = NULL;
+	par->msg_buf_used = 0;
+
+	rc = vtm_ws_parser_grow(par, out.used);
+	if (rc != VTM_OK)
+		goto end;
+
+	memcpy(par->msg_buf, out.data, out.used);
+	par->msg_buf_used = out.used;
+	par->msg_compressed = false;
+
+end:
+	vtm_buf_release(&out);
+	return rc;
+}
+
 int vtm_ws_parser_get_msg(struct vtm_ws_parser *par, struct vtm_ws_msg *msg)
 {
 	/* interleaved ctrl message available */
@@ -394,13 +512,16 @@ int vtm_ws_parser_get_msg(struct vtm_ws_parser *par, struct vtm_ws_msg *msg)
 		return VTM_OK;
 	}
 
-	vtm_ws_msg_init(msg, par->msg_type, par->msg_buf, par->msg_buf_used);
-
-	par->msg_buf = malloc(par->msg_buf_size);
-	if (!par->msg_buf) {
-		vtm_err_oom();
-		return vtm_err_get_code();
+	if (par->msg_view) {
+		vtm_ws_msg_init(msg, par->msg_type, par->msg_view, par->msg_buf_used, false);
+		par->msg_view = NULL;
+		return VTM_OK;
 	}
 
+	/* hand over the pooled buffer, the next msg borrows a new one */
+	vtm_ws_msg_init(msg, par->msg_type, par->msg_buf, par->msg_buf_used, true);
+	par->msg_buf = NULL;
+	par->msg_buf_size = 0;
+
 	return VTM_OK;
 }
@@ -13,6 +13,7 @@
 
 #include <vtm/core/api.h>
 #include <vtm/core/buffer.h>
+#include <vtm/core/utf8.h>
 #include <vtm/net/common.h>
 #include <vtm/net/http/ws.h>
 #include <vtm/net/http/ws_message.h>
@@ -21,6 +22,8 @@
 extern "C" {
 #endif
 
+struct vtm_ws_deflate;
+
 enum vtm_ws_parser_stage
 {
 	VTM_WS_PARSE_MSG_BEGIN,
@@ -55,12 +58,23 @@ struct vtm_ws_parser
 	size_t payload_begin;
 	uint32_t mask;
 
-	/* msg assembly buffer */
+	/* msg assembly buffer, borrowed from the message pool */
 	unsigned char *msg_buf;
 	size_t msg_buf_size;
 	size_t msg_buf_used;
 	size_t msg_frame_count;
 	enum vtm_ws_msg_type msg_type;
+	bool msg_compressed;
+
+	/* text validated frame by frame, compressed text after inflating */
+	struct vtm_utf8_state utf8;
+
+	/* single frame msg referenced in the input buffer */
+	bool zero_copy;
+	unsigned char *msg_view;
+
+	/* permessage-deflate, NULL if not negotiated */
+	struct vtm_ws_deflate *deflate;
 
 	/* interleaved control msg */
 	bool has_ctrl_msg;
@@ -93,6 +107,26 @@ VTM_API void vtm_ws_parser_release(struct vtm_ws_parser *par);
  */
 VTM_API void vtm_ws_parser_reset(struct vtm_ws_parser *par);
 
+/**
+ * Enables decompression of messages with rsv1 bit.
+ *
+ * @param par the parser
+ * @param wd the negotiated permessage-deflate state, NULL disables it
+ */
+VTM_API void vtm_ws_parser_set_deflate(struct vtm_ws_parser *par, struct vtm_ws_deflate *wd);
+
+/**
+ * Lets single frame messages reference the input buffer instead of
+ * copying them.
+ *
+ * Such a message is only valid until the parser runs again and the
+ * input buffer is not modified before.
+ *
+ * @param par the parser
+ * @param zero_copy true if messages may reference the input buffer
+ */
+VTM_API void vtm_ws_parser_set_zero_copy(struct vtm_ws_parser *par, bool zero_copy);
+
 /**
  * Lets the parser examine the input data.
  *
@@ -102,7 +136,7 @@ VTM_API void vtm_ws_parser_reset(struct vtm_ws_parser *par);
  * @return VTM_NET_RECV_STAT_AGAIN if the parser need a another run with more
  *         input data
  * @return VTM_NET_RECV_STAT_INVALID if the input data is not a valid
- *         WebSocket message
+ *         WebSocket message, this includes text that is not UTF-8
  * @return VTM_NET_RECV_STAT_ERROR if an error occured for example a necessary
  *         buffer could not be allocated
  */
@@ -111,6 +145,8 @@ VTM_API enum vtm_net_recv_stat vtm_ws_parser_run(struct vtm_ws_parser *par, stru
 /**
  * Retrieves the last parsed message
  *
+ * The message must be released with vtm_ws_msg_release().
+ *
  * @param par the parser
  * @param[out] msg the message is stored here
  * @return VTM_OK if the parsed message was successfully retrieved
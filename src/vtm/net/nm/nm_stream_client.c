@@ -81,6 +81,7 @@ int vtm_nm_stream_client_connect(vtm_nm_stream_client *cl, struct vtm_nm_stream_
 		tls_opts.no_cert_check = false;
 		tls_opts.ca_file = opts->tls.cert_file;
 		tls_opts.ciphers = opts->tls.ciphers;
+		tls_opts.alpn = opts->tls.alpn;
 		cl->sock = vtm_socket_tls_new(opts->addr.family, &tls_opts);
 	}
 	else {
@@ -12,6 +12,9 @@
 #define VTM_SOCKET_IS_CLOSED(SOCK)      \
 	vtm_flag_is_set((SOCK)->state, VTM_SOCK_STAT_CLOSED)
 
+/* forward declaration */
+static void vtm_socket_update_nbl_hints(vtm_socket *sock);
+
 int vtm_socket_base_init(struct vtm_socket *sock)
 {
 	sock->state = VTM_SOCK_STAT_DEFAULT;
@@ -179,19 +182,45 @@ int vtm_socket_write(vtm_socket *sock, const void *src, size_t len, size_t *out_
 	vtm_flag_unset(sock->state, VTM_SOCK_STAT_WRITE_AGAIN |
 		VTM_SOCK_STAT_WRITE_AGAIN_WHEN_READABLE);
 	rc = sock->vtable->vtm_socket_write(sock, src, len, out_written);
+	vtm_socket_update_nbl_hints(sock);
 
-	/* check if NBL hints must be changed */
-	if (sock->state & VTM_SOCK_STAT_NBL_AUTO) {
-		if (sock->state & (VTM_SOCK_STAT_WRITE_AGAIN |
-			VTM_SOCK_STAT_READ_AGAIN_WHEN_WRITEABLE)) {
-			sock->state &= ~VTM_SOCK_STAT_NBL_READ;
-			sock->state |= VTM_SOCK_STAT_NBL_WRITE;
-		}
-		else {
-			sock->state &= ~VTM_SOCK_STAT_NBL_WRITE;
-			sock->state |= VTM_SOCK_STAT_NBL_READ;
+unlock:
+	vtm_socket_unlock(sock);
+
+	return rc;
+}
+
+int vtm_socket_writev(vtm_socket *sock, const struct vtm_socket_iovec *vec, size_t count, size_t *out_written)
+{
+	int rc;
+	size_t i, num, written;
+
+	vtm_socket_lock(sock);
+	if (VTM_SOCKET_IS_CLOSED(sock)) {
+		*out_written = 0;
+		rc = VTM_E_IO_CLOSED;
+		goto unlock;
+	}
+
+	vtm_flag_unset(sock->state, VTM_SOCK_STAT_WRITE_AGAIN |
+		VTM_SOCK_STAT_WRITE_AGAIN_WHEN_READABLE);
+
+	if (sock->vtable->vtm_socket_writev) {
+		rc = sock->vtable->vtm_socket_writev(sock, vec, count, out_written);
+	}
+	else {
+		/* write regions one after another */
+		rc = VTM_OK;
+		written = 0;
+		for (i=0; i < count; i++) {
+			rc = sock->vtable->vtm_socket_write(sock, vec[i].data, vec[i].len, &num);
+			written += num;
+			if (rc != VTM_OK)
+				break;
 		}
+		*out_written = written;
 	}
+	vtm_socket_update_nbl_hints(sock);
 
 unlock:
 	vtm_socket_unlock(sock);
@@ -199,6 +228,22 @@ unlock:
 	return rc;
 }
 
+static void vtm_socket_update_nbl_hints(vtm_socket *sock)
+{
+	if (!(sock->state & VTM_SOCK_STAT_NBL_AUTO))
+		return;
+
+	if (sock->state & (VTM_SOCK_STAT_WRITE_AGAIN |
+		VTM_SOCK_STAT_READ_AGAIN_WHEN_WRITEABLE)) {
+		sock->state &= ~VTM_SOCK_STAT_NBL_READ;
+		sock->state |= VTM_SOCK_STAT_NBL_WRITE;
+	}
+	else {
+		sock->state &= ~VTM_SOCK_STAT_NBL_WRITE;
+		sock->state |= VTM_SOCK_STAT_NBL_READ;
+	}
+}
+
 int vtm_socket_read(vtm_socket *sock, void *buf, size_t len, size_t *out_read)
 {
 	int rc;
@@ -280,6 +325,51 @@ unsigned int vtm_socket_get_state(vtm_socket *sock)
 	return flags;
 }
 
+bool vtm_socket_pause_read(vtm_socket *sock)
+{
+	bool paused;
+
+	vtm_socket_lock(sock);
+	if ((sock->state & (VTM_SOCK_STAT_READ_PAUSED | VTM_SOCK_STAT_READ_RESUMED)) ==
+		VTM_SOCK_STAT_READ_RESUMED) {
+		/* resume happened before pause could take effect */
+		vtm_flag_unset(sock->state, VTM_SOCK_STAT_READ_RESUMED);
+		paused = false;
+	}
+	else {
+		vtm_flag_set(sock->state, VTM_SOCK_STAT_READ_PAUSED);
+		paused = true;
+	}
+	vtm_socket_unlock(sock);
+
+	return paused;
+}
+
+int vtm_socket_resume_read(vtm_socket *sock)
+{
+	int rc;
+	bool notify;
+
+	notify = false;
+
+	vtm_socket_lock(sock);
+	if (VTM_SOCKET_IS_CLOSED(sock)) {
+		rc = VTM_E_IO_CLOSED;
+	}
+	else {
+		/* server clears both flags when it schedules the read */
+		notify = (sock->state & VTM_SOCK_STAT_READ_PAUSED) != 0;
+		vtm_flag_set(sock->state, VTM_SOCK_STAT_READ_RESUMED);
+		rc = VTM_OK;
+	}
+	vtm_socket_unlock(sock);
+
+	if (notify)
+		vtm_socket_update_srv(sock);
+
+	return rc;
+}
+
 int vtm_socket_set_opt(vtm_socket *sock, int opt, const void *val, size_t len)
 {
 	int rc;
@@ -292,7 +382,7 @@ int vtm_socket_set_opt(vtm_socket *sock, int opt, const void *val, size_t len)
 
 	switch (opt) {
 		case VTM_SOCK_OPT_NONBLOCKING:
-			if (val)
+			if (*((bool*) val))
 				vtm_flag_set(sock->state, VTM_SOCK_STAT_NONBLOCKING);
 			else
 				vtm_flag_unset(sock->state, VTM_SOCK_STAT_NONBLOCKING);
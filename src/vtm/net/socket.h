@@ -37,6 +37,8 @@ extern "C" {
 #define VTM_SOCK_STAT_NBL_READ                    (1 << 11)  /**< Non-blocking read */
 #define VTM_SOCK_STAT_NBL_WRITE                   (1 << 12)  /**< Non-blocking write */
 #define VTM_SOCK_STAT_NBL_AUTO                    (1 << 13)  /**< Non-blocking read or write, automatically switched */
+#define VTM_SOCK_STAT_READ_PAUSED                 (1 << 14)  /**< Read notifications suspended */
+#define VTM_SOCK_STAT_READ_RESUMED                (1 << 15)  /**< Read resumed, processing is pending */
 
 /* shutdown */
 #define VTM_SOCK_SHUT_RD                   1  /**< Shutdown read-side */
@@ -51,6 +53,7 @@ extern "C" {
 #define VTM_SOCK_OPT_TCP_KEEPALIVE_INTVL   6  /**< expects int, value is seconds */
 #define VTM_SOCK_OPT_TCP_KEEPALIVE_PROBES  7  /**< expects int, value is count */
 #define VTM_SOCK_OPT_TCP_NODELAY           8  /**< expects bool */
+#define VTM_SOCK_OPT_TLS_ALPN              9  /**< expects char buffer, get only, value is the negotiated protocol or empty */
 
 /* default TLS ciphers */
 #define VTM_SOCKET_TLS_DEFAULT_CIPHERS                              \
@@ -65,6 +68,13 @@ struct vtm_socket_tls_opts
 	const char *cert_file;
 	const char *key_file;
 	const char *ciphers;
+	const char *alpn;  /**< comma separated protocols for ALPN, NULL if unused */
+};
+
+struct vtm_socket_iovec
+{
+	const void *data;  /**< pointer to the memory region */
+	size_t len;        /**< length of memory region in bytes */
 };
 
 typedef struct vtm_socket vtm_socket;
@@ -188,6 +198,8 @@ VTM_API int vtm_socket_accept(vtm_socket *sock, vtm_socket **client);
  * @param host either a hostname or an ip address
  * @param port the port number
  * @return VTM_OK if the call succeeded and the socket is now connected
+ * @return VTM_E_IO_AGAIN if the socket is non-blocking and the connection
+ *         is established in background, the socket becomes writeable then
  * @return VTM_E_NOT_SUPPORTED if the operation is not supported, for example
  *         you cannot connect a datagram based socket
  * @return VTM_E_IO_UNKNOWN or VTM_ERROR if an error occured
@@ -231,6 +243,24 @@ VTM_API int vtm_socket_close(vtm_socket *sock);
  */
 VTM_API int vtm_socket_write(vtm_socket *sock, const void *src, size_t len, size_t *out_written);
 
+/**
+ * Writes multiple memory regions to the socket.
+ *
+ * The regions are written in order as if they were one contiguous
+ * block. Plain sockets pass them to the kernel with a single call,
+ * other sockets write them one after another.
+ *
+ * @param sock the socket where the data should be written to
+ * @param vec the memory regions
+ * @param count the number of memory regions
+ * @param[out] out_written total number of bytes that were successfully written
+ * @return VTM_OK if the call succeeded
+ * @return VTM_E_IO_AGAIN if not all data could be written at once
+ * @return VRM_E_IO_CLOSED if the connection was closed
+ * @return VTM_E_IO_UNKNOWN or VTM_ERROR if an error occured
+ */
+VTM_API int vtm_socket_writev(vtm_socket *sock, const struct vtm_socket_iovec *vec, size_t count, size_t *out_written);
+
 /**
  * Reads data from the socket.
  *
@@ -302,6 +332,35 @@ VTM_API void vtm_socket_unset_state(vtm_socket *sock, unsigned int flags);
  */
 VTM_API unsigned int vtm_socket_get_state(vtm_socket *sock);
 
+/**
+ * Suspends read notifications of a socket that is run by a server.
+ *
+ * While paused, the server does not report the socket as readable, so
+ * that no further data is taken from the peer. Other events like
+ * writeability or hang up are still reported.
+ *
+ * When vtm_socket_resume_read() was already called for the pending pause,
+ * the socket is not paused and the caller should continue processing.
+ *
+ * @param sock the socket
+ * @return true if the socket was paused
+ * @return false if the socket was already resumed
+ */
+VTM_API bool vtm_socket_pause_read(vtm_socket *sock);
+
+/**
+ * Resumes read notifications of a paused socket.
+ *
+ * This function may be called from any thread. The server schedules a
+ * read event for the socket, so that already received data is processed
+ * even if the peer does not send anything new.
+ *
+ * @param sock the socket
+ * @return VTM_OK if the call succeeded
+ * @return VTM_E_IO_CLOSED if the socket was already closed
+ */
+VTM_API int vtm_socket_resume_read(vtm_socket *sock);
+
 /**
  * Set socket option.
  *
@@ -40,6 +40,9 @@ extern "C" {
 /** Minimum buffer size to hold string representation of an IP address */
 #define VTM_SOCK_ADDR_BUF_LEN           46
 
+/** Length of the binary IP address, IPv4 addresses are mapped to IPv6 */
+#define VTM_SOCK_ADDR_IP_LEN            16
+
 struct vtm_socket_addr
 {
 	enum vtm_socket_family   family;  /**< the socket family */
@@ -72,6 +75,19 @@ VTM_API int vtm_socket_os_addr_build(struct vtm_socket_saddr *saddr, struct vtm_
 VTM_API int vtm_socket_os_addr_convert(struct vtm_socket_saddr *saddr, enum vtm_socket_family *fam,
 	char *host_buf, size_t len, unsigned int *port);
 
+/**
+ * Extracts the binary IP address without the port.
+ *
+ * IPv4 addresses are returned as IPv4-mapped IPv6 address, so that
+ * the result can be used as fixed-size key for both families.
+ *
+ * @param saddr the address
+ * @param[out] ip buffer with at least VTM_SOCK_ADDR_IP_LEN bytes
+ * @return VTM_OK if the address was extracted
+ * @return VTM_E_NOT_SUPPORTED if the address is no IP address
+ */
+VTM_API int vtm_socket_os_addr_get_ip(struct vtm_socket_saddr *saddr, unsigned char *ip);
+
 #ifdef __cplusplus
 }
 #endif
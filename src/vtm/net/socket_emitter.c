@@ -4,7 +4,7 @@
 
 #include "socket_emitter.h"
 
-#include <string.h> /* memmove() */
+#include <string.h> /* memcpy() */
 #include <vtm/core/error.h>
 #include <vtm/fs/file.h>
 
@@ -23,19 +23,38 @@ struct vtm_emt_buf
 	struct vtm_buf *buf;
 };
 
+struct vtm_emt_iovec
+{
+	struct vtm_socket_emitter se;
+	struct vtm_socket_iovec vec[VTM_SOCK_EMT_IOVEC_MAX];
+	size_t index;
+	size_t count;
+	void (*fr)(void *arg);
+	void *fr_arg;
+};
+
 struct vtm_emt_file
 {
 	struct vtm_socket_emitter se;
 	char buf[VTM_EMT_FILE_BUF_SIZE];
 	size_t buf_used;
 	size_t buf_written;
+	uint64_t offset;
+	uint64_t remaining;
+	bool seek;
 	FILE *fp;
 };
 
 /* forward declaration */
 static enum vtm_socket_emitter_result vtm_socket_emitter_write_raw(struct vtm_socket_emitter *se);
+static struct vtm_socket_emitter* vtm_socket_emitter_file_new(vtm_socket *sock, FILE *fp, uint64_t offset, uint64_t len, bool seek, bool fr);
+static enum vtm_socket_emitter_result vtm_socket_emitter_write_iovec(struct vtm_socket_emitter *se);
 static enum vtm_socket_emitter_result vtm_socket_emitter_write_file(struct vtm_socket_emitter *se);
+static int vtm_socket_emitter_read_raw(struct vtm_socket_emitter *se, void *buf, size_t len, size_t *out_read);
+static int vtm_socket_emitter_read_iovec(struct vtm_socket_emitter *se, void *buf, size_t len, size_t *out_read);
+static int vtm_socket_emitter_read_file(struct vtm_socket_emitter *se, void *buf, size_t len, size_t *out_read);
 static void vtm_socket_emitter_clean_buf(struct vtm_socket_emitter *se);
+static void vtm_socket_emitter_clean_iovec(struct vtm_socket_emitter *se);
 static void vtm_socket_emitter_clean_file(struct vtm_socket_emitter *se);
 
 void vtm_socket_emitter_free_chain(struct vtm_socket_emitter *se)
@@ -80,6 +99,7 @@ struct vtm_socket_emitter* vtm_socket_emitter_for_raw(vtm_socket *sock, const vo
 	re->se.length = len;
 	re->se.vtm_sock_emt_write = vtm_socket_emitter_write_raw;
 	re->se.vtm_sock_emt_clean = NULL;
+	re->se.vtm_sock_emt_read = vtm_socket_emitter_read_raw;
 
 	return (struct vtm_socket_emitter*) re;
 }
@@ -104,11 +124,60 @@ struct vtm_socket_emitter* vtm_socket_emitter_for_buffer(vtm_socket *sock, struc
 	be->re.se.length = buf->used;
 	be->re.se.vtm_sock_emt_write = vtm_socket_emitter_write_raw;
 	be->re.se.vtm_sock_emt_clean = fr ? vtm_socket_emitter_clean_buf : NULL;
+	be->re.se.vtm_sock_emt_read = vtm_socket_emitter_read_raw;
 
 	return (struct vtm_socket_emitter*) be;
 }
 
+struct vtm_socket_emitter* vtm_socket_emitter_for_iovec(vtm_socket *sock, const struct vtm_socket_iovec *vec, size_t count, void (*fr)(void *arg), void *fr_arg)
+{
+	size_t i;
+	uint64_t len;
+	struct vtm_emt_iovec *ve;
+
+	if (count > VTM_SOCK_EMT_IOVEC_MAX) {
+		vtm_err_set(VTM_E_INVALID_ARG);
+		return NULL;
+	}
+
+	ve = malloc(sizeof(*ve));
+	if (!ve) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	len = 0;
+	for (i=0; i < count; i++) {
+		ve->vec[i] = vec[i];
+		len += vec[i].len;
+	}
+
+	ve->index = 0;
+	ve->count = count;
+	ve->fr = fr;
+	ve->fr_arg = fr_arg;
+
+	ve->se.sock = sock;
+	ve->se.next = NULL;
+	ve->se.length = len;
+	ve->se.vtm_sock_emt_write = vtm_socket_emitter_write_iovec;
+	ve->se.vtm_sock_emt_clean = fr ? vtm_socket_emitter_clean_iovec : NULL;
+	ve->se.vtm_sock_emt_read = vtm_socket_emitter_read_iovec;
+
+	return (struct vtm_socket_emitter*) ve;
+}
+
 struct vtm_socket_emitter* vtm_socket_emitter_for_file(vtm_socket *sock, FILE *fp)
+{
+	return vtm_socket_emitter_file_new(sock, fp, 0, vtm_file_get_fsize(fp), false, true);
+}
+
+struct vtm_socket_emitter* vtm_socket_emitter_for_file_range(vtm_socket *sock, FILE *fp, uint64_t offset, uint64_t len, bool fr)
+{
+	return vtm_socket_emitter_file_new(sock, fp, offset, len, true, fr);
+}
+
+static struct vtm_socket_emitter* vtm_socket_emitter_file_new(vtm_socket *sock, FILE *fp, uint64_t offset, uint64_t len, bool seek, bool fr)
 {
 	struct vtm_emt_file *fe;
 
@@ -121,12 +190,16 @@ struct vtm_socket_emitter* vtm_socket_emitter_for_file(vtm_socket *sock, FILE *f
 	fe->fp = fp;
 	fe->buf_used = 0;
 	fe->buf_written = 0;
+	fe->offset = offset;
+	fe->remaining = len;
+	fe->seek = seek;
 
 	fe->se.sock = sock;
 	fe->se.next = NULL;
-	fe->se.length = vtm_file_get_fsize(fp);
+	fe->se.length = len;
 	fe->se.vtm_sock_emt_write = vtm_socket_emitter_write_file;
-	fe->se.vtm_sock_emt_clean = vtm_socket_emitter_clean_file;
+	fe->se.vtm_sock_emt_clean = fr ? vtm_socket_emitter_clean_file : NULL;
+	fe->se.vtm_sock_emt_read = vtm_socket_emitter_read_file;
 
 	return (struct vtm_socket_emitter*) fe;
 }
@@ -159,28 +232,72 @@ static enum vtm_socket_emitter_result vtm_socket_emitter_write_raw(struct vtm_so
 	return VTM_SOCK_EMIT_ERROR;
 }
 
+static enum vtm_socket_emitter_result vtm_socket_emitter_write_iovec(struct vtm_socket_emitter *se)
+{
+	int rc;
+	size_t written;
+	struct vtm_emt_iovec *ve;
+
+	ve = (struct vtm_emt_iovec*) se;
+
+	rc = vtm_socket_writev(se->sock, ve->vec + ve->index, ve->count - ve->index, &written);
+	switch (rc) {
+		case VTM_OK:
+			return VTM_SOCK_EMIT_COMPLETE;
+
+		case VTM_E_IO_AGAIN:
+			/* advance regions */
+			while (ve->index < ve->count && written >= ve->vec[ve->index].len) {
+				written -= ve->vec[ve->index].len;
+				ve->index++;
+			}
+			if (ve->index < ve->count) {
+				ve->vec[ve->index].data = (const unsigned char*) ve->vec[ve->index].data + written;
+				ve->vec[ve->index].len -= written;
+			}
+			return VTM_SOCK_EMIT_AGAIN;
+
+		default:
+			break;
+	}
+
+	return VTM_SOCK_EMIT_ERROR;
+}
+
 static enum vtm_socket_emitter_result vtm_socket_emitter_write_file(struct vtm_socket_emitter *se)
 {
 	int rc;
 	struct vtm_emt_file *fe;
-	FILE *fp;
 	size_t rcount;
 	size_t wcount;
-	size_t diff;
 
 	fe = (struct vtm_emt_file*) se;
-	fp = fe->fp;
+
+	/* position lazily, the stream may be shared with other emitters */
+	if (fe->seek) {
+		if (vtm_file_seek(fe->fp, fe->offset) != VTM_OK)
+			return VTM_SOCK_EMIT_ERROR;
+		fe->seek = false;
+	}
 
 	while (true) {
-		rcount = fread(fe->buf + fe->buf_used, 1, VTM_EMT_FILE_BUF_SIZE - fe->buf_used, fp);
-		if (rcount <= 0) {
-			if (feof(fp) == 0)
-				return VTM_SOCK_EMIT_ERROR;
-			else
+		/* refill buffer */
+		if (fe->buf_written == fe->buf_used) {
+			if (fe->remaining == 0)
 				return VTM_SOCK_EMIT_COMPLETE;
-		}
 
-		fe->buf_used += rcount;
+			rcount = VTM_EMT_FILE_BUF_SIZE;
+			if (fe->remaining < rcount)
+				rcount = (size_t) fe->remaining;
+
+			rcount = fread(fe->buf, 1, rcount, fe->fp);
+			if (rcount == 0)
+				return VTM_SOCK_EMIT_ERROR;
+
+			fe->buf_used = rcount;
+			fe->buf_written = 0;
+			fe->remaining -= rcount;
+		}
 
 		rc = vtm_socket_write(se->sock,
 			fe->buf + fe->buf_written,
@@ -190,12 +307,7 @@ static enum vtm_socket_emitter_result vtm_socket_emitter_write_file(struct vtm_s
 		if (!(rc == VTM_OK || rc == VTM_E_IO_AGAIN))
 			return VTM_SOCK_EMIT_ERROR;
 
-		diff = VTM_EMT_FILE_BUF_SIZE - (fe->buf_written + wcount);
-		if (diff > 0)
-			memmove(fe->buf, fe->buf + fe->buf_written + wcount, diff);
-
-		fe->buf_used = diff;
-		fe->buf_written = 0;
+		fe->buf_written += wcount;
 
 		if (rc == VTM_E_IO_AGAIN)
 			return VTM_SOCK_EMIT_AGAIN;
@@ -204,11 +316,93 @@ static enum vtm_socket_emitter_result vtm_socket_emitter_write_file(struct vtm_s
 	return VTM_SOCK_EMIT_ERROR;
 }
 
+static int vtm_socket_emitter_read_raw(struct vtm_socket_emitter *se, void *buf, size_t len, size_t *out_read)
+{
+	struct vtm_emt_raw *re;
+
+	re = (struct vtm_emt_raw*) se;
+
+	if (len > se->length - re->buf_pos)
+		len = (size_t) (se->length - re->buf_pos);
+
+	memcpy(buf, re->src + re->buf_pos, len);
+	re->buf_pos += len;
+	*out_read = len;
+
+	return VTM_OK;
+}
+
+static int vtm_socket_emitter_read_iovec(struct vtm_socket_emitter *se, void *buf, size_t len, size_t *out_read)
+{
+	size_t num, read;
+	struct vtm_emt_iovec *ve;
+	struct vtm_socket_iovec *vec;
+
+	ve = (struct vtm_emt_iovec*) se;
+	read = 0;
+
+	while (read < len && ve->index < ve->count) {
+		vec = &ve->vec[ve->index];
+		num = len - read;
+		if (num > vec->len)
+			num = vec->len;
+
+		memcpy((unsigned char*) buf + read, vec->data, num);
+		read += num;
+
+		vec->data = (const unsigned char*) vec->data + num;
+		vec->len -= num;
+		if (vec->len == 0)
+			ve->index++;
+	}
+
+	*out_read = read;
+
+	return VTM_OK;
+}
+
+static int vtm_socket_emitter_read_file(struct vtm_socket_emitter *se, void *buf, size_t len, size_t *out_read)
+{
+	size_t num;
+	struct vtm_emt_file *fe;
+
+	fe = (struct vtm_emt_file*) se;
+	*out_read = 0;
+
+	if (fe->seek) {
+		if (vtm_file_seek(fe->fp, fe->offset) != VTM_OK)
+			return VTM_E_IO_UNKNOWN;
+		fe->seek = false;
+	}
+
+	if (len > fe->remaining)
+		len = (size_t) fe->remaining;
+	if (len == 0)
+		return VTM_OK;
+
+	num = fread(buf, 1, len, fe->fp);
+	if (num == 0)
+		return VTM_E_IO_UNKNOWN;
+
+	fe->remaining -= num;
+	*out_read = num;
+
+	return VTM_OK;
+}
+
 static void vtm_socket_emitter_clean_buf(struct vtm_socket_emitter *se)
 {
 	vtm_buf_free(((struct vtm_emt_buf*) se)->buf);
 }
 
+static void vtm_socket_emitter_clean_iovec(struct vtm_socket_emitter *se)
+{
+	struct vtm_emt_iovec *ve;
+
+	ve = (struct vtm_emt_iovec*) se;
+	ve->fr(ve->fr_arg);
+}
+
 static void vtm_socket_emitter_clean_file(struct vtm_socket_emitter *se)
 {
 	fclose(((struct vtm_emt_file*) se)->fp);
@@ -250,6 +444,14 @@ out:
 	return rc;
 }
 
+int vtm_socket_emitter_read(struct vtm_socket_emitter *se, void *buf, size_t len, size_t *out_read)
+{
+	if (!se->vtm_sock_emt_read)
+		return VTM_E_NOT_SUPPORTED;
+
+	return se->vtm_sock_emt_read(se, buf, len, out_read);
+}
+
 int vtm_socket_emitter_get_chain_lensum(struct vtm_socket_emitter *se, uint64_t *out_sum)
 {
 	uint64_t sum;
@@ -21,6 +21,8 @@
 extern "C" {
 #endif
 
+#define VTM_SOCK_EMT_IOVEC_MAX   4  /**< maximum number of regions per iovec emitter */
+
 enum vtm_socket_emitter_result
 {
 	VTM_SOCK_EMIT_AGAIN,     /**< There is still data that needs to be transmitted */
@@ -42,6 +44,12 @@ struct vtm_socket_emitter
 	/** function that is called when the emitter is released */
 	void (*vtm_sock_emt_clean)(struct vtm_socket_emitter *se);
 
+	/**
+	 * optional function that copies the next data to a buffer instead of
+	 * writing it to the socket, used when the data must be framed first
+	 */
+	int (*vtm_sock_emt_read)(struct vtm_socket_emitter *se, void *buf, size_t len, size_t *out_read);
+
 	/** pointer to next emitter in chain */
 	struct vtm_socket_emitter *next;
 };
@@ -72,6 +80,23 @@ VTM_API void vtm_socket_emitter_free_single(struct vtm_socket_emitter *se);
  */
 VTM_API struct vtm_socket_emitter* vtm_socket_emitter_for_raw(vtm_socket *sock, const void *src, size_t len);
 
+/**
+ * Creates a new socket emitter for sending multiple memory regions.
+ *
+ * The regions are not copied and must stay valid until the emitter
+ * is released. They are passed to the socket with a single vectored
+ * write where possible.
+ *
+ * @param sock the socket that should be used by the emitter
+ * @param vec the memory regions, at most VTM_SOCK_EMT_IOVEC_MAX
+ * @param count the number of memory regions
+ * @param fr optional function that is called with fr_arg when the emitter is released
+ * @param fr_arg the argument for the release function
+ * @return the created emitter
+ * @return NULL if an error occured
+ */
+VTM_API struct vtm_socket_emitter* vtm_socket_emitter_for_iovec(vtm_socket *sock, const struct vtm_socket_iovec *vec, size_t count, void (*fr)(void *arg), void *fr_arg);
+
 /**
  * Creates a new socket emitter for sending the contents of buffer.
  *
@@ -93,6 +118,23 @@ VTM_API struct vtm_socket_emitter* vtm_socket_emitter_for_buffer(vtm_socket *soc
  */
 VTM_API struct vtm_socket_emitter* vtm_socket_emitter_for_file(vtm_socket *sock, FILE *fp);
 
+/**
+ * Creates a new socket emitter for sending a part of a file.
+ *
+ * The file position is set to the given offset when the emitter starts
+ * writing, so the skipped bytes are never read. Multiple range emitters
+ * in the same chain may share one file stream.
+ *
+ * @param sock the socket that should be used by the emitter
+ * @param fp the already opened file
+ * @param offset the offset of the first byte that should be sent
+ * @param len the number of bytes that should be sent
+ * @param fr if true the file is closed when the emitter is released
+ * @return the created emitter
+ * @return NULL if an error occured
+ */
+VTM_API struct vtm_socket_emitter* vtm_socket_emitter_for_file_range(vtm_socket *sock, FILE *fp, uint64_t offset, uint64_t len, bool fr);
+
 /**
  * Tries to send the data of all emitters in the chain immediately.
  *
@@ -108,6 +150,19 @@ VTM_API struct vtm_socket_emitter* vtm_socket_emitter_for_file(vtm_socket *sock,
  */
 VTM_API int vtm_socket_emitter_try_write(struct vtm_socket_emitter **se);
 
+/**
+ * Copies the next data of a single emitter to a buffer.
+ * Data that was read is not written to the socket anymore.
+ * @param se the socket emitter
+ * @param buf the buffer where the data is stored
+ * @param len the size of the buffer in bytes
+ * @param[out] out_read the number of bytes copied, zero if all data was read
+ * @return VTM_OK if the call succeeded
+ * @return VTM_E_NOT_SUPPORTED if the emitter can only write to the socket
+ * @return VTM_E_IO_UNKNOWN if an error occured
+ */
+VTM_API int vtm_socket_emitter_read(struct vtm_socket_emitter *se, void *buf, size_t len, size_t *out_read);
+
 /**
  * Calculates the sum of all length specifications of the emitter chain.
  *
@@ -36,6 +36,7 @@ struct vtm_socket_vtable
 	int (*vtm_socket_close)(struct vtm_socket *sock);
 
 	int (*vtm_socket_write)(struct vtm_socket *sock, const void *src, size_t len, size_t *out_written);
+	int (*vtm_socket_writev)(struct vtm_socket *sock, const struct vtm_socket_iovec *vec, size_t count, size_t *out_written);
 	int (*vtm_socket_read)(struct vtm_socket *sock, void *buf, size_t len, size_t *out_read);
 
 	int (*vtm_socket_dgram_recv)(struct vtm_socket *sock, void *buf, size_t maxlen, size_t *out_recv, struct vtm_socket_saddr *saddr);
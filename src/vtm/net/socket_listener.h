@@ -83,6 +83,18 @@ VTM_API int vtm_socket_listener_rearm(vtm_socket_listener *li, vtm_socket *sock)
  */
 VTM_API int vtm_socket_listener_run(vtm_socket_listener *li, struct vtm_socket_event **events, size_t *num_events);
 
+/**
+ * Wait for new socket events, but at most the given time.
+ *
+ * @param li the target listener
+ * @param[out] events pointer to array of socket event pointers
+ * @param[out] num_events number of events read, zero if the timeout elapsed
+ * @param millis maximum time to wait in milliseconds
+ * @return VTM_OK if the call succeed
+ * @return VTM_ERROR if an error occcured
+ */
+VTM_API int vtm_socket_listener_run_timeout(vtm_socket_listener *li, struct vtm_socket_event **events, size_t *num_events, unsigned long millis);
+
 /**
  * Interrupts the listener if he is blocked in waiting for events.
  *
@@ -22,6 +22,7 @@ struct vtm_socket_tls_cfg
 	const char  *cert_file;  /**< full path to certificate in PEM format */
 	const char  *key_file;   /**< full path to key in PEM format */
 	const char  *ciphers;    /**< list of accepted ciphers */
+	const char  *alpn;       /**< comma separated ALPN protocols in order of preference */
 };
 
 #ifdef __cplusplus
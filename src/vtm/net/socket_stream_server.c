@@ -4,6 +4,7 @@
 
 #include "socket_stream_server.h"
 
+#include <stdlib.h> /* free() */
 #include <string.h> /* memset() */
 
 #include <vtm/core/error.h>
@@ -11,6 +12,7 @@
 #include <vtm/core/list.h>
 #include <vtm/core/map.h>
 #include <vtm/core/squeue.h>
+#include <vtm/core/string.h>
 #include <vtm/net/socket_intl.h>
 #include <vtm/net/socket_listener.h>
 #include <vtm/util/atomic.h>
@@ -29,6 +31,7 @@ enum vtm_socket_stream_srv_entry_type
 {
 	VTM_SOCK_SRV_ACCEPTED,
 	VTM_SOCK_SRV_READ,
+	VTM_SOCK_SRV_RESUME,
 	VTM_SOCK_SRV_WRITE,
 	VTM_SOCK_SRV_CLOSED,
 	VTM_SOCK_SRV_ERROR
@@ -65,6 +68,12 @@ struct vtm_socket_stream_srv
 
 	vtm_map *cons;
 	vtm_mutex *cons_mtx;
+
+	/* admission control, guarded by cons_mtx */
+	unsigned int max_cons;
+	unsigned int max_cons_per_ip;
+	unsigned int con_count;
+	vtm_map *ip_cons;
 };
 
 static VTM_THREAD_LOCAL vtm_socket *worker_current_socket;
@@ -95,6 +104,8 @@ static void vtm_socket_stream_srv_free_sockets(vtm_socket_stream_srv *srv);
 static bool vtm_socket_stream_srv_sock_event(vtm_socket_stream_srv *srv, vtm_dataset *wd, struct vtm_socket_stream_srv_entry *event);
 static int  vtm_socket_stream_srv_sock_check(vtm_socket_stream_srv *srv, vtm_dataset *wd, vtm_socket *sock, bool rearm);
 static void vtm_socket_stream_srv_sock_accepted(vtm_socket_stream_srv *srv, vtm_dataset *wd, vtm_socket *sock);
+static int  vtm_socket_stream_srv_sock_admit(vtm_socket_stream_srv *srv, vtm_socket *sock, char **ip);
+static void vtm_socket_stream_srv_sock_dismiss(vtm_socket_stream_srv *srv, char *ip);
 static void vtm_socket_stream_srv_sock_can_read(vtm_socket_stream_srv *srv, vtm_dataset *wd, vtm_socket *sock);
 static void vtm_socket_stream_srv_sock_can_write(vtm_socket_stream_srv *srv, vtm_dataset *wd, vtm_socket *sock);
 static void vtm_socket_stream_srv_sock_closed(vtm_socket_stream_srv *srv, vtm_dataset *wd, vtm_socket *sock);
@@ -176,11 +187,24 @@ int vtm_socket_stream_srv_run(vtm_socket_stream_srv *srv, struct vtm_socket_stre
 		goto clean_listener;
 	}
 
+	/* open connections per remote address */
+	srv->max_cons = opts->max_cons;
+	srv->max_cons_per_ip = opts->max_cons_per_ip;
+	srv->con_count = 0;
+	srv->ip_cons = NULL;
+	if (srv->max_cons_per_ip > 0) {
+		srv->ip_cons = vtm_map_new(VTM_ELEM_STRING, VTM_ELEM_UINT, 64);
+		if (!srv->ip_cons) {
+			rc = vtm_err_get_code();
+			goto clean_cons;
+		}
+	}
+
 	/* relay event list */
 	srv->relay_events = vtm_list_new(VTM_ELEM_POINTER, 8);
 	if (!srv->relay_events) {
 		rc = vtm_err_get_code();
-		goto clean;
+		goto clean_ip_cons;
 	}
 	vtm_list_set_free_func(srv->relay_events, free);
 
@@ -251,6 +275,12 @@ clean:
 	}
 
 	vtm_list_free(srv->relay_events);
+
+clean_ip_cons:
+	vtm_map_free(srv->ip_cons);
+	srv->ip_cons = NULL;
+
+clean_cons:
 	vtm_map_free(srv->cons);
 
 clean_listener:
@@ -294,6 +324,7 @@ static int vtm_socket_stream_srv_create_socket(vtm_socket_stream_srv *srv, struc
 		tls_opts.cert_file = opts->tls.cert_file;
 		tls_opts.key_file = opts->tls.key_file;
 		tls_opts.ciphers = opts->tls.ciphers;
+		tls_opts.alpn = opts->tls.alpn;
 		srv->socket = vtm_socket_tls_new(opts->addr.family, &tls_opts);
 	}
 	else {
@@ -396,6 +427,11 @@ static int vtm_socket_stream_srv_handle_direct(vtm_socket_stream_srv *srv, struc
 				vtm_socket_stream_srv_sock_error(srv, wd, event->sock);
 				break;
 
+			case VTM_SOCK_SRV_RESUME:
+				if ((vtm_socket_get_state(event->sock) & VTM_SOCK_STAT_CLOSED) == 0)
+					vtm_socket_stream_srv_sock_can_read(srv, wd, event->sock);
+				break;
+
 			default:
 				break;
 		}
@@ -890,9 +926,21 @@ static VTM_INLINE bool vtm_socket_stream_srv_sock_event(vtm_socket_stream_srv *s
 		case VTM_SOCK_SRV_READ:
 			if (vtm_socket_get_state(event->sock) & VTM_SOCK_STAT_CLOSED)
 				return true;
+			/* socket is rearmed before the lock is released, retry */
 			rc = vtm_socket_stream_srv_sock_trylock(event->sock, VTM_SOCK_STAT_READ_LOCKED);
 			if (rc != VTM_OK)
+				return false;
+			vtm_socket_stream_srv_sock_can_read(srv, wd, event->sock);
+			vtm_socket_stream_srv_sock_unlock(event->sock, VTM_SOCK_STAT_READ_LOCKED);
+			break;
+
+		case VTM_SOCK_SRV_RESUME:
+			if (vtm_socket_get_state(event->sock) & VTM_SOCK_STAT_CLOSED)
 				return true;
+			/* must not get lost, the socket is not armed for reading */
+			rc = vtm_socket_stream_srv_sock_trylock(event->sock, VTM_SOCK_STAT_READ_LOCKED);
+			if (rc != VTM_OK)
+				return false;
 			vtm_socket_stream_srv_sock_can_read(srv, wd, event->sock);
 			vtm_socket_stream_srv_sock_unlock(event->sock, VTM_SOCK_STAT_READ_LOCKED);
 			break;
@@ -902,7 +950,7 @@ static VTM_INLINE bool vtm_socket_stream_srv_sock_event(vtm_socket_stream_srv *s
 				return true;
 			rc = vtm_socket_stream_srv_sock_trylock(event->sock, VTM_SOCK_STAT_WRITE_LOCKED);
 			if (rc != VTM_OK)
-				return true;
+				return false;
 			vtm_socket_stream_srv_sock_can_write(srv, wd, event->sock);
 			vtm_socket_stream_srv_sock_unlock(event->sock, VTM_SOCK_STAT_WRITE_LOCKED);
 			break;
@@ -946,11 +994,21 @@ eval:
 static VTM_INLINE void vtm_socket_stream_srv_sock_accepted(vtm_socket_stream_srv *srv, vtm_dataset *wd, vtm_socket *sock)
 {
 	int rc;
+	char *ip;
+
+	/* reject before the connection causes any further work */
+	rc = vtm_socket_stream_srv_sock_admit(srv, sock, &ip);
+	if (rc != VTM_OK) {
+		vtm_socket_close(sock);
+		vtm_socket_stream_srv_sock_free(srv, sock);
+		return;
+	}
 
 	/* check if NONBLOCKING can be activated */
 	rc = vtm_socket_set_opt(sock, VTM_SOCK_OPT_NONBLOCKING,
 		(bool[]) {true}, sizeof(bool));
 	if (rc != VTM_OK) {
+		vtm_socket_stream_srv_sock_dismiss(srv, ip);
 		vtm_socket_close(sock);
 		vtm_socket_stream_srv_sock_free(srv, sock);
 		return;
@@ -965,20 +1023,23 @@ static VTM_INLINE void vtm_socket_stream_srv_sock_accepted(vtm_socket_stream_srv
 
 	/* check if socket was closed or got error in callback */
 	rc = vtm_socket_stream_srv_sock_check(srv, wd, sock, false);
-	if (rc != VTM_OK)
+	if (rc != VTM_OK) {
+		vtm_socket_stream_srv_sock_dismiss(srv, ip);
 		return;
+	}
 
 	/* register socket to listener and add to connections */
 	vtm_socket_set_state(sock, VTM_SOCK_STAT_NBL_READ);
 	vtm_socket_stream_srv_lock_cons(srv);
 	rc = vtm_socket_listener_add(srv->listener, sock);
 	if (rc == VTM_OK)
-		vtm_map_put_va(srv->cons, sock, sock);
+		vtm_map_put_va(srv->cons, sock, ip);
 	vtm_socket_stream_srv_unlock_cons(srv);
 
 	/* check for error, socket listener max could be reached */
 	if (rc != VTM_OK) {
 		/* run DISCONNECTED callback */
+		vtm_socket_stream_srv_sock_dismiss(srv, ip);
 		vtm_socket_close(sock);
 		if (srv->cbs.sock_disconnected)
 			srv->cbs.sock_disconnected(srv, wd, sock);
@@ -986,6 +1047,90 @@ static VTM_INLINE void vtm_socket_stream_srv_sock_accepted(vtm_socket_stream_srv
 	}
 }
 
+static int vtm_socket_stream_srv_sock_admit(vtm_socket_stream_srv *srv, vtm_socket *sock, char **ip)
+{
+	int rc;
+	union vtm_elem *count;
+	struct vtm_socket_saddr saddr;
+	char host[VTM_SOCK_ADDR_BUF_LEN];
+
+	*ip = NULL;
+
+	if (srv->max_cons == 0 && srv->max_cons_per_ip == 0)
+		return VTM_OK;
+
+	/* address is resolved outside of the lock */
+	if (srv->max_cons_per_ip > 0) {
+		rc = vtm_socket_get_remote_addr(sock, &saddr);
+		if (rc == VTM_OK)
+			rc = vtm_socket_os_addr_convert(&saddr, NULL, host, sizeof(host), NULL);
+		if (rc != VTM_OK)
+			return rc;
+
+		*ip = vtm_str_copy(host);
+		if (!*ip)
+			return vtm_err_get_code();
+	}
+
+	rc = VTM_OK;
+	vtm_socket_stream_srv_lock_cons(srv);
+
+	if (srv->max_cons > 0 && srv->con_count >= srv->max_cons) {
+		rc = VTM_E_MAX_REACHED;
+		goto unlock;
+	}
+
+	if (*ip) {
+		count = vtm_map_get_va(srv->ip_cons, *ip);
+		if (count && count->elem_uint >= srv->max_cons_per_ip) {
+			rc = VTM_E_MAX_REACHED;
+			goto unlock;
+		}
+
+		if (count)
+			count->elem_uint++;
+		else
+			rc = vtm_map_put_va(srv->ip_cons, *ip, 1u);
+
+		if (rc != VTM_OK)
+			goto unlock;
+	}
+
+	srv->con_count++;
+
+unlock:
+	vtm_socket_stream_srv_unlock_cons(srv);
+
+	if (rc != VTM_OK) {
+		free(*ip);
+		*ip = NULL;
+	}
+
+	return rc;
+}
+
+static void vtm_socket_stream_srv_sock_dismiss(vtm_socket_stream_srv *srv, char *ip)
+{
+	union vtm_elem *count;
+
+	if (srv->max_cons == 0 && srv->max_cons_per_ip == 0)
+		return;
+
+	vtm_socket_stream_srv_lock_cons(srv);
+
+	srv->con_count--;
+
+	if (ip) {
+		count = vtm_map_get_va(srv->ip_cons, ip);
+		if (count && --count->elem_uint == 0)
+			vtm_map_remove_va(srv->ip_cons, ip);
+	}
+
+	vtm_socket_stream_srv_unlock_cons(srv);
+
+	free(ip);
+}
+
 static VTM_INLINE void vtm_socket_stream_srv_sock_can_read(vtm_socket_stream_srv *srv, vtm_dataset *wd, vtm_socket *sock)
 {
 	if (srv->cbs.sock_can_read)
@@ -1005,14 +1150,18 @@ static VTM_INLINE void vtm_socket_stream_srv_sock_can_write(vtm_socket_stream_sr
 static VTM_INLINE void vtm_socket_stream_srv_sock_closed(vtm_socket_stream_srv *srv, vtm_dataset *wd, vtm_socket *sock)
 {
 	bool removed;
+	char *ip;
 
 	vtm_socket_stream_srv_lock_cons(srv);
+	ip = vtm_map_get_pointer_va(srv->cons, sock);
 	removed = vtm_map_remove_va(srv->cons, sock);
 	vtm_socket_stream_srv_unlock_cons(srv);
 
 	if (!removed)
 		return;
 
+	vtm_socket_stream_srv_sock_dismiss(srv, ip);
+
 	vtm_socket_listener_remove(srv->listener, sock);
 
 	if (srv->cbs.sock_disconnected)
@@ -1032,8 +1181,9 @@ static VTM_INLINE void vtm_socket_stream_srv_sock_error(vtm_socket_stream_srv *s
 
 static VTM_INLINE void vtm_socket_stream_srv_sock_free(vtm_socket_stream_srv *srv, vtm_socket *sock)
 {
+	/* socket may still be referenced by the application */
 	if (srv->thread_count == 0) {
-		vtm_socket_free(sock);
+		vtm_socket_enable_free_on_unref(sock);
 		return;
 	}
 
@@ -1079,6 +1229,13 @@ static int vtm_socket_stream_srv_sock_cb_update(void *stream_srv, vtm_socket *so
 		vtm_socket_stream_srv_create_relay_event(srv, VTM_SOCK_SRV_CLOSED, sock);
 		vtm_socket_listener_interrupt(srv->listener);
 	}
+	else if ((sock->state & VTM_SOCK_STAT_READ_PAUSED) &&
+			(sock->state & VTM_SOCK_STAT_READ_RESUMED)) {
+		sock->state &= ~(VTM_SOCK_STAT_READ_PAUSED | VTM_SOCK_STAT_READ_RESUMED);
+		vtm_socket_ref(sock);
+		vtm_socket_stream_srv_create_relay_event(srv, VTM_SOCK_SRV_RESUME, sock);
+		vtm_socket_listener_interrupt(srv->listener);
+	}
 	else if (sock->state & (VTM_SOCK_STAT_READ_AGAIN |
 				VTM_SOCK_STAT_READ_AGAIN_WHEN_WRITEABLE |
 				VTM_SOCK_STAT_WRITE_AGAIN |
@@ -1130,8 +1287,12 @@ static VTM_INLINE void vtm_socket_stream_srv_unlock_cons(vtm_socket_stream_srv *
 static void vtm_socket_stream_srv_free_sockets(vtm_socket_stream_srv *srv)
 {
 	size_t i, count;
+	vtm_socket *sock;
 
 	count = vtm_list_size(srv->release_socks);
-	for (i=0; i < count; i++)
-		vtm_socket_free(vtm_list_get_pointer(srv->release_socks, i));
+	for (i=0; i < count; i++) {
+		sock = vtm_list_get_pointer(srv->release_socks, i);
+		vtm_socket_enable_free_on_unref(sock);
+		vtm_socket_unref(sock);
+	}
 }
@@ -139,6 +139,16 @@ struct vtm_socket_stream_srv_opts
 	 * lets the server run in single threaded mode.
 	 */
 	unsigned int threads;
+
+	/**
+	 * Maximum number of open connections, zero means unlimited.
+	 * Further connections are closed right after accepting them,
+	 * before sock_connected is called.
+	 */
+	unsigned int max_cons;
+
+	/** Maximum number of open connections per remote IP address, zero means unlimited */
+	unsigned int max_cons_per_ip;
 };
 
 /**
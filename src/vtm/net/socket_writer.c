@@ -9,6 +9,7 @@
 
 /* forward declaration */
 static int vtm_socket_writer_ensure_space(struct vtm_socket_writer *sw, size_t len);
+static int vtm_socket_writer_write_direct(struct vtm_socket_writer *sw, const char *src, size_t len);
 
 void vtm_socket_writer_reset(struct vtm_socket_writer *sw)
 {
@@ -24,6 +25,10 @@ int vtm_socket_writer_putm(struct vtm_socket_writer *sw, const char *src, size_t
 	sw->lrc = vtm_socket_writer_ensure_space(sw, len);
 	if (sw->lrc != VTM_OK)
 		return sw->lrc;
+
+	/* data does not fit into buffer, write directly */
+	if (len >= sizeof(sw->buf))
+		return vtm_socket_writer_write_direct(sw, src, len);
 		
 	memcpy(sw->buf + sw->index, src, len);
 	sw->index += len;
@@ -78,3 +83,17 @@ static int vtm_socket_writer_ensure_space(struct vtm_socket_writer *sw, size_t l
 	
 	return VTM_OK;
 }
+
+static int vtm_socket_writer_write_direct(struct vtm_socket_writer *sw, const char *src, size_t len)
+{
+	size_t written;
+
+	sw->lrc = vtm_socket_write(sw->sock, src, len, &written);
+	if (sw->lrc != VTM_OK)
+		return sw->lrc;
+
+	if (written != len)
+		sw->lrc = vtm_err_set(VTM_E_IO_UNKNOWN);
+
+	return sw->lrc;
+}
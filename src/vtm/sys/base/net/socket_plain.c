@@ -14,6 +14,7 @@
 
 	#include <sys/types.h>
 	#include <sys/socket.h>
+	#include <sys/uio.h> /* struct iovec */
 
 	#define VTM_SHUT_RD                SHUT_RD
 	#define VTM_SHUT_WR                SHUT_WR
@@ -21,6 +22,8 @@
 
 	#define VTM_SOCKSIZE_CASTED(VAL)   (VAL)
 
+	#define VTM_SOCK_IOV_MAX           16
+
 #elif VTM_SYS_WINDOWS
 
 	#include <winsock2.h>
@@ -47,6 +50,9 @@ static int vtm_socket_plain_accept(struct vtm_socket *sock, struct vtm_socket **
 static int vtm_socket_plain_shutdown(struct vtm_socket *sock, int dir);
 static int vtm_socket_plain_close(struct vtm_socket *sock);
 static int vtm_socket_plain_write(struct vtm_socket *sock, const void *src, size_t len, size_t *out_written);
+#ifdef VTM_HAVE_POSIX
+static int vtm_socket_plain_writev(struct vtm_socket *sock, const struct vtm_socket_iovec *vec, size_t count, size_t *out_written);
+#endif
 static int vtm_socket_plain_read(struct vtm_socket *sock, void *buf, size_t len, size_t *out_read);
 static int vtm_socket_plain_dgram_recv(struct vtm_socket *sock, void *buf, size_t maxlen, size_t *out_recv, struct vtm_socket_saddr *saddr);
 static int vtm_socket_plain_dgram_send(struct vtm_socket *sock, const void *buf, size_t len, size_t *out_send, const struct vtm_socket_saddr *saddr);
@@ -61,6 +67,9 @@ static struct vtm_socket_vtable vtm_socket_plain_vtable = {
 	.vtm_socket_shutdown = vtm_socket_plain_shutdown,
 	.vtm_socket_close = vtm_socket_plain_close,
 	.vtm_socket_write = vtm_socket_plain_write,
+#ifdef VTM_HAVE_POSIX
+	.vtm_socket_writev = vtm_socket_plain_writev,
+#endif
 	.vtm_socket_read = vtm_socket_plain_read,
 	.vtm_socket_dgram_recv = vtm_socket_plain_dgram_recv,
 	.vtm_socket_dgram_send = vtm_socket_plain_dgram_send,
@@ -233,6 +242,66 @@ out:
 	return rc;
 }
 
+#ifdef VTM_HAVE_POSIX
+static int vtm_socket_plain_writev(struct vtm_socket *sock, const struct vtm_socket_iovec *vec, size_t count, size_t *out_written)
+{
+	int rc;
+	size_t i, n, skip, written;
+	struct iovec iov[VTM_SOCK_IOV_MAX];
+	struct msghdr msg;
+	vtm_sys_sockrc_t num;
+
+	rc = VTM_OK;
+
+	/* skip counts the already written bytes of the first region */
+	written = 0;
+	skip = 0;
+	while (count > 0) {
+		if (vec->len == skip) {
+			vec++;
+			count--;
+			skip = 0;
+			continue;
+		}
+
+		for (i=0, n=0; i < count && n < VTM_SOCK_IOV_MAX; i++) {
+			if (vec[i].len == 0)
+				continue;
+			iov[n].iov_base = (char*) vec[i].data;
+			iov[n].iov_len = vec[i].len;
+			n++;
+		}
+		iov[0].iov_base = (char*) iov[0].iov_base + skip;
+		iov[0].iov_len -= skip;
+
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = n;
+
+		num = sendmsg(sock->fd, &msg, 0);
+		if (num < 0) {
+			rc = vtm_socket_util_error(sock);
+			if (rc == VTM_E_IO_AGAIN)
+				vtm_socket_set_state_intl(sock, VTM_SOCK_STAT_WRITE_AGAIN);
+			goto out;
+		}
+		written += num;
+
+		/* advance regions */
+		skip += num;
+		while (count > 0 && skip >= vec->len) {
+			skip -= vec->len;
+			vec++;
+			count--;
+		}
+	}
+
+out:
+	*out_written = written;
+	return rc;
+}
+#endif
+
 static int vtm_socket_plain_read(struct vtm_socket *sock, void *buf, size_t len, size_t *out_read)
 {
 	int rc;
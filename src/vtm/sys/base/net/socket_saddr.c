@@ -4,7 +4,7 @@
 
 #include <vtm/net/socket_addr.h>
 
-#include <string.h> /* memset() */
+#include <string.h> /* memset(), memcpy() */
 #include <vtm/core/error.h>
 #include <vtm/core/format.h>
 #include <vtm/core/math.h>
@@ -112,3 +112,25 @@ int vtm_socket_os_addr_convert(struct vtm_socket_saddr *saddr, enum vtm_socket_f
 
 	return vtm_err_set(VTM_E_NOT_SUPPORTED);
 }
+
+int vtm_socket_os_addr_get_ip(struct vtm_socket_saddr *saddr, unsigned char *ip)
+{
+	switch (saddr->addr.sa.sa_family) {
+		case AF_INET:
+			/* IPv4-mapped IPv6 address */
+			memset(ip, 0, 10);
+			ip[10] = 0xff;
+			ip[11] = 0xff;
+			memcpy(ip + 12, &(saddr->addr.in4.sin_addr), 4);
+			return VTM_OK;
+
+		case AF_INET6:
+			memcpy(ip, &(saddr->addr.in6.sin6_addr), VTM_SOCK_ADDR_IP_LEN);
+			return VTM_OK;
+
+		default:
+			break;
+	}
+
+	return vtm_err_set(VTM_E_NOT_SUPPORTED);
+}
@@ -5,7 +5,7 @@
 #include <vtm/net/socket.h>
 
 #include <stdlib.h> /* malloc() */
-#include <string.h> /* memset() */
+#include <string.h> /* memset(), memcpy(), strchr(), strlen() */
 #include <netinet/in.h> /* sockaddr_in */
 #include <unistd.h> /* close() */
 
@@ -24,6 +24,10 @@
 #define VTM_SOCKET_TLS_BUF_SIZE               16384
 #define VTM_SOCKET_TLS_ACCEPT_TIMEOUT_MILLIS  10000
 
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+#define VTM_SOCKET_TLS_HAVE_ALPN
+#endif
+
 enum vtm_socket_tls_operation
 {
 	VTM_TLS_OP_ACCEPT,
@@ -43,12 +47,18 @@ struct vtm_socket_tls_info
 	size_t recv_buf_len;
 	size_t recv_buf_used;
 	size_t send_want_bytes;
+	unsigned char *alpn;
+	size_t alpn_len;
 };
 
 /* forward declaration */
 static vtm_socket* vtm_socket_tls_alloc(enum vtm_socket_family fam, int sockfd, SSL_CTX *ctx, SSL *ssl, bool free_ctx);
 
-static SSL_CTX* vtm_socket_tls_create_ctx(struct vtm_socket_tls_opts *opts);
+static SSL_CTX* vtm_socket_tls_create_ctx(struct vtm_socket_tls_opts *opts, unsigned char **alpn, size_t *alpn_len);
+static int vtm_socket_tls_alpn_wire(const char *list, unsigned char **out, size_t *out_len);
+#ifdef VTM_SOCKET_TLS_HAVE_ALPN
+static int vtm_socket_tls_alpn_select(SSL *ssl, const unsigned char **out, unsigned char *outlen, const unsigned char *in, unsigned int inlen, void *arg);
+#endif
 static SSL_CTX* vtm_socket_tls_get_ctx(struct vtm_socket *sock);
 static SSL* vtm_socket_tls_get_ssl(struct vtm_socket *sock);
 
@@ -65,6 +75,7 @@ static int    vtm_socket_tls_dgram_send(struct vtm_socket *sock, const void *buf
 static int    vtm_socket_tls_convert_error(struct vtm_socket *sock, SSL *ssl, int code, enum vtm_socket_tls_operation op);
 static int    vtm_socket_tls_save_error(int code);
 static int    vtm_socket_tls_set_opt(struct vtm_socket *sock, int opt, const void *val, size_t len);
+static int    vtm_socket_tls_get_opt(struct vtm_socket *sock, int opt, void *val, size_t len);
 static int    vtm_socket_tls_enable_buffers(struct vtm_socket *sock);
 static void   vtm_socket_tls_disable_buffers(struct vtm_socket *sock);
 static void   vtm_socket_tls_release_buffers(struct vtm_socket *sock);
@@ -83,7 +94,7 @@ static struct vtm_socket_vtable vtm_socket_tls_vtable = {
 	.vtm_socket_dgram_recv = vtm_socket_tls_dgram_recv,
 	.vtm_socket_dgram_send = vtm_socket_tls_dgram_send,
 	.vtm_socket_set_opt = vtm_socket_tls_set_opt,
-	.vtm_socket_get_opt = vtm_socket_util_get_opt,
+	.vtm_socket_get_opt = vtm_socket_tls_get_opt,
 	.vtm_socket_get_remote_addr = vtm_socket_util_get_remote_addr
 };
 
@@ -95,6 +106,8 @@ vtm_socket* vtm_socket_tls_new(enum vtm_socket_family fam, struct vtm_socket_tls
 	vtm_socket *sock;
 	SSL_CTX *ctx;
 	SSL *ssl;
+	unsigned char *alpn;
+	size_t alpn_len;
 
 	rc = vtm_socket_util_convert_family(fam, &sockfam);
 	if (rc != VTM_OK)
@@ -110,7 +123,7 @@ vtm_socket* vtm_socket_tls_new(enum vtm_socket_family fam, struct vtm_socket_tls
 	if (rc != VTM_OK)
 		goto err_close;
 
-	ctx = vtm_socket_tls_create_ctx(opts);
+	ctx = vtm_socket_tls_create_ctx(opts, &alpn, &alpn_len);
 	if (!ctx)
 		goto err_close;
 
@@ -128,10 +141,20 @@ vtm_socket* vtm_socket_tls_new(enum vtm_socket_family fam, struct vtm_socket_tls
 	if (!sock)
 		goto err_ssl;
 
+	/* protocol list is needed for each accepted connection */
+	if (alpn) {
+		((struct vtm_socket_tls_info*) sock->info)->alpn = alpn;
+		((struct vtm_socket_tls_info*) sock->info)->alpn_len = alpn_len;
+#ifdef VTM_SOCKET_TLS_HAVE_ALPN
+		SSL_CTX_set_alpn_select_cb(ctx, vtm_socket_tls_alpn_select, sock->info);
+#endif
+	}
+
 	return sock;
 
 err_ssl:
 	SSL_free(ssl);
+	free(alpn);
 
 err_ctx:
 	SSL_CTX_free(ctx);
@@ -170,6 +193,8 @@ static vtm_socket* vtm_socket_tls_alloc(enum vtm_socket_family fam, int sockfd,
 	info->recv_buf_len = 0;
 	info->recv_buf_used = 0;
 	info->send_want_bytes = 0;
+	info->alpn = NULL;
+	info->alpn_len = 0;
 
 	sock->fd = sockfd;
 	sock->family = fam;
@@ -196,6 +221,7 @@ static void vtm_socket_tls_free(struct vtm_socket *sock)
 	if (info->use_buffers)
 		vtm_socket_tls_release_buffers(sock);
 
+	free(info->alpn);
 	free(sock->info);
 	free(sock);
 }
@@ -284,11 +310,15 @@ static int vtm_socket_tls_connect(struct vtm_socket *sock, const char* host, uns
 	int rc;
 	SSL *ssl;
 
+	ssl = vtm_socket_tls_get_ssl(sock);
+
+	/* pending non-blocking connect, handshake starts with first read or write */
 	rc = vtm_socket_util_connect(sock, host, port);
+	if (rc == VTM_E_IO_AGAIN)
+		SSL_set_connect_state(ssl);
 	if (rc != VTM_OK)
 		return rc;
 
-	ssl = vtm_socket_tls_get_ssl(sock);
 	rc = SSL_connect(ssl);
 	if (rc <= 0)
 		return vtm_socket_tls_convert_error(sock, ssl, rc, VTM_TLS_OP_CONNECT);
@@ -448,12 +478,15 @@ static SSL* vtm_socket_tls_get_ssl(struct vtm_socket *sock)
 	return ((struct vtm_socket_tls_info*) sock->info)->ssl;
 }
 
-static SSL_CTX* vtm_socket_tls_create_ctx(struct vtm_socket_tls_opts *opts)
+static SSL_CTX* vtm_socket_tls_create_ctx(struct vtm_socket_tls_opts *opts, unsigned char **alpn, size_t *alpn_len)
 {
 	SSL_CTX *ctx;
 	const SSL_METHOD *method;
 	const char *ciphers;
 
+	*alpn = NULL;
+	*alpn_len = 0;
+
 #if OPENSSL_VERSION_NUMBER >= 0x10100000L
 	method = (opts->is_server) ? TLS_server_method() : TLS_client_method();
 	ctx = SSL_CTX_new(method);
@@ -498,6 +531,27 @@ static SSL_CTX* vtm_socket_tls_create_ctx(struct vtm_socket_tls_opts *opts)
 	SSL_CTX_set_mode(ctx, SSL_MODE_AUTO_RETRY |
 			SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
 
+	/* application layer protocol negotiation */
+	if (opts->alpn) {
+		if (vtm_socket_tls_alpn_wire(opts->alpn, alpn, alpn_len) != VTM_OK) {
+			SSL_CTX_free(ctx);
+			return NULL;
+		}
+
+#ifdef VTM_SOCKET_TLS_HAVE_ALPN
+		/* client list is copied, server list is kept by the socket */
+		if (!opts->is_server) {
+			if (SSL_CTX_set_alpn_protos(ctx, *alpn, (unsigned int) *alpn_len) != 0) {
+				free(*alpn);
+				*alpn = NULL;
+				goto err;
+			}
+			free(*alpn);
+			*alpn = NULL;
+		}
+#endif
+	}
+
 	return ctx;
 
 err:
@@ -507,6 +561,61 @@ err:
 	return NULL;
 }
 
+static int vtm_socket_tls_alpn_wire(const char *list, unsigned char **out, size_t *out_len)
+{
+	const char *begin, *end;
+	unsigned char *wire;
+	size_t len, pos;
+
+	/* "h2,http/1.1" becomes "\x02h2\x08http/1.1" */
+	wire = malloc(strlen(list) + 1);
+	if (!wire) {
+		vtm_err_oom();
+		return vtm_err_get_code();
+	}
+
+	pos = 0;
+	for (begin = list; *begin != '\0'; begin = end) {
+		end = strchr(begin, ',');
+		if (!end)
+			end = begin + strlen(begin);
+
+		len = (size_t) (end - begin);
+		if (len == 0 || len > 255) {
+			free(wire);
+			return vtm_err_set(VTM_E_INVALID_ARG);
+		}
+
+		wire[pos++] = (unsigned char) len;
+		memcpy(wire + pos, begin, len);
+		pos += len;
+
+		if (*end == ',')
+			end++;
+	}
+
+	*out = wire;
+	*out_len = pos;
+
+	return VTM_OK;
+}
+
+#ifdef VTM_SOCKET_TLS_HAVE_ALPN
+static int vtm_socket_tls_alpn_select(SSL *ssl, const unsigned char **out, unsigned char *outlen, const unsigned char *in, unsigned int inlen, void *arg)
+{
+	struct vtm_socket_tls_info *info;
+
+	info = arg;
+
+	/* server preference decides */
+	if (SSL_select_next_proto((unsigned char**) out, outlen, info->alpn,
+		(unsigned int) info->alpn_len, in, inlen) != OPENSSL_NPN_NEGOTIATED)
+		return SSL_TLSEXT_ERR_NOACK;
+
+	return SSL_TLSEXT_ERR_OK;
+}
+#endif
+
 static int vtm_socket_tls_convert_error(struct vtm_socket *sock, SSL *ssl, int code, enum vtm_socket_tls_operation op)
 {
 	int rc;
@@ -628,6 +737,32 @@ static int vtm_socket_tls_set_opt(struct vtm_socket *sock, int opt, const void *
 	return rc;
 }
 
+static int vtm_socket_tls_get_opt(struct vtm_socket *sock, int opt, void *val, size_t len)
+{
+	const unsigned char *proto;
+	unsigned int proto_len;
+
+	if (opt != VTM_SOCK_OPT_TLS_ALPN)
+		return vtm_socket_util_get_opt(sock, opt, val, len);
+
+	proto = NULL;
+	proto_len = 0;
+
+#ifdef VTM_SOCKET_TLS_HAVE_ALPN
+	if (vtm_socket_tls_get_ssl(sock))
+		SSL_get0_alpn_selected(vtm_socket_tls_get_ssl(sock), &proto, &proto_len);
+#endif
+
+	if (len <= proto_len)
+		return VTM_E_INVALID_ARG;
+
+	if (proto_len > 0)
+		memcpy(val, proto, proto_len);
+	((char*) val)[proto_len] = '\0';
+
+	return VTM_OK;
+}
+
 static int vtm_socket_tls_enable_buffers(struct vtm_socket *sock)
 {
 	struct vtm_socket_tls_info *info;
@@ -23,6 +23,7 @@
 
 	#define VTM_SOCK_ERR_AGAIN        EAGAIN
 	#define VTM_SOCK_ERR_WOULDBLOCK   EWOULDBLOCK
+	#define VTM_SOCK_ERR_INPROGRESS   EINPROGRESS
 	#define VTM_SOCK_ERR_CONNABORTED  ECONNABORTED
 	#define VTM_SOCK_ERR_INTR         EINTR
 	#define VTM_SOCK_ERR_MFILE        EMFILE
@@ -276,9 +277,10 @@ int vtm_socket_util_connect(struct vtm_socket *sock, const char *host, unsigned
 	if (rc != VTM_OK)
 		return rc;
 
+	/* non-blocking connect completes when socket becomes writeable */
 	rc = connect(sock->fd, (struct sockaddr*) &saddr.addr, saddr.len);
 	if (VTM_SOCK_ERR(rc))
-		return vtm_socket_util_read_error(sock);
+		return vtm_socket_util_write_error(sock);
 
 	return VTM_OK;
 }
@@ -376,6 +378,9 @@ int vtm_socket_util_error(struct vtm_socket *sock)
 	state = 0;
 
 	switch (err) {
+#ifdef VTM_SOCK_ERR_INPROGRESS
+		case VTM_SOCK_ERR_INPROGRESS:
+#endif
 		case VTM_SOCK_ERR_AGAIN:
 			rc = VTM_E_IO_AGAIN;
 			break;
@@ -9,6 +9,9 @@
 #include <sys/stat.h>
 #include <vtm/core/error.h>
 
+/* forward declaration */
+static void vtm_file_convert_stat(struct stat *buf, struct vtm_file_info *info);
+
 int vtm_file_get_fattr(FILE *fp, int *attr)
 {
 	int fd, hints;
@@ -31,3 +34,49 @@ int vtm_file_get_fattr(FILE *fp, int *attr)
 
 	return VTM_OK;
 }
+
+int vtm_file_seek(FILE *fp, uint64_t offset)
+{
+	if (offset > INT64_MAX || fseeko(fp, (off_t) offset, SEEK_SET) != 0)
+		return VTM_E_IO_UNKNOWN;
+
+	return VTM_OK;
+}
+
+int vtm_file_get_finfo(FILE *fp, struct vtm_file_info *info)
+{
+	struct stat buf;
+
+	if (fstat(fileno(fp), &buf) != 0)
+		return VTM_E_IO_UNKNOWN;
+
+	vtm_file_convert_stat(&buf, info);
+
+	return VTM_OK;
+}
+
+int vtm_file_get_finfo_path(const char *path, struct vtm_file_info *info)
+{
+	struct stat buf;
+
+	if (stat(path, &buf) != 0)
+		return VTM_E_IO_UNKNOWN;
+
+	vtm_file_convert_stat(&buf, info);
+
+	return VTM_OK;
+}
+
+static void vtm_file_convert_stat(struct stat *buf, struct vtm_file_info *info)
+{
+	info->attr = 0;
+
+	if (S_ISDIR(buf->st_mode))
+		info->attr |= VTM_FILE_ATTR_DIR;
+
+	if (S_ISREG(buf->st_mode))
+		info->attr |= VTM_FILE_ATTR_REG;
+
+	info->size = (uint64_t) buf->st_size;
+	info->mtime = (uint64_t) buf->st_mtime;
+}
@@ -27,6 +27,7 @@ struct vtm_socket_listener
 static int vtm_socket_listener_add_closer(vtm_socket_listener *li);
 static int vtm_socket_listener_epoll_ctl(vtm_socket_listener *li, vtm_socket *sock, int op);
 static void vtm_socket_listener_epoll_fill(vtm_socket *sock, struct epoll_event *event);
+static int vtm_socket_listener_wait(vtm_socket_listener *li, struct vtm_socket_event **events, size_t *num_events, int timeout);
 
 vtm_socket_listener* vtm_socket_listener_new(size_t max_events)
 {
@@ -135,13 +136,29 @@ int vtm_socket_listener_rearm(vtm_socket_listener *li, vtm_socket *sock)
 }
 
 int vtm_socket_listener_run(vtm_socket_listener *li, struct vtm_socket_event **events, size_t *num_events)
+{
+	return vtm_socket_listener_wait(li, events, num_events, -1);
+}
+
+int vtm_socket_listener_run_timeout(vtm_socket_listener *li, struct vtm_socket_event **events, size_t *num_events, unsigned long millis)
+{
+	return vtm_socket_listener_wait(li, events, num_events, millis > INT_MAX ? INT_MAX : (int) millis);
+}
+
+int vtm_socket_listener_interrupt(vtm_socket_listener *li)
+{
+	write(li->cfd, (uint64_t[]) {1}, sizeof(uint64_t));
+	return VTM_OK;
+}
+
+static int vtm_socket_listener_wait(vtm_socket_listener *li, struct vtm_socket_event **events, size_t *num_events, int timeout)
 {
 	int i, n, off;
 	unsigned int types;
 	uint64_t buf;
 
 	off = 0;
-	n = epoll_wait(li->efd, li->events, li->num_events, -1);
+	n = epoll_wait(li->efd, li->events, li->num_events, timeout);
 	if (n < 0) {
 		if (errno == EINTR) {
 			n = 0;
@@ -184,12 +201,6 @@ int vtm_socket_listener_run(vtm_socket_listener *li, struct vtm_socket_event **e
 	return VTM_OK;
 }
 
-int vtm_socket_listener_interrupt(vtm_socket_listener *li)
-{
-	write(li->cfd, (uint64_t[]) {1}, sizeof(uint64_t));
-	return VTM_OK;
-}
-
 static int vtm_socket_listener_epoll_ctl(vtm_socket_listener *li, vtm_socket *sock, int op)
 {
 	int rc;
@@ -215,7 +226,7 @@ static int vtm_socket_listener_epoll_ctl(vtm_socket_listener *li, vtm_socket *so
 
 static void vtm_socket_listener_epoll_fill(vtm_socket *sock, struct epoll_event *event)
 {
-	if ((sock->state & VTM_SOCK_STAT_NBL_READ) != 0)
+	if ((sock->state & (VTM_SOCK_STAT_NBL_READ | VTM_SOCK_STAT_READ_PAUSED)) == VTM_SOCK_STAT_NBL_READ)
 		event->events |= EPOLLIN;
 
 	if ((sock->state & VTM_SOCK_STAT_NBL_WRITE) != 0)
@@ -29,6 +29,7 @@ struct vtm_socket_listener
 /* forward declaration */
 static int vtm_socket_listener_add_closer(vtm_socket_listener *li);
 static int vtm_socket_listener_kevent_fill(vtm_socket_listener *li, vtm_socket *sock);
+static int vtm_socket_listener_wait(vtm_socket_listener *li, struct vtm_socket_event **events, size_t *num_events, const struct timespec *timeout);
 
 vtm_socket_listener* vtm_socket_listener_new(size_t max_events)
 {
@@ -158,13 +159,28 @@ int vtm_socket_listener_rearm(vtm_socket_listener *li, vtm_socket *sock)
 }
 
 int vtm_socket_listener_run(vtm_socket_listener *li, struct vtm_socket_event **events, size_t *num_events)
+{
+	return vtm_socket_listener_wait(li, events, num_events, NULL);
+}
+
+int vtm_socket_listener_run_timeout(vtm_socket_listener *li, struct vtm_socket_event **events, size_t *num_events, unsigned long millis)
+{
+	struct timespec ts;
+
+	ts.tv_sec = millis / 1000;
+	ts.tv_nsec = (millis % 1000) * 1000000;
+
+	return vtm_socket_listener_wait(li, events, num_events, &ts);
+}
+
+static int vtm_socket_listener_wait(vtm_socket_listener *li, struct vtm_socket_event **events, size_t *num_events, const struct timespec *timeout)
 {
 	int i, n, off;
 	unsigned int types;
 	char buf;
 
 	off = 0;
-	n = kevent(li->kq, NULL, 0, li->events, li->num_events, NULL);
+	n = kevent(li->kq, NULL, 0, li->events, li->num_events, timeout);
 	if (n < 0) {
 		if (errno == EINTR) {
 			n = 0;
@@ -220,7 +236,7 @@ static int vtm_socket_listener_kevent_fill(vtm_socket_listener *li, vtm_socket *
 	count = 0;
 	vtm_socket_lock(sock);
 
-	if ((sock->state & VTM_SOCK_STAT_NBL_READ) != 0) {
+	if ((sock->state & (VTM_SOCK_STAT_NBL_READ | VTM_SOCK_STAT_READ_PAUSED)) == VTM_SOCK_STAT_NBL_READ) {
 		EV_SET(&events[count], VTM_SOCK_FD(sock), EVFILT_READ, EV_ADD | EV_ONESHOT, 0, 0, sock);
 		count++;
 	}
@@ -13,6 +13,9 @@
 extern int _fileno(FILE*);
 #endif
 
+/* forward declaration */
+static void vtm_file_convert_stat(struct _stat *buf, struct vtm_file_info *info);
+
 int vtm_file_get_fattr(FILE *fp, int *attr)
 {
 	int fd, hints;
@@ -35,3 +38,49 @@ int vtm_file_get_fattr(FILE *fp, int *attr)
 
 	return VTM_OK;
 }
+
+int vtm_file_seek(FILE *fp, uint64_t offset)
+{
+	if (offset > INT64_MAX || _fseeki64(fp, (__int64) offset, SEEK_SET) != 0)
+		return VTM_E_IO_UNKNOWN;
+
+	return VTM_OK;
+}
+
+int vtm_file_get_finfo(FILE *fp, struct vtm_file_info *info)
+{
+	struct _stat buf;
+
+	if (_fstat(_fileno(fp), &buf) != 0)
+		return VTM_E_IO_UNKNOWN;
+
+	vtm_file_convert_stat(&buf, info);
+
+	return VTM_OK;
+}
+
+int vtm_file_get_finfo_path(const char *path, struct vtm_file_info *info)
+{
+	struct _stat buf;
+
+	if (_stat(path, &buf) != 0)
+		return VTM_E_IO_UNKNOWN;
+
+	vtm_file_convert_stat(&buf, info);
+
+	return VTM_OK;
+}
+
+static void vtm_file_convert_stat(struct _stat *buf, struct vtm_file_info *info)
+{
+	info->attr = 0;
+
+	if (buf->st_mode & _S_IFDIR)
+		info->attr |= VTM_FILE_ATTR_DIR;
+
+	if (buf->st_mode & _S_IFREG)
+		info->attr |= VTM_FILE_ATTR_REG;
+
+	info->size = (uint64_t) buf->st_size;
+	info->mtime = (uint64_t) buf->st_mtime;
+}
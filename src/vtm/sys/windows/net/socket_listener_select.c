@@ -154,7 +154,7 @@ static void vtm_socket_listener_select_fill(vtm_socket_listener *li, vtm_socket
 {
 	vtm_socket_lock(sock);
 
-	if ((sock->state & VTM_SOCK_STAT_NBL_READ) != 0)
+	if ((sock->state & (VTM_SOCK_STAT_NBL_READ | VTM_SOCK_STAT_READ_PAUSED)) == VTM_SOCK_STAT_NBL_READ)
 		FD_SET(VTM_SOCK_FD(sock), &li->read_set);
 
 	if ((sock->state & VTM_SOCK_STAT_NBL_WRITE) != 0)
@@ -317,6 +317,12 @@ finish:
 	return rc;
 }
 
+int vtm_socket_listener_run_timeout(vtm_socket_listener *li, struct vtm_socket_event **events, size_t *num_events, unsigned long millis)
+{
+	/* select() is polled with a short timeout anyway */
+	return vtm_socket_listener_run(li, events, num_events);
+}
+
 int vtm_socket_listener_interrupt(vtm_socket_listener *li)
 {
 	return VTM_OK;
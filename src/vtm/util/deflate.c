@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include "deflate.h"
+
+#include <stdlib.h> /* malloc(), free() */
+#include <vtm/core/error.h>
+
+#ifdef VTM_LIB_ZLIB
+
+#include <limits.h> /* UINT_MAX */
+#include <zlib.h>
+
+#define VTM_DEFLATE_OUT_MIN   256
+
+struct vtm_deflate
+{
+	z_stream              strm;
+	enum vtm_deflate_fmt  fmt;
+	bool                  header;
+	uLong                 check;
+	uLong                 total;
+};
+
+/* forward declaration */
+static int vtm_deflate_put_header(vtm_deflate *df, struct vtm_buf *out);
+static int vtm_deflate_put_trailer(vtm_deflate *df, struct vtm_buf *out);
+static void vtm_deflate_put_u32_le(struct vtm_buf *out, uLong val);
+static void vtm_deflate_put_u32_be(struct vtm_buf *out, uLong val);
+
+vtm_deflate* vtm_deflate_new(int level, int window_bits)
+{
+	vtm_deflate *df;
+
+	if (window_bits < 9 || window_bits > 15) {
+		vtm_err_set(VTM_E_INVALID_ARG);
+		return NULL;
+	}
+
+	df = malloc(sizeof(*df));
+	if (!df) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	df->strm.zalloc = Z_NULL;
+	df->strm.zfree = Z_NULL;
+	df->strm.opaque = Z_NULL;
+
+	/* raw stream, framing is added manually so that one state
+	   can produce every format without reinitialization */
+	if (deflateInit2(&df->strm, level, Z_DEFLATED, -window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		free(df);
+		vtm_err_set(VTM_ERROR);
+		return NULL;
+	}
+
+	df->fmt = VTM_DEFLATE_FMT_RAW;
+	df->header = false;
+	df->check = 0;
+	df->total = 0;
+
+	return df;
+}
+
+void vtm_deflate_free(vtm_deflate *df)
+{
+	if (!df)
+		return;
+
+	deflateEnd(&df->strm);
+	free(df);
+}
+
+int vtm_deflate_begin(vtm_deflate *df, enum vtm_deflate_fmt fmt)
+{
+	if (deflateReset(&df->strm) != Z_OK)
+		return vtm_err_set(VTM_ERROR);
+
+	df->fmt = fmt;
+	df->header = (fmt != VTM_DEFLATE_FMT_RAW);
+	df->total = 0;
+
+	switch (fmt) {
+		case VTM_DEFLATE_FMT_ZLIB:
+			df->check = adler32(0L, Z_NULL, 0);
+			break;
+
+		case VTM_DEFLATE_FMT_GZIP:
+			df->check = crc32(0L, Z_NULL, 0);
+			break;
+
+		default:
+			df->check = 0;
+			break;
+	}
+
+	return VTM_OK;
+}
+
+int vtm_deflate_update(vtm_deflate *df, const void *src, size_t len, enum vtm_deflate_flush flush, struct vtm_buf *out)
+{
+	int rc, zflush;
+	const unsigned char *in;
+	uInt chunk;
+	size_t avail;
+
+	if (df->header) {
+		rc = vtm_deflate_put_header(df, out);
+		if (rc != VTM_OK)
+			return rc;
+		df->header = false;
+	}
+
+	in = src;
+
+	/* zlib counts input in uInt */
+	do {
+		chunk = (len > UINT_MAX) ? UINT_MAX : (uInt) len;
+
+		/* checksum functions return their initial value for NULL */
+		if (chunk > 0) {
+			switch (df->fmt) {
+				case VTM_DEFLATE_FMT_ZLIB:
+					df->check = adler32(df->check, in, chunk);
+					break;
+
+				case VTM_DEFLATE_FMT_GZIP:
+					df->check = crc32(df->check, in, chunk);
+					break;
+
+				default:
+					break;
+			}
+			df->total += chunk;
+		}
+
+		zflush = Z_NO_FLUSH;
+		if (chunk == len) {
+			switch (flush) {
+				case VTM_DEFLATE_FLUSH_SYNC:    zflush = Z_SYNC_FLUSH;  break;
+				case VTM_DEFLATE_FLUSH_FINISH:  zflush = Z_FINISH;      break;
+				default:                        break;
+			}
+		}
+
+		df->strm.next_in = (Bytef*) in;
+		df->strm.avail_in = chunk;
+
+		do {
+			/* reserve output space */
+			avail = deflateBound(&df->strm, df->strm.avail_in);
+			if (avail < VTM_DEFLATE_OUT_MIN)
+				avail = VTM_DEFLATE_OUT_MIN;
+			if (avail > UINT_MAX)
+				avail = UINT_MAX;
+
+			rc = vtm_buf_ensure(out, avail);
+			if (rc != VTM_OK)
+				return rc;
+
+			df->strm.next_out = VTM_BUF_PUT_PTR(out);
+			df->strm.avail_out = (uInt) avail;
+
+			rc = deflate(&df->strm, zflush);
+			if (rc == Z_STREAM_ERROR)
+				return vtm_err_set(VTM_ERROR);
+
+			VTM_BUF_PUT_INC(out, avail - df->strm.avail_out);
+		} while (df->strm.avail_out == 0 || (zflush == Z_FINISH && rc != Z_STREAM_END));
+
+		in += chunk;
+		len -= chunk;
+	} while (len > 0);
+
+	if (flush == VTM_DEFLATE_FLUSH_FINISH)
+		return vtm_deflate_put_trailer(df, out);
+
+	return VTM_OK;
+}
+
+static int vtm_deflate_put_header(vtm_deflate *df, struct vtm_buf *out)
+{
+	static const unsigned char gzip_header[] = {
+		0x1f, 0x8b,              /* magic */
+		0x08,                    /* deflate */
+		0x00,                    /* no flags */
+		0x00, 0x00, 0x00, 0x00,  /* no mtime */
+		0x00,                    /* extra flags */
+		0xff                     /* unknown os */
+	};
+
+	static const unsigned char zlib_header[] = {
+		0x78, 0x9c               /* 32K window, default level */
+	};
+
+	switch (df->fmt) {
+		case VTM_DEFLATE_FMT_ZLIB:
+			return vtm_buf_putm(out, zlib_header, sizeof(zlib_header));
+
+		case VTM_DEFLATE_FMT_GZIP:
+			return vtm_buf_putm(out, gzip_header, sizeof(gzip_header));
+
+		default:
+			break;
+	}
+
+	return VTM_OK;
+}
+
+static int vtm_deflate_put_trailer(vtm_deflate *df, struct vtm_buf *out)
+{
+	switch (df->fmt) {
+		case VTM_DEFLATE_FMT_ZLIB:
+			vtm_deflate_put_u32_be(out, df->check);
+			break;
+
+		case VTM_DEFLATE_FMT_GZIP:
+			vtm_deflate_put_u32_le(out, df->check);
+			vtm_deflate_put_u32_le(out, df->total);
+			break;
+
+		default:
+			break;
+	}
+
+	return out->err;
+}
+
+static void vtm_deflate_put_u32_le(struct vtm_buf *out, uLong val)
+{
+	vtm_buf_putc(out, (unsigned char) (val & 0xff));
+	vtm_buf_putc(out, (unsigned char) ((val >> 8) & 0xff));
+	vtm_buf_putc(out, (unsigned char) ((val >> 16) & 0xff));
+	vtm_buf_putc(out, (unsigned char) ((val >> 24) & 0xff));
+}
+
+static void vtm_deflate_put_u32_be(struct vtm_buf *out, uLong val)
+{
+	vtm_buf_putc(out, (unsigned char) ((val >> 24) & 0xff));
+	vtm_buf_putc(out, (unsigned char) ((val >> 16) & 0xff));
+	vtm_buf_putc(out, (unsigned char) ((val >> 8) & 0xff));
+	vtm_buf_putc(out, (unsigned char) (val & 0xff));
+}
+
+#else /* no compression library supported */
+
+vtm_deflate* vtm_deflate_new(int level, int window_bits)
+{
+	vtm_err_set(VTM_E_NOT_SUPPORTED);
+	return NULL;
+}
+
+void vtm_deflate_free(vtm_deflate *df)
+{
+}
+
+int vtm_deflate_begin(vtm_deflate *df, enum vtm_deflate_fmt fmt)
+{
+	return vtm_err_set(VTM_E_NOT_SUPPORTED);
+}
+
+int vtm_deflate_update(vtm_deflate *df, const void *src, size_t len, enum vtm_deflate_flush flush, struct vtm_buf *out)
+{
+	return vtm_err_set(VTM_E_NOT_SUPPORTED);
+}
+
+#endif
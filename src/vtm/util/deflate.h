@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+/**
+ * @file deflate.h
+ *
+ * @brief Streaming DEFLATE compression
+ */
+
+#ifndef VTM_UTIL_DEFLATE_H_
+#define VTM_UTIL_DEFLATE_H_
+
+#include <vtm/core/api.h>
+#include <vtm/core/buffer.h>
+#include <vtm/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VTM_DEFLATE_LEVEL_DEFAULT    -1  /**< default compression level */
+#define VTM_DEFLATE_WINDOW_DEFAULT   15  /**< 32 KiB window */
+
+enum vtm_deflate_fmt
+{
+	VTM_DEFLATE_FMT_RAW,   /**< raw deflate stream without framing */
+	VTM_DEFLATE_FMT_ZLIB,  /**< zlib framing, HTTP "deflate" encoding */
+	VTM_DEFLATE_FMT_GZIP   /**< gzip framing, HTTP "gzip" encoding */
+};
+
+enum vtm_deflate_flush
+{
+	VTM_DEFLATE_FLUSH_NONE,   /**< compressor may keep input internally */
+	VTM_DEFLATE_FLUSH_SYNC,   /**< all pending output is written, stream continues */
+	VTM_DEFLATE_FLUSH_FINISH  /**< stream is completed including trailer */
+};
+
+typedef struct vtm_deflate vtm_deflate;
+
+/**
+ * Creates a new compressor.
+ *
+ * The compressor can be reused for any number of streams, the internal
+ * state is only allocated once.
+ *
+ * @param level the compression level from 1 to 9 or VTM_DEFLATE_LEVEL_DEFAULT
+ * @param window_bits the base two logarithm of the window size from 9 to 15
+ * @return the created compressor
+ * @return NULL if an error occured, VTM_E_NOT_SUPPORTED if the library
+ *         was built without zlib
+ */
+VTM_API vtm_deflate* vtm_deflate_new(int level, int window_bits);
+
+/**
+ * Releases the compressor.
+ *
+ * @param df the compressor that should be released
+ */
+VTM_API void vtm_deflate_free(vtm_deflate *df);
+
+/**
+ * Starts a new stream with given format.
+ *
+ * Any state of a previous stream is discarded.
+ *
+ * @param df the compressor
+ * @param fmt the framing of the compressed stream
+ * @return VTM_OK if the stream was started
+ * @return VTM_ERROR if an error occured
+ */
+VTM_API int vtm_deflate_begin(vtm_deflate *df, enum vtm_deflate_fmt fmt);
+
+/**
+ * Compresses input data and appends the output to a buffer.
+ *
+ * @param df the compressor
+ * @param src the input data, may be NULL if len is zero
+ * @param len length of input data in bytes
+ * @param flush the flush mode
+ * @param out the buffer where the compressed data is appended
+ * @return VTM_OK if the input was consumed
+ * @return VTM_E_MALLOC or VTM_ERROR if an error occured
+ */
+VTM_API int vtm_deflate_update(vtm_deflate *df, const void *src, size_t len, enum vtm_deflate_flush flush, struct vtm_buf *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_UTIL_DEFLATE_H_ */
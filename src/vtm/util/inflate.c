@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include "inflate.h"
+
+#include <stdlib.h> /* malloc(), free() */
+#include <vtm/core/error.h>
+
+#ifdef VTM_LIB_ZLIB
+
+#include <limits.h> /* UINT_MAX */
+#include <zlib.h>
+
+#define VTM_INFLATE_OUT_STEP   16384
+
+struct vtm_inflate
+{
+	z_stream  strm;
+};
+
+vtm_inflate* vtm_inflate_new(int window_bits)
+{
+	vtm_inflate *inf;
+
+	if (window_bits < 8 || window_bits > 15) {
+		vtm_err_set(VTM_E_INVALID_ARG);
+		return NULL;
+	}
+
+	inf = malloc(sizeof(*inf));
+	if (!inf) {
+		vtm_err_oom();
+		return NULL;
+	}
+
+	inf->strm.zalloc = Z_NULL;
+	inf->strm.zfree = Z_NULL;
+	inf->strm.opaque = Z_NULL;
+	inf->strm.next_in = Z_NULL;
+	inf->strm.avail_in = 0;
+
+	if (inflateInit2(&inf->strm, -window_bits) != Z_OK) {
+		free(inf);
+		vtm_err_set(VTM_ERROR);
+		return NULL;
+	}
+
+	return inf;
+}
+
+void vtm_inflate_free(vtm_inflate *inf)
+{
+	if (!inf)
+		return;
+
+	inflateEnd(&inf->strm);
+	free(inf);
+}
+
+int vtm_inflate_reset(vtm_inflate *inf)
+{
+	if (inflateReset(&inf->strm) != Z_OK)
+		return vtm_err_set(VTM_ERROR);
+
+	return VTM_OK;
+}
+
+int vtm_inflate_update(vtm_inflate *inf, const void *src, size_t len, size_t max, struct vtm_buf *out)
+{
+	int rc;
+	const unsigned char *in;
+	uInt chunk;
+	size_t avail, produced;
+
+	in = src;
+	produced = 0;
+
+	/* zlib counts input in uInt */
+	do {
+		chunk = (len > UINT_MAX) ? UINT_MAX : (uInt) len;
+
+		inf->strm.next_in = (Bytef*) in;
+		inf->strm.avail_in = chunk;
+
+		do {
+			/* one byte beyond the limit detects the overflow */
+			avail = max - produced;
+			avail = (avail < VTM_INFLATE_OUT_STEP) ? avail + 1 : VTM_INFLATE_OUT_STEP;
+
+			rc = vtm_buf_ensure(out, avail);
+			if (rc != VTM_OK)
+				return rc;
+
+			inf->strm.next_out = VTM_BUF_PUT_PTR(out);
+			inf->strm.avail_out = (uInt) avail;
+
+			rc = inflate(&inf->strm, Z_SYNC_FLUSH);
+
+			VTM_BUF_PUT_INC(out, avail - inf->strm.avail_out);
+			produced += avail - inf->strm.avail_out;
+
+			switch (rc) {
+				case Z_OK:
+				case Z_BUF_ERROR:
+					break;
+
+				case Z_STREAM_END:
+					/* final block, following data starts a new stream */
+					if (inflateReset(&inf->strm) != Z_OK)
+						return vtm_err_set(VTM_ERROR);
+					break;
+
+				case Z_MEM_ERROR:
+					vtm_err_oom();
+					return vtm_err_get_code();
+
+				default:
+					return vtm_err_set(VTM_E_IO_PROTOCOL);
+			}
+
+			if (produced > max)
+				return vtm_err_set(VTM_E_MAX_REACHED);
+		} while (inf->strm.avail_in > 0 || inf->strm.avail_out == 0);
+
+		in += chunk;
+		len -= chunk;
+	} while (len > 0);
+
+	return VTM_OK;
+}
+
+#else /* no compression library supported */
+
+vtm_inflate* vtm_inflate_new(int window_bits)
+{
+	vtm_err_set(VTM_E_NOT_SUPPORTED);
+	return NULL;
+}
+
+void vtm_inflate_free(vtm_inflate *inf)
+{
+}
+
+int vtm_inflate_reset(vtm_inflate *inf)
+{
+	return vtm_err_set(VTM_E_NOT_SUPPORTED);
+}
+
+int vtm_inflate_update(vtm_inflate *inf, const void *src, size_t len, size_t max, struct vtm_buf *out)
+{
+	return vtm_err_set(VTM_E_NOT_SUPPORTED);
+}
+
+#endif
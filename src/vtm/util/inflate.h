@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+/**
+ * @file inflate.h
+ *
+ * @brief Streaming DEFLATE decompression
+ */
+
+#ifndef VTM_UTIL_INFLATE_H_
+#define VTM_UTIL_INFLATE_H_
+
+#include <vtm/core/api.h>
+#include <vtm/core/buffer.h>
+#include <vtm/core/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct vtm_inflate vtm_inflate;
+
+/**
+ * Creates a new decompressor for raw deflate streams.
+ *
+ * The memory for the window is only allocated when the first
+ * compressed block needs it.
+ *
+ * @param window_bits the base two logarithm of the largest window
+ *        that the stream may use, from 8 to 15
+ * @return the created decompressor
+ * @return NULL if an error occured, VTM_E_NOT_SUPPORTED if the library
+ *         was built without zlib
+ */
+VTM_API vtm_inflate* vtm_inflate_new(int window_bits);
+
+/**
+ * Releases the decompressor.
+ *
+ * @param inf the decompressor that should be released
+ */
+VTM_API void vtm_inflate_free(vtm_inflate *inf);
+
+/**
+ * Discards the window of the previous data, so that the following
+ * input is decompressed as new stream.
+ *
+ * @param inf the decompressor
+ * @return VTM_OK if the decompressor was reset
+ * @return VTM_ERROR if an error occured
+ */
+VTM_API int vtm_inflate_reset(vtm_inflate *inf);
+
+/**
+ * Decompresses input data and appends the output to a buffer.
+ *
+ * The input does not need to end at a block boundary, the remaining
+ * bits are kept for the next call. A completed stream is followed by
+ * a new one.
+ *
+ * @param inf the decompressor
+ * @param src the compressed data, may be NULL if len is zero
+ * @param len length of compressed data in bytes
+ * @param max maximum number of bytes appended to the buffer
+ * @param out the buffer where the decompressed data is appended
+ * @return VTM_OK if the input was consumed
+ * @return VTM_E_MAX_REACHED if the output exceeds max bytes
+ * @return VTM_E_IO_PROTOCOL if the input is not a valid deflate stream
+ * @return VTM_E_MALLOC or VTM_ERROR if an error occured
+ */
+VTM_API int vtm_inflate_update(vtm_inflate *inf, const void *src, size_t len, size_t max, struct vtm_buf *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VTM_UTIL_INFLATE_H_ */
@@ -9,31 +9,39 @@
 
 int vtm_date_now_utc(struct vtm_date *date)
 {
-	time_t time_now;
-	struct tm *now;
+	return vtm_date_from_ts((uint64_t) time(NULL), date);
+}
+
+int vtm_date_from_ts(uint64_t ts, struct vtm_date *date)
+{
+	time_t time_ts;
+	struct tm *tm;
 
-	time_now = time(NULL);
+	time_ts = (time_t) ts;
 
 #ifdef VTM_SYS_WINDOWS
-	now = gmtime(&time_now);
+	tm = gmtime(&time_ts);
 #elif VTM_HAVE_POSIX
 	struct tm result;
-	now = gmtime_r(&time_now, &result);
+	tm = gmtime_r(&time_ts, &result);
 #else
 	#error need thread safe solution here
 #endif
 
-	date->year = 1900 + now->tm_year;
-	date->month = now->tm_mon;
-	date->day_of_week = now->tm_wday == 0 ? 6 : now->tm_wday - 1;
-	date->day_of_month = now->tm_mday;
-	date->day_of_year = now->tm_yday;
+	if (!tm)
+		return vtm_err_set(VTM_E_INVALID_ARG);
+
+	date->year = 1900 + tm->tm_year;
+	date->month = tm->tm_mon;
+	date->day_of_week = tm->tm_wday == 0 ? 6 : tm->tm_wday - 1;
+	date->day_of_month = tm->tm_mday;
+	date->day_of_year = tm->tm_yday;
 
-	date->hour = now->tm_hour;
-	date->minute = now->tm_min;
-	date->second = now->tm_sec;
+	date->hour = tm->tm_hour;
+	date->minute = tm->tm_min;
+	date->second = tm->tm_sec;
 
-	date->ts = time_now;
+	date->ts = ts;
 
 	return VTM_OK;
 }
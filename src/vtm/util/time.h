@@ -41,6 +41,16 @@ struct vtm_date
  */
 VTM_API int vtm_date_now_utc(struct vtm_date *date);
 
+/**
+ * Converts a timestamp to a date in UTC.
+ *
+ * @param ts seconds since 1970-01-01 UTC
+ * @param[out] date the date structure that is filled
+ * @return VTM_OK if call succeeded
+ * @return VTM_E_INVALID_ARG if the timestamp cannot be converted
+ */
+VTM_API int vtm_date_from_ts(uint64_t ts, struct vtm_date *date);
+
 /**
  * Get current timestamp in milliseconds.
  *
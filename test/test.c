@@ -16,6 +16,7 @@ extern void test_vtm_core_map(void);
 extern void test_vtm_core_variant(void);
 extern void test_vtm_core_dataset(void);
 extern void test_vtm_core_format(void);
+extern void test_vtm_core_utf8(void);
 
 void test_core(void)
 {
@@ -23,6 +24,7 @@ void test_core(void)
 	vtm_test_run(test_vtm_core_blob);
 	vtm_test_run(test_vtm_core_format);
 	vtm_test_run(test_vtm_core_string);
+	vtm_test_run(test_vtm_core_utf8);
 	vtm_test_run(test_vtm_core_list);
 	vtm_test_run(test_vtm_core_map);
 	vtm_test_run(test_vtm_core_elem);
@@ -57,12 +59,22 @@ void test_fs(void)
 }
 
 /* net */
+extern void test_vtm_net_http2(void);
+extern void test_vtm_net_http_access_log(void);
+extern void test_vtm_net_http_form(void);
+extern void test_vtm_net_http_memory(void);
+extern void test_vtm_net_http_ratelimit(void);
+extern void test_vtm_net_http_metrics(void);
+extern void test_vtm_net_http_router(void);
 extern void test_vtm_net_http_server(void);
 extern void test_vtm_net_nm_dgram(void);
 extern void test_vtm_net_nm_stream(void);
 extern void test_vtm_net_nm_stream_mt(void);
 extern void test_vtm_net_socket(void);
 extern void test_vtm_net_url(void);
+extern void test_vtm_net_ws_deflate(void);
+extern void test_vtm_net_ws_frame(void);
+extern void test_vtm_net_ws_parser(void);
 
 void test_net(void)
 {
@@ -72,7 +84,17 @@ void test_net(void)
 	vtm_test_run(test_vtm_net_nm_dgram);
 	vtm_test_run(test_vtm_net_nm_stream);
 	vtm_test_run(test_vtm_net_nm_stream_mt);
+	vtm_test_run(test_vtm_net_http2);
+	vtm_test_run(test_vtm_net_http_access_log);
+	vtm_test_run(test_vtm_net_http_form);
+	vtm_test_run(test_vtm_net_http_memory);
+	vtm_test_run(test_vtm_net_http_ratelimit);
+	vtm_test_run(test_vtm_net_http_metrics);
+	vtm_test_run(test_vtm_net_http_router);
 	vtm_test_run(test_vtm_net_http_server);
+	vtm_test_run(test_vtm_net_ws_frame);
+	vtm_test_run(test_vtm_net_ws_parser);
+	vtm_test_run(test_vtm_net_ws_deflate);
 }
 
 /* sql */
@@ -99,6 +121,7 @@ void test_sql(void)
 
 /* util */
 extern void test_vtm_util_base64(void);
+extern void test_vtm_util_deflate(void);
 extern void test_vtm_util_thread(void);
 extern void test_vtm_util_serialization(void);
 extern void test_vtm_util_spinlock(void);
@@ -107,6 +130,7 @@ void test_util(void)
 {
 	vtm_test_set_module("util");
 	vtm_test_run(test_vtm_util_base64);
+	vtm_test_run(test_vtm_util_deflate);
 	vtm_test_run(test_vtm_util_thread);
 	vtm_test_run(test_vtm_util_serialization);
 	vtm_test_run(test_vtm_util_spinlock);
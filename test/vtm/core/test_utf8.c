@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include <vtf.h>
+
+#include <string.h> /* memcpy(), memset(), strlen() */
+#include <vtm/core/utf8.h>
+
+#define TEST_UTF8_PAD_MAX    40
+#define TEST_UTF8_FUZZ_RUNS  3000
+#define TEST_UTF8_FUZZ_LEN   300
+
+struct test_utf8_case
+{
+	const char  *data;
+	bool        valid;
+};
+
+static const struct test_utf8_case test_utf8_cases[] = {
+	{"", true},
+	{"plain ASCII", true},
+	{"\xc3\xa4\xc3\xb6\xc3\xbc", true},                /* umlauts */
+	{"\xe2\x82\xac 10", true},                        /* euro sign */
+	{"\xf0\x9f\x98\x80", true},                       /* emoji */
+	{"\xed\x9f\xbf", true},                           /* U+D7FF */
+	{"\xee\x80\x80", true},                           /* U+E000 */
+	{"\xef\xbf\xbf", true},                           /* U+FFFF */
+	{"\xf4\x8f\xbf\xbf", true},                       /* U+10FFFF */
+	{"\x80", false},                                  /* lone continuation */
+	{"a\xbf", false},
+	{"\xc0\xaf", false},                              /* overlong slash */
+	{"\xc1\xbf", false},
+	{"\xe0\x9f\xbf", false},                          /* overlong 3 bytes */
+	{"\xf0\x8f\xbf\xbf", false},                      /* overlong 4 bytes */
+	{"\xed\xa0\x80", false},                          /* surrogate */
+	{"\xed\xbf\xbf", false},
+	{"\xf4\x90\x80\x80", false},                      /* above U+10FFFF */
+	{"\xf5\x80\x80\x80", false},
+	{"\xff", false},
+	{"\xc3", false},                                  /* truncated */
+	{"\xe2\x82", false},
+	{"\xf0\x9f\x98", false},
+	{"\xc3\x28", false},                              /* ASCII after lead */
+	{"\xe2\x28\xa1", false},
+	{"\xf0\x9f\x98\x80\x80", false},                  /* continuation too many */
+	{"\xe2\x82\xac\xe2\x82", false}
+};
+
+/* decodes code points, independent of the table based validation */
+static bool test_utf8_ref(const unsigned char *p, size_t len)
+{
+	size_t i, k, n;
+	uint32_t cp;
+
+	for (i=0; i < len; i += n) {
+		if (p[i] < 0x80) {
+			n = 1;
+			continue;
+		}
+		else if ((p[i] & 0xe0) == 0xc0) {
+			n = 2;
+			cp = p[i] & 0x1f;
+		}
+		else if ((p[i] & 0xf0) == 0xe0) {
+			n = 3;
+			cp = p[i] & 0x0f;
+		}
+		else if ((p[i] & 0xf8) == 0xf0) {
+			n = 4;
+			cp = p[i] & 0x07;
+		}
+		else {
+			return false;
+		}
+
+		if (len - i < n)
+			return false;
+
+		for (k=1; k < n; k++) {
+			if ((p[i+k] & 0xc0) != 0x80)
+				return false;
+			cp = (cp << 6) | (p[i+k] & 0x3f);
+		}
+
+		if ((n == 2 && cp < 0x80) || (n == 3 && cp < 0x800) || (n == 4 && cp < 0x10000))
+			return false;
+		if (cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff))
+			return false;
+	}
+
+	return true;
+}
+
+static bool test_utf8_split(const unsigned char *p, size_t len, size_t step)
+{
+	struct vtm_utf8_state st;
+	size_t i, n;
+
+	vtm_utf8_init(&st);
+
+	for (i=0; i + step < len; i += step) {
+		if (!vtm_utf8_validate(&st, p + i, step, false))
+			return false;
+	}
+	n = len - i;
+
+	return vtm_utf8_validate(&st, p + i, n, true);
+}
+
+static void test_utf8_cases_padded(void)
+{
+	size_t i, pre, post, len;
+	unsigned char buf[2 * TEST_UTF8_PAD_MAX + 16];
+	bool ok;
+
+	ok = true;
+	for (i=0; i < sizeof(test_utf8_cases) / sizeof(test_utf8_cases[0]); i++) {
+		len = strlen(test_utf8_cases[i].data);
+		if (vtm_utf8_is_valid(test_utf8_cases[i].data, len) != test_utf8_cases[i].valid ||
+			test_utf8_ref((const unsigned char*) test_utf8_cases[i].data, len) != test_utf8_cases[i].valid) {
+			ok = false;
+			break;
+		}
+
+		/* at every position of the vector blocks */
+		for (pre=0; pre <= TEST_UTF8_PAD_MAX && ok; pre++) {
+			for (post=0; post <= TEST_UTF8_PAD_MAX && ok; post++) {
+				memset(buf, 'x', pre);
+				memcpy(buf + pre, test_utf8_cases[i].data, len);
+				memset(buf + pre + len, 'y', post);
+				ok = vtm_utf8_is_valid(buf, pre + len + post) == test_utf8_cases[i].valid;
+			}
+		}
+	}
+	VTM_TEST_CHECK(ok, "utf8 cases");
+
+	/* lead at the end of a block waits for the next one */
+	memset(buf, 'x', sizeof(buf));
+	memcpy(buf + 15, "\xf0\x9f\x98\x80", 4);
+	memcpy(buf + 31, "\xe2\x82\xac", 3);
+	memcpy(buf + 63, "\xc3\xa4", 2);
+	VTM_TEST_CHECK(vtm_utf8_is_valid(buf, sizeof(buf)), "utf8 across blocks");
+	buf[33] = 'z';
+	VTM_TEST_CHECK(!vtm_utf8_is_valid(buf, sizeof(buf)), "utf8 truncated across blocks");
+	VTM_TEST_CHECK(!vtm_utf8_is_valid(buf, 32), "utf8 truncated at end");
+}
+
+static size_t test_utf8_random_text(unsigned char *buf, size_t size, uint32_t *seed)
+{
+	size_t len;
+	uint32_t cp;
+
+	len = 0;
+	while (len + 4 <= size) {
+		*seed = *seed * 1103515245 + 12345;
+		switch ((*seed >> 16) % 6) {
+			case 0:
+			case 1:
+				buf[len++] = 0x20 + (*seed >> 8) % 0x5f;
+				break;
+
+			case 2:
+				cp = 0x80 + (*seed >> 4) % 0x780;
+				buf[len++] = 0xc0 | (cp >> 6);
+				buf[len++] = 0x80 | (cp & 0x3f);
+				break;
+
+			case 3:
+			case 4:
+				cp = 0x800 + (*seed >> 4) % 0xf800;
+				if (cp >= 0xd800 && cp <= 0xdfff)
+					cp -= 0x800;
+				buf[len++] = 0xe0 | (cp >> 12);
+				buf[len++] = 0x80 | ((cp >> 6) & 0x3f);
+				buf[len++] = 0x80 | (cp & 0x3f);
+				break;
+
+			default:
+				cp = 0x10000 + (*seed >> 4) % 0x100000;
+				buf[len++] = 0xf0 | (cp >> 18);
+				buf[len++] = 0x80 | ((cp >> 12) & 0x3f);
+				buf[len++] = 0x80 | ((cp >> 6) & 0x3f);
+				buf[len++] = 0x80 | (cp & 0x3f);
+				break;
+		}
+	}
+
+	return len;
+}
+
+static void test_utf8_fuzz(void)
+{
+	unsigned char buf[TEST_UTF8_FUZZ_LEN];
+	size_t len, pos;
+	uint32_t seed;
+	unsigned int i, invalid;
+	bool ok, expected;
+
+	seed = 42;
+	invalid = 0;
+	ok = true;
+
+	for (i=0; i < TEST_UTF8_FUZZ_RUNS && ok; i++) {
+		len = test_utf8_random_text(buf, i % (TEST_UTF8_FUZZ_LEN - 4) + 4, &seed);
+
+		/* replace a random byte in most runs */
+		if (i % 4 != 0 && len > 0) {
+			seed = seed * 1103515245 + 12345;
+			pos = (seed >> 8) % len;
+			buf[pos] = (unsigned char) (seed >> 20);
+		}
+
+		expected = test_utf8_ref(buf, len);
+		if (!expected)
+			invalid++;
+
+		ok = vtm_utf8_is_valid(buf, len) == expected &&
+			test_utf8_split(buf, len, 1 + i % 7) == expected;
+	}
+
+	VTM_TEST_CHECK(ok, "utf8 fuzz matches reference");
+	VTM_TEST_CHECK(invalid > TEST_UTF8_FUZZ_RUNS / 4, "utf8 fuzz invalid inputs");
+}
+
+static void test_utf8_incremental(void)
+{
+	struct vtm_utf8_state st;
+	const char *text;
+	size_t i, len;
+	bool ok;
+
+	/* every split of a sequence */
+	text = "a\xf0\x9f\x98\x80 \xe2\x82\xac \xc3\xa4 b";
+	len = strlen(text);
+	ok = true;
+	for (i=0; i <= len && ok; i++) {
+		vtm_utf8_init(&st);
+		ok = vtm_utf8_validate(&st, text, i, false) &&
+			vtm_utf8_validate(&st, text + i, len - i, true);
+	}
+	VTM_TEST_CHECK(ok, "utf8 incremental splits");
+	VTM_TEST_CHECK(test_utf8_split((const unsigned char*) text, len, 1), "utf8 incremental bytes");
+
+	/* incomplete at the end */
+	vtm_utf8_init(&st);
+	VTM_TEST_CHECK(vtm_utf8_validate(&st, "x\xe2\x82", 3, false), "utf8 incremental pending");
+	VTM_TEST_CHECK(vtm_utf8_validate(&st, "", 0, false), "utf8 incremental empty part");
+	VTM_TEST_CHECK(!vtm_utf8_validate(&st, "", 0, true), "utf8 incremental truncated");
+
+	/* invalid beginnings fail early */
+	vtm_utf8_init(&st);
+	VTM_TEST_CHECK(!vtm_utf8_validate(&st, "x\xed\xa0", 3, false), "utf8 incremental surrogate");
+	vtm_utf8_init(&st);
+	VTM_TEST_CHECK(vtm_utf8_validate(&st, "\xf4", 1, false), "utf8 incremental lead");
+	VTM_TEST_CHECK(!vtm_utf8_validate(&st, "\x90", 1, false), "utf8 incremental too large");
+}
+
+extern void test_vtm_core_utf8(void)
+{
+	VTM_TEST_LABEL("utf8");
+	test_utf8_cases_padded();
+	test_utf8_fuzz();
+	test_utf8_incremental();
+}
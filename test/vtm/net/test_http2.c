@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include <vtf.h>
+
+#include <stdio.h> /* sscanf() */
+#include <string.h> /* memcmp(), strcmp(), strlen() */
+#include <vtm/core/buffer.h>
+#include <vtm/core/error.h>
+#include <vtm/net/http/http2_hpack_intl.h>
+
+#define TEST_HPACK_MAX_HEADERS  65536
+
+/* RFC 7541 C.4, requests with huffman coding */
+static const char *test_c4_blocks[] = {
+	"8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff",
+	"8286 84be 5886 a8eb 1064 9cbf",
+	"8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf"
+};
+
+static const char *test_c4_fields[] = {
+	":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\n",
+	":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\n"
+		"cache-control: no-cache\n",
+	":method: GET\n:scheme: https\n:path: /index.html\n:authority: www.example.com\n"
+		"custom-key: custom-value\n"
+};
+
+static const size_t test_c4_sizes[] = {57, 110, 164};
+
+/* RFC 7541 C.6, responses with huffman coding and eviction */
+static const char *test_c6_blocks[] = {
+	"4882 6402 5885 aec3 771a 4b61 96d0 7abe 9410 54d4 44a8 2005 9504 0b81 66e0 82a6"
+	"2d1b ff6e 919d 29ad 1718 63c7 8f0b 97c8 e9ae 82ae 43d3",
+	"4883 640e ffc1 c0bf",
+	"88c1 6196 d07a be94 1054 d444 a820 0595 040b 8166 e084 a62d 1bff c05a 839b d9ab"
+	"77ad 94e7 821d d7f2 e6c7 b335 dfdf cd5b 3960 d5af 2708 7f36 72c1 ab27 0fb5 291f"
+	"9587 3160 65c0 03ed 4ee5 b106 3d50 07"
+};
+
+static const char *test_c6_fields[] = {
+	":status: 302\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:21 GMT\n"
+		"location: https://www.example.com\n",
+	":status: 307\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:21 GMT\n"
+		"location: https://www.example.com\n",
+	":status: 200\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:22 GMT\n"
+		"location: https://www.example.com\ncontent-encoding: gzip\n"
+		"set-cookie: foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1\n"
+};
+
+static const size_t test_c6_sizes[] = {222, 222, 215};
+
+static size_t test_hex(const char *hex, unsigned char *out)
+{
+	size_t len;
+
+	len = 0;
+	while (*hex != '\0') {
+		if (*hex == ' ') {
+			hex++;
+			continue;
+		}
+		sscanf(hex, "%2hhx", &out[len++]);
+		hex += 2;
+	}
+
+	return len;
+}
+
+static int test_collect(void *arg, const char *name, size_t name_len, const char *value, size_t value_len)
+{
+	struct vtm_buf *buf;
+
+	buf = arg;
+	vtm_buf_puts(buf, name);
+	vtm_buf_puts(buf, ": ");
+	vtm_buf_puts(buf, value);
+	vtm_buf_putc(buf, '\n');
+
+	return buf->err;
+}
+
+static bool test_fields_eq(struct vtm_buf *buf, const char *expected)
+{
+	return buf->used == strlen(expected) &&
+		memcmp(buf->data, expected, buf->used) == 0;
+}
+
+static void test_hpack_decode(const char **blocks, const char **fields, const size_t *sizes, size_t table_size, const char *name)
+{
+	int i, rc;
+	size_t len;
+	unsigned char data[256];
+	struct vtm_http2_hpack hp;
+	struct vtm_buf scratch;
+	struct vtm_buf out;
+
+	vtm_buf_init(&scratch, VTM_BYTEORDER_LE);
+	vtm_buf_init(&out, VTM_BYTEORDER_LE);
+	vtm_http2_hpack_init(&hp, table_size);
+
+	for (i=0; i < 3; i++) {
+		vtm_buf_clear(&out);
+		len = test_hex(blocks[i], data);
+
+		rc = vtm_http2_hpack_decode(&hp, data, len, TEST_HPACK_MAX_HEADERS,
+			&scratch, test_collect, &out);
+		VTM_TEST_CHECK(rc == VTM_OK, name);
+		VTM_TEST_CHECK(test_fields_eq(&out, fields[i]), "hpack decoded fields");
+		VTM_TEST_CHECK(hp.size == sizes[i], "hpack dynamic table size");
+	}
+
+	vtm_http2_hpack_release(&hp);
+	vtm_buf_release(&out);
+	vtm_buf_release(&scratch);
+}
+
+static void test_hpack_invalid(void)
+{
+	int rc;
+	size_t len;
+	unsigned char data[64];
+	struct vtm_http2_hpack hp;
+	struct vtm_buf scratch;
+	struct vtm_buf out;
+
+	vtm_buf_init(&scratch, VTM_BYTEORDER_LE);
+	vtm_buf_init(&out, VTM_BYTEORDER_LE);
+	vtm_http2_hpack_init(&hp, VTM_HTTP2_HPACK_TABLE_SIZE);
+
+	/* index beyond static and dynamic table */
+	len = test_hex("be", data);
+	rc = vtm_http2_hpack_decode(&hp, data, len, TEST_HPACK_MAX_HEADERS,
+		&scratch, test_collect, &out);
+	VTM_TEST_CHECK(rc != VTM_OK, "hpack invalid index");
+
+	/* literal value longer than block */
+	len = test_hex("4088 25a8 49e9", data);
+	rc = vtm_http2_hpack_decode(&hp, data, len, TEST_HPACK_MAX_HEADERS,
+		&scratch, test_collect, &out);
+	VTM_TEST_CHECK(rc != VTM_OK, "hpack truncated literal");
+
+	/* table size update above limit */
+	len = test_hex("3fe2 1f", data);
+	rc = vtm_http2_hpack_decode(&hp, data, len, TEST_HPACK_MAX_HEADERS,
+		&scratch, test_collect, &out);
+	VTM_TEST_CHECK(rc != VTM_OK, "hpack table size above limit");
+
+	vtm_http2_hpack_release(&hp);
+	vtm_buf_release(&out);
+	vtm_buf_release(&scratch);
+}
+
+static void test_hpack_encode(void)
+{
+	int i, rc;
+	size_t len;
+	struct vtm_http2_hpack enc;
+	struct vtm_http2_hpack dec;
+	struct vtm_buf scratch;
+	struct vtm_buf block;
+	struct vtm_buf out;
+	static const char expected[] = ":status: 200\nserver: ventanium\n"
+		"content-type: text/html; charset=utf-8\nset-cookie: id=1\n";
+
+	vtm_buf_init(&scratch, VTM_BYTEORDER_LE);
+	vtm_buf_init(&block, VTM_BYTEORDER_LE);
+	vtm_buf_init(&out, VTM_BYTEORDER_LE);
+	vtm_http2_hpack_init(&enc, VTM_HTTP2_HPACK_TABLE_SIZE);
+	vtm_http2_hpack_init(&dec, VTM_HTTP2_HPACK_TABLE_SIZE);
+
+	len = 0;
+	for (i=0; i < 2; i++) {
+		vtm_buf_clear(&block);
+		vtm_buf_clear(&out);
+
+		vtm_http2_hpack_encode_begin(&enc, &block);
+		vtm_http2_hpack_encode(&enc, &block, ":status", 7, "200", 3, VTM_HTTP2_HPACK_INDEX);
+		vtm_http2_hpack_encode(&enc, &block, "server", 6, "ventanium", 9, VTM_HTTP2_HPACK_INDEX);
+		vtm_http2_hpack_encode(&enc, &block, "content-type", 12,
+			"text/html; charset=utf-8", 24, VTM_HTTP2_HPACK_INDEX);
+		vtm_http2_hpack_encode(&enc, &block, "set-cookie", 10, "id=1", 4, VTM_HTTP2_HPACK_NEVER_INDEX);
+		VTM_TEST_CHECK(block.err == VTM_OK, "hpack encode");
+
+		rc = vtm_http2_hpack_decode(&dec, block.data, block.used, TEST_HPACK_MAX_HEADERS,
+			&scratch, test_collect, &out);
+		VTM_TEST_CHECK(rc == VTM_OK, "hpack decode encoded block");
+		VTM_TEST_CHECK(test_fields_eq(&out, expected), "hpack encoded fields");
+
+		/* second block refers to dynamic table */
+		if (i == 1)
+			VTM_TEST_CHECK(block.used < len, "hpack encoder uses dynamic table");
+		len = block.used;
+	}
+
+	/* shrinking the table must be announced to the decoder */
+	vtm_http2_hpack_set_limit(&enc, 0);
+	vtm_buf_clear(&block);
+	vtm_buf_clear(&out);
+	vtm_http2_hpack_encode_begin(&enc, &block);
+	vtm_http2_hpack_encode(&enc, &block, "server", 6, "ventanium", 9, VTM_HTTP2_HPACK_INDEX);
+
+	rc = vtm_http2_hpack_decode(&dec, block.data, block.used, TEST_HPACK_MAX_HEADERS,
+		&scratch, test_collect, &out);
+	VTM_TEST_CHECK(rc == VTM_OK, "hpack decode after table size update");
+	VTM_TEST_CHECK(dec.size == 0, "hpack decoder table evicted");
+
+	vtm_http2_hpack_release(&dec);
+	vtm_http2_hpack_release(&enc);
+	vtm_buf_release(&out);
+	vtm_buf_release(&block);
+	vtm_buf_release(&scratch);
+}
+
+static void test_huffman(void)
+{
+	int rc;
+	struct vtm_buf enc;
+	struct vtm_buf dec;
+	unsigned char input[256];
+	size_t i;
+
+	vtm_buf_init(&enc, VTM_BYTEORDER_LE);
+	vtm_buf_init(&dec, VTM_BYTEORDER_LE);
+
+	for (i=0; i < sizeof(input); i++)
+		input[i] = (unsigned char) i;
+
+	rc = vtm_http2_huff_encode(input, sizeof(input), &enc);
+	VTM_TEST_CHECK(rc == VTM_OK, "huffman encode");
+	VTM_TEST_CHECK(enc.used == vtm_http2_huff_encoded_len(input, sizeof(input)),
+		"huffman encoded length");
+
+	rc = vtm_http2_huff_decode(enc.data, enc.used, &dec);
+	VTM_TEST_CHECK(rc == VTM_OK, "huffman decode");
+	VTM_TEST_CHECK(dec.used == sizeof(input) &&
+		memcmp(dec.data, input, sizeof(input)) == 0, "huffman roundtrip");
+
+	/* padding longer than 7 bits */
+	rc = vtm_http2_huff_decode((const unsigned char*) "\xff\xff", 2, &dec);
+	VTM_TEST_CHECK(rc != VTM_OK, "huffman invalid padding");
+
+	vtm_buf_release(&dec);
+	vtm_buf_release(&enc);
+}
+
+extern void test_vtm_net_http2(void)
+{
+	VTM_TEST_LABEL("http2");
+	test_hpack_decode(test_c4_blocks, test_c4_fields, test_c4_sizes,
+		VTM_HTTP2_HPACK_TABLE_SIZE, "hpack decode requests");
+	test_hpack_decode(test_c6_blocks, test_c6_fields, test_c6_sizes,
+		256, "hpack decode responses");
+	test_hpack_invalid();
+	test_hpack_encode();
+	test_huffman();
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include <vtf.h>
+
+#include <stdio.h> /* remove() */
+#include <stdlib.h> /* free() */
+#include <string.h> /* memset(), strcmp(), strcpy(), strlen() */
+#include <vtm/core/error.h>
+#include <vtm/fs/file.h>
+#include <vtm/net/socket_addr.h>
+#include <vtm/net/http/http_access_log_intl.h>
+
+#define TEST_ACCESS_LOG_FILE     "test_access_log.txt"
+#define TEST_ACCESS_LOG_RECORDS  1000
+
+static void test_fill(struct vtm_http_access_rec *rec, uint64_t time, const char *path)
+{
+	struct vtm_socket_addr addr;
+
+	addr.family = VTM_SOCK_FAM_IN4;
+	addr.host = "127.0.0.1";
+	addr.port = 8080;
+
+	memset(&rec->peer, 0, sizeof(rec->peer));
+	vtm_socket_os_addr_build(&rec->peer, &addr);
+
+	rec->time = time;
+	rec->duration = 157;
+	rec->bytes = 2326;
+	rec->status = 200;
+	rec->method = VTM_HTTP_METHOD_GET;
+	rec->version = VTM_HTTP_VER_1_1;
+	strcpy(rec->path, path);
+}
+
+static void test_log(void)
+{
+	int rc;
+	unsigned int i, committed, failed, lines;
+	bool first_ok;
+	FILE *fp;
+	char *line;
+	size_t line_len;
+	vtm_http_access_log *log;
+	vtm_http_access_ring *ring;
+	struct vtm_http_access_rec *rec;
+	struct vtm_http_access_log_opts opts;
+
+	remove(TEST_ACCESS_LOG_FILE);
+
+	memset(&opts, 0, sizeof(opts));
+	opts.path = TEST_ACCESS_LOG_FILE;
+	opts.ring_size = 3;
+	opts.flush_interval = 60000;
+
+	log = vtm_http_access_log_new(&opts);
+	VTM_TEST_ASSERT(log != NULL, "access log new");
+
+	ring = vtm_http_access_log_add_ring(log);
+	VTM_TEST_ASSERT(ring != NULL, "access log ring");
+
+	/* worker is faster than the log thread, so the small ring overflows */
+	committed = 0;
+	failed = 0;
+	for (i=0; i < TEST_ACCESS_LOG_RECORDS; i++) {
+		rec = vtm_http_access_ring_acquire(ring);
+		if (!rec) {
+			failed++;
+			continue;
+		}
+		test_fill(rec, 1571406936000000ULL, "/a\"b");
+		vtm_http_access_ring_commit(ring);
+		committed++;
+	}
+
+	VTM_TEST_CHECK(committed >= 4, "access log ring rounded up");
+	VTM_TEST_CHECK(failed > 0, "access log full ring drops");
+	VTM_TEST_CHECK(vtm_http_access_log_get_dropped(log) == failed, "access log dropped count");
+
+	/* remaining records are written on release */
+	vtm_http_access_log_free(log);
+
+	fp = fopen(TEST_ACCESS_LOG_FILE, "r");
+	VTM_TEST_ASSERT(fp != NULL, "access log file");
+
+	lines = 0;
+	first_ok = false;
+	line = NULL;
+	line_len = 0;
+	while ((rc = vtm_file_getline(fp, &line, &line_len)) == VTM_OK) {
+		if (lines == 0)
+			first_ok = strcmp(line, "127.0.0.1 - - [18/Oct/2019:13:55:36 +0000] "
+				"\"GET /a\\x22b HTTP/1.1\" 200 2326 157") == 0;
+		lines++;
+	}
+	free(line);
+	fclose(fp);
+	remove(TEST_ACCESS_LOG_FILE);
+
+	VTM_TEST_CHECK(first_ok, "access log line format");
+	VTM_TEST_CHECK(lines == committed, "access log all records written");
+}
+
+extern void test_vtm_net_http_access_log(void)
+{
+	VTM_TEST_LABEL("http-access-log");
+	test_log();
+}
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include <vtf.h>
+
+#include <string.h> /* memcmp(), memset(), strcpy(), strlen() */
+#include <vtm/core/buffer.h>
+#include <vtm/core/error.h>
+#include <vtm/net/http/http_form.h>
+
+#define TEST_FORM_CT  "multipart/form-data; boundary=\"--xYz\""
+
+#define TEST_FORM_BODY                                               \
+	"preamble\r\n"                                                   \
+	"----xYz\r\n"                                                    \
+	"Content-Disposition: form-data; name=\"title\"\r\n"             \
+	"\r\n"                                                           \
+	"hello\r\n"                                                      \
+	"----xYz  \r\n"                                                  \
+	"Content-Disposition: form-data; name=\"file\"; filename=\"a.bin\"\r\n" \
+	"Content-Type:  application/octet-stream \r\n"                   \
+	"\r\n"                                                           \
+	"\r\n\r\n--xY\r\n----x\r\r\n\r\n"                                \
+	"----xYz--\r\n"                                                  \
+	"epilogue"
+
+#define TEST_FORM_EVENTS                                             \
+	"[H:Content-Disposition=form-data; name=\"title\"]"              \
+	"(hello)]"                                                       \
+	"[H:Content-Disposition=form-data; name=\"file\"; filename=\"a.bin\"]" \
+	"H:Content-Type=application/octet-stream]"                       \
+	"(\r\n\r\n--xY\r\n----x\r\r\n)]"
+
+static int test_part_begin(void *usr_data)
+{
+	return vtm_buf_puts(usr_data, "[");
+}
+
+static int test_part_header(void *usr_data, const char *name, size_t name_len, const char *value, size_t value_len)
+{
+	vtm_buf_puts(usr_data, "H:");
+	vtm_buf_putm(usr_data, name, name_len);
+	vtm_buf_puts(usr_data, "=");
+	vtm_buf_putm(usr_data, value, value_len);
+	return vtm_buf_puts(usr_data, "]");
+}
+
+static int test_part_data(void *usr_data, const void *data, size_t len)
+{
+	struct vtm_buf *buf;
+
+	buf = usr_data;
+
+	/* consecutive fragments are merged */
+	if (buf->used > 0 && buf->data[buf->used-1] == ')')
+		buf->used--;
+	else
+		vtm_buf_puts(buf, "(");
+
+	vtm_buf_putm(buf, data, len);
+	return vtm_buf_puts(buf, ")");
+}
+
+static int test_part_end(void *usr_data)
+{
+	return vtm_buf_puts(usr_data, "]");
+}
+
+static int test_multipart_run(const char *body, size_t step, struct vtm_buf *events)
+{
+	int rc;
+	size_t pos, len, n;
+	struct vtm_http_form_multipart mp;
+	struct vtm_http_form_multipart_cbs cbs;
+
+	cbs.part_begin = test_part_begin;
+	cbs.part_header = test_part_header;
+	cbs.part_data = test_part_data;
+	cbs.part_end = test_part_end;
+
+	rc = vtm_http_form_multipart_init(&mp, TEST_FORM_CT, &cbs, events);
+	if (rc != VTM_OK)
+		return rc;
+
+	len = strlen(body);
+	for (pos=0; pos < len; pos += n) {
+		n = len - pos < step ? len - pos : step;
+		rc = vtm_http_form_multipart_run(&mp, body + pos, n);
+		if (rc != VTM_OK)
+			return rc;
+	}
+
+	return vtm_http_form_multipart_is_complete(&mp) ? VTM_OK : VTM_E_IO_PARTIAL;
+}
+
+static void test_multipart(void)
+{
+	int rc;
+	size_t step;
+	bool ok;
+	struct vtm_buf events;
+	struct vtm_http_form_multipart mp;
+	struct vtm_http_form_multipart_cbs cbs;
+
+	memset(&cbs, 0, sizeof(cbs));
+	VTM_TEST_CHECK(vtm_http_form_multipart_init(&mp, "text/plain; boundary=a", &cbs, NULL) == VTM_E_INVALID_ARG,
+		"multipart wrong type");
+	VTM_TEST_CHECK(vtm_http_form_multipart_init(&mp, "multipart/form-data", &cbs, NULL) == VTM_E_INVALID_ARG,
+		"multipart missing boundary");
+	VTM_TEST_CHECK(vtm_http_form_multipart_init(&mp, "Multipart/Form-Data;boundary=abc", &cbs, NULL) == VTM_OK,
+		"multipart unquoted boundary");
+
+	/* same events for every fragmentation of the body */
+	ok = true;
+	for (step=1; step <= strlen(TEST_FORM_BODY); step++) {
+		vtm_buf_init(&events, VTM_BYTEORDER_LE);
+		rc = test_multipart_run(TEST_FORM_BODY, step, &events);
+		if (rc != VTM_OK || events.used != strlen(TEST_FORM_EVENTS) ||
+			memcmp(events.data, TEST_FORM_EVENTS, events.used) != 0)
+			ok = false;
+		vtm_buf_release(&events);
+	}
+	VTM_TEST_CHECK(ok, "multipart events");
+
+	/* delimiter directly at the begin */
+	vtm_buf_init(&events, VTM_BYTEORDER_LE);
+	rc = test_multipart_run("----xYz\r\n\r\nA\r\n----xYz--", 3, &events);
+	VTM_TEST_CHECK(rc == VTM_OK && events.used == 5 && memcmp(events.data, "[(A)]", 5) == 0,
+		"multipart without preamble");
+	vtm_buf_release(&events);
+
+	/* truncated body */
+	vtm_buf_init(&events, VTM_BYTEORDER_LE);
+	rc = test_multipart_run("----xYz\r\n\r\nA\r\n--", 100, &events);
+	VTM_TEST_CHECK(rc == VTM_E_IO_PARTIAL, "multipart incomplete");
+	vtm_buf_release(&events);
+
+	/* malformed header */
+	vtm_buf_init(&events, VTM_BYTEORDER_LE);
+	rc = test_multipart_run("----xYz\r\nno colon\r\n\r\nA\r\n----xYz--", 100, &events);
+	VTM_TEST_CHECK(rc == VTM_E_IO_PROTOCOL, "multipart malformed header");
+	vtm_buf_release(&events);
+}
+
+static void test_disposition(void)
+{
+	int rc;
+	struct vtm_http_form_disposition disp;
+	const char *val;
+
+	val = "form-data; name=\"upload\"; filename=\"my file.txt\"";
+	rc = vtm_http_form_disposition_parse(val, strlen(val), &disp);
+	VTM_TEST_CHECK(rc == VTM_OK, "disposition parse");
+	VTM_TEST_CHECK(disp.name_len == 6 && memcmp(disp.name, "upload", 6) == 0, "disposition name");
+	VTM_TEST_CHECK(disp.filename_len == 11 && memcmp(disp.filename, "my file.txt", 11) == 0, "disposition filename");
+
+	val = "Form-Data;name=field";
+	rc = vtm_http_form_disposition_parse(val, strlen(val), &disp);
+	VTM_TEST_CHECK(rc == VTM_OK && disp.name_len == 5 && !disp.filename, "disposition token");
+
+	val = "attachment; filename=\"a.txt\"";
+	rc = vtm_http_form_disposition_parse(val, strlen(val), &disp);
+	VTM_TEST_CHECK(rc == VTM_E_INVALID_ARG, "disposition other type");
+}
+
+static void test_urlenc(void)
+{
+	int rc;
+	char body[128];
+	struct vtm_http_form_urlenc it;
+	struct vtm_http_form_field field;
+
+	strcpy(body, "a=1&&text=hello+world%21&empty=&flag&%C3%A4=%3D");
+	vtm_http_form_urlenc_init(&it, body, strlen(body));
+
+	rc = vtm_http_form_urlenc_next(&it, &field);
+	VTM_TEST_CHECK(rc == VTM_OK && field.name_len == 1 && field.name[0] == 'a' &&
+		field.value_len == 1 && field.value[0] == '1', "urlenc plain");
+
+	rc = vtm_http_form_urlenc_next(&it, &field);
+	VTM_TEST_CHECK(rc == VTM_OK && field.name_len == 4 && memcmp(field.name, "text", 4) == 0 &&
+		field.value_len == 12 && memcmp(field.value, "hello world!", 12) == 0, "urlenc decoded");
+
+	rc = vtm_http_form_urlenc_next(&it, &field);
+	VTM_TEST_CHECK(rc == VTM_OK && field.name_len == 5 && field.value_len == 0, "urlenc empty value");
+
+	rc = vtm_http_form_urlenc_next(&it, &field);
+	VTM_TEST_CHECK(rc == VTM_OK && field.name_len == 4 && field.value_len == 0, "urlenc no value");
+
+	rc = vtm_http_form_urlenc_next(&it, &field);
+	VTM_TEST_CHECK(rc == VTM_OK && field.name_len == 2 && memcmp(field.name, "\xC3\xA4", 2) == 0 &&
+		field.value_len == 1 && field.value[0] == '=', "urlenc encoded name");
+
+	rc = vtm_http_form_urlenc_next(&it, &field);
+	VTM_TEST_CHECK(rc == VTM_E_NOT_FOUND, "urlenc end");
+
+	strcpy(body, "a=%4");
+	vtm_http_form_urlenc_init(&it, body, strlen(body));
+	rc = vtm_http_form_urlenc_next(&it, &field);
+	VTM_TEST_CHECK(rc == VTM_E_INVALID_ARG, "urlenc invalid");
+}
+
+extern void test_vtm_net_http_form(void)
+{
+	VTM_TEST_LABEL("http-form");
+	test_urlenc();
+	test_multipart();
+	test_disposition();
+}
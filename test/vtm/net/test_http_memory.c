@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include <vtf.h>
+
+#include <stdio.h> /* sprintf() */
+#include <string.h> /* memcmp(), memset() */
+#include <vtm/core/buffer.h>
+#include <vtm/core/error.h>
+#include <vtm/net/http/http_memory_intl.h>
+#include <vtm/util/thread.h>
+
+#define TEST_MEM_THREADS   4
+#define TEST_MEM_KEYS    500
+
+static void test_values(void)
+{
+	int rc;
+	int val;
+	vtm_http_mem *mem;
+	struct vtm_http_mem_opts opts;
+	struct vtm_buf buf;
+
+	memset(&opts, 0, sizeof(opts));
+	mem = vtm_http_mem_new(&opts);
+	VTM_TEST_ASSERT(mem != NULL, "http mem new");
+
+	vtm_buf_init(&buf, VTM_BYTEORDER_LE);
+
+	/* pointer values */
+	vtm_http_mem_put(mem, "ptr", &val);
+	VTM_TEST_CHECK(vtm_http_mem_get(mem, "ptr") == &val, "http mem pointer value");
+	VTM_TEST_CHECK(vtm_http_mem_get(mem, "none") == NULL, "http mem missing pointer");
+
+	/* copied values */
+	rc = vtm_http_mem_set(mem, "data", "abc", 3, 0);
+	VTM_TEST_CHECK(rc == VTM_OK, "http mem set");
+	rc = vtm_http_mem_get_data(mem, "data", &buf);
+	VTM_TEST_CHECK(rc == VTM_OK && buf.used == 3 && memcmp(buf.data, "abc", 3) == 0,
+		"http mem get data");
+	VTM_TEST_CHECK(vtm_http_mem_get(mem, "data") == NULL, "http mem data is no pointer");
+
+	/* replace */
+	vtm_buf_clear(&buf);
+	rc = vtm_http_mem_set(mem, "data", "defg", 4, 0);
+	VTM_TEST_CHECK(rc == VTM_OK, "http mem replace");
+	rc = vtm_http_mem_get_data(mem, "data", &buf);
+	VTM_TEST_CHECK(rc == VTM_OK && buf.used == 4 && memcmp(buf.data, "defg", 4) == 0,
+		"http mem replaced data");
+
+	VTM_TEST_CHECK(vtm_http_mem_remove(mem, "data"), "http mem remove");
+	VTM_TEST_CHECK(!vtm_http_mem_remove(mem, "data"), "http mem remove missing");
+	VTM_TEST_CHECK(vtm_http_mem_get_data(mem, "data", &buf) == VTM_E_NOT_FOUND, "http mem removed");
+	VTM_TEST_CHECK(vtm_http_mem_size(mem) == 0, "http mem size after remove");
+
+	/* expiration */
+	rc = vtm_http_mem_set(mem, "ttl", "x", 1, 10);
+	VTM_TEST_CHECK(rc == VTM_OK, "http mem set ttl");
+	VTM_TEST_CHECK(vtm_http_mem_get_data(mem, "ttl", &buf) == VTM_OK, "http mem before ttl");
+	vtm_thread_sleep(20);
+	VTM_TEST_CHECK(vtm_http_mem_get_data(mem, "ttl", &buf) == VTM_E_NOT_FOUND, "http mem expired");
+
+	/* key locks */
+	vtm_http_mem_lock(mem, "lock");
+	vtm_http_mem_lock(mem, "other");
+	vtm_http_mem_unlock(mem, "other");
+	vtm_http_mem_unlock(mem, "lock");
+	VTM_TEST_PASSED("http mem lock");
+
+	vtm_buf_release(&buf);
+	vtm_http_mem_free(mem);
+}
+
+static void test_eviction(void)
+{
+	int i, rc;
+	char key[32];
+	char data[100];
+	vtm_http_mem *mem;
+	struct vtm_http_mem_opts opts;
+	struct vtm_buf buf;
+
+	/* single shard for predictable order */
+	memset(&opts, 0, sizeof(opts));
+	opts.shards = 1;
+	opts.max_size = 2048;
+
+	mem = vtm_http_mem_new(&opts);
+	VTM_TEST_ASSERT(mem != NULL, "http mem new");
+
+	vtm_buf_init(&buf, VTM_BYTEORDER_LE);
+	memset(data, 'x', sizeof(data));
+
+	rc = vtm_http_mem_set(mem, "keep", data, sizeof(data), 0);
+	VTM_TEST_CHECK(rc == VTM_OK, "http mem set");
+
+	for (i=0; i < 100; i++) {
+		/* recently used entry survives */
+		VTM_TEST_CHECK(vtm_http_mem_get_data(mem, "keep", &buf) == VTM_OK, "http mem lru");
+		vtm_buf_clear(&buf);
+
+		sprintf(key, "key%d", i);
+		rc = vtm_http_mem_set(mem, key, data, sizeof(data), 0);
+		VTM_TEST_CHECK(rc == VTM_OK, "http mem set");
+		VTM_TEST_CHECK(vtm_http_mem_size(mem) <= opts.max_size, "http mem size limit");
+	}
+
+	VTM_TEST_CHECK(vtm_http_mem_get_data(mem, "key0", &buf) == VTM_E_NOT_FOUND, "http mem evicted");
+	VTM_TEST_CHECK(vtm_http_mem_get_data(mem, "key99", &buf) == VTM_OK, "http mem newest");
+
+	/* value larger than limit */
+	rc = vtm_http_mem_set(mem, "big", NULL, 0, 0);
+	VTM_TEST_CHECK(rc == VTM_OK, "http mem empty value");
+	{
+		char big[4096];
+		memset(big, 0, sizeof(big));
+		rc = vtm_http_mem_set(mem, "big", big, sizeof(big), 0);
+		VTM_TEST_CHECK(rc == VTM_E_MAX_REACHED, "http mem value too big");
+	}
+
+	vtm_buf_release(&buf);
+	vtm_http_mem_free(mem);
+}
+
+static int test_worker(void *arg)
+{
+	int i, n, rc;
+	char key[32];
+	vtm_http_mem *mem;
+	struct vtm_buf buf;
+
+	mem = arg;
+	rc = VTM_OK;
+	vtm_buf_init(&buf, VTM_BYTEORDER_LE);
+
+	for (i=0; i < TEST_MEM_KEYS; i++) {
+		sprintf(key, "session-%d", i);
+		vtm_http_mem_set(mem, key, &i, sizeof(i), 0);
+
+		vtm_buf_clear(&buf);
+		if (vtm_http_mem_get_data(mem, key, &buf) != VTM_OK || buf.used != sizeof(n)) {
+			rc = VTM_ERROR;
+			continue;
+		}
+
+		memcpy(&n, buf.data, sizeof(n));
+		if (n != i)
+			rc = VTM_ERROR;
+
+		/* shared counter guarded by key lock */
+		vtm_http_mem_lock(mem, "counter");
+		n = 0;
+		vtm_buf_clear(&buf);
+		if (vtm_http_mem_get_data(mem, "counter", &buf) == VTM_OK)
+			memcpy(&n, buf.data, sizeof(n));
+		n++;
+		vtm_http_mem_set(mem, "counter", &n, sizeof(n), 0);
+		vtm_http_mem_unlock(mem, "counter");
+	}
+
+	vtm_buf_release(&buf);
+
+	return rc;
+}
+
+static void test_concurrent(void)
+{
+	int i, n;
+	vtm_http_mem *mem;
+	vtm_thread *threads[TEST_MEM_THREADS];
+	struct vtm_http_mem_opts opts;
+	struct vtm_buf buf;
+
+	memset(&opts, 0, sizeof(opts));
+	mem = vtm_http_mem_new(&opts);
+	VTM_TEST_ASSERT(mem != NULL, "http mem new");
+
+	for (i=0; i < TEST_MEM_THREADS; i++) {
+		threads[i] = vtm_thread_new(test_worker, mem);
+		VTM_TEST_ASSERT(threads[i] != NULL, "http mem thread");
+	}
+
+	for (i=0; i < TEST_MEM_THREADS; i++) {
+		vtm_thread_join(threads[i]);
+		VTM_TEST_CHECK(vtm_thread_get_result(threads[i]) == VTM_OK, "http mem concurrent access");
+		vtm_thread_free(threads[i]);
+	}
+
+	vtm_buf_init(&buf, VTM_BYTEORDER_LE);
+	n = 0;
+	if (vtm_http_mem_get_data(mem, "counter", &buf) == VTM_OK)
+		memcpy(&n, buf.data, sizeof(n));
+	VTM_TEST_CHECK(n == TEST_MEM_THREADS * TEST_MEM_KEYS, "http mem key lock");
+
+	vtm_buf_release(&buf);
+	vtm_http_mem_free(mem);
+}
+
+extern void test_vtm_net_http_memory(void)
+{
+	VTM_TEST_LABEL("http-memory");
+	test_values();
+	test_eviction();
+	test_concurrent();
+}
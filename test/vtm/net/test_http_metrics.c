@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include <vtf.h>
+
+#include <string.h> /* strstr(), strchr(), strcspn(), strncmp(), memcpy() */
+#include <vtm/core/buffer.h>
+#include <vtm/core/error.h>
+#include <vtm/net/http/http.h>
+#include <vtm/net/http/http_metrics_intl.h>
+#include <vtm/util/thread.h>
+
+#define TEST_METRICS_THREADS   4
+#define TEST_METRICS_REQUESTS  1000
+#define TEST_METRICS_FAMILIES  8
+#define TEST_METRICS_NAME_LEN  64
+
+struct test_metrics_worker
+{
+	vtm_http_metrics  *m;
+	unsigned int      id;
+};
+
+static int test_metrics_worker(void *arg)
+{
+	int i;
+	uint64_t start;
+	struct test_metrics_worker *w;
+
+	w = arg;
+
+	for (i=0; i < TEST_METRICS_REQUESTS; i++) {
+		start = vtm_http_metrics_begin(w->m, w->id);
+		vtm_http_metrics_end(w->m, w->id, start, i % 10 == 0 ? 500 : 200);
+	}
+
+	return VTM_OK;
+}
+
+static bool test_metrics_contains(vtm_http_metrics *m, const char *line)
+{
+	bool result;
+	struct vtm_buf buf;
+
+	vtm_buf_init(&buf, VTM_BYTEORDER_LE);
+
+	result = vtm_http_metrics_render(m, &buf) == VTM_OK &&
+		vtm_buf_putc(&buf, '\0') == VTM_OK &&
+		strstr((const char*) buf.data, line) != NULL;
+
+	vtm_buf_release(&buf);
+
+	return result;
+}
+
+static bool test_metrics_sample_of(const char *line, size_t len, const char *family)
+{
+	size_t flen;
+	const char *suffix;
+
+	flen = strlen(family);
+	if (len < flen || strncmp(line, family, flen) != 0)
+		return false;
+
+	suffix = line + flen;
+	len -= flen;
+
+	return len == 0 ||
+		(len == 7 && strncmp(suffix, "_bucket", 7) == 0) ||
+		(len == 4 && strncmp(suffix, "_sum", 4) == 0) ||
+		(len == 6 && strncmp(suffix, "_count", 6) == 0);
+}
+
+static bool test_metrics_grouped(vtm_http_metrics *m)
+{
+	bool result;
+	struct vtm_buf buf;
+	char families[TEST_METRICS_FAMILIES][TEST_METRICS_NAME_LEN];
+	size_t i, count, len;
+	const char *line, *eol;
+
+	vtm_buf_init(&buf, VTM_BYTEORDER_LE);
+
+	result = vtm_http_metrics_render(m, &buf) == VTM_OK &&
+		vtm_buf_putc(&buf, '\0') == VTM_OK;
+
+	/* every family is one group after its HELP and TYPE lines */
+	count = 0;
+	for (line = (const char*) buf.data; result && *line != '\0'; line = eol + 1) {
+		eol = strchr(line, '\n');
+		if (!eol) {
+			result = false;
+			break;
+		}
+
+		if (strncmp(line, "# HELP ", 7) == 0) {
+			len = strcspn(line + 7, " \n");
+			if (count == TEST_METRICS_FAMILIES || len >= TEST_METRICS_NAME_LEN) {
+				result = false;
+				break;
+			}
+			for (i=0; i < count; i++) {
+				if (strncmp(families[i], line + 7, len) == 0 && families[i][len] == '\0')
+					result = false;
+			}
+			memcpy(families[count], line + 7, len);
+			families[count++][len] = '\0';
+		}
+		else if (strncmp(line, "# TYPE ", 7) == 0) {
+			result = count > 0 &&
+				strncmp(line + 7, families[count-1], strlen(families[count-1])) == 0;
+		}
+		else {
+			result = count > 0 &&
+				test_metrics_sample_of(line, strcspn(line, "{ "), families[count-1]);
+		}
+	}
+
+	vtm_buf_release(&buf);
+
+	return result && count == 4;
+}
+
+static void test_record(void)
+{
+	int rc;
+	unsigned int id_any, id_get;
+	uint64_t start;
+	vtm_http_metrics *m;
+
+	m = vtm_http_metrics_new();
+	VTM_TEST_ASSERT(m != NULL, "http metrics new");
+
+	rc = vtm_http_metrics_register(m, -1, "/users/:id", &id_any);
+	VTM_TEST_CHECK(rc == VTM_OK, "http metrics register");
+	rc = vtm_http_metrics_register(m, VTM_HTTP_METHOD_GET, "/a\"b", &id_get);
+	VTM_TEST_CHECK(rc == VTM_OK && id_get != id_any, "http metrics register method");
+
+	/* in flight while handler runs */
+	start = vtm_http_metrics_begin(m, id_any);
+	VTM_TEST_CHECK(test_metrics_contains(m,
+		"vtm_http_requests_in_flight{method=\"any\",route=\"/users/:id\"} 1\n"),
+		"http metrics in flight");
+	vtm_http_metrics_end(m, id_any, start, 404);
+
+	VTM_TEST_CHECK(test_metrics_contains(m,
+		"vtm_http_requests_in_flight{method=\"any\",route=\"/users/:id\"} 0\n"),
+		"http metrics in flight done");
+	VTM_TEST_CHECK(test_metrics_contains(m,
+		"vtm_http_requests_total{method=\"any\",route=\"/users/:id\"} 1\n"),
+		"http metrics request count");
+	VTM_TEST_CHECK(test_metrics_contains(m,
+		"vtm_http_responses_total{method=\"any\",route=\"/users/:id\",code=\"4xx\"} 1\n"),
+		"http metrics status class");
+	VTM_TEST_CHECK(test_metrics_contains(m,
+		"vtm_http_request_duration_seconds_bucket{method=\"any\",route=\"/users/:id\",le=\"+Inf\"} 1\n"),
+		"http metrics histogram");
+
+	/* not handled requests are not counted */
+	start = vtm_http_metrics_begin(m, id_get);
+	vtm_http_metrics_end(m, id_get, start, -1);
+	VTM_TEST_CHECK(test_metrics_contains(m,
+		"vtm_http_requests_total{method=\"GET\",route=\"/a\\\"b\"} 0\n"),
+		"http metrics not handled and escaping");
+
+	/* lock-free shards of all threads are summed up */
+	{
+		size_t i;
+		vtm_thread *threads[TEST_METRICS_THREADS];
+		struct test_metrics_worker w;
+
+		w.m = m;
+		w.id = id_get;
+
+		for (i=0; i < TEST_METRICS_THREADS; i++) {
+			threads[i] = vtm_thread_new(test_metrics_worker, &w);
+			VTM_TEST_ASSERT(threads[i] != NULL, "http metrics thread");
+		}
+
+		for (i=0; i < TEST_METRICS_THREADS; i++) {
+			vtm_thread_join(threads[i]);
+			vtm_thread_free(threads[i]);
+		}
+	}
+
+	VTM_TEST_CHECK(test_metrics_contains(m,
+		"vtm_http_requests_total{method=\"GET\",route=\"/a\\\"b\"} 4000\n"),
+		"http metrics shards");
+	VTM_TEST_CHECK(test_metrics_contains(m,
+		"vtm_http_responses_total{method=\"GET\",route=\"/a\\\"b\",code=\"5xx\"} 400\n"),
+		"http metrics shard status");
+	VTM_TEST_CHECK(test_metrics_contains(m,
+		"vtm_http_request_duration_seconds_count{method=\"GET\",route=\"/a\\\"b\"} 4000\n"),
+		"http metrics shard histogram");
+
+	VTM_TEST_CHECK(test_metrics_grouped(m), "http metrics families grouped");
+
+	vtm_http_metrics_free(m);
+}
+
+extern void test_vtm_net_http_metrics(void)
+{
+	VTM_TEST_LABEL("http-metrics");
+	test_record();
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include <vtf.h>
+
+#include <string.h> /* memset() */
+#include <vtm/net/socket_addr.h>
+#include <vtm/net/http/http_ratelimit.h>
+#include <vtm/util/thread.h>
+
+static void test_ip(unsigned char *ip, unsigned char id)
+{
+	memset(ip, 0, VTM_SOCK_ADDR_IP_LEN);
+	ip[VTM_SOCK_ADDR_IP_LEN - 1] = id;
+}
+
+static void test_bucket(void)
+{
+	unsigned int i;
+	unsigned long retry_after;
+	unsigned char ip[VTM_SOCK_ADDR_IP_LEN];
+	vtm_http_ratelimit *rl;
+	struct vtm_http_ratelimit_opts opts;
+
+	memset(&opts, 0, sizeof(opts));
+	VTM_TEST_CHECK(vtm_http_ratelimit_new(&opts) == NULL, "ratelimit rate required");
+
+	opts.rate = 0.5;
+	opts.burst = 3;
+	rl = vtm_http_ratelimit_new(&opts);
+	VTM_TEST_ASSERT(rl != NULL, "ratelimit new");
+
+	test_ip(ip, 1);
+	for (i=0; i < 3; i++)
+		VTM_TEST_CHECK(vtm_http_ratelimit_take(rl, ip, NULL), "ratelimit burst");
+
+	retry_after = 0;
+	VTM_TEST_CHECK(!vtm_http_ratelimit_take(rl, ip, &retry_after), "ratelimit empty");
+	VTM_TEST_CHECK(retry_after == 2, "ratelimit retry after");
+
+	/* other clients have their own bucket */
+	test_ip(ip, 2);
+	VTM_TEST_CHECK(vtm_http_ratelimit_take(rl, ip, NULL), "ratelimit other client");
+
+	vtm_http_ratelimit_free(rl);
+
+	/* refill */
+	opts.rate = 100;
+	opts.burst = 1;
+	rl = vtm_http_ratelimit_new(&opts);
+	VTM_TEST_ASSERT(rl != NULL, "ratelimit new");
+
+	test_ip(ip, 1);
+	VTM_TEST_CHECK(vtm_http_ratelimit_take(rl, ip, NULL), "ratelimit refill first");
+	vtm_thread_sleep(50);
+	VTM_TEST_CHECK(vtm_http_ratelimit_take(rl, ip, NULL), "ratelimit refilled");
+
+	vtm_http_ratelimit_free(rl);
+}
+
+static void test_eviction(void)
+{
+	unsigned char i;
+	unsigned char ip[VTM_SOCK_ADDR_IP_LEN];
+	vtm_http_ratelimit *rl;
+	struct vtm_http_ratelimit_opts opts;
+
+	/* single set with eight slots */
+	memset(&opts, 0, sizeof(opts));
+	opts.rate = 0.001;
+	opts.burst = 1;
+	opts.clients = 8;
+	opts.shards = 1;
+	rl = vtm_http_ratelimit_new(&opts);
+	VTM_TEST_ASSERT(rl != NULL, "ratelimit new");
+
+	test_ip(ip, 0);
+	VTM_TEST_CHECK(vtm_http_ratelimit_take(rl, ip, NULL), "ratelimit eviction first");
+	VTM_TEST_CHECK(!vtm_http_ratelimit_take(rl, ip, NULL), "ratelimit eviction empty");
+
+	/* table is full, the oldest client is replaced */
+	for (i=1; i <= 8; i++) {
+		test_ip(ip, i);
+		VTM_TEST_CHECK(vtm_http_ratelimit_take(rl, ip, NULL), "ratelimit eviction fill");
+	}
+
+	test_ip(ip, 0);
+	VTM_TEST_CHECK(vtm_http_ratelimit_take(rl, ip, NULL), "ratelimit evicted client");
+
+	vtm_http_ratelimit_free(rl);
+}
+
+extern void test_vtm_net_http_ratelimit(void)
+{
+	VTM_TEST_LABEL("http-ratelimit");
+	test_bucket();
+	test_eviction();
+}
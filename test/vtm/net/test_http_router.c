@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include <vtf.h>
+
+#include <string.h> /* memset(), strcmp() */
+#include <vtm/core/error.h>
+#include <vtm/net/http/http_router.h>
+
+static const char *handled;
+
+static int test_rt_a(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
+{
+	handled = "a";
+	return VTM_OK;
+}
+
+static int test_rt_b(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
+{
+	handled = "b";
+	return VTM_OK;
+}
+
+static int test_rt_post(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
+{
+	handled = "post";
+	return VTM_OK;
+}
+
+static int test_rt_param(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
+{
+	handled = "param";
+	return VTM_OK;
+}
+
+static int test_rt_wildcard(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
+{
+	handled = "wildcard";
+	return VTM_OK;
+}
+
+static int test_rt_prefix(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
+{
+	handled = "prefix";
+	return VTM_OK;
+}
+
+static int test_rt_skip(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
+{
+	return VTM_E_NOT_HANDLED;
+}
+
+static int route(vtm_http_router *rtr, struct vtm_http_req *req, enum vtm_http_method method, const char *path)
+{
+	memset(req, 0, sizeof(*req));
+	req->method = method;
+	req->path = path;
+	handled = NULL;
+
+	return vtm_http_router_handle(rtr, NULL, req, NULL);
+}
+
+static bool check_param(struct vtm_http_req *req, const char *name, const char *expected)
+{
+	char buf[64];
+
+	if (vtm_http_req_copy_path_param(req, name, buf, sizeof(buf)) != VTM_OK)
+		return false;
+
+	return strcmp(buf, expected) == 0;
+}
+
+static void test_router(void)
+{
+	int rc;
+	vtm_http_router *rtr;
+	struct vtm_http_req req;
+
+	rtr = vtm_http_router_new();
+	VTM_TEST_ASSERT(rtr != NULL, "router new");
+
+	rc = vtm_http_router_static_rt(rtr, "/users", test_rt_a);
+	VTM_TEST_CHECK(rc == VTM_OK, "add static route");
+
+	rc = vtm_http_router_static_rt(rtr, "/users/list", test_rt_b);
+	VTM_TEST_CHECK(rc == VTM_OK, "add static route with common prefix");
+
+	rc = vtm_http_router_static_rt_method(rtr, VTM_HTTP_METHOD_POST, "/users", test_rt_post);
+	VTM_TEST_CHECK(rc == VTM_OK, "add method route");
+
+	rc = vtm_http_router_static_rt(rtr, "/users/:id/posts/:post", test_rt_param);
+	VTM_TEST_CHECK(rc == VTM_OK, "add param route");
+
+	rc = vtm_http_router_static_rt(rtr, "/static/*file", test_rt_wildcard);
+	VTM_TEST_CHECK(rc == VTM_OK, "add wildcard route");
+
+	rc = vtm_http_router_static_rt(rtr, "/files/", test_rt_skip);
+	VTM_TEST_CHECK(rc == VTM_OK, "add fall-through route");
+
+	rc = vtm_http_router_static_rt(rtr, "/files/", test_rt_prefix);
+	VTM_TEST_CHECK(rc == VTM_OK, "add prefix route");
+
+	rc = vtm_http_router_static_rt(rtr, "/users/:name", test_rt_a);
+	VTM_TEST_CHECK(rc == VTM_E_INVALID_ARG, "reject conflicting param name");
+
+	rc = vtm_http_router_static_rt(rtr, "/bad/*rest/more", test_rt_a);
+	VTM_TEST_CHECK(rc == VTM_E_INVALID_ARG, "reject inner wildcard");
+
+	rc = route(rtr, &req, VTM_HTTP_METHOD_GET, "/users");
+	VTM_TEST_CHECK(rc == VTM_OK && strcmp(handled, "a") == 0, "match static");
+
+	rc = route(rtr, &req, VTM_HTTP_METHOD_POST, "/users");
+	VTM_TEST_CHECK(rc == VTM_OK && strcmp(handled, "post") == 0, "match method");
+
+	rc = route(rtr, &req, VTM_HTTP_METHOD_GET, "/users/list");
+	VTM_TEST_CHECK(rc == VTM_OK && strcmp(handled, "b") == 0, "match split static");
+
+	rc = route(rtr, &req, VTM_HTTP_METHOD_GET, "/users/42/posts/abc");
+	VTM_TEST_CHECK(rc == VTM_OK && strcmp(handled, "param") == 0, "match param");
+	VTM_TEST_CHECK(req.path_param_count == 2, "param count");
+	VTM_TEST_CHECK(check_param(&req, "id", "42"), "param id value");
+	VTM_TEST_CHECK(check_param(&req, "post", "abc"), "param post value");
+
+	rc = route(rtr, &req, VTM_HTTP_METHOD_GET, "/users/list/posts/x");
+	VTM_TEST_CHECK(rc == VTM_OK && strcmp(handled, "param") == 0, "backtrack to param");
+	VTM_TEST_CHECK(check_param(&req, "id", "list"), "backtracked param value");
+
+	rc = route(rtr, &req, VTM_HTTP_METHOD_GET, "/static/css/main.css");
+	VTM_TEST_CHECK(rc == VTM_OK && strcmp(handled, "wildcard") == 0, "match wildcard");
+	VTM_TEST_CHECK(check_param(&req, "file", "css/main.css"), "wildcard value");
+
+	rc = route(rtr, &req, VTM_HTTP_METHOD_GET, "/files/a/b.txt");
+	VTM_TEST_CHECK(rc == VTM_OK && strcmp(handled, "prefix") == 0, "match prefix");
+
+	rc = route(rtr, &req, VTM_HTTP_METHOD_GET, "/files/");
+	VTM_TEST_CHECK(rc == VTM_OK && strcmp(handled, "prefix") == 0, "match prefix exact");
+
+	rc = route(rtr, &req, VTM_HTTP_METHOD_GET, "/files");
+	VTM_TEST_CHECK(rc == VTM_E_NOT_HANDLED, "no match without slash");
+
+	rc = route(rtr, &req, VTM_HTTP_METHOD_GET, "/user");
+	VTM_TEST_CHECK(rc == VTM_E_NOT_HANDLED, "no match partial");
+
+	rc = route(rtr, &req, VTM_HTTP_METHOD_GET, "/users/42/posts/");
+	VTM_TEST_CHECK(rc == VTM_E_NOT_HANDLED, "no match empty param");
+
+	vtm_http_router_free(rtr);
+	VTM_TEST_PASSED("router free");
+}
+
+extern void test_vtm_net_http_router(void)
+{
+	VTM_TEST_LABEL("http-router");
+	test_router();
+}
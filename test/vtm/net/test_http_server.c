@@ -5,27 +5,92 @@
 #include <vtf.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <vtm/core/buffer.h>
 #include <vtm/core/error.h>
 #include <vtm/core/format.h>
 #include <vtm/crypto/crypto.h>
+#include <vtm/fs/file.h>
 #include <vtm/net/http/http_client.h>
+#include <vtm/net/http/http_client_async.h>
+#include <vtm/net/http/http_cache_route.h>
+#include <vtm/net/http/http_metrics.h>
+#include <vtm/net/http/http_ratelimit.h>
 #include <vtm/net/http/http_server.h>
 #include <vtm/net/http/http_util.h>
 #include <vtm/net/http/http_router.h>
+#include <vtm/net/http/http_file.h>
 #include <vtm/net/http/http_file_route.h>
+#include <vtm/net/http/http_sse.h>
 #include <vtm/net/http/http_upgrade.h>
+#include <vtm/net/http/http2_hpack_intl.h>
 #include <vtm/net/http/ws_client.h>
+#include <vtm/net/http/ws_client_async.h>
+#include <vtm/net/http/ws_group.h>
+#include <vtm/util/atomic.h>
 #include <vtm/util/latch.h>
 #include <vtm/util/signal.h>
 #include <vtm/util/thread.h>
 
 #define TEST_RT_BIG_SIZE   1000000
+#define TEST_RT_OWN_SIZE   300000
+#define TEST_RT_REF_DATA   "referenced body"
+#define TEST_RT_ENC_COUNT  400
+
+#define TEST_SIDECAR_FILE  "./test/data/net/http/test.txt.gz"
+#define TEST_SIDECAR_DATA  "precompressed"
+#define TEST_SIDECAR_COUNT 200
+#define TEST_UPLOAD_SIZE   200000
+
+#define TEST_HPACK_MAX_HEADERS  65536
+
+#define TEST_CACHE_TTL     300
+#define TEST_CACHE_THREADS 4
+#define TEST_CACHE_PNG_SIZE 4000
+#define TEST_ACCESS_LOG    "test_http_access_log.txt"
+#define TEST_LIMIT_BURST   3
+
+#define TEST_WS_GROUP_SIZE 60000
+#define TEST_WS_JSON       "{\"id\":1234,\"type\":\"quote\",\"symbol\":\"VTM\",\"bid\":10.25,\"ask\":10.27}"
+
+#define TEST_WS_PING_INTERVAL  50
+#define TEST_WS_FLOOD_COUNT    600
+#define TEST_WS_HIGH_WATERMARK 1000000
+#define TEST_WS_GROUP_MEMBERS  3
+
+#define TEST_WS_ASYNC_CONS     8
+#define TEST_WS_ASYNC_BATCH    10
+
+#define TEST_SSE_CHUNK     "23\r\nid: 1\nevent: tick\ndata: a\ndata: b\n\n\r\n"
+
+struct test_ws_reader
+{
+	vtm_ws_client  *cl;
+	unsigned int   received;
+	bool           done;
+};
+
+struct test_upload
+{
+	uint64_t      len;
+	uint64_t      sum;
+	unsigned int  fragments;
+};
 
 static vtm_thread *th;
 static vtm_http_srv *srv;
 static vtm_http_router *rtr;
+static vtm_http_metrics *metrics;
 static struct vtm_latch latch;
+static VTM_ATOMIC_INT32_TYPE cache_calls;
+static vtm_http_sse_chan *sse_chan;
+static vtm_ws_group *ws_group;
+static unsigned char ws_group_data[TEST_WS_GROUP_SIZE];
+static VTM_ATOMIC_INT32_TYPE ws_congested;
+static VTM_ATOMIC_INT32_TYPE ws_relieved;
+static VTM_ATOMIC_INT32_TYPE ws_broadcasts;
+static vtm_ws_con *ws_slow_con;
 
 static void init_modules(void)
 {
@@ -86,6 +151,87 @@ static int test_rt_big(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_h
 	return VTM_OK;
 }
 
+static int test_rt_encoded(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
+{
+	int i;
+
+	/* body is already encoded, content type follows the encoding */
+	vtm_http_res_begin(res, VTM_HTTP_RES_MODE_FIXED, VTM_HTTP_200_OK);
+	vtm_http_res_header(res, VTM_HTTP_HEADER_CONTENT_ENCODING, VTM_HTTP_VALUE_GZIP);
+	vtm_http_res_header(res, VTM_HTTP_HEADER_CONTENT_TYPE, "text/html");
+
+	for (i=0; i < TEST_RT_ENC_COUNT; i++) {
+		vtm_http_res_body_str(res, "Hello\n");
+	}
+
+	vtm_http_res_end(res);
+
+	return VTM_OK;
+}
+
+static int test_rt_ref(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
+{
+	vtm_http_res_begin(res, VTM_HTTP_RES_MODE_FIXED, VTM_HTTP_200_OK);
+	vtm_http_res_body_ref(res, TEST_RT_REF_DATA, strlen(TEST_RT_REF_DATA));
+	vtm_http_res_end(res);
+
+	return VTM_OK;
+}
+
+static int test_rt_own(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
+{
+	size_t i;
+	unsigned char *data;
+
+	data = malloc(TEST_RT_OWN_SIZE);
+	if (!data)
+		return VTM_E_MALLOC;
+
+	for (i=0; i < TEST_RT_OWN_SIZE; i++)
+		data[i] = (unsigned char) (i % 251);
+
+	vtm_http_res_begin(res, VTM_HTTP_RES_MODE_FIXED, VTM_HTTP_200_OK);
+	vtm_http_res_body_own(res, data, TEST_RT_OWN_SIZE, free, data);
+	vtm_http_res_end(res);
+
+	return VTM_OK;
+}
+
+static int test_rt_cached(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
+{
+	int32_t n;
+	char buf[VTM_FMT_CHARS_INT32 + 1];
+	char png[TEST_CACHE_PNG_SIZE];
+
+	n = VTM_ATOMIC_ADD_INT32(&cache_calls, 1);
+
+	/* media type that is never compressed */
+	if (vtm_http_req_get_query_str(req, "png")) {
+		memset(png, 'p', sizeof(png));
+		vtm_http_res_begin(res, VTM_HTTP_RES_MODE_FIXED, VTM_HTTP_200_OK);
+		vtm_http_res_header(res, VTM_HTTP_HEADER_CONTENT_TYPE, "image/png");
+		vtm_http_res_body_raw(res, png, sizeof(png));
+		return vtm_http_res_end(res);
+	}
+
+	/* give concurrent requests time to arrive */
+	if (vtm_http_req_get_query_str(req, "slow"))
+		vtm_thread_sleep(100);
+
+	buf[vtm_fmt_int(buf, n)] = '\0';
+
+	vtm_http_res_begin(res, VTM_HTTP_RES_MODE_FIXED, VTM_HTTP_200_OK);
+	if (vtm_http_req_get_query_str(req, "nostore"))
+		vtm_http_res_header(res, VTM_HTTP_HEADER_CACHE_CONTROL, "no-store");
+	if (vtm_http_req_get_query_str(req, "vary"))
+		vtm_http_res_header(res, VTM_HTTP_HEADER_VARY, vtm_http_req_get_query_str(req, "vary"));
+	vtm_http_res_header(res, "Computed", buf);
+	vtm_http_res_body_str(res, buf);
+	vtm_http_res_end(res);
+
+	return VTM_OK;
+}
+
 static int test_rt_path(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
 {
 	vtm_http_res_begin(res, VTM_HTTP_RES_MODE_CHUNKED, VTM_HTTP_200_OK);
@@ -115,6 +261,72 @@ static int test_rt_file(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_
 	return VTM_OK;
 }
 
+static void test_upload_reply(vtm_http_res *res, uint64_t len, uint64_t sum)
+{
+	char buf[32];
+
+	vtm_http_res_begin(res, VTM_HTTP_RES_MODE_FIXED, VTM_HTTP_200_OK);
+	buf[vtm_fmt_uint64(buf, len)] = '\0';
+	vtm_http_res_header(res, "Length", buf);
+	buf[vtm_fmt_uint64(buf, sum)] = '\0';
+	vtm_http_res_header(res, "Sum", buf);
+	vtm_http_res_end(res);
+}
+
+static int test_rt_upload(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
+{
+	size_t i;
+	uint64_t sum;
+
+	/* body follows in http_body callback */
+	if (req->streamed) {
+		req->usr_data = calloc(1, sizeof(struct test_upload));
+		return req->usr_data ? VTM_OK : VTM_E_MALLOC;
+	}
+
+	sum = 0;
+	for (i=0; i < req->body_len; i++)
+		sum += ((const unsigned char*) req->body)[i];
+
+	test_upload_reply(res, req->body_len, sum);
+
+	return VTM_OK;
+}
+
+static int http_body(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res, const void *data, size_t len, enum vtm_http_req_body_stat stat)
+{
+	size_t i;
+	struct test_upload *up;
+
+	up = req->usr_data;
+	if (!up)
+		return VTM_ERROR;
+
+	if (stat == VTM_HTTP_REQ_BODY_ABORTED) {
+		free(up);
+		return VTM_OK;
+	}
+
+	for (i=0; i < len; i++)
+		up->sum += ((const unsigned char*) data)[i];
+	up->len += len;
+
+	if (stat == VTM_HTTP_REQ_BODY_LAST) {
+		test_upload_reply(res, up->len, up->sum);
+		free(up);
+		req->usr_data = NULL;
+		return VTM_OK;
+	}
+
+	/* exercise flow control, resume happens before pause takes effect */
+	if (++up->fragments % 4 == 0) {
+		vtm_http_req_resume(req);
+		return VTM_E_IO_AGAIN;
+	}
+
+	return VTM_OK;
+}
+
 static int test_rt_ws(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
 {
 	if (!vtm_http_is_ws_request(req))
@@ -123,6 +335,21 @@ static int test_rt_ws(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_ht
 	return vtm_http_upgrade_to_ws(req, res, NULL);
 }
 
+static int test_rt_sse(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
+{
+	int rc;
+	vtm_http_sse *sse;
+
+	rc = vtm_http_sse_begin(res, &sse);
+	if (rc != VTM_OK)
+		return rc;
+
+	vtm_http_sse_chan_subscribe(sse_chan, sse);
+	vtm_http_sse_release(sse);
+
+	return VTM_OK;
+}
+
 static void http_request(struct vtm_http_ctx *ctx, struct vtm_http_req *req, vtm_http_res *res)
 {
 	int rc;
@@ -139,32 +366,147 @@ static void http_ready(vtm_http_srv *srv, struct vtm_http_srv_opts *opts)
 	vtm_latch_count(&latch);
 }
 
+static void test_ws_flood(vtm_ws_con *con)
+{
+	unsigned int i;
+
+	/* more than the socket buffers take, older messages are dropped */
+	for (i=0; i < TEST_WS_FLOOD_COUNT; i++)
+		vtm_ws_con_send_msg(con, VTM_WS_MSG_BINARY, ws_group_data, sizeof(ws_group_data));
+
+	vtm_ws_con_send_msg(con, VTM_WS_MSG_TEXT, "E", 1);
+}
+
+static void test_ws_group_flood(void)
+{
+	unsigned int i;
+
+	/* until the slow member leaves from its congestion callback,
+	   paced so that only the member that does not read congests */
+	for (i=0; i < TEST_WS_FLOOD_COUNT && vtm_ws_group_count(ws_group) == TEST_WS_GROUP_MEMBERS; i++) {
+		vtm_ws_group_broadcast(ws_group, VTM_WS_MSG_BINARY, ws_group_data, sizeof(ws_group_data));
+		VTM_ATOMIC_ADD_INT32(&ws_broadcasts, 1);
+		vtm_thread_sleep(2);
+	}
+
+	vtm_ws_group_broadcast(ws_group, VTM_WS_MSG_TEXT, "E", 1);
+}
+
 static void ws_msg(struct vtm_http_ctx *ctx, struct vtm_ws_msg *msg)
 {
-	if (msg->len == 1 && *((char*)msg->data) == 'A')
-		vtm_ws_con_send_msg(msg->con, VTM_WS_MSG_TEXT, "B", 1);
+	/* longer messages are echoed */
+	if (msg->len > 1 && msg->type == VTM_WS_MSG_TEXT) {
+		vtm_ws_con_send_msg(msg->con, VTM_WS_MSG_TEXT, msg->data, msg->len);
+		return;
+	}
+
+	if (msg->len != 1)
+		return;
+
+	switch (*((char*)msg->data)) {
+		case 'A':
+			vtm_ws_con_send_msg(msg->con, VTM_WS_MSG_TEXT, "B", 1);
+			break;
+
+		case 'J':
+			vtm_ws_group_join(ws_group, msg->con);
+			vtm_ws_group_broadcast(ws_group, VTM_WS_MSG_BINARY, ws_group_data, sizeof(ws_group_data));
+			break;
+
+		case 'F':
+			test_ws_flood(msg->con);
+			break;
+
+		case 'S':
+			ws_slow_con = msg->con;
+			vtm_ws_group_join(ws_group, msg->con);
+			break;
+
+		case 'M':
+			vtm_ws_group_join(ws_group, msg->con);
+			break;
+
+		case 'G':
+			test_ws_group_flood();
+			break;
+	}
+}
+
+static void ws_congestion(struct vtm_http_ctx *ctx, vtm_ws_con *con, bool congested)
+{
+	if (congested)
+		VTM_ATOMIC_ADD_INT32(&ws_congested, 1);
+	else
+		VTM_ATOMIC_ADD_INT32(&ws_relieved, 1);
+
+	/* runs inside the broadcast that filled the queue */
+	if (congested && con == ws_slow_con)
+		vtm_ws_group_leave(ws_group, con);
+}
+
+static void ws_close(struct vtm_http_ctx *ctx, vtm_ws_con *con)
+{
+	vtm_ws_group_leave(ws_group, con);
 }
 
 static int http_server(void *arg)
 {
 	int rc;
 	struct vtm_http_route *file_rt;
+	struct vtm_http_route *uncached_rt;
+	struct vtm_http_route *static_rt;
+	struct vtm_http_route *cache_rt;
+	struct vtm_http_route *metrics_rt;
 
 	/* router */
 	rtr = vtm_http_router_new();
 	if (!rtr)
 		goto err;
 
+	metrics = vtm_http_metrics_new();
+	if (!metrics)
+		goto err;
+
+	vtm_http_router_set_metrics(rtr, metrics);
+
 	file_rt = vtm_http_file_rt_new(".");
 	if (!file_rt)
 		goto err;
 
 	vtm_http_router_add_rt(rtr, "/files/", file_rt);
+
+	uncached_rt = vtm_http_file_rt_new(".");
+	if (!uncached_rt)
+		goto err;
+
+	vtm_http_file_rt_set_opt(uncached_rt, VTM_HTTP_FILE_RT_OPT_CACHE_SIZE, (size_t[]) {0}, sizeof(size_t));
+	vtm_http_router_add_rt(rtr, "/uncached/", uncached_rt);
+
+	static_rt = vtm_http_static_rt_new(NULL, test_rt_cached);
+	if (!static_rt)
+		goto err;
+
+	cache_rt = vtm_http_cache_rt_new(static_rt, TEST_CACHE_TTL);
+	if (!cache_rt)
+		goto err;
+
+	vtm_http_router_add_rt(rtr, "/cached", cache_rt);
+
+	metrics_rt = vtm_http_metrics_rt_new(metrics);
+	if (!metrics_rt)
+		goto err;
+
+	vtm_http_router_add_rt(rtr, "/metrics", metrics_rt);
 	vtm_http_router_static_rt(rtr, "/file", test_rt_file);
 	vtm_http_router_static_rt(rtr, "/big", test_rt_big);
+	vtm_http_router_static_rt(rtr, "/encoded", test_rt_encoded);
 	vtm_http_router_static_rt(rtr, "/param", test_rt_param);
 	vtm_http_router_static_rt(rtr, "/path", test_rt_path);
+	vtm_http_router_static_rt(rtr, "/ref", test_rt_ref);
+	vtm_http_router_static_rt(rtr, "/own", test_rt_own);
 	vtm_http_router_static_rt(rtr, "/ws", test_rt_ws);
+	vtm_http_router_static_rt(rtr, "/upload", test_rt_upload);
+	vtm_http_router_static_rt(rtr, "/sse", test_rt_sse);
 
 	srv = vtm_http_srv_new();
 	if (!srv)
@@ -175,6 +517,7 @@ static int http_server(void *arg)
 		goto err;
 
 	vtm_http_router_free(rtr);
+	vtm_http_metrics_free(metrics);
 	vtm_http_srv_free(srv);
 
 	return VTM_OK;
@@ -214,7 +557,10 @@ static void test_client(struct vtm_http_client_req *req, struct vtm_http_srv_opt
 	char base_url[256];
 	char urlbuf[256];
 	char portbuf[8];
+	char etagbuf[64];
+	const char *etag;
 	unsigned int sum;
+	size_t i;
 
 	/* prepare base url */
 	portbuf[vtm_fmt_uint(portbuf, opts->port)] = '\0';
@@ -252,6 +598,33 @@ static void test_client(struct vtm_http_client_req *req, struct vtm_http_srv_opt
 
 	vtm_http_client_res_release(&res);
 
+	/* test: referenced and owned bodies */
+	strcpy(urlbuf, base_url);
+	strcat(urlbuf, "/ref");
+	req->url = urlbuf;
+
+	rc = vtm_http_client_request(cl, req, &res);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http client req");
+	VTM_TEST_CHECK(res.body_len == strlen(TEST_RT_REF_DATA) &&
+		strncmp(TEST_RT_REF_DATA, res.body, (size_t) res.body_len) == 0, "http referenced body");
+
+	vtm_http_client_res_release(&res);
+
+	strcpy(urlbuf, base_url);
+	strcat(urlbuf, "/own");
+	req->url = urlbuf;
+
+	rc = vtm_http_client_request(cl, req, &res);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http client req");
+	VTM_TEST_ASSERT(res.body_len == TEST_RT_OWN_SIZE, "http owned body length");
+	for (i=0; i < TEST_RT_OWN_SIZE; i++) {
+		if (((unsigned char*) res.body)[i] != (unsigned char) (i % 251))
+			break;
+	}
+	VTM_TEST_CHECK(i == TEST_RT_OWN_SIZE, "http owned body");
+
+	vtm_http_client_res_release(&res);
+
 	/* test: request param */
 	strcpy(urlbuf, base_url);
 	strcat(urlbuf, "/param?a=39&b=12879&f=dddd");
@@ -267,63 +640,1828 @@ static void test_client(struct vtm_http_client_req *req, struct vtm_http_srv_opt
 
 	vtm_http_client_res_release(&res);
 
+	/* test: file route and conditional request */
+	strcpy(urlbuf, base_url);
+	strcat(urlbuf, "/files/test/data/net/http/test.txt");
+	req->url = urlbuf;
+
+	rc = vtm_http_client_request(cl, req, &res);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http client req");
+	VTM_TEST_CHECK(res.status_code == VTM_HTTP_200_OK, "http file status code");
+	VTM_TEST_ASSERT(res.headers != NULL, "http res headers");
+
+	rc = strncmp("HTTP Test File", res.body, 14);
+	VTM_TEST_CHECK(rc == 0, "http file response");
+
+	etag = vtm_dataset_get_string(res.headers, VTM_HTTP_HEADER_ETAG);
+	VTM_TEST_ASSERT(etag != NULL && strlen(etag) < sizeof(etagbuf), "http file etag");
+	strcpy(etagbuf, etag);
+
+	vtm_http_client_res_release(&res);
+
+	req->headers = vtm_dataset_new();
+	VTM_TEST_ASSERT(req->headers != NULL, "http req headers");
+	vtm_dataset_set_string(req->headers, VTM_HTTP_HEADER_IF_NONE_MATCH, etagbuf);
+
+	rc = vtm_http_client_request(cl, req, &res);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http client req");
+	VTM_TEST_CHECK(res.status_code == VTM_HTTP_304_NOT_MODIFIED, "http file not modified");
+	VTM_TEST_CHECK(res.body_len == 0, "http file not modified body");
+
+	vtm_http_client_res_release(&res);
+
+	/* test: range request */
+	vtm_dataset_free(req->headers);
+	req->headers = vtm_dataset_new();
+	VTM_TEST_ASSERT(req->headers != NULL, "http req headers");
+	vtm_dataset_set_string(req->headers, VTM_HTTP_HEADER_RANGE, "bytes=5-8");
+
+	rc = vtm_http_client_request(cl, req, &res);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http client req");
+	VTM_TEST_CHECK(res.status_code == VTM_HTTP_206_PARTIAL_CONTENT, "http file partial content");
+	VTM_TEST_CHECK(res.body_len == 4 && strncmp("Test", res.body, 4) == 0, "http file range");
+
+	vtm_http_client_res_release(&res);
+
+	/* strong etag satisfies If-Range */
+	vtm_dataset_set_string(req->headers, VTM_HTTP_HEADER_IF_RANGE, etagbuf);
+
+	rc = vtm_http_client_request(cl, req, &res);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http client req");
+	VTM_TEST_CHECK(res.status_code == VTM_HTTP_206_PARTIAL_CONTENT, "http file if-range strong");
+
+	vtm_http_client_res_release(&res);
+
+	/* test: uncached file has a weak etag */
+	vtm_dataset_free(req->headers);
+	req->headers = NULL;
+
+	strcpy(urlbuf, base_url);
+	strcat(urlbuf, "/uncached/test/data/net/http/test.txt");
+
+	rc = vtm_http_client_request(cl, req, &res);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http client req");
+	VTM_TEST_ASSERT(res.headers != NULL, "http res headers");
+
+	etag = vtm_dataset_get_string(res.headers, VTM_HTTP_HEADER_ETAG);
+	VTM_TEST_ASSERT(etag != NULL && strlen(etag) < sizeof(etagbuf), "http file weak etag");
+	VTM_TEST_CHECK(strncmp(etag, "W/\"", 3) == 0, "http file weak etag prefix");
+	strcpy(etagbuf, etag);
+
+	vtm_http_client_res_release(&res);
+
+	req->headers = vtm_dataset_new();
+	VTM_TEST_ASSERT(req->headers != NULL, "http req headers");
+	vtm_dataset_set_string(req->headers, VTM_HTTP_HEADER_IF_NONE_MATCH, etagbuf);
+
+	rc = vtm_http_client_request(cl, req, &res);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http client req");
+	VTM_TEST_CHECK(res.status_code == VTM_HTTP_304_NOT_MODIFIED, "http file weak not modified");
+
+	vtm_http_client_res_release(&res);
+
+	/* weak etag never satisfies If-Range */
+	vtm_dataset_free(req->headers);
+	req->headers = vtm_dataset_new();
+	VTM_TEST_ASSERT(req->headers != NULL, "http req headers");
+	vtm_dataset_set_string(req->headers, VTM_HTTP_HEADER_RANGE, "bytes=5-8");
+	vtm_dataset_set_string(req->headers, VTM_HTTP_HEADER_IF_RANGE, etagbuf);
+
+	rc = vtm_http_client_request(cl, req, &res);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http client req");
+	VTM_TEST_CHECK(res.status_code == VTM_HTTP_200_OK, "http file if-range weak");
+	VTM_TEST_CHECK(res.body_len > 4 && strncmp("HTTP Test File", res.body, 14) == 0, "http file if-range weak body");
+
+	vtm_http_client_res_release(&res);
+
+	vtm_dataset_free(req->headers);
+	req->headers = NULL;
+
 	vtm_http_client_free(cl);
 	VTM_TEST_PASSED("http client free");
 }
 
-#ifdef VTM_MODULE_CRYPTO
-static void test_ws_client(struct vtm_http_srv_opts *opts)
+static void test_upload(struct vtm_http_client_req *req, struct vtm_http_srv_opts *opts)
 {
 	int rc;
-	struct vtm_ws_client *cl;
-	char url[256];
+	vtm_http_client *cl;
+	struct vtm_http_client_res res;
+	char urlbuf[256];
 	char portbuf[8];
-	struct vtm_ws_msg msg;
+	unsigned char *data;
+	char *chunked;
+	size_t i, n, off;
+	uint64_t sum;
 
 	portbuf[vtm_fmt_uint(portbuf, opts->port)] = '\0';
+	strcpy(urlbuf, "http://");
+	strcat(urlbuf, opts->host);
+	strcat(urlbuf, ":");
+	strcat(urlbuf, portbuf);
+	strcat(urlbuf, "/upload");
+
+	data = malloc(TEST_UPLOAD_SIZE);
+	chunked = malloc(TEST_UPLOAD_SIZE * 2);
+	VTM_TEST_ASSERT(data != NULL && chunked != NULL, "http upload alloc");
+
+	sum = 0;
+	for (i=0; i < TEST_UPLOAD_SIZE; i++) {
+		data[i] = (unsigned char) ((i * 7) % 251);
+		sum += data[i];
+	}
 
-	if (opts->tls.enabled)
-		strcpy(url, "https://");
-	else
-		strcpy(url, "http://");
-	strcat(url, opts->host);
-	strcat(url, ":");
-	strcat(url, portbuf);
-	strcat(url, "/ws");
+	cl = vtm_http_client_new();
+	VTM_TEST_ASSERT(cl != NULL, "http client new");
 
-	cl = vtm_ws_client_new();
-	VTM_TEST_ASSERT(cl != NULL, "ws client new");
+	vtm_http_client_set_opt(cl, VTM_HTTP_CL_OPT_TIMEOUT,
+		                    (unsigned long[]) {1000}, sizeof(unsigned long));
 
-	/* disable tls cert checking */
-	if (opts->tls.enabled)
-		vtm_ws_client_set_opt(cl, VTM_WS_CL_OPT_NO_CERT_CHECK, (bool[]) {true}, sizeof(bool));
+	req->method = VTM_HTTP_METHOD_POST;
+	req->url = urlbuf;
 
-	rc = vtm_ws_client_connect(cl, VTM_SOCK_FAM_IN4, url);
-	VTM_TEST_ASSERT(rc == VTM_OK, "ws client connect");
+	/* body with content length */
+	req->body = data;
+	req->body_len = TEST_UPLOAD_SIZE;
 
-	rc = vtm_ws_client_send(cl, VTM_WS_MSG_TEXT, "A", 1);
-	VTM_TEST_CHECK(rc == VTM_OK, "ws client send");
+	rc = vtm_http_client_request(cl, req, &res);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http client req");
+	VTM_TEST_ASSERT(res.headers != NULL, "http res headers");
+	VTM_TEST_CHECK(vtm_dataset_get_uint64(res.headers, "Length") == TEST_UPLOAD_SIZE, "http upload fixed length");
+	VTM_TEST_CHECK(vtm_dataset_get_uint64(res.headers, "Sum") == sum, "http upload fixed data");
+	vtm_http_client_res_release(&res);
 
-	rc = vtm_ws_client_recv(cl, &msg);
-	VTM_TEST_CHECK(rc == VTM_OK, "ws client recv");
-	VTM_TEST_CHECK(msg.type == VTM_WS_MSG_TEXT, "ws client response type");
-	VTM_TEST_CHECK(msg.len == 1, "ws client response length");
-	VTM_TEST_CHECK( *((char*)msg.data) == 'B', "ws client response payload");
+	/* chunked body with varying chunk sizes */
+	off = 0;
+	for (i=0, n=1; i < TEST_UPLOAD_SIZE; i += n, n = n * 3 + 1) {
+		if (n > TEST_UPLOAD_SIZE - i)
+			n = TEST_UPLOAD_SIZE - i;
+		off += sprintf(chunked + off, "%lx\r\n", (unsigned long) n);
+		memcpy(chunked + off, data + i, n);
+		off += n;
+		chunked[off++] = '\r';
+		chunked[off++] = '\n';
+	}
+	off += sprintf(chunked + off, "0\r\n\r\n");
 
-	vtm_ws_msg_release(&msg);
+	req->headers = vtm_dataset_new();
+	VTM_TEST_ASSERT(req->headers != NULL, "http req headers");
+	vtm_dataset_set_string(req->headers, VTM_HTTP_HEADER_TRANSFER_ENCODING, VTM_HTTP_VALUE_CHUNKED);
+	req->body = chunked;
+	req->body_len = off;
 
-	rc = vtm_ws_client_close(cl);
-	VTM_TEST_CHECK(rc == VTM_OK, "ws client close");
+	rc = vtm_http_client_request(cl, req, &res);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http client req");
+	VTM_TEST_ASSERT(res.headers != NULL, "http res headers");
+	VTM_TEST_CHECK(vtm_dataset_get_uint64(res.headers, "Length") == TEST_UPLOAD_SIZE, "http upload chunked length");
+	VTM_TEST_CHECK(vtm_dataset_get_uint64(res.headers, "Sum") == sum, "http upload chunked data");
+	vtm_http_client_res_release(&res);
 
-	vtm_ws_client_free(cl);
-	VTM_TEST_PASSED("ws client free");
-}
-#endif
+	vtm_dataset_free(req->headers);
+	req->headers = NULL;
+	req->body = NULL;
+	req->body_len = 0;
+	req->method = VTM_HTTP_METHOD_GET;
+
+	vtm_http_client_free(cl);
+	free(chunked);
+	free(data);
+}
+
+#ifdef VTM_LIB_ZLIB
+static void test_compress(struct vtm_http_client_req *req, struct vtm_http_srv_opts *opts)
+{
+	int rc;
+	vtm_http_client *cl;
+	struct vtm_http_client_res res;
+	char base_url[256];
+	char urlbuf[256];
+	char portbuf[8];
+	const char *enc, *val;
+	FILE *fp;
+	int i;
+
+	portbuf[vtm_fmt_uint(portbuf, opts->port)] = '\0';
+	strcpy(base_url, "http://");
+	strcat(base_url, opts->host);
+	strcat(base_url, ":");
+	strcat(base_url, portbuf);
+
+	cl = vtm_http_client_new();
+	VTM_TEST_ASSERT(cl != NULL, "http client new");
+
+	vtm_http_client_set_opt(cl, VTM_HTTP_CL_OPT_TIMEOUT,
+		                    (unsigned long[]) {1000}, sizeof(unsigned long));
+
+	/* without accepted encoding */
+	strcpy(urlbuf, base_url);
+	strcat(urlbuf, "/path");
+	req->url = urlbuf;
+
+	rc = vtm_http_client_request(cl, req, &res);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http client req");
+	VTM_TEST_ASSERT(res.headers != NULL, "http res headers");
+	enc = vtm_dataset_get_string(res.headers, VTM_HTTP_HEADER_CONTENT_ENCODING);
+	VTM_TEST_CHECK(enc == NULL, "http compress identity");
+	VTM_TEST_CHECK(res.body_len == 5 && strncmp("/path", res.body, 5) == 0, "http compress identity body");
+	vtm_http_client_res_release(&res);
+
+	/* chunked response with gzip */
+	req->headers = vtm_dataset_new();
+	VTM_TEST_ASSERT(req->headers != NULL, "http req headers");
+	vtm_dataset_set_string(req->headers, VTM_HTTP_HEADER_ACCEPT_ENCODING, "deflate;q=0.5, gzip");
+
+	strcpy(urlbuf, base_url);
+	strcat(urlbuf, "/big");
+
+	rc = vtm_http_client_request(cl, req, &res);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http client req");
+	VTM_TEST_ASSERT(res.headers != NULL, "http res headers");
+	enc = vtm_dataset_get_string(res.headers, VTM_HTTP_HEADER_CONTENT_ENCODING);
+	VTM_TEST_CHECK(enc && strcmp(enc, VTM_HTTP_VALUE_GZIP) == 0, "http compress gzip");
+	VTM_TEST_CHECK(res.body_len > 2 && res.body_len < TEST_RT_BIG_SIZE &&
+		((unsigned char*) res.body)[0] == 0x1f && ((unsigned char*) res.body)[1] == 0x8b,
+		"http compress gzip body");
+	vtm_http_client_res_release(&res);
+
+	/* already encoded by the handler */
+	strcpy(urlbuf, base_url);
+	strcat(urlbuf, "/encoded");
+
+	rc = vtm_http_client_request(cl, req, &res);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http client req");
+	VTM_TEST_ASSERT(res.headers != NULL, "http res headers");
+	enc = vtm_dataset_get_string(res.headers, VTM_HTTP_HEADER_CONTENT_ENCODING);
+	VTM_TEST_CHECK(enc && strcmp(enc, VTM_HTTP_VALUE_GZIP) == 0, "http compress encoded");
+	VTM_TEST_CHECK(vtm_dataset_get_string(res.headers, VTM_HTTP_HEADER_VARY) == NULL, "http compress encoded vary");
+	VTM_TEST_CHECK(res.body_len == TEST_RT_ENC_COUNT * 6 &&
+		strncmp("Hello\n", res.body, 6) == 0, "http compress encoded body");
+	vtm_http_client_res_release(&res);
+
+	/* cached response keeps its media type on a hit */
+	strcpy(urlbuf, base_url);
+	strcat(urlbuf, "/cached?png=1");
+
+	for (i=0; i < 2; i++) {
+		rc = vtm_http_client_request(cl, req, &res);
+		VTM_TEST_ASSERT(rc == VTM_OK, "http client req");
+		VTM_TEST_ASSERT(res.headers != NULL, "http res headers");
+		enc = vtm_dataset_get_string(res.headers, VTM_HTTP_HEADER_CONTENT_ENCODING);
+		VTM_TEST_CHECK(enc == NULL, "http compress cached media type");
+		VTM_TEST_CHECK(res.body_len == TEST_CACHE_PNG_SIZE, "http compress cached body");
+		VTM_TEST_CHECK(i == 0 || vtm_dataset_get_string(res.headers, VTM_HTTP_HEADER_AGE) != NULL,
+			"http compress cache hit");
+		vtm_http_client_res_release(&res);
+	}
+
+	/* precompressed sidecar above compression threshold */
+	fp = fopen(TEST_SIDECAR_FILE, "wb");
+	VTM_TEST_ASSERT(fp != NULL, "http sidecar create");
+	for (i=0; i < TEST_SIDECAR_COUNT; i++)
+		fputs(TEST_SIDECAR_DATA, fp);
+	fclose(fp);
+
+	strcpy(urlbuf, base_url);
+	strcat(urlbuf, "/files/test/data/net/http/test.txt");
+
+	rc = vtm_http_client_request(cl, req, &res);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http client req");
+	VTM_TEST_ASSERT(res.headers != NULL, "http res headers");
+	enc = vtm_dataset_get_string(res.headers, VTM_HTTP_HEADER_CONTENT_ENCODING);
+	VTM_TEST_CHECK(enc && strcmp(enc, VTM_HTTP_VALUE_GZIP) == 0, "http sidecar encoding");
+	val = vtm_dataset_get_string(res.headers, VTM_HTTP_HEADER_CONTENT_TYPE);
+	VTM_TEST_CHECK(val && strcmp(val, "text/plain") == 0, "http sidecar content type");
+	VTM_TEST_CHECK(res.body_len == TEST_SIDECAR_COUNT * strlen(TEST_SIDECAR_DATA) &&
+		strncmp(TEST_SIDECAR_DATA, res.body, strlen(TEST_SIDECAR_DATA)) == 0, "http sidecar body");
+	vtm_http_client_res_release(&res);
+
+	/* alias of the same file shares the sidecar lookup */
+	strcpy(urlbuf, base_url);
+	strcat(urlbuf, "/files/test//data/net/http/../http/test.txt");
+
+	rc = vtm_http_client_request(cl, req, &res);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http client req");
+	VTM_TEST_ASSERT(res.headers != NULL, "http res headers");
+	enc = vtm_dataset_get_string(res.headers, VTM_HTTP_HEADER_CONTENT_ENCODING);
+	VTM_TEST_CHECK(enc && strcmp(enc, VTM_HTTP_VALUE_GZIP) == 0, "http sidecar alias");
+	vtm_http_client_res_release(&res);
+
+	strcpy(urlbuf, base_url);
+	strcat(urlbuf, "/files/test/data/net/http/test.txt");
+
+	/* fixed response below threshold */
+	vtm_dataset_set_string(req->headers, VTM_HTTP_HEADER_ACCEPT_ENCODING, "deflate");
+
+	rc = vtm_http_client_request(cl, req, &res);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http client req");
+	VTM_TEST_ASSERT(res.headers != NULL, "http res headers");
+	enc = vtm_dataset_get_string(res.headers, VTM_HTTP_HEADER_CONTENT_ENCODING);
+	VTM_TEST_CHECK(enc == NULL, "http compress min size");
+	val = vtm_dataset_get_string(res.headers, VTM_HTTP_HEADER_VARY);
+	VTM_TEST_CHECK(val != NULL, "http sidecar vary");
+	vtm_http_client_res_release(&res);
+
+	remove(TEST_SIDECAR_FILE);
+
+	vtm_dataset_free(req->headers);
+	req->headers = NULL;
+
+	vtm_http_client_free(cl);
+}
+#endif
+
+#ifdef VTM_MODULE_CRYPTO
+struct test_cache_worker
+{
+	const char  *url;
+	int32_t     value;
+	int         rc;
+};
+
+static int test_cache_request(const char *url, int32_t *value, bool *has_age)
+{
+	int rc;
+	vtm_http_client *cl;
+	struct vtm_http_client_req req;
+	struct vtm_http_client_res res;
+	char buf[VTM_FMT_CHARS_INT32 + 1];
+
+	cl = vtm_http_client_new();
+	if (!cl)
+		return vtm_err_get_code();
+
+	memset(&req, 0, sizeof(req));
+	req.method = VTM_HTTP_METHOD_GET;
+	req.version = VTM_HTTP_VER_1_1;
+	req.fam = VTM_SOCK_FAM_IN4;
+	req.url = url;
+
+	rc = vtm_http_client_request(cl, &req, &res);
+	if (rc != VTM_OK)
+		goto end;
+
+	if (res.status_code != VTM_HTTP_200_OK || res.body_len == 0 ||
+		res.body_len >= sizeof(buf)) {
+		rc = VTM_ERROR;
+		goto release;
+	}
+
+	memcpy(buf, res.body, (size_t) res.body_len);
+	buf[res.body_len] = '\0';
+	*value = (int32_t) atoi(buf);
+
+	if (has_age)
+		*has_age = vtm_dataset_contains(res.headers, VTM_HTTP_HEADER_AGE);
+
+release:
+	vtm_http_client_res_release(&res);
+
+end:
+	vtm_http_client_free(cl);
+	return rc;
+}
+
+static int test_cache_worker(void *arg)
+{
+	struct test_cache_worker *w;
+
+	w = arg;
+	w->rc = test_cache_request(w->url, &w->value, NULL);
+
+	return VTM_OK;
+}
+
+static void test_micro_cache(struct vtm_http_srv_opts *opts)
+{
+	int rc;
+	size_t i;
+	int32_t calls, v1, v2;
+	bool has_age;
+	struct test_cache_worker workers[TEST_CACHE_THREADS];
+	vtm_thread *threads[TEST_CACHE_THREADS];
+	char base[128];
+	char url[256];
+
+	sprintf(base, "http://%s:%u/cached", opts->host, opts->port);
+
+	/* query order does not matter */
+	calls = VTM_ATOMIC_LOAD_INT32(&cache_calls);
+	sprintf(url, "%s?b=2&a=1", base);
+	rc = test_cache_request(url, &v1, NULL);
+	VTM_TEST_CHECK(rc == VTM_OK, "http cache first request");
+	sprintf(url, "%s?a=1&b=2", base);
+	rc = test_cache_request(url, &v2, &has_age);
+	VTM_TEST_CHECK(rc == VTM_OK, "http cache second request");
+	VTM_TEST_CHECK(v1 == v2, "http cache hit");
+	VTM_TEST_CHECK(has_age, "http cache age header");
+	VTM_TEST_CHECK(VTM_ATOMIC_LOAD_INT32(&cache_calls) == calls + 1, "http cache handler called once");
+
+	/* different query is a different entry */
+	sprintf(url, "%s?a=3", base);
+	rc = test_cache_request(url, &v2, NULL);
+	VTM_TEST_CHECK(rc == VTM_OK && v2 != v1, "http cache query key");
+
+	/* expired entry is recomputed */
+	vtm_thread_sleep(TEST_CACHE_TTL + 50);
+	sprintf(url, "%s?a=1&b=2", base);
+	rc = test_cache_request(url, &v2, NULL);
+	VTM_TEST_CHECK(rc == VTM_OK && v2 != v1, "http cache expired");
+
+	/* uncacheable response */
+	sprintf(url, "%s?nostore=1", base);
+	rc = test_cache_request(url, &v1, NULL);
+	VTM_TEST_CHECK(rc == VTM_OK, "http cache no-store first");
+	rc = test_cache_request(url, &v2, NULL);
+	VTM_TEST_CHECK(rc == VTM_OK && v1 != v2, "http cache no-store");
+
+	/* response depends on other request headers */
+	sprintf(url, "%s?vary=Accept-Encoding,%%20Cookie", base);
+	rc = test_cache_request(url, &v1, NULL);
+	VTM_TEST_CHECK(rc == VTM_OK, "http cache vary first");
+	rc = test_cache_request(url, &v2, NULL);
+	VTM_TEST_CHECK(rc == VTM_OK && v1 != v2, "http cache vary");
+
+	/* only varies by encoding */
+	sprintf(url, "%s?vary=accept-encoding", base);
+	rc = test_cache_request(url, &v1, NULL);
+	VTM_TEST_CHECK(rc == VTM_OK, "http cache vary encoding first");
+	rc = test_cache_request(url, &v2, NULL);
+	VTM_TEST_CHECK(rc == VTM_OK && v1 == v2, "http cache vary encoding");
+
+	/* concurrent misses are coalesced */
+	calls = VTM_ATOMIC_LOAD_INT32(&cache_calls);
+	sprintf(url, "%s?slow=1", base);
+	for (i=0; i < TEST_CACHE_THREADS; i++) {
+		workers[i].url = url;
+		workers[i].value = 0;
+		workers[i].rc = VTM_ERROR;
+		threads[i] = vtm_thread_new(test_cache_worker, &workers[i]);
+		VTM_TEST_ASSERT(threads[i] != NULL, "http cache thread");
+	}
+
+	for (i=0; i < TEST_CACHE_THREADS; i++) {
+		vtm_thread_join(threads[i]);
+		vtm_thread_free(threads[i]);
+		VTM_TEST_CHECK(workers[i].rc == VTM_OK, "http cache concurrent request");
+		VTM_TEST_CHECK(workers[i].value == workers[0].value, "http cache concurrent value");
+	}
+	VTM_TEST_CHECK(VTM_ATOMIC_LOAD_INT32(&cache_calls) == calls + 1, "http cache coalesced");
+}
+
+static void test_access_log(void)
+{
+	FILE *fp;
+	char *line;
+	size_t line_len;
+	bool found;
+
+	fp = fopen(TEST_ACCESS_LOG, "r");
+	VTM_TEST_ASSERT(fp != NULL, "http access log written");
+
+	found = false;
+	line = NULL;
+	line_len = 0;
+	while (!found && vtm_file_getline(fp, &line, &line_len) == VTM_OK)
+		found = strstr(line, "\"GET /ref HTTP/1.1\" 200 ") != NULL;
+
+	free(line);
+	fclose(fp);
+	remove(TEST_ACCESS_LOG);
+
+	VTM_TEST_CHECK(found, "http access log request");
+}
+
+static void test_metrics(struct vtm_http_srv_opts *opts)
+{
+	int rc;
+	int i;
+	vtm_http_client *cl;
+	struct vtm_http_client_req req;
+	struct vtm_http_client_res res;
+	char url[256];
+	char *body;
+
+	cl = vtm_http_client_new();
+	VTM_TEST_ASSERT(cl != NULL, "http metrics client");
+
+	memset(&req, 0, sizeof(req));
+	req.method = VTM_HTTP_METHOD_GET;
+	req.version = VTM_HTTP_VER_1_1;
+	req.fam = VTM_SOCK_FAM_IN4;
+	req.url = url;
+
+	sprintf(url, "http://%s:%u/ref", opts->host, opts->port);
+	for (i=0; i < 3; i++) {
+		rc = vtm_http_client_request(cl, &req, &res);
+		VTM_TEST_CHECK(rc == VTM_OK, "http metrics request");
+		if (rc == VTM_OK)
+			vtm_http_client_res_release(&res);
+	}
+
+	sprintf(url, "http://%s:%u/metrics", opts->host, opts->port);
+	rc = vtm_http_client_request(cl, &req, &res);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http metrics scrape");
+	VTM_TEST_CHECK(res.status_code == VTM_HTTP_200_OK, "http metrics status");
+
+	body = malloc((size_t) res.body_len + 1);
+	VTM_TEST_ASSERT(body != NULL, "http metrics body");
+	memcpy(body, res.body, (size_t) res.body_len);
+	body[res.body_len] = '\0';
+
+	VTM_TEST_CHECK(strstr(body, "vtm_http_requests_total{method=\"any\",route=\"/ref\"} 3\n") != NULL,
+		"http metrics route counted");
+	VTM_TEST_CHECK(strstr(body, "vtm_http_responses_total{method=\"any\",route=\"/ref\",code=\"2xx\"} 3\n") != NULL,
+		"http metrics route status class");
+	VTM_TEST_CHECK(strstr(body, "vtm_http_request_duration_seconds_count{method=\"any\",route=\"/ref\"} 3\n") != NULL,
+		"http metrics route latency");
+
+	free(body);
+	vtm_http_client_res_release(&res);
+	vtm_http_client_free(cl);
+}
+
+static vtm_socket* test_limit_connect(struct vtm_http_srv_opts *opts)
+{
+	int rc;
+	vtm_socket *sock;
+
+	sock = vtm_socket_new(VTM_SOCK_FAM_IN4, VTM_SOCK_TYPE_STREAM);
+	VTM_TEST_ASSERT(sock != NULL, "http limit socket");
+
+	rc = vtm_socket_connect(sock, opts->host, opts->port);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http limit connect");
+
+	vtm_socket_set_opt(sock, VTM_SOCK_OPT_RECV_TIMEOUT, (unsigned long[]) {2000}, sizeof(unsigned long));
+
+	return sock;
+}
+
+static int test_limit_request(vtm_socket *sock, char *buf, size_t len)
+{
+	int rc;
+	size_t used, n;
+
+	static const char request[] = "GET /ref HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+	rc = vtm_socket_write(sock, request, sizeof(request) - 1, &n);
+	if (rc != VTM_OK)
+		return rc;
+
+	used = 0;
+	buf[0] = '\0';
+	while (!strstr(buf, "\r\n\r\n")) {
+		if (used + 1 >= len)
+			return VTM_ERROR;
+
+		rc = vtm_socket_read(sock, buf + used, len - used - 1, &n);
+		if (rc != VTM_OK)
+			return rc;
+
+		used += n;
+		buf[used] = '\0';
+	}
+
+	return VTM_OK;
+}
+
+static void test_limits(struct vtm_http_srv_opts *opts)
+{
+	int rc;
+	unsigned int i;
+	vtm_socket *socks[3];
+	char buf[1024];
+
+	/* connections are accepted in order, the third exceeds the cap */
+	for (i=0; i < 3; i++)
+		socks[i] = test_limit_connect(opts);
+
+	rc = test_limit_request(socks[2], buf, sizeof(buf));
+	VTM_TEST_CHECK(rc != VTM_OK, "http limit connections per ip");
+
+	/* the burst is shared by all connections of the client */
+	rc = test_limit_request(socks[0], buf, sizeof(buf));
+	VTM_TEST_CHECK(rc == VTM_OK && strncmp(buf, "HTTP/1.1 200", 12) == 0, "http limit first connection");
+
+	for (i=1; i < TEST_LIMIT_BURST; i++) {
+		rc = test_limit_request(socks[1], buf, sizeof(buf));
+		VTM_TEST_CHECK(rc == VTM_OK && strncmp(buf, "HTTP/1.1 200", 12) == 0, "http limit burst");
+	}
+
+	rc = test_limit_request(socks[1], buf, sizeof(buf));
+	VTM_TEST_CHECK(rc == VTM_OK && strncmp(buf, "HTTP/1.1 429", 12) == 0, "http limit rate exceeded");
+	VTM_TEST_CHECK(strstr(buf, "\r\nRetry-After: 1\r\n") != NULL, "http limit retry after");
+
+	for (i=0; i < 3; i++) {
+		vtm_socket_close(socks[i]);
+		vtm_socket_free(socks[i]);
+	}
+}
+
+static void test_sse(struct vtm_http_srv_opts *opts)
+{
+	int rc;
+	unsigned int i;
+	size_t used, n;
+	vtm_socket *sock;
+	char buf[1024];
+	struct vtm_http_sse_event ev;
+
+	static const char request[] = "GET /sse HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+	sse_chan = vtm_http_sse_chan_new();
+	VTM_TEST_ASSERT(sse_chan != NULL, "http sse channel");
+
+	sock = test_limit_connect(opts);
+	rc = vtm_socket_write(sock, request, sizeof(request) - 1, &n);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http sse request");
+
+	used = 0;
+	buf[0] = '\0';
+	while (!strstr(buf, "\r\n\r\n") && used + 1 < sizeof(buf)) {
+		rc = vtm_socket_read(sock, buf + used, sizeof(buf) - used - 1, &n);
+		if (rc != VTM_OK)
+			break;
+		used += n;
+		buf[used] = '\0';
+	}
+	VTM_TEST_ASSERT(strncmp(buf, "HTTP/1.1 200", 12) == 0, "http sse status");
+	VTM_TEST_CHECK(strstr(buf, "\r\nContent-Type: text/event-stream\r\n") != NULL, "http sse content type");
+	VTM_TEST_CHECK(strstr(buf, "\r\nTransfer-Encoding: chunked\r\n") != NULL, "http sse chunked");
+
+	/* handler subscribes after the headers were sent */
+	for (i=0; i < 100 && vtm_http_sse_chan_count(sse_chan) == 0; i++)
+		vtm_thread_sleep(10);
+	VTM_TEST_ASSERT(vtm_http_sse_chan_count(sse_chan) == 1, "http sse subscribed");
+
+	memset(&ev, 0, sizeof(ev));
+	ev.id = "1";
+	ev.event = "tick";
+	ev.data = "a\r\nb";
+	ev.data_len = 4;
+	rc = vtm_http_sse_chan_publish(sse_chan, &ev);
+	VTM_TEST_CHECK(rc == VTM_OK, "http sse publish");
+
+	used = 0;
+	while (used < sizeof(TEST_SSE_CHUNK) - 1) {
+		rc = vtm_socket_read(sock, buf + used, sizeof(TEST_SSE_CHUNK) - 1 - used, &n);
+		if (rc != VTM_OK)
+			break;
+		used += n;
+	}
+	VTM_TEST_CHECK(used == sizeof(TEST_SSE_CHUNK) - 1 && memcmp(buf, TEST_SSE_CHUNK, used) == 0,
+		"http sse event");
+
+	ev.id = "invalid\n";
+	VTM_TEST_CHECK(vtm_http_sse_chan_publish(sse_chan, &ev) == VTM_E_INVALID_ARG, "http sse invalid id");
+
+	/* closed streams are dropped by the next publish */
+	vtm_socket_close(sock);
+	vtm_socket_free(sock);
+
+	ev.id = NULL;
+	for (i=0; i < 100 && vtm_http_sse_chan_count(sse_chan) > 0; i++) {
+		vtm_http_sse_chan_publish(sse_chan, &ev);
+		vtm_thread_sleep(10);
+	}
+	VTM_TEST_CHECK(vtm_http_sse_chan_count(sse_chan) == 0, "http sse closed");
+
+	vtm_http_sse_chan_free(sse_chan);
+	sse_chan = NULL;
+}
+
+struct test_pool_worker
+{
+	vtm_http_client_pool  *pool;
+	const char            *url;
+	unsigned int          failed;
+};
+
+static int test_pool_request(vtm_http_client *cl, const char *url)
+{
+	int rc;
+	struct vtm_http_client_req req;
+	struct vtm_http_client_res res;
+
+	memset(&req, 0, sizeof(req));
+	req.method = VTM_HTTP_METHOD_GET;
+	req.version = VTM_HTTP_VER_1_1;
+	req.fam = VTM_SOCK_FAM_IN4;
+	req.url = url;
+
+	rc = vtm_http_client_request(cl, &req, &res);
+	if (rc != VTM_OK)
+		return rc;
+
+	if (res.body_len != strlen(TEST_RT_REF_DATA) ||
+		strncmp(TEST_RT_REF_DATA, res.body, (size_t) res.body_len) != 0)
+		rc = VTM_ERROR;
+
+	vtm_http_client_res_release(&res);
+
+	return rc;
+}
+
+static int test_pool_worker(void *arg)
+{
+	int i;
+	vtm_http_client *cl;
+	struct test_pool_worker *w;
+
+	w = arg;
+
+	cl = vtm_http_client_new();
+	if (!cl)
+		return VTM_ERROR;
+
+	vtm_http_client_set_opt(cl, VTM_HTTP_CL_OPT_POOL, &w->pool, sizeof(w->pool));
+	vtm_http_client_set_opt(cl, VTM_HTTP_CL_OPT_TIMEOUT,
+		(unsigned long[]) {1000}, sizeof(unsigned long));
+
+	for (i=0; i < 20; i++) {
+		if (test_pool_request(cl, w->url) != VTM_OK)
+			w->failed++;
+	}
+
+	vtm_http_client_free(cl);
+
+	return VTM_OK;
+}
+
+static void test_client_pool(struct vtm_http_srv_opts *opts)
+{
+	int rc;
+	size_t i;
+	vtm_http_client_pool *pool;
+	vtm_http_client *cl[2];
+	struct vtm_http_client_pool_opts pool_opts;
+	struct vtm_http_client_pool_stats stats;
+	struct test_pool_worker workers[4];
+	vtm_thread *threads[4];
+	char url[256];
+	char portbuf[8];
+
+	portbuf[vtm_fmt_uint(portbuf, opts->port)] = '\0';
+	strcpy(url, "http://");
+	strcat(url, opts->host);
+	strcat(url, ":");
+	strcat(url, portbuf);
+	strcat(url, "/ref");
+
+	pool_opts.max_idle = 4;
+	pool_opts.max_per_host = 2;
+	pool_opts.idle_timeout = 0;
+
+	pool = vtm_http_client_pool_new(&pool_opts);
+	VTM_TEST_ASSERT(pool != NULL, "http pool new");
+
+	for (i=0; i < 2; i++) {
+		cl[i] = vtm_http_client_new();
+		VTM_TEST_ASSERT(cl[i] != NULL, "http client new");
+		rc = vtm_http_client_set_opt(cl[i], VTM_HTTP_CL_OPT_POOL, &pool, sizeof(pool));
+		VTM_TEST_CHECK(rc == VTM_OK, "http client set pool");
+	}
+
+	/* second client reuses connection of first one */
+	rc = test_pool_request(cl[0], url);
+	VTM_TEST_CHECK(rc == VTM_OK, "http pool first request");
+	rc = test_pool_request(cl[1], url);
+	VTM_TEST_CHECK(rc == VTM_OK, "http pool second request");
+
+	vtm_http_client_pool_get_stats(pool, &stats);
+	VTM_TEST_CHECK(stats.misses == 1 && stats.hits == 1, "http pool hit");
+	VTM_TEST_CHECK(stats.idle == 1, "http pool idle count");
+
+	/* concurrent clients share at most two connections */
+	for (i=0; i < 4; i++) {
+		workers[i].pool = pool;
+		workers[i].url = url;
+		workers[i].failed = 0;
+		threads[i] = vtm_thread_new(test_pool_worker, &workers[i]);
+		VTM_TEST_ASSERT(threads[i] != NULL, "http pool thread");
+	}
+
+	for (i=0; i < 4; i++) {
+		vtm_thread_join(threads[i]);
+		VTM_TEST_CHECK(vtm_thread_get_result(threads[i]) == VTM_OK &&
+			workers[i].failed == 0, "http pool concurrent requests");
+		vtm_thread_free(threads[i]);
+	}
+
+	vtm_http_client_pool_get_stats(pool, &stats);
+	VTM_TEST_CHECK(stats.hits + stats.misses == 82, "http pool request count");
+	VTM_TEST_CHECK(stats.misses <= 2 && stats.idle <= 2, "http pool per host limit");
+
+	/* connections closed by the server are detected before reuse */
+	stop_server();
+	start_server(opts);
+
+	rc = test_pool_request(cl[0], url);
+	VTM_TEST_CHECK(rc == VTM_OK, "http pool request after restart");
+
+	vtm_http_client_pool_get_stats(pool, &stats);
+	VTM_TEST_CHECK(stats.stale > 0, "http pool stale connection");
+
+	for (i=0; i < 2; i++)
+		vtm_http_client_free(cl[i]);
+	vtm_http_client_pool_free(pool);
+
+	/* idle timeout */
+	pool_opts.idle_timeout = 1;
+	pool = vtm_http_client_pool_new(&pool_opts);
+	VTM_TEST_ASSERT(pool != NULL, "http pool new");
+
+	cl[0] = vtm_http_client_new();
+	VTM_TEST_ASSERT(cl[0] != NULL, "http client new");
+	vtm_http_client_set_opt(cl[0], VTM_HTTP_CL_OPT_POOL, &pool, sizeof(pool));
+
+	rc = test_pool_request(cl[0], url);
+	VTM_TEST_CHECK(rc == VTM_OK, "http pool request");
+
+	vtm_thread_sleep(10);
+	vtm_http_client_pool_evict(pool);
+
+	vtm_http_client_pool_get_stats(pool, &stats);
+	VTM_TEST_CHECK(stats.idle == 0 && stats.evicted == 1, "http pool idle eviction");
+
+	vtm_http_client_free(cl[0]);
+	vtm_http_client_pool_free(pool);
+}
+
+struct test_async_state
+{
+	struct vtm_latch  latch;
+	unsigned int      ok;
+	unsigned int      timeouts;
+};
+
+struct test_async_arg
+{
+	struct test_async_state  *state;
+	bool                     own;
+};
+
+static void test_async_cb(void *arg, int rc, struct vtm_http_client_res *res)
+{
+	size_t i;
+	struct test_async_arg *a;
+
+	a = arg;
+
+	if (rc == VTM_E_IO_TIMEOUT)
+		a->state->timeouts++;
+
+	if (rc != VTM_OK || res->status_code != VTM_HTTP_200_OK)
+		goto end;
+
+	if (a->own) {
+		if (res->body_len != TEST_RT_OWN_SIZE)
+			goto end;
+		for (i=0; i < TEST_RT_OWN_SIZE; i++)
+			if (((unsigned char*) res->body)[i] != (unsigned char) (i % 251))
+				goto end;
+	}
+	else if (res->body_len != strlen(TEST_RT_REF_DATA) ||
+		strncmp(TEST_RT_REF_DATA, res->body, (size_t) res->body_len) != 0) {
+		goto end;
+	}
+
+	a->state->ok++;
+
+end:
+	vtm_latch_count(&a->state->latch);
+}
+
+static int test_async_loop(void *arg)
+{
+	return vtm_http_client_async_run(arg);
+}
+
+static void test_client_async(struct vtm_http_srv_opts *opts)
+{
+	int rc, round;
+	size_t i;
+	vtm_http_client_async *cl;
+	vtm_thread *loop;
+	vtm_socket *silent;
+	struct vtm_http_client_req req;
+	struct test_async_state state;
+	struct test_async_arg args[2];
+	char base_url[256];
+	char urlbuf[2][256];
+	char portbuf[8];
+
+	portbuf[vtm_fmt_uint(portbuf, opts->port)] = '\0';
+	strcpy(base_url, opts->tls.enabled ? "https://" : "http://");
+	strcat(base_url, opts->host);
+	strcat(base_url, ":");
+	strcat(base_url, portbuf);
+
+	strcpy(urlbuf[0], base_url);
+	strcat(urlbuf[0], "/ref");
+	strcpy(urlbuf[1], base_url);
+	strcat(urlbuf[1], "/own");
+
+	cl = vtm_http_client_async_new();
+	VTM_TEST_ASSERT(cl != NULL, "http async client new");
+
+	if (opts->tls.enabled)
+		vtm_http_client_async_set_opt(cl, VTM_HTTP_CL_ASYNC_OPT_NO_CERT_CHECK, (bool[]) {true}, sizeof(bool));
+
+	loop = vtm_thread_new(test_async_loop, cl);
+	VTM_TEST_ASSERT(loop != NULL, "http async client thread");
+
+	memset(&req, 0, sizeof(req));
+	req.method = VTM_HTTP_METHOD_GET;
+	req.version = VTM_HTTP_VER_1_1;
+	req.fam = VTM_SOCK_FAM_IN4;
+
+	for (i=0; i < 2; i++) {
+		args[i].state = &state;
+		args[i].own = i == 1;
+	}
+
+	/* fan out, second round reuses idle connections */
+	for (round=0; round < 2; round++) {
+		state.ok = 0;
+		state.timeouts = 0;
+		vtm_latch_init(&state.latch, 50);
+
+		for (i=0; i < 50; i++) {
+			req.url = urlbuf[i % 2];
+			rc = vtm_http_client_async_request(cl, &req, 5000, test_async_cb, &args[i % 2]);
+			VTM_TEST_CHECK(rc == VTM_OK, "http async request");
+		}
+
+		vtm_latch_await(&state.latch);
+		vtm_latch_release(&state.latch);
+		VTM_TEST_CHECK(state.ok == 50, "http async responses");
+	}
+
+	/* server that accepts connections but never answers */
+	silent = vtm_socket_new(VTM_SOCK_FAM_IN4, VTM_SOCK_TYPE_STREAM);
+	VTM_TEST_ASSERT(silent != NULL, "http async silent socket");
+	rc = vtm_socket_bind(silent, opts->host, opts->port + 1);
+	VTM_TEST_CHECK(rc == VTM_OK, "http async silent bind");
+	rc = vtm_socket_listen(silent, 10);
+	VTM_TEST_CHECK(rc == VTM_OK, "http async silent listen");
+
+	portbuf[vtm_fmt_uint(portbuf, opts->port + 1)] = '\0';
+	strcpy(urlbuf[0], "http://");
+	strcat(urlbuf[0], opts->host);
+	strcat(urlbuf[0], ":");
+	strcat(urlbuf[0], portbuf);
+	strcat(urlbuf[0], "/ref");
+
+	state.ok = 0;
+	state.timeouts = 0;
+	vtm_latch_init(&state.latch, 1);
+
+	req.url = urlbuf[0];
+	rc = vtm_http_client_async_request(cl, &req, 100, test_async_cb, &args[0]);
+	VTM_TEST_CHECK(rc == VTM_OK, "http async request");
+
+	vtm_latch_await(&state.latch);
+	vtm_latch_release(&state.latch);
+	VTM_TEST_CHECK(state.timeouts == 1, "http async deadline");
+
+	vtm_socket_close(silent);
+	vtm_socket_free(silent);
+
+	vtm_http_client_async_stop(cl);
+	vtm_thread_join(loop);
+	VTM_TEST_CHECK(vtm_thread_get_result(loop) == VTM_OK, "http async client stopped");
+	vtm_thread_free(loop);
+
+	vtm_http_client_async_free(cl);
+}
+
+static void test_ws_client(struct vtm_http_srv_opts *opts)
+{
+	int rc;
+	unsigned int i;
+	struct vtm_ws_client *cl;
+	char url[256];
+	char portbuf[8];
+	struct vtm_ws_msg msg;
+
+	portbuf[vtm_fmt_uint(portbuf, opts->port)] = '\0';
+
+	if (opts->tls.enabled)
+		strcpy(url, "https://");
+	else
+		strcpy(url, "http://");
+	strcat(url, opts->host);
+	strcat(url, ":");
+	strcat(url, portbuf);
+	strcat(url, "/ws");
+
+	cl = vtm_ws_client_new();
+	VTM_TEST_ASSERT(cl != NULL, "ws client new");
+
+	/* disable tls cert checking */
+	if (opts->tls.enabled)
+		vtm_ws_client_set_opt(cl, VTM_WS_CL_OPT_NO_CERT_CHECK, (bool[]) {true}, sizeof(bool));
+
+	rc = vtm_ws_client_connect(cl, VTM_SOCK_FAM_IN4, url);
+	VTM_TEST_ASSERT(rc == VTM_OK, "ws client connect");
+
+	rc = vtm_ws_client_send(cl, VTM_WS_MSG_TEXT, "A", 1);
+	VTM_TEST_CHECK(rc == VTM_OK, "ws client send");
+
+	rc = vtm_ws_client_recv(cl, &msg);
+	VTM_TEST_CHECK(rc == VTM_OK, "ws client recv");
+	VTM_TEST_CHECK(msg.type == VTM_WS_MSG_TEXT, "ws client response type");
+	VTM_TEST_CHECK(msg.len == 1, "ws client response length");
+	VTM_TEST_CHECK( *((char*)msg.data) == 'B', "ws client response payload");
+
+	vtm_ws_msg_release(&msg);
+
+	/* joining triggers a broadcast to the group */
+	rc = vtm_ws_client_send(cl, VTM_WS_MSG_TEXT, "J", 1);
+	VTM_TEST_CHECK(rc == VTM_OK, "ws client join");
+
+	rc = vtm_ws_client_recv(cl, &msg);
+	VTM_TEST_CHECK(rc == VTM_OK && msg.type == VTM_WS_MSG_BINARY && msg.len == sizeof(ws_group_data) &&
+		memcmp(msg.data, ws_group_data, msg.len) == 0, "ws group broadcast");
+	if (rc == VTM_OK)
+		vtm_ws_msg_release(&msg);
+
+	rc = vtm_ws_client_close(cl);
+	VTM_TEST_CHECK(rc == VTM_OK, "ws client close");
+
+	vtm_ws_client_free(cl);
+	VTM_TEST_PASSED("ws client free");
+
+	for (i=0; i < 100 && vtm_ws_group_count(ws_group) > 0; i++)
+		vtm_thread_sleep(10);
+	VTM_TEST_CHECK(vtm_ws_group_count(ws_group) == 0, "ws group left");
+}
+
+#ifdef VTM_LIB_ZLIB
+static void test_ws_deflate(struct vtm_http_srv_opts *opts, bool no_context_takeover)
+{
+	int rc;
+	unsigned int i;
+	struct vtm_ws_client *cl;
+	struct vtm_ws_deflate_opts df_opts;
+	struct vtm_buf json;
+	char url[256];
+	struct vtm_ws_msg msg;
+	bool ok;
+
+	sprintf(url, "http://%s:%u/ws", opts->host, opts->port);
+
+	vtm_buf_init(&json, VTM_BYTEORDER_LE);
+	for (i=0; i < 100; i++)
+		vtm_buf_puts(&json, TEST_WS_JSON);
+
+	cl = vtm_ws_client_new();
+	VTM_TEST_ASSERT(cl != NULL, "ws deflate client new");
+
+	memset(&df_opts, 0, sizeof(df_opts));
+	df_opts.enabled = true;
+	df_opts.max_window_bits = 12;
+	df_opts.no_context_takeover = no_context_takeover;
+	rc = vtm_ws_client_set_opt(cl, VTM_WS_CL_OPT_DEFLATE, &df_opts, sizeof(df_opts));
+	VTM_TEST_CHECK(rc == VTM_OK, "ws deflate client opt");
+
+	rc = vtm_ws_client_connect(cl, VTM_SOCK_FAM_IN4, url);
+	VTM_TEST_ASSERT(rc == VTM_OK, "ws deflate client connect");
+
+	/* echo in both directions, later messages use the previous context */
+	ok = true;
+	for (i=0; i < 3 && ok; i++) {
+		rc = vtm_ws_client_send(cl, VTM_WS_MSG_TEXT, json.data, json.used);
+		ok = (rc == VTM_OK);
+		if (ok) {
+			rc = vtm_ws_client_recv(cl, &msg);
+			ok = (rc == VTM_OK && msg.type == VTM_WS_MSG_TEXT && msg.len == json.used &&
+				memcmp(msg.data, json.data, json.used) == 0);
+			if (rc == VTM_OK)
+				vtm_ws_msg_release(&msg);
+		}
+	}
+	VTM_TEST_CHECK(ok, "ws deflate echo");
+
+	/* small messages are not compressed */
+	rc = vtm_ws_client_send(cl, VTM_WS_MSG_TEXT, "A", 1);
+	VTM_TEST_CHECK(rc == VTM_OK, "ws deflate small send");
+	rc = vtm_ws_client_recv(cl, &msg);
+	VTM_TEST_CHECK(rc == VTM_OK && msg.len == 1 && *((char*) msg.data) == 'B', "ws deflate small recv");
+	if (rc == VTM_OK)
+		vtm_ws_msg_release(&msg);
+
+	if (no_context_takeover)
+		VTM_TEST_CHECK(vtm_ws_deflate_get_mem_usage() == 0, "ws deflate no context memory");
+	else
+		VTM_TEST_CHECK(vtm_ws_deflate_get_mem_usage() > 0, "ws deflate context memory");
+
+	/* shared or per member compressed broadcast */
+	rc = vtm_ws_client_send(cl, VTM_WS_MSG_TEXT, "J", 1);
+	VTM_TEST_CHECK(rc == VTM_OK, "ws deflate join");
+	rc = vtm_ws_client_recv(cl, &msg);
+	VTM_TEST_CHECK(rc == VTM_OK && msg.type == VTM_WS_MSG_BINARY && msg.len == sizeof(ws_group_data) &&
+		memcmp(msg.data, ws_group_data, msg.len) == 0, "ws deflate broadcast");
+	if (rc == VTM_OK)
+		vtm_ws_msg_release(&msg);
+
+	vtm_ws_client_close(cl);
+	vtm_ws_client_free(cl);
+	vtm_buf_release(&json);
+
+	/* server releases its state after the close callback */
+	for (i=0; i < 100 && (vtm_ws_group_count(ws_group) > 0 || vtm_ws_deflate_get_mem_usage() > 0); i++)
+		vtm_thread_sleep(10);
+	VTM_TEST_CHECK(vtm_ws_deflate_get_mem_usage() == 0, "ws deflate memory released");
+}
+#endif
+
+static vtm_ws_client* test_ws_connect(struct vtm_http_srv_opts *opts)
+{
+	vtm_ws_client *cl;
+	char url[256];
+
+	sprintf(url, "http://%s:%u/ws", opts->host, opts->port);
+
+	cl = vtm_ws_client_new();
+	if (!cl)
+		return NULL;
+
+	vtm_ws_client_set_opt(cl, VTM_WS_CL_OPT_TIMEOUT, (unsigned long[]) {2000}, sizeof(unsigned long));
+	if (vtm_ws_client_connect(cl, VTM_SOCK_FAM_IN4, url) != VTM_OK) {
+		vtm_ws_client_free(cl);
+		return NULL;
+	}
+
+	return cl;
+}
+
+static void test_ws_keepalive(struct vtm_http_srv_opts *opts)
+{
+	int rc;
+	unsigned int pings;
+	vtm_ws_client *cl;
+	struct vtm_ws_msg msg;
+	bool ok;
+
+	/* answered pings keep the connection open */
+	cl = test_ws_connect(opts);
+	VTM_TEST_ASSERT(cl != NULL, "ws keepalive connect");
+
+	ok = true;
+	for (pings=0; pings < 2 && ok; pings++) {
+		rc = vtm_ws_client_recv(cl, &msg);
+		ok = (rc == VTM_OK && msg.type == VTM_WS_MSG_PING);
+		if (rc == VTM_OK) {
+			vtm_ws_client_send(cl, VTM_WS_MSG_PONG, msg.data, msg.len);
+			vtm_ws_msg_release(&msg);
+		}
+	}
+	VTM_TEST_CHECK(ok, "ws keepalive pinged");
+
+	rc = vtm_ws_client_send(cl, VTM_WS_MSG_TEXT, "A", 1);
+	VTM_TEST_CHECK(rc == VTM_OK, "ws keepalive send");
+	while ((rc = vtm_ws_client_recv(cl, &msg)) == VTM_OK && msg.type == VTM_WS_MSG_PING)
+		vtm_ws_msg_release(&msg);
+	VTM_TEST_CHECK(rc == VTM_OK && msg.type == VTM_WS_MSG_TEXT && msg.len == 1 &&
+		*((char*) msg.data) == 'B', "ws keepalive alive");
+	if (rc == VTM_OK)
+		vtm_ws_msg_release(&msg);
+
+	vtm_ws_client_close(cl);
+	vtm_ws_client_free(cl);
+
+	/* a silent peer is disconnected after the pong timeout */
+	cl = test_ws_connect(opts);
+	VTM_TEST_ASSERT(cl != NULL, "ws keepalive silent connect");
+
+	pings = 0;
+	while ((rc = vtm_ws_client_recv(cl, &msg)) == VTM_OK) {
+		if (msg.type == VTM_WS_MSG_PING)
+			pings++;
+		vtm_ws_msg_release(&msg);
+	}
+	VTM_TEST_CHECK(pings > 0, "ws keepalive silent pinged");
+	VTM_TEST_CHECK(rc != VTM_E_IO_TIMEOUT, "ws keepalive silent closed");
+
+	vtm_ws_client_free(cl);
+}
+
+static void test_ws_slow_consumer(struct vtm_http_srv_opts *opts)
+{
+	int rc;
+	unsigned int i, received;
+	vtm_ws_client *cl;
+	struct vtm_ws_msg msg;
+	bool done;
+
+	vtm_atomic_flag_init(ws_congested, false);
+	vtm_atomic_flag_init(ws_relieved, false);
+
+	cl = test_ws_connect(opts);
+	VTM_TEST_ASSERT(cl != NULL, "ws slow connect");
+
+	rc = vtm_ws_client_send(cl, VTM_WS_MSG_TEXT, "F", 1);
+	VTM_TEST_CHECK(rc == VTM_OK, "ws slow flood");
+
+	/* server queue overflows while nothing is read */
+	vtm_thread_sleep(500);
+	VTM_TEST_CHECK(VTM_ATOMIC_LOAD_INT32(&ws_congested) == 1, "ws slow congested");
+
+	received = 0;
+	done = false;
+	while (!done && (rc = vtm_ws_client_recv(cl, &msg)) == VTM_OK) {
+		if (msg.type == VTM_WS_MSG_BINARY && msg.len == sizeof(ws_group_data))
+			received++;
+		else if (msg.type == VTM_WS_MSG_TEXT && msg.len == 1 && *((char*) msg.data) == 'E')
+			done = true;
+		vtm_ws_msg_release(&msg);
+	}
+	VTM_TEST_CHECK(done, "ws slow marker received");
+	VTM_TEST_CHECK(received > 0 && received < TEST_WS_FLOOD_COUNT, "ws slow oldest dropped");
+
+	for (i=0; i < 100 && VTM_ATOMIC_LOAD_INT32(&ws_relieved) == 0; i++)
+		vtm_thread_sleep(10);
+	VTM_TEST_CHECK(VTM_ATOMIC_LOAD_INT32(&ws_relieved) == 1, "ws slow relieved");
+
+	vtm_ws_client_close(cl);
+	vtm_ws_client_free(cl);
+}
+
+static int test_ws_group_reader(void *arg)
+{
+	struct test_ws_reader *r;
+	struct vtm_ws_msg msg;
+
+	r = arg;
+	while (!r->done && vtm_ws_client_recv(r->cl, &msg) == VTM_OK) {
+		if (msg.type == VTM_WS_MSG_BINARY && msg.len == sizeof(ws_group_data))
+			r->received++;
+		else if (msg.type == VTM_WS_MSG_TEXT && msg.len == 1 && *((char*) msg.data) == 'E')
+			r->done = true;
+		vtm_ws_msg_release(&msg);
+	}
+	vtm_ws_msg_pool_clear();
+
+	return VTM_OK;
+}
+
+static void test_ws_group_congestion(struct vtm_http_srv_opts *opts)
+{
+	int rc;
+	unsigned int i;
+	vtm_ws_client *slow;
+	struct test_ws_reader readers[TEST_WS_GROUP_MEMBERS - 1];
+	vtm_thread *threads[TEST_WS_GROUP_MEMBERS - 1];
+
+	VTM_ATOMIC_ZERO_INT32(&ws_broadcasts);
+
+	/* slow member is not the last one, so leaving moves another member */
+	slow = test_ws_connect(opts);
+	VTM_TEST_ASSERT(slow != NULL, "ws group congestion connect");
+	rc = vtm_ws_client_send(slow, VTM_WS_MSG_TEXT, "S", 1);
+	VTM_TEST_CHECK(rc == VTM_OK, "ws group congestion slow join");
+	for (i=0; i < 100 && vtm_ws_group_count(ws_group) < 1; i++)
+		vtm_thread_sleep(10);
+
+	for (i=0; i < TEST_WS_GROUP_MEMBERS - 1; i++) {
+		readers[i].cl = test_ws_connect(opts);
+		VTM_TEST_ASSERT(readers[i].cl != NULL, "ws group congestion reader connect");
+		readers[i].received = 0;
+		readers[i].done = false;
+		rc = vtm_ws_client_send(readers[i].cl, VTM_WS_MSG_TEXT, "M", 1);
+		VTM_TEST_CHECK(rc == VTM_OK, "ws group congestion reader join");
+	}
+	for (i=0; i < 100 && vtm_ws_group_count(ws_group) < TEST_WS_GROUP_MEMBERS; i++)
+		vtm_thread_sleep(10);
+	VTM_TEST_ASSERT(vtm_ws_group_count(ws_group) == TEST_WS_GROUP_MEMBERS, "ws group congestion joined");
+
+	for (i=0; i < TEST_WS_GROUP_MEMBERS - 1; i++) {
+		threads[i] = vtm_thread_new(test_ws_group_reader, &readers[i]);
+		VTM_TEST_ASSERT(threads[i] != NULL, "ws group congestion reader thread");
+	}
+
+	/* slow member does not read until it leaves */
+	rc = vtm_ws_client_send(slow, VTM_WS_MSG_TEXT, "G", 1);
+	VTM_TEST_CHECK(rc == VTM_OK, "ws group congestion flood");
+
+	for (i=0; i < TEST_WS_GROUP_MEMBERS - 1; i++) {
+		vtm_thread_join(threads[i]);
+		vtm_thread_free(threads[i]);
+		VTM_TEST_CHECK(readers[i].done, "ws group congestion marker received");
+		VTM_TEST_CHECK(readers[i].received == (unsigned int) VTM_ATOMIC_LOAD_INT32(&ws_broadcasts),
+			"ws group congestion all received");
+	}
+	VTM_TEST_CHECK(vtm_ws_group_count(ws_group) == TEST_WS_GROUP_MEMBERS - 1, "ws group congestion slow left");
+
+	vtm_ws_client_free(slow);
+	for (i=0; i < TEST_WS_GROUP_MEMBERS - 1; i++) {
+		vtm_ws_client_close(readers[i].cl);
+		vtm_ws_client_free(readers[i].cl);
+	}
+
+	for (i=0; i < 100 && vtm_ws_group_count(ws_group) > 0; i++)
+		vtm_thread_sleep(10);
+	VTM_TEST_CHECK(vtm_ws_group_count(ws_group) == 0, "ws group congestion left");
+	ws_slow_con = NULL;
+}
+#endif
+
+struct test_h2_stream
+{
+	char            status[4];
+	struct vtm_buf  body;
+	bool            done;
+};
+
+static int test_h2_status(void *arg, const char *name, size_t name_len, const char *value, size_t value_len)
+{
+	struct test_h2_stream *stream;
+
+	stream = arg;
+	if (strcmp(name, ":status") == 0 && value_len == 3)
+		memcpy(stream->status, value, 4);
+
+	return VTM_OK;
+}
+
+struct test_ws_async_state
+{
+	VTM_ATOMIC_INT32_TYPE  opens;
+	VTM_ATOMIC_INT32_TYPE  replies;
+	VTM_ATOMIC_INT32_TYPE  echoes;
+	VTM_ATOMIC_INT32_TYPE  disorder;
+	VTM_ATOMIC_INT32_TYPE  lost;
+	VTM_ATOMIC_INT32_TYPE  closed;
+};
+
+struct test_ws_async_con
+{
+	struct test_ws_async_state  *state;
+	vtm_ws_client_async_con     *con;
+	unsigned int                seq;
+};
+
+static void test_ws_async_open(void *arg, vtm_ws_client_async_con *con)
+{
+	struct test_ws_async_con *a;
+
+	a = arg;
+	a->seq = 0;
+	VTM_ATOMIC_ADD_INT32(&a->state->opens, 1);
+}
+
+static void test_ws_async_msg(void *arg, vtm_ws_client_async_con *con, struct vtm_ws_msg *msg)
+{
+	struct test_ws_async_con *a;
+	const char *data;
+
+	a = arg;
+	data = msg->data;
+
+	if (msg->len == 1 && data[0] == 'B') {
+		VTM_ATOMIC_ADD_INT32(&a->state->replies, 1);
+		return;
+	}
+
+	/* echoes keep the sending order */
+	if (msg->len == 3 + strlen(TEST_WS_JSON) && (unsigned int) atoi(data) == a->seq) {
+		a->seq++;
+		VTM_ATOMIC_ADD_INT32(&a->state->echoes, 1);
+	}
+	else {
+		VTM_ATOMIC_ADD_INT32(&a->state->disorder, 1);
+	}
+}
+
+static void test_ws_async_close(void *arg, vtm_ws_client_async_con *con, int rc, bool reconnect)
+{
+	struct test_ws_async_con *a;
+
+	a = arg;
+	if (reconnect)
+		VTM_ATOMIC_ADD_INT32(&a->state->lost, 1);
+	else if (rc == VTM_OK)
+		VTM_ATOMIC_ADD_INT32(&a->state->closed, 1);
+}
+
+static int test_ws_async_loop(void *arg)
+{
+	return vtm_ws_client_async_run(arg);
+}
+
+static bool test_ws_async_wait(VTM_ATOMIC_INT32_TYPE *counter, int32_t expected)
+{
+	unsigned int i;
+
+	for (i=0; i < 500 && VTM_ATOMIC_LOAD_INT32(counter) < expected; i++)
+		vtm_thread_sleep(10);
+
+	return VTM_ATOMIC_LOAD_INT32(counter) == expected;
+}
+
+static void test_ws_client_async(struct vtm_http_srv_opts *opts, bool deflate)
+{
+	int rc;
+	unsigned int i, k;
+	vtm_ws_client_async *cl;
+	vtm_ws_client_async_con *invalid;
+	vtm_ws_client_async_con *kept;
+	vtm_thread *loop;
+	struct vtm_ws_client_async_cbs cbs;
+	struct vtm_ws_deflate_opts df_opts;
+	struct test_ws_async_state state;
+	struct test_ws_async_con cons[TEST_WS_ASYNC_CONS];
+	char url[256];
+	char data[64 + sizeof(TEST_WS_JSON)];
+	bool ok;
+
+	sprintf(url, "%s://%s:%u/ws", opts->tls.enabled ? "https" : "http", opts->host, opts->port);
+
+	memset(&cbs, 0, sizeof(cbs));
+	cbs.ws_open = test_ws_async_open;
+	cbs.ws_message = test_ws_async_msg;
+	cbs.ws_close = test_ws_async_close;
+
+	cl = vtm_ws_client_async_new(&cbs);
+	VTM_TEST_ASSERT(cl != NULL, "ws async client new");
+
+	if (opts->tls.enabled)
+		vtm_ws_client_async_set_opt(cl, VTM_WS_CL_ASYNC_OPT_NO_CERT_CHECK, (bool[]) {true}, sizeof(bool));
+
+	if (deflate) {
+		memset(&df_opts, 0, sizeof(df_opts));
+		df_opts.enabled = true;
+		rc = vtm_ws_client_async_set_opt(cl, VTM_WS_CL_ASYNC_OPT_DEFLATE, &df_opts, sizeof(df_opts));
+		VTM_TEST_CHECK(rc == VTM_OK, "ws async deflate opt");
+	}
+
+	rc = vtm_ws_client_async_set_opt(cl, VTM_WS_CL_ASYNC_OPT_RECONNECT_MIN, (unsigned long[]) {20}, sizeof(unsigned long));
+	VTM_TEST_CHECK(rc == VTM_OK, "ws async reconnect min");
+	rc = vtm_ws_client_async_set_opt(cl, VTM_WS_CL_ASYNC_OPT_RECONNECT_MAX, (unsigned long[]) {200}, sizeof(unsigned long));
+	VTM_TEST_CHECK(rc == VTM_OK, "ws async reconnect max");
+
+	memset(&state, 0, sizeof(state));
+
+	rc = vtm_ws_client_async_connect(cl, VTM_SOCK_FAM_IN4, "ftp://localhost/ws", NULL, &invalid);
+	VTM_TEST_CHECK(rc != VTM_OK, "ws async invalid url");
+
+	loop = vtm_thread_new(test_ws_async_loop, cl);
+	VTM_TEST_ASSERT(loop != NULL, "ws async client thread");
+
+	/* many connections on one thread */
+	for (i=0; i < TEST_WS_ASYNC_CONS; i++) {
+		cons[i].state = &state;
+		cons[i].seq = 0;
+		rc = vtm_ws_client_async_connect(cl, VTM_SOCK_FAM_IN4, url, &cons[i], &cons[i].con);
+		VTM_TEST_CHECK(rc == VTM_OK, "ws async connect");
+	}
+	VTM_TEST_CHECK(test_ws_async_wait(&state.opens, TEST_WS_ASYNC_CONS), "ws async opened");
+
+	/* burst of messages, written together per connection */
+	ok = true;
+	for (i=0; i < TEST_WS_ASYNC_CONS; i++) {
+		ok &= vtm_ws_client_async_send(cons[i].con, VTM_WS_MSG_TEXT, "A", 1) == VTM_OK;
+		for (k=0; k < TEST_WS_ASYNC_BATCH; k++) {
+			sprintf(data, "%02u %s", k, TEST_WS_JSON);
+			ok &= vtm_ws_client_async_send(cons[i].con, VTM_WS_MSG_TEXT, data, strlen(data)) == VTM_OK;
+		}
+	}
+	VTM_TEST_CHECK(ok, "ws async send");
+	VTM_TEST_CHECK(test_ws_async_wait(&state.replies, TEST_WS_ASYNC_CONS), "ws async replies");
+	VTM_TEST_CHECK(test_ws_async_wait(&state.echoes, TEST_WS_ASYNC_CONS * TEST_WS_ASYNC_BATCH), "ws async echoes");
+	VTM_TEST_CHECK(VTM_ATOMIC_LOAD_INT32(&state.disorder) == 0, "ws async echo order");
+
+	/* pings of the server are answered */
+	if (opts->ws_con.ping_interval > 0)
+		vtm_thread_sleep(4 * opts->ws_con.ping_interval);
+	VTM_TEST_CHECK(VTM_ATOMIC_LOAD_INT32(&state.lost) == 0, "ws async kept open");
+
+	/* every connection comes back after a server restart */
+	stop_server();
+	start_server(opts);
+	VTM_TEST_CHECK(test_ws_async_wait(&state.opens, 2 * TEST_WS_ASYNC_CONS), "ws async reconnected");
+	VTM_TEST_CHECK(VTM_ATOMIC_LOAD_INT32(&state.lost) >= TEST_WS_ASYNC_CONS, "ws async lost");
+
+	ok = true;
+	for (i=0; i < TEST_WS_ASYNC_CONS; i++)
+		ok &= vtm_ws_client_async_send(cons[i].con, VTM_WS_MSG_TEXT, "A", 1) == VTM_OK;
+	VTM_TEST_CHECK(ok, "ws async send after reconnect");
+	VTM_TEST_CHECK(test_ws_async_wait(&state.replies, 2 * TEST_WS_ASYNC_CONS), "ws async replies after reconnect");
+
+	/* send then close, the loop may release the handle right after */
+	for (i=0; i < TEST_WS_ASYNC_CONS; i++) {
+		vtm_ws_client_async_send(cons[i].con, VTM_WS_MSG_TEXT, "A", 1);
+		vtm_ws_client_async_close(cons[i].con);
+	}
+	VTM_TEST_CHECK(test_ws_async_wait(&state.closed, TEST_WS_ASYNC_CONS), "ws async closed");
+
+	/* connection finished by the loop, the handle stays with the application */
+	cons[0].seq = 0;
+	rc = vtm_ws_client_async_connect(cl, VTM_SOCK_FAM_IN4, url, &cons[0], &kept);
+	VTM_TEST_CHECK(rc == VTM_OK, "ws async connect kept");
+	VTM_TEST_CHECK(test_ws_async_wait(&state.opens, 2 * TEST_WS_ASYNC_CONS + 1), "ws async kept opened");
+
+	vtm_ws_client_async_stop(cl);
+	vtm_thread_join(loop);
+	VTM_TEST_CHECK(vtm_thread_get_result(loop) == VTM_OK, "ws async client stopped");
+	vtm_thread_free(loop);
+
+	rc = vtm_ws_client_async_send(kept, VTM_WS_MSG_TEXT, "A", 1);
+	VTM_TEST_CHECK(rc == VTM_E_INVALID_STATE, "ws async send after finish");
+
+	vtm_ws_client_async_free(cl);
+	vtm_ws_client_async_close(kept);
+}
+
+static void test_h2_frame(struct vtm_buf *buf, size_t len, uint8_t type, uint8_t flags, uint32_t stream_id)
+{
+	vtm_buf_putc(buf, (unsigned char) (len >> 16));
+	vtm_buf_putc(buf, (unsigned char) (len >> 8));
+	vtm_buf_putc(buf, (unsigned char) len);
+	vtm_buf_putc(buf, type);
+	vtm_buf_putc(buf, flags);
+	vtm_buf_putc(buf, (unsigned char) (stream_id >> 24));
+	vtm_buf_putc(buf, (unsigned char) (stream_id >> 16));
+	vtm_buf_putc(buf, (unsigned char) (stream_id >> 8));
+	vtm_buf_putc(buf, (unsigned char) stream_id);
+}
+
+static void test_h2_request(struct vtm_buf *buf, struct vtm_http2_hpack *enc, uint32_t stream_id, const char *path)
+{
+	struct vtm_buf block;
+
+	vtm_buf_init(&block, VTM_BYTEORDER_LE);
+	vtm_http2_hpack_encode_begin(enc, &block);
+	vtm_http2_hpack_encode(enc, &block, ":method", 7, "GET", 3, VTM_HTTP2_HPACK_INDEX);
+	vtm_http2_hpack_encode(enc, &block, ":scheme", 7, "http", 4, VTM_HTTP2_HPACK_INDEX);
+	vtm_http2_hpack_encode(enc, &block, ":path", 5, path, strlen(path), VTM_HTTP2_HPACK_INDEX);
+	vtm_http2_hpack_encode(enc, &block, ":authority", 10, "127.0.0.1", 9, VTM_HTTP2_HPACK_INDEX);
+
+	/* END_STREAM | END_HEADERS */
+	test_h2_frame(buf, block.used, 0x1, 0x5, stream_id);
+	vtm_buf_putm(buf, block.data, block.used);
+
+	vtm_buf_release(&block);
+}
+
+static int test_h2_write(vtm_socket *sock, struct vtm_buf *buf)
+{
+	int rc;
+	size_t written;
+
+	while (VTM_BUF_GET_AVAIL_TOTAL(buf) > 0) {
+		rc = vtm_socket_write(sock, buf->data + buf->read, VTM_BUF_GET_AVAIL_TOTAL(buf), &written);
+		if (rc != VTM_OK)
+			return rc;
+		vtm_buf_mark_processed(buf, written);
+	}
+	vtm_buf_clear(buf);
+
+	return VTM_OK;
+}
+
+static int test_h2_read(vtm_socket *sock, struct vtm_buf *buf)
+{
+	int rc;
+	size_t read;
+
+	vtm_buf_discard_processed(buf);
+	rc = vtm_buf_ensure(buf, 16384);
+	if (rc != VTM_OK)
+		return rc;
+
+	rc = vtm_socket_read(sock, VTM_BUF_PUT_PTR(buf), VTM_BUF_PUT_AVAIL_TOTAL(buf), &read);
+	VTM_BUF_PUT_INC(buf, read);
+
+	if (rc == VTM_OK && read == 0)
+		return VTM_E_IO_CLOSED;
+
+	return rc;
+}
+
+static int test_h2_upgrade(vtm_socket *sock, struct vtm_buf *in)
+{
+	int rc;
+	char *end;
+	struct vtm_buf out;
+	static const char upgrade[] = "GET /ref HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+		"Connection: Upgrade, HTTP2-Settings\r\nUpgrade: h2c\r\n"
+		"HTTP2-Settings: AAQAEAAA\r\n\r\n";
+
+	vtm_buf_init(&out, VTM_BYTEORDER_LE);
+	vtm_buf_puts(&out, upgrade);
+	rc = test_h2_write(sock, &out);
+	vtm_buf_release(&out);
+	if (rc != VTM_OK)
+		return rc;
+
+	/* frames may follow the 101 response immediately */
+	while (true) {
+		rc = test_h2_read(sock, in);
+		if (rc != VTM_OK)
+			return rc;
+
+		vtm_buf_putc(in, '\0');
+		in->used--;
+
+		end = strstr((char*) in->data, "\r\n\r\n");
+		if (!end)
+			continue;
+
+		if (strncmp((char*) in->data, "HTTP/1.1 101 ", 13) != 0)
+			return VTM_ERROR;
+
+		vtm_buf_mark_processed(in, (size_t) (end + 4 - (char*) in->data));
+		return VTM_OK;
+	}
+}
+
+static void test_h2_client(struct vtm_http_srv_opts *opts, bool upgrade)
+{
+	int rc;
+	size_t i, len;
+	uint32_t stream_id;
+	unsigned char *src;
+	vtm_socket *sock;
+	struct vtm_buf in, out;
+	struct vtm_http2_hpack enc, dec;
+	struct vtm_buf scratch;
+	struct test_h2_stream streams[2];
+	struct test_h2_stream *stream;
+	char proto[16];
+
+	/* settings: INITIAL_WINDOW_SIZE 1MB */
+	static const unsigned char settings[] = {0x00, 0x04, 0x00, 0x10, 0x00, 0x00};
+	static const unsigned char window[] = {0x00, 0x10, 0x00, 0x00};
+
+#ifdef VTM_MODULE_CRYPTO
+	struct vtm_socket_tls_opts tls_opts;
+
+	if (opts->tls.enabled) {
+		memset(&tls_opts, 0, sizeof(tls_opts));
+		tls_opts.no_cert_check = true;
+		tls_opts.alpn = "h2";
+		sock = vtm_socket_tls_new(VTM_SOCK_FAM_IN4, &tls_opts);
+	}
+	else
+#endif
+	sock = vtm_socket_new(VTM_SOCK_FAM_IN4, VTM_SOCK_TYPE_STREAM);
+	VTM_TEST_ASSERT(sock != NULL, "http2 client socket");
+
+	rc = vtm_socket_connect(sock, opts->host, opts->port);
+	VTM_TEST_ASSERT(rc == VTM_OK, "http2 client connect");
+
+	if (opts->tls.enabled) {
+		rc = vtm_socket_get_opt(sock, VTM_SOCK_OPT_TLS_ALPN, proto, sizeof(proto));
+		VTM_TEST_CHECK(rc == VTM_OK && strcmp(proto, "h2") == 0, "http2 alpn negotiated");
+	}
+
+	vtm_buf_init(&in, VTM_BYTEORDER_LE);
+	vtm_buf_init(&out, VTM_BYTEORDER_LE);
+	vtm_buf_init(&scratch, VTM_BYTEORDER_LE);
+	vtm_http2_hpack_init(&enc, VTM_HTTP2_HPACK_TABLE_SIZE);
+	vtm_http2_hpack_init(&dec, VTM_HTTP2_HPACK_TABLE_SIZE);
+
+	for (i=0; i < 2; i++) {
+		streams[i].status[0] = '\0';
+		streams[i].done = false;
+		vtm_buf_init(&streams[i].body, VTM_BYTEORDER_LE);
+	}
+
+	/* request for stream 1 is sent with HTTP/1.1 */
+	if (upgrade) {
+		rc = test_h2_upgrade(sock, &in);
+		VTM_TEST_CHECK(rc == VTM_OK, "http2 h2c upgrade");
+	}
+
+	vtm_buf_putm(&out, "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n", 24);
+	test_h2_frame(&out, sizeof(settings), 0x4, 0x0, 0);
+	vtm_buf_putm(&out, settings, sizeof(settings));
+	test_h2_frame(&out, sizeof(window), 0x8, 0x0, 0);
+	vtm_buf_putm(&out, window, sizeof(window));
+	if (!upgrade)
+		test_h2_request(&out, &enc, 1, "/ref");
+	test_h2_request(&out, &enc, 3, "/own");
+
+	rc = test_h2_write(sock, &out);
+	VTM_TEST_CHECK(rc == VTM_OK, "http2 client send requests");
+
+	/* receive frames until both streams are complete */
+	while (rc == VTM_OK && !(streams[0].done && streams[1].done)) {
+		if (VTM_BUF_GET_AVAIL_TOTAL(&in) < 9 ||
+			VTM_BUF_GET_AVAIL_TOTAL(&in) < 9 + (((size_t) in.data[in.read] << 16) |
+			((size_t) in.data[in.read+1] << 8) | in.data[in.read+2])) {
+			rc = test_h2_read(sock, &in);
+			continue;
+		}
+
+		src = in.data + in.read;
+		len = ((size_t) src[0] << 16) | ((size_t) src[1] << 8) | src[2];
+		stream_id = ((uint32_t) (src[5] & 0x7f) << 24) | ((uint32_t) src[6] << 16) |
+			((uint32_t) src[7] << 8) | src[8];
+		vtm_buf_mark_processed(&in, 9 + len);
+
+		stream = NULL;
+		if (stream_id == 1 || stream_id == 3)
+			stream = &streams[stream_id / 2];
+
+		switch (src[3]) {
+			case 0x0:
+				if (!stream) {
+					rc = VTM_ERROR;
+					break;
+				}
+				vtm_buf_putm(&stream->body, src + 9, len);
+				break;
+
+			case 0x1:
+				if (!stream) {
+					rc = VTM_ERROR;
+					break;
+				}
+				rc = vtm_http2_hpack_decode(&dec, src + 9, len,
+					TEST_HPACK_MAX_HEADERS, &scratch, test_h2_status, stream);
+				break;
+
+			case 0x3:
+			case 0x7:
+				/* RST_STREAM or GOAWAY */
+				rc = VTM_ERROR;
+				break;
+		}
+
+		if (stream && (src[3] == 0x0 || src[3] == 0x1) && (src[4] & 0x1))
+			stream->done = true;
+	}
+	VTM_TEST_CHECK(rc == VTM_OK, "http2 client receive responses");
+
+	VTM_TEST_CHECK(strcmp(streams[0].status, "200") == 0, "http2 stream 1 status");
+	VTM_TEST_CHECK(streams[0].body.used == strlen(TEST_RT_REF_DATA) &&
+		memcmp(streams[0].body.data, TEST_RT_REF_DATA, streams[0].body.used) == 0,
+		"http2 stream 1 body");
+
+	VTM_TEST_CHECK(strcmp(streams[1].status, "200") == 0, "http2 stream 3 status");
+	VTM_TEST_CHECK(streams[1].body.used == TEST_RT_OWN_SIZE, "http2 stream 3 body length");
+	for (i=0; i < streams[1].body.used; i++) {
+		if (streams[1].body.data[i] != (unsigned char) (i % 251))
+			break;
+	}
+	VTM_TEST_CHECK(i == TEST_RT_OWN_SIZE, "http2 stream 3 body");
+
+	for (i=0; i < 2; i++)
+		vtm_buf_release(&streams[i].body);
+
+	vtm_http2_hpack_release(&dec);
+	vtm_http2_hpack_release(&enc);
+	vtm_buf_release(&scratch);
+	vtm_buf_release(&out);
+	vtm_buf_release(&in);
+
+	vtm_socket_close(sock);
+	vtm_socket_free(sock);
+}
+
+static void test_file_range(void)
+{
+	int rc;
+	struct vtm_http_range ranges[4];
+	size_t count;
+
+	count = 4;
+	rc = vtm_http_file_parse_range("bytes=0-499, 1000-, -200", 1200, ranges, &count);
+	VTM_TEST_CHECK(rc == VTM_OK && count == 3, "range parse");
+	VTM_TEST_CHECK(ranges[0].offset == 0 && ranges[0].len == 500, "range first-last");
+	VTM_TEST_CHECK(ranges[1].offset == 1000 && ranges[1].len == 200, "range first-");
+	VTM_TEST_CHECK(ranges[2].offset == 1000 && ranges[2].len == 200, "range suffix");
+
+	count = 4;
+	rc = vtm_http_file_parse_range("bytes=100-5000", 1200, ranges, &count);
+	VTM_TEST_CHECK(rc == VTM_OK && count == 1 && ranges[0].len == 1100, "range clipped");
+
+	count = 4;
+	rc = vtm_http_file_parse_range("bytes=1200-", 1200, ranges, &count);
+	VTM_TEST_CHECK(rc == VTM_E_OUT_OF_RANGE, "range not satisfiable");
+
+	count = 4;
+	rc = vtm_http_file_parse_range("bytes=5-1", 1200, ranges, &count);
+	VTM_TEST_CHECK(rc == VTM_E_INVALID_ARG, "range invalid");
+
+	count = 4;
+	rc = vtm_http_file_parse_range("items=0-1", 1200, ranges, &count);
+	VTM_TEST_CHECK(rc == VTM_E_INVALID_ARG, "range unit");
+
+	count = 2;
+	rc = vtm_http_file_parse_range("bytes=0-1,2-3,4-5", 1200, ranges, &count);
+	VTM_TEST_CHECK(rc == VTM_E_INVALID_ARG, "range too many");
+}
 
 static void test_http_server(void)
 {
 	struct vtm_http_srv_opts opts;
 	struct vtm_http_client_req req;
+	struct vtm_http_ratelimit_opts rl_opts;
+	vtm_http_ratelimit *rl;
+	size_t i;
 
 	/* options */
 	memset(&opts, 0, sizeof(opts));
@@ -335,6 +2473,12 @@ static void test_http_server(void)
 	opts.cbs.server_ready = http_ready;
 	opts.cbs.http_request = http_request;
 	opts.cbs.ws_message = ws_msg;
+	opts.cbs.ws_close = ws_close;
+
+	ws_group = vtm_ws_group_new();
+	VTM_TEST_ASSERT(ws_group != NULL, "ws group new");
+	for (i=0; i < sizeof(ws_group_data); i++)
+		ws_group_data[i] = (unsigned char) (i * 7);
 
 	req.method = VTM_HTTP_METHOD_GET;
 	req.version = VTM_HTTP_VER_1_1;
@@ -347,6 +2491,8 @@ static void test_http_server(void)
 	VTM_TEST_LABEL("http-plain-single");
 	start_server(&opts);
 	test_client(&req, &opts);
+	test_upload(&req, &opts);
+	test_client_pool(&opts);
 #ifdef VTM_MODULE_CRYPTO
 	test_ws_client(&opts);
 #endif
@@ -355,12 +2501,106 @@ static void test_http_server(void)
 	/* test multi-threaded */
 	VTM_TEST_LABEL("http-plain-multi");
 	opts.threads = 4;
+	opts.access_log.path = TEST_ACCESS_LOG;
+	remove(TEST_ACCESS_LOG);
 	start_server(&opts);
+	test_metrics(&opts);
 	test_client(&req, &opts);
+	test_client_async(&opts);
+	test_micro_cache(&opts);
+	test_sse(&opts);
 #ifdef VTM_MODULE_CRYPTO
 	test_ws_client(&opts);
 #endif
 	stop_server();
+	test_access_log();
+	opts.access_log.path = NULL;
+
+	/* test streamed request body */
+	VTM_TEST_LABEL("http-stream");
+	opts.cbs.http_body = http_body;
+	start_server(&opts);
+	test_client(&req, &opts);
+	test_upload(&req, &opts);
+	stop_server();
+	opts.cbs.http_body = NULL;
+
+	/* test connection caps and rate limiting */
+	VTM_TEST_LABEL("http-limits");
+	memset(&rl_opts, 0, sizeof(rl_opts));
+	rl_opts.rate = 1;
+	rl_opts.burst = TEST_LIMIT_BURST;
+	rl = vtm_http_ratelimit_new(&rl_opts);
+	VTM_TEST_ASSERT(rl != NULL, "http ratelimit new");
+	opts.ratelimit = rl;
+	opts.max_cons_per_ip = 2;
+	start_server(&opts);
+	test_limits(&opts);
+	stop_server();
+	opts.ratelimit = NULL;
+	opts.max_cons_per_ip = 0;
+	vtm_http_ratelimit_free(rl);
+
+	/* test HTTP/2 with prior knowledge and h2c upgrade */
+	VTM_TEST_LABEL("http2-plain");
+	opts.http2 = true;
+	start_server(&opts);
+	test_client(&req, &opts);
+	test_h2_client(&opts, false);
+	test_h2_client(&opts, true);
+	stop_server();
+	opts.http2 = false;
+
+#ifdef VTM_LIB_ZLIB
+	/* test response compression */
+	VTM_TEST_LABEL("http-compress");
+	opts.threads = 0;
+	opts.compress.enabled = true;
+	opts.compress.min_size = 1024;
+	start_server(&opts);
+	test_compress(&req, &opts);
+	stop_server();
+	opts.compress.enabled = false;
+
+#ifdef VTM_MODULE_CRYPTO
+	/* test WebSocket permessage-deflate */
+	VTM_TEST_LABEL("http-ws-deflate");
+	opts.threads = 4;
+	opts.ws_deflate.enabled = true;
+	opts.ws_deflate.min_size = 16;
+	start_server(&opts);
+	test_ws_deflate(&opts, false);
+	test_ws_deflate(&opts, true);
+	test_ws_client_async(&opts, true);
+	stop_server();
+	opts.ws_deflate.enabled = false;
+	opts.threads = 0;
+#endif
+#endif
+
+#ifdef VTM_MODULE_CRYPTO
+	/* test WebSocket keepalive and slow consumers */
+	VTM_TEST_LABEL("http-ws-keepalive");
+	opts.threads = 4;
+	opts.ws_con.ping_interval = TEST_WS_PING_INTERVAL;
+	opts.ws_con.pong_timeout = 2 * TEST_WS_PING_INTERVAL;
+	start_server(&opts);
+	test_ws_keepalive(&opts);
+	test_ws_client_async(&opts, false);
+	stop_server();
+	opts.ws_con.ping_interval = 0;
+
+	opts.cbs.ws_congestion = ws_congestion;
+	opts.ws_con.high_watermark = TEST_WS_HIGH_WATERMARK;
+	opts.ws_con.slow_policy = VTM_WS_SLOW_DROP_OLDEST;
+	start_server(&opts);
+	test_ws_slow_consumer(&opts);
+	test_ws_group_congestion(&opts);
+	stop_server();
+	memset(&opts.ws_con, 0, sizeof(opts.ws_con));
+	opts.cbs.ws_congestion = NULL;
+	opts.threads = 0;
+#endif
 
 #ifdef VTM_MODULE_CRYPTO
 	/* test TLS single-threaded */
@@ -379,15 +2619,29 @@ static void test_http_server(void)
 	opts.threads = 4;
 	start_server(&opts);
 	test_client(&req, &opts);
+	test_client_async(&opts);
 	test_ws_client(&opts);
+	test_ws_client_async(&opts, false);
+	stop_server();
+
+	/* test HTTP/2 negotiated by ALPN */
+	VTM_TEST_LABEL("http2-tls");
+	opts.http2 = true;
+	start_server(&opts);
+	test_client(&req, &opts);
+	test_h2_client(&opts, false);
 	stop_server();
+	opts.http2 = false;
 #endif
+
+	vtm_ws_group_free(ws_group);
 }
 
 extern void test_vtm_net_http_server(void)
 {
 	VTM_TEST_LABEL("http");
 	init_modules();
+	test_file_range();
 	test_http_server();
 	end_modules();
 }
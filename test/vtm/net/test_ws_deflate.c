@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include <vtf.h>
+
+#include <string.h> /* memcmp(), memset(), strcmp(), strlen() */
+#include <vtm/core/buffer.h>
+#include <vtm/core/error.h>
+#include <vtm/net/http/ws_deflate_intl.h>
+#include <vtm/net/http/ws_message.h>
+#include <vtm/net/http/ws_parser.h>
+
+#ifdef VTM_LIB_ZLIB
+
+#define TEST_JSON  "{\"id\":1234,\"type\":\"quote\",\"symbol\":\"VTM\",\"bid\":10.25,\"ask\":10.27}"
+
+/* compressed "Hello" from RFC 7692 section 7.2.3.1 */
+static const unsigned char test_hello[] = {0xf2, 0x48, 0xcd, 0xc9, 0xc9, 0x07, 0x00};
+
+static bool test_accept(const struct vtm_ws_deflate_opts *opts, const char *offers,
+	struct vtm_ws_deflate_params *params, const char *expected)
+{
+	int rc;
+	bool result;
+	struct vtm_buf buf;
+
+	vtm_buf_init(&buf, VTM_BYTEORDER_LE);
+	rc = vtm_ws_deflate_accept(opts, offers, params, &buf);
+	vtm_buf_putc(&buf, '\0');
+
+	if (expected)
+		result = (rc == VTM_OK && strcmp((char*) buf.data, expected) == 0);
+	else
+		result = (rc == VTM_E_NOT_FOUND);
+
+	vtm_buf_release(&buf);
+
+	return result;
+}
+
+static void test_negotiate_server(void)
+{
+	struct vtm_ws_deflate_opts opts;
+	struct vtm_ws_deflate_params params;
+
+	memset(&opts, 0, sizeof(opts));
+	opts.enabled = true;
+
+	VTM_TEST_CHECK(test_accept(&opts, "x-webkit-deflate-frame, permessage-deflate; client_max_window_bits",
+		&params, "permessage-deflate; client_max_window_bits=15"), "deflate accept second extension");
+	VTM_TEST_CHECK(!params.server_no_context_takeover && !params.client_no_context_takeover &&
+		params.server_max_window_bits == 15 && params.client_max_window_bits == 15, "deflate accept params");
+
+	/* 256 byte window is declined, next offer is taken */
+	VTM_TEST_CHECK(test_accept(&opts, "permessage-deflate; server_max_window_bits=8, "
+		"Permessage-Deflate ; server_max_window_bits=\"10\" ; client_no_context_takeover",
+		&params, "permessage-deflate; client_no_context_takeover; server_max_window_bits=10"),
+		"deflate accept fallback offer");
+	VTM_TEST_CHECK(params.server_max_window_bits == 10 && params.client_no_context_takeover,
+		"deflate accept fallback params");
+
+	VTM_TEST_CHECK(test_accept(&opts, "permessage-deflate; foo", &params, NULL), "deflate unknown param");
+	VTM_TEST_CHECK(test_accept(&opts, "permessage-deflate; server_max_window_bits=016", &params, NULL),
+		"deflate leading zero");
+	VTM_TEST_CHECK(test_accept(&opts, "permessage-deflate; server_max_window_bits", &params, NULL),
+		"deflate missing value");
+	VTM_TEST_CHECK(test_accept(&opts, "permessage-deflate; client_no_context_takeover; client_no_context_takeover",
+		&params, NULL), "deflate duplicate param");
+
+	/* own window limit */
+	opts.max_window_bits = 11;
+	VTM_TEST_CHECK(test_accept(&opts, "permessage-deflate; client_max_window_bits=13", &params,
+		"permessage-deflate; server_max_window_bits=11; client_max_window_bits=11"), "deflate accept window limit");
+
+	/* budget used up */
+	opts.max_window_bits = 0;
+	opts.mem_budget = 1;
+	VTM_TEST_CHECK(test_accept(&opts, "permessage-deflate", &params,
+		"permessage-deflate; server_no_context_takeover; client_no_context_takeover"), "deflate accept budget");
+}
+
+static void test_negotiate_client(void)
+{
+	struct vtm_ws_deflate_opts opts;
+	struct vtm_ws_deflate_params params;
+	struct vtm_buf buf;
+
+	memset(&opts, 0, sizeof(opts));
+	opts.enabled = true;
+	opts.max_window_bits = 12;
+
+	vtm_buf_init(&buf, VTM_BYTEORDER_LE);
+	vtm_ws_deflate_offer(&opts, &buf);
+	vtm_buf_putc(&buf, '\0');
+	VTM_TEST_CHECK(strcmp((char*) buf.data,
+		"permessage-deflate; server_max_window_bits=12; client_max_window_bits=12") == 0, "deflate offer");
+	vtm_buf_release(&buf);
+
+	VTM_TEST_CHECK(vtm_ws_deflate_confirm(&opts, "permessage-deflate; server_max_window_bits=10", &params) == VTM_OK &&
+		params.server_max_window_bits == 10 && params.client_max_window_bits == 12, "deflate confirm");
+	VTM_TEST_CHECK(vtm_ws_deflate_confirm(&opts, "permessage-deflate; server_max_window_bits=13", &params) == VTM_E_IO_PROTOCOL,
+		"deflate confirm larger window");
+	VTM_TEST_CHECK(vtm_ws_deflate_confirm(&opts, "permessage-deflate; client_max_window_bits", &params) == VTM_E_IO_PROTOCOL,
+		"deflate confirm missing value");
+	VTM_TEST_CHECK(vtm_ws_deflate_confirm(&opts, "permessage-deflate, permessage-deflate", &params) == VTM_E_IO_PROTOCOL,
+		"deflate confirm twice");
+	VTM_TEST_CHECK(vtm_ws_deflate_confirm(&opts, "x-other", &params) == VTM_E_IO_PROTOCOL,
+		"deflate confirm not offered");
+	VTM_TEST_CHECK(vtm_ws_deflate_confirm(&opts, "permessage-deflate; client_max_window_bits=8", &params) == VTM_E_NOT_SUPPORTED,
+		"deflate confirm small window");
+	VTM_TEST_CHECK(vtm_ws_deflate_confirm(&opts, "", &params) == VTM_E_NOT_FOUND, "deflate confirm empty");
+}
+
+static void test_roundtrip(bool context_takeover)
+{
+	int rc;
+	size_t i, first, last;
+	bool ok;
+	vtm_ws_deflate *srv, *cl;
+	struct vtm_ws_deflate_opts opts;
+	struct vtm_ws_deflate_params params;
+	struct vtm_buf comp, plain;
+
+	memset(&opts, 0, sizeof(opts));
+	opts.enabled = true;
+
+	params.server_no_context_takeover = !context_takeover;
+	params.client_no_context_takeover = !context_takeover;
+	params.server_max_window_bits = 15;
+	params.client_max_window_bits = 15;
+
+	srv = vtm_ws_deflate_new(VTM_WS_MODE_SERVER, &params, &opts);
+	cl = vtm_ws_deflate_new(VTM_WS_MODE_CLIENT, &params, &opts);
+	VTM_TEST_ASSERT(srv && cl, "deflate new");
+
+	/* idle connections count against the budget */
+	VTM_TEST_CHECK((vtm_ws_deflate_get_mem_usage() > 0) == context_takeover, "deflate memory reserved");
+	if (context_takeover) {
+		opts.mem_budget = vtm_ws_deflate_get_mem_usage() + 1;
+		VTM_TEST_CHECK(test_accept(&opts, "permessage-deflate", &params,
+			"permessage-deflate; server_no_context_takeover; client_no_context_takeover"),
+			"deflate reserved budget");
+		opts.mem_budget = 0;
+	}
+
+	vtm_buf_init(&comp, VTM_BYTEORDER_LE);
+	vtm_buf_init(&plain, VTM_BYTEORDER_LE);
+
+	ok = true;
+	first = last = 0;
+	for (i=0; i < 3 && ok; i++) {
+		vtm_buf_clear(&comp);
+		vtm_buf_clear(&plain);
+		rc = vtm_ws_deflate_compress(srv, TEST_JSON, strlen(TEST_JSON), &comp);
+		if (rc == VTM_OK)
+			rc = vtm_ws_deflate_decompress(cl, comp.data, comp.used, 1024, &plain);
+		ok = (rc == VTM_OK && plain.used == strlen(TEST_JSON) && memcmp(plain.data, TEST_JSON, plain.used) == 0);
+		if (i == 0)
+			first = comp.used;
+		last = comp.used;
+	}
+	VTM_TEST_CHECK(ok, "deflate roundtrip");
+
+	/* repeated message is a single reference into the context */
+	if (context_takeover)
+		VTM_TEST_CHECK(last < first / 4, "deflate context takeover");
+	else
+		VTM_TEST_CHECK(last == first, "deflate no context takeover");
+
+	VTM_TEST_CHECK((vtm_ws_deflate_get_mem_usage() > 0) == context_takeover, "deflate memory accounting");
+
+	vtm_ws_deflate_free(srv);
+	vtm_ws_deflate_free(cl);
+	VTM_TEST_CHECK(vtm_ws_deflate_get_mem_usage() == 0, "deflate memory released");
+
+	vtm_buf_release(&comp);
+	vtm_buf_release(&plain);
+}
+
+static void test_decompress_errors(void)
+{
+	int rc;
+	vtm_ws_deflate *wd;
+	struct vtm_ws_deflate_opts opts;
+	struct vtm_ws_deflate_params params;
+	struct vtm_buf out;
+
+	memset(&opts, 0, sizeof(opts));
+	memset(&params, 0, sizeof(params));
+	params.server_max_window_bits = 15;
+	params.client_max_window_bits = 15;
+
+	wd = vtm_ws_deflate_new(VTM_WS_MODE_CLIENT, &params, &opts);
+	VTM_TEST_ASSERT(wd != NULL, "deflate errors new");
+
+	vtm_buf_init(&out, VTM_BYTEORDER_LE);
+	rc = vtm_ws_deflate_decompress(wd, test_hello, sizeof(test_hello), 1024, &out);
+	VTM_TEST_CHECK(rc == VTM_OK && out.used == 5 && memcmp(out.data, "Hello", 5) == 0, "deflate rfc example");
+
+	vtm_buf_clear(&out);
+	rc = vtm_ws_deflate_decompress(wd, test_hello, sizeof(test_hello), 4, &out);
+	VTM_TEST_CHECK(rc == VTM_E_MAX_REACHED, "deflate max size");
+
+	vtm_buf_clear(&out);
+	rc = vtm_ws_deflate_decompress(wd, "\xff\xff\xff", 3, 1024, &out);
+	VTM_TEST_CHECK(rc == VTM_E_IO_PROTOCOL, "deflate invalid data");
+
+	vtm_buf_release(&out);
+	vtm_ws_deflate_free(wd);
+}
+
+static void test_parser(void)
+{
+	enum vtm_net_recv_stat stat;
+	vtm_ws_deflate *wd;
+	struct vtm_ws_deflate_opts opts;
+	struct vtm_ws_deflate_params params;
+	struct vtm_ws_parser par;
+	struct vtm_ws_msg msg;
+	struct vtm_buf buf;
+
+	memset(&opts, 0, sizeof(opts));
+	memset(&params, 0, sizeof(params));
+	params.server_max_window_bits = 15;
+	params.client_max_window_bits = 15;
+
+	wd = vtm_ws_deflate_new(VTM_WS_MODE_CLIENT, &params, &opts);
+	VTM_TEST_ASSERT(wd != NULL, "deflate parser state");
+	VTM_TEST_ASSERT(vtm_ws_parser_init(&par, VTM_WS_MODE_CLIENT) == VTM_OK, "deflate parser init");
+
+	/* compressed text frame with rsv1 */
+	vtm_buf_init(&buf, VTM_BYTEORDER_LE);
+	vtm_buf_putm(&buf, "\xc1\x07", 2);
+	vtm_buf_putm(&buf, test_hello, sizeof(test_hello));
+
+	stat = vtm_ws_parser_run(&par, &buf);
+	VTM_TEST_CHECK(stat == VTM_NET_RECV_STAT_INVALID, "deflate parser not negotiated");
+
+	vtm_ws_parser_reset(&par);
+	vtm_ws_parser_set_deflate(&par, wd);
+	buf.read = 0;
+	stat = vtm_ws_parser_run(&par, &buf);
+	VTM_TEST_CHECK(stat == VTM_NET_RECV_STAT_COMPLETE, "deflate parser complete");
+	VTM_TEST_CHECK(vtm_ws_parser_get_msg(&par, &msg) == VTM_OK && msg.type == VTM_WS_MSG_TEXT &&
+		msg.len == 5 && memcmp(msg.data, "Hello", 5) == 0, "deflate parser message");
+	vtm_ws_msg_release(&msg);
+
+	/* control frames must not be compressed */
+	vtm_buf_clear(&buf);
+	vtm_buf_putm(&buf, "\xc9\x00", 2);
+	stat = vtm_ws_parser_run(&par, &buf);
+	VTM_TEST_CHECK(stat == VTM_NET_RECV_STAT_INVALID, "deflate parser compressed ping");
+
+	vtm_buf_release(&buf);
+	vtm_ws_parser_release(&par);
+	vtm_ws_deflate_free(wd);
+}
+
+extern void test_vtm_net_ws_deflate(void)
+{
+	VTM_TEST_LABEL("ws-deflate");
+	test_negotiate_server();
+	test_negotiate_client();
+	test_roundtrip(true);
+	test_roundtrip(false);
+	test_decompress_errors();
+	test_parser();
+}
+
+#else
+
+extern void test_vtm_net_ws_deflate(void)
+{
+	VTM_TEST_LABEL("ws-deflate");
+}
+
+#endif
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include <vtf.h>
+
+#include <string.h> /* memcmp(), memcpy() */
+#include <vtm/net/http/ws_frame_intl.h>
+
+#define TEST_MASK       0x37fa213dUL
+#define TEST_MASK_LEN   300
+
+static void test_mask_ref(unsigned char *dst, size_t len, uint32_t mask)
+{
+	size_t i;
+
+	for (i=0; i < len; i++)
+		dst[i] ^= (mask >> (24-8*(i % 4))) & 0xff;
+}
+
+static void test_mask_payload(void)
+{
+	size_t i, off, len, split;
+	bool ok;
+	uint32_t mask;
+	unsigned char src[TEST_MASK_LEN + 16];
+	unsigned char buf[TEST_MASK_LEN + 16];
+	unsigned char ref[TEST_MASK_LEN + 16];
+
+	for (i=0; i < sizeof(src); i++)
+		src[i] = (unsigned char) (i * 31 + 7);
+
+	/* every alignment of head and tail */
+	ok = true;
+	for (off=0; off < 16; off++) {
+		for (len=0; len <= TEST_MASK_LEN; len++) {
+			memcpy(buf, src, sizeof(buf));
+			memcpy(ref, src, sizeof(ref));
+			test_mask_ref(ref + off, len, TEST_MASK);
+			vtm_ws_frame_mask_payload(buf + off, len, TEST_MASK);
+			if (memcmp(buf, ref, sizeof(buf)) != 0)
+				ok = false;
+		}
+	}
+	VTM_TEST_CHECK(ok, "ws mask alignment");
+
+	/* mask continues across fragments */
+	ok = true;
+	memcpy(ref, src, sizeof(ref));
+	test_mask_ref(ref, TEST_MASK_LEN, TEST_MASK);
+	for (split=0; split <= TEST_MASK_LEN; split++) {
+		memcpy(buf, src, sizeof(buf));
+		mask = vtm_ws_frame_mask_payload(buf, split, TEST_MASK);
+		vtm_ws_frame_mask_payload(buf + split, TEST_MASK_LEN - split, mask);
+		if (memcmp(buf, ref, sizeof(buf)) != 0)
+			ok = false;
+	}
+	VTM_TEST_CHECK(ok, "ws mask fragments");
+
+	/* masking twice restores the payload */
+	memcpy(buf, src, sizeof(buf));
+	vtm_ws_frame_mask_payload(buf + 3, TEST_MASK_LEN, TEST_MASK);
+	vtm_ws_frame_mask_payload(buf + 3, TEST_MASK_LEN, TEST_MASK);
+	VTM_TEST_CHECK(memcmp(buf, src, sizeof(buf)) == 0, "ws mask reversible");
+}
+
+extern void test_vtm_net_ws_frame(void)
+{
+	VTM_TEST_LABEL("ws-frame");
+	test_mask_payload();
+}
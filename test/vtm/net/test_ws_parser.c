@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include <vtf.h>
+
+#include <string.h> /* memcmp() */
+#include <vtm/core/buffer.h>
+#include <vtm/core/error.h>
+#include <vtm/net/http/ws_error.h>
+#include <vtm/net/http/ws_message_intl.h>
+#include <vtm/net/http/ws_parser.h>
+
+static void test_put_frame(struct vtm_buf *buf, unsigned char fin_opcode, const char *payload)
+{
+	/* masked with zero key */
+	vtm_buf_putc(buf, fin_opcode);
+	vtm_buf_putc(buf, 0x80 | (unsigned char) strlen(payload));
+	vtm_buf_putm(buf, "\x00\x00\x00\x00", 4);
+	vtm_buf_puts(buf, payload);
+}
+
+static void test_pool(void)
+{
+	void *data, *again;
+	size_t cap;
+
+	vtm_ws_msg_pool_clear();
+
+	data = vtm_ws_msg_buf_get(100, &cap);
+	VTM_TEST_ASSERT(data != NULL, "ws pool get");
+	VTM_TEST_CHECK(cap == 1024, "ws pool smallest class");
+	vtm_ws_msg_buf_put(data);
+	VTM_TEST_CHECK(vtm_ws_msg_pool_get_size() == 1024, "ws pool cached");
+
+	again = vtm_ws_msg_buf_get(1000, &cap);
+	VTM_TEST_CHECK(again == data, "ws pool reuse");
+	vtm_ws_msg_buf_put(again);
+
+	data = vtm_ws_msg_buf_get(5000, &cap);
+	VTM_TEST_ASSERT(data != NULL, "ws pool get larger");
+	VTM_TEST_CHECK(cap == 8192, "ws pool larger class");
+	vtm_ws_msg_buf_put(data);
+	VTM_TEST_CHECK(vtm_ws_msg_pool_get_size() == 1024 + 8192, "ws pool cached classes");
+
+	/* beyond the largest class */
+	data = vtm_ws_msg_buf_get(70000, &cap);
+	VTM_TEST_ASSERT(data != NULL, "ws pool get oversized");
+	VTM_TEST_CHECK(cap == 70000, "ws pool oversized capacity");
+	vtm_ws_msg_buf_put(data);
+	VTM_TEST_CHECK(vtm_ws_msg_pool_get_size() == 1024 + 8192, "ws pool oversized not cached");
+
+	/* buffers used since the last trim are kept */
+	vtm_ws_msg_pool_trim();
+	VTM_TEST_CHECK(vtm_ws_msg_pool_get_size() == 1024 + 8192, "ws pool trim used");
+
+	data = vtm_ws_msg_buf_get(10, &cap);
+	vtm_ws_msg_buf_put(data);
+	vtm_ws_msg_pool_trim();
+	VTM_TEST_CHECK(vtm_ws_msg_pool_get_size() == 1024, "ws pool trim idle");
+
+	vtm_ws_msg_pool_trim();
+	VTM_TEST_CHECK(vtm_ws_msg_pool_get_size() == 0, "ws pool trim all");
+
+	vtm_ws_msg_pool_clear();
+}
+
+static void test_zero_copy(void)
+{
+	struct vtm_ws_parser par;
+	struct vtm_ws_msg msg;
+	struct vtm_buf buf;
+
+	vtm_ws_msg_pool_clear();
+	VTM_TEST_ASSERT(vtm_ws_parser_init(&par, VTM_WS_MODE_SERVER) == VTM_OK, "ws parser init");
+	vtm_ws_parser_set_zero_copy(&par, true);
+	vtm_buf_init(&buf, VTM_BYTEORDER_LE);
+
+	/* single frame references the input */
+	test_put_frame(&buf, 0x81, "hello");
+	test_put_frame(&buf, 0x81, "world");
+	VTM_TEST_CHECK(vtm_ws_parser_run(&par, &buf) == VTM_NET_RECV_STAT_COMPLETE, "ws parser view complete");
+	VTM_TEST_ASSERT(vtm_ws_parser_get_msg(&par, &msg) == VTM_OK, "ws parser view msg");
+	VTM_TEST_CHECK(!msg.pooled && (unsigned char*) msg.data > buf.data &&
+		(unsigned char*) msg.data < buf.data + buf.used, "ws parser view in input");
+	VTM_TEST_CHECK(msg.type == VTM_WS_MSG_TEXT && msg.len == 5 &&
+		memcmp(msg.data, "hello", 5) == 0, "ws parser view payload");
+	vtm_ws_msg_release(&msg);
+
+	/* next run discards the previous frame */
+	VTM_TEST_CHECK(vtm_ws_parser_run(&par, &buf) == VTM_NET_RECV_STAT_COMPLETE, "ws parser view next");
+	VTM_TEST_ASSERT(vtm_ws_parser_get_msg(&par, &msg) == VTM_OK, "ws parser view next msg");
+	VTM_TEST_CHECK(msg.data == buf.data + 6 && msg.len == 5 &&
+		memcmp(msg.data, "world", 5) == 0, "ws parser view discarded");
+	vtm_ws_msg_release(&msg);
+	VTM_TEST_CHECK(vtm_ws_msg_pool_get_size() == 0, "ws parser view not pooled");
+
+	/* fragmented message is assembled in a pooled buffer */
+	vtm_buf_clear(&buf);
+	test_put_frame(&buf, 0x01, "frag");
+	test_put_frame(&buf, 0x89, "ping");
+	test_put_frame(&buf, 0x80, "mented");
+	VTM_TEST_CHECK(vtm_ws_parser_run(&par, &buf) == VTM_NET_RECV_STAT_COMPLETE, "ws parser ctrl complete");
+	VTM_TEST_ASSERT(vtm_ws_parser_get_msg(&par, &msg) == VTM_OK, "ws parser ctrl msg");
+	VTM_TEST_CHECK(msg.pooled && msg.type == VTM_WS_MSG_PING && msg.len == 4 &&
+		memcmp(msg.data, "ping", 4) == 0, "ws parser ctrl payload");
+	vtm_ws_msg_release(&msg);
+
+	VTM_TEST_CHECK(vtm_ws_parser_run(&par, &buf) == VTM_NET_RECV_STAT_COMPLETE, "ws parser fragments complete");
+	VTM_TEST_ASSERT(vtm_ws_parser_get_msg(&par, &msg) == VTM_OK, "ws parser fragments msg");
+	VTM_TEST_CHECK(msg.pooled && msg.type == VTM_WS_MSG_TEXT && msg.len == 10 &&
+		memcmp(msg.data, "fragmented", 10) == 0, "ws parser fragments payload");
+	vtm_ws_msg_release(&msg);
+
+	vtm_buf_release(&buf);
+	vtm_ws_parser_release(&par);
+	vtm_ws_msg_pool_clear();
+}
+
+static void test_pooled_msgs(void)
+{
+	struct vtm_ws_parser par;
+	struct vtm_ws_msg msg1, msg2;
+	struct vtm_buf buf;
+	void *data;
+	bool ok;
+	int i;
+
+	vtm_ws_msg_pool_clear();
+	VTM_TEST_ASSERT(vtm_ws_parser_init(&par, VTM_WS_MODE_CLIENT) == VTM_OK, "ws parser client init");
+	vtm_buf_init(&buf, VTM_BYTEORDER_LE);
+
+	/* messages without zero copy may outlive the next run */
+	vtm_buf_putm(&buf, "\x81\x03one\x81\x03two", 10);
+	VTM_TEST_CHECK(vtm_ws_parser_run(&par, &buf) == VTM_NET_RECV_STAT_COMPLETE &&
+		vtm_ws_parser_get_msg(&par, &msg1) == VTM_OK, "ws parser client first");
+	VTM_TEST_CHECK(vtm_ws_parser_run(&par, &buf) == VTM_NET_RECV_STAT_COMPLETE &&
+		vtm_ws_parser_get_msg(&par, &msg2) == VTM_OK, "ws parser client second");
+	VTM_TEST_CHECK(msg1.pooled && msg1.len == 3 && memcmp(msg1.data, "one", 3) == 0 &&
+		msg2.pooled && msg2.len == 3 && memcmp(msg2.data, "two", 3) == 0, "ws parser client payloads");
+	data = msg2.data;
+	vtm_ws_msg_release(&msg1);
+	vtm_ws_msg_release(&msg2);
+
+	/* released buffers are reused instead of allocated */
+	ok = true;
+	for (i=0; i < 10; i++) {
+		vtm_buf_clear(&buf);
+		vtm_buf_putm(&buf, "\x82\x02xy", 4);
+		if (vtm_ws_parser_run(&par, &buf) != VTM_NET_RECV_STAT_COMPLETE ||
+			vtm_ws_parser_get_msg(&par, &msg1) != VTM_OK) {
+			ok = false;
+			break;
+		}
+		if (msg1.data != data || msg1.type != VTM_WS_MSG_BINARY)
+			ok = false;
+		vtm_ws_msg_release(&msg1);
+	}
+	VTM_TEST_CHECK(ok, "ws parser client reuse");
+	VTM_TEST_CHECK(vtm_ws_msg_pool_get_size() == 2048, "ws parser client cached");
+
+	vtm_buf_release(&buf);
+	vtm_ws_parser_release(&par);
+	vtm_ws_msg_pool_clear();
+}
+
+static enum vtm_net_recv_stat test_run_frames(struct vtm_ws_parser *par, struct vtm_buf *buf, struct vtm_ws_msg *msg)
+{
+	enum vtm_net_recv_stat stat;
+
+	vtm_ws_parser_reset(par);
+	stat = vtm_ws_parser_run(par, buf);
+	if (stat == VTM_NET_RECV_STAT_COMPLETE && vtm_ws_parser_get_msg(par, msg) != VTM_OK)
+		stat = VTM_NET_RECV_STAT_ERROR;
+
+	vtm_buf_clear(buf);
+
+	return stat;
+}
+
+static void test_utf8(void)
+{
+	struct vtm_ws_parser par;
+	struct vtm_ws_msg msg;
+	struct vtm_buf buf;
+	enum vtm_net_recv_stat stat;
+
+	VTM_TEST_ASSERT(vtm_ws_parser_init(&par, VTM_WS_MODE_SERVER) == VTM_OK, "ws parser utf8 init");
+	vtm_buf_init(&buf, VTM_BYTEORDER_LE);
+
+	test_put_frame(&buf, 0x81, "gr\xc3\xbc\xc3\x9f" "e");
+	stat = test_run_frames(&par, &buf, &msg);
+	VTM_TEST_CHECK(stat == VTM_NET_RECV_STAT_COMPLETE && msg.len == 7, "ws parser utf8 text");
+	if (stat == VTM_NET_RECV_STAT_COMPLETE)
+		vtm_ws_msg_release(&msg);
+
+	test_put_frame(&buf, 0x81, "bad \xed\xa0\x80");
+	VTM_TEST_CHECK(test_run_frames(&par, &buf, &msg) == VTM_NET_RECV_STAT_INVALID &&
+		vtm_err_get_code() == VTM_E_WS_INVALID_UTF8, "ws parser utf8 invalid");
+
+	/* code point split between fragments */
+	test_put_frame(&buf, 0x01, "10 \xe2\x82");
+	test_put_frame(&buf, 0x80, "\xac");
+	stat = test_run_frames(&par, &buf, &msg);
+	VTM_TEST_CHECK(stat == VTM_NET_RECV_STAT_COMPLETE && msg.len == 6 &&
+		memcmp(msg.data, "10 \xe2\x82\xac", 6) == 0, "ws parser utf8 fragments");
+	if (stat == VTM_NET_RECV_STAT_COMPLETE)
+		vtm_ws_msg_release(&msg);
+
+	/* fails before the last fragment arrives */
+	test_put_frame(&buf, 0x01, "\xc3\x28");
+	VTM_TEST_CHECK(test_run_frames(&par, &buf, &msg) == VTM_NET_RECV_STAT_INVALID, "ws parser utf8 early");
+
+	test_put_frame(&buf, 0x01, "\xf0\x9f");
+	test_put_frame(&buf, 0x80, "\x98");
+	VTM_TEST_CHECK(test_run_frames(&par, &buf, &msg) == VTM_NET_RECV_STAT_INVALID, "ws parser utf8 truncated");
+
+	/* binary payloads are not text */
+	test_put_frame(&buf, 0x82, "\xff\xfe");
+	stat = test_run_frames(&par, &buf, &msg);
+	VTM_TEST_CHECK(stat == VTM_NET_RECV_STAT_COMPLETE && msg.type == VTM_WS_MSG_BINARY, "ws parser utf8 binary");
+	if (stat == VTM_NET_RECV_STAT_COMPLETE)
+		vtm_ws_msg_release(&msg);
+
+	/* close reason after the status code */
+	test_put_frame(&buf, 0x88, "\x03\xe8\xc0\xaf");
+	VTM_TEST_CHECK(test_run_frames(&par, &buf, &msg) == VTM_NET_RECV_STAT_INVALID, "ws parser utf8 close reason");
+
+	vtm_buf_release(&buf);
+	vtm_ws_parser_release(&par);
+	vtm_ws_msg_pool_clear();
+}
+
+extern void test_vtm_net_ws_parser(void)
+{
+	VTM_TEST_LABEL("ws-parser");
+	test_pool();
+	test_zero_copy();
+	test_pooled_msgs();
+	test_utf8();
+}
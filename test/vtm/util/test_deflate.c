@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2018-2019 Matthias Benkendorf
+ */
+
+#include <vtf.h>
+
+#include <stdlib.h> /* malloc(), free() */
+#include <string.h> /* memcmp(), memset(), strlen() */
+#include <vtm/core/buffer.h>
+#include <vtm/core/error.h>
+#include <vtm/util/deflate.h>
+#include <vtm/util/inflate.h>
+
+#ifdef VTM_LIB_ZLIB
+
+#include <zlib.h>
+
+#define TEST_INPUT       "Teststring for compression, Teststring for compression"
+#define TEST_DATA_LEN    100000
+
+static bool test_deflate_inflate(struct vtm_buf *buf, int window_bits, const void *expected, size_t len)
+{
+	int rc;
+	bool result;
+	z_stream strm;
+	unsigned char *out;
+
+	out = malloc(len + 1);
+	if (!out)
+		return false;
+
+	memset(&strm, 0, sizeof(strm));
+	if (inflateInit2(&strm, window_bits) != Z_OK) {
+		free(out);
+		return false;
+	}
+
+	strm.next_in = buf->data;
+	strm.avail_in = buf->used;
+	strm.next_out = out;
+	strm.avail_out = len + 1;
+
+	rc = inflate(&strm, Z_FINISH);
+	result = (rc == Z_STREAM_END && strm.total_out == len &&
+		strm.avail_in == 0 && memcmp(out, expected, len) == 0);
+
+	inflateEnd(&strm);
+	free(out);
+
+	return result;
+}
+
+static void test_deflate_formats(vtm_deflate *df)
+{
+	int rc;
+	struct vtm_buf buf;
+
+	vtm_buf_init(&buf, VTM_BYTEORDER_LE);
+
+	rc = vtm_deflate_begin(df, VTM_DEFLATE_FMT_GZIP);
+	VTM_TEST_CHECK(rc == VTM_OK, "deflate begin gzip");
+	rc = vtm_deflate_update(df, TEST_INPUT, strlen(TEST_INPUT), VTM_DEFLATE_FLUSH_FINISH, &buf);
+	VTM_TEST_CHECK(rc == VTM_OK, "deflate gzip");
+	VTM_TEST_CHECK(test_deflate_inflate(&buf, 16 + 15, TEST_INPUT, strlen(TEST_INPUT)), "deflate gzip check");
+
+	/* reuse of compressor */
+	vtm_buf_clear(&buf);
+	rc = vtm_deflate_begin(df, VTM_DEFLATE_FMT_ZLIB);
+	VTM_TEST_CHECK(rc == VTM_OK, "deflate begin zlib");
+	rc = vtm_deflate_update(df, TEST_INPUT, strlen(TEST_INPUT), VTM_DEFLATE_FLUSH_FINISH, &buf);
+	VTM_TEST_CHECK(rc == VTM_OK, "deflate zlib");
+	VTM_TEST_CHECK(test_deflate_inflate(&buf, 15, TEST_INPUT, strlen(TEST_INPUT)), "deflate zlib check");
+
+	vtm_buf_clear(&buf);
+	rc = vtm_deflate_begin(df, VTM_DEFLATE_FMT_RAW);
+	VTM_TEST_CHECK(rc == VTM_OK, "deflate begin raw");
+	rc = vtm_deflate_update(df, TEST_INPUT, strlen(TEST_INPUT), VTM_DEFLATE_FLUSH_FINISH, &buf);
+	VTM_TEST_CHECK(rc == VTM_OK, "deflate raw");
+	VTM_TEST_CHECK(test_deflate_inflate(&buf, -15, TEST_INPUT, strlen(TEST_INPUT)), "deflate raw check");
+
+	vtm_buf_release(&buf);
+}
+
+static void test_deflate_stream(vtm_deflate *df)
+{
+	int rc;
+	size_t i;
+	unsigned char *data;
+	struct vtm_buf buf;
+
+	data = malloc(TEST_DATA_LEN);
+	if (!data) {
+		VTM_TEST_FAILED("deflate stream alloc");
+		return;
+	}
+
+	for (i=0; i < TEST_DATA_LEN; i++)
+		data[i] = (unsigned char) ((i * 7) % 251);
+
+	vtm_buf_init(&buf, VTM_BYTEORDER_LE);
+
+	rc = vtm_deflate_begin(df, VTM_DEFLATE_FMT_GZIP);
+	VTM_TEST_CHECK(rc == VTM_OK, "deflate stream begin");
+
+	/* multiple writes with empty final update */
+	for (i=0; i < TEST_DATA_LEN && rc == VTM_OK; i += 1000)
+		rc = vtm_deflate_update(df, data + i, 1000, i == 0 ? VTM_DEFLATE_FLUSH_SYNC : VTM_DEFLATE_FLUSH_NONE, &buf);
+	VTM_TEST_CHECK(rc == VTM_OK, "deflate stream update");
+
+	rc = vtm_deflate_update(df, NULL, 0, VTM_DEFLATE_FLUSH_FINISH, &buf);
+	VTM_TEST_CHECK(rc == VTM_OK, "deflate stream finish");
+	VTM_TEST_CHECK(buf.used < TEST_DATA_LEN, "deflate stream size");
+	VTM_TEST_CHECK(test_deflate_inflate(&buf, 16 + 15, data, TEST_DATA_LEN), "deflate stream check");
+
+	vtm_buf_release(&buf);
+	free(data);
+}
+
+static void test_inflate(vtm_deflate *df)
+{
+	int rc;
+	size_t i;
+	vtm_inflate *inf;
+	struct vtm_buf comp, out;
+
+	vtm_buf_init(&comp, VTM_BYTEORDER_LE);
+	vtm_buf_init(&out, VTM_BYTEORDER_LE);
+
+	/* two flushed messages of one raw stream */
+	vtm_deflate_begin(df, VTM_DEFLATE_FMT_RAW);
+	vtm_deflate_update(df, TEST_INPUT, strlen(TEST_INPUT), VTM_DEFLATE_FLUSH_SYNC, &comp);
+	vtm_deflate_update(df, TEST_INPUT, strlen(TEST_INPUT), VTM_DEFLATE_FLUSH_FINISH, &comp);
+
+	inf = vtm_inflate_new(VTM_DEFLATE_WINDOW_DEFAULT);
+	VTM_TEST_ASSERT(inf != NULL, "inflate new");
+
+	/* input split at every byte */
+	rc = VTM_OK;
+	for (i=0; i < comp.used && rc == VTM_OK; i++)
+		rc = vtm_inflate_update(inf, comp.data + i, 1, 2 * strlen(TEST_INPUT) - out.used, &out);
+	VTM_TEST_CHECK(rc == VTM_OK && out.used == 2 * strlen(TEST_INPUT) &&
+		memcmp(out.data, TEST_INPUT, strlen(TEST_INPUT)) == 0 &&
+		memcmp(out.data + strlen(TEST_INPUT), TEST_INPUT, strlen(TEST_INPUT)) == 0, "inflate stream");
+
+	vtm_buf_clear(&out);
+	rc = vtm_inflate_reset(inf);
+	VTM_TEST_CHECK(rc == VTM_OK, "inflate reset");
+	rc = vtm_inflate_update(inf, comp.data, comp.used, 10, &out);
+	VTM_TEST_CHECK(rc == VTM_E_MAX_REACHED, "inflate max");
+
+	vtm_buf_clear(&out);
+	vtm_inflate_reset(inf);
+	rc = vtm_inflate_update(inf, "\xff\xff\xff\xff", 4, 100, &out);
+	VTM_TEST_CHECK(rc == VTM_E_IO_PROTOCOL, "inflate invalid");
+
+	vtm_inflate_free(inf);
+	vtm_buf_release(&comp);
+	vtm_buf_release(&out);
+}
+
+extern void test_vtm_util_deflate(void)
+{
+	vtm_deflate *df;
+
+	VTM_TEST_LABEL("deflate");
+
+	df = vtm_deflate_new(VTM_DEFLATE_LEVEL_DEFAULT, VTM_DEFLATE_WINDOW_DEFAULT);
+	VTM_TEST_ASSERT(df != NULL, "deflate new");
+
+	test_deflate_formats(df);
+	test_deflate_stream(df);
+	test_inflate(df);
+
+	vtm_deflate_free(df);
+}
+
+#else
+
+extern void test_vtm_util_deflate(void)
+{
+	VTM_TEST_LABEL("deflate");
+	VTM_TEST_CHECK(vtm_deflate_new(VTM_DEFLATE_LEVEL_DEFAULT, VTM_DEFLATE_WINDOW_DEFAULT) == NULL, "deflate not supported");
+	VTM_TEST_CHECK(vtm_inflate_new(VTM_DEFLATE_WINDOW_DEFAULT) == NULL, "inflate not supported");
+}
+
+#endif